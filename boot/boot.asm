@@ -1,6 +1,6 @@
 ; ============================================================================
 ; MixOS Bootloader - boot/boot.asm
-; Минимальный Multiboot2 загрузчик для x86_64
+; Минимальный Multiboot2/PVH загрузчик для x86_64
 ; ============================================================================
 
 ; Константы Multiboot2
@@ -9,6 +9,10 @@ MULTIBOOT2_ARCHITECTURE    equ 0             ; 0 = i386 (32-bit protected mode)
 MULTIBOOT2_HEADER_LENGTH   equ (multiboot_header_end - multiboot_header_start)
 MULTIBOOT2_CHECKSUM        equ -(MULTIBOOT2_MAGIC + MULTIBOOT2_ARCHITECTURE + MULTIBOOT2_HEADER_LENGTH)
 
+; Вход PVH (qemu -kernel): точка входа - ELF-заметка Xen PHYS32_ENTRY
+XEN_ELFNOTE_PHYS32_ENTRY   equ 18
+PVH_START_MAGIC            equ 0x336ec578    ; hvm_start_info.magic, передаётся в EAX
+
 ; Константы для работы с памятью
 KERNEL_STACK_SIZE equ 16384  ; 16 KB стек для ядра
 
@@ -40,6 +44,126 @@ multiboot_header_start:
     dd 8                             ; size
 multiboot_header_end:
 
+; ============================================================================
+; РАЗДЕЛ: ELF-заметка PVH
+; QEMU (-kernel) и Xen находят по ней 32-битную точку входа без paging,
+; в EBX - адрес struct hvm_start_info. Так ядро грузится без GRUB.
+; ============================================================================
+section .note.Xen note alloc noexec nowrite align=4
+    dd 4                             ; namesz
+    dd 8                             ; descsz
+    dd XEN_ELFNOTE_PHYS32_ENTRY      ; type
+    db "Xen", 0                      ; name
+    dq pvh_start                     ; desc: физический адрес входа
+
+%ifdef LZ4_STUB
+; ============================================================================
+; РАЗДЕЛ: Заглушка сжатого ядра (make COMPRESS=1)
+; Ядро собрано как обычно, его образ от 1MB до конца .data упакован
+; tools/lz4pack в один LZ4-блок. Заглушка распаковывает блок по адресу
+; компоновки ядра и передаёт управление его _start с исходными EAX/EBX,
+; дальше загрузка идёт как без сжатия: проверки, paging и long_mode_start.
+; Место под ядро вместе с его BSS - пустой сегмент в linker_lz4.ld: GRUB
+; обнуляет его и не кладёт туда модули и Multiboot info.
+; ============================================================================
+LZ4_STUB_MAGIC   equ 0x5A4C584D      ; "MXLZ", заголовок tools/lz4pack.c
+KERNEL_LOAD_ADDR equ 0x100000        ; Адрес компоновки ядра (linker.ld)
+
+extern KERNEL_ENTRY                  ; _start ядра (--defsym в Makefile)
+
+section .bss
+align 16
+stack_bottom:
+    resb 4096                        ; Распаковщику хватает нескольких слов
+stack_top:
+
+section .rodata
+align 4
+kernel_payload:                      ; magic, raw_size, packed_size, блок
+    incbin KERNEL_PAYLOAD
+
+section .text
+bits 32
+
+global _start
+_start:
+    mov esp, stack_top
+    push eax                         ; Магическое число Multiboot2
+    push ebx                         ; Адрес структуры Multiboot info
+    cld
+
+    cmp dword [kernel_payload], LZ4_STUB_MAGIC
+    jne .bad_payload
+    mov esi, kernel_payload + 12     ; Начало LZ4-блока
+    mov edx, esi
+    add edx, [kernel_payload + 8]    ; Конец LZ4-блока
+    mov edi, KERNEL_LOAD_ADDR
+    call lz4_decompress
+
+    ; Блок должен дать ровно raw_size байт
+    sub edi, KERNEL_LOAD_ADDR
+    cmp edi, [kernel_payload + 4]
+    jne .bad_payload
+
+    pop ebx
+    pop eax
+    mov ecx, KERNEL_ENTRY
+    jmp ecx
+
+.bad_payload:
+    mov al, 'Z'
+    jmp error
+
+; ----------------------------------------------------------------------------
+; Распаковка LZ4-блока [ESI, EDX) в EDI; на выходе EDI - конец данных.
+; Блок собран вместе с ядром, поэтому проверяется только итоговый размер.
+; Литералы и совпадения копируются REP MOVSB: копирование идёт строго
+; вперёд, так что перекрывающееся совпадение (смещение меньше длины)
+; повторяет последние байты, как того требует формат.
+; ----------------------------------------------------------------------------
+lz4_decompress:
+.sequence:
+    movzx ebx, byte [esi]            ; Токен: литералы << 4 | совпадение
+    inc esi
+    mov ecx, ebx
+    shr ecx, 4
+    cmp ecx, 15
+    jne .literals
+.literal_length:                     ; 15 - длина продолжается байтами до не-255
+    movzx eax, byte [esi]
+    inc esi
+    add ecx, eax
+    cmp eax, 255
+    je .literal_length
+.literals:
+    rep movsb
+    cmp esi, edx                     ; Последняя последовательность - без совпадения
+    jae .done
+
+    movzx eax, word [esi]            ; Смещение назад
+    add esi, 2
+    mov ebp, edi
+    sub ebp, eax                     ; Источник совпадения
+    and ebx, 15
+    cmp ebx, 15
+    jne .match
+.match_length:
+    movzx eax, byte [esi]
+    inc esi
+    add ebx, eax
+    cmp eax, 255
+    je .match_length
+.match:
+    lea ecx, [ebx + 4]               ; Совпадение не короче 4 байт
+    xchg esi, ebp
+    rep movsb
+    xchg esi, ebp
+    cmp esi, edx
+    jb .sequence
+.done:
+    ret
+
+%else
 ; ============================================================================
 ; РАЗДЕЛ: BSS (неинициализированные данные)
 ; Здесь резервируем память под стек ядра
@@ -54,7 +178,7 @@ stack_top:
 align 4096
 pml4_table:     resb 4096            ; Page Map Level 4 (верхний уровень)
 pdp_table:      resb 4096            ; Page Directory Pointer Table
-pd_table:       resb 4096            ; Page Directory
+pd_table:       resb 4096 * 4        ; 4 Page Directory (по 1GB каждая)
 
 ; ============================================================================
 ; РАЗДЕЛ: Код загрузчика (32-bit protected mode)
@@ -98,7 +222,10 @@ _start:
 ; ----------------------------------------------------------------------------
 check_multiboot:
     cmp eax, 0x36d76289              ; Multiboot2 magic number
+    je .ok
+    cmp eax, PVH_START_MAGIC         ; Вход PVH (pvh_start)
     jne .no_multiboot
+.ok:
     ret
 .no_multiboot:
     mov al, 'M'
@@ -144,13 +271,16 @@ check_long_mode:
     jmp error
 
 ; ----------------------------------------------------------------------------
-; Настройка Page Tables для identity mapping первых 2MB
-; (виртуальные адреса = физическим адресам)
+; Настройка Page Tables для identity mapping первых 4GB страницами по 2MB
+; (виртуальные адреса = физическим адресам). Ядро обращается к любой
+; физической странице ниже 4GB напрямую, без временных отображений.
+; Отображение одинаково во всех адресных пространствах, поэтому страницы
+; глобальные: после включения CR4.PGE (tlb_init) смена CR3 их не сбрасывает.
 ; ----------------------------------------------------------------------------
 setup_page_tables:
     ; Обнуляем таблицы
     mov edi, pml4_table
-    mov ecx, 3 * 4096 / 4            ; 3 таблицы по 4KB
+    mov ecx, 6 * 4096 / 4            ; PML4 + PDP + 4 PD по 4KB
     xor eax, eax
     rep stosd
     
@@ -159,15 +289,27 @@ setup_page_tables:
     or eax, 0b11                     ; Present + Writable
     mov [pml4_table], eax
     
-    ; PDP[0] -> PD Table
+    ; PDP[0..3] -> PD Tables
     mov eax, pd_table
     or eax, 0b11
-    mov [pdp_table], eax
+    xor ecx, ecx
+.map_pdp:
+    mov [pdp_table + ecx * 8], eax
+    add eax, 4096
+    inc ecx
+    cmp ecx, 4
+    jne .map_pdp
     
-    ; PD[0] -> 2MB huge page (identity mapped)
-    mov eax, 0x0
-    or eax, 0b10000011               ; Present + Writable + Huge Page
-    mov [pd_table], eax
+    ; PD[0..2047] -> 2MB huge pages (identity mapped)
+    xor ecx, ecx
+.map_pd:
+    mov eax, 0x200000
+    mul ecx                          ; EAX = ECX * 2MB
+    or eax, 0b110000011              ; Present + Writable + Huge Page + Global
+    mov [pd_table + ecx * 8], eax
+    inc ecx
+    cmp ecx, 512 * 4
+    jne .map_pd
     
     ret
 
@@ -196,6 +338,16 @@ enable_paging:
     mov cr0, eax
     
     ret
+%endif
+
+; ----------------------------------------------------------------------------
+; Вход PVH: flat-сегменты, paging выключен, стека нет, в EBX -
+; hvm_start_info. Дальше загрузка идёт общим путём _start, а ядро
+; отличает PVH от Multiboot2 по магическому числу в EAX.
+; ----------------------------------------------------------------------------
+pvh_start:
+    mov eax, PVH_START_MAGIC
+    jmp _start
 
 ; ----------------------------------------------------------------------------
 ; Обработка критических ошибок
@@ -210,6 +362,7 @@ error:
     hlt
     jmp .hang
 
+%ifndef LZ4_STUB
 ; ============================================================================
 ; РАЗДЕЛ: GDT для Long Mode (64-bit)
 ; ============================================================================
@@ -237,9 +390,12 @@ long_mode_start:
     mov fs, ax
     mov gs, ax
     
-    ; Восстанавливаем Multiboot info из стека
-    pop rdi                          ; Магическое число
-    pop rsi                          ; Адрес Multiboot info структуры
+    ; Восстанавливаем Multiboot info из стека: в 32-битном режиме были
+    ; сохранены два dword, в 64-битном они читаются одним qword
+    pop rdi
+    mov rsi, rdi
+    shr rsi, 32                      ; Адрес Multiboot info структуры
+    mov edi, edi                     ; Магическое число
     
     ; Вызываем C функцию kernel_main(magic, multiboot_info)
     extern kernel_main
@@ -250,3 +406,4 @@ long_mode_start:
 .hang:
     hlt
     jmp .hang
+%endif
@@ -0,0 +1,91 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/acpi/acpi.c
+ * Поиск таблиц ACPI
+ * ============================================================================
+ */
+
+#include "acpi/acpi.h"
+#include "mm/pmm.h"
+#include "errno.h"
+
+#define ACPI_MAX_TABLES     32
+
+static const struct acpi_table_header* acpi_tables[ACPI_MAX_TABLES];
+static uint32_t acpi_nr_tables;
+
+static uint8_t acpi_checksum(const void* data, size_t len) {
+    const uint8_t* p = data;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+/* Таблица по физическому адресу, если она целиком в прямом отображении и цела */
+static const struct acpi_table_header* acpi_map_table(uint64_t phys) {
+    if (!phys || phys + sizeof(struct acpi_table_header) > PMM_DIRECT_MAP_LIMIT) {
+        return NULL;
+    }
+    const struct acpi_table_header* table = phys_to_virt(phys);
+    if (table->length < sizeof(*table) || phys + table->length > PMM_DIRECT_MAP_LIMIT ||
+        acpi_checksum(table, table->length) != 0) {
+        return NULL;
+    }
+    return table;
+}
+
+int acpi_init(const struct acpi_rsdp* rsdp) {
+    acpi_nr_tables = 0;
+    if (!rsdp || memcmp(rsdp->signature, ACPI_SIG_RSDP, 8) != 0 ||
+        acpi_checksum(rsdp, ACPI_RSDP_V1_SIZE) != 0) {
+        return -EINVAL;
+    }
+
+    /* XSDT (64-битные указатели) предпочтительнее RSDT */
+    const struct acpi_table_header* root = NULL;
+    size_t entry_size = 4;
+    if (rsdp->revision >= 2 && rsdp->length >= sizeof(*rsdp) &&
+        acpi_checksum(rsdp, rsdp->length) == 0) {
+        root = acpi_map_table(rsdp->xsdt_address);
+        if (root && memcmp(root->signature, ACPI_SIG_XSDT, 4) == 0) {
+            entry_size = 8;
+        } else {
+            root = NULL;
+        }
+    }
+    if (!root) {
+        root = acpi_map_table(rsdp->rsdt_address);
+        if (!root || memcmp(root->signature, ACPI_SIG_RSDT, 4) != 0) {
+            return -EINVAL;
+        }
+    }
+
+    const uint8_t* entries = (const uint8_t*)(root + 1);
+    size_t count = (root->length - sizeof(*root)) / entry_size;
+    for (size_t i = 0; i < count && acpi_nr_tables < ACPI_MAX_TABLES; i++) {
+        uint64_t phys;
+        if (entry_size == 8) {
+            memcpy(&phys, entries + i * 8, 8);
+        } else {
+            uint32_t phys32;
+            memcpy(&phys32, entries + i * 4, 4);
+            phys = phys32;
+        }
+        const struct acpi_table_header* table = acpi_map_table(phys);
+        if (table) {
+            acpi_tables[acpi_nr_tables++] = table;
+        }
+    }
+    return 0;
+}
+
+const struct acpi_table_header* acpi_find_table(const char* sig) {
+    for (uint32_t i = 0; i < acpi_nr_tables; i++) {
+        if (memcmp(acpi_tables[i]->signature, sig, 4) == 0) {
+            return acpi_tables[i];
+        }
+    }
+    return NULL;
+}
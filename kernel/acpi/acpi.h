@@ -0,0 +1,125 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/acpi/acpi.h
+ * Таблицы ACPI: поиск по RSDP/XSDT, форматы SRAT и SLIT
+ *
+ * Загрузчик Multiboot2 передаёт копию RSDP, по ней находятся остальные
+ * таблицы. Таблицы читаются через прямое отображение, поэтому таблицы
+ * выше 4 GiB пропускаются.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_ACPI_ACPI_H
+#define MIXOS_ACPI_ACPI_H
+
+#include "kernel.h"
+
+#define ACPI_SIG_RSDP       "RSD PTR "
+#define ACPI_SIG_RSDT       "RSDT"
+#define ACPI_SIG_XSDT       "XSDT"
+#define ACPI_SIG_SRAT       "SRAT"
+#define ACPI_SIG_SLIT       "SLIT"
+
+/* Root System Description Pointer */
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;               /* Сумма первых 20 байт */
+    char oem_id[6];
+    uint8_t revision;               /* 0 - ACPI 1.0, 2 - ACPI 2.0+ */
+    uint32_t rsdt_address;
+    /* ACPI 2.0+ */
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;      /* Сумма всей структуры */
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+#define ACPI_RSDP_V1_SIZE   20
+
+/* Общий заголовок таблиц */
+struct acpi_table_header {
+    char signature[4];
+    uint32_t length;                /* Вместе с заголовком */
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t asl_compiler_id;
+    uint32_t asl_compiler_revision;
+} __attribute__((packed));
+
+/* ============================================================================
+ * SRAT - System Resource Affinity Table
+ * ============================================================================ */
+
+struct acpi_table_srat {
+    struct acpi_table_header header;
+    uint32_t table_revision;        /* Должно быть 1 */
+    uint64_t reserved;
+} __attribute__((packed));
+
+struct acpi_subtable_header {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+#define ACPI_SRAT_TYPE_CPU_AFFINITY     0
+#define ACPI_SRAT_TYPE_MEMORY_AFFINITY  1
+#define ACPI_SRAT_TYPE_X2APIC_AFFINITY  2
+
+/* Флаги записей SRAT */
+#define ACPI_SRAT_ENABLED               (1U << 0)
+#define ACPI_SRAT_MEM_HOT_PLUGGABLE     (1U << 1)
+
+struct acpi_srat_cpu_affinity {
+    struct acpi_subtable_header header;
+    uint8_t proximity_domain_lo;
+    uint8_t apic_id;
+    uint32_t flags;
+    uint8_t local_sapic_eid;
+    uint8_t proximity_domain_hi[3]; /* Старшие байты домена (SRAT ревизии 2+) */
+    uint32_t clock_domain;
+} __attribute__((packed));
+
+struct acpi_srat_mem_affinity {
+    struct acpi_subtable_header header;
+    uint32_t proximity_domain;
+    uint16_t reserved;
+    uint64_t base_address;
+    uint64_t length;
+    uint32_t reserved1;
+    uint32_t flags;
+    uint64_t reserved2;
+} __attribute__((packed));
+
+struct acpi_srat_x2apic_cpu_affinity {
+    struct acpi_subtable_header header;
+    uint16_t reserved;
+    uint32_t proximity_domain;
+    uint32_t apic_id;
+    uint32_t flags;
+    uint32_t clock_domain;
+    uint32_t reserved2;
+} __attribute__((packed));
+
+/* ============================================================================
+ * SLIT - System Locality Information Table
+ * ============================================================================ */
+
+struct acpi_table_slit {
+    struct acpi_table_header header;
+    uint64_t locality_count;
+    uint8_t entry[0];               /* Матрица locality_count x locality_count */
+} __attribute__((packed));
+
+/* Разбор RSDT/XSDT по копии RSDP от загрузчика */
+int acpi_init(const struct acpi_rsdp* rsdp);
+
+/* Таблица с сигнатурой sig или NULL */
+const struct acpi_table_header* acpi_find_table(const char* sig);
+
+/* Узлы NUMA из SRAT и расстояния из SLIT (acpi/numa.c) */
+int acpi_numa_init(void);
+
+#endif /* MIXOS_ACPI_ACPI_H */
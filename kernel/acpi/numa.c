@@ -0,0 +1,130 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/acpi/numa.c
+ * Топология NUMA из таблиц SRAT и SLIT
+ *
+ * Домены близости (proximity domain) ACPI - произвольные 32-битные
+ * числа; узлы получают плотные номера в порядке появления в SRAT.
+ * ============================================================================
+ */
+
+#include "acpi/acpi.h"
+#include "mm/numa.h"
+#include "errno.h"
+
+static uint32_t node_to_pxm[MAX_NUMNODES];
+static uint32_t nr_pxm_nodes;
+
+/* Номер узла для домена близости, с выдачей нового при первой встрече */
+static int pxm_to_node(uint32_t pxm) {
+    for (uint32_t nid = 0; nid < nr_pxm_nodes; nid++) {
+        if (node_to_pxm[nid] == pxm) {
+            return (int)nid;
+        }
+    }
+    if (nr_pxm_nodes == MAX_NUMNODES) {
+        return -ENOSPC;
+    }
+    node_to_pxm[nr_pxm_nodes] = pxm;
+    return (int)nr_pxm_nodes++;
+}
+
+static int acpi_parse_srat_entry(const struct acpi_table_srat* srat,
+                                 const struct acpi_subtable_header* entry) {
+    switch (entry->type) {
+        case ACPI_SRAT_TYPE_CPU_AFFINITY: {
+            const struct acpi_srat_cpu_affinity* cpu = (const void*)entry;
+            if (entry->length < sizeof(*cpu) || !(cpu->flags & ACPI_SRAT_ENABLED)) {
+                return 0;
+            }
+            uint32_t pxm = cpu->proximity_domain_lo;
+            if (srat->header.revision >= 2) {
+                pxm |= (uint32_t)cpu->proximity_domain_hi[0] << 8 |
+                       (uint32_t)cpu->proximity_domain_hi[1] << 16 |
+                       (uint32_t)cpu->proximity_domain_hi[2] << 24;
+            }
+            int nid = pxm_to_node(pxm);
+            return nid < 0 ? nid : numa_add_cpu(cpu->apic_id, (uint32_t)nid);
+        }
+        case ACPI_SRAT_TYPE_X2APIC_AFFINITY: {
+            const struct acpi_srat_x2apic_cpu_affinity* cpu = (const void*)entry;
+            if (entry->length < sizeof(*cpu) || !(cpu->flags & ACPI_SRAT_ENABLED)) {
+                return 0;
+            }
+            int nid = pxm_to_node(cpu->proximity_domain);
+            return nid < 0 ? nid : numa_add_cpu(cpu->apic_id, (uint32_t)nid);
+        }
+        case ACPI_SRAT_TYPE_MEMORY_AFFINITY: {
+            const struct acpi_srat_mem_affinity* mem = (const void*)entry;
+            if (entry->length < sizeof(*mem) || !(mem->flags & ACPI_SRAT_ENABLED) ||
+                mem->length == 0) {
+                return 0;
+            }
+            int nid = pxm_to_node(mem->proximity_domain);
+            return nid < 0 ? nid : numa_add_memblk((uint32_t)nid, mem->base_address,
+                                                   mem->base_address + mem->length);
+        }
+        default:
+            return 0;
+    }
+}
+
+static int acpi_parse_srat(const struct acpi_table_srat* srat) {
+    const uint8_t* pos = (const uint8_t*)(srat + 1);
+    const uint8_t* end = (const uint8_t*)srat + srat->header.length;
+
+    if (srat->header.length < sizeof(*srat)) {
+        return -EINVAL;
+    }
+    while (pos + sizeof(struct acpi_subtable_header) <= end) {
+        const struct acpi_subtable_header* entry = (const void*)pos;
+        if (entry->length < sizeof(*entry) || pos + entry->length > end) {
+            return -EINVAL;
+        }
+        int err = acpi_parse_srat_entry(srat, entry);
+        if (err < 0) {
+            return err;
+        }
+        pos += entry->length;
+    }
+    return 0;
+}
+
+/* Расстояния между узлами: строки и столбцы SLIT - домены близости */
+static void acpi_parse_slit(const struct acpi_table_slit* slit) {
+    uint64_t count = slit->locality_count;
+    /* Матрица должна целиком лежать в таблице (длина таблицы - 32 бита) */
+    if (slit->header.length < sizeof(*slit) || count > 0xFFFF ||
+        count * count > slit->header.length - sizeof(*slit)) {
+        return;
+    }
+    for (uint32_t from = 0; from < nr_pxm_nodes; from++) {
+        for (uint32_t to = 0; to < nr_pxm_nodes; to++) {
+            uint64_t row = node_to_pxm[from];
+            uint64_t col = node_to_pxm[to];
+            if (row < count && col < count) {
+                numa_set_distance(from, to, slit->entry[row * count + col]);
+            }
+        }
+    }
+}
+
+int acpi_numa_init(void) {
+    const struct acpi_table_srat* srat = (const void*)acpi_find_table(ACPI_SIG_SRAT);
+    if (!srat) {
+        return -ENOENT;
+    }
+
+    nr_pxm_nodes = 0;
+    int err = acpi_parse_srat(srat);
+    if (err < 0) {
+        numa_reset();
+        return err;
+    }
+
+    const struct acpi_table_slit* slit = (const void*)acpi_find_table(ACPI_SIG_SLIT);
+    if (slit) {
+        acpi_parse_slit(slit);
+    }
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/bench.c
+ * Встроенные замеры производительности
+ * ============================================================================
+ */
+
+#include "bench.h"
+#include "cpu/tsc.h"
+#include "mm/pmm.h"
+#include "mm/mm.h"
+#include "mm/huge_mm.h"
+#include "mm/kmalloc.h"
+#include "lib/lz4.h"
+#include "proc/task.h"
+#include "errno.h"
+
+/* Повторов на каждый способ создания задачи */
+#define BENCH_FORK_ITERATIONS   20
+
+/* Размер памяти "большого" родителя */
+#define BENCH_BIG_RSS           (1ULL << 30)
+
+/* Время в микросекундах с одним знаком; без частоты TSC - в тактах */
+static void bench_print_time(uint64_t cycles) {
+    if (!tsc_khz) {
+        terminal_writedec(cycles);
+        terminal_writestring(" cycles");
+        return;
+    }
+    uint64_t ns = tsc_cycles_to_ns(cycles);
+    terminal_writedec(ns / 1000);
+    terminal_writestring(".");
+    terminal_writedec(ns % 1000 / 100);
+    terminal_writestring(" us");
+}
+
+static void bench_error(const char* what, int err) {
+    terminal_writestring("  bench: ");
+    terminal_writestring(what);
+    terminal_writestring(" failed, error -");
+    terminal_writedec((uint64_t)-err);
+    terminal_writestring("\n");
+}
+
+/* ============================================================================
+ * fork+exec
+ * ============================================================================ */
+
+enum bench_spawn_mode {
+    BENCH_FORK,
+    BENCH_VFORK,
+    BENCH_SPAWN,
+    BENCH_NR_MODES,
+};
+
+static const char* const bench_mode_names[BENCH_NR_MODES] = {
+    "fork+exec", "vfork+exec", "spawn",
+};
+
+/* Новая задача с программой prog и её завершение */
+static int bench_spawn_once(struct task* parent, enum bench_spawn_mode mode, const char* prog) {
+    const char* const argv[] = { prog, NULL };
+    const char* const envp[] = { NULL };
+    struct task* child;
+    int err;
+
+    if (mode == BENCH_SPAWN) {
+        err = task_spawn(parent, prog, argv, envp, &child);
+        if (err < 0) {
+            return err;
+        }
+    } else {
+        err = task_fork(parent, mode == BENCH_VFORK ? CLONE_VM | CLONE_VFORK : 0, &child);
+        if (err < 0) {
+            return err;
+        }
+        err = task_exec(child, prog, argv, envp);
+    }
+    task_exit(child, 0);
+    task_reap(child);
+    return err;
+}
+
+static int bench_fork_parent(const char* name, struct task* parent, const char* prog) {
+    terminal_writestring("  ");
+    terminal_writestring(name);
+    terminal_writestring(":");
+    for (int mode = 0; mode < BENCH_NR_MODES; mode++) {
+        uint64_t start = rdtsc();
+        for (int i = 0; i < BENCH_FORK_ITERATIONS; i++) {
+            int err = bench_spawn_once(parent, mode, prog);
+            if (err < 0) {
+                terminal_writestring("\n");
+                bench_error(bench_mode_names[mode], err);
+                return err;
+            }
+        }
+        terminal_writestring(mode ? ", " : " ");
+        terminal_writestring(bench_mode_names[mode]);
+        terminal_writestring(" ");
+        bench_print_time((rdtsc() - start) / BENCH_FORK_ITERATIONS);
+    }
+    terminal_writestring("\n");
+    return 0;
+}
+
+/* Родитель с BENCH_BIG_RSS байт анонимной памяти: страницами 4K или THP */
+static int bench_fork_big(struct task* parent, const char* prog, bool thp) {
+    if (pmm_free_pages() < BENCH_BIG_RSS / PAGE_SIZE * 5 / 4) {
+        terminal_writestring("  1 GiB parent: not enough memory (run with -m 2G)\n");
+        return -ENOMEM;
+    }
+
+    bool thp_saved = thp_enabled;
+    thp_enabled = thp;
+    int64_t addr = mmap_region(parent->mm, 0, BENCH_BIG_RSS, VM_READ | VM_WRITE, NULL, 0);
+    int err = addr < 0 ? (int)addr : 0;
+    for (uint64_t offset = 0; err == 0 && offset < BENCH_BIG_RSS; offset += PAGE_SIZE) {
+        err = handle_mm_fault(parent->mm, (uint64_t)addr + offset,
+                              FAULT_FLAG_WRITE | FAULT_FLAG_USER);
+    }
+    thp_enabled = thp_saved;
+
+    if (err == 0) {
+        err = bench_fork_parent(thp ? "1 GiB parent, THP" : "1 GiB parent, 4K pages",
+                                parent, prog);
+    } else {
+        bench_error("populating 1 GiB", err);
+    }
+    if (addr >= 0) {
+        do_munmap(parent->mm, (uint64_t)addr, BENCH_BIG_RSS);
+    }
+    return err;
+}
+
+static void bench_fork(const char* prog) {
+    const char* const argv[] = { prog, NULL };
+    const char* const envp[] = { NULL };
+
+    terminal_writestring("[BENCH] fork/vfork/spawn + exec ");
+    terminal_writestring(prog);
+    terminal_writestring("\n");
+
+    /* Родитель - сама программа: адресное пространство как у процесса */
+    struct task* parent;
+    int err = task_spawn(current, prog, argv, envp, &parent);
+    if (err < 0) {
+        bench_error("spawning the parent", err);
+        return;
+    }
+    /* THP первым: снятие отображения оставляет таблицы PTE, и в том же
+     * диапазоне большие страницы уже не появились бы */
+    if (bench_fork_parent("small parent", parent, prog) == 0 &&
+        bench_fork_big(parent, prog, true) == 0) {
+        bench_fork_big(parent, prog, false);
+    }
+    task_exit(parent, 0);
+    task_reap(parent);
+}
+
+/* ============================================================================
+ * LZ4: блоки и поток
+ * ============================================================================ */
+
+/* Данные - образ ядра (код и данные, без BSS) блоками как у страниц */
+#define BENCH_LZ4_BLOCK         PAGE_SIZE
+
+/* Кольцевые буферы потока: 64 KiB истории и место под следующий блок */
+#define BENCH_LZ4_RING          (LZ4_DICT_SIZE + BENCH_LZ4_BLOCK)
+
+/* Сколько данных прогоняется через каждый замер */
+#define BENCH_LZ4_BYTES         (64ULL << 20)
+
+extern uint8_t __kernel_start[];
+extern uint8_t __bss_start[];
+
+struct bench_lz4 {
+    const uint8_t* src;
+    size_t size;
+    size_t nr_blocks;
+    uint8_t* packed;                /* Сжатые блоки подряд */
+    uint32_t* packed_size;
+    uint8_t ring[BENCH_LZ4_RING];   /* Вход сжатия потока */
+    uint8_t out[BENCH_LZ4_RING];    /* Выход распаковки потока */
+    uint8_t wrkmem[LZ4_MEM_COMPRESS];
+    struct lz4_stream stream;
+    struct lz4_stream_decode decode;
+};
+
+/* Скорость в MB/s; без частоты TSC - в тактах на KiB */
+static void bench_print_rate(uint64_t bytes, uint64_t cycles) {
+    if (!tsc_khz) {
+        terminal_writedec(cycles * 1024 / bytes);
+        terminal_writestring(" cycles/KiB");
+        return;
+    }
+    terminal_writedec(bytes * tsc_khz / (cycles ? cycles : 1) / 1000);
+    terminal_writestring(" MB/s");
+}
+
+/* Степень сжатия с тремя знаками */
+static void bench_print_ratio(uint64_t packed, uint64_t raw) {
+    uint64_t ratio = packed * 1000 / raw;
+    terminal_writedec(ratio / 1000);
+    terminal_writestring(".");
+    terminal_writedec(ratio / 100 % 10);
+    terminal_writedec(ratio / 10 % 10);
+    terminal_writedec(ratio % 10);
+}
+
+/* Позиция очередного блока в кольцевом буфере */
+static size_t bench_lz4_ring_pos(size_t pos, size_t len) {
+    return pos + len > BENCH_LZ4_RING ? 0 : pos;
+}
+
+/* Один проход сжатия образа; возвращает суммарный размер или 0 */
+static size_t bench_lz4_compress(struct bench_lz4* b, bool stream) {
+    size_t total = 0;
+    size_t pos = 0;
+
+    lz4_stream_init(&b->stream);
+    for (size_t i = 0; i < b->nr_blocks; i++) {
+        size_t offset = i * BENCH_LZ4_BLOCK;
+        size_t len = MIN(BENCH_LZ4_BLOCK, b->size - offset);
+        size_t packed;
+        if (stream) {
+            pos = bench_lz4_ring_pos(pos, len);
+            memcpy(b->ring + pos, b->src + offset, len);
+            packed = lz4_compress_continue(&b->stream, b->ring + pos, len, b->packed + total,
+                                           LZ4_COMPRESS_BOUND(len));
+            pos += len;
+        } else {
+            packed = lz4_compress(b->src + offset, len, b->packed + total,
+                                  LZ4_COMPRESS_BOUND(len), b->wrkmem);
+        }
+        if (!packed) {
+            return 0;
+        }
+        b->packed_size[i] = (uint32_t)packed;
+        total += packed;
+    }
+    return total;
+}
+
+/* Один проход распаковки; verify - сверить с образом */
+static int bench_lz4_decompress(struct bench_lz4* b, bool stream, bool verify) {
+    const uint8_t* packed = b->packed;
+    size_t pos = 0;
+
+    lz4_stream_decode_init(&b->decode, NULL, 0);
+    for (size_t i = 0; i < b->nr_blocks; i++) {
+        size_t offset = i * BENCH_LZ4_BLOCK;
+        size_t len = MIN(BENCH_LZ4_BLOCK, b->size - offset);
+        int64_t ret;
+        pos = bench_lz4_ring_pos(pos, len);
+        if (stream) {
+            ret = lz4_decompress_continue(&b->decode, packed, b->packed_size[i],
+                                          b->out + pos, len);
+        } else {
+            ret = lz4_decompress(packed, b->packed_size[i], b->out + pos, len);
+        }
+        if (ret != (int64_t)len || (verify && memcmp(b->out + pos, b->src + offset, len))) {
+            return -EIO;
+        }
+        packed += b->packed_size[i];
+        pos += len;
+    }
+    return 0;
+}
+
+static void bench_lz4_mode(struct bench_lz4* b, bool stream) {
+    size_t packed = bench_lz4_compress(b, stream);
+    if (!packed) {
+        bench_error("compression", -ENOSPC);
+        return;
+    }
+    int err = bench_lz4_decompress(b, stream, true);
+    if (err < 0) {
+        bench_error("round trip", err);
+        return;
+    }
+
+    uint64_t passes = BENCH_LZ4_BYTES / b->size + 1;
+    uint64_t start = rdtsc();
+    for (uint64_t i = 0; i < passes; i++) {
+        bench_lz4_compress(b, stream);
+    }
+    uint64_t compress = rdtsc() - start;
+    start = rdtsc();
+    for (uint64_t i = 0; i < passes; i++) {
+        bench_lz4_decompress(b, stream, false);
+    }
+    uint64_t decompress = rdtsc() - start;
+
+    terminal_writestring(stream ? "  stream: ratio " : "  block:  ratio ");
+    bench_print_ratio(packed, b->size);
+    terminal_writestring(", compress ");
+    bench_print_rate(passes * b->size, compress);
+    terminal_writestring(", decompress ");
+    bench_print_rate(passes * b->size, decompress);
+    terminal_writestring("\n");
+}
+
+static void bench_lz4(void) {
+    struct bench_lz4* b = kzalloc(sizeof(*b));
+    if (!b) {
+        bench_error("allocation", -ENOMEM);
+        return;
+    }
+    b->src = __kernel_start;
+    b->size = (size_t)(__bss_start - __kernel_start);
+    b->nr_blocks = DIV_ROUND_UP(b->size, BENCH_LZ4_BLOCK);
+    b->packed = kmalloc(LZ4_COMPRESS_BOUND(BENCH_LZ4_BLOCK) * b->nr_blocks);
+    b->packed_size = kmalloc(b->nr_blocks * sizeof(uint32_t));
+
+    if (b->packed && b->packed_size) {
+        terminal_writestring("[BENCH] LZ4, kernel image ");
+        terminal_writedec(b->size / 1024);
+        terminal_writestring(" KiB in 4 KiB blocks\n");
+        bench_lz4_mode(b, false);
+        bench_lz4_mode(b, true);
+    } else {
+        bench_error("allocation", -ENOMEM);
+    }
+    kfree(b->packed_size);
+    kfree(b->packed);
+    kfree(b);
+}
+
+/* ============================================================================
+ * Запуск
+ * ============================================================================ */
+
+static bool bench_is(const char* name, size_t len, const char* what) {
+    return strlen(what) == len && strncmp(name, what, len) == 0;
+}
+
+void bench_run(const char* list, const char* prog) {
+    if (!tsc_khz) {
+        terminal_writestring("  bench: TSC frequency unknown, reporting cycles\n");
+    }
+    for (const char* p = list; *p; ) {
+        const char* end = p;
+        while (*end && *end != ',') {
+            end++;
+        }
+        size_t len = (size_t)(end - p);
+
+        if (bench_is(p, len, "fork")) {
+            bench_fork(prog);
+        } else if (bench_is(p, len, "lz4")) {
+            bench_lz4();
+        } else if (len) {
+            terminal_writestring("  bench: unknown benchmark ");
+            terminal_write(p, len);
+            terminal_writestring("\n");
+        }
+        p = *end ? end + 1 : end;
+    }
+}
@@ -0,0 +1,31 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/bench.h
+ * Встроенные замеры производительности
+ *
+ * Запускаются при загрузке параметром bench= (имена через запятую),
+ * удобнее всего через make bench: ядро грузится напрямую в QEMU с
+ * образом корневой ФС, где лежит программа для замеров fork+exec.
+ * Время считается по TSC (cpu/tsc.h), результаты выводятся на терминал.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_BENCH_H
+#define MIXOS_BENCH_H
+
+#include "kernel.h"
+
+/* Программа для fork+exec по умолчанию (параметр benchprog=) */
+#define BENCH_DEFAULT_PROG  "/bin/true"
+
+/*
+ * Замеры из списка list ("fork,lz4"):
+ *   fork - fork+exec, vfork+exec и spawn программы prog из родителя
+ *          без памяти и из родителя с 1 GiB (страницы 4K и THP)
+ *   lz4  - скорость сжатия и распаковки образа ядра блоками по 4 KiB,
+ *          по отдельности и потоком через кольцевой буфер
+ *          (то же на хосте: lz4pack -b файл)
+ */
+void bench_run(const char* list, const char* prog);
+
+#endif /* MIXOS_BENCH_H */
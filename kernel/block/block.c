@@ -0,0 +1,177 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/block/block.c
+ * Блочный уровень: реестр устройств и кеш блоков поверх page cache
+ * ============================================================================
+ */
+
+#include "block/block.h"
+#include "errno.h"
+
+static struct list_head block_devices = LIST_HEAD_INIT(block_devices);
+
+/* ============================================================================
+ * Кеш устройства: страница с индексом N содержит секторы [N*8, N*8+8)
+ * ============================================================================ */
+
+/* Число секторов устройства, попадающих в страницу (последняя может быть неполной) */
+static uint32_t bdev_page_sectors(struct block_device* bdev, uint64_t index) {
+    uint64_t first = index * SECTORS_PER_PAGE;
+    if (first >= bdev->nr_sectors) {
+        return 0;
+    }
+    return (uint32_t)MIN((uint64_t)SECTORS_PER_PAGE, bdev->nr_sectors - first);
+}
+
+static int bdev_readpage(struct address_space* mapping, struct page* page) {
+    struct block_device* bdev = mapping->host;
+    uint32_t count = bdev_page_sectors(bdev, page->index);
+    uint8_t* data = page_address(page);
+
+    if (count < SECTORS_PER_PAGE) {
+        memset(data + count * SECTOR_SIZE, 0, (SECTORS_PER_PAGE - count) * SECTOR_SIZE);
+    }
+    if (count == 0) {
+        return 0;
+    }
+    return block_read(bdev, page->index * SECTORS_PER_PAGE, count, data);
+}
+
+/* Записываются только непрерывные серии грязных секторов страницы */
+static int bdev_writepage(struct address_space* mapping, struct page* page) {
+    struct block_device* bdev = mapping->host;
+    uint32_t count = bdev_page_sectors(bdev, page->index);
+    uint64_t dirty = page->private;
+    uint8_t* data = page_address(page);
+
+    page->private = 0;
+    for (uint32_t first = 0; first < count; first++) {
+        if (!(dirty & (1UL << first))) {
+            continue;
+        }
+        uint32_t last = first;
+        while (last + 1 < count && (dirty & (1UL << (last + 1)))) {
+            last++;
+        }
+        int err = block_write(bdev, page->index * SECTORS_PER_PAGE + first,
+                              last - first + 1, data + first * SECTOR_SIZE);
+        if (err < 0) {
+            return err;
+        }
+        first = last;
+    }
+    return 0;
+}
+
+static const struct address_space_ops bdev_aops = {
+    .readpage = bdev_readpage,
+    .writepage = bdev_writepage,
+};
+
+/* ============================================================================
+ * Реестр устройств
+ * ============================================================================ */
+
+void block_register(struct block_device* bdev) {
+    address_space_init(&bdev->mapping, &bdev_aops, bdev);
+    list_add_tail(&bdev->list, &block_devices);
+
+    terminal_writestring("  Block device ");
+    terminal_writestring(bdev->name);
+    terminal_writestring(": ");
+    terminal_writedec(bdev->nr_sectors * SECTOR_SIZE / 1024);
+    terminal_writestring(" KiB\n");
+}
+
+struct block_device* block_find(const char* name) {
+    struct list_head* pos;
+    list_for_each(pos, &block_devices) {
+        struct block_device* bdev = list_entry(pos, struct block_device, list);
+        if (strcmp(bdev->name, name) == 0) {
+            return bdev;
+        }
+    }
+    return NULL;
+}
+
+int block_read(struct block_device* bdev, uint64_t sector, uint32_t count, void* buffer) {
+    if (sector + count > bdev->nr_sectors) {
+        return -EIO;
+    }
+    return bdev->ops->read(bdev, sector, count, buffer);
+}
+
+int block_write(struct block_device* bdev, uint64_t sector, uint32_t count, const void* buffer) {
+    if (sector + count > bdev->nr_sectors) {
+        return -EIO;
+    }
+    return bdev->ops->write(bdev, sector, count, buffer);
+}
+
+int block_flush(struct block_device* bdev) {
+    return bdev->ops->flush ? bdev->ops->flush(bdev) : 0;
+}
+
+int block_discard(struct block_device* bdev, uint64_t sector, uint32_t count) {
+    if (sector + count > bdev->nr_sectors) {
+        return -EIO;
+    }
+    return bdev->ops->discard ? bdev->ops->discard(bdev, sector, count) : 0;
+}
+
+/* ============================================================================
+ * Доступ к блокам файловой системы
+ * ============================================================================ */
+
+int bread(struct block_device* bdev, uint64_t block, uint32_t size, struct buffer* buf) {
+    uint64_t offset = block * size;
+    struct page* page;
+
+    int err = read_cache_page(&bdev->mapping, offset >> PAGE_SHIFT, &page);
+    if (err < 0) {
+        return err;
+    }
+    buf->bdev = bdev;
+    buf->page = page;
+    buf->data = (uint8_t*)page_address(page) + (offset & (PAGE_SIZE - 1));
+    buf->block = block;
+    buf->size = size;
+    return 0;
+}
+
+/* Маска секторов страницы, занятых блоком */
+static uint64_t buffer_sector_mask(uint64_t block, uint32_t size) {
+    uint64_t offset = (block * size) & (PAGE_SIZE - 1);
+    uint32_t first = (uint32_t)(offset >> SECTOR_SHIFT);
+    uint32_t count = size >> SECTOR_SHIFT;
+    return ((1UL << count) - 1) << first;
+}
+
+void mark_buffer_dirty(struct buffer* buf) {
+    buf->page->private |= buffer_sector_mask(buf->block, buf->size);
+    set_page_dirty(buf->page);
+}
+
+void brelse(struct buffer* buf) {
+    if (buf->page) {
+        page_cache_release(buf->page);
+        buf->page = NULL;
+        buf->data = NULL;
+    }
+}
+
+void bforget(struct block_device* bdev, uint64_t block, uint32_t size) {
+    struct page* page = find_get_page(&bdev->mapping, (block * size) >> PAGE_SHIFT);
+    if (page) {
+        page->private &= ~buffer_sector_mask(block, size);
+        page_cache_release(page);
+    }
+}
+
+int bdev_sync(struct block_device* bdev) {
+    int err = sync_mapping(&bdev->mapping);
+    if (err < 0) {
+        return err;
+    }
+    return block_flush(bdev);
+}
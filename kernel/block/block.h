@@ -0,0 +1,74 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/block/block.h
+ * Блочный уровень: регистрация устройств и кеш их блоков
+ * ============================================================================
+ */
+
+#ifndef MIXOS_BLOCK_BLOCK_H
+#define MIXOS_BLOCK_BLOCK_H
+
+#include "kernel.h"
+#include "lib/list.h"
+#include "mm/page_cache.h"
+
+#define SECTOR_SHIFT        9
+#define SECTOR_SIZE         (1U << SECTOR_SHIFT)
+#define SECTORS_PER_PAGE    (PAGE_SIZE / SECTOR_SIZE)
+
+struct block_device;
+
+/* Операции драйвера устройства (смещения и длины в секторах по 512 байт) */
+struct block_device_ops {
+    int (*read)(struct block_device* bdev, uint64_t sector, uint32_t count, void* buffer);
+    int (*write)(struct block_device* bdev, uint64_t sector, uint32_t count, const void* buffer);
+    int (*flush)(struct block_device* bdev);
+    /* Данные секторов больше не нужны (необязательно) */
+    int (*discard)(struct block_device* bdev, uint64_t sector, uint32_t count);
+};
+
+struct block_device {
+    char name[16];
+    uint64_t nr_sectors;
+    const struct block_device_ops* ops;
+    void* private;
+    struct address_space mapping;   /* Кеш блоков устройства (метаданные ФС) */
+    struct list_head list;
+};
+
+void block_register(struct block_device* bdev);
+struct block_device* block_find(const char* name);
+
+int block_read(struct block_device* bdev, uint64_t sector, uint32_t count, void* buffer);
+int block_write(struct block_device* bdev, uint64_t sector, uint32_t count, const void* buffer);
+int block_flush(struct block_device* bdev);
+int block_discard(struct block_device* bdev, uint64_t sector, uint32_t count);
+
+/*
+ * Буфер: блок размера size (<= PAGE_SIZE) в кеше устройства. Грязными
+ * помечаются отдельные секторы страницы (маска в page->private), поэтому
+ * запись страницы не затрагивает соседние блоки, принадлежащие данным
+ * файлов, которые пишутся в обход кеша устройства.
+ */
+struct buffer {
+    struct block_device* bdev;
+    struct page* page;
+    void* data;
+    uint64_t block;
+    uint32_t size;
+};
+
+int bread(struct block_device* bdev, uint64_t block, uint32_t size, struct buffer* buf);
+void mark_buffer_dirty(struct buffer* buf);
+void brelse(struct buffer* buf);
+
+/* Блок освобождён: отменить его отложенную запись из кеша устройства */
+void bforget(struct block_device* bdev, uint64_t block, uint32_t size);
+
+/* Запись грязных блоков устройства и сброс его кеша записи */
+int bdev_sync(struct block_device* bdev);
+
+/* Ramdisk поверх области физической памяти (модуль загрузчика) */
+struct block_device* ramdisk_create(const char* name, void* base, uint64_t size);
+
+#endif /* MIXOS_BLOCK_BLOCK_H */
@@ -0,0 +1,45 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/block/ramdisk.c
+ * Ramdisk: блочное устройство поверх образа диска в памяти
+ * (образ передаётся загрузчиком как Multiboot2 модуль)
+ * ============================================================================
+ */
+
+#include "block/block.h"
+#include "mm/kmalloc.h"
+
+static int ramdisk_read(struct block_device* bdev, uint64_t sector,
+                        uint32_t count, void* buffer) {
+    uint8_t* base = bdev->private;
+    memcpy(buffer, base + sector * SECTOR_SIZE, (size_t)count * SECTOR_SIZE);
+    return 0;
+}
+
+static int ramdisk_write(struct block_device* bdev, uint64_t sector,
+                         uint32_t count, const void* buffer) {
+    uint8_t* base = bdev->private;
+    memcpy(base + sector * SECTOR_SIZE, buffer, (size_t)count * SECTOR_SIZE);
+    return 0;
+}
+
+static const struct block_device_ops ramdisk_ops = {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+};
+
+struct block_device* ramdisk_create(const char* name, void* base, uint64_t size) {
+    struct block_device* bdev = kzalloc(sizeof(*bdev));
+    if (!bdev) {
+        return NULL;
+    }
+
+    size_t len = MIN(strlen(name), sizeof(bdev->name) - 1);
+    memcpy(bdev->name, name, len);
+    bdev->nr_sectors = size / SECTOR_SIZE;
+    bdev->ops = &ramdisk_ops;
+    bdev->private = base;
+
+    block_register(bdev);
+    return bdev;
+}
@@ -0,0 +1,273 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/block/zram.c
+ * zram: сжатое блочное устройство в памяти
+ * ============================================================================
+ */
+
+#include "block/zram.h"
+#include "cpu/cpu.h"
+#include "lib/lz4.h"
+#include "mm/kmalloc.h"
+#include "mm/zsmalloc.h"
+#include "errno.h"
+
+/* Флаги слота */
+#define ZRAM_SAME           (1U << 0)   /* handle - значение, которым заполнена страница */
+#define ZRAM_HUGE           (1U << 1)   /* Данные хранятся без сжатия */
+
+/* Слот страницы: пуст, если нет ни данных, ни ZRAM_SAME */
+struct zram_slot {
+    uint64_t handle;
+    uint32_t size;
+    uint32_t flags;
+};
+
+struct zram {
+    struct block_device bdev;
+    uint64_t nr_pages;
+    struct zram_slot* table;
+    struct zs_pool* pool;
+    void* wrkmem;                   /* Рабочая память LZ4 */
+    uint8_t* compress_buf;          /* Результат сжатия до копирования в zsmalloc */
+    uint8_t* page_buf;              /* Страница для записи и чтения части страницы */
+    struct zram_stats stats;
+};
+
+static inline struct zram* bdev_zram(struct block_device* bdev) {
+    return container_of(bdev, struct zram, bdev);
+}
+
+static inline bool zram_slot_empty(const struct zram_slot* slot) {
+    return !slot->handle && !(slot->flags & ZRAM_SAME);
+}
+
+/* Страница заполнена одним 64-битным значением */
+static bool page_same_filled(const void* data, uint64_t* value) {
+    const uint64_t* words = data;
+    uint64_t first = words[0];
+    for (size_t i = 1; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (words[i] != first) {
+            return false;
+        }
+    }
+    *value = first;
+    return true;
+}
+
+static void zram_free_slot(struct zram* zram, uint64_t index) {
+    struct zram_slot* slot = &zram->table[index];
+
+    if (zram_slot_empty(slot)) {
+        return;
+    }
+    if (slot->flags & ZRAM_SAME) {
+        zram->stats.same_pages--;
+    } else {
+        zs_free(zram->pool, slot->handle);
+        zram->stats.compr_data_size -= slot->size;
+        if (slot->flags & ZRAM_HUGE) {
+            zram->stats.huge_pages--;
+        }
+    }
+    zram->stats.pages_stored--;
+    slot->handle = 0;
+    slot->size = 0;
+    slot->flags = 0;
+}
+
+static int zram_read_page(struct zram* zram, uint64_t index, void* dst) {
+    struct zram_slot* slot = &zram->table[index];
+    uint64_t start = rdtsc();
+
+    zram->stats.num_reads++;
+    if (slot->flags & ZRAM_SAME) {
+        uint64_t* words = dst;
+        for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+            words[i] = slot->handle;
+        }
+        return 0;
+    }
+    if (!slot->handle) {
+        memset(dst, 0, PAGE_SIZE);
+        return 0;
+    }
+    const void* src = zs_map_object(slot->handle);
+    if (slot->flags & ZRAM_HUGE) {
+        memcpy(dst, src, PAGE_SIZE);
+        return 0;
+    }
+    int64_t len = lz4_decompress(src, slot->size, dst, PAGE_SIZE);
+    zram->stats.decompress_cycles += rdtsc() - start;
+    return len == PAGE_SIZE ? 0 : -EIO;
+}
+
+static int zram_write_page(struct zram* zram, uint64_t index, const void* src) {
+    struct zram_slot* slot = &zram->table[index];
+    uint64_t start = rdtsc();
+    uint64_t value;
+
+    zram->stats.num_writes++;
+    if (page_same_filled(src, &value)) {
+        zram_free_slot(zram, index);
+        slot->handle = value;
+        slot->flags = ZRAM_SAME;
+        zram->stats.same_pages++;
+        zram->stats.pages_stored++;
+        zram->stats.compress_cycles += rdtsc() - start;
+        return 0;
+    }
+
+    uint32_t flags = 0;
+    const void* data = zram->compress_buf;
+    size_t len = lz4_compress(src, PAGE_SIZE, zram->compress_buf, ZRAM_HUGE_SIZE,
+                              zram->wrkmem);
+    if (len == 0) {
+        /* Не сжимается: хранение как есть дешевле распаковки */
+        data = src;
+        len = PAGE_SIZE;
+        flags = ZRAM_HUGE;
+    }
+    zram->stats.compress_cycles += rdtsc() - start;
+
+    /* Прежние данные слота остаются, пока новые не размещены */
+    uint64_t handle = zs_malloc(zram->pool, len);
+    if (!handle) {
+        zram->stats.failed_writes++;
+        return -ENOMEM;
+    }
+    memcpy(zs_map_object(handle), data, len);
+
+    zram_free_slot(zram, index);
+    slot->handle = handle;
+    slot->size = (uint32_t)len;
+    slot->flags = flags;
+    zram->stats.pages_stored++;
+    zram->stats.compr_data_size += len;
+    if (flags & ZRAM_HUGE) {
+        zram->stats.huge_pages++;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Операции блочного устройства
+ * ============================================================================ */
+
+static int zram_read(struct block_device* bdev, uint64_t sector, uint32_t count,
+                     void* buffer) {
+    struct zram* zram = bdev_zram(bdev);
+    uint8_t* out = buffer;
+
+    while (count > 0) {
+        uint64_t index = sector / SECTORS_PER_PAGE;
+        uint32_t first = sector % SECTORS_PER_PAGE;
+        uint32_t n = MIN(count, (uint32_t)SECTORS_PER_PAGE - first);
+        int err;
+
+        if (n == SECTORS_PER_PAGE) {
+            err = zram_read_page(zram, index, out);
+        } else {
+            err = zram_read_page(zram, index, zram->page_buf);
+            memcpy(out, zram->page_buf + first * SECTOR_SIZE, n * SECTOR_SIZE);
+        }
+        if (err < 0) {
+            return err;
+        }
+        out += n * SECTOR_SIZE;
+        sector += n;
+        count -= n;
+    }
+    return 0;
+}
+
+static int zram_write(struct block_device* bdev, uint64_t sector, uint32_t count,
+                      const void* buffer) {
+    struct zram* zram = bdev_zram(bdev);
+    const uint8_t* in = buffer;
+
+    while (count > 0) {
+        uint64_t index = sector / SECTORS_PER_PAGE;
+        uint32_t first = sector % SECTORS_PER_PAGE;
+        uint32_t n = MIN(count, (uint32_t)SECTORS_PER_PAGE - first);
+        int err;
+
+        if (n == SECTORS_PER_PAGE) {
+            err = zram_write_page(zram, index, in);
+        } else {
+            /* Часть страницы: чтение, изменение и повторное сжатие */
+            err = zram_read_page(zram, index, zram->page_buf);
+            if (err == 0) {
+                memcpy(zram->page_buf + first * SECTOR_SIZE, in, n * SECTOR_SIZE);
+                err = zram_write_page(zram, index, zram->page_buf);
+            }
+        }
+        if (err < 0) {
+            return err;
+        }
+        in += n * SECTOR_SIZE;
+        sector += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/* Освобождаются только страницы, покрытые диапазоном целиком */
+static int zram_discard(struct block_device* bdev, uint64_t sector, uint32_t count) {
+    struct zram* zram = bdev_zram(bdev);
+    uint64_t first = DIV_ROUND_UP(sector, SECTORS_PER_PAGE);
+    uint64_t end = (sector + count) / SECTORS_PER_PAGE;
+
+    for (uint64_t index = first; index < end; index++) {
+        zram_free_slot(zram, index);
+    }
+    return 0;
+}
+
+static const struct block_device_ops zram_ops = {
+    .read = zram_read,
+    .write = zram_write,
+    .discard = zram_discard,
+};
+
+struct block_device* zram_create(const char* name, uint64_t disksize) {
+    struct zram* zram = kzalloc(sizeof(*zram));
+    if (!zram) {
+        return NULL;
+    }
+
+    zram->nr_pages = disksize / PAGE_SIZE;
+    zram->table = kzalloc(zram->nr_pages * sizeof(struct zram_slot));
+    zram->pool = zs_create_pool();
+    zram->wrkmem = kmalloc(LZ4_MEM_COMPRESS);
+    zram->compress_buf = kmalloc(ZRAM_HUGE_SIZE);
+    zram->page_buf = kmalloc(PAGE_SIZE);
+    if (!zram->nr_pages || !zram->table || !zram->pool || !zram->wrkmem ||
+        !zram->compress_buf || !zram->page_buf) {
+        kfree(zram->table);
+        if (zram->pool) {
+            zs_destroy_pool(zram->pool);
+        }
+        kfree(zram->wrkmem);
+        kfree(zram->compress_buf);
+        kfree(zram->page_buf);
+        kfree(zram);
+        return NULL;
+    }
+
+    struct block_device* bdev = &zram->bdev;
+    size_t len = MIN(strlen(name), sizeof(bdev->name) - 1);
+    memcpy(bdev->name, name, len);
+    bdev->nr_sectors = zram->nr_pages * SECTORS_PER_PAGE;
+    bdev->ops = &zram_ops;
+    bdev->private = zram;
+
+    block_register(bdev);
+    return bdev;
+}
+
+void zram_get_stats(struct block_device* bdev, struct zram_stats* stats) {
+    struct zram* zram = bdev_zram(bdev);
+    *stats = zram->stats;
+    stats->mem_used_pages = zram->pool->pages_allocated;
+}
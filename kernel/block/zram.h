@@ -0,0 +1,40 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/block/zram.h
+ * zram: блочное устройство со сжатием в оперативной памяти
+ *
+ * Каждая страница устройства хранится сжатой LZ4 в zsmalloc. Страница,
+ * заполненная одним 64-битным значением (чаще всего нулями), хранится
+ * без данных - только значением в своём слоте; несжимаемая - как есть.
+ * Устройство служит swap для анонимной памяти (mm/swap.h): освобождённые
+ * слоты swap снимаются через discard.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_BLOCK_ZRAM_H
+#define MIXOS_BLOCK_ZRAM_H
+
+#include "block/block.h"
+
+/* Сжатые данные больше этого порога хранятся без сжатия */
+#define ZRAM_HUGE_SIZE      (PAGE_SIZE / 4 * 3)
+
+struct zram_stats {
+    uint64_t pages_stored;          /* Занятых страниц устройства */
+    uint64_t same_pages;            /* Из них заполненных одним значением */
+    uint64_t huge_pages;            /* Из них несжимаемых */
+    uint64_t compr_data_size;       /* Байт сжатых данных */
+    uint64_t mem_used_pages;        /* Страниц памяти под сжатые данные */
+    uint64_t num_reads;
+    uint64_t num_writes;
+    uint64_t failed_writes;         /* Нет памяти под сжатые данные */
+    uint64_t compress_cycles;       /* Тактов на сжатие (вместе с поиском одного значения) */
+    uint64_t decompress_cycles;
+};
+
+/* Устройство на disksize байт (округляется вниз до страницы) */
+struct block_device* zram_create(const char* name, uint64_t disksize);
+
+void zram_get_stats(struct block_device* bdev, struct zram_stats* stats);
+
+#endif /* MIXOS_BLOCK_ZRAM_H */
@@ -0,0 +1,32 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/cpu/cpu.c
+ * Определение возможностей процессора
+ * ============================================================================
+ */
+
+#include "cpu/cpu.h"
+
+struct cpuinfo boot_cpu;
+
+void cpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid_count(0, 0, &eax, &ebx, &ecx, &edx);
+    boot_cpu.max_leaf = eax;
+
+    cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
+    boot_cpu.features[CPUID_1_EDX] = edx;
+    boot_cpu.features[CPUID_1_ECX] = ecx;
+    boot_cpu.apic_id = ebx >> 24;
+
+    if (boot_cpu.max_leaf >= 7) {
+        cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+        boot_cpu.features[CPUID_7_0_EBX] = ebx;
+    }
+
+    if (boot_cpu.max_leaf >= 0xD) {
+        cpuid_count(0xD, 1, &eax, &ebx, &ecx, &edx);
+        boot_cpu.features[CPUID_D_1_EAX] = eax;
+    }
+}
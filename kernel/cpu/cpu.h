@@ -0,0 +1,119 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/cpu/cpu.h
+ * Возможности процессора (CPUID) и управляющие регистры
+ *
+ * cpu_init один раз читает нужные листья CPUID; дальше подсистемы
+ * спрашивают cpu_has(X86_FEATURE_...) без повторных инструкций CPUID.
+ * Номер возможности - слово * 32 + бит, как в Linux.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_CPU_CPU_H
+#define MIXOS_CPU_CPU_H
+
+#include "kernel.h"
+
+/* Слова возможностей */
+#define CPUID_1_EDX         0
+#define CPUID_1_ECX         1
+#define CPUID_7_0_EBX       2
+#define CPUID_D_1_EAX       3
+#define CPUID_NR_WORDS      4
+
+#define X86_FEATURE(word, bit)  ((word) * 32 + (bit))
+
+#define X86_FEATURE_PGE         X86_FEATURE(CPUID_1_EDX, 13)
+#define X86_FEATURE_FXSR        X86_FEATURE(CPUID_1_EDX, 24)
+#define X86_FEATURE_XMM         X86_FEATURE(CPUID_1_EDX, 25)
+#define X86_FEATURE_XMM2        X86_FEATURE(CPUID_1_EDX, 26)
+#define X86_FEATURE_PCLMULQDQ   X86_FEATURE(CPUID_1_ECX, 1)
+#define X86_FEATURE_SSSE3       X86_FEATURE(CPUID_1_ECX, 9)
+#define X86_FEATURE_PCID        X86_FEATURE(CPUID_1_ECX, 17)
+#define X86_FEATURE_XMM4_2      X86_FEATURE(CPUID_1_ECX, 20)
+#define X86_FEATURE_XSAVE       X86_FEATURE(CPUID_1_ECX, 26)
+#define X86_FEATURE_AVX         X86_FEATURE(CPUID_1_ECX, 28)
+#define X86_FEATURE_AVX2        X86_FEATURE(CPUID_7_0_EBX, 5)
+#define X86_FEATURE_INVPCID     X86_FEATURE(CPUID_7_0_EBX, 10)
+#define X86_FEATURE_AVX512F     X86_FEATURE(CPUID_7_0_EBX, 16)
+#define X86_FEATURE_XSAVEOPT    X86_FEATURE(CPUID_D_1_EAX, 0)
+#define X86_FEATURE_XSAVEC      X86_FEATURE(CPUID_D_1_EAX, 1)
+#define X86_FEATURE_XSAVES      X86_FEATURE(CPUID_D_1_EAX, 3)
+
+/* Биты CR0 */
+#define X86_CR0_MP          (1ULL << 1)
+#define X86_CR0_EM          (1ULL << 2)
+#define X86_CR0_TS          (1ULL << 3)
+#define X86_CR0_NE          (1ULL << 5)
+
+/* Биты CR4 */
+#define X86_CR4_PGE         (1ULL << 7)
+#define X86_CR4_OSFXSR      (1ULL << 9)
+#define X86_CR4_OSXMMEXCPT  (1ULL << 10)
+#define X86_CR4_PCIDE       (1ULL << 17)
+#define X86_CR4_OSXSAVE     (1ULL << 18)
+
+/*
+ * Число процессоров. Запуск вторичных процессоров ещё не реализован,
+ * но по-процессорные структуры уже индексируются smp_processor_id().
+ * Маски процессоров - uint64_t, поэтому не больше 64.
+ */
+#define NR_CPUS             1
+
+static inline uint32_t smp_processor_id(void) {
+    return 0;
+}
+
+struct cpuinfo {
+    uint32_t max_leaf;
+    uint32_t apic_id;               /* Начальный APIC ID (CPUID.1:EBX[31:24]) */
+    uint32_t features[CPUID_NR_WORDS];
+};
+
+extern struct cpuinfo boot_cpu;
+
+void cpu_init(void);
+
+static inline bool cpu_has(uint32_t feature) {
+    return boot_cpu.features[feature / 32] & (1U << (feature % 32));
+}
+
+static inline void cpuid_count(uint32_t leaf, uint32_t subleaf, uint32_t* eax, uint32_t* ebx,
+                               uint32_t* ecx, uint32_t* edx) {
+    __asm__ volatile ("cpuid"
+                      : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                      : "a"(leaf), "c"(subleaf));
+}
+
+/* Счётчик тактов: грубые замеры задержек */
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t read_cr0(void) {
+    uint64_t cr0;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint64_t cr0) {
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static inline void write_cr4(uint64_t cr4) {
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+#endif /* MIXOS_CPU_CPU_H */
@@ -0,0 +1,265 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/cpu/fpu.c
+ * Сохранение и отложенное восстановление состояния FPU
+ * ============================================================================
+ */
+
+#include "cpu/fpu.h"
+#include "cpu/cpu.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+#define MSR_IA32_XSS            0xDA0
+
+/* Смещения в области FXSAVE/XSAVE */
+#define FXSAVE_FCW              0
+#define FXSAVE_MXCSR            24
+#define XSAVE_HDR_XCOMP_BV      520
+
+/* XCOMP_BV: область в сжатом формате */
+#define XCOMP_BV_COMPACTED      (1ULL << 63)
+
+/* Начальное значение управляющего слова x87 (после FNINIT) */
+#define FCW_DEFAULT             0x037F
+
+struct fpu_config fpu_config;
+struct fpu_stats fpu_stats;
+bool kernel_fpu_active[NR_CPUS];
+
+/* Чьё состояние сейчас в регистрах процессора (NULL - ничьё) */
+static struct fpu* fpregs_owner[NR_CPUS];
+
+/*
+ * Начальное состояние: XSTATE_BV = 0, т.е. все компоненты в исходном
+ * виде. 4 KiB хватает на x87..AVX-512 в любом формате.
+ */
+static uint8_t init_fpstate[4096] __attribute__((aligned(64)));
+
+static inline void xsetbv(uint32_t index, uint64_t value) {
+    __asm__ volatile ("xsetbv" : : "c"(index), "a"((uint32_t)value),
+                      "d"((uint32_t)(value >> 32)));
+}
+
+/* Сохранение регистров в state; маска - все включённые компоненты */
+static void save_fpregs(void* state) {
+    uint32_t lo = (uint32_t)fpu_config.xfeatures;
+    uint32_t hi = (uint32_t)(fpu_config.xfeatures >> 32);
+    switch (fpu_config.save_insn) {
+    case FPU_SAVE_XSAVES:
+        __asm__ volatile ("xsaves64 (%0)" : : "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_SAVE_XSAVEOPT:
+        __asm__ volatile ("xsaveopt64 (%0)" : : "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_SAVE_XSAVE:
+        __asm__ volatile ("xsave64 (%0)" : : "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_SAVE_FXSAVE:
+        __asm__ volatile ("fxsave64 (%0)" : : "r"(state) : "memory");
+        break;
+    }
+}
+
+static void restore_fpregs(const void* state) {
+    uint32_t lo = (uint32_t)fpu_config.xfeatures;
+    uint32_t hi = (uint32_t)(fpu_config.xfeatures >> 32);
+    switch (fpu_config.save_insn) {
+    case FPU_SAVE_XSAVES:
+        __asm__ volatile ("xrstors64 (%0)" : : "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_SAVE_XSAVEOPT:
+    case FPU_SAVE_XSAVE:
+        __asm__ volatile ("xrstor64 (%0)" : : "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_SAVE_FXSAVE:
+        __asm__ volatile ("fxrstor64 (%0)" : : "r"(state) : "memory");
+        break;
+    }
+}
+
+/* Компоненты XCR0: AVX-512 включается только целиком и только вместе с AVX */
+static uint64_t xstate_features(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid_count(0xD, 0, &eax, &ebx, &ecx, &edx);
+
+    uint64_t features = ((uint64_t)edx << 32 | eax) & XFEATURE_MASK_USER_SUPPORTED;
+    if ((features & XFEATURE_MASK_AVX512) != XFEATURE_MASK_AVX512 ||
+        !(features & XFEATURE_MASK_YMM)) {
+        features &= ~XFEATURE_MASK_AVX512;
+    }
+    return features;
+}
+
+/* Размер области для включённых компонентов (CPUID зависит от XCR0 и XSS) */
+static uint32_t xstate_size(bool compacted) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid_count(0xD, compacted ? 1 : 0, &eax, &ebx, &ecx, &edx);
+    return ebx;
+}
+
+void fpu_init(void) {
+    if (!cpu_has(X86_FEATURE_FXSR) || !cpu_has(X86_FEATURE_XMM2)) {
+        panic("fpu_init: CPU without FXSR/SSE2");
+    }
+
+    /* FPU без эмуляции и ленивого #NM: исключения x87 - через #MF */
+    uint64_t cr0 = read_cr0();
+    cr0 &= ~(X86_CR0_EM | X86_CR0_TS);
+    cr0 |= X86_CR0_MP | X86_CR0_NE;
+    write_cr0(cr0);
+
+    uint64_t cr4 = read_cr4() | X86_CR4_OSFXSR | X86_CR4_OSXMMEXCPT;
+    if (cpu_has(X86_FEATURE_XSAVE)) {
+        write_cr4(cr4 | X86_CR4_OSXSAVE);
+        fpu_config.xfeatures = xstate_features();
+        xsetbv(0, fpu_config.xfeatures);
+
+        if (cpu_has(X86_FEATURE_XSAVES)) {
+            /* Супервизорных компонентов ядро не использует */
+            wrmsr(MSR_IA32_XSS, 0);
+            fpu_config.save_insn = FPU_SAVE_XSAVES;
+        } else if (cpu_has(X86_FEATURE_XSAVEOPT)) {
+            fpu_config.save_insn = FPU_SAVE_XSAVEOPT;
+        } else {
+            fpu_config.save_insn = FPU_SAVE_XSAVE;
+        }
+        fpu_config.size = xstate_size(fpu_config.save_insn == FPU_SAVE_XSAVES);
+    } else {
+        write_cr4(cr4);
+        fpu_config.xfeatures = XFEATURE_MASK_FP | XFEATURE_MASK_SSE;
+        fpu_config.save_insn = FPU_SAVE_FXSAVE;
+        fpu_config.size = 512;
+    }
+    if (fpu_config.size > sizeof(init_fpstate)) {
+        panic("fpu_init: XSAVE area too large");
+    }
+
+    *(uint16_t*)(init_fpstate + FXSAVE_FCW) = FCW_DEFAULT;
+    *(uint32_t*)(init_fpstate + FXSAVE_MXCSR) = MXCSR_DEFAULT;
+    if (fpu_config.save_insn == FPU_SAVE_XSAVES) {
+        *(uint64_t*)(init_fpstate + XSAVE_HDR_XCOMP_BV) =
+            XCOMP_BV_COMPACTED | fpu_config.xfeatures;
+    }
+    restore_fpregs(init_fpstate);
+}
+
+int fpu_alloc(struct fpu* fpu) {
+    /* Классы kmalloc от 512 байт выровнены на свой размер */
+    fpu->state = kmalloc(fpu_config.size);
+    if (!fpu->state) {
+        return -ENOMEM;
+    }
+    memcpy(fpu->state, init_fpstate, fpu_config.size);
+    fpu->last_cpu = UINT32_MAX;
+    fpu->need_load = true;
+    return 0;
+}
+
+void fpu_free(struct fpu* fpu) {
+    if (fpregs_owner[smp_processor_id()] == fpu) {
+        fpregs_owner[smp_processor_id()] = NULL;
+    }
+    kfree(fpu->state);
+    fpu->state = NULL;
+}
+
+/* Регистры держат актуальное состояние задачи, которое ещё не сохранено */
+static inline bool fpregs_active(const struct fpu* fpu) {
+    return fpregs_owner[smp_processor_id()] == fpu && !fpu->need_load;
+}
+
+static void fpu_save(struct fpu* fpu) {
+    save_fpregs(fpu->state);
+    fpu->last_cpu = smp_processor_id();
+    fpu_stats.saves++;
+}
+
+/* Регистры заняты ядром: состояние задач трогать нельзя */
+static inline void fpu_check_user(const char* who) {
+    if (unlikely(kernel_fpu_in_section())) {
+        panic(who);
+    }
+}
+
+void fpu_copy(struct fpu* dst, struct fpu* src) {
+    fpu_check_user("fpu_copy: inside kernel_fpu_begin/end");
+    if (fpregs_active(src)) {
+        fpu_save(src);
+    }
+    memcpy(dst->state, src->state, fpu_config.size);
+    dst->last_cpu = UINT32_MAX;
+    dst->need_load = true;
+}
+
+void fpu_reset(struct fpu* fpu) {
+    if (fpregs_owner[smp_processor_id()] == fpu) {
+        fpregs_owner[smp_processor_id()] = NULL;
+    }
+    memcpy(fpu->state, init_fpstate, fpu_config.size);
+    fpu->last_cpu = UINT32_MAX;
+    fpu->need_load = true;
+}
+
+void switch_fpu_prepare(struct fpu* old) {
+    fpu_check_user("switch_fpu_prepare: task switch inside kernel_fpu_begin/end");
+    /* Регистры остаются за old: вернувшись первой, она их не перезагрузит */
+    if (old->state && fpregs_active(old)) {
+        fpu_save(old);
+    }
+}
+
+void switch_fpu_finish(struct fpu* new) {
+    if (new->state) {
+        new->need_load = true;
+    }
+}
+
+void fpu_return_to_user(struct fpu* fpu) {
+    fpu_check_user("fpu_return_to_user: inside kernel_fpu_begin/end");
+    if (!fpu->need_load) {
+        return;
+    }
+    uint32_t cpu = smp_processor_id();
+    if (fpregs_owner[cpu] == fpu && fpu->last_cpu == cpu) {
+        fpu_stats.restores_skipped++;
+    } else {
+        restore_fpregs(fpu->state);
+        fpregs_owner[cpu] = fpu;
+        fpu->last_cpu = cpu;
+        fpu_stats.restores++;
+    }
+    fpu->need_load = false;
+}
+
+void kernel_fpu_begin(void) {
+    uint32_t cpu = smp_processor_id();
+    if (kernel_fpu_active[cpu]) {
+        panic("kernel_fpu_begin: nested section");
+    }
+    kernel_fpu_active[cpu] = true;
+
+    /* Состояние задачи сохраняется, только если его ещё нет в памяти */
+    struct fpu* owner = fpregs_owner[cpu];
+    if (owner) {
+        if (!owner->need_load) {
+            fpu_save(owner);
+            owner->need_load = true;
+        }
+        fpregs_owner[cpu] = NULL;
+    }
+
+    /* Режимы округления и маски исключений задачи ядру не подходят */
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    __asm__ volatile ("ldmxcsr %0" : : "m"(mxcsr));
+    __asm__ volatile ("fninit");
+    fpu_stats.kernel_sections++;
+}
+
+void kernel_fpu_end(void) {
+    uint32_t cpu = smp_processor_id();
+    if (!kernel_fpu_active[cpu]) {
+        panic("kernel_fpu_end: no matching kernel_fpu_begin");
+    }
+    kernel_fpu_active[cpu] = false;
+}
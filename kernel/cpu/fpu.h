@@ -0,0 +1,135 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/cpu/fpu.h
+ * Состояние FPU/SSE/AVX пользовательских задач
+ *
+ * Ядро собрано без SSE и само регистры FPU не трогает, поэтому
+ * пользовательское состояние живёт в регистрах, пока выполняется ядро.
+ * При переключении задач оно сохраняется в область XSAVE уходящей
+ * задачи, а восстанавливается не сразу, а лишь перед возвратом новой
+ * задачи в пользовательский режим (fpu_return_to_user). Если с тех пор
+ * регистры никто не занимал (задача снова на том же процессоре, между
+ * ними работали только потоки ядра), восстановление пропускается.
+ *
+ * Сохранение - лучшей из доступных инструкций: XSAVES (сжатый формат,
+ * пропуск неизменённых компонентов), XSAVEOPT (стандартный формат,
+ * пропуск неизменённых), XSAVE или FXSAVE. Неизменёнными считаются
+ * компоненты, не тронутые после XRSTOR из той же области, - задача,
+ * не касавшаяся AVX-512 с прошлого переключения, не платит за его
+ * сохранение.
+ *
+ * Векторный код ядра (контрольные суммы, XOR, сжатие) собирается с
+ * SSE/AVX только в отдельных единицах трансляции (*_sse.c, *_avx2.c,
+ * см. Makefile) и вызывается лишь между kernel_fpu_begin и
+ * kernel_fpu_end. Выбор реализации и сама секция - в обычном коде без
+ * SSE: компилятор вправе использовать векторные регистры где угодно в
+ * такой единице, и вне секции они испортили бы состояние задачи.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_CPU_FPU_H
+#define MIXOS_CPU_FPU_H
+
+#include "kernel.h"
+#include "cpu/cpu.h"
+
+/* Компоненты XSAVE */
+#define XFEATURE_MASK_FP        (1ULL << 0)
+#define XFEATURE_MASK_SSE       (1ULL << 1)
+#define XFEATURE_MASK_YMM       (1ULL << 2)
+#define XFEATURE_MASK_OPMASK    (1ULL << 5)
+#define XFEATURE_MASK_ZMM_Hi256 (1ULL << 6)
+#define XFEATURE_MASK_Hi16_ZMM  (1ULL << 7)
+
+#define XFEATURE_MASK_AVX512    (XFEATURE_MASK_OPMASK | XFEATURE_MASK_ZMM_Hi256 | \
+                                 XFEATURE_MASK_Hi16_ZMM)
+
+/* Компоненты, которые ядро включает в XCR0, если их знает процессор */
+#define XFEATURE_MASK_USER_SUPPORTED \
+    (XFEATURE_MASK_FP | XFEATURE_MASK_SSE | XFEATURE_MASK_YMM | XFEATURE_MASK_AVX512)
+
+/* Начальное значение MXCSR: все исключения SSE замаскированы */
+#define MXCSR_DEFAULT           0x1F80
+
+/* Состояние FPU задачи */
+struct fpu {
+    void* state;                    /* Область XSAVE (выровнена на 64 байта) */
+    uint32_t last_cpu;              /* Где регистры совпадали с state (UINT32_MAX - нигде) */
+    bool need_load;                 /* В регистрах не состояние этой задачи */
+};
+
+/* Как сохраняется состояние (по убыванию предпочтения) */
+enum fpu_save_insn {
+    FPU_SAVE_XSAVES,
+    FPU_SAVE_XSAVEOPT,
+    FPU_SAVE_XSAVE,
+    FPU_SAVE_FXSAVE,
+};
+
+struct fpu_config {
+    enum fpu_save_insn save_insn;
+    uint64_t xfeatures;             /* Включённые в XCR0 компоненты */
+    uint32_t size;                  /* Размер области состояния задачи */
+};
+
+struct fpu_stats {
+    uint64_t saves;                 /* Сохранений при переключении */
+    uint64_t restores;              /* Восстановлений перед возвратом в ring 3 */
+    uint64_t restores_skipped;      /* Регистры ещё хранили состояние задачи */
+    uint64_t kernel_sections;       /* Секций kernel_fpu_begin/end */
+};
+
+extern struct fpu_config fpu_config;
+extern struct fpu_stats fpu_stats;
+
+/* Включение FPU/SSE/XSAVE и выбор формата; до создания задач */
+void fpu_init(void);
+
+/* Область задачи в начальном состоянии */
+int fpu_alloc(struct fpu* fpu);
+void fpu_free(struct fpu* fpu);
+
+/* fork: копия состояния src (вместе с ещё не сохранёнными регистрами) */
+void fpu_copy(struct fpu* dst, struct fpu* src);
+
+/* exec: начальное состояние */
+void fpu_reset(struct fpu* fpu);
+
+/*
+ * Переключение задач (вызывает планировщик): prepare - для уходящей,
+ * finish - для приходящей. Регистры при этом не загружаются.
+ */
+void switch_fpu_prepare(struct fpu* old);
+void switch_fpu_finish(struct fpu* new);
+
+/* Последний шаг перед возвратом задачи в пользовательский режим */
+void fpu_return_to_user(struct fpu* fpu);
+
+/* ============================================================================
+ * Векторные регистры в ядре
+ * ============================================================================ */
+
+extern bool kernel_fpu_active[NR_CPUS];
+
+/*
+ * Секция, в которой ядро может портить регистры FPU/SSE/AVX.
+ * Несохранённое состояние задачи сохраняется и будет восстановлено
+ * перед возвратом в пользовательский режим. Секции не вкладываются,
+ * внутри нельзя переключать задачи и засыпать; MXCSR и управляющее
+ * слово x87 - начальные.
+ */
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+static inline bool kernel_fpu_in_section(void) {
+    return kernel_fpu_active[smp_processor_id()];
+}
+
+/* Вход в векторную функцию: вызов вне секции - ошибка ядра */
+static inline void kernel_fpu_assert(const char* who) {
+    if (unlikely(!kernel_fpu_in_section())) {
+        panic(who);
+    }
+}
+
+#endif /* MIXOS_CPU_FPU_H */
@@ -0,0 +1,62 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/cpu/tsc.c
+ * Определение частоты TSC
+ * ============================================================================
+ */
+
+#include "cpu/tsc.h"
+#include "cpu/io.h"
+
+/* Канал 2 PIT: вход разрешается битом 0 порта 0x61, выход - бит 5 */
+#define PIT_FREQ_HZ             1193182
+#define PIT_CH2_PORT            0x42
+#define PIT_CMD_PORT            0x43
+#define PIT_GATE_PORT           0x61
+#define PIT_GATE_CH2            0x01
+#define PIT_SPEAKER             0x02
+#define PIT_OUT_CH2             0x20
+#define PIT_CALIBRATE_MS        10
+
+/* Без PIT бит выхода не изменится: ждём с ограничением */
+#define PIT_POLL_LIMIT          (1U << 28)
+
+uint64_t tsc_khz;
+
+static uint64_t tsc_khz_cpuid(void) {
+    if (boot_cpu.max_leaf < 0x15) {
+        return 0;
+    }
+    uint32_t denominator, numerator, crystal_hz, edx;
+    cpuid_count(0x15, 0, &denominator, &numerator, &crystal_hz, &edx);
+    if (!denominator || !numerator || !crystal_hz) {
+        return 0;
+    }
+    return (uint64_t)crystal_hz * numerator / denominator / 1000;
+}
+
+static uint64_t tsc_khz_pit(void) {
+    uint32_t latch = PIT_FREQ_HZ * PIT_CALIBRATE_MS / 1000;
+
+    /* Режим 0: выход поднимается, когда счёт дойдёт до нуля */
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~PIT_SPEAKER) | PIT_GATE_CH2);
+    outb(PIT_CMD_PORT, 0xB0);       /* Канал 2, младший и старший байт, режим 0 */
+    outb(PIT_CH2_PORT, latch & 0xFF);
+    outb(PIT_CH2_PORT, latch >> 8);
+
+    uint64_t start = rdtsc();
+    uint32_t polls = 0;
+    while (!(inb(PIT_GATE_PORT) & PIT_OUT_CH2)) {
+        if (++polls == PIT_POLL_LIMIT) {
+            return 0;
+        }
+    }
+    return (rdtsc() - start) / PIT_CALIBRATE_MS;
+}
+
+void tsc_init(void) {
+    tsc_khz = tsc_khz_cpuid();
+    if (!tsc_khz) {
+        tsc_khz = tsc_khz_pit();
+    }
+}
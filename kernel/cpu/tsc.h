@@ -0,0 +1,27 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/cpu/tsc.h
+ * Частота счётчика тактов (TSC) для перевода замеров во время
+ * ============================================================================
+ */
+
+#ifndef MIXOS_CPU_TSC_H
+#define MIXOS_CPU_TSC_H
+
+#include "kernel.h"
+#include "cpu/cpu.h"
+
+/* Тактов TSC в миллисекунду; 0 - частота неизвестна */
+extern uint64_t tsc_khz;
+
+/*
+ * Частота из CPUID 0x15 (кварц и множитель), иначе калибровка по
+ * каналу 2 PIT за 10 мс. После cpu_init.
+ */
+void tsc_init(void);
+
+static inline uint64_t tsc_cycles_to_ns(uint64_t cycles) {
+    return tsc_khz ? cycles * 1000000 / tsc_khz : 0;
+}
+
+#endif /* MIXOS_CPU_TSC_H */
@@ -0,0 +1,46 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/errno.h
+ * Коды ошибок ядра (функции возвращают отрицательные значения: -ENOENT)
+ * ============================================================================
+ */
+
+#ifndef MIXOS_ERRNO_H
+#define MIXOS_ERRNO_H
+
+#define EPERM       1       /* Операция не разрешена */
+#define ENOENT      2       /* Нет такого файла или каталога */
+#define EIO         5       /* Ошибка ввода-вывода */
+#define ENXIO       6       /* Нет такого устройства */
+#define E2BIG       7       /* Слишком длинный список аргументов */
+#define ENOEXEC     8       /* Неверный формат исполняемого файла */
+#define EBADF       9       /* Неверный файловый дескриптор */
+#define EAGAIN      11      /* Ресурс временно недоступен */
+#define ENOMEM      12      /* Недостаточно памяти */
+#define EACCES      13      /* Доступ запрещён */
+#define EFAULT      14      /* Неверный адрес */
+#define EBUSY       16      /* Устройство или ресурс занят */
+#define EEXIST      17      /* Файл существует */
+#define EXDEV       18      /* Ссылка между устройствами */
+#define ENODEV      19      /* Нет такого устройства */
+#define ENOTDIR     20      /* Не каталог */
+#define EISDIR      21      /* Это каталог */
+#define EINVAL      22      /* Неверный аргумент */
+#define ENFILE      23      /* Переполнена таблица файлов */
+#define EFBIG       27      /* Файл слишком велик */
+#define ENOSPC      28      /* Нет места на устройстве */
+#define ESPIPE      29      /* Недопустимый seek */
+#define EROFS       30      /* Файловая система только для чтения */
+#define EMLINK      31      /* Слишком много ссылок */
+#define EPIPE       32      /* Канал разорван */
+#define ERANGE      34      /* Результат вне диапазона */
+#define ENAMETOOLONG 36     /* Слишком длинное имя файла */
+#define ENOSYS      38      /* Функция не реализована */
+#define ENOTEMPTY   39      /* Каталог не пуст */
+#define EOVERFLOW   75      /* Значение слишком велико */
+#define EUCLEAN     117     /* Структура повреждена */
+#define EOPNOTSUPP  95      /* Операция не поддерживается */
+
+#define EFSCORRUPTED EUCLEAN /* Повреждённые метаданные файловой системы */
+
+#endif /* MIXOS_ERRNO_H */
@@ -0,0 +1,80 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/elf.h
+ * Формат ELF64 (только то, что нужно загрузчику)
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_ELF_H
+#define MIXOS_FS_ELF_H
+
+#include "kernel.h"
+
+#define EI_NIDENT       16
+#define EI_CLASS        4
+#define EI_DATA         5
+#define EI_VERSION      6
+
+#define ELFMAG          "\177ELF"
+#define SELFMAG         4
+#define ELFCLASS64      2
+#define ELFDATA2LSB     1
+#define EV_CURRENT      1
+
+/* Тип файла */
+#define ET_EXEC         2
+#define ET_DYN          3
+
+#define EM_X86_64       62
+
+/* Типы сегментов */
+#define PT_LOAD         1
+#define PT_INTERP       3
+#define PT_PHDR         6
+#define PT_GNU_STACK    0x6474E551
+
+/* Права сегмента */
+#define PF_X            (1U << 0)
+#define PF_W            (1U << 1)
+#define PF_R            (1U << 2)
+
+/* Вектор вспомогательных значений (auxv) на стеке процесса */
+#define AT_NULL         0
+#define AT_PHDR         3
+#define AT_PHENT        4
+#define AT_PHNUM        5
+#define AT_PAGESZ       6
+#define AT_BASE         7
+#define AT_FLAGS        8
+#define AT_ENTRY        9
+#define AT_EXECFN       31
+
+typedef struct {
+    uint8_t e_ident[EI_NIDENT];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} Elf64_Ehdr;
+
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+} Elf64_Phdr;
+
+#endif /* MIXOS_FS_ELF_H */
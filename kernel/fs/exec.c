@@ -0,0 +1,407 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/exec.c
+ * Загрузчик ELF64
+ *
+ * Сегменты PT_LOAD становятся файловыми областями адресного пространства:
+ * страницы читаются в page cache и отображаются только при первом
+ * обращении, неизменяемые страницы (код, константы) общие для всех
+ * процессов одной программы. Загрузчик сам касается только заголовков,
+ * неполной страницы на границе .data/.bss (её хвост обнуляется) и
+ * вершины стека с аргументами.
+ *
+ * Пока ядро отображает первые 4 GiB один-в-один в нижней половине,
+ * пользовательские адреса начинаются с USER_SPACE_START: программы
+ * ET_EXEC, слинкованные ниже (классические 0x400000), не загружаются,
+ * позиционно-независимые (ET_DYN) размещаются с ELF_ET_DYN_BASE.
+ * ============================================================================
+ */
+
+#include "fs/exec.h"
+#include "fs/elf.h"
+#include "fs/vfs.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/* Предел размера таблицы заголовков программы и пути интерпретатора */
+#define ELF_MAX_PHDRS_SIZE  (64U * 1024)
+#define ELF_MAX_INTERP      4096
+
+struct elf_binary {
+    struct file* file;
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr* phdrs;
+    uint64_t load_bias;             /* Сдвиг адресов ET_DYN относительно p_vaddr */
+    uint64_t phdr_addr;             /* Адрес таблицы заголовков в памяти процесса */
+};
+
+/* ============================================================================
+ * Заголовки
+ * ============================================================================ */
+
+static int kernel_read(struct file* file, uint64_t pos, void* buf, size_t len) {
+    int64_t n = file->f_op->read(file, buf, len, &pos);
+    if (n < 0) {
+        return (int)n;
+    }
+    return (size_t)n == len ? 0 : -ENOEXEC;
+}
+
+static int elf_open(const char* path, struct elf_binary* elf) {
+    memset(elf, 0, sizeof(*elf));
+    int err = vfs_open(path, O_RDONLY, 0, &elf->file);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode = elf->file->inode;
+    if (!S_ISREG(inode->mode) || !(inode->mode & 0111)) {
+        return -EACCES;
+    }
+    if (!inode->mapping.a_ops) {
+        return -ENOEXEC;
+    }
+
+    Elf64_Ehdr* ehdr = &elf->ehdr;
+    err = kernel_read(elf->file, 0, ehdr, sizeof(*ehdr));
+    if (err < 0) {
+        return err;
+    }
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+        ehdr->e_ident[EI_VERSION] != EV_CURRENT ||
+        (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) ||
+        ehdr->e_machine != EM_X86_64 ||
+        ehdr->e_phentsize != sizeof(Elf64_Phdr) ||
+        ehdr->e_phnum == 0) {
+        return -ENOEXEC;
+    }
+
+    size_t size = (size_t)ehdr->e_phnum * sizeof(Elf64_Phdr);
+    if (size > ELF_MAX_PHDRS_SIZE) {
+        return -ENOEXEC;
+    }
+    elf->phdrs = kmalloc(size);
+    if (!elf->phdrs) {
+        return -ENOMEM;
+    }
+    return kernel_read(elf->file, ehdr->e_phoff, elf->phdrs, size);
+}
+
+/* Файл остаётся открытым через ссылки областей, которые его отображают */
+static void elf_close(struct elf_binary* elf) {
+    kfree(elf->phdrs);
+    if (elf->file) {
+        fput(elf->file);
+    }
+}
+
+static int elf_read_interp(struct elf_binary* elf, char** out) {
+    *out = NULL;
+    for (uint32_t i = 0; i < elf->ehdr.e_phnum; i++) {
+        const Elf64_Phdr* phdr = &elf->phdrs[i];
+        if (phdr->p_type != PT_INTERP) {
+            continue;
+        }
+        if (phdr->p_filesz < 2 || phdr->p_filesz > ELF_MAX_INTERP) {
+            return -ENOEXEC;
+        }
+        char* path = kmalloc(phdr->p_filesz);
+        if (!path) {
+            return -ENOMEM;
+        }
+        int err = kernel_read(elf->file, phdr->p_offset, path, phdr->p_filesz);
+        if (err == 0 && path[phdr->p_filesz - 1] != '\0') {
+            err = -ENOEXEC;
+        }
+        if (err < 0) {
+            kfree(path);
+            return err;
+        }
+        *out = path;
+        return 0;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Отображение сегментов
+ * ============================================================================ */
+
+static uint32_t elf_vm_flags(uint32_t p_flags) {
+    uint32_t flags = 0;
+    if (p_flags & PF_R) {
+        flags |= VM_READ;
+    }
+    if (p_flags & PF_W) {
+        flags |= VM_WRITE;
+    }
+    if (p_flags & PF_X) {
+        flags |= VM_EXEC;
+    }
+    return flags;
+}
+
+/*
+ * Файловая часть сегмента отображается из page cache; хвост последней
+ * файловой страницы за p_filesz обнуляется (это единственная страница,
+ * которую загрузчик копирует), остаток .bss - анонимная память.
+ */
+static int elf_map_segment(struct mm_struct* mm, struct elf_binary* elf,
+                           const Elf64_Phdr* phdr) {
+    uint64_t vaddr = elf->load_bias + phdr->p_vaddr;
+    uint64_t start = ALIGN_DOWN(vaddr, PAGE_SIZE);
+    uint64_t file_end = vaddr + phdr->p_filesz;
+    uint64_t mem_end = vaddr + phdr->p_memsz;
+    uint32_t flags = elf_vm_flags(phdr->p_flags);
+    uint64_t anon_start = start;
+
+    if (phdr->p_filesz) {
+        uint64_t pgoff = (phdr->p_offset - (vaddr - start)) >> PAGE_SHIFT;
+        int64_t ret = mmap_region(mm, start, ALIGN_UP(file_end, PAGE_SIZE) - start, flags,
+                                  elf->file, pgoff);
+        if (ret < 0) {
+            return (int)ret;
+        }
+        anon_start = ALIGN_UP(file_end, PAGE_SIZE);
+
+        if (mem_end > file_end && (file_end & (PAGE_SIZE - 1))) {
+            int err = clear_process_vm(mm, file_end, anon_start - file_end);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+
+    uint64_t anon_end = ALIGN_UP(mem_end, PAGE_SIZE);
+    if (anon_end > anon_start) {
+        int64_t ret = mmap_region(mm, anon_start, anon_end - anon_start, flags, NULL, 0);
+        if (ret < 0) {
+            return (int)ret;
+        }
+    }
+    return 0;
+}
+
+static int elf_map(struct mm_struct* mm, struct elf_binary* elf, bool main) {
+    const Elf64_Ehdr* ehdr = &elf->ehdr;
+    uint64_t lo = UINT64_MAX;
+    uint64_t hi = 0;
+
+    for (uint32_t i = 0; i < ehdr->e_phnum; i++) {
+        const Elf64_Phdr* phdr = &elf->phdrs[i];
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0) {
+            continue;
+        }
+        if (phdr->p_filesz > phdr->p_memsz ||
+            ((phdr->p_vaddr - phdr->p_offset) & (PAGE_SIZE - 1)) ||
+            phdr->p_vaddr + phdr->p_memsz < phdr->p_vaddr ||
+            phdr->p_offset + phdr->p_filesz < phdr->p_offset) {
+            return -ENOEXEC;
+        }
+        lo = MIN(lo, ALIGN_DOWN(phdr->p_vaddr, PAGE_SIZE));
+        hi = MAX(hi, ALIGN_UP(phdr->p_vaddr + phdr->p_memsz, PAGE_SIZE));
+    }
+    if (hi == 0) {
+        return -ENOEXEC;
+    }
+
+    if (ehdr->e_type == ET_DYN) {
+        /* Программа - с постоянного адреса, интерпретатор - под областями mmap */
+        uint64_t base = main ? ELF_ET_DYN_BASE : get_unmapped_area(mm, hi - lo);
+        if (!base) {
+            return -ENOMEM;
+        }
+        elf->load_bias = base - lo;
+    }
+    if (elf->load_bias + lo < USER_SPACE_START || elf->load_bias + hi > USER_SPACE_END) {
+        return -ENOEXEC;
+    }
+
+    for (uint32_t i = 0; i < ehdr->e_phnum; i++) {
+        const Elf64_Phdr* phdr = &elf->phdrs[i];
+        if (phdr->p_type == PT_PHDR) {
+            elf->phdr_addr = elf->load_bias + phdr->p_vaddr;
+        }
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0) {
+            continue;
+        }
+        int err = elf_map_segment(mm, elf, phdr);
+        if (err < 0) {
+            return err;
+        }
+
+        /* Без PT_PHDR таблица заголовков видна, если попала в сегмент */
+        if (!elf->phdr_addr && ehdr->e_phoff >= phdr->p_offset &&
+            ehdr->e_phoff - phdr->p_offset < phdr->p_filesz) {
+            elf->phdr_addr = elf->load_bias + phdr->p_vaddr + (ehdr->e_phoff - phdr->p_offset);
+        }
+
+        if (main) {
+            uint64_t start = elf->load_bias + phdr->p_vaddr;
+            uint64_t end = start + phdr->p_memsz;
+            if (phdr->p_flags & PF_X) {
+                mm->start_code = mm->start_code ? MIN(mm->start_code, start) : start;
+                mm->end_code = MAX(mm->end_code, start + phdr->p_filesz);
+            } else {
+                mm->start_data = mm->start_data ? MIN(mm->start_data, start) : start;
+                mm->end_data = MAX(mm->end_data, start + phdr->p_filesz);
+            }
+            mm->brk = MAX(mm->brk, ALIGN_UP(end, PAGE_SIZE));
+        }
+    }
+    if (main) {
+        mm->start_brk = mm->brk;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Стек процесса
+ * ============================================================================ */
+
+static int count_strings(const char* const* strings, size_t* count, size_t* size) {
+    *count = 0;
+    for (; strings && strings[*count]; (*count)++) {
+        *size += strlen(strings[*count]) + 1;
+        if (*size > EXEC_ARG_MAX) {
+            return -E2BIG;
+        }
+    }
+    return 0;
+}
+
+/* Строка в образ вершины стека; возвращает её адрес в процессе */
+static uint64_t push_string(uint8_t* image, uint64_t stack, char** str, const char* s) {
+    size_t len = strlen(s) + 1;
+    uint64_t addr = stack + (uint64_t)((uint8_t*)*str - image);
+    memcpy(*str, s, len);
+    *str += len;
+    return addr;
+}
+
+/*
+ * Вершина стека по System V ABI: argc, argv[], NULL, envp[], NULL,
+ * auxv (пары, AT_NULL), выше - сами строки. RSP выровнен на 16 байт.
+ */
+static int setup_stack(struct mm_struct* mm, const char* path, const char* const* argv,
+                       const char* const* envp, const uint64_t* auxv, size_t auxv_words,
+                       uint64_t* sp) {
+    int64_t ret = mmap_region(mm, STACK_TOP - STACK_SIZE, STACK_SIZE,
+                              VM_READ | VM_WRITE | VM_STACK, NULL, 0);
+    if (ret < 0) {
+        return (int)ret;
+    }
+
+    size_t argc;
+    size_t envc;
+    size_t strings_size = strlen(path) + 1;
+    int err = count_strings(argv, &argc, &strings_size);
+    if (err == 0) {
+        err = count_strings(envp, &envc, &strings_size);
+    }
+    if (err < 0) {
+        return err;
+    }
+
+    /* auxv дополняется парой AT_EXECFN перед завершающей AT_NULL */
+    size_t words = 1 + (argc + 1) + (envc + 1) + auxv_words + 2;
+    uint64_t strings = STACK_TOP - strings_size;
+    uint64_t stack = ALIGN_DOWN(strings - words * sizeof(uint64_t), 16);
+
+    size_t size = STACK_TOP - stack;
+    uint8_t* image = kzalloc(size);
+    if (!image) {
+        return -ENOMEM;
+    }
+    uint64_t* word = (uint64_t*)image;
+    char* str = (char*)image + (strings - stack);
+
+    *word++ = argc;
+    for (size_t i = 0; i < argc; i++) {
+        *word++ = push_string(image, stack, &str, argv[i]);
+    }
+    *word++ = 0;
+    for (size_t i = 0; i < envc; i++) {
+        *word++ = push_string(image, stack, &str, envp[i]);
+    }
+    *word++ = 0;
+    memcpy(word, auxv, (auxv_words - 2) * sizeof(uint64_t));
+    word += auxv_words - 2;
+    *word++ = AT_EXECFN;
+    *word++ = push_string(image, stack, &str, path);
+    *word++ = AT_NULL;
+    *word++ = 0;
+
+    ret = access_process_vm(mm, stack, image, size, true);
+    kfree(image);
+    if (ret < 0) {
+        return (int)ret;
+    }
+    *sp = stack;
+    mm->start_stack = stack;
+    return 0;
+}
+
+/* ============================================================================
+ * Загрузка
+ * ============================================================================ */
+
+int exec_load(const char* path, const char* const* argv, const char* const* envp,
+              struct exec_image* image) {
+    struct elf_binary elf;
+    struct elf_binary interp;
+    struct mm_struct* mm = NULL;
+    char* interp_path = NULL;
+    bool has_interp = false;
+
+    memset(&interp, 0, sizeof(interp));
+    int err = elf_open(path, &elf);
+    if (err == 0) {
+        err = elf_read_interp(&elf, &interp_path);
+    }
+    if (err == 0 && interp_path) {
+        has_interp = true;
+        err = elf_open(interp_path, &interp);
+        if (err == 0 && interp.ehdr.e_type != ET_DYN) {
+            err = -ENOEXEC;
+        }
+    }
+    if (err == 0) {
+        mm = mm_alloc();
+        err = mm ? 0 : -ENOMEM;
+    }
+    if (err == 0) {
+        err = elf_map(mm, &elf, true);
+    }
+    if (err == 0 && has_interp) {
+        err = elf_map(mm, &interp, false);
+    }
+
+    if (err == 0) {
+        uint64_t entry = elf.load_bias + elf.ehdr.e_entry;
+        uint64_t auxv[] = {
+            AT_PHDR, elf.phdr_addr,
+            AT_PHENT, sizeof(Elf64_Phdr),
+            AT_PHNUM, elf.ehdr.e_phnum,
+            AT_PAGESZ, PAGE_SIZE,
+            AT_BASE, has_interp ? interp.load_bias : 0,
+            AT_FLAGS, 0,
+            AT_ENTRY, entry,
+            AT_NULL, 0,
+        };
+        err = setup_stack(mm, path, argv, envp, auxv, ARRAY_SIZE(auxv), &image->stack);
+        image->entry = has_interp ? interp.load_bias + interp.ehdr.e_entry : entry;
+    }
+
+    if (err < 0 && mm) {
+        mmput(mm);
+    } else if (err == 0) {
+        image->mm = mm;
+    }
+    kfree(interp_path);
+    elf_close(&interp);
+    elf_close(&elf);
+    return err;
+}
@@ -0,0 +1,34 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/exec.h
+ * Запуск программ: загрузка ELF64 в новое адресное пространство
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_EXEC_H
+#define MIXOS_FS_EXEC_H
+
+#include "mm/mm.h"
+
+/* Готовый к запуску образ: адресное пространство, точка входа, стек */
+struct exec_image {
+    struct mm_struct* mm;
+    uint64_t entry;                 /* RIP (точка входа интерпретатора, если он есть) */
+    uint64_t stack;                 /* RSP: argc, argv, envp, auxv */
+};
+
+/* Адрес загрузки позиционно-независимых программ (ET_DYN) */
+#define ELF_ET_DYN_BASE     0x0000555555554000ULL
+
+/* Предел суммарной длины аргументов и окружения */
+#define EXEC_ARG_MAX        (128U * 1024)
+
+/*
+ * Загрузка программы path. Сегменты отображаются из page cache и
+ * подгружаются при первом обращении, так что время загрузки не зависит
+ * от размера файла. argv и envp - массивы строк, завершённые NULL.
+ */
+int exec_load(const char* path, const char* const* argv, const char* const* envp,
+              struct exec_image* image);
+
+#endif /* MIXOS_FS_EXEC_H */
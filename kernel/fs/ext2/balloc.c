@@ -0,0 +1,368 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/ext2/balloc.c
+ * Драйвер ext2: выделение блоков с учётом локальности
+ *
+ * Блоки ищутся сначала в группе цели (рядом с предыдущим блоком файла или
+ * в группе его inode, которая совпадает с группой родительского каталога),
+ * затем в остальных группах по кругу. Растущие обычные файлы получают окно
+ * резервирования - непрерывную серию свободных блоков, которую другие
+ * файлы обходят; размер окна удваивается, пока файл его полностью съедает.
+ *
+ * С журналом блок, освобождённый в открытой транзакции, считается занятым
+ * до её фиксации (по копии битовой карты до освобождения): иначе после
+ * сбоя он мог бы оказаться и в старом файле, и в новом.
+ * ============================================================================
+ */
+
+#include "fs/ext2/ext2.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Битовые карты
+ * ============================================================================ */
+
+static inline bool ext2_test_bit(const uint8_t* bitmap, uint32_t bit) {
+    return (bitmap[bit >> 3] >> (bit & 7)) & 1;
+}
+
+static inline void ext2_set_bit(uint8_t* bitmap, uint32_t bit) {
+    bitmap[bit >> 3] |= (uint8_t)(1U << (bit & 7));
+}
+
+static inline void ext2_clear_bit(uint8_t* bitmap, uint32_t bit) {
+    bitmap[bit >> 3] &= (uint8_t)~(1U << (bit & 7));
+}
+
+/* Блок занят сейчас или в последней зафиксированной битовой карте */
+static inline bool ext2_block_busy(const uint8_t* bitmap, const uint8_t* committed,
+                                   uint32_t bit) {
+    return ext2_test_bit(bitmap, bit) || (committed && ext2_test_bit(committed, bit));
+}
+
+static inline uint8_t ext2_busy_byte(const uint8_t* bitmap, const uint8_t* committed,
+                                     uint32_t index) {
+    return bitmap[index] | (committed ? committed[index] : 0);
+}
+
+uint32_t ext2_group_first_block(struct ext2_sb_info* sbi, uint32_t group) {
+    return sbi->first_data_block + group * sbi->blocks_per_group;
+}
+
+/* Число блоков в группе (последняя группа может быть короче) */
+static uint32_t ext2_group_blocks(struct ext2_sb_info* sbi, uint32_t group) {
+    uint32_t first = ext2_group_first_block(sbi, group);
+    return MIN(sbi->blocks_per_group, sbi->es->s_blocks_count - first);
+}
+
+/* ============================================================================
+ * Окна резервирования
+ * ============================================================================ */
+
+static inline bool rsv_empty(const struct ext2_reserve_window* rsv) {
+    return rsv->start == 0;
+}
+
+/* Чужое окно, содержащее блок, или NULL */
+static struct ext2_reserve_window* rsv_conflict(struct ext2_sb_info* sbi, uint32_t block,
+                                                const struct ext2_reserve_window* self) {
+    struct list_head* pos;
+    list_for_each(pos, &sbi->rsv_windows) {
+        struct ext2_reserve_window* rsv = list_entry(pos, struct ext2_reserve_window, list);
+        if (rsv->start > block) {
+            break;
+        }
+        if (rsv != self && block <= rsv->end) {
+            return rsv;
+        }
+    }
+    return NULL;
+}
+
+static void rsv_insert(struct ext2_sb_info* sbi, struct ext2_reserve_window* rsv) {
+    struct list_head* pos;
+    list_for_each(pos, &sbi->rsv_windows) {
+        struct ext2_reserve_window* other = list_entry(pos, struct ext2_reserve_window, list);
+        if (other->start > rsv->start) {
+            break;
+        }
+    }
+    /* Вставка перед первым окном с большим началом */
+    list_add_tail(&rsv->list, pos);
+}
+
+static void rsv_remove(struct ext2_reserve_window* rsv) {
+    if (!rsv_empty(rsv)) {
+        list_del(&rsv->list);
+        rsv->start = 0;
+        rsv->end = 0;
+        rsv->alloc_hit = 0;
+    }
+}
+
+void ext2_discard_reservation(struct inode* inode) {
+    rsv_remove(&EXT2_I(inode)->rsv);
+}
+
+/* ============================================================================
+ * Поиск в битовой карте группы
+ * ============================================================================ */
+
+/*
+ * Первый свободный бит в [start, end), не попадающий в чужие окна.
+ * Возвращает номер бита или -1.
+ */
+static int64_t find_free_bit(struct ext2_sb_info* sbi, const uint8_t* bitmap,
+                             const uint8_t* committed, uint32_t group_base,
+                             uint32_t start, uint32_t end,
+                             const struct ext2_reserve_window* self) {
+    uint32_t bit = start;
+    while (bit < end) {
+        /* Быстрый пропуск полностью занятых байтов */
+        if ((bit & 7) == 0 && bit + 8 <= end &&
+            ext2_busy_byte(bitmap, committed, bit >> 3) == 0xFF) {
+            bit += 8;
+            continue;
+        }
+        if (ext2_block_busy(bitmap, committed, bit)) {
+            bit++;
+            continue;
+        }
+        struct ext2_reserve_window* other = rsv_conflict(sbi, group_base + bit, self);
+        if (other) {
+            bit = other->end + 1 - group_base;
+            continue;
+        }
+        return bit;
+    }
+    return -1;
+}
+
+/* Поиск непрерывной серии из size свободных битов, начиная с start */
+static int64_t find_free_run(struct ext2_sb_info* sbi, const uint8_t* bitmap,
+                             const uint8_t* committed, uint32_t group_base,
+                             uint32_t start, uint32_t end, uint32_t size,
+                             const struct ext2_reserve_window* self) {
+    while (start + size <= end) {
+        int64_t first = find_free_bit(sbi, bitmap, committed, group_base, start, end, self);
+        if (first < 0 || (uint32_t)first + size > end) {
+            return -1;
+        }
+        uint32_t length = 1;
+        while (length < size &&
+               !ext2_block_busy(bitmap, committed, (uint32_t)first + length) &&
+               !rsv_conflict(sbi, group_base + (uint32_t)first + length, self)) {
+            length++;
+        }
+        if (length == size) {
+            return first;
+        }
+        start = (uint32_t)first + length + 1;
+    }
+    return -1;
+}
+
+/* ============================================================================
+ * Выделение и освобождение блоков
+ * ============================================================================ */
+
+/* Захват бита group/bit: обновление карты, дескриптора и суперблока */
+static void claim_block(struct inode* inode, uint32_t group, struct buffer* bitmap,
+                        uint32_t bit) {
+    struct super_block* sb = inode->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    struct buffer* gd_buffer;
+    struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, &gd_buffer);
+
+    ext2_set_bit(bitmap->data, bit);
+    ext2_mark_buffer_dirty(sb, bitmap);
+    gd->bg_free_blocks_count--;
+    ext2_mark_buffer_dirty(sb, gd_buffer);
+    sbi->es->s_free_blocks_count--;
+    ext2_mark_super_dirty(sb);
+
+    EXT2_I(inode)->i_blocks += sbi->block_size >> SECTOR_SHIFT;
+    mark_inode_dirty(inode);
+}
+
+/* Попытка выделить блок из окна резервирования inode */
+static int alloc_from_window(struct inode* inode, uint32_t goal, uint32_t* block) {
+    struct ext2_sb_info* sbi = EXT2_SB(inode->sb);
+    struct ext2_reserve_window* rsv = &EXT2_I(inode)->rsv;
+    uint32_t group = (rsv->start - sbi->first_data_block) / sbi->blocks_per_group;
+    uint32_t base = ext2_group_first_block(sbi, group);
+    uint32_t start = (goal >= rsv->start && goal <= rsv->end) ? goal : rsv->start;
+
+    struct ext2_group_desc* gd = ext2_get_group_desc(inode->sb, group, NULL);
+    struct buffer bitmap;
+    if (bread(inode->sb->bdev, gd->bg_block_bitmap, sbi->block_size, &bitmap) < 0) {
+        return -EIO;
+    }
+
+    int64_t bit = find_free_bit(sbi, bitmap.data,
+                                ext2_journal_undo_data(inode->sb, gd->bg_block_bitmap),
+                                base, start - base, rsv->end + 1 - base, rsv);
+    if (bit < 0) {
+        brelse(&bitmap);
+        return -ENOSPC;
+    }
+    claim_block(inode, group, &bitmap, (uint32_t)bit);
+    brelse(&bitmap);
+
+    rsv->alloc_hit++;
+    *block = base + (uint32_t)bit;
+    return 0;
+}
+
+/*
+ * Новое окно для inode: непрерывная свободная серия goal_size блоков
+ * в группе цели или в следующих группах.
+ */
+static bool alloc_new_window(struct inode* inode, uint32_t goal_group, uint32_t goal_bit) {
+    struct ext2_sb_info* sbi = EXT2_SB(inode->sb);
+    struct ext2_reserve_window* rsv = &EXT2_I(inode)->rsv;
+
+    for (uint32_t i = 0; i < sbi->groups_count; i++) {
+        uint32_t group = (goal_group + i) % sbi->groups_count;
+        struct ext2_group_desc* gd = ext2_get_group_desc(inode->sb, group, NULL);
+        uint32_t nblocks = ext2_group_blocks(sbi, group);
+        uint32_t size = MIN(rsv->goal_size, nblocks);
+
+        if (gd->bg_free_blocks_count < size) {
+            continue;
+        }
+
+        struct buffer bitmap;
+        if (bread(inode->sb->bdev, gd->bg_block_bitmap, sbi->block_size, &bitmap) < 0) {
+            return false;
+        }
+        uint32_t base = ext2_group_first_block(sbi, group);
+        const uint8_t* committed = ext2_journal_undo_data(inode->sb, gd->bg_block_bitmap);
+        int64_t bit = find_free_run(sbi, bitmap.data, committed, base,
+                                    i == 0 ? goal_bit : 0, nblocks, size, rsv);
+        brelse(&bitmap);
+
+        if (bit >= 0) {
+            rsv->start = base + (uint32_t)bit;
+            rsv->end = rsv->start + size - 1;
+            rsv->alloc_hit = 0;
+            rsv_insert(sbi, rsv);
+            return true;
+        }
+    }
+    return false;
+}
+
+int ext2_new_block(struct inode* inode, uint32_t goal, bool reserve, uint32_t* block) {
+    struct super_block* sb = inode->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    struct ext2_reserve_window* rsv = &EXT2_I(inode)->rsv;
+
+    if (sbi->es->s_free_blocks_count == 0) {
+        return -ENOSPC;
+    }
+    if (goal < sbi->first_data_block || goal >= sbi->es->s_blocks_count) {
+        goal = ext2_group_first_block(sbi, EXT2_I(inode)->block_group);
+    }
+    uint32_t goal_group = (goal - sbi->first_data_block) / sbi->blocks_per_group;
+    uint32_t goal_bit = (goal - sbi->first_data_block) % sbi->blocks_per_group;
+
+    if (reserve && S_ISREG(inode->mode)) {
+        if (!rsv_empty(rsv)) {
+            if (alloc_from_window(inode, goal, block) == 0) {
+                return 0;
+            }
+            /* Окно исчерпано: следующее вдвое больше, если файл его съел */
+            uint32_t size = rsv->end - rsv->start + 1;
+            if (rsv->alloc_hit * 2 >= size) {
+                rsv->goal_size = MIN(rsv->goal_size * 2, EXT2_MAX_RESERVE_BLOCKS);
+            }
+            rsv_remove(rsv);
+        }
+        if (alloc_new_window(inode, goal_group, goal_bit) &&
+            alloc_from_window(inode, goal, block) == 0) {
+            return 0;
+        }
+    }
+
+    /* Без окна: ближайший к цели свободный блок */
+    for (uint32_t i = 0; i <= sbi->groups_count; i++) {
+        uint32_t group = (goal_group + i) % sbi->groups_count;
+        struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, NULL);
+        if (gd->bg_free_blocks_count == 0) {
+            continue;
+        }
+
+        struct buffer bitmap;
+        int err = bread(sb->bdev, gd->bg_block_bitmap, sbi->block_size, &bitmap);
+        if (err < 0) {
+            return err;
+        }
+        uint32_t base = ext2_group_first_block(sbi, group);
+        uint32_t nblocks = ext2_group_blocks(sbi, group);
+        const uint8_t* committed = ext2_journal_undo_data(sb, gd->bg_block_bitmap);
+        int64_t bit = -1;
+
+        if (i == 0) {
+            bit = find_free_bit(sbi, bitmap.data, committed, base, goal_bit, nblocks, rsv);
+        } else if (i == sbi->groups_count) {
+            /* Полный круг: начало группы цели до самой цели */
+            bit = find_free_bit(sbi, bitmap.data, committed, base, 0, goal_bit, rsv);
+        } else {
+            bit = find_free_bit(sbi, bitmap.data, committed, base, 0, nblocks, rsv);
+        }
+
+        if (bit >= 0) {
+            claim_block(inode, group, &bitmap, (uint32_t)bit);
+            brelse(&bitmap);
+            *block = base + (uint32_t)bit;
+            return 0;
+        }
+        brelse(&bitmap);
+    }
+    return -ENOSPC;
+}
+
+void ext2_free_blocks(struct inode* inode, uint32_t block, uint32_t count) {
+    struct super_block* sb = inode->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+
+    for (uint32_t i = 0; i < count; i++, block++) {
+        if (block < sbi->first_data_block || block >= sbi->es->s_blocks_count) {
+            terminal_writestring("  ext2: freeing block outside of filesystem\n");
+            continue;
+        }
+        uint32_t group = (block - sbi->first_data_block) / sbi->blocks_per_group;
+        uint32_t bit = (block - sbi->first_data_block) % sbi->blocks_per_group;
+        struct buffer* gd_buffer;
+        struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, &gd_buffer);
+
+        struct buffer bitmap;
+        if (bread(sb->bdev, gd->bg_block_bitmap, sbi->block_size, &bitmap) < 0) {
+            continue;
+        }
+        if (!ext2_test_bit(bitmap.data, bit)) {
+            terminal_writestring("  ext2: freeing already free block\n");
+            brelse(&bitmap);
+            continue;
+        }
+        if (ext2_journal_get_undo_access(sb, &bitmap) < 0) {
+            brelse(&bitmap);
+            continue;
+        }
+        ext2_clear_bit(bitmap.data, bit);
+        ext2_mark_buffer_dirty(sb, &bitmap);
+        brelse(&bitmap);
+
+        /* Отложенная запись освобождённого блока метаданных больше не нужна */
+        ext2_journal_forget(sb, block);
+        bforget(sb->bdev, block, sbi->block_size);
+
+        gd->bg_free_blocks_count++;
+        ext2_mark_buffer_dirty(sb, gd_buffer);
+        sbi->es->s_free_blocks_count++;
+        EXT2_I(inode)->i_blocks -= sbi->block_size >> SECTOR_SHIFT;
+    }
+    ext2_mark_super_dirty(sb);
+    mark_inode_dirty(inode);
+}
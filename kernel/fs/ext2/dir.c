@@ -0,0 +1,521 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/ext2/dir.c
+ * Драйвер ext2: каталоги (линейный формат) и операции с именами
+ * ============================================================================
+ */
+
+#include "fs/ext2/ext2.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Блоки каталога (через page cache каталога)
+ * ============================================================================ */
+
+int ext2_dir_block(struct inode* dir, uint32_t n, bool create,
+                   struct page** page, struct ext2_dir_entry** data) {
+    uint32_t block_size = dir->sb->block_size;
+    uint64_t offset = (uint64_t)n * block_size;
+    bool append = offset >= dir->size;
+
+    if (append && !create) {
+        return -ENOENT;
+    }
+    if (append) {
+        uint32_t physical;
+        int err = ext2_get_block(dir, n, true, &physical);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    int err = read_cache_page(&dir->mapping, offset >> PAGE_SHIFT, page);
+    if (err < 0) {
+        return err;
+    }
+    *data = (struct ext2_dir_entry*)((uint8_t*)page_address(*page) +
+                                     (offset & (PAGE_SIZE - 1)));
+
+    if (append) {
+        /* Новый блок: одна пустая запись на весь блок */
+        memset(*data, 0, block_size);
+        (*data)->rec_len = (uint16_t)block_size;
+        dir->size = offset + block_size;
+        mark_inode_dirty(dir);
+        ext2_dir_block_dirty(dir, *page);
+    }
+    return 0;
+}
+
+/* С журналом блоки каталога - метаданные: они пишутся транзакцией, а не страницей */
+void ext2_dir_block_dirty(struct inode* dir, struct page* page) {
+    struct journal* journal = EXT2_SB(dir->sb)->journal;
+    if (!journal) {
+        set_page_dirty(page);
+        return;
+    }
+
+    uint32_t block_size = dir->sb->block_size;
+    uint32_t blocks_per_page = PAGE_SIZE / block_size;
+    uint32_t first_iblock = (uint32_t)(page->index * blocks_per_page);
+    uint8_t* data = page_address(page);
+
+    for (uint32_t i = 0; i < blocks_per_page; i++) {
+        uint32_t physical;
+        if ((uint64_t)(first_iblock + i) * block_size >= dir->size ||
+            ext2_get_block(dir, first_iblock + i, false, &physical) < 0) {
+            break;
+        }
+        if (physical) {
+            jbd_dirty_block(journal, physical, page, data + i * block_size);
+        }
+    }
+    EXT2_I(dir)->i_sync_tid = journal->tid;
+}
+
+bool ext2_check_dir_entry(struct inode* dir, struct ext2_dir_entry* de, uint32_t offset) {
+    uint32_t block_size = dir->sb->block_size;
+    if (de->rec_len < EXT2_DIR_REC_LEN(1) || (de->rec_len & 3) ||
+        de->rec_len < EXT2_DIR_REC_LEN(de->name_len) ||
+        offset + de->rec_len > block_size) {
+        terminal_writestring("  ext2: corrupted directory entry\n");
+        return false;
+    }
+    return true;
+}
+
+uint8_t ext2_file_type(uint32_t mode) {
+    switch (mode & S_IFMT) {
+        case S_IFREG:  return EXT2_FT_REG_FILE;
+        case S_IFDIR:  return EXT2_FT_DIR;
+        case S_IFCHR:  return EXT2_FT_CHRDEV;
+        case S_IFBLK:  return EXT2_FT_BLKDEV;
+        case S_IFIFO:  return EXT2_FT_FIFO;
+        case S_IFSOCK: return EXT2_FT_SOCK;
+        case S_IFLNK:  return EXT2_FT_SYMLINK;
+        default:       return EXT2_FT_UNKNOWN;
+    }
+}
+
+static uint8_t ext2_dtype(uint8_t file_type) {
+    static const uint8_t types[] = {
+        DT_UNKNOWN, DT_REG, DT_DIR, DT_CHR, DT_BLK, DT_FIFO, DT_SOCK, DT_LNK,
+    };
+    return file_type < ARRAY_SIZE(types) ? types[file_type] : DT_UNKNOWN;
+}
+
+static inline bool ext2_match(struct ext2_dir_entry* de, const char* name, size_t len) {
+    return de->inode && de->name_len == len && memcmp(de->name, name, len) == 0;
+}
+
+/* ============================================================================
+ * Поиск, добавление и удаление записей
+ * ============================================================================ */
+
+/* Поиск имени в одном блоке; заполняет entry/prev в loc */
+int ext2_search_block(struct inode* dir, struct ext2_dir_entry* block,
+                      const char* name, size_t len, struct ext2_dir_location* loc) {
+    uint32_t block_size = dir->sb->block_size;
+    struct ext2_dir_entry* prev = NULL;
+    uint32_t offset = 0;
+
+    while (offset < block_size) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)((uint8_t*)block + offset);
+        if (!ext2_check_dir_entry(dir, de, offset)) {
+            return -EFSCORRUPTED;
+        }
+        if (ext2_match(de, name, len)) {
+            loc->block = block;
+            loc->entry = de;
+            loc->prev = prev;
+            return 0;
+        }
+        prev = de;
+        offset += de->rec_len;
+    }
+    return -ENOENT;
+}
+
+/* Линейный поиск по всем блокам каталога */
+static int ext2_find_entry_linear(struct inode* dir, const char* name, size_t len,
+                                  struct ext2_dir_location* loc) {
+    uint32_t nblocks = (uint32_t)(dir->size / dir->sb->block_size);
+
+    for (uint32_t n = 0; n < nblocks; n++) {
+        struct page* page;
+        struct ext2_dir_entry* block;
+        int err = ext2_dir_block(dir, n, false, &page, &block);
+        if (err < 0) {
+            return err;
+        }
+        err = ext2_search_block(dir, block, name, len, loc);
+        if (err == 0) {
+            loc->page = page;
+            return 0;
+        }
+        page_cache_release(page);
+        if (err != -ENOENT) {
+            return err;
+        }
+    }
+    return -ENOENT;
+}
+
+static bool is_dot_or_dotdot(const char* name, size_t len) {
+    return (len == 1 && name[0] == '.') || (len == 2 && name[0] == '.' && name[1] == '.');
+}
+
+static int ext2_find_entry(struct inode* dir, const char* name, size_t len,
+                           struct ext2_dir_location* loc) {
+    /* "." и ".." лежат в корневом блоке индекса, а не в листьях */
+    if (ext2_dx_enabled(dir) && !is_dot_or_dotdot(name, len)) {
+        int err = ext2_dx_find_entry(dir, name, len, loc);
+        if (err != -EAGAIN) {
+            return err;
+        }
+    }
+    return ext2_find_entry_linear(dir, name, len, loc);
+}
+
+int ext2_add_to_block(struct inode* dir, struct ext2_dir_entry* block,
+                      const char* name, size_t len, struct inode* inode) {
+    struct ext2_sb_info* sbi = EXT2_SB(dir->sb);
+    uint32_t block_size = sbi->block_size;
+    uint32_t needed = EXT2_DIR_REC_LEN(len);
+    uint32_t offset = 0;
+
+    while (offset < block_size) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)((uint8_t*)block + offset);
+        if (!ext2_check_dir_entry(dir, de, offset)) {
+            return -EFSCORRUPTED;
+        }
+        if (ext2_match(de, name, len)) {
+            return -EEXIST;
+        }
+
+        uint32_t used = de->inode ? EXT2_DIR_REC_LEN(de->name_len) : 0;
+        if (de->rec_len - used >= needed) {
+            if (de->inode) {
+                /* Отделяем хвост существующей записи */
+                struct ext2_dir_entry* tail = (struct ext2_dir_entry*)((uint8_t*)de + used);
+                tail->rec_len = (uint16_t)(de->rec_len - used);
+                de->rec_len = (uint16_t)used;
+                de = tail;
+            }
+            de->inode = (uint32_t)inode->ino;
+            de->name_len = (uint8_t)len;
+            de->file_type = ext2_has_incompat(sbi, EXT2_FEATURE_INCOMPAT_FILETYPE)
+                          ? ext2_file_type(inode->mode) : 0;
+            memcpy(de->name, name, len);
+            return 0;
+        }
+        offset += de->rec_len;
+    }
+    return -ENOSPC;
+}
+
+static int ext2_add_link(struct inode* dir, const char* name, size_t len, struct inode* inode) {
+    uint32_t block_size = dir->sb->block_size;
+    uint32_t nblocks = (uint32_t)(dir->size / block_size);
+    struct page* page;
+    struct ext2_dir_entry* block;
+    int err;
+
+    if (ext2_dx_enabled(dir)) {
+        err = ext2_dx_add_entry(dir, name, len, inode);
+        if (err != -EAGAIN) {
+            goto out;
+        }
+        /* Индекс непригоден и снят: каталог снова линейный */
+        nblocks = (uint32_t)(dir->size / block_size);
+    }
+
+    for (uint32_t n = 0; n < nblocks; n++) {
+        err = ext2_dir_block(dir, n, false, &page, &block);
+        if (err < 0) {
+            return err;
+        }
+        err = ext2_add_to_block(dir, block, name, len, inode);
+        if (err == 0) {
+            ext2_dir_block_dirty(dir, page);
+        }
+        page_cache_release(page);
+        if (err != -ENOSPC) {
+            goto out;
+        }
+    }
+
+    /* Первый блок заполнен: каталог переводится на htree-индекс */
+    if (nblocks == 1 && ext2_has_compat(EXT2_SB(dir->sb), EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        err = ext2_make_indexed_dir(dir, name, len, inode);
+        if (err != -EAGAIN) {
+            goto out;
+        }
+    }
+
+    err = ext2_dir_block(dir, nblocks, true, &page, &block);
+    if (err < 0) {
+        return err;
+    }
+    err = ext2_add_to_block(dir, block, name, len, inode);
+    ext2_dir_block_dirty(dir, page);
+    page_cache_release(page);
+
+out:
+    if (err == 0) {
+        dir->mtime = dir->ctime = ext2_current_time(dir->sb);
+        mark_inode_dirty(dir);
+    }
+    return err;
+}
+
+static void ext2_delete_entry(struct inode* dir, struct ext2_dir_location* loc) {
+    if (loc->prev) {
+        loc->prev->rec_len = (uint16_t)(loc->prev->rec_len + loc->entry->rec_len);
+    } else {
+        loc->entry->inode = 0;
+    }
+    ext2_dir_block_dirty(dir, loc->page);
+    dir->mtime = dir->ctime = ext2_current_time(dir->sb);
+    mark_inode_dirty(dir);
+}
+
+/* Каталог пуст, если кроме "." и ".." в нём нет записей */
+static int ext2_empty_dir(struct inode* dir) {
+    uint32_t block_size = dir->sb->block_size;
+    uint32_t nblocks = (uint32_t)(dir->size / block_size);
+
+    for (uint32_t n = 0; n < nblocks; n++) {
+        struct page* page;
+        struct ext2_dir_entry* block;
+        int err = ext2_dir_block(dir, n, false, &page, &block);
+        if (err < 0) {
+            return err;
+        }
+        for (uint32_t offset = 0; offset < block_size; ) {
+            struct ext2_dir_entry* de = (struct ext2_dir_entry*)((uint8_t*)block + offset);
+            if (!ext2_check_dir_entry(dir, de, offset)) {
+                page_cache_release(page);
+                return -EFSCORRUPTED;
+            }
+            if (de->inode && !is_dot_or_dotdot(de->name, de->name_len)) {
+                page_cache_release(page);
+                return -ENOTEMPTY;
+            }
+            offset += de->rec_len;
+        }
+        page_cache_release(page);
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Операции каталога
+ * ============================================================================ */
+
+static int ext2_lookup(struct inode* dir, const char* name, size_t len, struct inode** out) {
+    struct ext2_dir_location loc;
+    int err = ext2_find_entry(dir, name, len, &loc);
+    if (err < 0) {
+        return err;
+    }
+    uint32_t ino = loc.entry->inode;
+    page_cache_release(loc.page);
+    return iget(dir->sb, ino, out);
+}
+
+static int ext2_create(struct inode* dir, const char* name, size_t len,
+                       uint32_t mode, struct inode** out) {
+    int err = ext2_journal_start(dir->sb);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode;
+    err = ext2_new_inode(dir, mode, &inode);
+    if (err < 0) {
+        return err;
+    }
+    inode->nlink = 1;
+    mark_inode_dirty(inode);
+
+    err = ext2_add_link(dir, name, len, inode);
+    if (err < 0) {
+        inode->nlink = 0;
+        iput(inode);
+        return err;
+    }
+    *out = inode;
+    return 0;
+}
+
+static int ext2_mkdir(struct inode* dir, const char* name, size_t len,
+                      uint32_t mode, struct inode** out) {
+    if (dir->nlink >= EXT2_LINK_MAX) {
+        return -EMLINK;
+    }
+    int err = ext2_journal_start(dir->sb);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode;
+    err = ext2_new_inode(dir, mode, &inode);
+    if (err < 0) {
+        return err;
+    }
+
+    struct page* page;
+    struct ext2_dir_entry* block;
+    err = ext2_dir_block(inode, 0, true, &page, &block);
+    if (err < 0) {
+        iput(inode);
+        return err;
+    }
+
+    bool filetype = ext2_has_incompat(EXT2_SB(dir->sb), EXT2_FEATURE_INCOMPAT_FILETYPE);
+    struct ext2_dir_entry* dot = block;
+    dot->inode = (uint32_t)inode->ino;
+    dot->rec_len = EXT2_DIR_REC_LEN(1);
+    dot->name_len = 1;
+    dot->file_type = filetype ? EXT2_FT_DIR : 0;
+    memcpy(dot->name, ".", 1);
+
+    struct ext2_dir_entry* dotdot = ext2_next_entry(dot);
+    dotdot->inode = (uint32_t)dir->ino;
+    dotdot->rec_len = (uint16_t)(inode->sb->block_size - dot->rec_len);
+    dotdot->name_len = 2;
+    dotdot->file_type = filetype ? EXT2_FT_DIR : 0;
+    memcpy(dotdot->name, "..", 2);
+    ext2_dir_block_dirty(inode, page);
+    page_cache_release(page);
+
+    inode->nlink = 2;
+    mark_inode_dirty(inode);
+
+    err = ext2_add_link(dir, name, len, inode);
+    if (err < 0) {
+        inode->nlink = 0;
+        iput(inode);
+        return err;
+    }
+    dir->nlink++;
+    mark_inode_dirty(dir);
+    *out = inode;
+    return 0;
+}
+
+static int ext2_unlink(struct inode* dir, const char* name, size_t len) {
+    int err = ext2_journal_start(dir->sb);
+    if (err < 0) {
+        return err;
+    }
+
+    struct ext2_dir_location loc;
+    err = ext2_find_entry(dir, name, len, &loc);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode;
+    err = iget(dir->sb, loc.entry->inode, &inode);
+    if (err < 0) {
+        page_cache_release(loc.page);
+        return err;
+    }
+    ext2_delete_entry(dir, &loc);
+    page_cache_release(loc.page);
+
+    if (inode->nlink) {
+        inode->nlink--;
+    }
+    inode->ctime = dir->ctime;
+    mark_inode_dirty(inode);
+    iput(inode);
+    return 0;
+}
+
+static int ext2_rmdir(struct inode* dir, const char* name, size_t len) {
+    if (is_dot_or_dotdot(name, len)) {
+        return -EINVAL;
+    }
+    int err = ext2_journal_start(dir->sb);
+    if (err < 0) {
+        return err;
+    }
+
+    struct ext2_dir_location loc;
+    err = ext2_find_entry(dir, name, len, &loc);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode;
+    err = iget(dir->sb, loc.entry->inode, &inode);
+    if (err < 0) {
+        page_cache_release(loc.page);
+        return err;
+    }
+    err = ext2_empty_dir(inode);
+    if (err < 0) {
+        page_cache_release(loc.page);
+        iput(inode);
+        return err;
+    }
+
+    ext2_delete_entry(dir, &loc);
+    page_cache_release(loc.page);
+
+    inode->nlink = 0;
+    mark_inode_dirty(inode);
+    dir->nlink--;
+    mark_inode_dirty(dir);
+    iput(inode);
+    return 0;
+}
+
+static int ext2_readdir(struct file* file, filldir_t filldir, void* ctx) {
+    struct inode* dir = file->inode;
+    uint32_t block_size = dir->sb->block_size;
+
+    while (file->pos < dir->size) {
+        uint32_t n = (uint32_t)(file->pos / block_size);
+        uint32_t offset = (uint32_t)(file->pos % block_size);
+        struct page* page;
+        struct ext2_dir_entry* block;
+
+        int err = ext2_dir_block(dir, n, false, &page, &block);
+        if (err < 0) {
+            return err;
+        }
+        while (offset < block_size) {
+            struct ext2_dir_entry* de = (struct ext2_dir_entry*)((uint8_t*)block + offset);
+            if (!ext2_check_dir_entry(dir, de, offset)) {
+                page_cache_release(page);
+                return -EFSCORRUPTED;
+            }
+            if (de->inode &&
+                filldir(ctx, de->name, de->name_len, de->inode, ext2_dtype(de->file_type))) {
+                page_cache_release(page);
+                return 0;
+            }
+            offset += de->rec_len;
+            file->pos += de->rec_len;
+        }
+        page_cache_release(page);
+    }
+    return 0;
+}
+
+const struct inode_operations ext2_dir_inode_operations = {
+    .lookup = ext2_lookup,
+    .create = ext2_create,
+    .mkdir = ext2_mkdir,
+    .unlink = ext2_unlink,
+    .rmdir = ext2_rmdir,
+};
+
+const struct file_operations ext2_dir_operations = {
+    .readdir = ext2_readdir,
+    .fsync = ext2_fsync,
+};
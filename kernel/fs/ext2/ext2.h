@@ -0,0 +1,331 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/ext2/ext2.h
+ * Драйвер ext2: дисковые структуры и внутренние интерфейсы
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_EXT2_H
+#define MIXOS_FS_EXT2_H
+
+#include "fs/vfs.h"
+#include "fs/jbd/jbd.h"
+
+#define EXT2_SUPER_MAGIC        0xEF53
+#define EXT2_SUPERBLOCK_OFFSET  1024
+#define EXT2_ROOT_INO           2
+#define EXT2_GOOD_OLD_FIRST_INO 11
+#define EXT2_GOOD_OLD_INODE_SIZE 128
+#define EXT2_LINK_MAX           32000
+#define EXT2_NAME_LEN           255
+
+/* Номера блоков в i_block */
+#define EXT2_NDIR_BLOCKS        12
+#define EXT2_IND_BLOCK          12
+#define EXT2_DIND_BLOCK         13
+#define EXT2_TIND_BLOCK         14
+#define EXT2_N_BLOCKS           15
+
+/* Флаги совместимости */
+#define EXT2_FEATURE_COMPAT_HAS_JOURNAL     0x0004
+#define EXT2_FEATURE_COMPAT_DIR_INDEX       0x0020
+#define EXT2_FEATURE_INCOMPAT_FILETYPE      0x0002
+#define EXT2_FEATURE_INCOMPAT_RECOVER       0x0004  /* Журнал не очищен */
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE   0x0002
+
+#define EXT2_FEATURE_INCOMPAT_SUPP      (EXT2_FEATURE_INCOMPAT_FILETYPE | \
+                                         EXT2_FEATURE_INCOMPAT_RECOVER)
+#define EXT2_FEATURE_RO_COMPAT_SUPP     (EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | \
+                                         EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+
+/* s_flags: знаковость char при вычислении хеша каталогов */
+#define EXT2_FLAGS_SIGNED_HASH      0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH    0x0002
+
+/* Флаги inode */
+#define EXT2_INDEX_FL           0x00001000  /* Каталог с htree-индексом */
+
+/* Типы записей каталога (INCOMPAT_FILETYPE) */
+#define EXT2_FT_UNKNOWN         0
+#define EXT2_FT_REG_FILE        1
+#define EXT2_FT_DIR             2
+#define EXT2_FT_CHRDEV          3
+#define EXT2_FT_BLKDEV          4
+#define EXT2_FT_FIFO            5
+#define EXT2_FT_SOCK            6
+#define EXT2_FT_SYMLINK         7
+
+/* ============================================================================
+ * Дисковые структуры (little-endian)
+ * ============================================================================ */
+
+struct ext2_super_block {
+    uint32_t s_inodes_count;
+    uint32_t s_blocks_count;
+    uint32_t s_r_blocks_count;
+    uint32_t s_free_blocks_count;
+    uint32_t s_free_inodes_count;
+    uint32_t s_first_data_block;
+    uint32_t s_log_block_size;
+    uint32_t s_log_frag_size;
+    uint32_t s_blocks_per_group;
+    uint32_t s_frags_per_group;
+    uint32_t s_inodes_per_group;
+    uint32_t s_mtime;
+    uint32_t s_wtime;
+    uint16_t s_mnt_count;
+    int16_t  s_max_mnt_count;
+    uint16_t s_magic;
+    uint16_t s_state;
+    uint16_t s_errors;
+    uint16_t s_minor_rev_level;
+    uint32_t s_lastcheck;
+    uint32_t s_checkinterval;
+    uint32_t s_creator_os;
+    uint32_t s_rev_level;
+    uint16_t s_def_resuid;
+    uint16_t s_def_resgid;
+    /* EXT2_DYNAMIC_REV */
+    uint32_t s_first_ino;
+    uint16_t s_inode_size;
+    uint16_t s_block_group_nr;
+    uint32_t s_feature_compat;
+    uint32_t s_feature_incompat;
+    uint32_t s_feature_ro_compat;
+    uint8_t  s_uuid[16];
+    char     s_volume_name[16];
+    char     s_last_mounted[64];
+    uint32_t s_algorithm_usage_bitmap;
+    uint8_t  s_prealloc_blocks;
+    uint8_t  s_prealloc_dir_blocks;
+    uint16_t s_reserved_gdt_blocks;
+    uint8_t  s_journal_uuid[16];
+    uint32_t s_journal_inum;
+    uint32_t s_journal_dev;
+    uint32_t s_last_orphan;
+    uint32_t s_hash_seed[4];
+    uint8_t  s_def_hash_version;
+    uint8_t  s_jnl_backup_type;
+    uint16_t s_desc_size;
+    uint32_t s_default_mount_opts;
+    uint32_t s_first_meta_bg;
+    uint32_t s_mkfs_time;
+    uint32_t s_jnl_blocks[17];
+    uint32_t s_blocks_count_hi;
+    uint32_t s_r_blocks_count_hi;
+    uint32_t s_free_blocks_hi;
+    uint16_t s_min_extra_isize;
+    uint16_t s_want_extra_isize;
+    uint32_t s_flags;
+    uint8_t  s_reserved[668];
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct ext2_super_block) == 1024, "ext2 superblock size");
+_Static_assert(offsetof(struct ext2_super_block, s_flags) == 0x160, "ext2 s_flags offset");
+
+struct ext2_group_desc {
+    uint32_t bg_block_bitmap;
+    uint32_t bg_inode_bitmap;
+    uint32_t bg_inode_table;
+    uint16_t bg_free_blocks_count;
+    uint16_t bg_free_inodes_count;
+    uint16_t bg_used_dirs_count;
+    uint16_t bg_pad;
+    uint32_t bg_reserved[3];
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct ext2_group_desc) == 32, "ext2 group descriptor size");
+
+struct ext2_inode {
+    uint16_t i_mode;
+    uint16_t i_uid;
+    uint32_t i_size;
+    uint32_t i_atime;
+    uint32_t i_ctime;
+    uint32_t i_mtime;
+    uint32_t i_dtime;
+    uint16_t i_gid;
+    uint16_t i_links_count;
+    uint32_t i_blocks;              /* В единицах по 512 байт */
+    uint32_t i_flags;
+    uint32_t i_osd1;
+    uint32_t i_block[EXT2_N_BLOCKS];
+    uint32_t i_generation;
+    uint32_t i_file_acl;
+    uint32_t i_size_high;
+    uint32_t i_faddr;
+    uint16_t i_blocks_hi;
+    uint16_t i_file_acl_high;
+    uint16_t i_uid_high;
+    uint16_t i_gid_high;
+    uint32_t i_osd2_reserved;
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct ext2_inode) == 128, "ext2 inode size");
+
+struct ext2_dir_entry {
+    uint32_t inode;
+    uint16_t rec_len;
+    uint8_t  name_len;
+    uint8_t  file_type;
+    char     name[];
+} __attribute__((packed));
+
+#define EXT2_DIR_ENTRY_HEADER   8
+#define EXT2_DIR_REC_LEN(len)   (((len) + EXT2_DIR_ENTRY_HEADER + 3) & ~3U)
+
+/* ============================================================================
+ * Структуры в памяти
+ * ============================================================================ */
+
+/*
+ * Окно резервирования: непрерывный диапазон свободных блоков, который
+ * растущий файл занимает в первую очередь. Другие inode обходят чужие
+ * окна, поэтому последовательная запись получает непрерывные экстенты.
+ */
+struct ext2_reserve_window {
+    uint32_t start;                 /* 0 - окна нет */
+    uint32_t end;                   /* Включительно */
+    uint32_t goal_size;             /* Размер следующего окна в блоках */
+    uint32_t alloc_hit;             /* Блоков выделено из текущего окна */
+    struct list_head list;          /* Упорядоченный список окон ФС */
+};
+
+struct ext2_inode_info {
+    uint32_t i_block[EXT2_N_BLOCKS];
+    uint32_t i_flags;
+    uint32_t i_dtime;
+    uint32_t i_blocks;
+    uint32_t i_file_acl;
+    uint32_t i_generation;
+    uint32_t block_group;           /* Группа, в которой создан inode */
+    uint32_t last_alloc_logical;    /* Последний выделенный логический блок */
+    uint32_t last_alloc_physical;
+    struct ext2_reserve_window rsv;
+    struct jbd_inode jinode;        /* Упорядоченные данные в журнале */
+    uint32_t i_sync_tid;            /* Транзакция последнего изменения метаданных */
+    struct inode vfs_inode;
+};
+
+struct ext2_sb_info {
+    struct super_block* sb;
+    struct buffer sb_buffer;        /* Закреплённый буфер суперблока */
+    struct ext2_super_block* es;
+    struct buffer* gd_buffers;      /* Закреплённые блоки таблицы дескрипторов */
+    uint32_t gd_blocks;
+    uint32_t block_size;
+    uint32_t blocks_per_group;
+    uint32_t inodes_per_group;
+    uint32_t groups_count;
+    uint32_t first_data_block;
+    uint32_t first_ino;
+    uint32_t inode_size;
+    uint32_t inodes_per_block;
+    uint32_t desc_per_block;
+    uint32_t addr_per_block;
+    uint32_t addr_per_block_bits;
+    uint32_t hash_seed[4];
+    uint8_t def_hash_version;
+    uint8_t hash_unsigned;          /* 3, если хеш считается по unsigned char */
+    struct list_head rsv_windows;   /* Окна резервирования, по возрастанию */
+    struct journal* journal;        /* NULL - ФС без журнала */
+};
+
+/* Начальный и максимальный размер окна резервирования (в блоках) */
+#define EXT2_DEFAULT_RESERVE_BLOCKS 8
+#define EXT2_MAX_RESERVE_BLOCKS     1024
+
+static inline struct ext2_inode_info* EXT2_I(struct inode* inode) {
+    return container_of(inode, struct ext2_inode_info, vfs_inode);
+}
+
+static inline struct ext2_sb_info* EXT2_SB(struct super_block* sb) {
+    return sb->fs_info;
+}
+
+static inline bool ext2_has_compat(struct ext2_sb_info* sbi, uint32_t mask) {
+    return (sbi->es->s_feature_compat & mask) != 0;
+}
+
+static inline bool ext2_has_incompat(struct ext2_sb_info* sbi, uint32_t mask) {
+    return (sbi->es->s_feature_incompat & mask) != 0;
+}
+
+/* super.c */
+struct ext2_group_desc* ext2_get_group_desc(struct super_block* sb, uint32_t group,
+                                            struct buffer** buf);
+uint32_t ext2_current_time(struct super_block* sb);
+void ext2_mark_super_dirty(struct super_block* sb);
+
+/* balloc.c */
+int ext2_new_block(struct inode* inode, uint32_t goal, bool reserve, uint32_t* block);
+void ext2_free_blocks(struct inode* inode, uint32_t block, uint32_t count);
+void ext2_discard_reservation(struct inode* inode);
+uint32_t ext2_group_first_block(struct ext2_sb_info* sbi, uint32_t group);
+
+/* ialloc.c */
+int ext2_new_inode(struct inode* dir, uint32_t mode, struct inode** out);
+void ext2_free_inode(struct inode* inode);
+
+/* inode.c */
+extern const struct address_space_ops ext2_aops;
+extern const struct inode_operations ext2_file_inode_operations;
+extern const struct file_operations ext2_file_operations;
+int ext2_read_inode(struct inode* inode);
+int ext2_write_inode(struct inode* inode);
+void ext2_evict_inode(struct inode* inode);
+int ext2_get_block(struct inode* inode, uint32_t iblock, bool create, uint32_t* block);
+int ext2_truncate(struct inode* inode, uint64_t size);
+void ext2_set_inode_ops(struct inode* inode);
+
+/* dir.c */
+/* Положение найденной записи каталога */
+struct ext2_dir_location {
+    struct page* page;
+    struct ext2_dir_entry* block;   /* Начало блока каталога */
+    struct ext2_dir_entry* entry;   /* Найденная запись */
+    struct ext2_dir_entry* prev;    /* Предыдущая запись в блоке или NULL */
+};
+
+extern const struct inode_operations ext2_dir_inode_operations;
+extern const struct file_operations ext2_dir_operations;
+int ext2_dir_block(struct inode* dir, uint32_t n, bool create,
+                   struct page** page, struct ext2_dir_entry** data);
+void ext2_dir_block_dirty(struct inode* dir, struct page* page);
+bool ext2_check_dir_entry(struct inode* dir, struct ext2_dir_entry* de,
+                          uint32_t offset);
+int ext2_search_block(struct inode* dir, struct ext2_dir_entry* block,
+                      const char* name, size_t len, struct ext2_dir_location* loc);
+int ext2_add_to_block(struct inode* dir, struct ext2_dir_entry* block,
+                      const char* name, size_t len, struct inode* inode);
+uint8_t ext2_file_type(uint32_t mode);
+
+static inline struct ext2_dir_entry* ext2_next_entry(struct ext2_dir_entry* de) {
+    return (struct ext2_dir_entry*)((uint8_t*)de + de->rec_len);
+}
+
+/* htree.c: хешированный индекс каталогов */
+bool ext2_dx_enabled(struct inode* dir);
+int ext2_dx_find_entry(struct inode* dir, const char* name, size_t len,
+                       struct ext2_dir_location* loc);
+int ext2_dx_add_entry(struct inode* dir, const char* name, size_t len,
+                      struct inode* inode);
+int ext2_make_indexed_dir(struct inode* dir, const char* name, size_t len,
+                          struct inode* inode);
+
+/* journal.c: журнал ext3 (метаданные через JBD2, данные в режиме ordered) */
+int ext2_load_journal(struct super_block* sb);
+int ext2_journal_start(struct super_block* sb);
+void ext2_mark_buffer_dirty(struct super_block* sb, struct buffer* buf);
+int ext2_journal_get_undo_access(struct super_block* sb, struct buffer* buf);
+const uint8_t* ext2_journal_undo_data(struct super_block* sb, uint32_t block);
+void ext2_journal_forget(struct super_block* sb, uint32_t block);
+void ext2_journal_file_inode(struct inode* inode);
+int ext2_journal_read_page(struct inode* inode, struct page* page);
+bool ext2_journal_retry_alloc(struct super_block* sb);
+int ext2_fsync(struct file* file);
+
+void ext2_init(void);
+
+#endif /* MIXOS_FS_EXT2_H */
@@ -0,0 +1,790 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/ext2/htree.c
+ * Драйвер ext2: хешированный индекс каталогов (htree, dir_index)
+ *
+ * Блок 0 индексированного каталога содержит "." и "..", за которыми идёт
+ * корень индекса: упорядоченные по хешу пары (hash, блок). При одном
+ * промежуточном уровне узлов поиск имени читает не более трёх блоков
+ * независимо от размера каталога. Блоки индекса выглядят для линейного
+ * обхода как пустые записи, поэтому формат совместим с Linux.
+ * ============================================================================
+ */
+
+#include "fs/ext2/ext2.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+#define DX_HASH_LEGACY              0
+#define DX_HASH_HALF_MD4            1
+#define DX_HASH_TEA                 2
+#define DX_HASH_LEGACY_UNSIGNED     3
+#define DX_HASH_HALF_MD4_UNSIGNED   4
+#define DX_HASH_TEA_UNSIGNED        5
+
+#define DX_HTREE_EOF                0x7FFFFFFFU
+#define DX_ROOT_INFO_OFFSET         24      /* После записей "." и ".." */
+#define DX_NODE_HEADER              8       /* Фиктивная пустая запись */
+
+/* Корень и один уровень промежуточных узлов */
+#define DX_MAX_LEVELS               2
+
+struct dx_root_info {
+    uint32_t reserved_zero;
+    uint8_t hash_version;
+    uint8_t info_length;
+    uint8_t indirect_levels;
+    uint8_t unused_flags;
+} __attribute__((packed));
+
+struct dx_entry {
+    uint32_t hash;
+    uint32_t block;
+} __attribute__((packed));
+
+/* Занимает место поля hash первой записи массива */
+struct dx_countlimit {
+    uint16_t limit;
+    uint16_t count;
+} __attribute__((packed));
+
+struct dx_hash_info {
+    uint32_t hash;
+    uint32_t minor_hash;
+    int version;
+    const uint32_t* seed;
+};
+
+struct dx_frame {
+    struct page* page;
+    uint8_t* block;
+    struct dx_entry* entries;
+    struct dx_entry* at;
+};
+
+struct dx_map_entry {
+    uint32_t hash;
+    uint16_t offset;
+    uint16_t size;
+};
+
+/* ============================================================================
+ * Хеш-функции имён (совместимы с Linux ext3/ext4)
+ * ============================================================================ */
+
+static inline uint32_t rol32(uint32_t word, unsigned int shift) {
+    return (word << shift) | (word >> (32 - shift));
+}
+
+#define TEA_DELTA 0x9E3779B9U
+
+static void tea_transform(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+
+    for (int n = 0; n < 16; n++) {
+        sum += TEA_DELTA;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+#define MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD4_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = rol32(a, s))
+#define MD4_K1 0U
+#define MD4_K2 013240474631U
+#define MD4_K3 015666365641U
+
+static void half_md4_transform(uint32_t buf[4], const uint32_t in[8]) {
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    MD4_ROUND(MD4_F, a, b, c, d, in[0] + MD4_K1, 3);
+    MD4_ROUND(MD4_F, d, a, b, c, in[1] + MD4_K1, 7);
+    MD4_ROUND(MD4_F, c, d, a, b, in[2] + MD4_K1, 11);
+    MD4_ROUND(MD4_F, b, c, d, a, in[3] + MD4_K1, 19);
+    MD4_ROUND(MD4_F, a, b, c, d, in[4] + MD4_K1, 3);
+    MD4_ROUND(MD4_F, d, a, b, c, in[5] + MD4_K1, 7);
+    MD4_ROUND(MD4_F, c, d, a, b, in[6] + MD4_K1, 11);
+    MD4_ROUND(MD4_F, b, c, d, a, in[7] + MD4_K1, 19);
+
+    MD4_ROUND(MD4_G, a, b, c, d, in[1] + MD4_K2, 3);
+    MD4_ROUND(MD4_G, d, a, b, c, in[3] + MD4_K2, 5);
+    MD4_ROUND(MD4_G, c, d, a, b, in[5] + MD4_K2, 9);
+    MD4_ROUND(MD4_G, b, c, d, a, in[7] + MD4_K2, 13);
+    MD4_ROUND(MD4_G, a, b, c, d, in[0] + MD4_K2, 3);
+    MD4_ROUND(MD4_G, d, a, b, c, in[2] + MD4_K2, 5);
+    MD4_ROUND(MD4_G, c, d, a, b, in[4] + MD4_K2, 9);
+    MD4_ROUND(MD4_G, b, c, d, a, in[6] + MD4_K2, 13);
+
+    MD4_ROUND(MD4_H, a, b, c, d, in[3] + MD4_K3, 3);
+    MD4_ROUND(MD4_H, d, a, b, c, in[7] + MD4_K3, 9);
+    MD4_ROUND(MD4_H, c, d, a, b, in[2] + MD4_K3, 11);
+    MD4_ROUND(MD4_H, b, c, d, a, in[6] + MD4_K3, 15);
+    MD4_ROUND(MD4_H, a, b, c, d, in[1] + MD4_K3, 3);
+    MD4_ROUND(MD4_H, d, a, b, c, in[5] + MD4_K3, 9);
+    MD4_ROUND(MD4_H, c, d, a, b, in[0] + MD4_K3, 11);
+    MD4_ROUND(MD4_H, b, c, d, a, in[4] + MD4_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+/* Исходный хеш ext3 ("legacy") */
+static uint32_t dx_hack_hash(const char* name, size_t len, bool is_unsigned) {
+    uint32_t hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+
+    for (size_t i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+        uint32_t hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+        if (hash & 0x80000000U) {
+            hash -= 0x7FFFFFFF;
+        }
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+/* Упаковка имени в слова с заполнением длиной (как str2hashbuf в Linux) */
+static void str2hashbuf(const char* msg, size_t len, uint32_t* buf, int num,
+                        bool is_unsigned) {
+    uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+
+    uint32_t val = pad;
+    if (len > (size_t)num * 4) {
+        len = (size_t)num * 4;
+    }
+    for (size_t i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+        val = (uint32_t)c + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) {
+        *buf++ = val;
+    }
+    while (--num >= 0) {
+        *buf++ = pad;
+    }
+}
+
+static void ext2_dirhash(const char* name, size_t len, struct dx_hash_info* hinfo) {
+    uint32_t buf[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+    uint32_t in[8];
+    uint32_t hash = 0, minor_hash = 0;
+
+    if (hinfo->seed && (hinfo->seed[0] | hinfo->seed[1] | hinfo->seed[2] | hinfo->seed[3])) {
+        memcpy(buf, hinfo->seed, sizeof(buf));
+    }
+
+    bool is_unsigned = hinfo->version >= DX_HASH_LEGACY_UNSIGNED;
+    switch (hinfo->version) {
+        case DX_HASH_LEGACY:
+        case DX_HASH_LEGACY_UNSIGNED:
+            hash = dx_hack_hash(name, len, is_unsigned);
+            break;
+        case DX_HASH_HALF_MD4:
+        case DX_HASH_HALF_MD4_UNSIGNED:
+            for (const char* p = name; ; p += 32) {
+                size_t remaining = len - (size_t)(p - name);
+                str2hashbuf(p, remaining, in, 8, is_unsigned);
+                half_md4_transform(buf, in);
+                if (remaining <= 32) {
+                    break;
+                }
+            }
+            hash = buf[1];
+            minor_hash = buf[2];
+            break;
+        case DX_HASH_TEA:
+        case DX_HASH_TEA_UNSIGNED:
+            for (const char* p = name; ; p += 16) {
+                size_t remaining = len - (size_t)(p - name);
+                str2hashbuf(p, remaining, in, 4, is_unsigned);
+                tea_transform(buf, in);
+                if (remaining <= 16) {
+                    break;
+                }
+            }
+            hash = buf[0];
+            minor_hash = buf[1];
+            break;
+    }
+
+    hash &= ~1U;
+    if (hash == (DX_HTREE_EOF << 1)) {
+        hash = (DX_HTREE_EOF - 1) << 1;
+    }
+    hinfo->hash = hash;
+    hinfo->minor_hash = minor_hash;
+}
+
+/* ============================================================================
+ * Доступ к узлам индекса
+ * ============================================================================ */
+
+static inline struct dx_countlimit* dx_countlimit(struct dx_entry* entries) {
+    return (struct dx_countlimit*)entries;
+}
+
+static inline uint32_t dx_get_count(struct dx_entry* entries) {
+    return dx_countlimit(entries)->count;
+}
+
+static inline uint32_t dx_get_limit(struct dx_entry* entries) {
+    return dx_countlimit(entries)->limit;
+}
+
+static inline void dx_set_count(struct dx_entry* entries, uint32_t count) {
+    dx_countlimit(entries)->count = (uint16_t)count;
+}
+
+static inline void dx_set_limit(struct dx_entry* entries, uint32_t limit) {
+    dx_countlimit(entries)->limit = (uint16_t)limit;
+}
+
+static inline uint32_t dx_get_block(struct dx_entry* entry) {
+    return entry->block & 0x0FFFFFFF;
+}
+
+static inline uint32_t dx_root_limit(uint32_t block_size) {
+    return (block_size - DX_ROOT_INFO_OFFSET - sizeof(struct dx_root_info)) /
+           sizeof(struct dx_entry);
+}
+
+static inline uint32_t dx_node_limit(uint32_t block_size) {
+    return (block_size - DX_NODE_HEADER) / sizeof(struct dx_entry);
+}
+
+static inline struct dx_root_info* dx_root_info(uint8_t* block) {
+    return (struct dx_root_info*)(block + DX_ROOT_INFO_OFFSET);
+}
+
+static void dx_release(struct dx_frame* frames, int levels) {
+    for (int i = 0; i <= levels; i++) {
+        if (frames[i].page) {
+            page_cache_release(frames[i].page);
+            frames[i].page = NULL;
+        }
+    }
+}
+
+bool ext2_dx_enabled(struct inode* dir) {
+    return ext2_has_compat(EXT2_SB(dir->sb), EXT2_FEATURE_COMPAT_DIR_INDEX) &&
+           (EXT2_I(dir)->i_flags & EXT2_INDEX_FL);
+}
+
+/* Индекс непригоден: каталог переводится в линейный режим */
+static int dx_fallback(struct inode* dir) {
+    terminal_writestring("  ext2: bad htree index, using linear directory\n");
+    EXT2_I(dir)->i_flags &= ~EXT2_INDEX_FL;
+    mark_inode_dirty(dir);
+    return -EAGAIN;
+}
+
+/*
+ * Спуск от корня к листу, покрывающему хеш имени (или hinfo->hash, если
+ * name == NULL). -EAGAIN означает неподдерживаемый или повреждённый индекс.
+ */
+static int dx_probe(struct inode* dir, const char* name, size_t len,
+                    struct dx_hash_info* hinfo, struct dx_frame* frames, int* levels) {
+    struct ext2_sb_info* sbi = EXT2_SB(dir->sb);
+    uint32_t block_size = sbi->block_size;
+    struct page* page;
+    struct ext2_dir_entry* data;
+
+    int err = ext2_dir_block(dir, 0, false, &page, &data);
+    if (err < 0) {
+        return err;
+    }
+    uint8_t* block = (uint8_t*)data;
+    struct dx_root_info* info = dx_root_info(block);
+
+    if (info->reserved_zero || info->info_length != sizeof(struct dx_root_info) ||
+        info->hash_version > DX_HASH_TEA || info->indirect_levels >= DX_MAX_LEVELS) {
+        page_cache_release(page);
+        return -EAGAIN;
+    }
+
+    hinfo->version = info->hash_version + sbi->hash_unsigned;
+    hinfo->seed = sbi->hash_seed;
+    if (name) {
+        ext2_dirhash(name, len, hinfo);
+    }
+
+    struct dx_entry* entries = (struct dx_entry*)(block + DX_ROOT_INFO_OFFSET +
+                                                  info->info_length);
+    uint32_t limit = dx_root_limit(block_size);
+    int depth = info->indirect_levels;
+
+    for (int level = 0; ; level++) {
+        uint32_t count = dx_get_count(entries);
+        if (dx_get_limit(entries) != limit || count == 0 || count > limit) {
+            page_cache_release(page);
+            dx_release(frames, level - 1);
+            return -EAGAIN;
+        }
+
+        /* Последняя запись с hash <= искомого */
+        struct dx_entry* p = entries + 1;
+        struct dx_entry* q = entries + count - 1;
+        while (p <= q) {
+            struct dx_entry* m = p + (q - p) / 2;
+            if (m->hash > hinfo->hash) {
+                q = m - 1;
+            } else {
+                p = m + 1;
+            }
+        }
+
+        frames[level].page = page;
+        frames[level].block = block;
+        frames[level].entries = entries;
+        frames[level].at = p - 1;
+
+        if (level == depth) {
+            *levels = depth;
+            return 0;
+        }
+
+        err = ext2_dir_block(dir, dx_get_block(frames[level].at), false, &page, &data);
+        if (err < 0) {
+            dx_release(frames, level);
+            return err == -ENOENT ? -EAGAIN : err;
+        }
+        block = (uint8_t*)data;
+        entries = (struct dx_entry*)(block + DX_NODE_HEADER);
+        limit = dx_node_limit(block_size);
+    }
+}
+
+/*
+ * Переход к следующему листу, если он продолжает ту же серию хешей
+ * (младший бит хеша в индексе отмечает коллизию через границу листа).
+ */
+static int dx_next_block(struct inode* dir, uint32_t hash,
+                         struct dx_frame* frames, int levels) {
+    struct dx_frame* p = &frames[levels];
+    int climbed = 0;
+
+    while (1) {
+        if (++p->at < p->entries + dx_get_count(p->entries)) {
+            break;
+        }
+        if (p == frames) {
+            return 0;
+        }
+        climbed++;
+        p--;
+    }
+
+    if ((p->at->hash & ~1U) != hash) {
+        return 0;
+    }
+
+    while (climbed--) {
+        struct page* page;
+        struct ext2_dir_entry* data;
+        int err = ext2_dir_block(dir, dx_get_block(p->at), false, &page, &data);
+        if (err < 0) {
+            return err;
+        }
+        p++;
+        page_cache_release(p->page);
+        p->page = page;
+        p->block = (uint8_t*)data;
+        p->entries = p->at = (struct dx_entry*)(p->block + DX_NODE_HEADER);
+    }
+    return 1;
+}
+
+/* ============================================================================
+ * Поиск
+ * ============================================================================ */
+
+int ext2_dx_find_entry(struct inode* dir, const char* name, size_t len,
+                       struct ext2_dir_location* loc) {
+    struct dx_frame frames[DX_MAX_LEVELS] = { 0 };
+    struct dx_hash_info hinfo;
+    int levels;
+
+    int err = dx_probe(dir, name, len, &hinfo, frames, &levels);
+    if (err < 0) {
+        return err;
+    }
+
+    do {
+        struct page* page;
+        struct ext2_dir_entry* block;
+        err = ext2_dir_block(dir, dx_get_block(frames[levels].at), false, &page, &block);
+        if (err < 0) {
+            break;
+        }
+        err = ext2_search_block(dir, block, name, len, loc);
+        if (err == 0) {
+            loc->page = page;
+            break;
+        }
+        page_cache_release(page);
+        if (err != -ENOENT) {
+            break;
+        }
+        int next = dx_next_block(dir, hinfo.hash, frames, levels);
+        if (next < 0) {
+            err = next;
+        }
+        if (next <= 0) {
+            break;
+        }
+    } while (1);
+
+    dx_release(frames, levels);
+    return err;
+}
+
+/* ============================================================================
+ * Вставка
+ * ============================================================================ */
+
+/* Вставка пары (hash, block) после frame->at */
+static void dx_insert_block(struct inode* dir, struct dx_frame* frame, uint32_t hash,
+                            uint32_t block) {
+    uint32_t count = dx_get_count(frame->entries);
+    struct dx_entry* new_entry = frame->at + 1;
+
+    memmove(new_entry + 1, new_entry,
+            (size_t)(frame->entries + count - new_entry) * sizeof(struct dx_entry));
+    new_entry->hash = hash;
+    new_entry->block = block;
+    dx_set_count(frame->entries, count + 1);
+    ext2_dir_block_dirty(dir, frame->page);
+}
+
+/* Плотная упаковка записей map[first..last) в блок */
+static void dx_pack_entries(uint8_t* dst, const uint8_t* src, uint32_t block_size,
+                            const struct dx_map_entry* map, uint32_t first, uint32_t last) {
+    struct ext2_dir_entry* prev = NULL;
+    uint32_t offset = 0;
+
+    for (uint32_t i = first; i < last; i++) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)(dst + offset);
+        memcpy(de, src + map[i].offset, map[i].size);
+        de->rec_len = map[i].size;
+        prev = de;
+        offset += map[i].size;
+    }
+    if (prev) {
+        prev->rec_len = (uint16_t)(block_size - ((uint8_t*)prev - dst));
+    } else {
+        struct ext2_dir_entry* empty = (struct ext2_dir_entry*)dst;
+        memset(empty, 0, EXT2_DIR_ENTRY_HEADER);
+        empty->rec_len = (uint16_t)block_size;
+    }
+}
+
+/*
+ * Расщепление переполненного листа: записи сортируются по хешу, верхняя
+ * половина (по объёму) переносится в новый блок, в индекс добавляется его
+ * граница. Возвращает лист, в который должно попасть имя с хешем hinfo.
+ */
+static int dx_split_leaf(struct inode* dir, struct dx_frame* frame,
+                         struct page* leaf_page, struct ext2_dir_entry* leaf,
+                         struct dx_hash_info* hinfo,
+                         struct page** target_page, struct ext2_dir_entry** target) {
+    uint32_t block_size = dir->sb->block_size;
+    uint32_t new_nr = (uint32_t)(dir->size / block_size);
+    uint8_t* src = (uint8_t*)leaf;
+
+    uint32_t max_entries = block_size / EXT2_DIR_REC_LEN(1);
+    struct dx_map_entry* map = kmalloc(max_entries * sizeof(*map));
+    uint8_t* copy = kmalloc(block_size);
+    if (!map || !copy) {
+        kfree(map);
+        kfree(copy);
+        page_cache_release(leaf_page);
+        return -ENOMEM;
+    }
+
+    /* Карта живых записей, отсортированная вставками по хешу */
+    uint32_t count = 0;
+    for (uint32_t offset = 0; offset < block_size; ) {
+        struct ext2_dir_entry* de = (struct ext2_dir_entry*)(src + offset);
+        if (de->inode) {
+            struct dx_hash_info h = *hinfo;
+            ext2_dirhash(de->name, de->name_len, &h);
+            uint32_t i = count++;
+            while (i > 0 && map[i - 1].hash > h.hash) {
+                map[i] = map[i - 1];
+                i--;
+            }
+            map[i].hash = h.hash;
+            map[i].offset = (uint16_t)offset;
+            map[i].size = (uint16_t)EXT2_DIR_REC_LEN(de->name_len);
+        }
+        offset += de->rec_len;
+    }
+    if (count < 2) {
+        kfree(map);
+        kfree(copy);
+        page_cache_release(leaf_page);
+        return -ENOSPC;
+    }
+
+    /* Точка раздела: примерно половина объёма блока */
+    uint32_t size = 0, move = 0;
+    for (int64_t i = (int64_t)count - 1; i > 0; i--) {
+        if (size + map[i].size / 2 > block_size / 2) {
+            break;
+        }
+        size += map[i].size;
+        move++;
+    }
+    if (move == 0) {
+        move = 1;
+    }
+    uint32_t split = count - move;
+    uint32_t hash2 = map[split].hash;
+    uint32_t continued = hash2 == map[split - 1].hash;
+
+    struct page* new_page;
+    struct ext2_dir_entry* new_block;
+    int err = ext2_dir_block(dir, new_nr, true, &new_page, &new_block);
+    if (err < 0) {
+        kfree(map);
+        kfree(copy);
+        page_cache_release(leaf_page);
+        return err;
+    }
+
+    memcpy(copy, src, block_size);
+    dx_pack_entries((uint8_t*)new_block, copy, block_size, map, split, count);
+    dx_pack_entries(src, copy, block_size, map, 0, split);
+    kfree(map);
+    kfree(copy);
+
+    dx_insert_block(dir, frame, hash2 + continued, new_nr);
+    ext2_dir_block_dirty(dir, leaf_page);
+    ext2_dir_block_dirty(dir, new_page);
+
+    if (hinfo->hash >= hash2) {
+        page_cache_release(leaf_page);
+        *target_page = new_page;
+        *target = new_block;
+    } else {
+        page_cache_release(new_page);
+        *target_page = leaf_page;
+        *target = leaf;
+    }
+    return 0;
+}
+
+/* Освобождение места в узле индекса frames[levels] перед расщеплением листа */
+static int dx_make_room(struct inode* dir, struct dx_frame* frames, int* levels) {
+    uint32_t block_size = dir->sb->block_size;
+    struct dx_frame* frame = &frames[*levels];
+
+    if (dx_get_count(frame->entries) < dx_get_limit(frame->entries)) {
+        return 0;
+    }
+
+    struct page* page;
+    struct ext2_dir_entry* data;
+    uint32_t new_nr = (uint32_t)(dir->size / block_size);
+
+    if (*levels == 0) {
+        /* Корень заполнен: его записи уходят в новый узел, дерево растёт */
+        int err = ext2_dir_block(dir, new_nr, true, &page, &data);
+        if (err < 0) {
+            return err;
+        }
+        struct dx_entry* node = (struct dx_entry*)((uint8_t*)data + DX_NODE_HEADER);
+        uint32_t count = dx_get_count(frames[0].entries);
+
+        memcpy(node, frames[0].entries, count * sizeof(struct dx_entry));
+        dx_set_limit(node, dx_node_limit(block_size));
+        dx_set_count(node, count);
+
+        dx_set_count(frames[0].entries, 1);
+        frames[0].entries[0].block = new_nr;
+        dx_root_info(frames[0].block)->indirect_levels = 1;
+        ext2_dir_block_dirty(dir, frames[0].page);
+        ext2_dir_block_dirty(dir, page);
+
+        frames[1].page = page;
+        frames[1].block = (uint8_t*)data;
+        frames[1].entries = node;
+        frames[1].at = node + (frames[0].at - frames[0].entries);
+        frames[0].at = frames[0].entries;
+        *levels = 1;
+        return 0;
+    }
+
+    /* Промежуточный узел заполнен: делим его пополам и добавляем в корень */
+    if (dx_get_count(frames[0].entries) == dx_get_limit(frames[0].entries)) {
+        terminal_writestring("  ext2: directory index full\n");
+        return -ENOSPC;
+    }
+
+    int err = ext2_dir_block(dir, new_nr, true, &page, &data);
+    if (err < 0) {
+        return err;
+    }
+    struct dx_entry* node2 = (struct dx_entry*)((uint8_t*)data + DX_NODE_HEADER);
+    uint32_t count = dx_get_count(frame->entries);
+    uint32_t count1 = count / 2;
+    uint32_t count2 = count - count1;
+    uint32_t hash2 = frame->entries[count1].hash;
+
+    memcpy(node2, frame->entries + count1, count2 * sizeof(struct dx_entry));
+    dx_set_limit(node2, dx_node_limit(block_size));
+    dx_set_count(node2, count2);
+    dx_set_count(frame->entries, count1);
+    dx_insert_block(dir, &frames[0], hash2, new_nr);
+    ext2_dir_block_dirty(dir, frame->page);
+    ext2_dir_block_dirty(dir, page);
+
+    if (frame->at >= frame->entries + count1) {
+        ptrdiff_t index = frame->at - (frame->entries + count1);
+        page_cache_release(frame->page);
+        frame->page = page;
+        frame->block = (uint8_t*)data;
+        frame->entries = node2;
+        frame->at = node2 + index;
+    } else {
+        page_cache_release(page);
+    }
+    return 0;
+}
+
+int ext2_dx_add_entry(struct inode* dir, const char* name, size_t len, struct inode* inode) {
+    struct dx_frame frames[DX_MAX_LEVELS] = { 0 };
+    struct dx_hash_info hinfo;
+    int levels;
+
+    int err = dx_probe(dir, name, len, &hinfo, frames, &levels);
+    if (err == -EAGAIN) {
+        return dx_fallback(dir);
+    }
+    if (err < 0) {
+        return err;
+    }
+
+    struct page* page;
+    struct ext2_dir_entry* leaf;
+    err = ext2_dir_block(dir, dx_get_block(frames[levels].at), false, &page, &leaf);
+    if (err < 0) {
+        dx_release(frames, levels);
+        return err == -ENOENT ? dx_fallback(dir) : err;
+    }
+
+    err = ext2_add_to_block(dir, leaf, name, len, inode);
+    if (err == 0) {
+        ext2_dir_block_dirty(dir, page);
+    }
+    if (err != -ENOSPC) {
+        page_cache_release(page);
+        dx_release(frames, levels);
+        return err;
+    }
+
+    err = dx_make_room(dir, frames, &levels);
+    if (err < 0) {
+        page_cache_release(page);
+        dx_release(frames, levels);
+        return err;
+    }
+
+    struct page* target_page;
+    struct ext2_dir_entry* target;
+    err = dx_split_leaf(dir, &frames[levels], page, leaf, &hinfo, &target_page, &target);
+    if (err == 0) {
+        err = ext2_add_to_block(dir, target, name, len, inode);
+        if (err == 0) {
+            ext2_dir_block_dirty(dir, target_page);
+        }
+        page_cache_release(target_page);
+    }
+    dx_release(frames, levels);
+    return err;
+}
+
+/*
+ * Преобразование заполненного однoблочного каталога в индексированный:
+ * записи после ".." переносятся в блок 1, блок 0 становится корнем индекса.
+ */
+int ext2_make_indexed_dir(struct inode* dir, const char* name, size_t len,
+                          struct inode* inode) {
+    struct ext2_sb_info* sbi = EXT2_SB(dir->sb);
+    uint32_t block_size = sbi->block_size;
+    struct page* root_page;
+    struct ext2_dir_entry* root;
+
+    int err = ext2_dir_block(dir, 0, false, &root_page, &root);
+    if (err < 0) {
+        return err;
+    }
+
+    struct ext2_dir_entry* dot = root;
+    struct ext2_dir_entry* dotdot = ext2_next_entry(dot);
+    if (dot->rec_len != EXT2_DIR_REC_LEN(1) || dot->name_len != 1 || dot->name[0] != '.' ||
+        dotdot->name_len != 2 || memcmp(dotdot->name, "..", 2) != 0 ||
+        !ext2_check_dir_entry(dir, dotdot, dot->rec_len)) {
+        page_cache_release(root_page);
+        return -EAGAIN;
+    }
+
+    struct page* page;
+    struct ext2_dir_entry* leaf;
+    err = ext2_dir_block(dir, 1, true, &page, &leaf);
+    if (err < 0) {
+        page_cache_release(root_page);
+        return err;
+    }
+
+    /* Записи после ".." переезжают в блок 1 */
+    uint8_t* start = (uint8_t*)dotdot + dotdot->rec_len;
+    uint8_t* end = (uint8_t*)root + block_size;
+    if (start < end) {
+        memcpy(leaf, start, (size_t)(end - start));
+        struct ext2_dir_entry* de = leaf;
+        uint8_t* top = (uint8_t*)leaf + (end - start);
+        while ((uint8_t*)ext2_next_entry(de) < top) {
+            de = ext2_next_entry(de);
+        }
+        de->rec_len = (uint16_t)((uint8_t*)leaf + block_size - (uint8_t*)de);
+    }
+    ext2_dir_block_dirty(dir, page);
+    page_cache_release(page);
+
+    /* Блок 0: "..", растянутая до конца блока, и корень индекса за ней */
+    dotdot->rec_len = (uint16_t)(block_size - EXT2_DIR_REC_LEN(1));
+    memset((uint8_t*)root + DX_ROOT_INFO_OFFSET, 0, block_size - DX_ROOT_INFO_OFFSET);
+
+    struct dx_root_info* info = dx_root_info((uint8_t*)root);
+    info->hash_version = sbi->def_hash_version <= DX_HASH_TEA
+                       ? sbi->def_hash_version : DX_HASH_HALF_MD4;
+    info->info_length = sizeof(struct dx_root_info);
+
+    struct dx_entry* entries = (struct dx_entry*)((uint8_t*)info + info->info_length);
+    dx_set_limit(entries, dx_root_limit(block_size));
+    dx_set_count(entries, 1);
+    entries[0].block = 1;
+    ext2_dir_block_dirty(dir, root_page);
+    page_cache_release(root_page);
+
+    EXT2_I(dir)->i_flags |= EXT2_INDEX_FL;
+    mark_inode_dirty(dir);
+
+    return ext2_dx_add_entry(dir, name, len, inode);
+}
@@ -0,0 +1,249 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/ext2/ialloc.c
+ * Драйвер ext2: выделение inode
+ *
+ * Файлы размещаются в группе родительского каталога, чтобы inode, записи
+ * каталога и данные лежали рядом. Каталоги верхнего уровня разносятся по
+ * группам (упрощённый алгоритм Орлова), вложенные остаются рядом с
+ * родителем, пока в его группе хватает места.
+ * ============================================================================
+ */
+
+#include "fs/ext2/ext2.h"
+#include "errno.h"
+
+static inline bool test_bit(const uint8_t* bitmap, uint32_t bit) {
+    return (bitmap[bit >> 3] >> (bit & 7)) & 1;
+}
+
+/* Суммарное число каталогов во всех группах */
+static uint32_t ext2_count_dirs(struct super_block* sb) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    uint32_t count = 0;
+    for (uint32_t group = 0; group < sbi->groups_count; group++) {
+        count += ext2_get_group_desc(sb, group, NULL)->bg_used_dirs_count;
+    }
+    return count;
+}
+
+/* Группа для нового каталога */
+static int64_t find_group_dir(struct super_block* sb, struct inode* parent) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    uint32_t ngroups = sbi->groups_count;
+    uint32_t parent_group = EXT2_I(parent)->block_group;
+    uint32_t avefreei = sbi->es->s_free_inodes_count / ngroups;
+    uint32_t avefreeb = sbi->es->s_free_blocks_count / ngroups;
+
+    if (parent->ino == EXT2_ROOT_INO) {
+        /* Каталог верхнего уровня: группа с запасом места и меньшим числом каталогов */
+        int64_t best = -1;
+        uint32_t best_dirs = UINT32_MAX;
+        uint32_t best_free = 0;
+        for (uint32_t i = 0; i < ngroups; i++) {
+            uint32_t group = (parent_group + i) % ngroups;
+            struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, NULL);
+            if (gd->bg_free_inodes_count < avefreei || gd->bg_free_blocks_count < avefreeb) {
+                continue;
+            }
+            if (gd->bg_used_dirs_count < best_dirs ||
+                (gd->bg_used_dirs_count == best_dirs && gd->bg_free_blocks_count > best_free)) {
+                best = group;
+                best_dirs = gd->bg_used_dirs_count;
+                best_free = gd->bg_free_blocks_count;
+            }
+        }
+        if (best >= 0) {
+            return best;
+        }
+    } else {
+        /* Вложенный каталог: ближайшая к родителю не перегруженная группа */
+        uint32_t max_dirs = ext2_count_dirs(sb) / ngroups + sbi->inodes_per_group / 16;
+        uint32_t min_inodes = avefreei > sbi->inodes_per_group / 4
+                            ? avefreei - sbi->inodes_per_group / 4 : 1;
+        uint32_t min_blocks = avefreeb > sbi->blocks_per_group / 4
+                            ? avefreeb - sbi->blocks_per_group / 4 : 0;
+        for (uint32_t i = 0; i < ngroups; i++) {
+            uint32_t group = (parent_group + i) % ngroups;
+            struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, NULL);
+            if (gd->bg_used_dirs_count < max_dirs &&
+                gd->bg_free_inodes_count >= min_inodes &&
+                gd->bg_free_blocks_count >= min_blocks) {
+                return group;
+            }
+        }
+    }
+
+    /* Запасной вариант: любая группа со средним числом свободных inode */
+    for (uint32_t i = 0; i < ngroups; i++) {
+        uint32_t group = (parent_group + i) % ngroups;
+        if (ext2_get_group_desc(sb, group, NULL)->bg_free_inodes_count >= MAX(avefreei, 1U)) {
+            return group;
+        }
+    }
+    for (uint32_t i = 0; i < ngroups; i++) {
+        uint32_t group = (parent_group + i) % ngroups;
+        if (ext2_get_group_desc(sb, group, NULL)->bg_free_inodes_count) {
+            return group;
+        }
+    }
+    return -1;
+}
+
+/* Группа для файла: группа родителя, затем квадратичный, затем линейный поиск */
+static int64_t find_group_other(struct super_block* sb, struct inode* parent) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    uint32_t ngroups = sbi->groups_count;
+    uint32_t parent_group = EXT2_I(parent)->block_group;
+
+    struct ext2_group_desc* gd = ext2_get_group_desc(sb, parent_group, NULL);
+    if (gd->bg_free_inodes_count && gd->bg_free_blocks_count) {
+        return parent_group;
+    }
+
+    uint32_t group = (parent_group + (uint32_t)parent->ino) % ngroups;
+    for (uint32_t step = 1; step < ngroups; step <<= 1) {
+        group = (group + step) % ngroups;
+        gd = ext2_get_group_desc(sb, group, NULL);
+        if (gd->bg_free_inodes_count && gd->bg_free_blocks_count) {
+            return group;
+        }
+    }
+
+    for (uint32_t i = 0; i < ngroups; i++) {
+        group = (parent_group + i) % ngroups;
+        if (ext2_get_group_desc(sb, group, NULL)->bg_free_inodes_count) {
+            return group;
+        }
+    }
+    return -1;
+}
+
+/* Обнуление дисковой копии inode перед повторным использованием */
+static int ext2_clear_raw_inode(struct super_block* sb, uint64_t ino) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    uint32_t group = (uint32_t)((ino - 1) / sbi->inodes_per_group);
+    uint32_t index = (uint32_t)((ino - 1) % sbi->inodes_per_group);
+    struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, NULL);
+
+    struct buffer buf;
+    int err = bread(sb->bdev, gd->bg_inode_table + index / sbi->inodes_per_block,
+                    sbi->block_size, &buf);
+    if (err < 0) {
+        return err;
+    }
+    memset((uint8_t*)buf.data + (index % sbi->inodes_per_block) * sbi->inode_size,
+           0, sbi->inode_size);
+    ext2_mark_buffer_dirty(sb, &buf);
+    brelse(&buf);
+    return 0;
+}
+
+int ext2_new_inode(struct inode* dir, uint32_t mode, struct inode** out) {
+    struct super_block* sb = dir->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+
+    if (sbi->es->s_free_inodes_count == 0) {
+        return -ENOSPC;
+    }
+
+    int64_t found = S_ISDIR(mode) ? find_group_dir(sb, dir) : find_group_other(sb, dir);
+    if (found < 0) {
+        return -ENOSPC;
+    }
+
+    /* Группа могла оказаться заполненной: перебираем по кругу */
+    for (uint32_t i = 0; i < sbi->groups_count; i++) {
+        uint32_t group = ((uint32_t)found + i) % sbi->groups_count;
+        struct buffer* gd_buffer;
+        struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, &gd_buffer);
+        if (gd->bg_free_inodes_count == 0) {
+            continue;
+        }
+
+        struct buffer bitmap;
+        int err = bread(sb->bdev, gd->bg_inode_bitmap, sbi->block_size, &bitmap);
+        if (err < 0) {
+            return err;
+        }
+
+        for (uint32_t bit = 0; bit < sbi->inodes_per_group; bit++) {
+            if ((bit & 7) == 0 && ((uint8_t*)bitmap.data)[bit >> 3] == 0xFF) {
+                bit += 7;
+                continue;
+            }
+            uint64_t ino = (uint64_t)group * sbi->inodes_per_group + bit + 1;
+            if (test_bit(bitmap.data, bit) || ino < sbi->first_ino) {
+                continue;
+            }
+
+            ((uint8_t*)bitmap.data)[bit >> 3] |= (uint8_t)(1U << (bit & 7));
+            ext2_mark_buffer_dirty(sb, &bitmap);
+            brelse(&bitmap);
+
+            gd->bg_free_inodes_count--;
+            if (S_ISDIR(mode)) {
+                gd->bg_used_dirs_count++;
+            }
+            ext2_mark_buffer_dirty(sb, gd_buffer);
+            sbi->es->s_free_inodes_count--;
+            ext2_mark_super_dirty(sb);
+
+            err = ext2_clear_raw_inode(sb, ino);
+            if (err < 0) {
+                return err;
+            }
+
+            struct inode* inode = new_inode(sb, ino);
+            if (!inode) {
+                return -ENOMEM;
+            }
+            struct ext2_inode_info* ei = EXT2_I(inode);
+            uint32_t now = ext2_current_time(sb);
+
+            inode->mode = mode;
+            inode->nlink = 0;
+            inode->size = 0;
+            inode->atime = inode->mtime = inode->ctime = now;
+            ei->block_group = group;
+            ei->i_generation = (uint32_t)ino ^ now;
+            ext2_set_inode_ops(inode);
+            mark_inode_dirty(inode);
+
+            *out = inode;
+            return 0;
+        }
+        brelse(&bitmap);
+    }
+    return -ENOSPC;
+}
+
+void ext2_free_inode(struct inode* inode) {
+    struct super_block* sb = inode->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    uint32_t group = (uint32_t)((inode->ino - 1) / sbi->inodes_per_group);
+    uint32_t bit = (uint32_t)((inode->ino - 1) % sbi->inodes_per_group);
+    struct buffer* gd_buffer;
+    struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, &gd_buffer);
+
+    struct buffer bitmap;
+    if (bread(sb->bdev, gd->bg_inode_bitmap, sbi->block_size, &bitmap) < 0) {
+        return;
+    }
+    if (!test_bit(bitmap.data, bit)) {
+        terminal_writestring("  ext2: freeing already free inode\n");
+        brelse(&bitmap);
+        return;
+    }
+    ((uint8_t*)bitmap.data)[bit >> 3] &= (uint8_t)~(1U << (bit & 7));
+    ext2_mark_buffer_dirty(sb, &bitmap);
+    brelse(&bitmap);
+
+    gd->bg_free_inodes_count++;
+    if (S_ISDIR(inode->mode)) {
+        gd->bg_used_dirs_count--;
+    }
+    ext2_mark_buffer_dirty(sb, gd_buffer);
+    sbi->es->s_free_inodes_count++;
+    ext2_mark_super_dirty(sb);
+}
@@ -0,0 +1,563 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/ext2/inode.c
+ * Драйвер ext2: inode, отображение блоков файла, page cache
+ * ============================================================================
+ */
+
+#include "fs/ext2/ext2.h"
+#include "errno.h"
+
+/* Inode без операций (устройства, FIFO, символьные ссылки) */
+static const struct inode_operations ext2_special_inode_operations = { 0 };
+
+/* Номера блоков файла хранятся только для обычных файлов, каталогов
+ * и длинных символьных ссылок */
+static bool ext2_inode_has_blocks(struct inode* inode) {
+    if (S_ISREG(inode->mode) || S_ISDIR(inode->mode)) {
+        return true;
+    }
+    if (S_ISLNK(inode->mode)) {
+        struct ext2_inode_info* ei = EXT2_I(inode);
+        uint32_t acl_blocks = ei->i_file_acl ? inode->sb->block_size >> SECTOR_SHIFT : 0;
+        return ei->i_blocks != acl_blocks;
+    }
+    return false;
+}
+
+/* ============================================================================
+ * Чтение и запись дисковой копии inode
+ * ============================================================================ */
+
+static int ext2_inode_location(struct inode* inode, struct buffer* buf,
+                               struct ext2_inode** raw) {
+    struct super_block* sb = inode->sb;
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+
+    if (inode->ino < 1 || inode->ino > sbi->es->s_inodes_count) {
+        return -EINVAL;
+    }
+    uint32_t group = (uint32_t)((inode->ino - 1) / sbi->inodes_per_group);
+    uint32_t index = (uint32_t)((inode->ino - 1) % sbi->inodes_per_group);
+    struct ext2_group_desc* gd = ext2_get_group_desc(sb, group, NULL);
+
+    int err = bread(sb->bdev, gd->bg_inode_table + index / sbi->inodes_per_block,
+                    sbi->block_size, buf);
+    if (err < 0) {
+        return err;
+    }
+    *raw = (struct ext2_inode*)((uint8_t*)buf->data +
+                                (index % sbi->inodes_per_block) * sbi->inode_size);
+    return 0;
+}
+
+void ext2_set_inode_ops(struct inode* inode) {
+    if (S_ISREG(inode->mode)) {
+        inode->i_op = &ext2_file_inode_operations;
+        inode->f_op = &ext2_file_operations;
+        inode->mapping.a_ops = &ext2_aops;
+    } else if (S_ISDIR(inode->mode)) {
+        inode->i_op = &ext2_dir_inode_operations;
+        inode->f_op = &ext2_dir_operations;
+        inode->mapping.a_ops = &ext2_aops;
+    } else {
+        inode->i_op = &ext2_special_inode_operations;
+        inode->f_op = NULL;
+    }
+}
+
+int ext2_read_inode(struct inode* inode) {
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    struct ext2_sb_info* sbi = EXT2_SB(inode->sb);
+    struct ext2_inode* raw;
+    struct buffer buf;
+
+    int err = ext2_inode_location(inode, &buf, &raw);
+    if (err < 0) {
+        return err;
+    }
+
+    if (raw->i_links_count == 0 && (raw->i_mode == 0 || raw->i_dtime)) {
+        brelse(&buf);
+        return -ENOENT;
+    }
+
+    inode->mode = raw->i_mode;
+    inode->uid = raw->i_uid | ((uint32_t)raw->i_uid_high << 16);
+    inode->gid = raw->i_gid | ((uint32_t)raw->i_gid_high << 16);
+    inode->nlink = raw->i_links_count;
+    inode->size = raw->i_size;
+    if (S_ISREG(inode->mode)) {
+        inode->size |= (uint64_t)raw->i_size_high << 32;
+    }
+    inode->atime = raw->i_atime;
+    inode->mtime = raw->i_mtime;
+    inode->ctime = raw->i_ctime;
+
+    memcpy(ei->i_block, raw->i_block, sizeof(ei->i_block));
+    ei->i_flags = raw->i_flags;
+    ei->i_dtime = raw->i_dtime;
+    ei->i_blocks = raw->i_blocks;
+    ei->i_file_acl = raw->i_file_acl;
+    ei->i_generation = raw->i_generation;
+    ei->block_group = (uint32_t)((inode->ino - 1) / sbi->inodes_per_group);
+    brelse(&buf);
+
+    ext2_set_inode_ops(inode);
+    return 0;
+}
+
+int ext2_write_inode(struct inode* inode) {
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    struct ext2_sb_info* sbi = EXT2_SB(inode->sb);
+    struct ext2_inode* raw;
+    struct buffer buf;
+
+    int err = ext2_inode_location(inode, &buf, &raw);
+    if (err < 0) {
+        return err;
+    }
+
+    raw->i_mode = (uint16_t)inode->mode;
+    raw->i_uid = (uint16_t)inode->uid;
+    raw->i_uid_high = (uint16_t)(inode->uid >> 16);
+    raw->i_gid = (uint16_t)inode->gid;
+    raw->i_gid_high = (uint16_t)(inode->gid >> 16);
+    raw->i_links_count = (uint16_t)inode->nlink;
+    raw->i_size = (uint32_t)inode->size;
+    raw->i_size_high = S_ISREG(inode->mode) ? (uint32_t)(inode->size >> 32) : 0;
+    raw->i_atime = inode->atime;
+    raw->i_mtime = inode->mtime;
+    raw->i_ctime = inode->ctime;
+    raw->i_dtime = ei->i_dtime;
+    raw->i_blocks = ei->i_blocks;
+    raw->i_flags = ei->i_flags;
+    raw->i_file_acl = ei->i_file_acl;
+    raw->i_generation = ei->i_generation;
+    memcpy(raw->i_block, ei->i_block, sizeof(raw->i_block));
+    ext2_mark_buffer_dirty(inode->sb, &buf);
+    brelse(&buf);
+    if (sbi->journal) {
+        ei->i_sync_tid = sbi->journal->tid;
+    }
+
+    /* Файл больше 2 GiB требует флага large_file в суперблоке */
+    if (inode->size > 0x7FFFFFFFULL &&
+        !(sbi->es->s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE)) {
+        sbi->es->s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+        ext2_mark_super_dirty(inode->sb);
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Отображение логических блоков файла на физические
+ * ============================================================================ */
+
+/* Путь в дереве косвенных блоков: индексы на каждом уровне */
+static int ext2_block_to_path(struct ext2_sb_info* sbi, uint32_t iblock, uint32_t offsets[4]) {
+    uint64_t apb = sbi->addr_per_block;
+    uint32_t bits = sbi->addr_per_block_bits;
+    uint64_t block = iblock;
+
+    if (block < EXT2_NDIR_BLOCKS) {
+        offsets[0] = (uint32_t)block;
+        return 1;
+    }
+    block -= EXT2_NDIR_BLOCKS;
+    if (block < apb) {
+        offsets[0] = EXT2_IND_BLOCK;
+        offsets[1] = (uint32_t)block;
+        return 2;
+    }
+    block -= apb;
+    if (block < apb * apb) {
+        offsets[0] = EXT2_DIND_BLOCK;
+        offsets[1] = (uint32_t)(block >> bits);
+        offsets[2] = (uint32_t)(block & (apb - 1));
+        return 3;
+    }
+    block -= apb * apb;
+    if (block < apb * apb * apb) {
+        offsets[0] = EXT2_TIND_BLOCK;
+        offsets[1] = (uint32_t)(block >> (2 * bits));
+        offsets[2] = (uint32_t)((block >> bits) & (apb - 1));
+        offsets[3] = (uint32_t)(block & (apb - 1));
+        return 4;
+    }
+    return -EFBIG;
+}
+
+/* Цель для нового блока: продолжение последнего выделенного или группа inode */
+static uint32_t ext2_find_goal(struct inode* inode, uint32_t iblock) {
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    if (ei->last_alloc_physical && ei->last_alloc_logical + 1 == iblock) {
+        return ei->last_alloc_physical + 1;
+    }
+    if (ei->last_alloc_physical) {
+        return ei->last_alloc_physical;
+    }
+    return ext2_group_first_block(EXT2_SB(inode->sb), ei->block_group);
+}
+
+/* Новый обнулённый косвенный блок */
+static int ext2_alloc_indirect(struct inode* inode, uint32_t goal, uint32_t* block) {
+    int err = ext2_new_block(inode, goal, false, block);
+    if (err < 0) {
+        return err;
+    }
+
+    struct buffer buf;
+    err = bread(inode->sb->bdev, *block, inode->sb->block_size, &buf);
+    if (err < 0) {
+        ext2_free_blocks(inode, *block, 1);
+        return err;
+    }
+    memset(buf.data, 0, buf.size);
+    ext2_mark_buffer_dirty(inode->sb, &buf);
+    brelse(&buf);
+    return 0;
+}
+
+int ext2_get_block(struct inode* inode, uint32_t iblock, bool create, uint32_t* block) {
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    struct super_block* sb = inode->sb;
+    uint32_t offsets[4];
+
+    int depth = ext2_block_to_path(EXT2_SB(sb), iblock, offsets);
+    if (depth < 0) {
+        return depth;
+    }
+
+    uint32_t* slot = &ei->i_block[offsets[0]];
+    struct buffer buf = { 0 };
+    uint32_t goal = create ? ext2_find_goal(inode, iblock) : 0;
+    int err = 0;
+
+    for (int level = 1; level < depth; level++) {
+        if (*slot == 0) {
+            if (!create) {
+                *block = 0;
+                goto out;
+            }
+            uint32_t indirect;
+            err = ext2_alloc_indirect(inode, goal, &indirect);
+            if (err < 0) {
+                goto out;
+            }
+            *slot = indirect;
+            if (buf.page) {
+                ext2_mark_buffer_dirty(sb, &buf);
+            } else {
+                mark_inode_dirty(inode);
+            }
+            goal = indirect + 1;
+        }
+
+        uint32_t next = *slot;
+        brelse(&buf);
+        err = bread(sb->bdev, next, sb->block_size, &buf);
+        if (err < 0) {
+            goto out;
+        }
+        slot = (uint32_t*)buf.data + offsets[level];
+    }
+
+    if (*slot == 0 && create) {
+        uint32_t data_block;
+        err = ext2_new_block(inode, goal, true, &data_block);
+        if (err < 0) {
+            goto out;
+        }
+        *slot = data_block;
+        if (buf.page) {
+            ext2_mark_buffer_dirty(sb, &buf);
+        } else {
+            mark_inode_dirty(inode);
+        }
+        ext2_journal_file_inode(inode);
+        ei->last_alloc_logical = iblock;
+        ei->last_alloc_physical = data_block;
+    }
+    *block = *slot;
+
+out:
+    brelse(&buf);
+    return err;
+}
+
+/* ============================================================================
+ * Page cache: чтение и запись страниц файла
+ * ============================================================================ */
+
+/*
+ * Обход блоков страницы: смежные физические блоки объединяются в один
+ * запрос к устройству. Блоки за концом файла и дыры пропускаются.
+ */
+static int ext2_page_io(struct inode* inode, struct page* page, bool write) {
+    struct super_block* sb = inode->sb;
+    uint32_t block_size = sb->block_size;
+    uint32_t sectors_per_block = block_size >> SECTOR_SHIFT;
+    uint32_t blocks_per_page = PAGE_SIZE / block_size;
+    uint32_t first_iblock = (uint32_t)(page->index * blocks_per_page);
+    uint8_t* data = page_address(page);
+
+    uint32_t run_start = 0;       /* Первый физический блок серии */
+    uint32_t run_length = 0;
+    uint8_t* run_data = NULL;
+
+    for (uint32_t i = 0; i <= blocks_per_page; i++) {
+        uint32_t physical = 0;
+
+        if (i < blocks_per_page &&
+            (uint64_t)(first_iblock + i) * block_size < inode->size) {
+            int err = ext2_get_block(inode, first_iblock + i, false, &physical);
+            if (err < 0) {
+                return err;
+            }
+        }
+        if (!write && i < blocks_per_page && physical == 0) {
+            memset(data + i * block_size, 0, block_size);
+        }
+
+        /* Продолжение текущей серии */
+        if (physical && run_length && physical == run_start + run_length) {
+            run_length++;
+            continue;
+        }
+
+        if (run_length) {
+            uint64_t sector = (uint64_t)run_start * sectors_per_block;
+            uint32_t count = run_length * sectors_per_block;
+            int err = write ? block_write(sb->bdev, sector, count, run_data)
+                            : block_read(sb->bdev, sector, count, run_data);
+            if (err < 0) {
+                return err;
+            }
+        }
+        run_start = physical;
+        run_length = physical ? 1 : 0;
+        run_data = data + i * block_size;
+    }
+    return 0;
+}
+
+static int ext2_readpage(struct address_space* mapping, struct page* page) {
+    struct inode* inode = mapping->host;
+    int err = ext2_page_io(inode, page, false);
+    if (err == 0 && S_ISDIR(inode->mode) && EXT2_SB(inode->sb)->journal) {
+        err = ext2_journal_read_page(inode, page);
+    }
+    return err;
+}
+
+static int ext2_writepage(struct address_space* mapping, struct page* page) {
+    return ext2_page_io(mapping->host, page, true);
+}
+
+static int ext2_alloc_page_blocks(struct inode* inode, struct page* page,
+                                  uint32_t from, uint32_t to) {
+    uint32_t block_size = inode->sb->block_size;
+    uint32_t blocks_per_page = PAGE_SIZE / block_size;
+    uint32_t first_iblock = (uint32_t)(page->index * blocks_per_page);
+
+    for (uint32_t i = from / block_size; i < DIV_ROUND_UP(to, block_size); i++) {
+        uint32_t physical;
+        int err = ext2_get_block(inode, first_iblock + i, true, &physical);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+/* Блоки выделяются при записи в кеш, чтобы ENOSPC вернулся из write() */
+static int ext2_write_begin(struct address_space* mapping, struct page* page,
+                            uint32_t from, uint32_t to) {
+    struct inode* inode = mapping->host;
+    int err = ext2_journal_start(inode->sb);
+    if (err < 0) {
+        return err;
+    }
+    err = ext2_alloc_page_blocks(inode, page, from, to);
+    if (err == -ENOSPC && ext2_journal_retry_alloc(inode->sb)) {
+        err = ext2_alloc_page_blocks(inode, page, from, to);
+    }
+    return err;
+}
+
+const struct address_space_ops ext2_aops = {
+    .readpage = ext2_readpage,
+    .writepage = ext2_writepage,
+    .write_begin = ext2_write_begin,
+};
+
+/* ============================================================================
+ * Усечение файла
+ * ============================================================================ */
+
+/* Освобождение поддерева: level = 0 - блок данных, 1..3 - косвенный блок */
+static void ext2_free_branch(struct inode* inode, uint32_t block, int level) {
+    if (level > 0) {
+        struct ext2_sb_info* sbi = EXT2_SB(inode->sb);
+        struct buffer buf;
+        if (bread(inode->sb->bdev, block, sbi->block_size, &buf) == 0) {
+            uint32_t* entries = buf.data;
+            for (uint32_t i = 0; i < sbi->addr_per_block; i++) {
+                if (entries[i]) {
+                    ext2_free_branch(inode, entries[i], level - 1);
+                }
+            }
+            brelse(&buf);
+        }
+    }
+    ext2_free_blocks(inode, block, 1);
+}
+
+/*
+ * Освобождение данных косвенного блока начиная с относительного логического
+ * номера start. Возвращает true, если блок опустел и его можно освободить.
+ */
+static bool ext2_truncate_indirect(struct inode* inode, uint32_t block, int level,
+                                   uint64_t start) {
+    struct ext2_sb_info* sbi = EXT2_SB(inode->sb);
+    uint64_t span = 1;
+    for (int i = 1; i < level; i++) {
+        span *= sbi->addr_per_block;
+    }
+
+    struct buffer buf;
+    if (bread(inode->sb->bdev, block, sbi->block_size, &buf) < 0) {
+        return false;
+    }
+    uint32_t* entries = buf.data;
+    uint32_t first = (uint32_t)(start / span);
+
+    if (start % span && entries[first]) {
+        if (ext2_truncate_indirect(inode, entries[first], level - 1, start % span)) {
+            ext2_free_blocks(inode, entries[first], 1);
+            entries[first] = 0;
+        }
+        first++;
+    } else if (start % span) {
+        first++;
+    }
+
+    for (uint32_t i = first; i < sbi->addr_per_block; i++) {
+        if (entries[i]) {
+            ext2_free_branch(inode, entries[i], level - 1);
+            entries[i] = 0;
+        }
+    }
+    ext2_mark_buffer_dirty(inode->sb, &buf);
+
+    bool empty = true;
+    for (uint32_t i = 0; i < sbi->addr_per_block && empty; i++) {
+        empty = entries[i] == 0;
+    }
+    brelse(&buf);
+    return empty;
+}
+
+int ext2_truncate(struct inode* inode, uint64_t size) {
+    struct ext2_inode_info* ei = EXT2_I(inode);
+    struct ext2_sb_info* sbi = EXT2_SB(inode->sb);
+    uint32_t block_size = sbi->block_size;
+
+    if (!ext2_inode_has_blocks(inode)) {
+        return -EINVAL;
+    }
+    if (size > inode->size) {
+        /* Расширение: новые блоки станут дырами */
+        inode->size = size;
+        mark_inode_dirty(inode);
+        return 0;
+    }
+
+    /* Данные за новым концом файла удаляются из кеша, хвост страницы обнуляется */
+    truncate_mapping(&inode->mapping, DIV_ROUND_UP(size, PAGE_SIZE));
+    if (size & (PAGE_SIZE - 1)) {
+        struct page* page = find_get_page(&inode->mapping, size >> PAGE_SHIFT);
+        if (page) {
+            uint32_t offset = size & (PAGE_SIZE - 1);
+            memset((uint8_t*)page_address(page) + offset, 0, PAGE_SIZE - offset);
+            page_cache_release(page);
+        }
+    }
+
+    ext2_discard_reservation(inode);
+    uint64_t first = DIV_ROUND_UP(size, block_size);
+
+    for (uint64_t i = first; i < EXT2_NDIR_BLOCKS; i++) {
+        if (ei->i_block[i]) {
+            ext2_free_blocks(inode, ei->i_block[i], 1);
+            ei->i_block[i] = 0;
+        }
+    }
+
+    uint64_t base = EXT2_NDIR_BLOCKS;
+    uint64_t span = sbi->addr_per_block;
+    for (int level = 1; level <= 3; level++) {
+        uint32_t* slot = &ei->i_block[EXT2_IND_BLOCK + level - 1];
+        if (*slot) {
+            if (first <= base) {
+                ext2_free_branch(inode, *slot, level);
+                *slot = 0;
+            } else if (first < base + span &&
+                       ext2_truncate_indirect(inode, *slot, level, first - base)) {
+                ext2_free_blocks(inode, *slot, 1);
+                *slot = 0;
+            }
+        }
+        base += span;
+        span *= sbi->addr_per_block;
+    }
+
+    if (ei->last_alloc_logical >= first) {
+        ei->last_alloc_logical = 0;
+        ei->last_alloc_physical = 0;
+    }
+    inode->size = size;
+    inode->mtime = inode->ctime = ext2_current_time(inode->sb);
+    mark_inode_dirty(inode);
+    return 0;
+}
+
+void ext2_evict_inode(struct inode* inode) {
+    struct ext2_inode_info* ei = EXT2_I(inode);
+
+    if (ext2_inode_has_blocks(inode)) {
+        ext2_truncate(inode, 0);
+    }
+    ei->i_dtime = ext2_current_time(inode->sb);
+    ext2_write_inode(inode);
+    ext2_free_inode(inode);
+}
+
+/* ============================================================================
+ * Операции обычных файлов
+ * ============================================================================ */
+
+static int ext2_setsize(struct inode* inode, uint64_t size) {
+    int err = ext2_journal_start(inode->sb);
+    return err < 0 ? err : ext2_truncate(inode, size);
+}
+
+/* Незанятое окно резервирования возвращается при закрытии файла на запись */
+static void ext2_release_file(struct file* file) {
+    if ((file->flags & O_ACCMODE) != O_RDONLY) {
+        ext2_discard_reservation(file->inode);
+    }
+}
+
+const struct inode_operations ext2_file_inode_operations = {
+    .truncate = ext2_setsize,
+};
+
+const struct file_operations ext2_file_operations = {
+    .read = generic_file_read,
+    .write = generic_file_write,
+    .splice_read = generic_file_splice_read,
+    .fsync = ext2_fsync,
+    .release = ext2_release_file,
+};
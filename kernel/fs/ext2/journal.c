@@ -0,0 +1,243 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/ext2/journal.c
+ * Драйвер ext2: журнал ext3
+ *
+ * ФС с флагом has_journal ведёт журнал в формате JBD2 во внутреннем
+ * inode (обычно 8). Битовые карты, дескрипторы групп, таблицы inode,
+ * косвенные блоки и блоки каталогов попадают в журнал, а не в кеш
+ * устройства; данные файлов пишутся на место до фиксации транзакции,
+ * которая на них ссылается (режим ordered ext3).
+ *
+ * Списка сирот нет: inode, удалённый при открытом файле, после сбоя
+ * остаётся занятым до проверки e2fsck.
+ * ============================================================================
+ */
+
+#include "fs/ext2/ext2.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Загрузка журнала
+ * ============================================================================ */
+
+/*
+ * Карта блоков inode журнала. Корень ФС ещё не прочитан, и inode журнала
+ * не должен попадать в кеш inode: он читается во временную структуру.
+ */
+static int ext2_journal_map(struct super_block* sb, uint32_t** out, uint32_t* count) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    struct ext2_inode_info* ei = kzalloc(sizeof(*ei));
+    if (!ei) {
+        return -ENOMEM;
+    }
+    struct inode* inode = &ei->vfs_inode;
+    inode->sb = sb;
+    inode->ino = sbi->es->s_journal_inum;
+
+    uint32_t* blocks = NULL;
+    uint32_t nblocks = 0;
+    int err = ext2_read_inode(inode);
+    if (err == 0) {
+        nblocks = (uint32_t)(inode->size / sbi->block_size);
+        if (!S_ISREG(inode->mode) || nblocks == 0) {
+            err = -EFSCORRUPTED;
+        }
+    }
+    if (err == 0) {
+        blocks = kmalloc(nblocks * sizeof(uint32_t));
+        err = blocks ? 0 : -ENOMEM;
+    }
+    for (uint32_t i = 0; err == 0 && i < nblocks; i++) {
+        err = ext2_get_block(inode, i, false, &blocks[i]);
+        if (err == 0 && blocks[i] == 0) {
+            err = -EFSCORRUPTED;
+        }
+    }
+    kfree(ei);
+
+    if (err < 0) {
+        kfree(blocks);
+        return err;
+    }
+    *out = blocks;
+    *count = nblocks;
+    return 0;
+}
+
+/*
+ * Незавершённые транзакции воспроизводятся при любом монтировании;
+ * запись через журнал включается, только если ФС монтируется на запись
+ * и формат журнала поддерживается.
+ */
+int ext2_load_journal(struct super_block* sb) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    struct ext2_super_block* es = sbi->es;
+
+    if (!ext2_has_compat(sbi, EXT2_FEATURE_COMPAT_HAS_JOURNAL)) {
+        return ext2_has_incompat(sbi, EXT2_FEATURE_INCOMPAT_RECOVER) ? -EINVAL : 0;
+    }
+    if (es->s_journal_dev || es->s_journal_inum == 0) {
+        terminal_writestring("  ext2: external journals are not supported\n");
+        return -EINVAL;
+    }
+
+    uint32_t* blocks;
+    uint32_t count;
+    int err = ext2_journal_map(sb, &blocks, &count);
+    if (err < 0) {
+        terminal_writestring("  ext2: cannot read journal inode\n");
+        return err;
+    }
+
+    struct journal* journal;
+    err = jbd_load(sb, blocks, count, &journal);
+    if (err == -EOPNOTSUPP) {
+        terminal_writestring("  ext2: unsupported journal format, mounting read-only\n");
+        sb->flags |= SB_RDONLY;
+        return 0;
+    }
+    if (err < 0) {
+        return err;
+    }
+    if (sb->flags & SB_RDONLY) {
+        jbd_destroy(journal);
+        return 0;
+    }
+    sbi->journal = journal;
+    return 0;
+}
+
+/* ============================================================================
+ * Метаданные через журнал
+ * ============================================================================ */
+
+int ext2_journal_start(struct super_block* sb) {
+    struct journal* journal = EXT2_SB(sb)->journal;
+    return journal ? jbd_start(journal) : 0;
+}
+
+/* Блок ФС, которому принадлежит буфер (суперблок - буфер в 1 KiB) */
+static uint32_t ext2_buffer_block(struct super_block* sb, struct buffer* buf, void** data) {
+    uint64_t block = buf->block * buf->size / sb->block_size;
+    *data = (uint8_t*)page_address(buf->page) + ((block * sb->block_size) & (PAGE_SIZE - 1));
+    return (uint32_t)block;
+}
+
+void ext2_mark_buffer_dirty(struct super_block* sb, struct buffer* buf) {
+    struct journal* journal = EXT2_SB(sb)->journal;
+    if (!journal) {
+        mark_buffer_dirty(buf);
+        return;
+    }
+    void* data;
+    uint32_t block = ext2_buffer_block(sb, buf, &data);
+    jbd_dirty_block(journal, block, buf->page, data);
+}
+
+/* Копия битовой карты до освобождений: освобождённое не выделяется до фиксации */
+int ext2_journal_get_undo_access(struct super_block* sb, struct buffer* buf) {
+    struct journal* journal = EXT2_SB(sb)->journal;
+    if (!journal) {
+        return 0;
+    }
+    void* data;
+    uint32_t block = ext2_buffer_block(sb, buf, &data);
+    return jbd_get_undo_access(journal, block, buf->page, data);
+}
+
+const uint8_t* ext2_journal_undo_data(struct super_block* sb, uint32_t block) {
+    struct journal* journal = EXT2_SB(sb)->journal;
+    return journal ? jbd_undo_data(journal, block) : NULL;
+}
+
+void ext2_journal_forget(struct super_block* sb, uint32_t block) {
+    struct journal* journal = EXT2_SB(sb)->journal;
+    if (journal) {
+        jbd_forget(journal, block);
+    }
+}
+
+/* Новый блок данных: страницы файла пишутся до фиксации указателя на него */
+void ext2_journal_file_inode(struct inode* inode) {
+    struct journal* journal = EXT2_SB(inode->sb)->journal;
+    if (journal && S_ISREG(inode->mode)) {
+        jbd_file_inode(journal, &EXT2_I(inode)->jinode);
+    }
+}
+
+/*
+ * Блоки каталога, ещё не записанные на место контрольной точкой,
+ * берутся из журнала: на диске под ними старое содержимое.
+ */
+int ext2_journal_read_page(struct inode* inode, struct page* page) {
+    struct journal* journal = EXT2_SB(inode->sb)->journal;
+    uint32_t block_size = inode->sb->block_size;
+    uint32_t blocks_per_page = PAGE_SIZE / block_size;
+    uint32_t first_iblock = (uint32_t)(page->index * blocks_per_page);
+    uint8_t* data = page_address(page);
+
+    for (uint32_t i = 0; i < blocks_per_page; i++) {
+        if ((uint64_t)(first_iblock + i) * block_size >= inode->size) {
+            break;
+        }
+        uint32_t physical;
+        int err = ext2_get_block(inode, first_iblock + i, false, &physical);
+        if (err < 0) {
+            return err;
+        }
+        if (physical) {
+            jbd_read_block(journal, physical, data + i * block_size);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Блоки, освобождённые в открытой транзакции, недоступны до её фиксации.
+ * При нехватке места транзакция фиксируется, и выделение повторяется.
+ */
+bool ext2_journal_retry_alloc(struct super_block* sb) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    struct journal* journal = sbi->journal;
+    if (!journal || journal->nr_running == 0 || sbi->es->s_free_blocks_count == 0) {
+        return false;
+    }
+    return jbd_commit(journal) == 0;
+}
+
+/* ============================================================================
+ * fsync
+ * ============================================================================ */
+
+/*
+ * Метаданные inode уходят фиксацией транзакции; если их уже унесла
+ * фиксация для другого fsync (групповая фиксация), журнал не трогается.
+ * Сброс кеша нужен отдельно, только если данные писались без фиксации.
+ */
+int ext2_fsync(struct file* file) {
+    struct inode* inode = file->inode;
+    struct journal* journal = EXT2_SB(inode->sb)->journal;
+    if (!journal) {
+        return generic_file_fsync(file);
+    }
+
+    bool data = !list_empty(&inode->mapping.dirty_pages);
+    int err = sync_mapping(&inode->mapping);
+    int werr = write_inode_now(inode);
+    if (err == 0) {
+        err = werr;
+    }
+    if (err < 0) {
+        return err;
+    }
+
+    if (!jbd_tid_committed(journal, EXT2_I(inode)->i_sync_tid)) {
+        err = jbd_commit(journal);
+        if (err < 0 || jbd_tid_committed(journal, EXT2_I(inode)->i_sync_tid)) {
+            return err;
+        }
+    }
+    return data ? block_flush(inode->sb->bdev) : 0;
+}
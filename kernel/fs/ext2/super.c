@@ -0,0 +1,357 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/ext2/super.c
+ * Драйвер ext2: монтирование, суперблок, таблица дескрипторов групп
+ * ============================================================================
+ */
+
+#include "fs/ext2/ext2.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Доступ к метаданным ФС
+ * ============================================================================ */
+
+struct ext2_group_desc* ext2_get_group_desc(struct super_block* sb, uint32_t group,
+                                            struct buffer** buf) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    struct buffer* gd_buffer = &sbi->gd_buffers[group / sbi->desc_per_block];
+    if (buf) {
+        *buf = gd_buffer;
+    }
+    return (struct ext2_group_desc*)gd_buffer->data + (group % sbi->desc_per_block);
+}
+
+/*
+ * Часов реального времени в ядре пока нет: временем считается момент
+ * последней записи суперблока (не ноль, чтобы e2fsck принимал i_dtime).
+ */
+uint32_t ext2_current_time(struct super_block* sb) {
+    struct ext2_super_block* es = EXT2_SB(sb)->es;
+    uint32_t now = MAX(es->s_wtime, es->s_mkfs_time);
+    return now ? now : 1;
+}
+
+void ext2_mark_super_dirty(struct super_block* sb) {
+    ext2_mark_buffer_dirty(sb, &EXT2_SB(sb)->sb_buffer);
+}
+
+/* ============================================================================
+ * Операции суперблока
+ * ============================================================================ */
+
+static struct inode* ext2_alloc_inode(struct super_block* sb) {
+    (void)sb;
+    struct ext2_inode_info* ei = kzalloc(sizeof(*ei));
+    if (!ei) {
+        return NULL;
+    }
+    list_init(&ei->rsv.list);
+    ei->rsv.goal_size = EXT2_DEFAULT_RESERVE_BLOCKS;
+    ei->jinode.inode = &ei->vfs_inode;
+    list_init(&ei->jinode.list);
+    return &ei->vfs_inode;
+}
+
+static void ext2_destroy_inode(struct inode* inode) {
+    ext2_discard_reservation(inode);
+    jbd_release_inode(&EXT2_I(inode)->jinode);
+    kfree(EXT2_I(inode));
+}
+
+static int ext2_sync_fs(struct super_block* sb) {
+    struct journal* journal = EXT2_SB(sb)->journal;
+    ext2_mark_super_dirty(sb);
+    return journal ? jbd_commit(journal) : 0;
+}
+
+static const struct super_operations ext2_super_operations = {
+    .alloc_inode = ext2_alloc_inode,
+    .destroy_inode = ext2_destroy_inode,
+    .read_inode = ext2_read_inode,
+    .write_inode = ext2_write_inode,
+    .evict_inode = ext2_evict_inode,
+    .sync_fs = ext2_sync_fs,
+};
+
+/* ============================================================================
+ * Монтирование
+ * ============================================================================ */
+
+static void ext2_release_metadata(struct ext2_sb_info* sbi) {
+    if (sbi->gd_buffers) {
+        for (uint32_t i = 0; i < sbi->gd_blocks; i++) {
+            brelse(&sbi->gd_buffers[i]);
+        }
+        kfree(sbi->gd_buffers);
+        sbi->gd_buffers = NULL;
+    }
+    brelse(&sbi->sb_buffer);
+}
+
+static void ext2_put_super(struct ext2_sb_info* sbi) {
+    if (sbi->journal) {
+        jbd_destroy(sbi->journal);
+    }
+    ext2_release_metadata(sbi);
+    kfree(sbi);
+}
+
+static int ext2_read_super(struct ext2_sb_info* sbi, struct block_device* bdev) {
+    /* Суперблок всегда расположен по смещению 1024 байта */
+    int err = bread(bdev, EXT2_SUPERBLOCK_OFFSET / 1024, 1024, &sbi->sb_buffer);
+    if (err == 0) {
+        sbi->es = sbi->sb_buffer.data;
+    }
+    return err;
+}
+
+/* Таблица дескрипторов групп закрепляется в кеше на всё время работы */
+static int ext2_read_group_descs(struct ext2_sb_info* sbi, struct block_device* bdev) {
+    sbi->gd_buffers = kzalloc(sbi->gd_blocks * sizeof(struct buffer));
+    if (!sbi->gd_buffers) {
+        return -ENOMEM;
+    }
+    for (uint32_t i = 0; i < sbi->gd_blocks; i++) {
+        int err = bread(bdev, sbi->first_data_block + 1 + i, sbi->block_size,
+                        &sbi->gd_buffers[i]);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Журнал загружается до чтения корня: воспроизведение пишет блоки мимо
+ * кеша устройства, поэтому закреплённые метаданные затем перечитываются.
+ * Флаг recover стоит на диске, пока журнал используется для записи.
+ */
+static int ext2_setup_journal(struct ext2_sb_info* sbi, struct super_block* sb) {
+    int err = ext2_load_journal(sb);
+    if (err < 0 || !ext2_has_compat(sbi, EXT2_FEATURE_COMPAT_HAS_JOURNAL)) {
+        return err;
+    }
+
+    ext2_release_metadata(sbi);
+    truncate_mapping(&sb->bdev->mapping, 0);
+    err = ext2_read_super(sbi, sb->bdev);
+    if (err == 0) {
+        err = ext2_read_group_descs(sbi, sb->bdev);
+    }
+    if (err < 0) {
+        return err;
+    }
+
+    bool recover = sbi->journal != NULL;
+    if (ext2_has_incompat(sbi, EXT2_FEATURE_INCOMPAT_RECOVER) != recover) {
+        sbi->es->s_feature_incompat ^= EXT2_FEATURE_INCOMPAT_RECOVER;
+        mark_buffer_dirty(&sbi->sb_buffer);
+        err = bdev_sync(sb->bdev);
+    }
+    if (err == 0 && sbi->journal) {
+        terminal_writestring("  ext2: journal of ");
+        terminal_writedec(sbi->journal->maxlen);
+        terminal_writestring(" blocks, ordered data mode\n");
+    }
+    return err;
+}
+
+static int ext2_fill_super(struct ext2_sb_info* sbi, struct super_block* sb) {
+    struct ext2_super_block* es = sbi->es;
+
+    if (es->s_magic != EXT2_SUPER_MAGIC) {
+        return -EINVAL;
+    }
+    if (es->s_log_block_size > 2) {
+        /* Блоки больше страницы не поддерживаются кешем устройства */
+        return -EINVAL;
+    }
+    if (es->s_feature_incompat & ~EXT2_FEATURE_INCOMPAT_SUPP) {
+        terminal_writestring("  ext2: unsupported incompatible features\n");
+        return -EINVAL;
+    }
+    if (es->s_feature_ro_compat & ~EXT2_FEATURE_RO_COMPAT_SUPP) {
+        terminal_writestring("  ext2: unsupported features, mounting read-only\n");
+        sb->flags |= SB_RDONLY;
+    }
+
+    sbi->block_size = 1024U << es->s_log_block_size;
+    sbi->blocks_per_group = es->s_blocks_per_group;
+    sbi->inodes_per_group = es->s_inodes_per_group;
+    sbi->first_data_block = es->s_first_data_block;
+
+    if (es->s_rev_level == 0) {
+        sbi->first_ino = EXT2_GOOD_OLD_FIRST_INO;
+        sbi->inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+    } else {
+        sbi->first_ino = es->s_first_ino;
+        sbi->inode_size = es->s_inode_size;
+    }
+    if (sbi->inode_size < EXT2_GOOD_OLD_INODE_SIZE || sbi->inode_size > sbi->block_size ||
+        (sbi->inode_size & (sbi->inode_size - 1))) {
+        return -EINVAL;
+    }
+    if (sbi->blocks_per_group == 0 || sbi->inodes_per_group == 0 ||
+        sbi->blocks_per_group > sbi->block_size * 8 ||
+        sbi->inodes_per_group > sbi->block_size * 8) {
+        return -EINVAL;
+    }
+    if ((uint64_t)es->s_blocks_count * sbi->block_size >
+        sb->bdev->nr_sectors * SECTOR_SIZE) {
+        return -EINVAL;
+    }
+
+    sbi->inodes_per_block = sbi->block_size / sbi->inode_size;
+    sbi->desc_per_block = sbi->block_size / sizeof(struct ext2_group_desc);
+    sbi->addr_per_block = sbi->block_size / sizeof(uint32_t);
+    sbi->addr_per_block_bits = 8 + es->s_log_block_size;
+    sbi->groups_count = DIV_ROUND_UP(es->s_blocks_count - sbi->first_data_block,
+                                     sbi->blocks_per_group);
+
+    memcpy(sbi->hash_seed, es->s_hash_seed, sizeof(sbi->hash_seed));
+    sbi->def_hash_version = es->s_def_hash_version;
+    sbi->hash_unsigned = (es->s_flags & EXT2_FLAGS_UNSIGNED_HASH) ? 3 : 0;
+
+    sbi->gd_blocks = DIV_ROUND_UP(sbi->groups_count, sbi->desc_per_block);
+    int err = ext2_read_group_descs(sbi, sb->bdev);
+    if (err < 0) {
+        return err;
+    }
+
+    list_init(&sbi->rsv_windows);
+    sb->block_size = sbi->block_size;
+    sb->s_op = &ext2_super_operations;
+    sb->fs_info = sbi;
+
+    err = ext2_setup_journal(sbi, sb);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* root;
+    err = iget(sb, EXT2_ROOT_INO, &root);
+    if (err < 0) {
+        return err;
+    }
+    if (!S_ISDIR(root->mode)) {
+        iput(root);
+        return -EFSCORRUPTED;
+    }
+    sb->root = root;
+    return 0;
+}
+
+static void ext2_unmount(struct super_block* sb) {
+    struct ext2_sb_info* sbi = EXT2_SB(sb);
+    if (sb->root) {
+        iput(sb->root);
+    }
+
+    /* Журнал очищается, и ФС снова не требует восстановления */
+    if (sbi->journal && jbd_checkpoint(sbi->journal) == 0) {
+        jbd_destroy(sbi->journal);
+        sbi->journal = NULL;
+        sbi->es->s_feature_incompat &= ~EXT2_FEATURE_INCOMPAT_RECOVER;
+        mark_buffer_dirty(&sbi->sb_buffer);
+        bdev_sync(sb->bdev);
+    }
+    ext2_put_super(sbi);
+}
+
+/* Параметры монтирования */
+struct ext2_mount_options {
+    uint32_t commit_ops;            /* Интервал фиксации журнала (0 - по умолчанию) */
+};
+
+/*
+ * Разбор "commit_ops=N[,...]"; неизвестный параметр - ошибка. N - число
+ * операций между фиксациями журнала, а не секунды, как у commit= в
+ * Linux: другое имя не даёт перенести оттуда commit=5 и фиксировать
+ * каждые пять операций.
+ */
+static int ext2_parse_options(const char* options, struct ext2_mount_options* opts) {
+    const char* p = options;
+    while (p && *p) {
+        const char* end = p;
+        while (*end && *end != ',') {
+            end++;
+        }
+        size_t len = (size_t)(end - p);
+
+        if (len > 11 && strncmp(p, "commit_ops=", 11) == 0) {
+            uint64_t value = 0;
+            for (const char* c = p + 11; c < end; c++) {
+                if (*c < '0' || *c > '9' || value > UINT32_MAX / 10) {
+                    return -EINVAL;
+                }
+                value = value * 10 + (uint64_t)(*c - '0');
+            }
+            if (value == 0 || value > UINT32_MAX) {
+                return -EINVAL;
+            }
+            opts->commit_ops = (uint32_t)value;
+        } else if (len) {
+            terminal_writestring("  ext2: unknown mount option\n");
+            return -EINVAL;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+static int ext2_mount(struct block_device* bdev, struct super_block* sb) {
+    struct ext2_mount_options opts = { 0 };
+    int err = ext2_parse_options(sb->options, &opts);
+    if (err < 0) {
+        return err;
+    }
+
+    struct ext2_sb_info* sbi = kzalloc(sizeof(*sbi));
+    if (!sbi) {
+        return -ENOMEM;
+    }
+    sbi->sb = sb;
+    sb->bdev = bdev;
+
+    err = ext2_read_super(sbi, bdev);
+    if (err == 0) {
+        err = ext2_fill_super(sbi, sb);
+    }
+    if (err < 0) {
+        sb->fs_info = NULL;
+        ext2_put_super(sbi);
+        return err;
+    }
+
+    /* Без журнала (ext2, только чтение) параметр не молча игнорируется */
+    if (opts.commit_ops) {
+        if (!sbi->journal) {
+            terminal_writestring("  ext2: commit_ops= needs a journal\n");
+            ext2_unmount(sb);
+            sb->fs_info = NULL;
+            return -EINVAL;
+        }
+        jbd_set_commit_interval(sbi->journal, opts.commit_ops);
+    }
+
+    terminal_writestring("  ext2: ");
+    terminal_writedec(sbi->es->s_blocks_count);
+    terminal_writestring(" blocks of ");
+    terminal_writedec(sbi->block_size);
+    terminal_writestring(" bytes, ");
+    terminal_writedec(sbi->groups_count);
+    terminal_writestring(" groups\n");
+    return 0;
+}
+
+static struct filesystem_type ext2_fs_type = {
+    .name = "ext2",
+    .mount = ext2_mount,
+    .unmount = ext2_unmount,
+};
+
+void ext2_init(void) {
+    register_filesystem(&ext2_fs_type);
+}
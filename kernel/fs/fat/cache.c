@@ -0,0 +1,227 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/fat/cache.c
+ * Драйвер FAT32: кеш экстентов цепочек кластеров
+ *
+ * Цепочка кластеров - связный список в FAT, и поиск кластера по смещению
+ * в файле без кеша требует прохода от начала файла. Каждый inode хранит
+ * несколько экстентов (кластер файла -> кластер диска, длина); поиск
+ * начинается от ближайшего экстента слева, а на непрерывных участках
+ * ответ вычисляется без чтения FAT.
+ * ============================================================================
+ */
+
+#include "fs/fat/fat.h"
+#include "errno.h"
+
+static struct fat_extent* fat_cache_lookup(struct fat_inode_info* fi, uint32_t fcluster) {
+    struct fat_extent* best = NULL;
+    for (uint32_t i = 0; i < fi->nr_extents; i++) {
+        struct fat_extent* e = &fi->extents[i];
+        if (e->fcluster <= fcluster && (!best || e->fcluster > best->fcluster)) {
+            best = e;
+        }
+    }
+    if (best) {
+        best->stamp = ++fi->extent_clock;
+    }
+    return best;
+}
+
+void fat_cache_add(struct inode* inode, uint32_t fcluster, uint32_t dcluster, uint32_t len) {
+    struct fat_inode_info* fi = FAT_I(inode);
+
+    /* Продолжение или перекрытие существующего экстента */
+    for (uint32_t i = 0; i < fi->nr_extents; i++) {
+        struct fat_extent* e = &fi->extents[i];
+        if (fcluster >= e->fcluster && fcluster <= e->fcluster + e->len &&
+            dcluster - fcluster == e->dcluster - e->fcluster) {
+            e->len = MAX(e->len, fcluster + len - e->fcluster);
+            e->stamp = ++fi->extent_clock;
+            return;
+        }
+    }
+
+    struct fat_extent* slot;
+    if (fi->nr_extents < FAT_EXTENT_CACHE_SIZE) {
+        slot = &fi->extents[fi->nr_extents++];
+    } else {
+        slot = &fi->extents[0];
+        for (uint32_t i = 1; i < FAT_EXTENT_CACHE_SIZE; i++) {
+            if (fi->extents[i].stamp < slot->stamp) {
+                slot = &fi->extents[i];
+            }
+        }
+    }
+    slot->fcluster = fcluster;
+    slot->dcluster = dcluster;
+    slot->len = len;
+    slot->stamp = ++fi->extent_clock;
+}
+
+/* Отбрасывание сведений о кластерах с номерами >= nr_clusters */
+void fat_cache_truncate(struct inode* inode, uint32_t nr_clusters) {
+    struct fat_inode_info* fi = FAT_I(inode);
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < fi->nr_extents; i++) {
+        struct fat_extent e = fi->extents[i];
+        if (e.fcluster >= nr_clusters) {
+            continue;
+        }
+        e.len = MIN(e.len, nr_clusters - e.fcluster);
+        fi->extents[kept++] = e;
+    }
+    fi->nr_extents = kept;
+}
+
+/*
+ * Кластер диска для кластера файла fcluster. Если цепочка короче,
+ * возвращается -ENOENT, а в last_* - последний кластер цепочки
+ * (last_dcluster = 0 у файла без кластеров).
+ */
+int fat_get_cluster(struct inode* inode, uint32_t fcluster, uint32_t* dcluster,
+                    uint32_t* last_fcluster, uint32_t* last_dcluster) {
+    struct fat_inode_info* fi = FAT_I(inode);
+    struct super_block* sb = inode->sb;
+    struct fat_sb_info* sbi = FAT_SB(sb);
+
+    if (fi->start == 0) {
+        if (last_fcluster) {
+            *last_fcluster = 0;
+            *last_dcluster = 0;
+        }
+        return -ENOENT;
+    }
+
+    uint32_t cur_f = 0, cur_d = fi->start;
+    struct fat_extent* e = fat_cache_lookup(fi, fcluster);
+    if (e) {
+        if (fcluster < e->fcluster + e->len) {
+            *dcluster = e->dcluster + (fcluster - e->fcluster);
+            return 0;
+        }
+        cur_f = e->fcluster + e->len - 1;
+        cur_d = e->dcluster + e->len - 1;
+    }
+
+    /* Проход по FAT с записью встреченных непрерывных участков */
+    uint32_t run_f = cur_f, run_d = cur_d, run_len = 1;
+    struct fat_entry fe;
+    int err = 0;
+
+    fat_entry_init(&fe);
+    while (cur_f < fcluster) {
+        uint32_t next;
+        err = fat_ent_read(sb, &fe, cur_d, &next);
+        if (err < 0) {
+            break;
+        }
+        if (next >= FAT_EOC) {
+            break;
+        }
+        if (!fat_valid_cluster(sbi, next) || cur_f + 1 >= sbi->max_cluster) {
+            terminal_writestring("  fat: corrupted cluster chain\n");
+            err = -EFSCORRUPTED;
+            break;
+        }
+        cur_f++;
+        if (next == cur_d + 1) {
+            run_len++;
+        } else {
+            fat_cache_add(inode, run_f, run_d, run_len);
+            run_f = cur_f;
+            run_d = next;
+            run_len = 1;
+        }
+        cur_d = next;
+    }
+    fat_entry_release(&fe);
+    fat_cache_add(inode, run_f, run_d, run_len);
+
+    if (err < 0) {
+        return err;
+    }
+    if (cur_f == fcluster) {
+        *dcluster = cur_d;
+        return 0;
+    }
+    if (last_fcluster) {
+        *last_fcluster = cur_f;
+        *last_dcluster = cur_d;
+    }
+    return -ENOENT;
+}
+
+/*
+ * Кластер диска с выделением недостающих до fcluster включительно. В FAT
+ * нет дыр: промежуточные кластеры обнуляются, последний - тоже, если
+ * вызывающий не перезаписывает его целиком (overwrite).
+ */
+int fat_get_block(struct inode* inode, uint32_t fcluster, bool create, bool overwrite,
+                  uint32_t* dcluster) {
+    struct fat_inode_info* fi = FAT_I(inode);
+    struct super_block* sb = inode->sb;
+    bool metadata = S_ISDIR(inode->mode);
+    uint32_t last_f, last_d;
+
+    int err = fat_get_cluster(inode, fcluster, dcluster, &last_f, &last_d);
+    if (err != -ENOENT || !create) {
+        return err;
+    }
+    if (sb->flags & SB_RDONLY) {
+        return -EROFS;
+    }
+
+    uint32_t next_f = last_d ? last_f + 1 : 0;
+    while (next_f <= fcluster) {
+        uint32_t cluster;
+        err = fat_alloc_cluster(sb, last_d ? last_d + 1 : 0, &cluster);
+        if (err < 0) {
+            return err;
+        }
+        if (!overwrite || next_f < fcluster) {
+            err = fat_zero_cluster(sb, cluster, metadata);
+            if (err < 0) {
+                fat_free_chain(sb, cluster, metadata);
+                return err;
+            }
+        }
+
+        if (last_d) {
+            struct fat_entry fe;
+            fat_entry_init(&fe);
+            err = fat_ent_write(sb, &fe, last_d, cluster);
+            fat_entry_release(&fe);
+            if (err < 0) {
+                fat_free_chain(sb, cluster, metadata);
+                return err;
+            }
+        } else {
+            fi->start = cluster;
+            mark_inode_dirty(inode);
+        }
+        fat_cache_add(inode, next_f, cluster, 1);
+
+        last_d = cluster;
+        next_f++;
+    }
+    *dcluster = last_d;
+    return 0;
+}
+
+/* Длина цепочки в кластерах (размер каталогов на диске не хранится) */
+int fat_chain_length(struct inode* inode, uint32_t* count) {
+    struct fat_sb_info* sbi = FAT_SB(inode->sb);
+    uint32_t dcluster, last_f, last_d;
+
+    int err = fat_get_cluster(inode, sbi->max_cluster, &dcluster, &last_f, &last_d);
+    if (err == 0) {
+        return -EFSCORRUPTED;
+    }
+    if (err != -ENOENT) {
+        return err;
+    }
+    *count = last_d ? last_f + 1 : 0;
+    return 0;
+}
@@ -0,0 +1,920 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/fat/dir.c
+ * Драйвер FAT32: каталоги, короткие и длинные (VFAT) имена
+ *
+ * Каталоги читаются и пишутся через кеш блочного устройства посекторно,
+ * как и записи, служащие inode: так у каждой записи одна копия в памяти.
+ * Имена сравниваются без учёта регистра латиницы, длинные имена хранятся
+ * в UTF-16 и отдаются наружу в UTF-8.
+ * ============================================================================
+ */
+
+#include "fs/fat/fat.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/* Максимальная длина имени в UTF-8 (255 символов UTF-16 по 3 байта) */
+#define FAT_NAME_BUF            (FAT_LFN_MAX_SLOTS * FAT_LFN_CHARS * 3 + 1)
+
+/* Каталог FAT ограничен 65536 записями */
+#define FAT_MAX_DIR_SIZE        (65536U * FAT_DIR_ENTRY_SIZE)
+
+/* Разобранная запись каталога */
+struct fat_slot_info {
+    char name[FAT_NAME_BUF];
+    size_t len;
+    uint64_t start;                 /* Смещение первого слота (LFN или короткого) */
+    uint64_t offset;                /* Смещение короткой записи */
+    uint64_t ino;
+    struct fat_dir_entry de;
+};
+
+/* Курсор по секторам каталога */
+struct fat_dir_cursor {
+    struct buffer buf;
+    uint64_t sector;
+    bool valid;
+};
+
+static void fat_cursor_release(struct fat_dir_cursor* cursor) {
+    if (cursor->valid) {
+        brelse(&cursor->buf);
+        cursor->valid = false;
+    }
+}
+
+/* Запись каталога по смещению; sector получает номер её сектора */
+static int fat_dir_entry_at(struct inode* dir, struct fat_dir_cursor* cursor,
+                            uint64_t offset, struct fat_dir_entry** de, uint64_t* sector) {
+    struct fat_sb_info* sbi = FAT_SB(dir->sb);
+    uint32_t dcluster;
+
+    int err = fat_get_cluster(dir, (uint32_t)(offset / sbi->cluster_size), &dcluster, NULL, NULL);
+    if (err < 0) {
+        return err == -ENOENT ? -EFSCORRUPTED : err;
+    }
+    uint64_t s = fat_cluster_sector(sbi, dcluster) +
+                 (offset % sbi->cluster_size) / FAT_SECTOR_SIZE;
+
+    if (!cursor->valid || cursor->sector != s) {
+        fat_cursor_release(cursor);
+        err = bread(dir->sb->bdev, s, FAT_SECTOR_SIZE, &cursor->buf);
+        if (err < 0) {
+            return err;
+        }
+        cursor->sector = s;
+        cursor->valid = true;
+    }
+    *de = (struct fat_dir_entry*)((uint8_t*)cursor->buf.data + offset % FAT_SECTOR_SIZE);
+    if (sector) {
+        *sector = s;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Имена
+ * ============================================================================ */
+
+static inline char fat_toupper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+static inline char fat_tolower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool fat_name_equal(const char* a, size_t alen, const char* b, size_t blen) {
+    if (alen != blen) {
+        return false;
+    }
+    for (size_t i = 0; i < alen; i++) {
+        if (fat_toupper(a[i]) != fat_toupper(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t fat_checksum(const uint8_t* name) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + name[i]);
+    }
+    return sum;
+}
+
+/* Короткое имя записи в виде строки с учётом флагов регистра */
+static size_t fat_short_to_name(const struct fat_dir_entry* de, char* out) {
+    size_t len = 0;
+    int base_end = 8, ext_end = 11;
+
+    while (base_end > 0 && de->name[base_end - 1] == ' ') {
+        base_end--;
+    }
+    while (ext_end > 8 && de->name[ext_end - 1] == ' ') {
+        ext_end--;
+    }
+    for (int i = 0; i < base_end; i++) {
+        char c = (char)de->name[i];
+        if (i == 0 && de->name[0] == FAT_KANJI_E5) {
+            c = (char)FAT_DELETED;
+        }
+        out[len++] = (de->lcase & FAT_LCASE_BASE) ? fat_tolower(c) : c;
+    }
+    if (ext_end > 8) {
+        out[len++] = '.';
+        for (int i = 8; i < ext_end; i++) {
+            char c = (char)de->name[i];
+            out[len++] = (de->lcase & FAT_LCASE_EXT) ? fat_tolower(c) : c;
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/* UTF-16 (только BMP) -> UTF-8 */
+static size_t fat_utf16_to_utf8(const uint16_t* in, size_t count, char* out) {
+    size_t len = 0;
+    for (size_t i = 0; i < count && in[i]; i++) {
+        uint16_t c = in[i];
+        if (c < 0x80) {
+            out[len++] = (char)c;
+        } else if (c < 0x800) {
+            out[len++] = (char)(0xC0 | (c >> 6));
+            out[len++] = (char)(0x80 | (c & 0x3F));
+        } else if (c >= 0xD800 && c <= 0xDFFF) {
+            out[len++] = '?';
+        } else {
+            out[len++] = (char)(0xE0 | (c >> 12));
+            out[len++] = (char)(0x80 | ((c >> 6) & 0x3F));
+            out[len++] = (char)(0x80 | (c & 0x3F));
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/* UTF-8 -> UTF-16; символы вне BMP и некорректные последовательности отвергаются */
+static int fat_utf8_to_utf16(const char* in, size_t len, uint16_t* out, size_t max) {
+    size_t count = 0;
+    for (size_t i = 0; i < len; ) {
+        uint8_t c = (uint8_t)in[i];
+        uint32_t cp;
+        size_t n;
+        if (c < 0x80) {
+            cp = c;
+            n = 1;
+        } else if ((c & 0xE0) == 0xC0) {
+            cp = c & 0x1F;
+            n = 2;
+        } else if ((c & 0xF0) == 0xE0) {
+            cp = c & 0x0F;
+            n = 3;
+        } else {
+            return -EINVAL;
+        }
+        if (i + n > len) {
+            return -EINVAL;
+        }
+        for (size_t k = 1; k < n; k++) {
+            uint8_t cc = (uint8_t)in[i + k];
+            if ((cc & 0xC0) != 0x80) {
+                return -EINVAL;
+            }
+            cp = (cp << 6) | (cc & 0x3F);
+        }
+        if (count >= max || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            return -EINVAL;
+        }
+        out[count++] = (uint16_t)cp;
+        i += n;
+    }
+    return (int)count;
+}
+
+static bool fat_short_char_ok(char c) {
+    if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    for (const char* p = "!#$%&'()-@^_`{}~"; *p; p++) {
+        if (*p == c) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int fat_check_name(const char* name, size_t len) {
+    if (len == 0 || (len == 1 && name[0] == '.') ||
+        (len == 2 && name[0] == '.' && name[1] == '.')) {
+        return -EINVAL;
+    }
+    /* Windows отбрасывает завершающие точки и пробелы: такие имена не создаём */
+    if (name[len - 1] == '.' || name[len - 1] == ' ') {
+        return -EINVAL;
+    }
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)name[i];
+        if (c < 0x20 || c == '"' || c == '*' || c == '/' || c == ':' || c == '<' ||
+            c == '>' || c == '?' || c == '\\' || c == '|') {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Точное представление имени в формате 8.3. Части, целиком набранные
+ * строчными буквами, отмечаются флагами lcase; смешанный регистр требует
+ * длинного имени.
+ */
+static bool fat_format_short(const char* name, size_t len, uint8_t* out, uint8_t* lcase) {
+    size_t dot = len;
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] == '.') {
+            if (dot != len) {
+                return false;
+            }
+            dot = i;
+        }
+    }
+    size_t base_len = dot;
+    size_t ext_len = dot < len ? len - dot - 1 : 0;
+    if (base_len == 0 || base_len > 8 || ext_len > 3 || (dot < len && ext_len == 0)) {
+        return false;
+    }
+
+    memset(out, ' ', 11);
+    *lcase = 0;
+    for (int part = 0; part < 2; part++) {
+        const char* src = part ? name + dot + 1 : name;
+        size_t count = part ? ext_len : base_len;
+        bool upper = false, lower = false;
+        for (size_t i = 0; i < count; i++) {
+            char c = src[i];
+            if (c >= 'a' && c <= 'z') {
+                lower = true;
+            } else if (c >= 'A' && c <= 'Z') {
+                upper = true;
+            }
+            c = fat_toupper(c);
+            if (!fat_short_char_ok(c)) {
+                return false;
+            }
+            out[(part ? 8 : 0) + i] = (uint8_t)c;
+        }
+        if (upper && lower) {
+            return false;
+        }
+        if (lower) {
+            *lcase |= part ? FAT_LCASE_EXT : FAT_LCASE_BASE;
+        }
+    }
+    if (out[0] == FAT_DELETED) {
+        out[0] = FAT_KANJI_E5;
+    }
+    return true;
+}
+
+/* Основа короткого имени для длинного: "LONGFI~1.TXT" без хвоста */
+static void fat_short_basis(const char* name, size_t len, uint8_t* out, size_t* base_len) {
+    size_t start = 0;
+    while (start < len && name[start] == '.') {
+        start++;
+    }
+    size_t dot = len;
+    for (size_t i = len; i > start; i--) {
+        if (name[i - 1] == '.') {
+            dot = i - 1;
+            break;
+        }
+    }
+
+    memset(out, ' ', 11);
+    size_t n = 0;
+    for (size_t i = start; i < dot && n < 8; i++) {
+        char c = fat_toupper(name[i]);
+        if (c == ' ' || c == '.') {
+            continue;
+        }
+        out[n++] = fat_short_char_ok(c) ? (uint8_t)c : '_';
+    }
+    if (n == 0) {
+        out[n++] = '_';
+    }
+    *base_len = n;
+
+    size_t e = 8;
+    for (size_t i = dot + 1; i < len && e < 11; i++) {
+        char c = fat_toupper(name[i]);
+        if (c == ' ') {
+            continue;
+        }
+        out[e++] = fat_short_char_ok(c) ? (uint8_t)c : '_';
+    }
+}
+
+/* ============================================================================
+ * Обход записей
+ * ============================================================================ */
+
+/*
+ * Следующая занятая запись начиная со смещения *pos. Цепочка слотов LFN
+ * принимается, только если номера идут подряд и контрольная сумма совпадает
+ * с коротким именем, иначе используется короткое имя.
+ */
+static int fat_dir_next(struct inode* dir, uint64_t* pos, struct fat_slot_info* si) {
+    struct fat_dir_cursor cursor = { .valid = false };
+    uint16_t lfn[FAT_LFN_MAX_SLOTS * FAT_LFN_CHARS];
+    uint32_t lfn_slots = 0, lfn_seq = 0;
+    uint8_t lfn_checksum = 0;
+    uint64_t lfn_start = 0;
+    int err = -ENOENT;
+
+    while (*pos < dir->size) {
+        uint64_t offset = *pos;
+        struct fat_dir_entry* de;
+        uint64_t sector;
+
+        int r = fat_dir_entry_at(dir, &cursor, offset, &de, &sector);
+        if (r < 0) {
+            err = r;
+            break;
+        }
+        *pos += FAT_DIR_ENTRY_SIZE;
+
+        if (de->name[0] == FAT_END_OF_DIR) {
+            *pos = dir->size;
+            break;
+        }
+        if (de->name[0] == FAT_DELETED) {
+            lfn_seq = 0;
+            continue;
+        }
+        if (de->attr == FAT_ATTR_LFN) {
+            struct fat_lfn_entry* l = (struct fat_lfn_entry*)de;
+            uint32_t seq = l->id & FAT_LFN_SEQ_MASK;
+            if (l->id & FAT_LFN_LAST) {
+                if (seq == 0 || seq > FAT_LFN_MAX_SLOTS) {
+                    lfn_seq = 0;
+                    continue;
+                }
+                lfn_slots = seq;
+                lfn_checksum = l->checksum;
+                lfn_start = offset;
+                memset(lfn, 0, sizeof(lfn));
+            } else if (lfn_seq == 0 || seq != lfn_seq - 1 || l->checksum != lfn_checksum) {
+                lfn_seq = 0;
+                continue;
+            }
+            lfn_seq = seq;
+            uint16_t* dst = &lfn[(seq - 1) * FAT_LFN_CHARS];
+            memcpy(dst, l->name0_4, sizeof(l->name0_4));
+            memcpy(dst + 5, l->name5_10, sizeof(l->name5_10));
+            memcpy(dst + 11, l->name11_12, sizeof(l->name11_12));
+            continue;
+        }
+        if (de->attr & FAT_ATTR_VOLUME) {
+            lfn_seq = 0;
+            continue;
+        }
+
+        si->de = *de;
+        si->offset = offset;
+        si->ino = fat_make_ino(sector, (uint32_t)(offset % FAT_SECTOR_SIZE) / FAT_DIR_ENTRY_SIZE);
+        if (lfn_seq == 1 && fat_checksum(de->name) == lfn_checksum) {
+            si->len = fat_utf16_to_utf8(lfn, lfn_slots * FAT_LFN_CHARS, si->name);
+            si->start = lfn_start;
+        } else {
+            si->len = fat_short_to_name(de, si->name);
+            si->start = offset;
+        }
+        err = 0;
+        break;
+    }
+    fat_cursor_release(&cursor);
+    return err;
+}
+
+static bool fat_is_dot(const struct fat_slot_info* si) {
+    return si->de.name[0] == '.' && (si->de.attr & FAT_ATTR_DIR);
+}
+
+/* Поиск по длинному или короткому имени */
+static int fat_find(struct inode* dir, const char* name, size_t len, struct fat_slot_info* si) {
+    uint64_t pos = 0;
+    int err;
+    while ((err = fat_dir_next(dir, &pos, si)) == 0) {
+        if (fat_name_equal(si->name, si->len, name, len)) {
+            return 0;
+        }
+        if (si->start != si->offset) {
+            char short_name[13];
+            size_t short_len = fat_short_to_name(&si->de, short_name);
+            if (fat_name_equal(short_name, short_len, name, len)) {
+                return 0;
+            }
+        }
+    }
+    return err;
+}
+
+static bool fat_short_exists(struct inode* dir, const uint8_t* name11) {
+    struct fat_slot_info* si = kmalloc(sizeof(*si));
+    if (!si) {
+        return true;
+    }
+    uint64_t pos = 0;
+    bool found = false;
+    while (!found && fat_dir_next(dir, &pos, si) == 0) {
+        found = memcmp(si->de.name, name11, 11) == 0;
+    }
+    kfree(si);
+    return found;
+}
+
+/* ============================================================================
+ * Добавление и удаление записей
+ * ============================================================================ */
+
+/* Поиск nr подряд идущих свободных слотов; при нехватке каталог растёт */
+static int fat_find_slots(struct inode* dir, uint32_t nr, uint64_t* out) {
+    struct fat_sb_info* sbi = FAT_SB(dir->sb);
+    struct fat_dir_cursor cursor = { .valid = false };
+    uint64_t run_start = 0;
+    uint32_t run = 0;
+    bool end_seen = false;
+
+    for (uint64_t offset = 0; ; offset += FAT_DIR_ENTRY_SIZE) {
+        if (offset >= dir->size) {
+            /* Новый обнулённый кластер в конец каталога */
+            fat_cursor_release(&cursor);
+            if (dir->size + sbi->cluster_size > FAT_MAX_DIR_SIZE) {
+                return -ENOSPC;
+            }
+            uint32_t dcluster;
+            int err = fat_get_block(dir, (uint32_t)(dir->size / sbi->cluster_size),
+                                    true, false, &dcluster);
+            if (err < 0) {
+                return err;
+            }
+            dir->size += sbi->cluster_size;
+            end_seen = true;
+        }
+
+        struct fat_dir_entry* de = NULL;
+        if (!end_seen) {
+            int err = fat_dir_entry_at(dir, &cursor, offset, &de, NULL);
+            if (err < 0) {
+                fat_cursor_release(&cursor);
+                return err;
+            }
+            if (de->name[0] == FAT_END_OF_DIR) {
+                end_seen = true;
+            }
+        }
+
+        if (end_seen || de->name[0] == FAT_DELETED) {
+            if (run++ == 0) {
+                run_start = offset;
+            }
+            if (run == nr) {
+                fat_cursor_release(&cursor);
+                *out = run_start;
+                return 0;
+            }
+        } else {
+            run = 0;
+        }
+    }
+}
+
+/*
+ * Создание записи каталога: слоты длинного имени (если имя не
+ * представимо в 8.3) и короткая запись. Возвращает её номер inode.
+ */
+static int fat_add_entry(struct inode* dir, const char* name, size_t len, uint8_t attr,
+                         uint32_t start, struct fat_dir_entry* out, uint64_t* ino) {
+    int err = fat_check_name(name, len);
+    if (err < 0) {
+        return err;
+    }
+
+    struct fat_dir_entry de;
+    memset(&de, 0, sizeof(de));
+    uint16_t* lfn = NULL;
+    uint32_t lfn_slots = 0;
+    int lfn_len = 0;
+
+    if (!fat_format_short(name, len, de.name, &de.lcase)) {
+        lfn = kmalloc(FAT_LFN_MAX_SLOTS * FAT_LFN_CHARS * sizeof(uint16_t));
+        if (!lfn) {
+            return -ENOMEM;
+        }
+        lfn_len = fat_utf8_to_utf16(name, len, lfn, FAT_LFN_MAX_SLOTS * FAT_LFN_CHARS);
+        if (lfn_len < 0) {
+            kfree(lfn);
+            return lfn_len;
+        }
+        lfn_slots = DIV_ROUND_UP((uint32_t)lfn_len, FAT_LFN_CHARS);
+
+        /* Короткое имя с числовым хвостом ~N, уникальное в каталоге */
+        size_t base_len;
+        fat_short_basis(name, len, de.name, &base_len);
+        uint8_t basis[8];
+        memcpy(basis, de.name, 8);
+        bool unique = false;
+        for (uint32_t n = 1; n < 1000000 && !unique; n++) {
+            char tail[8];
+            size_t tail_len = 0;
+            for (uint32_t v = n; v; v /= 10) {
+                tail[tail_len++] = (char)('0' + v % 10);
+            }
+            tail[tail_len++] = '~';
+            size_t keep = MIN(base_len, 8 - tail_len);
+            memcpy(de.name, basis, keep);
+            for (size_t i = 0; i < tail_len; i++) {
+                de.name[keep + i] = (uint8_t)tail[tail_len - 1 - i];
+            }
+            memset(de.name + keep + tail_len, ' ', 8 - keep - tail_len);
+            unique = !fat_short_exists(dir, de.name);
+        }
+        if (!unique) {
+            kfree(lfn);
+            return -EEXIST;
+        }
+    }
+
+    uint64_t offset;
+    err = fat_find_slots(dir, lfn_slots + 1, &offset);
+    if (err < 0) {
+        kfree(lfn);
+        return err;
+    }
+
+    struct fat_dir_cursor cursor = { .valid = false };
+    struct fat_dir_entry* slot;
+    uint8_t checksum = fat_checksum(de.name);
+
+    for (uint32_t i = 0; i < lfn_slots; i++) {
+        err = fat_dir_entry_at(dir, &cursor, offset, &slot, NULL);
+        if (err < 0) {
+            break;
+        }
+        struct fat_lfn_entry* l = (struct fat_lfn_entry*)slot;
+        uint32_t seq = lfn_slots - i;
+        uint16_t chars[FAT_LFN_CHARS];
+        for (uint32_t k = 0; k < FAT_LFN_CHARS; k++) {
+            int index = (int)((seq - 1) * FAT_LFN_CHARS + k);
+            chars[k] = index < lfn_len ? lfn[index] : (index == lfn_len ? 0x0000 : 0xFFFF);
+        }
+        memset(l, 0, sizeof(*l));
+        l->id = (uint8_t)(seq | (i == 0 ? FAT_LFN_LAST : 0));
+        l->attr = FAT_ATTR_LFN;
+        l->checksum = checksum;
+        memcpy(l->name0_4, chars, sizeof(l->name0_4));
+        memcpy(l->name5_10, chars + 5, sizeof(l->name5_10));
+        memcpy(l->name11_12, chars + 11, sizeof(l->name11_12));
+        mark_buffer_dirty(&cursor.buf);
+        offset += FAT_DIR_ENTRY_SIZE;
+    }
+    kfree(lfn);
+
+    uint64_t sector;
+    if (err == 0) {
+        err = fat_dir_entry_at(dir, &cursor, offset, &slot, &sector);
+    }
+    if (err < 0) {
+        fat_cursor_release(&cursor);
+        return err;
+    }
+
+    de.attr = attr;
+    de.start_hi = (uint16_t)(start >> 16);
+    de.start_lo = (uint16_t)start;
+    fat_touch_entry(&de);
+    de.cdate = de.date;
+    de.ctime = de.time;
+    *slot = de;
+    mark_buffer_dirty(&cursor.buf);
+    fat_cursor_release(&cursor);
+
+    *out = de;
+    *ino = fat_make_ino(sector, (uint32_t)(offset % FAT_SECTOR_SIZE) / FAT_DIR_ENTRY_SIZE);
+    dir->mtime = dir->ctime = fat_time_to_unix(de.date, de.time);
+    mark_inode_dirty(dir);
+    return 0;
+}
+
+/* Пометка слотов [start, offset] удалёнными */
+static int fat_remove_entries(struct inode* dir, const struct fat_slot_info* si) {
+    struct fat_dir_cursor cursor = { .valid = false };
+    int err = 0;
+
+    for (uint64_t offset = si->start; offset <= si->offset; offset += FAT_DIR_ENTRY_SIZE) {
+        struct fat_dir_entry* de;
+        err = fat_dir_entry_at(dir, &cursor, offset, &de, NULL);
+        if (err < 0) {
+            break;
+        }
+        de->name[0] = FAT_DELETED;
+        mark_buffer_dirty(&cursor.buf);
+    }
+    fat_cursor_release(&cursor);
+    mark_inode_dirty(dir);
+    return err;
+}
+
+/* ============================================================================
+ * Родительский каталог ("..")
+ * ============================================================================ */
+
+/* Первый кластер родителя по записи ".." каталога, начинающегося в cluster */
+static int fat_dotdot_cluster(struct super_block* sb, uint32_t cluster, uint32_t* parent) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    struct buffer buf;
+    int err = bread(sb->bdev, fat_cluster_sector(sbi, cluster), FAT_SECTOR_SIZE, &buf);
+    if (err < 0) {
+        return err;
+    }
+    struct fat_dir_entry* de = (struct fat_dir_entry*)buf.data + 1;
+    if (memcmp(de->name, "..         ", 11) != 0) {
+        brelse(&buf);
+        return -EFSCORRUPTED;
+    }
+    *parent = ((uint32_t)de->start_hi << 16) | de->start_lo;
+    if (*parent == 0) {
+        *parent = sbi->root_cluster;
+    }
+    brelse(&buf);
+    return 0;
+}
+
+/*
+ * Номер inode родителя: его запись ищется в каталоге деда по номеру
+ * первого кластера (имя родителя из ".." не восстановить).
+ */
+static int fat_parent_ino(struct inode* dir, uint64_t* ino) {
+    struct super_block* sb = dir->sb;
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    uint32_t parent, grandparent;
+
+    int err = fat_dotdot_cluster(sb, FAT_I(dir)->start, &parent);
+    if (err < 0) {
+        return err;
+    }
+    if (parent == sbi->root_cluster) {
+        *ino = FAT_ROOT_INO;
+        return 0;
+    }
+    err = fat_dotdot_cluster(sb, parent, &grandparent);
+    if (err < 0) {
+        return err;
+    }
+
+    struct fat_entry fe;
+    fat_entry_init(&fe);
+    uint32_t cluster = grandparent;
+    for (uint32_t steps = 0; fat_valid_cluster(sbi, cluster) && steps < sbi->max_cluster; steps++) {
+        uint64_t sector = fat_cluster_sector(sbi, cluster);
+        for (uint32_t s = 0; s < sbi->sectors_per_cluster; s++) {
+            struct buffer buf;
+            err = bread(sb->bdev, sector + s, FAT_SECTOR_SIZE, &buf);
+            if (err < 0) {
+                fat_entry_release(&fe);
+                return err;
+            }
+            struct fat_dir_entry* de = buf.data;
+            for (uint32_t i = 0; i < FAT_DIR_ENTRIES_PER_SECTOR; i++) {
+                uint32_t start = ((uint32_t)de[i].start_hi << 16) | de[i].start_lo;
+                if (de[i].name[0] != FAT_DELETED && de[i].name[0] != '.' &&
+                    de[i].attr != FAT_ATTR_LFN && (de[i].attr & FAT_ATTR_DIR) &&
+                    start == parent) {
+                    brelse(&buf);
+                    fat_entry_release(&fe);
+                    *ino = fat_make_ino(sector + s, i);
+                    return 0;
+                }
+            }
+            brelse(&buf);
+        }
+        err = fat_ent_read(sb, &fe, cluster, &cluster);
+        if (err < 0) {
+            break;
+        }
+    }
+    fat_entry_release(&fe);
+    return err < 0 ? err : -EFSCORRUPTED;
+}
+
+/* ============================================================================
+ * Операции каталогов
+ * ============================================================================ */
+
+static int fat_lookup(struct inode* dir, const char* name, size_t len, struct inode** out) {
+    if (len == 2 && name[0] == '.' && name[1] == '.') {
+        if (dir->ino == FAT_ROOT_INO) {
+            ihold(dir);
+            *out = dir;
+            return 0;
+        }
+        uint64_t ino;
+        int err = fat_parent_ino(dir, &ino);
+        return err < 0 ? err : iget(dir->sb, ino, out);
+    }
+
+    struct fat_slot_info* si = kmalloc(sizeof(*si));
+    if (!si) {
+        return -ENOMEM;
+    }
+    int err = fat_find(dir, name, len, si);
+    uint64_t ino = si->ino;
+    kfree(si);
+    return err < 0 ? err : iget(dir->sb, ino, out);
+}
+
+/* Inode для только что созданной записи */
+static int fat_instantiate(struct inode* dir, const struct fat_dir_entry* de, uint64_t ino,
+                           struct inode** out) {
+    struct inode* inode = new_inode(dir->sb, ino);
+    if (!inode) {
+        return -ENOMEM;
+    }
+    fat_fill_inode(inode, de);
+    if (S_ISDIR(inode->mode)) {
+        struct fat_sb_info* sbi = FAT_SB(dir->sb);
+        inode->size = sbi->cluster_size;
+        fat_cache_add(inode, 0, FAT_I(inode)->start, 1);
+    }
+    *out = inode;
+    return 0;
+}
+
+static int fat_create(struct inode* dir, const char* name, size_t len,
+                      uint32_t mode, struct inode** out) {
+    if (!S_ISREG(mode)) {
+        return -EPERM;
+    }
+    struct fat_dir_entry de;
+    uint64_t ino;
+    uint8_t attr = FAT_ATTR_ARCH | ((mode & 0222) ? 0 : FAT_ATTR_RO);
+    int err = fat_add_entry(dir, name, len, attr, 0, &de, &ino);
+    if (err < 0) {
+        return err;
+    }
+    return fat_instantiate(dir, &de, ino, out);
+}
+
+static int fat_mkdir(struct inode* dir, const char* name, size_t len,
+                     uint32_t mode, struct inode** out) {
+    (void)mode;
+    struct super_block* sb = dir->sb;
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    uint32_t cluster;
+
+    int err = fat_check_name(name, len);
+    if (err < 0) {
+        return err;
+    }
+    err = fat_alloc_cluster(sb, 0, &cluster);
+    if (err < 0) {
+        return err;
+    }
+    err = fat_zero_cluster(sb, cluster, true);
+    if (err < 0) {
+        fat_free_chain(sb, cluster, true);
+        return err;
+    }
+
+    /* "." и ".." (у подкаталогов корня ".." указывает на кластер 0) */
+    struct buffer buf;
+    err = bread(sb->bdev, fat_cluster_sector(sbi, cluster), FAT_SECTOR_SIZE, &buf);
+    if (err < 0) {
+        fat_free_chain(sb, cluster, true);
+        return err;
+    }
+    struct fat_dir_entry* dots = buf.data;
+    uint32_t parent = dir->ino == FAT_ROOT_INO ? 0 : FAT_I(dir)->start;
+    memcpy(dots[0].name, ".          ", 11);
+    memcpy(dots[1].name, "..         ", 11);
+    for (int i = 0; i < 2; i++) {
+        uint32_t start = i ? parent : cluster;
+        dots[i].attr = FAT_ATTR_DIR;
+        dots[i].start_hi = (uint16_t)(start >> 16);
+        dots[i].start_lo = (uint16_t)start;
+        fat_touch_entry(&dots[i]);
+        dots[i].cdate = dots[i].date;
+        dots[i].ctime = dots[i].time;
+    }
+    mark_buffer_dirty(&buf);
+    brelse(&buf);
+
+    struct fat_dir_entry de;
+    uint64_t ino;
+    err = fat_add_entry(dir, name, len, FAT_ATTR_DIR, cluster, &de, &ino);
+    if (err < 0) {
+        fat_free_chain(sb, cluster, true);
+        return err;
+    }
+    return fat_instantiate(dir, &de, ino, out);
+}
+
+/* Общая часть unlink и rmdir */
+static int fat_remove(struct inode* dir, const char* name, size_t len, bool directory) {
+    if ((len == 1 && name[0] == '.') || (len == 2 && name[0] == '.' && name[1] == '.')) {
+        return -EINVAL;
+    }
+    struct fat_slot_info* si = kmalloc(sizeof(*si));
+    if (!si) {
+        return -ENOMEM;
+    }
+    int err = fat_find(dir, name, len, si);
+    if (err < 0) {
+        kfree(si);
+        return err;
+    }
+
+    struct inode* inode;
+    err = iget(dir->sb, si->ino, &inode);
+    if (err < 0) {
+        kfree(si);
+        return err;
+    }
+
+    if (directory) {
+        uint64_t pos = 0;
+        while ((err = fat_dir_next(inode, &pos, si)) == 0) {
+            if (!fat_is_dot(si)) {
+                err = -ENOTEMPTY;
+                break;
+            }
+        }
+        if (err == -ENOENT) {
+            err = 0;
+        }
+        if (err < 0) {
+            kfree(si);
+            iput(inode);
+            return err;
+        }
+        /* Обход затёр si: запись ищется заново */
+        err = fat_find(dir, name, len, si);
+    }
+
+    if (err == 0) {
+        err = fat_remove_entries(dir, si);
+    }
+    if (err == 0) {
+        inode->nlink = 0;
+        dir->mtime = dir->ctime = inode->ctime;
+    }
+    kfree(si);
+    iput(inode);
+    return err;
+}
+
+static int fat_unlink(struct inode* dir, const char* name, size_t len) {
+    return fat_remove(dir, name, len, false);
+}
+
+static int fat_rmdir(struct inode* dir, const char* name, size_t len) {
+    return fat_remove(dir, name, len, true);
+}
+
+static int fat_readdir(struct file* file, filldir_t filldir, void* ctx) {
+    struct inode* dir = file->inode;
+    struct fat_slot_info* si = kmalloc(sizeof(*si));
+    if (!si) {
+        return -ENOMEM;
+    }
+
+    int err;
+    uint64_t pos = file->pos;
+    while ((err = fat_dir_next(dir, &pos, si)) == 0) {
+        uint8_t type = (si->de.attr & FAT_ATTR_DIR) ? DT_DIR : DT_REG;
+        if (filldir(ctx, si->name, si->len, si->ino, type)) {
+            break;
+        }
+        file->pos = pos;
+    }
+    if (err == -ENOENT) {
+        file->pos = pos;
+        err = 0;
+    }
+    kfree(si);
+    return err;
+}
+
+const struct inode_operations fat_dir_inode_operations = {
+    .lookup = fat_lookup,
+    .create = fat_create,
+    .mkdir = fat_mkdir,
+    .unlink = fat_unlink,
+    .rmdir = fat_rmdir,
+};
+
+const struct file_operations fat_dir_operations = {
+    .readdir = fat_readdir,
+};
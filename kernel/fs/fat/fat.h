@@ -0,0 +1,264 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/fat/fat.h
+ * Драйвер FAT32: дисковые структуры и внутренние интерфейсы
+ *
+ * Таблица FAT читается через кеш блочного устройства (page cache), цепочки
+ * кластеров файлов кешируются экстентами в inode. Inode на диске нет:
+ * номером inode служит позиция короткой записи каталога на устройстве
+ * (сектор * 16 + индекс записи), у корневого каталога номер FAT_ROOT_INO.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_FAT_H
+#define MIXOS_FS_FAT_H
+
+#include "kernel.h"
+#include "fs/vfs.h"
+
+#define FAT_ROOT_INO            1
+
+#define FAT_SECTOR_SIZE         512
+#define FAT_DIR_ENTRY_SIZE      32
+#define FAT_DIR_ENTRIES_PER_SECTOR  (FAT_SECTOR_SIZE / FAT_DIR_ENTRY_SIZE)
+
+/* Значения записей FAT32 (старшие 4 бита зарезервированы) */
+#define FAT32_ENTRY_MASK        0x0FFFFFFFU
+#define FAT_FREE                0x00000000U
+#define FAT_BAD                 0x0FFFFFF7U
+#define FAT_EOC                 0x0FFFFFF8U     /* >= - конец цепочки */
+#define FAT_EOC_MARK            0x0FFFFFFFU
+#define FAT_FIRST_CLUSTER       2
+
+/* FAT32 допускает не менее 65525 кластеров, меньшие тома - FAT12/16 */
+#define FAT32_MIN_CLUSTERS      65525
+
+#define FAT_FREE_UNKNOWN        0xFFFFFFFFU
+
+/* Атрибуты записи каталога */
+#define FAT_ATTR_RO             0x01
+#define FAT_ATTR_HIDDEN         0x02
+#define FAT_ATTR_SYSTEM         0x04
+#define FAT_ATTR_VOLUME         0x08
+#define FAT_ATTR_DIR            0x10
+#define FAT_ATTR_ARCH           0x20
+#define FAT_ATTR_LFN            (FAT_ATTR_RO | FAT_ATTR_HIDDEN | FAT_ATTR_SYSTEM | FAT_ATTR_VOLUME)
+
+/* Первый байт имени */
+#define FAT_DELETED             0xE5
+#define FAT_END_OF_DIR          0x00
+#define FAT_KANJI_E5            0x05
+
+/* Регистр частей короткого имени (поле lcase, расширение Windows NT) */
+#define FAT_LCASE_BASE          0x08
+#define FAT_LCASE_EXT           0x10
+
+#define FAT_LFN_LAST            0x40
+#define FAT_LFN_SEQ_MASK        0x1F
+#define FAT_LFN_CHARS           13
+#define FAT_LFN_MAX_SLOTS       20              /* 255 символов */
+
+/* ============================================================================
+ * Дисковые структуры
+ * ============================================================================ */
+
+struct fat_boot_sector {
+    uint8_t  jump[3];
+    char     oem_name[8];
+    uint16_t bytes_per_sector;
+    uint8_t  sectors_per_cluster;
+    uint16_t reserved_sectors;
+    uint8_t  num_fats;
+    uint16_t root_entries;          /* 0 у FAT32 */
+    uint16_t total_sectors16;
+    uint8_t  media;
+    uint16_t fat_length16;          /* 0 у FAT32 */
+    uint16_t sectors_per_track;
+    uint16_t heads;
+    uint32_t hidden_sectors;
+    uint32_t total_sectors32;
+    /* Расширение FAT32 */
+    uint32_t fat_length32;
+    uint16_t ext_flags;             /* Биты 0-3: активная FAT, бит 7: без зеркалирования */
+    uint16_t version;
+    uint32_t root_cluster;
+    uint16_t fsinfo_sector;
+    uint16_t backup_boot_sector;
+    uint8_t  reserved[12];
+    uint8_t  drive_number;
+    uint8_t  reserved1;
+    uint8_t  boot_signature;
+    uint32_t volume_id;
+    char     volume_label[11];
+    char     fs_type[8];
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct fat_boot_sector) == 90, "FAT32 boot sector size");
+
+#define FAT_EXT_FLAGS_ACTIVE    0x000F
+#define FAT_EXT_FLAGS_NOMIRROR  0x0080
+
+#define FAT_FSINFO_LEAD_SIG     0x41615252U
+#define FAT_FSINFO_STRUCT_SIG   0x61417272U
+#define FAT_FSINFO_TRAIL_SIG    0xAA550000U
+
+struct fat_fsinfo {
+    uint32_t lead_sig;
+    uint8_t  reserved1[480];
+    uint32_t struct_sig;
+    uint32_t free_count;            /* Подсказка: число свободных кластеров */
+    uint32_t next_free;             /* Подсказка: где начинать поиск */
+    uint8_t  reserved2[12];
+    uint32_t trail_sig;
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct fat_fsinfo) == FAT_SECTOR_SIZE, "FAT32 FSInfo size");
+
+struct fat_dir_entry {
+    uint8_t  name[11];              /* 8.3, дополнено пробелами */
+    uint8_t  attr;
+    uint8_t  lcase;
+    uint8_t  ctime_cs;
+    uint16_t ctime;
+    uint16_t cdate;
+    uint16_t adate;
+    uint16_t start_hi;
+    uint16_t time;
+    uint16_t date;
+    uint16_t start_lo;
+    uint32_t size;
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct fat_dir_entry) == FAT_DIR_ENTRY_SIZE, "FAT dir entry size");
+
+/* Фрагмент длинного имени (VFAT): 13 символов UTF-16 */
+struct fat_lfn_entry {
+    uint8_t  id;                    /* Номер фрагмента, FAT_LFN_LAST у последнего */
+    uint16_t name0_4[5];
+    uint8_t  attr;                  /* Всегда FAT_ATTR_LFN */
+    uint8_t  reserved;
+    uint8_t  checksum;              /* Контрольная сумма короткого имени */
+    uint16_t name5_10[6];
+    uint16_t start;                 /* Всегда 0 */
+    uint16_t name11_12[2];
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct fat_lfn_entry) == FAT_DIR_ENTRY_SIZE, "FAT LFN entry size");
+
+/* ============================================================================
+ * Структуры в памяти
+ * ============================================================================ */
+
+/* Непрерывный участок цепочки: кластеры файла [fcluster, fcluster+len) */
+struct fat_extent {
+    uint32_t fcluster;
+    uint32_t dcluster;
+    uint32_t len;
+    uint32_t stamp;                 /* Для вытеснения давно не используемых */
+};
+
+#define FAT_EXTENT_CACHE_SIZE   8
+
+struct fat_inode_info {
+    uint32_t start;                 /* Первый кластер, 0 у пустого файла */
+    uint8_t attr;
+    uint8_t lcase;
+    uint16_t cdate;
+    uint16_t ctime;
+    struct fat_extent extents[FAT_EXTENT_CACHE_SIZE];
+    uint32_t nr_extents;
+    uint32_t extent_clock;
+    struct inode vfs_inode;
+};
+
+struct fat_sb_info {
+    struct super_block* sb;
+    uint32_t sectors_per_cluster;
+    uint32_t cluster_size;
+    uint32_t fat_start;             /* Первый сектор активной FAT */
+    uint32_t fat_length;            /* Секторов в одной копии FAT */
+    uint32_t num_fats;
+    uint32_t first_fat;             /* Первый сектор FAT 0 */
+    bool mirror;                    /* Записи FAT копируются во все таблицы */
+    uint32_t data_start;            /* Сектор кластера 2 */
+    uint32_t max_cluster;           /* Номер последнего кластера + 1 */
+    uint32_t root_cluster;
+    uint32_t fsinfo_sector;         /* 0, если FSInfo нет */
+    uint32_t free_clusters;         /* FAT_FREE_UNKNOWN, пока не подсчитано */
+    uint32_t prev_free;             /* Последний выделенный кластер */
+    bool fsinfo_dirty;
+    struct page* zero_page;         /* Для обнуления новых кластеров */
+};
+
+/* Курсор чтения/записи FAT: держит буфер текущего сектора таблицы */
+struct fat_entry {
+    struct buffer buf;
+    uint64_t sector;
+    bool valid;
+};
+
+static inline struct fat_inode_info* FAT_I(struct inode* inode) {
+    return container_of(inode, struct fat_inode_info, vfs_inode);
+}
+
+static inline struct fat_sb_info* FAT_SB(struct super_block* sb) {
+    return (struct fat_sb_info*)sb->fs_info;
+}
+
+static inline uint64_t fat_cluster_sector(struct fat_sb_info* sbi, uint32_t cluster) {
+    return sbi->data_start + (uint64_t)(cluster - FAT_FIRST_CLUSTER) * sbi->sectors_per_cluster;
+}
+
+static inline bool fat_valid_cluster(struct fat_sb_info* sbi, uint32_t cluster) {
+    return cluster >= FAT_FIRST_CLUSTER && cluster < sbi->max_cluster;
+}
+
+/* Номер inode для короткой записи каталога в секторе sector */
+static inline uint64_t fat_make_ino(uint64_t sector, uint32_t index) {
+    return sector * FAT_DIR_ENTRIES_PER_SECTOR + index;
+}
+
+/* super.c */
+void fat_touch_entry(struct fat_dir_entry* de);
+uint32_t fat_time_to_unix(uint16_t date, uint16_t time);
+
+/* fatent.c: таблица FAT */
+static inline void fat_entry_init(struct fat_entry* fe) {
+    fe->valid = false;
+}
+void fat_entry_release(struct fat_entry* fe);
+int fat_ent_read(struct super_block* sb, struct fat_entry* fe, uint32_t cluster,
+                 uint32_t* value);
+int fat_ent_write(struct super_block* sb, struct fat_entry* fe, uint32_t cluster,
+                  uint32_t value);
+int fat_alloc_cluster(struct super_block* sb, uint32_t goal, uint32_t* cluster);
+int fat_free_chain(struct super_block* sb, uint32_t start, bool metadata);
+int fat_count_free(struct super_block* sb);
+int fat_zero_cluster(struct super_block* sb, uint32_t cluster, bool metadata);
+
+/* cache.c: кеш экстентов цепочек */
+void fat_cache_add(struct inode* inode, uint32_t fcluster, uint32_t dcluster, uint32_t len);
+void fat_cache_truncate(struct inode* inode, uint32_t nr_clusters);
+int fat_get_cluster(struct inode* inode, uint32_t fcluster, uint32_t* dcluster,
+                    uint32_t* last_fcluster, uint32_t* last_dcluster);
+int fat_get_block(struct inode* inode, uint32_t fcluster, bool create, bool overwrite,
+                  uint32_t* dcluster);
+int fat_chain_length(struct inode* inode, uint32_t* count);
+
+/* inode.c */
+extern const struct address_space_ops fat_aops;
+extern const struct inode_operations fat_file_inode_operations;
+extern const struct file_operations fat_file_operations;
+void fat_fill_inode(struct inode* inode, const struct fat_dir_entry* de);
+int fat_read_inode(struct inode* inode);
+int fat_write_inode(struct inode* inode);
+void fat_evict_inode(struct inode* inode);
+int fat_truncate(struct inode* inode, uint64_t size);
+
+/* dir.c */
+extern const struct inode_operations fat_dir_inode_operations;
+extern const struct file_operations fat_dir_operations;
+
+void fat_init(void);
+
+#endif /* MIXOS_FS_FAT_H */
@@ -0,0 +1,275 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/fat/fatent.c
+ * Драйвер FAT32: записи таблицы FAT, выделение и освобождение кластеров
+ *
+ * Сектора FAT читаются через кеш блочного устройства и остаются в нём,
+ * поэтому повторные обходы цепочек не обращаются к носителю. Поиск
+ * свободного кластера начинается с подсказки FSInfo (next_free), а число
+ * свободных кластеров берётся из FSInfo и не требует полного просмотра FAT.
+ * ============================================================================
+ */
+
+#include "fs/fat/fat.h"
+#include "errno.h"
+
+void fat_entry_release(struct fat_entry* fe) {
+    if (fe->valid) {
+        brelse(&fe->buf);
+        fe->valid = false;
+    }
+}
+
+/* Буфер сектора активной FAT, содержащего запись cluster */
+static int fat_ent_buffer(struct super_block* sb, struct fat_entry* fe, uint32_t cluster,
+                          uint32_t** entry) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    uint64_t offset = (uint64_t)cluster * sizeof(uint32_t);
+    uint64_t sector = sbi->fat_start + offset / FAT_SECTOR_SIZE;
+
+    if (!fe->valid || fe->sector != sector) {
+        fat_entry_release(fe);
+        int err = bread(sb->bdev, sector, FAT_SECTOR_SIZE, &fe->buf);
+        if (err < 0) {
+            return err;
+        }
+        fe->sector = sector;
+        fe->valid = true;
+    }
+    *entry = (uint32_t*)((uint8_t*)fe->buf.data + offset % FAT_SECTOR_SIZE);
+    return 0;
+}
+
+int fat_ent_read(struct super_block* sb, struct fat_entry* fe, uint32_t cluster,
+                 uint32_t* value) {
+    uint32_t* entry;
+    int err = fat_ent_buffer(sb, fe, cluster, &entry);
+    if (err < 0) {
+        return err;
+    }
+    *value = *entry & FAT32_ENTRY_MASK;
+    return 0;
+}
+
+int fat_ent_write(struct super_block* sb, struct fat_entry* fe, uint32_t cluster,
+                  uint32_t value) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    uint32_t* entry;
+    int err = fat_ent_buffer(sb, fe, cluster, &entry);
+    if (err < 0) {
+        return err;
+    }
+    *entry = (*entry & ~FAT32_ENTRY_MASK) | (value & FAT32_ENTRY_MASK);
+    mark_buffer_dirty(&fe->buf);
+
+    if (!sbi->mirror) {
+        return 0;
+    }
+
+    /* Остальные копии FAT обновляются тем же значением */
+    uint32_t offset = (uint32_t)(fe->sector - sbi->fat_start);
+    uint32_t raw = *entry;
+    for (uint32_t i = 0; i < sbi->num_fats; i++) {
+        uint64_t sector = sbi->first_fat + (uint64_t)i * sbi->fat_length + offset;
+        if (sector == fe->sector) {
+            continue;
+        }
+        struct buffer copy;
+        err = bread(sb->bdev, sector, FAT_SECTOR_SIZE, &copy);
+        if (err < 0) {
+            return err;
+        }
+        *(uint32_t*)((uint8_t*)copy.data + (cluster * sizeof(uint32_t)) % FAT_SECTOR_SIZE) = raw;
+        mark_buffer_dirty(&copy);
+        brelse(&copy);
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Выделение кластеров
+ * ============================================================================ */
+
+/* Захват свободного кластера: запись конца цепочки и обновление счётчиков */
+static int fat_claim(struct super_block* sb, struct fat_entry* fe, uint32_t cluster) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    int err = fat_ent_write(sb, fe, cluster, FAT_EOC_MARK);
+    if (err < 0) {
+        return err;
+    }
+    sbi->prev_free = cluster;
+    if (sbi->free_clusters != FAT_FREE_UNKNOWN) {
+        sbi->free_clusters--;
+    }
+    sbi->fsinfo_dirty = true;
+    return 0;
+}
+
+/*
+ * Выделение одного кластера. Сначала проверяется goal (кластер сразу за
+ * концом файла, чтобы цепочка оставалась непрерывной), затем поиск идёт
+ * от подсказки FSInfo с переходом через конец таблицы.
+ */
+int fat_alloc_cluster(struct super_block* sb, uint32_t goal, uint32_t* cluster) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    struct fat_entry fe;
+    uint32_t value;
+    int err;
+
+    if (sbi->free_clusters == 0) {
+        return -ENOSPC;
+    }
+    fat_entry_init(&fe);
+
+    if (fat_valid_cluster(sbi, goal)) {
+        err = fat_ent_read(sb, &fe, goal, &value);
+        if (err == 0 && value == FAT_FREE) {
+            err = fat_claim(sb, &fe, goal);
+            fat_entry_release(&fe);
+            if (err == 0) {
+                *cluster = goal;
+            }
+            return err;
+        }
+    }
+
+    uint32_t total = sbi->max_cluster - FAT_FIRST_CLUSTER;
+    uint32_t start = sbi->prev_free + 1;
+    if (!fat_valid_cluster(sbi, start)) {
+        start = FAT_FIRST_CLUSTER;
+    }
+
+    for (uint32_t i = 0; i < total; i++) {
+        uint32_t candidate = start + i;
+        if (candidate >= sbi->max_cluster) {
+            candidate -= total;
+        }
+        err = fat_ent_read(sb, &fe, candidate, &value);
+        if (err < 0) {
+            fat_entry_release(&fe);
+            return err;
+        }
+        if (value == FAT_FREE) {
+            err = fat_claim(sb, &fe, candidate);
+            fat_entry_release(&fe);
+            if (err == 0) {
+                *cluster = candidate;
+            }
+            return err;
+        }
+    }
+
+    fat_entry_release(&fe);
+    sbi->free_clusters = 0;
+    sbi->fsinfo_dirty = true;
+    return -ENOSPC;
+}
+
+/*
+ * Освобождение цепочки начиная с start. Для кластеров каталогов (metadata)
+ * отменяется отложенная запись их секторов из кеша устройства: кластер
+ * может достаться файлу, данные которого пишутся в обход кеша.
+ */
+int fat_free_chain(struct super_block* sb, uint32_t start, bool metadata) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    struct fat_entry fe;
+    uint32_t cluster = start;
+    uint32_t freed = 0;
+    int err = 0;
+
+    fat_entry_init(&fe);
+    while (fat_valid_cluster(sbi, cluster)) {
+        uint32_t next;
+        err = fat_ent_read(sb, &fe, cluster, &next);
+        if (err < 0) {
+            break;
+        }
+        if (next == FAT_FREE) {
+            terminal_writestring("  fat: freeing already free cluster\n");
+            err = -EFSCORRUPTED;
+            break;
+        }
+        err = fat_ent_write(sb, &fe, cluster, FAT_FREE);
+        if (err < 0) {
+            break;
+        }
+        if (metadata) {
+            uint64_t sector = fat_cluster_sector(sbi, cluster);
+            for (uint32_t i = 0; i < sbi->sectors_per_cluster; i++) {
+                bforget(sb->bdev, sector + i, FAT_SECTOR_SIZE);
+            }
+        }
+        freed++;
+        if (freed > sbi->max_cluster) {
+            err = -EFSCORRUPTED;        /* Цикл в цепочке */
+            break;
+        }
+        cluster = next;
+    }
+    fat_entry_release(&fe);
+
+    if (sbi->free_clusters != FAT_FREE_UNKNOWN) {
+        sbi->free_clusters += freed;
+    }
+    sbi->fsinfo_dirty = true;
+    return err;
+}
+
+/* Подсчёт свободных кластеров, если FSInfo отсутствует или недостоверна */
+int fat_count_free(struct super_block* sb) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    struct fat_entry fe;
+    uint32_t free = 0;
+
+    fat_entry_init(&fe);
+    for (uint32_t cluster = FAT_FIRST_CLUSTER; cluster < sbi->max_cluster; cluster++) {
+        uint32_t value;
+        int err = fat_ent_read(sb, &fe, cluster, &value);
+        if (err < 0) {
+            fat_entry_release(&fe);
+            return err;
+        }
+        if (value == FAT_FREE) {
+            free++;
+        }
+    }
+    fat_entry_release(&fe);
+    sbi->free_clusters = free;
+    sbi->fsinfo_dirty = true;
+    return 0;
+}
+
+/*
+ * Обнуление нового кластера. Кластеры каталогов обнуляются в кеше
+ * устройства (каталоги читаются через него), кластеры файлов - на носителе.
+ */
+int fat_zero_cluster(struct super_block* sb, uint32_t cluster, bool metadata) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    uint64_t sector = fat_cluster_sector(sbi, cluster);
+
+    if (metadata) {
+        for (uint32_t i = 0; i < sbi->sectors_per_cluster; i++) {
+            struct buffer buf;
+            int err = bread(sb->bdev, sector + i, FAT_SECTOR_SIZE, &buf);
+            if (err < 0) {
+                return err;
+            }
+            memset(buf.data, 0, FAT_SECTOR_SIZE);
+            mark_buffer_dirty(&buf);
+            brelse(&buf);
+        }
+        return 0;
+    }
+
+    uint32_t remaining = sbi->sectors_per_cluster;
+    while (remaining) {
+        uint32_t count = MIN(remaining, (uint32_t)SECTORS_PER_PAGE);
+        int err = block_write(sb->bdev, sector, count, page_address(sbi->zero_page));
+        if (err < 0) {
+            return err;
+        }
+        sector += count;
+        remaining -= count;
+    }
+    return 0;
+}
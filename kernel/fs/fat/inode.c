@@ -0,0 +1,336 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/fat/inode.c
+ * Драйвер FAT32: inode поверх записей каталога, данные файлов
+ * ============================================================================
+ */
+
+#include "fs/fat/fat.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Чтение и запись "inode" (короткой записи каталога)
+ * ============================================================================ */
+
+static int fat_inode_entry(struct inode* inode, struct buffer* buf,
+                           struct fat_dir_entry** de) {
+    uint64_t sector = inode->ino / FAT_DIR_ENTRIES_PER_SECTOR;
+    int err = bread(inode->sb->bdev, sector, FAT_SECTOR_SIZE, buf);
+    if (err < 0) {
+        return err;
+    }
+    *de = (struct fat_dir_entry*)buf->data + inode->ino % FAT_DIR_ENTRIES_PER_SECTOR;
+    return 0;
+}
+
+static void fat_set_inode_ops(struct inode* inode) {
+    if (S_ISDIR(inode->mode)) {
+        inode->i_op = &fat_dir_inode_operations;
+        inode->f_op = &fat_dir_operations;
+    } else {
+        inode->i_op = &fat_file_inode_operations;
+        inode->f_op = &fat_file_operations;
+        inode->mapping.a_ops = &fat_aops;
+    }
+}
+
+/* Размер каталога - длина его цепочки */
+static int fat_dir_size(struct inode* inode) {
+    uint32_t clusters;
+    int err = fat_chain_length(inode, &clusters);
+    if (err < 0) {
+        return err;
+    }
+    inode->size = (uint64_t)clusters * FAT_SB(inode->sb)->cluster_size;
+    return 0;
+}
+
+void fat_fill_inode(struct inode* inode, const struct fat_dir_entry* de) {
+    struct fat_inode_info* fi = FAT_I(inode);
+
+    fi->start = ((uint32_t)de->start_hi << 16) | de->start_lo;
+    fi->attr = de->attr;
+    fi->lcase = de->lcase;
+    fi->cdate = de->cdate;
+    fi->ctime = de->ctime;
+    fi->nr_extents = 0;
+
+    if (de->attr & FAT_ATTR_DIR) {
+        inode->mode = S_IFDIR | 0755;
+        inode->nlink = 2;
+        inode->size = 0;
+    } else {
+        inode->mode = S_IFREG | ((de->attr & FAT_ATTR_RO) ? 0444 : 0644);
+        inode->nlink = 1;
+        inode->size = de->size;
+    }
+    inode->uid = 0;
+    inode->gid = 0;
+    inode->mtime = fat_time_to_unix(de->date, de->time);
+    inode->ctime = fat_time_to_unix(de->cdate, de->ctime);
+    inode->atime = fat_time_to_unix(de->adate, 0);
+    fat_set_inode_ops(inode);
+}
+
+int fat_read_inode(struct inode* inode) {
+    struct fat_sb_info* sbi = FAT_SB(inode->sb);
+
+    if (inode->ino == FAT_ROOT_INO) {
+        struct fat_inode_info* fi = FAT_I(inode);
+        fi->start = sbi->root_cluster;
+        fi->attr = FAT_ATTR_DIR;
+        inode->mode = S_IFDIR | 0755;
+        inode->nlink = 2;
+        fat_set_inode_ops(inode);
+        return fat_dir_size(inode);
+    }
+
+    struct buffer buf;
+    struct fat_dir_entry* de;
+    int err = fat_inode_entry(inode, &buf, &de);
+    if (err < 0) {
+        return err;
+    }
+    if (de->name[0] == FAT_DELETED || de->name[0] == FAT_END_OF_DIR ||
+        de->attr == FAT_ATTR_LFN) {
+        brelse(&buf);
+        return -ENOENT;
+    }
+    fat_fill_inode(inode, de);
+    brelse(&buf);
+
+    return S_ISDIR(inode->mode) ? fat_dir_size(inode) : 0;
+}
+
+int fat_write_inode(struct inode* inode) {
+    struct fat_inode_info* fi = FAT_I(inode);
+
+    /* У корня нет записи каталога; запись удалённого файла могла быть занята */
+    if (inode->ino == FAT_ROOT_INO || inode->nlink == 0) {
+        return 0;
+    }
+
+    struct buffer buf;
+    struct fat_dir_entry* de;
+    int err = fat_inode_entry(inode, &buf, &de);
+    if (err < 0) {
+        return err;
+    }
+    de->start_hi = (uint16_t)(fi->start >> 16);
+    de->start_lo = (uint16_t)fi->start;
+    de->size = S_ISDIR(inode->mode) ? 0 : (uint32_t)inode->size;
+    de->attr = fi->attr;
+    fat_touch_entry(de);
+    mark_buffer_dirty(&buf);
+    brelse(&buf);
+    return 0;
+}
+
+/* ============================================================================
+ * Данные файлов (через page cache файла)
+ * ============================================================================ */
+
+/* Чтение или запись страницы; смежные секторы объединяются в один запрос */
+static int fat_page_io(struct inode* inode, struct page* page, bool write) {
+    struct super_block* sb = inode->sb;
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    uint64_t first_sector = page->index * SECTORS_PER_PAGE;
+    uint8_t* data = page_address(page);
+
+    uint64_t run_start = 0;
+    uint32_t run_length = 0;
+    uint8_t* run_data = NULL;
+
+    for (uint32_t i = 0; i <= SECTORS_PER_PAGE; i++) {
+        uint64_t sector = 0;
+
+        if (i < SECTORS_PER_PAGE && (first_sector + i) * FAT_SECTOR_SIZE < inode->size) {
+            uint64_t file_sector = first_sector + i;
+            uint32_t dcluster;
+            int err = fat_get_cluster(inode, (uint32_t)(file_sector / sbi->sectors_per_cluster),
+                                      &dcluster, NULL, NULL);
+            if (err == 0) {
+                sector = fat_cluster_sector(sbi, dcluster) +
+                         file_sector % sbi->sectors_per_cluster;
+            } else if (err != -ENOENT) {
+                return err;
+            }
+        }
+        if (!write && i < SECTORS_PER_PAGE && sector == 0) {
+            memset(data + i * FAT_SECTOR_SIZE, 0, FAT_SECTOR_SIZE);
+        }
+
+        if (sector && run_length && sector == run_start + run_length) {
+            run_length++;
+            continue;
+        }
+
+        if (run_length) {
+            int err = write ? block_write(sb->bdev, run_start, run_length, run_data)
+                            : block_read(sb->bdev, run_start, run_length, run_data);
+            if (err < 0) {
+                return err;
+            }
+        }
+        run_start = sector;
+        run_length = sector ? 1 : 0;
+        run_data = data + i * FAT_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+static int fat_readpage(struct address_space* mapping, struct page* page) {
+    return fat_page_io(mapping->host, page, false);
+}
+
+static int fat_writepage(struct address_space* mapping, struct page* page) {
+    return fat_page_io(mapping->host, page, true);
+}
+
+/*
+ * Кластеры выделяются при записи в кеш. Кластер, целиком лежащий в этой
+ * странице, будет полностью записан из неё, и обнулять его не нужно.
+ */
+static int fat_write_begin(struct address_space* mapping, struct page* page,
+                           uint32_t from, uint32_t to) {
+    struct inode* inode = mapping->host;
+    struct fat_sb_info* sbi = FAT_SB(inode->sb);
+    uint64_t start = (page->index << PAGE_SHIFT) + from;
+    uint64_t end = (page->index << PAGE_SHIFT) + to;
+    bool overwrite = sbi->cluster_size <= PAGE_SIZE;
+
+    if (end > 0xFFFFFFFFULL) {
+        return -EFBIG;
+    }
+    for (uint64_t c = start / sbi->cluster_size; c < DIV_ROUND_UP(end, sbi->cluster_size); c++) {
+        uint32_t dcluster;
+        int err = fat_get_block(inode, (uint32_t)c, true, overwrite, &dcluster);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+const struct address_space_ops fat_aops = {
+    .readpage = fat_readpage,
+    .writepage = fat_writepage,
+    .write_begin = fat_write_begin,
+};
+
+/* ============================================================================
+ * Усечение и удаление
+ * ============================================================================ */
+
+int fat_truncate(struct inode* inode, uint64_t size) {
+    struct fat_inode_info* fi = FAT_I(inode);
+    struct super_block* sb = inode->sb;
+    struct fat_sb_info* sbi = FAT_SB(sb);
+    bool metadata = S_ISDIR(inode->mode);
+
+    if (size > 0xFFFFFFFFULL) {
+        return -EFBIG;
+    }
+    if (size > inode->size) {
+        /* Дыр в FAT нет: расширение выделяет обнулённые кластеры */
+        if (size) {
+            uint32_t dcluster;
+            int err = fat_get_block(inode, (uint32_t)((size - 1) / sbi->cluster_size),
+                                    true, false, &dcluster);
+            if (err < 0) {
+                return err;
+            }
+        }
+        inode->size = size;
+        mark_inode_dirty(inode);
+        return 0;
+    }
+
+    truncate_mapping(&inode->mapping, DIV_ROUND_UP(size, PAGE_SIZE));
+    if (size & (PAGE_SIZE - 1)) {
+        struct page* page = find_get_page(&inode->mapping, size >> PAGE_SHIFT);
+        if (page) {
+            uint32_t offset = size & (PAGE_SIZE - 1);
+            memset((uint8_t*)page_address(page) + offset, 0, PAGE_SIZE - offset);
+            page_cache_release(page);
+        }
+    }
+
+    uint32_t keep = (uint32_t)DIV_ROUND_UP(size, sbi->cluster_size);
+    int err = 0;
+    if (keep == 0) {
+        if (fi->start) {
+            err = fat_free_chain(sb, fi->start, metadata);
+            fi->start = 0;
+        }
+    } else {
+        uint32_t last, next;
+        err = fat_get_cluster(inode, keep - 1, &last, NULL, NULL);
+        if (err == 0) {
+            struct fat_entry fe;
+            fat_entry_init(&fe);
+            err = fat_ent_read(sb, &fe, last, &next);
+            if (err == 0 && next < FAT_EOC) {
+                err = fat_ent_write(sb, &fe, last, FAT_EOC_MARK);
+                if (err == 0) {
+                    err = fat_free_chain(sb, next, metadata);
+                }
+            }
+            fat_entry_release(&fe);
+        } else if (err == -ENOENT) {
+            err = 0;                    /* Цепочка уже короче */
+        }
+    }
+    fat_cache_truncate(inode, keep);
+
+    inode->size = size;
+    mark_inode_dirty(inode);
+    return err;
+}
+
+void fat_evict_inode(struct inode* inode) {
+    struct fat_inode_info* fi = FAT_I(inode);
+    if (fi->start) {
+        fat_free_chain(inode->sb, fi->start, S_ISDIR(inode->mode));
+        fi->start = 0;
+    }
+    fi->nr_extents = 0;
+}
+
+/* ============================================================================
+ * Операции обычных файлов
+ * ============================================================================ */
+
+static int fat_setsize(struct inode* inode, uint64_t size) {
+    return fat_truncate(inode, size);
+}
+
+static int64_t fat_file_write(struct file* file, const void* buffer, size_t count,
+                              uint64_t* pos) {
+    uint64_t start = (file->flags & O_APPEND) ? file->inode->size : *pos;
+    if (start >= 0xFFFFFFFFULL) {
+        return -EFBIG;
+    }
+    /* Размер файла в записи каталога 32-битный */
+    count = (size_t)MIN((uint64_t)count, 0xFFFFFFFFULL - start);
+
+    /* Запись за концом файла: промежуток заполняется нулями */
+    if (start > file->inode->size) {
+        int err = fat_truncate(file->inode, start);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return generic_file_write(file, buffer, count, pos);
+}
+
+const struct inode_operations fat_file_inode_operations = {
+    .truncate = fat_setsize,
+};
+
+const struct file_operations fat_file_operations = {
+    .read = generic_file_read,
+    .write = fat_file_write,
+    .splice_read = generic_file_splice_read,
+    .fsync = generic_file_fsync,
+};
@@ -0,0 +1,271 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/fat/super.c
+ * Драйвер FAT32: монтирование, загрузочный сектор, FSInfo
+ * ============================================================================
+ */
+
+#include "fs/fat/fat.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Время
+ * ============================================================================ */
+
+/*
+ * Время изменения записи. Часов реального времени в ядре пока нет, поэтому
+ * используется начало эпохи DOS (1980-01-01 00:00).
+ */
+void fat_touch_entry(struct fat_dir_entry* de) {
+    de->date = (0 << 9) | (1 << 5) | 1;
+    de->time = 0;
+    de->adate = de->date;
+}
+
+/* Дата и время FAT (локальное время без пояса) -> секунды с 1970 года */
+uint32_t fat_time_to_unix(uint16_t date, uint16_t time) {
+    if (date == 0) {
+        return 0;
+    }
+    int64_t year = 1980 + (date >> 9);
+    int64_t month = (date >> 5) & 0xF;
+    int64_t day = date & 0x1F;
+    if (month < 1 || month > 12 || day < 1) {
+        return 0;
+    }
+
+    /* Число дней от 1970-01-01 (алгоритм days_from_civil) */
+    year -= month <= 2;
+    int64_t era = year / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = era * 146097 + doe - 719468;
+
+    return (uint32_t)(days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3F) * 60 +
+                      (time & 0x1F) * 2);
+}
+
+/* ============================================================================
+ * Операции суперблока
+ * ============================================================================ */
+
+static struct inode* fat_alloc_inode(struct super_block* sb) {
+    (void)sb;
+    struct fat_inode_info* fi = kzalloc(sizeof(*fi));
+    return fi ? &fi->vfs_inode : NULL;
+}
+
+static void fat_destroy_inode(struct inode* inode) {
+    kfree(FAT_I(inode));
+}
+
+/*
+ * Подсказки FSInfo обновляются при синхронизации, а не при каждом выделении.
+ * Если при монтировании счётчик был недостоверен, FAT просматривается здесь
+ * один раз, чтобы следующее монтирование его уже не пересчитывало.
+ */
+static int fat_sync_fs(struct super_block* sb) {
+    struct fat_sb_info* sbi = FAT_SB(sb);
+
+    if (!sbi->fsinfo_dirty || sbi->fsinfo_sector == 0) {
+        return 0;
+    }
+    int err;
+    if (sbi->free_clusters == FAT_FREE_UNKNOWN) {
+        err = fat_count_free(sb);
+        if (err < 0) {
+            return err;
+        }
+    }
+    struct buffer buf;
+    err = bread(sb->bdev, sbi->fsinfo_sector, FAT_SECTOR_SIZE, &buf);
+    if (err < 0) {
+        return err;
+    }
+    struct fat_fsinfo* fsinfo = buf.data;
+    fsinfo->free_count = sbi->free_clusters;
+    fsinfo->next_free = sbi->prev_free;
+    mark_buffer_dirty(&buf);
+    brelse(&buf);
+    sbi->fsinfo_dirty = false;
+    return 0;
+}
+
+static const struct super_operations fat_super_operations = {
+    .alloc_inode = fat_alloc_inode,
+    .destroy_inode = fat_destroy_inode,
+    .read_inode = fat_read_inode,
+    .write_inode = fat_write_inode,
+    .evict_inode = fat_evict_inode,
+    .sync_fs = fat_sync_fs,
+};
+
+/* ============================================================================
+ * Монтирование
+ * ============================================================================ */
+
+static void fat_put_super(struct fat_sb_info* sbi) {
+    if (sbi->zero_page) {
+        free_page(sbi->zero_page);
+    }
+    kfree(sbi);
+}
+
+/* Подсказки FSInfo принимаются, только если сигнатуры и значения корректны */
+static void fat_read_fsinfo(struct fat_sb_info* sbi, struct super_block* sb) {
+    struct buffer buf;
+    if (bread(sb->bdev, sbi->fsinfo_sector, FAT_SECTOR_SIZE, &buf) < 0) {
+        sbi->fsinfo_sector = 0;
+        return;
+    }
+    struct fat_fsinfo* fsinfo = buf.data;
+    if (fsinfo->lead_sig != FAT_FSINFO_LEAD_SIG || fsinfo->struct_sig != FAT_FSINFO_STRUCT_SIG ||
+        fsinfo->trail_sig != FAT_FSINFO_TRAIL_SIG) {
+        terminal_writestring("  fat: invalid FSInfo sector\n");
+        sbi->fsinfo_sector = 0;
+        brelse(&buf);
+        return;
+    }
+    if (fsinfo->free_count <= sbi->max_cluster - FAT_FIRST_CLUSTER) {
+        sbi->free_clusters = fsinfo->free_count;
+    }
+    if (fat_valid_cluster(sbi, fsinfo->next_free)) {
+        sbi->prev_free = fsinfo->next_free;
+    }
+    brelse(&buf);
+}
+
+static int fat_fill_super(struct fat_sb_info* sbi, struct super_block* sb,
+                          const struct fat_boot_sector* bs) {
+    if (bs->bytes_per_sector != FAT_SECTOR_SIZE) {
+        return -EINVAL;
+    }
+    uint32_t spc = bs->sectors_per_cluster;
+    if (spc == 0 || (spc & (spc - 1)) || spc * FAT_SECTOR_SIZE > 65536) {
+        return -EINVAL;
+    }
+    if (bs->reserved_sectors == 0 || bs->num_fats == 0 || bs->root_entries != 0 ||
+        bs->fat_length16 != 0 || bs->fat_length32 == 0) {
+        /* FAT12/16 (корневой каталог фиксированного размера) не поддерживаются */
+        return -EINVAL;
+    }
+
+    uint64_t total = bs->total_sectors16 ? bs->total_sectors16 : bs->total_sectors32;
+    uint64_t meta = bs->reserved_sectors + (uint64_t)bs->num_fats * bs->fat_length32;
+    if (total <= meta || total > sb->bdev->nr_sectors) {
+        return -EINVAL;
+    }
+    uint64_t clusters = (total - meta) / spc;
+    if (clusters < FAT32_MIN_CLUSTERS || clusters > FAT32_ENTRY_MASK - 16) {
+        return -EINVAL;
+    }
+    if ((uint64_t)bs->fat_length32 * (FAT_SECTOR_SIZE / sizeof(uint32_t)) <
+        clusters + FAT_FIRST_CLUSTER) {
+        return -EINVAL;
+    }
+
+    sbi->sectors_per_cluster = spc;
+    sbi->cluster_size = spc * FAT_SECTOR_SIZE;
+    sbi->num_fats = bs->num_fats;
+    sbi->fat_length = bs->fat_length32;
+    sbi->first_fat = bs->reserved_sectors;
+    sbi->mirror = !(bs->ext_flags & FAT_EXT_FLAGS_NOMIRROR);
+    uint32_t active = sbi->mirror ? 0 : (bs->ext_flags & FAT_EXT_FLAGS_ACTIVE);
+    if (active >= sbi->num_fats) {
+        return -EINVAL;
+    }
+    sbi->fat_start = sbi->first_fat + active * sbi->fat_length;
+    sbi->data_start = (uint32_t)meta;
+    sbi->max_cluster = (uint32_t)clusters + FAT_FIRST_CLUSTER;
+    sbi->root_cluster = bs->root_cluster;
+    if (!fat_valid_cluster(sbi, sbi->root_cluster)) {
+        return -EINVAL;
+    }
+
+    sbi->free_clusters = FAT_FREE_UNKNOWN;
+    sbi->prev_free = FAT_FIRST_CLUSTER - 1;
+    sbi->fsinfo_sector = bs->fsinfo_sector;
+    if (sbi->fsinfo_sector >= 1 && sbi->fsinfo_sector < bs->reserved_sectors) {
+        fat_read_fsinfo(sbi, sb);
+    } else {
+        sbi->fsinfo_sector = 0;
+    }
+
+    sbi->zero_page = alloc_zeroed_page();
+    if (!sbi->zero_page) {
+        return -ENOMEM;
+    }
+
+    sb->block_size = sbi->cluster_size;
+    sb->s_op = &fat_super_operations;
+    sb->fs_info = sbi;
+
+    struct inode* root;
+    int err = iget(sb, FAT_ROOT_INO, &root);
+    if (err < 0) {
+        return err;
+    }
+    sb->root = root;
+    return 0;
+}
+
+static int fat_mount(struct block_device* bdev, struct super_block* sb) {
+    struct buffer buf;
+    int err = bread(bdev, 0, FAT_SECTOR_SIZE, &buf);
+    if (err < 0) {
+        return err;
+    }
+    uint8_t* sector = buf.data;
+    if (sector[510] != 0x55 || sector[511] != 0xAA) {
+        brelse(&buf);
+        return -EINVAL;
+    }
+
+    struct fat_sb_info* sbi = kzalloc(sizeof(*sbi));
+    if (!sbi) {
+        brelse(&buf);
+        return -ENOMEM;
+    }
+    sbi->sb = sb;
+    sb->bdev = bdev;
+
+    err = fat_fill_super(sbi, sb, (const struct fat_boot_sector*)sector);
+    brelse(&buf);
+    if (err < 0) {
+        sb->fs_info = NULL;
+        fat_put_super(sbi);
+        return err;
+    }
+
+    terminal_writestring("  fat: ");
+    terminal_writedec(sbi->max_cluster - FAT_FIRST_CLUSTER);
+    terminal_writestring(" clusters of ");
+    terminal_writedec(sbi->cluster_size);
+    terminal_writestring(" bytes");
+    if (sbi->free_clusters != FAT_FREE_UNKNOWN) {
+        terminal_writestring(", ");
+        terminal_writedec(sbi->free_clusters);
+        terminal_writestring(" free");
+    }
+    terminal_writestring("\n");
+    return 0;
+}
+
+static void fat_unmount(struct super_block* sb) {
+    if (sb->root) {
+        iput(sb->root);
+    }
+    fat_put_super(FAT_SB(sb));
+}
+
+static struct filesystem_type fat_fs_type = {
+    .name = "fat",
+    .mount = fat_mount,
+    .unmount = fat_unmount,
+};
+
+void fat_init(void) {
+    register_filesystem(&fat_fs_type);
+}
@@ -0,0 +1,244 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/jbd/jbd.h
+ * Журнал метаданных (формат JBD2, совместимый с ext3/ext4 и e2fsck)
+ *
+ * Журнал упреждающей записи: изменённые блоки метаданных копируются в
+ * кольцевую область журнала, и только после фиксации транзакции пишутся
+ * на свои места. Все операции между фиксациями собираются в одну
+ * транзакцию (групповая фиксация): много мелких fsync превращаются в
+ * одну запись журнала и один сброс кеша устройства.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_JBD_H
+#define MIXOS_FS_JBD_H
+
+#include "fs/vfs.h"
+
+/* ============================================================================
+ * Дисковые структуры (big-endian)
+ * ============================================================================ */
+
+#define JBD_MAGIC               0xC03B3998U
+
+/* Типы блоков журнала */
+#define JBD_DESCRIPTOR_BLOCK    1
+#define JBD_COMMIT_BLOCK        2
+#define JBD_SUPERBLOCK_V1       3
+#define JBD_SUPERBLOCK_V2       4
+#define JBD_REVOKE_BLOCK        5
+
+/* Флаги тегов дескриптора */
+#define JBD_FLAG_ESCAPE         1   /* Блок начинался с JBD_MAGIC */
+#define JBD_FLAG_SAME_UUID      2   /* UUID после тега не записан */
+#define JBD_FLAG_DELETED        4
+#define JBD_FLAG_LAST_TAG       8
+
+/* Возможности журнала */
+#define JBD_FEATURE_COMPAT_CHECKSUM         0x00000001
+#define JBD_FEATURE_INCOMPAT_REVOKE         0x00000001
+#define JBD_FEATURE_INCOMPAT_64BIT          0x00000002
+#define JBD_FEATURE_INCOMPAT_ASYNC_COMMIT   0x00000004
+
+#define JBD_KNOWN_COMPAT        JBD_FEATURE_COMPAT_CHECKSUM
+#define JBD_KNOWN_INCOMPAT      (JBD_FEATURE_INCOMPAT_REVOKE | \
+                                 JBD_FEATURE_INCOMPAT_ASYNC_COMMIT)
+
+/* Контрольная сумма транзакции в блоке фиксации */
+#define JBD_CRC32_CHKSUM        1
+#define JBD_CRC32_CHKSUM_SIZE   4
+
+struct jbd_header {
+    uint32_t h_magic;
+    uint32_t h_blocktype;
+    uint32_t h_sequence;            /* Номер транзакции */
+} __attribute__((packed));
+
+struct jbd_superblock {
+    struct jbd_header s_header;
+    uint32_t s_blocksize;
+    uint32_t s_maxlen;              /* Длина журнала в блоках */
+    uint32_t s_first;               /* Первый блок области записей */
+    uint32_t s_sequence;            /* Первая транзакция в журнале */
+    uint32_t s_start;               /* Её первый блок; 0 - журнал пуст */
+    uint32_t s_errno;
+    /* JBD_SUPERBLOCK_V2 */
+    uint32_t s_feature_compat;
+    uint32_t s_feature_incompat;
+    uint32_t s_feature_ro_compat;
+    uint8_t  s_uuid[16];
+    uint32_t s_nr_users;
+    uint32_t s_dynsuper;
+    uint32_t s_max_transaction;
+    uint32_t s_max_trans_data;
+    uint8_t  s_checksum_type;
+    uint8_t  s_padding2[3];
+    uint32_t s_num_fc_blks;
+    uint32_t s_head;
+    uint32_t s_padding[40];
+    uint32_t s_checksum;
+    uint8_t  s_users[16 * 48];
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct jbd_superblock) == 1024, "jbd superblock size");
+
+/* Тег блока в дескрипторе (без 64BIT и CSUM_V2/V3) */
+struct jbd_block_tag {
+    uint32_t t_blocknr;
+    uint16_t t_checksum;
+    uint16_t t_flags;
+} __attribute__((packed));
+
+struct jbd_commit_header {
+    struct jbd_header h_header;
+    uint8_t  h_chksum_type;
+    uint8_t  h_chksum_size;
+    uint8_t  h_padding[2];
+    uint32_t h_chksum[8];
+    uint64_t h_commit_sec;
+    uint32_t h_commit_nsec;
+} __attribute__((packed));
+
+struct jbd_revoke_header {
+    struct jbd_header r_header;
+    uint32_t r_count;               /* Занято байт, включая заголовок */
+} __attribute__((packed));
+
+static inline uint32_t jbd_be32(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+
+static inline uint16_t jbd_be16(uint16_t value) {
+    return __builtin_bswap16(value);
+}
+
+/* ============================================================================
+ * Структуры в памяти
+ * ============================================================================ */
+
+/* Состояние блока под управлением журнала */
+#define JBD_BUF_RUNNING     (1U << 0)   /* Изменён в текущей транзакции */
+#define JBD_BUF_LOGGED      (1U << 1)   /* Копия есть в журнале, на место не записан */
+
+struct jbd_buffer {
+    uint64_t block;                 /* Номер блока ФС */
+    struct page* page;              /* Страница с актуальными данными (со ссылкой) */
+    void* data;
+    uint8_t* committed;             /* Содержимое до первого освобождения в транзакции */
+    uint32_t state;
+    struct jbd_buffer* hash_next;
+    struct list_head running;
+    struct list_head checkpoint;
+};
+
+/* Inode, данные которого пишутся на диск до фиксации его метаданных */
+struct jbd_inode {
+    struct inode* inode;
+    struct list_head list;          /* Пустой, если inode не прикреплён */
+};
+
+/*
+ * Интервал фиксации по умолчанию. Единица - операции ФС (вызовы
+ * jbd_start), а не время: таймеров у журнала нет. Параметр
+ * монтирования ext3 - commit_ops=N, а не секундный commit= из Linux.
+ */
+#define JBD_DEFAULT_COMMIT_INTERVAL 1024
+
+#define JBD_HASH_SIZE           1024
+
+struct journal {
+    struct super_block* sb;
+    struct block_device* bdev;
+    uint32_t block_size;
+    uint32_t* log_blocks;           /* Блок журнала -> блок устройства */
+    uint32_t maxlen;
+    uint32_t first;
+    uint32_t head;                  /* Следующий свободный блок журнала */
+    bool log_empty;                 /* На диске журнал помечен пустым */
+    uint32_t tid;                   /* Номер открытой транзакции */
+    uint32_t max_transaction;       /* Порог размера транзакции в блоках журнала */
+    uint32_t commit_interval;       /* Порог числа операций в транзакции */
+    uint32_t handles;               /* Операций в открытой транзакции */
+    uint32_t tags_per_descriptor;
+    uint32_t revokes_per_block;
+    uint32_t recovered;             /* Блоков восстановлено при монтировании */
+    bool committing;
+    int error;                      /* Журнал остановлен после ошибки */
+
+    uint32_t nr_running;
+    struct list_head running;       /* Блоки открытой транзакции */
+    struct list_head checkpoint;    /* Блоки, ждущие записи на место */
+    struct list_head inodes;        /* Inode с упорядоченными данными */
+    uint32_t* revoked;              /* Отозванные блоки открытой транзакции */
+    uint32_t nr_revoked;
+    uint32_t revoke_capacity;
+
+    struct jbd_buffer* hash[JBD_HASH_SIZE];
+    struct jbd_superblock* jsb;     /* Копия суперблока журнала (блок целиком) */
+    uint8_t* io_buffer;             /* Блок для дескрипторов и экранированных копий */
+};
+
+/* ============================================================================
+ * Интерфейс для файловых систем
+ * ============================================================================ */
+
+/*
+ * Загрузка журнала: log_blocks[i] - блок устройства для i-го блока
+ * журнала (массив переходит во владение журнала). Незавершённый журнал
+ * воспроизводится; число восстановленных блоков - в journal->recovered.
+ * -EOPNOTSUPP: журнал чистый, но его формат не поддерживается для записи.
+ */
+int jbd_load(struct super_block* sb, uint32_t* log_blocks, uint32_t count,
+             struct journal** out);
+void jbd_destroy(struct journal* journal);
+
+/* Воспроизведение журнала (recovery.c) */
+int jbd_recover(struct journal* journal);
+
+/*
+ * Начало операции ФС. Вызывается там, где состояние в памяти согласовано:
+ * здесь срабатывает интервал фиксации и освобождается место в журнале.
+ */
+int jbd_start(struct journal* journal);
+
+/*
+ * Интервал фиксации: открытая транзакция фиксируется, набрав handles
+ * операций (или заполнив max_transaction блоков журнала). Больше -
+ * крупнее группы и реже сброс кеша, но больше теряется при сбое.
+ */
+int jbd_set_commit_interval(struct journal* journal, uint32_t handles);
+
+/* Блок метаданных изменён: он войдёт в открытую транзакцию */
+int jbd_dirty_block(struct journal* journal, uint64_t block, struct page* page, void* data);
+
+/*
+ * Блок будет освобождён: сохранить копию для jbd_undo_data, чтобы
+ * освобождённое не выделялось повторно до фиксации транзакции.
+ */
+int jbd_get_undo_access(struct journal* journal, uint64_t block, struct page* page,
+                        void* data);
+const uint8_t* jbd_undo_data(struct journal* journal, uint64_t block);
+
+/* Блок освобождён: убрать из транзакций, при необходимости отозвать копии */
+void jbd_forget(struct journal* journal, uint64_t block);
+
+/* Актуальная копия блока, ещё не записанного на место (false - читать с диска) */
+bool jbd_read_block(struct journal* journal, uint64_t block, void* buffer);
+
+/* Данные inode пишутся перед фиксацией открытой транзакции (режим ordered) */
+void jbd_file_inode(struct journal* journal, struct jbd_inode* jinode);
+void jbd_release_inode(struct jbd_inode* jinode);
+
+/* Фиксация открытой транзакции: одна запись журнала и один сброс кеша */
+int jbd_commit(struct journal* journal);
+
+/* Транзакция tid уже зафиксирована */
+static inline bool jbd_tid_committed(struct journal* journal, uint32_t tid) {
+    return (int32_t)(tid - journal->tid) < 0;
+}
+
+/* Запись всех зафиксированных блоков на место и очистка журнала */
+int jbd_checkpoint(struct journal* journal);
+
+#endif /* MIXOS_FS_JBD_H */
@@ -0,0 +1,615 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/jbd/journal.c
+ * Журнал метаданных: транзакции, фиксация, контрольные точки
+ *
+ * Открыта всегда одна транзакция, в неё попадают все операции до
+ * фиксации. Фиксация пишет блоки отзыва, дескрипторы с копиями блоков и
+ * блок фиксации с CRC32 всей транзакции, после чего кеш устройства
+ * сбрасывается один раз (режим async_commit: оборванная фиксация
+ * распознаётся по контрольной сумме). Изменённые блоки удерживаются в
+ * памяти и пишутся на место только контрольной точкой, когда журнал
+ * заполняется; после этого журнал снова начинается с первого блока.
+ * ============================================================================
+ */
+
+#include "fs/jbd/jbd.h"
+#include "lib/crc32.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/* Журнал короче этого не даёт места даже одной операции */
+#define JBD_MIN_LOG_BLOCKS  32
+
+/* ============================================================================
+ * Ввод-вывод блоков журнала
+ * ============================================================================ */
+
+static int jbd_log_io(struct journal* journal, uint32_t index, void* buffer, bool write) {
+    uint32_t sectors = journal->block_size >> SECTOR_SHIFT;
+    uint64_t sector = (uint64_t)journal->log_blocks[index] * sectors;
+    return write ? block_write(journal->bdev, sector, sectors, buffer)
+                 : block_read(journal->bdev, sector, sectors, buffer);
+}
+
+static int jbd_write_super(struct journal* journal, uint32_t start, uint32_t sequence) {
+    journal->jsb->s_start = jbd_be32(start);
+    journal->jsb->s_sequence = jbd_be32(sequence);
+    return jbd_log_io(journal, 0, journal->jsb, true);
+}
+
+static void jbd_abort(struct journal* journal, int err) {
+    if (journal->error) {
+        return;
+    }
+    journal->error = err < 0 ? err : -EIO;
+    journal->sb->flags |= SB_RDONLY;
+    terminal_writestring("  jbd: journal aborted, filesystem is read-only now\n");
+}
+
+/* ============================================================================
+ * Загрузка
+ * ============================================================================ */
+
+int jbd_load(struct super_block* sb, uint32_t* log_blocks, uint32_t count,
+             struct journal** out) {
+    struct journal* journal = kzalloc(sizeof(*journal));
+    if (!journal) {
+        kfree(log_blocks);
+        return -ENOMEM;
+    }
+    journal->sb = sb;
+    journal->bdev = sb->bdev;
+    journal->block_size = sb->block_size;
+    journal->log_blocks = log_blocks;
+    journal->maxlen = count;
+    journal->commit_interval = JBD_DEFAULT_COMMIT_INTERVAL;
+    list_init(&journal->running);
+    list_init(&journal->checkpoint);
+    list_init(&journal->inodes);
+
+    journal->jsb = kmalloc(journal->block_size);
+    journal->io_buffer = kmalloc(journal->block_size);
+    if (!journal->jsb || !journal->io_buffer) {
+        jbd_destroy(journal);
+        return -ENOMEM;
+    }
+
+    struct jbd_superblock* jsb = journal->jsb;
+    int err = count ? jbd_log_io(journal, 0, jsb, false) : -EINVAL;
+    if (err < 0) {
+        jbd_destroy(journal);
+        return err;
+    }
+
+    uint32_t type = jbd_be32(jsb->s_header.h_blocktype);
+    uint32_t maxlen = jbd_be32(jsb->s_maxlen);
+    uint32_t first = jbd_be32(jsb->s_first);
+    if (jbd_be32(jsb->s_header.h_magic) != JBD_MAGIC ||
+        (type != JBD_SUPERBLOCK_V1 && type != JBD_SUPERBLOCK_V2) ||
+        jbd_be32(jsb->s_blocksize) != journal->block_size ||
+        maxlen > count || first == 0 || first >= maxlen) {
+        jbd_destroy(journal);
+        return -EFSCORRUPTED;
+    }
+    journal->maxlen = maxlen;
+    journal->first = first;
+
+    /* Без суперблока v2 нельзя включить отзыв и контрольные суммы */
+    bool supported = type == JBD_SUPERBLOCK_V2 &&
+                     !(jbd_be32(jsb->s_feature_incompat) & ~JBD_KNOWN_INCOMPAT) &&
+                     maxlen - first >= JBD_MIN_LOG_BLOCKS;
+    if (type == JBD_SUPERBLOCK_V2 &&
+        (jbd_be32(jsb->s_feature_incompat) & ~JBD_KNOWN_INCOMPAT) && jsb->s_start) {
+        /* Записи в незнакомом формате не воспроизвести */
+        terminal_writestring("  jbd: cannot recover journal with unknown features\n");
+        jbd_destroy(journal);
+        return -EINVAL;
+    }
+
+    err = jbd_recover(journal);
+    if (err < 0) {
+        jbd_destroy(journal);
+        return err;
+    }
+    if (!supported) {
+        jbd_destroy(journal);
+        return -EOPNOTSUPP;
+    }
+
+    jsb->s_feature_compat |= jbd_be32(JBD_FEATURE_COMPAT_CHECKSUM);
+    jsb->s_feature_incompat |= jbd_be32(JBD_FEATURE_INCOMPAT_REVOKE |
+                                        JBD_FEATURE_INCOMPAT_ASYNC_COMMIT);
+    err = jbd_write_super(journal, 0, journal->tid);
+    if (err == 0) {
+        err = block_flush(journal->bdev);
+    }
+    if (err < 0) {
+        jbd_destroy(journal);
+        return err;
+    }
+
+    journal->head = first;
+    journal->log_empty = true;
+    journal->max_transaction = (maxlen - first) / 4;
+    journal->tags_per_descriptor = (journal->block_size - sizeof(struct jbd_header) - 16) /
+                                   sizeof(struct jbd_block_tag);
+    journal->revokes_per_block = (journal->block_size - sizeof(struct jbd_revoke_header)) /
+                                 sizeof(uint32_t);
+    *out = journal;
+    return 0;
+}
+
+/* ============================================================================
+ * Блоки под управлением журнала
+ * ============================================================================ */
+
+static inline uint32_t jbd_hashfn(uint64_t block) {
+    return (uint32_t)((block * 0x9E3779B97F4A7C15ULL) >> 54) & (JBD_HASH_SIZE - 1);
+}
+
+static struct jbd_buffer* jbd_find(struct journal* journal, uint64_t block) {
+    struct jbd_buffer* jb = journal->hash[jbd_hashfn(block)];
+    while (jb && jb->block != block) {
+        jb = jb->hash_next;
+    }
+    return jb;
+}
+
+static struct jbd_buffer* jbd_get(struct journal* journal, uint64_t block) {
+    struct jbd_buffer* jb = jbd_find(journal, block);
+    if (jb) {
+        return jb;
+    }
+    jb = kzalloc(sizeof(*jb));
+    if (!jb) {
+        return NULL;
+    }
+    jb->block = block;
+    list_init(&jb->running);
+    list_init(&jb->checkpoint);
+    uint32_t bucket = jbd_hashfn(block);
+    jb->hash_next = journal->hash[bucket];
+    journal->hash[bucket] = jb;
+    return jb;
+}
+
+static void jbd_free_buffer(struct journal* journal, struct jbd_buffer* jb) {
+    struct jbd_buffer** link = &journal->hash[jbd_hashfn(jb->block)];
+    while (*link != jb) {
+        link = &(*link)->hash_next;
+    }
+    *link = jb->hash_next;
+
+    if (jb->state & JBD_BUF_RUNNING) {
+        list_del(&jb->running);
+        journal->nr_running--;
+    }
+    list_del(&jb->checkpoint);
+    if (jb->page) {
+        put_page(jb->page);
+    }
+    kfree(jb->committed);
+    kfree(jb);
+}
+
+/* Блок снова записывается в журнал: его отзыв в этой транзакции отменяется */
+static void jbd_cancel_revoke(struct journal* journal, uint64_t block) {
+    for (uint32_t i = 0; i < journal->nr_revoked; i++) {
+        if (journal->revoked[i] == block) {
+            journal->revoked[i] = journal->revoked[--journal->nr_revoked];
+            return;
+        }
+    }
+}
+
+int jbd_dirty_block(struct journal* journal, uint64_t block, struct page* page, void* data) {
+    if (journal->error) {
+        return journal->error;
+    }
+    struct jbd_buffer* jb = jbd_get(journal, block);
+    if (!jb) {
+        jbd_abort(journal, -ENOMEM);
+        return -ENOMEM;
+    }
+
+    /* Блок каталога мог быть перечитан в новую страницу */
+    if (jb->page != page) {
+        get_page(page);
+        if (jb->page) {
+            put_page(jb->page);
+        }
+        jb->page = page;
+    }
+    jb->data = data;
+
+    if (!(jb->state & JBD_BUF_RUNNING)) {
+        jb->state |= JBD_BUF_RUNNING;
+        list_add_tail(&jb->running, &journal->running);
+        journal->nr_running++;
+        jbd_cancel_revoke(journal, block);
+    }
+    return 0;
+}
+
+int jbd_get_undo_access(struct journal* journal, uint64_t block, struct page* page,
+                        void* data) {
+    int err = jbd_dirty_block(journal, block, page, data);
+    if (err < 0) {
+        return err;
+    }
+    struct jbd_buffer* jb = jbd_find(journal, block);
+    if (!jb->committed) {
+        jb->committed = kmalloc(journal->block_size);
+        if (!jb->committed) {
+            jbd_abort(journal, -ENOMEM);
+            return -ENOMEM;
+        }
+        memcpy(jb->committed, data, journal->block_size);
+    }
+    return 0;
+}
+
+const uint8_t* jbd_undo_data(struct journal* journal, uint64_t block) {
+    struct jbd_buffer* jb = jbd_find(journal, block);
+    return jb ? jb->committed : NULL;
+}
+
+void jbd_forget(struct journal* journal, uint64_t block) {
+    struct jbd_buffer* jb = jbd_find(journal, block);
+    if (!jb) {
+        return;
+    }
+
+    /* Копии в журнале не должны затереть новое содержимое блока при восстановлении */
+    if (jb->state & JBD_BUF_LOGGED) {
+        if (journal->nr_revoked == journal->revoke_capacity) {
+            uint32_t capacity = journal->revoke_capacity ? journal->revoke_capacity * 2 : 64;
+            uint32_t* revoked = kmalloc(capacity * sizeof(uint32_t));
+            if (!revoked) {
+                jbd_abort(journal, -ENOMEM);
+                return;
+            }
+            if (journal->revoked) {
+                memcpy(revoked, journal->revoked, journal->nr_revoked * sizeof(uint32_t));
+                kfree(journal->revoked);
+            }
+            journal->revoked = revoked;
+            journal->revoke_capacity = capacity;
+        }
+        journal->revoked[journal->nr_revoked++] = (uint32_t)block;
+    }
+    jbd_free_buffer(journal, jb);
+}
+
+bool jbd_read_block(struct journal* journal, uint64_t block, void* buffer) {
+    struct jbd_buffer* jb = jbd_find(journal, block);
+    if (!jb) {
+        return false;
+    }
+    memcpy(buffer, jb->data, journal->block_size);
+    return true;
+}
+
+void jbd_file_inode(struct journal* journal, struct jbd_inode* jinode) {
+    if (list_empty(&jinode->list)) {
+        list_add_tail(&jinode->list, &journal->inodes);
+    }
+}
+
+void jbd_release_inode(struct jbd_inode* jinode) {
+    list_del(&jinode->list);
+}
+
+/* ============================================================================
+ * Фиксация
+ * ============================================================================ */
+
+/* Блоков журнала, нужных для фиксации открытой транзакции */
+static uint32_t jbd_log_space(struct journal* journal) {
+    return journal->nr_running +
+           DIV_ROUND_UP(journal->nr_running, journal->tags_per_descriptor) +
+           DIV_ROUND_UP(journal->nr_revoked, journal->revokes_per_block) + 1;
+}
+
+/*
+ * Перед записью транзакции в неё попадают все грязные inode, а данные
+ * файлов с новыми блоками пишутся на место (режим ordered), чтобы
+ * зафиксированные указатели не ссылались на старое содержимое блоков.
+ */
+static int jbd_prepare_commit(struct journal* journal) {
+    int result = 0;
+
+    while (!list_empty(&journal->sb->dirty_inodes)) {
+        struct inode* inode = list_first_entry(&journal->sb->dirty_inodes, struct inode, dirty);
+        int err = write_inode_now(inode);
+        if (err < 0 && result == 0) {
+            result = err;
+        }
+    }
+    while (!list_empty(&journal->inodes)) {
+        struct jbd_inode* jinode = list_first_entry(&journal->inodes, struct jbd_inode, list);
+        list_del(&jinode->list);
+        int err = sync_mapping(&jinode->inode->mapping);
+        if (err < 0 && result == 0) {
+            result = err;
+        }
+    }
+    return result;
+}
+
+static int jbd_write_revokes(struct journal* journal, uint32_t* pos) {
+    uint8_t* buffer = journal->io_buffer;
+
+    for (uint32_t i = 0; i < journal->nr_revoked; ) {
+        uint32_t n = MIN(journal->nr_revoked - i, journal->revokes_per_block);
+        struct jbd_revoke_header* header = (struct jbd_revoke_header*)buffer;
+        uint32_t* records = (uint32_t*)(header + 1);
+
+        memset(buffer, 0, journal->block_size);
+        header->r_header.h_magic = jbd_be32(JBD_MAGIC);
+        header->r_header.h_blocktype = jbd_be32(JBD_REVOKE_BLOCK);
+        header->r_header.h_sequence = jbd_be32(journal->tid);
+        header->r_count = jbd_be32((uint32_t)(sizeof(*header) + n * sizeof(uint32_t)));
+        for (uint32_t k = 0; k < n; k++) {
+            records[k] = jbd_be32(journal->revoked[i + k]);
+        }
+        int err = jbd_log_io(journal, (*pos)++, buffer, true);
+        if (err < 0) {
+            return err;
+        }
+        i += n;
+    }
+    return 0;
+}
+
+/*
+ * Дескриптор и следующие за ним копии блоков. CRC считается в порядке
+ * блоков журнала, как при восстановлении; копия, начинающаяся с
+ * JBD_MAGIC, пишется с обнулённым началом и флагом ESCAPE.
+ */
+static int jbd_write_blocks(struct journal* journal, uint32_t* pos, uint32_t* crc) {
+    uint32_t magic = jbd_be32(JBD_MAGIC);
+    uint8_t* buffer = journal->io_buffer;
+    struct list_head* next = journal->running.next;
+
+    while (next != &journal->running) {
+        struct jbd_header* header = (struct jbd_header*)buffer;
+        uint8_t* tagp = buffer + sizeof(*header);
+        struct jbd_block_tag* tag = NULL;
+        struct list_head* batch = next;
+
+        memset(buffer, 0, journal->block_size);
+        header->h_magic = magic;
+        header->h_blocktype = jbd_be32(JBD_DESCRIPTOR_BLOCK);
+        header->h_sequence = jbd_be32(journal->tid);
+
+        for (uint32_t n = 0; n < journal->tags_per_descriptor && next != &journal->running; n++) {
+            struct jbd_buffer* jb = list_entry(next, struct jbd_buffer, running);
+            uint16_t flags = n ? JBD_FLAG_SAME_UUID : 0;
+            if (*(const uint32_t*)jb->data == magic) {
+                flags |= JBD_FLAG_ESCAPE;
+            }
+            tag = (struct jbd_block_tag*)tagp;
+            tag->t_blocknr = jbd_be32((uint32_t)jb->block);
+            tag->t_flags = jbd_be16(flags);
+            tagp += sizeof(*tag);
+            if (n == 0) {
+                memcpy(tagp, journal->jsb->s_uuid, sizeof(journal->jsb->s_uuid));
+                tagp += sizeof(journal->jsb->s_uuid);
+            }
+            next = next->next;
+        }
+        tag->t_flags |= jbd_be16(JBD_FLAG_LAST_TAG);
+
+        *crc = crc32_be(*crc, buffer, journal->block_size);
+        int err = jbd_log_io(journal, (*pos)++, buffer, true);
+        if (err < 0) {
+            return err;
+        }
+
+        /* Дескриптор уже записан: буфер свободен для экранированных копий */
+        for (struct list_head* l = batch; l != next; l = l->next) {
+            struct jbd_buffer* jb = list_entry(l, struct jbd_buffer, running);
+            void* data = jb->data;
+            if (*(const uint32_t*)data == magic) {
+                memcpy(buffer, data, journal->block_size);
+                *(uint32_t*)buffer = 0;
+                data = buffer;
+            }
+            *crc = crc32_be(*crc, data, journal->block_size);
+            err = jbd_log_io(journal, (*pos)++, data, true);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+    return 0;
+}
+
+static int jbd_write_commit_block(struct journal* journal, uint32_t pos, uint32_t crc) {
+    struct jbd_commit_header* commit = (struct jbd_commit_header*)journal->io_buffer;
+
+    memset(commit, 0, journal->block_size);
+    commit->h_header.h_magic = jbd_be32(JBD_MAGIC);
+    commit->h_header.h_blocktype = jbd_be32(JBD_COMMIT_BLOCK);
+    commit->h_header.h_sequence = jbd_be32(journal->tid);
+    commit->h_chksum_type = JBD_CRC32_CHKSUM;
+    commit->h_chksum_size = JBD_CRC32_CHKSUM_SIZE;
+    commit->h_chksum[0] = jbd_be32(crc);
+    return jbd_log_io(journal, pos, commit, true);
+}
+
+static int jbd_write_transaction(struct journal* journal) {
+    if (jbd_log_space(journal) > journal->maxlen - journal->head) {
+        terminal_writestring("  jbd: transaction does not fit into the journal\n");
+        return -ENOSPC;
+    }
+
+    /* Первая транзакция после очистки: суперблок указывает на её начало.
+     * Он попадает под тот же сброс кеша, что и сама транзакция */
+    if (journal->log_empty) {
+        int err = jbd_write_super(journal, journal->head, journal->tid);
+        if (err < 0) {
+            return err;
+        }
+        journal->log_empty = false;
+    }
+
+    uint32_t pos = journal->head;
+    uint32_t crc = ~0U;
+    int err = jbd_write_revokes(journal, &pos);
+    if (err == 0) {
+        err = jbd_write_blocks(journal, &pos, &crc);
+    }
+    if (err == 0) {
+        err = jbd_write_commit_block(journal, pos++, crc);
+    }
+    if (err == 0) {
+        err = block_flush(journal->bdev);
+    }
+    if (err < 0) {
+        return err;
+    }
+    journal->head = pos;
+
+    /* Блоки ждут контрольной точки; копии для отмены освобождений не нужны */
+    while (!list_empty(&journal->running)) {
+        struct jbd_buffer* jb = list_first_entry(&journal->running, struct jbd_buffer, running);
+        list_del(&jb->running);
+        jb->state &= ~JBD_BUF_RUNNING;
+        if (!(jb->state & JBD_BUF_LOGGED)) {
+            jb->state |= JBD_BUF_LOGGED;
+            list_add_tail(&jb->checkpoint, &journal->checkpoint);
+        }
+        kfree(jb->committed);
+        jb->committed = NULL;
+    }
+    journal->nr_running = 0;
+    journal->nr_revoked = 0;
+    journal->tid++;
+    return 0;
+}
+
+int jbd_commit(struct journal* journal) {
+    if (journal->error) {
+        return journal->error;
+    }
+    if (journal->committing) {
+        return 0;
+    }
+
+    journal->committing = true;
+    int err = jbd_prepare_commit(journal);
+    if (journal->nr_running || journal->nr_revoked) {
+        int werr = jbd_write_transaction(journal);
+        if (werr < 0) {
+            jbd_abort(journal, werr);
+            err = werr;
+        }
+    }
+    journal->handles = 0;
+    journal->committing = false;
+    return err;
+}
+
+/* ============================================================================
+ * Контрольная точка
+ * ============================================================================ */
+
+int jbd_checkpoint(struct journal* journal) {
+    int err = jbd_commit(journal);
+    if (err < 0) {
+        return err;
+    }
+    if (journal->log_empty) {
+        return 0;
+    }
+
+    struct list_head* pos;
+    uint32_t sectors = journal->block_size >> SECTOR_SHIFT;
+    list_for_each(pos, &journal->checkpoint) {
+        struct jbd_buffer* jb = list_entry(pos, struct jbd_buffer, checkpoint);
+        err = block_write(journal->bdev, jb->block * sectors, sectors, jb->data);
+        if (err < 0) {
+            break;
+        }
+    }
+    /* Журнал очищается, только когда блоки уже на своих местах */
+    if (err == 0) {
+        err = block_flush(journal->bdev);
+    }
+    if (err == 0) {
+        err = jbd_write_super(journal, 0, journal->tid);
+    }
+    if (err == 0) {
+        err = block_flush(journal->bdev);
+    }
+    if (err < 0) {
+        jbd_abort(journal, err);
+        return err;
+    }
+
+    while (!list_empty(&journal->checkpoint)) {
+        jbd_free_buffer(journal, list_first_entry(&journal->checkpoint, struct jbd_buffer,
+                                                  checkpoint));
+    }
+    journal->head = journal->first;
+    journal->log_empty = true;
+    return 0;
+}
+
+/* ============================================================================
+ * Операции
+ * ============================================================================ */
+
+int jbd_start(struct journal* journal) {
+    if (journal->error) {
+        return journal->error;
+    }
+    if (journal->committing) {
+        return 0;
+    }
+
+    int err = 0;
+    if (journal->handles >= journal->commit_interval ||
+        jbd_log_space(journal) > journal->max_transaction) {
+        err = jbd_commit(journal);
+    }
+    /* Место для открытой транзакции и ещё одной такой же */
+    if (err == 0 && journal->maxlen - journal->head < 2 * journal->max_transaction) {
+        err = jbd_checkpoint(journal);
+    }
+    if (err < 0) {
+        return err;
+    }
+    journal->handles++;
+    return 0;
+}
+
+int jbd_set_commit_interval(struct journal* journal, uint32_t handles) {
+    if (handles == 0) {
+        return -EINVAL;
+    }
+    journal->commit_interval = handles;
+    return 0;
+}
+
+void jbd_destroy(struct journal* journal) {
+    while (!list_empty(&journal->running)) {
+        jbd_free_buffer(journal, list_first_entry(&journal->running, struct jbd_buffer,
+                                                  running));
+    }
+    while (!list_empty(&journal->checkpoint)) {
+        jbd_free_buffer(journal, list_first_entry(&journal->checkpoint, struct jbd_buffer,
+                                                  checkpoint));
+    }
+    while (!list_empty(&journal->inodes)) {
+        list_del(journal->inodes.next);
+    }
+    kfree(journal->revoked);
+    kfree(journal->log_blocks);
+    kfree(journal->jsb);
+    kfree(journal->io_buffer);
+    kfree(journal);
+}
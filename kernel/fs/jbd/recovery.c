@@ -0,0 +1,301 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/jbd/recovery.c
+ * Журнал метаданных: воспроизведение после сбоя
+ *
+ * Три прохода по журналу, как в JBD2:
+ *   SCAN   - поиск последней целой транзакции (номера, контрольные суммы);
+ *   REVOKE - сбор отозванных блоков;
+ *   REPLAY - запись копий блоков на места, кроме отозванных.
+ * ============================================================================
+ */
+
+#include "fs/jbd/jbd.h"
+#include "lib/crc32.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+enum jbd_pass {
+    PASS_SCAN,
+    PASS_REVOKE,
+    PASS_REPLAY,
+};
+
+#define JBD_REVOKE_HASH_SIZE    256
+
+/* Блок отозван транзакцией tid: его копии из транзакций <= tid не пишутся */
+struct jbd_revoke_entry {
+    uint32_t block;
+    uint32_t tid;
+    struct jbd_revoke_entry* next;
+};
+
+struct jbd_recovery {
+    uint32_t end_tid;               /* Первая транзакция, не подлежащая воспроизведению */
+    uint8_t* block;                 /* Буфер для копий блоков */
+    struct jbd_revoke_entry* revoke[JBD_REVOKE_HASH_SIZE];
+};
+
+static inline uint32_t revoke_hashfn(uint32_t block) {
+    return (block * 0x9E3779B1U) >> 24;
+}
+
+static struct jbd_revoke_entry* find_revoke(struct jbd_recovery* info, uint32_t block) {
+    struct jbd_revoke_entry* entry = info->revoke[revoke_hashfn(block)];
+    while (entry && entry->block != block) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+static int set_revoke(struct jbd_recovery* info, uint32_t block, uint32_t tid) {
+    struct jbd_revoke_entry* entry = find_revoke(info, block);
+    if (entry) {
+        if ((int32_t)(tid - entry->tid) > 0) {
+            entry->tid = tid;
+        }
+        return 0;
+    }
+    entry = kmalloc(sizeof(*entry));
+    if (!entry) {
+        return -ENOMEM;
+    }
+    uint32_t bucket = revoke_hashfn(block);
+    entry->block = block;
+    entry->tid = tid;
+    entry->next = info->revoke[bucket];
+    info->revoke[bucket] = entry;
+    return 0;
+}
+
+static bool test_revoke(struct jbd_recovery* info, uint32_t block, uint32_t tid) {
+    struct jbd_revoke_entry* entry = find_revoke(info, block);
+    return entry && (int32_t)(entry->tid - tid) >= 0;
+}
+
+static void free_revokes(struct jbd_recovery* info) {
+    for (uint32_t i = 0; i < JBD_REVOKE_HASH_SIZE; i++) {
+        while (info->revoke[i]) {
+            struct jbd_revoke_entry* entry = info->revoke[i];
+            info->revoke[i] = entry->next;
+            kfree(entry);
+        }
+    }
+}
+
+/* ============================================================================
+ * Проходы
+ * ============================================================================ */
+
+static int read_log(struct journal* journal, uint32_t index, void* buffer) {
+    uint32_t sectors = journal->block_size >> SECTOR_SHIFT;
+    return block_read(journal->bdev, (uint64_t)journal->log_blocks[index] * sectors,
+                      sectors, buffer);
+}
+
+static inline uint32_t wrap(struct journal* journal, uint32_t index) {
+    return index >= journal->maxlen ? index - (journal->maxlen - journal->first) : index;
+}
+
+/* Число тегов дескриптора (без 64BIT и CSUM_V2/V3 тег занимает 8 байт) */
+static uint32_t count_tags(struct journal* journal, const uint8_t* descriptor) {
+    uint32_t offset = sizeof(struct jbd_header);
+    uint32_t count = 0;
+
+    while (offset + sizeof(struct jbd_block_tag) <= journal->block_size) {
+        const struct jbd_block_tag* tag = (const struct jbd_block_tag*)(descriptor + offset);
+        uint16_t flags = jbd_be16(tag->t_flags);
+        offset += sizeof(*tag);
+        if (!(flags & JBD_FLAG_SAME_UUID)) {
+            offset += 16;
+        }
+        count++;
+        if (flags & JBD_FLAG_LAST_TAG) {
+            break;
+        }
+    }
+    return count;
+}
+
+static int replay_tags(struct journal* journal, struct jbd_recovery* info,
+                       const uint8_t* descriptor, uint32_t pos, uint32_t tid) {
+    uint32_t offset = sizeof(struct jbd_header);
+    uint32_t sectors = journal->block_size >> SECTOR_SHIFT;
+
+    while (offset + sizeof(struct jbd_block_tag) <= journal->block_size) {
+        const struct jbd_block_tag* tag = (const struct jbd_block_tag*)(descriptor + offset);
+        uint16_t flags = jbd_be16(tag->t_flags);
+        uint32_t block = jbd_be32(tag->t_blocknr);
+
+        if (!test_revoke(info, block, tid)) {
+            int err = read_log(journal, pos, info->block);
+            if (err < 0) {
+                return err;
+            }
+            if (flags & JBD_FLAG_ESCAPE) {
+                *(uint32_t*)info->block = jbd_be32(JBD_MAGIC);
+            }
+            err = block_write(journal->bdev, (uint64_t)block * sectors, sectors, info->block);
+            if (err < 0) {
+                return err;
+            }
+            journal->recovered++;
+        }
+
+        pos = wrap(journal, pos + 1);
+        offset += sizeof(*tag);
+        if (!(flags & JBD_FLAG_SAME_UUID)) {
+            offset += 16;
+        }
+        if (flags & JBD_FLAG_LAST_TAG) {
+            break;
+        }
+    }
+    return 0;
+}
+
+static int collect_revokes(struct journal* journal, struct jbd_recovery* info,
+                           const uint8_t* buffer, uint32_t tid) {
+    const struct jbd_revoke_header* header = (const struct jbd_revoke_header*)buffer;
+    uint32_t size = MIN(jbd_be32(header->r_count), journal->block_size);
+    const uint32_t* records = (const uint32_t*)(header + 1);
+    uint32_t count = (uint32_t)((size - MIN(size, sizeof(*header))) / sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < count; i++) {
+        int err = set_revoke(info, jbd_be32(records[i]), tid);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int do_one_pass(struct journal* journal, struct jbd_recovery* info, enum jbd_pass pass) {
+    const struct jbd_superblock* jsb = journal->jsb;
+    bool checksum = (jbd_be32(jsb->s_header.h_blocktype) == JBD_SUPERBLOCK_V2) &&
+                    (jbd_be32(jsb->s_feature_compat) & JBD_FEATURE_COMPAT_CHECKSUM);
+    uint32_t tid = jbd_be32(jsb->s_sequence);
+    uint32_t pos = jbd_be32(jsb->s_start);
+    uint32_t crc = ~0U;
+    uint8_t* buffer = journal->io_buffer;
+
+    while (pass == PASS_SCAN || tid != info->end_tid) {
+        int err = read_log(journal, pos, buffer);
+        if (err < 0) {
+            return err;
+        }
+        const struct jbd_header* header = (const struct jbd_header*)buffer;
+        if (jbd_be32(header->h_magic) != JBD_MAGIC || jbd_be32(header->h_sequence) != tid) {
+            break;
+        }
+        pos = wrap(journal, pos + 1);
+
+        uint32_t type = jbd_be32(header->h_blocktype);
+        if (type == JBD_DESCRIPTOR_BLOCK) {
+            uint32_t count = count_tags(journal, buffer);
+            if (pass == PASS_SCAN && checksum) {
+                crc = crc32_be(crc, buffer, journal->block_size);
+                for (uint32_t i = 0; i < count; i++) {
+                    err = read_log(journal, wrap(journal, pos + i), info->block);
+                    if (err < 0) {
+                        return err;
+                    }
+                    crc = crc32_be(crc, info->block, journal->block_size);
+                }
+            } else if (pass == PASS_REPLAY) {
+                err = replay_tags(journal, info, buffer, pos, tid);
+                if (err < 0) {
+                    return err;
+                }
+            }
+            pos = wrap(journal, pos + count);
+        } else if (type == JBD_COMMIT_BLOCK) {
+            if (pass == PASS_SCAN && checksum) {
+                const struct jbd_commit_header* commit = (const struct jbd_commit_header*)buffer;
+                uint32_t found = jbd_be32(commit->h_chksum[0]);
+                bool valid = (commit->h_chksum_type == JBD_CRC32_CHKSUM &&
+                              commit->h_chksum_size == JBD_CRC32_CHKSUM_SIZE && found == crc) ||
+                             (commit->h_chksum_type == 0 && commit->h_chksum_size == 0 &&
+                              found == 0);
+                /* Оборванная фиксация: транзакция и всё после неё отбрасываются */
+                if (!valid) {
+                    break;
+                }
+                crc = ~0U;
+            }
+            tid++;
+        } else if (type == JBD_REVOKE_BLOCK) {
+            if (pass == PASS_REVOKE) {
+                err = collect_revokes(journal, info, buffer, tid);
+                if (err < 0) {
+                    return err;
+                }
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (pass == PASS_SCAN) {
+        info->end_tid = tid;
+    }
+    return 0;
+}
+
+int jbd_recover(struct journal* journal) {
+    struct jbd_superblock* jsb = journal->jsb;
+
+    if (jsb->s_start == 0) {
+        journal->tid = jbd_be32(jsb->s_sequence) + 1;
+        return 0;
+    }
+    if (jbd_be32(jsb->s_start) < journal->first || jbd_be32(jsb->s_start) >= journal->maxlen) {
+        return -EFSCORRUPTED;
+    }
+
+    struct jbd_recovery* info = kzalloc(sizeof(*info));
+    if (!info) {
+        return -ENOMEM;
+    }
+    info->block = kmalloc(journal->block_size);
+    int err = info->block ? 0 : -ENOMEM;
+
+    if (err == 0) {
+        err = do_one_pass(journal, info, PASS_SCAN);
+    }
+    if (err == 0) {
+        err = do_one_pass(journal, info, PASS_REVOKE);
+    }
+    if (err == 0) {
+        err = do_one_pass(journal, info, PASS_REPLAY);
+    }
+
+    /* Журнал пуст, только когда восстановленные блоки уже на носителе.
+     * Номер следующей транзакции пропускает возможный обрывок end_tid */
+    if (err == 0) {
+        err = block_flush(journal->bdev);
+    }
+    if (err == 0) {
+        journal->tid = info->end_tid + 1;
+        jsb->s_start = 0;
+        jsb->s_sequence = jbd_be32(journal->tid);
+        uint32_t sectors = journal->block_size >> SECTOR_SHIFT;
+        err = block_write(journal->bdev, (uint64_t)journal->log_blocks[0] * sectors, sectors,
+                          jsb);
+    }
+    if (err == 0) {
+        err = block_flush(journal->bdev);
+    }
+
+    if (journal->recovered) {
+        terminal_writestring("  jbd: recovered ");
+        terminal_writedec(journal->recovered);
+        terminal_writestring(" blocks, transactions up to ");
+        terminal_writedec(info->end_tid - 1);
+        terminal_writestring("\n");
+    }
+    free_revokes(info);
+    kfree(info->block);
+    kfree(info);
+    return err;
+}
@@ -0,0 +1,801 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/mixfs/btree.c
+ * MixFS: B+дерево с копированием при записи
+ *
+ * Поиск с cow = true копирует все узлы пути, ещё не принадлежащие текущей
+ * транзакции, и заранее делит переполненные узлы (ins_len - сколько байт
+ * данных предстоит добавить в лист), поэтому вставка не распространяется
+ * вверх. Ключ во внутреннем узле всегда равен наименьшему ключу поддерева:
+ * его поддерживают вставка и удаление в позиции 0. Благодаря этому
+ * предшественник ключа, отсутствующего в дереве, всегда лежит в том же
+ * листе, что и позиция вставки.
+ *
+ * Контрольные суммы новых узлов вычисляются один раз при фиксации
+ * (mixfs_tree_checksum), прочитанные с диска узлы проверяются при первом
+ * обращении к странице кеша.
+ * ============================================================================
+ */
+
+#include "fs/mixfs/mixfs.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Пути и узлы
+ * ============================================================================ */
+
+void mixfs_path_init(struct mixfs_path* path) {
+    memset(path, 0, sizeof(*path));
+}
+
+void mixfs_path_release(struct mixfs_path* path) {
+    for (int level = 0; level < MIXFS_MAX_LEVEL; level++) {
+        brelse(&path->nodes[level]);
+    }
+}
+
+/* Чтение узла; generation - ожидаемое поколение из указателя родителя (0 - любое) */
+int mixfs_read_node(struct super_block* sb, uint64_t blocknr, uint64_t generation,
+                    struct buffer* buf) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    if (blocknr < sbi->first_data_block || blocknr >= sbi->total_blocks) {
+        return -EFSCORRUPTED;
+    }
+    int err = bread(sb->bdev, blocknr, MIXFS_BLOCK_SIZE, buf);
+    if (err < 0) {
+        return err;
+    }
+
+    struct mixfs_node_header* node = buf->data;
+    if (!(buf->page->flags & PG_CHECKED)) {
+        if (node->magic != MIXFS_NODE_MAGIC || node->blocknr != blocknr ||
+            node->csum != mixfs_block_csum(node)) {
+            terminal_writestring("  mixfs: bad tree node ");
+            terminal_writedec(blocknr);
+            terminal_writestring("\n");
+            brelse(buf);
+            return -EFSCORRUPTED;
+        }
+        buf->page->flags |= PG_CHECKED;
+    }
+    if ((generation && node->generation != generation) || node->level >= MIXFS_MAX_LEVEL) {
+        terminal_writestring("  mixfs: tree node generation mismatch\n");
+        brelse(buf);
+        return -EFSCORRUPTED;
+    }
+    return 0;
+}
+
+static int alloc_node(struct super_block* sb, uint8_t level, struct buffer* buf) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    uint64_t blocknr, count;
+
+    int err = mixfs_alloc_blocks(sb, sbi->meta_hint, 1, &blocknr, &count);
+    if (err < 0) {
+        return err;
+    }
+    sbi->meta_hint = blocknr + 1;
+
+    err = bread(sb->bdev, blocknr, MIXFS_BLOCK_SIZE, buf);
+    if (err < 0) {
+        mixfs_free_blocks(sb, blocknr, 1, true);
+        return err;
+    }
+    struct mixfs_node_header* node = buf->data;
+    memset(node, 0, MIXFS_BLOCK_SIZE);
+    node->magic = MIXFS_NODE_MAGIC;
+    node->blocknr = blocknr;
+    node->generation = sbi->transid;
+    node->level = level;
+    buf->page->flags |= PG_CHECKED;
+    mark_buffer_dirty(buf);
+    return 0;
+}
+
+static uint32_t leaf_data_end(struct mixfs_node_header* leaf) {
+    return leaf->nritems ? mixfs_leaf_items(leaf)[leaf->nritems - 1].offset : MIXFS_BLOCK_SIZE;
+}
+
+static uint32_t leaf_free_space(struct mixfs_node_header* leaf) {
+    return leaf_data_end(leaf) - (uint32_t)(sizeof(*leaf) + leaf->nritems * sizeof(struct mixfs_item));
+}
+
+static uint32_t leaf_used_space(struct mixfs_node_header* leaf) {
+    return MIXFS_LEAF_SPACE - leaf_free_space(leaf);
+}
+
+static const struct mixfs_key* node_first_key(struct mixfs_node_header* node) {
+    return node->level ? &mixfs_node_ptrs(node)[0].key : &mixfs_leaf_items(node)[0].key;
+}
+
+/* ============================================================================
+ * Копирование при записи
+ * ============================================================================ */
+
+/* Узел уровня level в пути становится частью текущей транзакции */
+static int cow_node(struct super_block* sb, struct mixfs_path* path, int level) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    struct mixfs_node_header* node = path->nodes[level].data;
+
+    if (node->generation == sbi->transid) {
+        mark_buffer_dirty(&path->nodes[level]);
+        return 0;
+    }
+
+    struct buffer copy;
+    int err = alloc_node(sb, node->level, &copy);
+    if (err < 0) {
+        return err;
+    }
+    struct mixfs_node_header* new_node = copy.data;
+    uint64_t old = node->blocknr;
+    memcpy(new_node, node, MIXFS_BLOCK_SIZE);
+    new_node->blocknr = copy.block;
+    new_node->generation = sbi->transid;
+
+    brelse(&path->nodes[level]);
+    path->nodes[level] = copy;
+
+    if ((uint32_t)level == sbi->root_level) {
+        sbi->root = copy.block;
+    } else {
+        struct mixfs_ptr* ptr = &mixfs_node_ptrs(path->nodes[level + 1].data)[path->slots[level + 1]];
+        ptr->blocknr = copy.block;
+        ptr->generation = sbi->transid;
+    }
+    mixfs_free_blocks(sb, old, 1, true);
+    return 0;
+}
+
+/* Копирование соседа slot узла уровня level + 1 (родитель уже скопирован) */
+static int cow_child(struct super_block* sb, struct mixfs_path* path, int level, int slot,
+                     struct buffer* buf) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    struct mixfs_ptr* ptr = &mixfs_node_ptrs(path->nodes[level + 1].data)[slot];
+
+    int err = mixfs_read_node(sb, ptr->blocknr, ptr->generation, buf);
+    if (err < 0) {
+        return err;
+    }
+    if (ptr->generation == sbi->transid) {
+        mark_buffer_dirty(buf);
+        return 0;
+    }
+
+    struct buffer copy;
+    err = alloc_node(sb, (uint8_t)level, &copy);
+    if (err < 0) {
+        brelse(buf);
+        return err;
+    }
+    memcpy(copy.data, buf->data, MIXFS_BLOCK_SIZE);
+    ((struct mixfs_node_header*)copy.data)->blocknr = copy.block;
+    ((struct mixfs_node_header*)copy.data)->generation = sbi->transid;
+    mixfs_free_blocks(sb, ptr->blocknr, 1, true);
+    ptr->blocknr = copy.block;
+    ptr->generation = sbi->transid;
+
+    brelse(buf);
+    *buf = copy;
+    return 0;
+}
+
+/* Обновление ключей предков после изменения наименьшего ключа узла level */
+static void fixup_low_keys(struct mixfs_path* path, const struct mixfs_key* key, int level) {
+    for (int i = level + 1; i < MIXFS_MAX_LEVEL && path->nodes[i].data; i++) {
+        mixfs_node_ptrs(path->nodes[i].data)[path->slots[i]].key = *key;
+        if (path->slots[i] != 0) {
+            break;
+        }
+    }
+}
+
+/* ============================================================================
+ * Вставка указателей и деление узлов
+ * ============================================================================ */
+
+static void insert_ptr(struct mixfs_path* path, int level, int slot,
+                       const struct mixfs_key* key, uint64_t blocknr, uint64_t generation) {
+    struct mixfs_node_header* node = path->nodes[level].data;
+    struct mixfs_ptr* ptrs = mixfs_node_ptrs(node);
+
+    memmove(&ptrs[slot + 1], &ptrs[slot], (node->nritems - slot) * sizeof(*ptrs));
+    ptrs[slot].key = *key;
+    ptrs[slot].blocknr = blocknr;
+    ptrs[slot].generation = generation;
+    node->nritems++;
+    mark_buffer_dirty(&path->nodes[level]);
+}
+
+/* Новый корень над текущим: дерево вырастает на уровень */
+static int grow_root(struct super_block* sb, struct mixfs_path* path) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    int level = (int)sbi->root_level + 1;
+
+    if (level >= MIXFS_MAX_LEVEL) {
+        return -ENOSPC;
+    }
+    struct buffer root;
+    int err = alloc_node(sb, (uint8_t)level, &root);
+    if (err < 0) {
+        return err;
+    }
+    struct mixfs_node_header* child = path->nodes[level - 1].data;
+    path->nodes[level] = root;
+    path->slots[level] = 0;
+    insert_ptr(path, level, 0, node_first_key(child), child->blocknr, child->generation);
+
+    sbi->root = root.block;
+    sbi->root_level = (uint32_t)level;
+    return 0;
+}
+
+/* Деление внутреннего узла пополам перед спуском через него */
+static int split_node(struct super_block* sb, struct mixfs_path* path, int level,
+                      const struct mixfs_key* key) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    if ((uint32_t)level == sbi->root_level) {
+        int err = grow_root(sb, path);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    struct buffer right_buf;
+    int err = alloc_node(sb, (uint8_t)level, &right_buf);
+    if (err < 0) {
+        return err;
+    }
+    struct mixfs_node_header* left = path->nodes[level].data;
+    struct mixfs_node_header* right = right_buf.data;
+    uint32_t mid = left->nritems / 2;
+
+    right->nritems = (uint16_t)(left->nritems - mid);
+    memcpy(mixfs_node_ptrs(right), &mixfs_node_ptrs(left)[mid],
+           right->nritems * sizeof(struct mixfs_ptr));
+    left->nritems = (uint16_t)mid;
+
+    insert_ptr(path, level + 1, path->slots[level + 1] + 1, node_first_key(right),
+               right_buf.block, sbi->transid);
+
+    if (mixfs_key_cmp(key, node_first_key(right)) >= 0) {
+        brelse(&path->nodes[level]);
+        path->nodes[level] = right_buf;
+        path->slots[level + 1]++;
+    } else {
+        brelse(&right_buf);
+    }
+    return 0;
+}
+
+/* Перенос элементов [from, nritems) листа src в конец листа dst */
+static void move_leaf_items(struct mixfs_node_header* dst, struct mixfs_node_header* src,
+                            uint32_t from) {
+    struct mixfs_item* src_items = mixfs_leaf_items(src);
+    struct mixfs_item* dst_items = mixfs_leaf_items(dst);
+
+    for (uint32_t i = from; i < src->nritems; i++) {
+        uint32_t end = leaf_data_end(dst);
+        struct mixfs_item* item = &dst_items[dst->nritems];
+        item->key = src_items[i].key;
+        item->size = src_items[i].size;
+        item->offset = end - item->size;
+        memcpy((uint8_t*)dst + item->offset, (uint8_t*)src + src_items[i].offset, item->size);
+        dst->nritems++;
+    }
+}
+
+/*
+ * Деление листа: элементы делятся примерно поровну по занимаемому месту,
+ * путь переводится в ту половину, куда попадает позиция вставки (found -
+ * путь указывает на существующий элемент, который будет увеличен).
+ */
+static int split_leaf(struct super_block* sb, struct mixfs_path* path, uint32_t need, bool found) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    if (sbi->root_level == 0) {
+        int err = grow_root(sb, path);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    struct mixfs_node_header* left = path->nodes[0].data;
+    struct mixfs_item* items = mixfs_leaf_items(left);
+    uint32_t total = leaf_used_space(left);
+    uint32_t used = 0;
+    uint32_t mid = 1;
+    for (uint32_t i = 0; i < left->nritems; i++) {
+        used += items[i].size + sizeof(struct mixfs_item);
+        if (used >= total / 2) {
+            mid = i + 1;
+            break;
+        }
+    }
+    mid = MIN(mid, (uint32_t)left->nritems - 1);
+    if (mid == 0) {
+        mid = 1;
+    }
+
+    struct buffer right_buf;
+    int err = alloc_node(sb, 0, &right_buf);
+    if (err < 0) {
+        return err;
+    }
+    struct mixfs_node_header* right = right_buf.data;
+    /* Данные оставшихся элементов уже лежат подряд в конце блока */
+    move_leaf_items(right, left, mid);
+    left->nritems = (uint16_t)mid;
+
+    insert_ptr(path, 1, path->slots[1] + 1, node_first_key(right), right_buf.block,
+               sbi->transid);
+
+    int slot = path->slots[0];
+    bool to_right = found ? (uint32_t)slot >= mid
+                          : (uint32_t)slot > mid || ((uint32_t)slot == mid && leaf_free_space(left) < need);
+    if (to_right) {
+        brelse(&path->nodes[0]);
+        path->nodes[0] = right_buf;
+        path->slots[0] = slot - (int)mid;
+        path->slots[1]++;
+    } else {
+        brelse(&right_buf);
+    }
+    if (leaf_free_space(path->nodes[0].data) < need) {
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Поиск
+ * ============================================================================ */
+
+/* Позиция в листе: 0 - ключ найден, 1 - позиция вставки */
+static int leaf_search(struct mixfs_node_header* leaf, const struct mixfs_key* key, int* slot) {
+    struct mixfs_item* items = mixfs_leaf_items(leaf);
+    int lo = 0, hi = leaf->nritems;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = mixfs_key_cmp(&items[mid].key, key);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else if (cmp > 0) {
+            hi = mid;
+        } else {
+            *slot = mid;
+            return 0;
+        }
+    }
+    *slot = lo;
+    return 1;
+}
+
+/* Последний указатель с ключом <= key (или первый, если таких нет) */
+static int node_search(struct mixfs_node_header* node, const struct mixfs_key* key) {
+    struct mixfs_ptr* ptrs = mixfs_node_ptrs(node);
+    int lo = 0, hi = node->nritems;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (mixfs_key_cmp(&ptrs[mid].key, key) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo ? lo - 1 : 0;
+}
+
+/*
+ * Поиск ключа. Возвращает 0, если элемент найден (path->slots[0] - его
+ * позиция), 1, если нет (позиция вставки), или ошибку. Путь нужно
+ * освободить в любом случае.
+ */
+int mixfs_search(struct super_block* sb, const struct mixfs_key* key, struct mixfs_path* path,
+                 int ins_len, bool cow) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    int level = (int)sbi->root_level;
+
+    mixfs_path_release(path);
+    mixfs_path_init(path);
+
+    int err = mixfs_read_node(sb, sbi->root, 0, &path->nodes[level]);
+    if (err < 0) {
+        return err;
+    }
+    if (((struct mixfs_node_header*)path->nodes[level].data)->level != level) {
+        return -EFSCORRUPTED;
+    }
+    if (cow) {
+        err = cow_node(sb, path, level);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    while (level > 0) {
+        struct mixfs_node_header* node = path->nodes[level].data;
+        if (cow && ins_len > 0 && node->nritems >= MIXFS_NODE_PTRS - 1) {
+            err = split_node(sb, path, level, key);
+            if (err < 0) {
+                return err;
+            }
+            node = path->nodes[level].data;
+        }
+        if (node->nritems == 0) {
+            return -EFSCORRUPTED;
+        }
+
+        int slot = node_search(node, key);
+        path->slots[level] = slot;
+        struct mixfs_ptr* ptr = &mixfs_node_ptrs(node)[slot];
+        err = mixfs_read_node(sb, ptr->blocknr, ptr->generation, &path->nodes[level - 1]);
+        if (err < 0) {
+            return err;
+        }
+        if (((struct mixfs_node_header*)path->nodes[level - 1].data)->level != level - 1) {
+            return -EFSCORRUPTED;
+        }
+        level--;
+        if (cow) {
+            err = cow_node(sb, path, level);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+
+    int ret = leaf_search(path->nodes[0].data, key, &path->slots[0]);
+    if (cow && ins_len > 0) {
+        uint32_t need = (uint32_t)ins_len + (ret ? sizeof(struct mixfs_item) : 0);
+        if (leaf_free_space(path->nodes[0].data) < need) {
+            err = split_leaf(sb, path, need, ret == 0);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+    return ret;
+}
+
+/* Переход к следующему элементу (только для путей без копирования). 1 - конец */
+int mixfs_next_item(struct super_block* sb, struct mixfs_path* path) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    struct mixfs_node_header* leaf = path->nodes[0].data;
+
+    if (++path->slots[0] < leaf->nritems) {
+        return 0;
+    }
+
+    int level = 1;
+    while ((uint32_t)level <= sbi->root_level) {
+        struct mixfs_node_header* node = path->nodes[level].data;
+        if (path->slots[level] + 1 < node->nritems) {
+            break;
+        }
+        level++;
+    }
+    if ((uint32_t)level > sbi->root_level) {
+        path->slots[0] = leaf->nritems;
+        return 1;
+    }
+
+    path->slots[level]++;
+    for (; level > 0; level--) {
+        struct mixfs_ptr* ptr = &mixfs_node_ptrs(path->nodes[level].data)[path->slots[level]];
+        struct buffer child;
+        int err = mixfs_read_node(sb, ptr->blocknr, ptr->generation, &child);
+        if (err < 0) {
+            return err;
+        }
+        brelse(&path->nodes[level - 1]);
+        path->nodes[level - 1] = child;
+        path->slots[level - 1] = 0;
+    }
+    return ((struct mixfs_node_header*)path->nodes[0].data)->nritems ? 0 : 1;
+}
+
+/* ============================================================================
+ * Элементы листа
+ * ============================================================================ */
+
+void mixfs_mark_leaf_dirty(struct mixfs_path* path) {
+    mark_buffer_dirty(&path->nodes[0]);
+}
+
+/* Вставка пустого элемента в позицию path->slots[0] (место обеспечено поиском) */
+int mixfs_insert_item(struct super_block* sb, struct mixfs_path* path,
+                      const struct mixfs_key* key, uint32_t size) {
+    (void)sb;
+    struct mixfs_node_header* leaf = path->nodes[0].data;
+    struct mixfs_item* items = mixfs_leaf_items(leaf);
+    int slot = path->slots[0];
+
+    if (size > MIXFS_MAX_ITEM_SIZE) {
+        return -ENAMETOOLONG;
+    }
+    if (leaf_free_space(leaf) < size + sizeof(struct mixfs_item)) {
+        return -ENOSPC;
+    }
+
+    uint32_t data_end = leaf_data_end(leaf);
+    uint32_t offset;
+    if (slot < leaf->nritems) {
+        uint32_t old_end = items[slot].offset + items[slot].size;
+        memmove((uint8_t*)leaf + data_end - size, (uint8_t*)leaf + data_end, old_end - data_end);
+        for (int i = slot; i < leaf->nritems; i++) {
+            items[i].offset -= size;
+        }
+        memmove(&items[slot + 1], &items[slot], (leaf->nritems - slot) * sizeof(*items));
+        offset = old_end - size;
+    } else {
+        offset = data_end - size;
+    }
+
+    items[slot].key = *key;
+    items[slot].offset = offset;
+    items[slot].size = size;
+    leaf->nritems++;
+    memset((uint8_t*)leaf + offset, 0, size);
+    mark_buffer_dirty(&path->nodes[0]);
+
+    if (slot == 0) {
+        fixup_low_keys(path, key, 0);
+    }
+    return 0;
+}
+
+int mixfs_insert(struct super_block* sb, const struct mixfs_key* key, const void* data,
+                 uint32_t size) {
+    struct mixfs_path path;
+    mixfs_path_init(&path);
+
+    int err = mixfs_search(sb, key, &path, (int)size, true);
+    if (err == 0) {
+        err = -EEXIST;
+    } else if (err == 1) {
+        err = mixfs_insert_item(sb, &path, key, size);
+        if (err == 0) {
+            memcpy(mixfs_path_data(&path), data, size);
+        }
+    }
+    mixfs_path_release(&path);
+    return err;
+}
+
+/* Увеличение элемента на extra байт в конце (место обеспечено поиском) */
+void mixfs_extend_item(struct mixfs_path* path, uint32_t extra) {
+    struct mixfs_node_header* leaf = path->nodes[0].data;
+    struct mixfs_item* items = mixfs_leaf_items(leaf);
+    int slot = path->slots[0];
+    uint32_t data_end = leaf_data_end(leaf);
+    uint32_t old_end = items[slot].offset + items[slot].size;
+
+    memmove((uint8_t*)leaf + data_end - extra, (uint8_t*)leaf + data_end, old_end - data_end);
+    for (int i = slot; i < leaf->nritems; i++) {
+        items[i].offset -= extra;
+    }
+    items[slot].size += extra;
+    memset((uint8_t*)leaf + old_end - extra, 0, extra);
+    mark_buffer_dirty(&path->nodes[0]);
+}
+
+/* Усечение элемента до new_size байт (сохраняется начало данных) */
+void mixfs_shrink_item(struct mixfs_path* path, uint32_t new_size) {
+    struct mixfs_node_header* leaf = path->nodes[0].data;
+    struct mixfs_item* items = mixfs_leaf_items(leaf);
+    int slot = path->slots[0];
+    uint32_t data_end = leaf_data_end(leaf);
+    uint32_t diff = items[slot].size - new_size;
+    uint32_t keep_end = items[slot].offset + new_size;
+
+    memmove((uint8_t*)leaf + data_end + diff, (uint8_t*)leaf + data_end, keep_end - data_end);
+    for (int i = slot; i < leaf->nritems; i++) {
+        items[i].offset += diff;
+    }
+    items[slot].size = new_size;
+    mark_buffer_dirty(&path->nodes[0]);
+}
+
+/* ============================================================================
+ * Удаление
+ * ============================================================================ */
+
+static int del_ptr(struct super_block* sb, struct mixfs_path* path, int level, int slot);
+
+/* Пустой узел уровня level удаляется из родителя */
+static int remove_node(struct super_block* sb, struct mixfs_path* path, int level) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    struct mixfs_node_header* node = path->nodes[level].data;
+
+    if ((uint32_t)level == sbi->root_level) {
+        /* Опустевший корень становится пустым листом */
+        node->level = 0;
+        sbi->root_level = 0;
+        mark_buffer_dirty(&path->nodes[level]);
+        return 0;
+    }
+    uint64_t blocknr = node->blocknr;
+    brelse(&path->nodes[level]);
+    mixfs_free_blocks(sb, blocknr, 1, true);
+    return del_ptr(sb, path, level + 1, path->slots[level + 1]);
+}
+
+/* Слияние недозаполненного узла с соседом, если вместе они помещаются в блок */
+static int try_merge(struct super_block* sb, struct mixfs_path* path, int level) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    struct mixfs_node_header* node = path->nodes[level].data;
+
+    if ((uint32_t)level == sbi->root_level) {
+        return 0;
+    }
+    bool leaf = level == 0;
+    uint32_t used = leaf ? leaf_used_space(node) : node->nritems * (uint32_t)sizeof(struct mixfs_ptr);
+    if (used >= MIXFS_LEAF_SPACE / 4) {
+        return 0;
+    }
+
+    struct mixfs_node_header* parent = path->nodes[level + 1].data;
+    int slot = path->slots[level + 1];
+    int sibling_slot;
+    if (slot > 0) {
+        sibling_slot = slot - 1;
+    } else if (slot + 1 < parent->nritems) {
+        sibling_slot = slot + 1;
+    } else {
+        return 0;
+    }
+
+    /* Сосед копируется, только если слияние действительно возможно */
+    struct mixfs_ptr* sibling_ptr = &mixfs_node_ptrs(parent)[sibling_slot];
+    struct buffer sibling;
+    int err = mixfs_read_node(sb, sibling_ptr->blocknr, sibling_ptr->generation, &sibling);
+    if (err < 0) {
+        return err;
+    }
+    struct mixfs_node_header* sib = sibling.data;
+    bool fits = leaf ? used + leaf_used_space(sib) <= MIXFS_LEAF_SPACE
+                     : node->nritems + sib->nritems <= MIXFS_NODE_PTRS;
+    brelse(&sibling);
+    if (!fits) {
+        return 0;
+    }
+    err = cow_child(sb, path, level, sibling_slot, &sibling);
+    if (err < 0) {
+        return err;
+    }
+
+    /* Правый узел переносится в левый и удаляется из родителя */
+    struct mixfs_node_header* left = sibling_slot < slot ? sibling.data : node;
+    struct mixfs_node_header* right = sibling_slot < slot ? node : sibling.data;
+    int right_slot = MAX(slot, sibling_slot);
+    if (leaf) {
+        move_leaf_items(left, right, 0);
+    } else {
+        memcpy(&mixfs_node_ptrs(left)[left->nritems], mixfs_node_ptrs(right),
+               right->nritems * sizeof(struct mixfs_ptr));
+        left->nritems += right->nritems;
+    }
+    right->nritems = 0;
+    uint64_t right_block = right->blocknr;
+    brelse(&sibling);
+
+    mixfs_free_blocks(sb, right_block, 1, true);
+    path->slots[level + 1] = right_slot;
+    return del_ptr(sb, path, level + 1, right_slot);
+}
+
+static void collapse_root(struct super_block* sb) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    while (sbi->root_level > 0) {
+        struct buffer root;
+        if (mixfs_read_node(sb, sbi->root, 0, &root) < 0) {
+            return;
+        }
+        struct mixfs_node_header* node = root.data;
+        if (node->nritems != 1) {
+            brelse(&root);
+            return;
+        }
+        uint64_t old = sbi->root;
+        sbi->root = mixfs_node_ptrs(node)[0].blocknr;
+        sbi->root_level--;
+        brelse(&root);
+        mixfs_free_blocks(sb, old, 1, true);
+    }
+}
+
+static int del_ptr(struct super_block* sb, struct mixfs_path* path, int level, int slot) {
+    struct mixfs_node_header* node = path->nodes[level].data;
+    struct mixfs_ptr* ptrs = mixfs_node_ptrs(node);
+
+    memmove(&ptrs[slot], &ptrs[slot + 1], (node->nritems - slot - 1) * sizeof(*ptrs));
+    node->nritems--;
+    mark_buffer_dirty(&path->nodes[level]);
+
+    if (node->nritems == 0) {
+        return remove_node(sb, path, level);
+    }
+    if (slot == 0) {
+        fixup_low_keys(path, &ptrs[0].key, level);
+    }
+    return try_merge(sb, path, level);
+}
+
+/*
+ * Удаление элемента path->slots[0] (путь получен поиском с cow = true).
+ * После удаления путь недействителен.
+ */
+int mixfs_del_item(struct super_block* sb, struct mixfs_path* path) {
+    struct mixfs_node_header* leaf = path->nodes[0].data;
+    struct mixfs_item* items = mixfs_leaf_items(leaf);
+    int slot = path->slots[0];
+    uint32_t size = items[slot].size;
+    uint32_t data_end = leaf_data_end(leaf);
+
+    memmove((uint8_t*)leaf + data_end + size, (uint8_t*)leaf + data_end,
+            items[slot].offset - data_end);
+    for (int i = slot + 1; i < leaf->nritems; i++) {
+        items[i].offset += size;
+    }
+    memmove(&items[slot], &items[slot + 1], (leaf->nritems - slot - 1) * sizeof(*items));
+    leaf->nritems--;
+    mark_buffer_dirty(&path->nodes[0]);
+
+    int err;
+    if (leaf->nritems == 0) {
+        err = remove_node(sb, path, 0);
+    } else {
+        if (slot == 0) {
+            fixup_low_keys(path, &items[0].key, 0);
+        }
+        err = try_merge(sb, path, 0);
+    }
+    collapse_root(sb);
+    return err;
+}
+
+/* ============================================================================
+ * Фиксация
+ * ============================================================================ */
+
+static void checksum_subtree(struct super_block* sb, uint64_t blocknr) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    struct buffer buf;
+
+    if (mixfs_read_node(sb, blocknr, sbi->transid, &buf) < 0) {
+        return;
+    }
+    struct mixfs_node_header* node = buf.data;
+    if (node->level) {
+        struct mixfs_ptr* ptrs = mixfs_node_ptrs(node);
+        for (uint32_t i = 0; i < node->nritems; i++) {
+            if (ptrs[i].generation == sbi->transid) {
+                checksum_subtree(sb, ptrs[i].blocknr);
+            }
+        }
+    }
+    node->csum = mixfs_block_csum(node);
+    mark_buffer_dirty(&buf);
+    brelse(&buf);
+}
+
+/* Контрольные суммы узлов, созданных в текущей транзакции */
+void mixfs_tree_checksum(struct super_block* sb) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    struct buffer root;
+
+    if (mixfs_read_node(sb, sbi->root, 0, &root) < 0) {
+        return;
+    }
+    bool modified = ((struct mixfs_node_header*)root.data)->generation == sbi->transid;
+    brelse(&root);
+    if (modified) {
+        checksum_subtree(sb, sbi->root);
+    }
+}
@@ -0,0 +1,390 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/mixfs/dir.c
+ * MixFS: каталоги
+ *
+ * Имя хранится в дереве дважды: DIR_ITEM с ключом по хешу имени служит
+ * для поиска, DIR_INDEX с возрастающим номером - для readdir, чтобы
+ * позиция в каталоге не менялась при удалении соседних записей. "." и ".."
+ * не хранятся: родитель записан в элементе inode каталога.
+ * ============================================================================
+ */
+
+#include "fs/mixfs/mixfs.h"
+#include "errno.h"
+
+static bool is_dot_or_dotdot(const char* name, size_t len) {
+    return (len == 1 && name[0] == '.') || (len == 2 && name[0] == '.' && name[1] == '.');
+}
+
+static uint8_t mixfs_file_type(uint32_t mode) {
+    if (S_ISDIR(mode)) {
+        return MIXFS_FT_DIR;
+    }
+    if (S_ISREG(mode)) {
+        return MIXFS_FT_REG;
+    }
+    if (S_ISLNK(mode)) {
+        return MIXFS_FT_LNK;
+    }
+    return MIXFS_FT_UNKNOWN;
+}
+
+/* Запись с именем name в данных элемента DIR_ITEM или NULL */
+static struct mixfs_dir_entry* mixfs_match_entry(void* data, uint32_t size,
+                                                 const char* name, size_t len) {
+    uint32_t offset = 0;
+    while (offset + sizeof(struct mixfs_dir_entry) <= size) {
+        struct mixfs_dir_entry* de = (struct mixfs_dir_entry*)((uint8_t*)data + offset);
+        uint32_t rec_len = MIXFS_DIR_ENTRY_LEN(de->name_len);
+        if (offset + rec_len > size) {
+            break;
+        }
+        if (de->name_len == len && memcmp(de->name, name, len) == 0) {
+            return de;
+        }
+        offset += rec_len;
+    }
+    return NULL;
+}
+
+static void mixfs_fill_entry(struct mixfs_dir_entry* de, const char* name, size_t len,
+                             uint64_t ino, uint64_t index, uint8_t type) {
+    memset(de, 0, MIXFS_DIR_ENTRY_LEN(len));
+    de->ino = ino;
+    de->index = index;
+    de->name_len = (uint16_t)len;
+    de->type = type;
+    memcpy(de->name, name, len);
+}
+
+/* Поиск записи: ino и номер DIR_INDEX */
+static int mixfs_find_entry(struct inode* dir, const char* name, size_t len,
+                            uint64_t* ino, uint64_t* index) {
+    struct mixfs_path path;
+    struct mixfs_key key;
+
+    mixfs_set_key(&key, dir->ino, MIXFS_DIR_ITEM, mixfs_name_hash(name, len));
+    mixfs_path_init(&path);
+    int err = mixfs_search(dir->sb, &key, &path, 0, false);
+    if (err == 0) {
+        struct mixfs_dir_entry* de = mixfs_match_entry(mixfs_path_data(&path),
+                                                       mixfs_path_item(&path)->size, name, len);
+        if (de) {
+            *ino = de->ino;
+            *index = de->index;
+        } else {
+            err = -ENOENT;
+        }
+    } else if (err == 1) {
+        err = -ENOENT;
+    }
+    mixfs_path_release(&path);
+    return err;
+}
+
+static int mixfs_add_entry(struct inode* dir, const char* name, size_t len, struct inode* inode) {
+    struct super_block* sb = dir->sb;
+    struct mixfs_inode_info* di = MIXFS_I(dir);
+    uint32_t rec_len = MIXFS_DIR_ENTRY_LEN(len);
+    uint64_t index = di->next_index;
+    uint8_t type = mixfs_file_type(inode->mode);
+    struct mixfs_path path;
+    struct mixfs_key key;
+
+    if (is_dot_or_dotdot(name, len)) {
+        return -EEXIST;
+    }
+
+    /* DIR_ITEM: имена с одинаковым хешем дописываются в один элемент */
+    mixfs_set_key(&key, dir->ino, MIXFS_DIR_ITEM, mixfs_name_hash(name, len));
+    mixfs_path_init(&path);
+    int err = mixfs_search(sb, &key, &path, (int)rec_len, true);
+    if (err == 0) {
+        struct mixfs_item* item = mixfs_path_item(&path);
+        if (mixfs_match_entry(mixfs_path_data(&path), item->size, name, len)) {
+            err = -EEXIST;
+        } else if (item->size + rec_len > MIXFS_MAX_ITEM_SIZE) {
+            err = -ENOSPC;
+        } else {
+            uint32_t old_size = item->size;
+            mixfs_extend_item(&path, rec_len);
+            mixfs_fill_entry((struct mixfs_dir_entry*)((uint8_t*)mixfs_path_data(&path) + old_size),
+                             name, len, inode->ino, index, type);
+        }
+    } else if (err == 1) {
+        err = mixfs_insert_item(sb, &path, &key, rec_len);
+        if (err == 0) {
+            mixfs_fill_entry(mixfs_path_data(&path), name, len, inode->ino, index, type);
+        }
+    }
+    mixfs_path_release(&path);
+    if (err < 0) {
+        return err;
+    }
+
+    /* DIR_INDEX: та же запись под порядковым номером */
+    uint8_t buffer[MIXFS_DIR_ENTRY_LEN(MIXFS_NAME_MAX)];
+    mixfs_fill_entry((struct mixfs_dir_entry*)buffer, name, len, inode->ino, index, type);
+    mixfs_set_key(&key, dir->ino, MIXFS_DIR_INDEX, index);
+    err = mixfs_insert(sb, &key, buffer, rec_len);
+    if (err < 0) {
+        return err;
+    }
+
+    di->next_index++;
+    dir->size++;
+    dir->mtime = dir->ctime = (uint32_t)mixfs_current_time(sb);
+    mark_inode_dirty(dir);
+    return 0;
+}
+
+static int mixfs_delete_entry(struct inode* dir, const char* name, size_t len, uint64_t index) {
+    struct super_block* sb = dir->sb;
+    struct mixfs_path path;
+    struct mixfs_key key;
+
+    mixfs_set_key(&key, dir->ino, MIXFS_DIR_ITEM, mixfs_name_hash(name, len));
+    mixfs_path_init(&path);
+    int err = mixfs_search(sb, &key, &path, 0, true);
+    if (err == 1) {
+        err = -EFSCORRUPTED;
+    }
+    if (err == 0) {
+        struct mixfs_item* item = mixfs_path_item(&path);
+        uint8_t* data = mixfs_path_data(&path);
+        struct mixfs_dir_entry* de = mixfs_match_entry(data, item->size, name, len);
+        uint32_t rec_len = MIXFS_DIR_ENTRY_LEN(len);
+        if (!de) {
+            err = -EFSCORRUPTED;
+        } else if (item->size == rec_len) {
+            err = mixfs_del_item(sb, &path);
+        } else {
+            uint32_t offset = (uint32_t)((uint8_t*)de - data);
+            memmove(data + offset, data + offset + rec_len, item->size - offset - rec_len);
+            mixfs_shrink_item(&path, item->size - rec_len);
+        }
+    }
+    mixfs_path_release(&path);
+    if (err < 0) {
+        return err;
+    }
+
+    mixfs_set_key(&key, dir->ino, MIXFS_DIR_INDEX, index);
+    mixfs_path_init(&path);
+    err = mixfs_search(sb, &key, &path, 0, true);
+    if (err == 0) {
+        err = mixfs_del_item(sb, &path);
+    } else if (err == 1) {
+        err = -EFSCORRUPTED;
+    }
+    mixfs_path_release(&path);
+    if (err < 0) {
+        return err;
+    }
+
+    dir->size--;
+    dir->mtime = dir->ctime = (uint32_t)mixfs_current_time(sb);
+    mark_inode_dirty(dir);
+    return 0;
+}
+
+/* ============================================================================
+ * Операции каталога
+ * ============================================================================ */
+
+static int mixfs_lookup(struct inode* dir, const char* name, size_t len, struct inode** out) {
+    uint64_t ino, index;
+
+    if (len == 2 && name[0] == '.' && name[1] == '.') {
+        return iget(dir->sb, MIXFS_I(dir)->parent, out);
+    }
+    int err = mixfs_find_entry(dir, name, len, &ino, &index);
+    if (err < 0) {
+        return err;
+    }
+    return iget(dir->sb, ino, out);
+}
+
+static int mixfs_create(struct inode* dir, const char* name, size_t len,
+                        uint32_t mode, struct inode** out) {
+    struct inode* inode;
+    int err = mixfs_new_inode(dir, mode, &inode);
+    if (err < 0) {
+        return err;
+    }
+    inode->nlink = 1;
+    mark_inode_dirty(inode);
+
+    err = mixfs_add_entry(dir, name, len, inode);
+    if (err < 0) {
+        inode->nlink = 0;
+        iput(inode);
+        return err;
+    }
+    *out = inode;
+    return 0;
+}
+
+static int mixfs_mkdir(struct inode* dir, const char* name, size_t len,
+                       uint32_t mode, struct inode** out) {
+    struct inode* inode;
+    int err = mixfs_new_inode(dir, mode, &inode);
+    if (err < 0) {
+        return err;
+    }
+    inode->nlink = 2;
+    mark_inode_dirty(inode);
+
+    err = mixfs_add_entry(dir, name, len, inode);
+    if (err < 0) {
+        inode->nlink = 0;
+        iput(inode);
+        return err;
+    }
+    dir->nlink++;
+    mark_inode_dirty(dir);
+    *out = inode;
+    return 0;
+}
+
+static int mixfs_unlink(struct inode* dir, const char* name, size_t len) {
+    uint64_t ino, index;
+    int err = mixfs_find_entry(dir, name, len, &ino, &index);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode;
+    err = iget(dir->sb, ino, &inode);
+    if (err < 0) {
+        return err;
+    }
+    if (S_ISDIR(inode->mode)) {
+        iput(inode);
+        return -EISDIR;
+    }
+    err = mixfs_delete_entry(dir, name, len, index);
+    if (err < 0) {
+        iput(inode);
+        return err;
+    }
+
+    if (inode->nlink) {
+        inode->nlink--;
+    }
+    inode->ctime = dir->ctime;
+    mark_inode_dirty(inode);
+    iput(inode);
+    return 0;
+}
+
+static int mixfs_rmdir(struct inode* dir, const char* name, size_t len) {
+    if (is_dot_or_dotdot(name, len)) {
+        return -EINVAL;
+    }
+
+    uint64_t ino, index;
+    int err = mixfs_find_entry(dir, name, len, &ino, &index);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode;
+    err = iget(dir->sb, ino, &inode);
+    if (err < 0) {
+        return err;
+    }
+    if (!S_ISDIR(inode->mode)) {
+        iput(inode);
+        return -ENOTDIR;
+    }
+    if (inode->size != 0) {
+        iput(inode);
+        return -ENOTEMPTY;
+    }
+    err = mixfs_delete_entry(dir, name, len, index);
+    if (err < 0) {
+        iput(inode);
+        return err;
+    }
+
+    inode->nlink = 0;
+    mark_inode_dirty(inode);
+    dir->nlink--;
+    mark_inode_dirty(dir);
+    iput(inode);
+    return 0;
+}
+
+/* Позиция: 0 - ".", 1 - "..", далее номер следующего DIR_INDEX */
+static int mixfs_readdir(struct file* file, filldir_t filldir, void* ctx) {
+    struct inode* dir = file->inode;
+    struct super_block* sb = dir->sb;
+
+    if (file->pos == 0) {
+        if (filldir(ctx, ".", 1, dir->ino, DT_DIR)) {
+            return 0;
+        }
+        file->pos = 1;
+    }
+    if (file->pos == 1) {
+        if (filldir(ctx, "..", 2, MIXFS_I(dir)->parent, DT_DIR)) {
+            return 0;
+        }
+        file->pos = MIXFS_FIRST_DIR_INDEX;
+    }
+
+    struct mixfs_path path;
+    struct mixfs_key key;
+    mixfs_set_key(&key, dir->ino, MIXFS_DIR_INDEX, file->pos);
+    mixfs_path_init(&path);
+    int err = mixfs_search(sb, &key, &path, 0, false);
+    if (err == 1 && path.slots[0] >= mixfs_path_node(&path, 0)->nritems) {
+        path.slots[0]--;
+        err = mixfs_next_item(sb, &path);
+        if (err == 1) {
+            mixfs_path_release(&path);
+            return 0;
+        }
+    }
+
+    while (err >= 0) {
+        struct mixfs_item* item = mixfs_path_item(&path);
+        if (item->key.objectid != dir->ino || item->key.type != MIXFS_DIR_INDEX) {
+            err = 0;
+            break;
+        }
+        struct mixfs_dir_entry* de = mixfs_path_data(&path);
+        if (item->size < sizeof(*de) || MIXFS_DIR_ENTRY_LEN(de->name_len) > item->size) {
+            err = -EFSCORRUPTED;
+            break;
+        }
+        if (filldir(ctx, de->name, de->name_len, de->ino, de->type)) {
+            err = 0;
+            break;
+        }
+        file->pos = item->key.offset + 1;
+
+        err = mixfs_next_item(sb, &path);
+        if (err == 1) {
+            err = 0;
+            break;
+        }
+    }
+    mixfs_path_release(&path);
+    return err;
+}
+
+const struct inode_operations mixfs_dir_inode_operations = {
+    .lookup = mixfs_lookup,
+    .create = mixfs_create,
+    .mkdir = mixfs_mkdir,
+    .unlink = mixfs_unlink,
+    .rmdir = mixfs_rmdir,
+};
+
+const struct file_operations mixfs_dir_operations = {
+    .readdir = mixfs_readdir,
+    .fsync = generic_file_fsync,
+};
@@ -0,0 +1,654 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/mixfs/inode.c
+ * MixFS: inode, экстенты файлов, отложенная запись данных
+ *
+ * Грязная страница файла держит резерв в один блок (page->private), блоки
+ * выделяются только в writepages: грязные страницы сортируются, и каждая
+ * серия подряд идущих страниц получает непрерывный участок диска и один
+ * экстент. Перезапись тоже получает новые блоки, старые освобождаются.
+ * ============================================================================
+ */
+
+#include "fs/mixfs/mixfs.h"
+#include "errno.h"
+
+/* Страниц за один проход writepages */
+#define MIXFS_WRITEPAGES_BATCH  128
+
+/* page->private страницы файла: место под страницу зарезервировано */
+#define MIXFS_PAGE_RESERVED     1
+
+static const struct inode_operations mixfs_special_inode_operations = { 0 };
+
+static void mixfs_set_inode_ops(struct inode* inode) {
+    if (S_ISREG(inode->mode)) {
+        inode->i_op = &mixfs_file_inode_operations;
+        inode->f_op = &mixfs_file_operations;
+        inode->mapping.a_ops = &mixfs_aops;
+    } else if (S_ISDIR(inode->mode)) {
+        inode->i_op = &mixfs_dir_inode_operations;
+        inode->f_op = &mixfs_dir_operations;
+    } else {
+        inode->i_op = &mixfs_special_inode_operations;
+        inode->f_op = NULL;
+    }
+}
+
+/* ============================================================================
+ * Элемент inode
+ * ============================================================================ */
+
+int mixfs_read_inode(struct inode* inode) {
+    struct mixfs_inode_info* ei = MIXFS_I(inode);
+    struct mixfs_path path;
+    struct mixfs_key key;
+
+    mixfs_set_key(&key, inode->ino, MIXFS_INODE_ITEM, 0);
+    mixfs_path_init(&path);
+    int err = mixfs_search(inode->sb, &key, &path, 0, false);
+    if (err == 1) {
+        err = -ENOENT;
+    }
+    if (err == 0 && mixfs_path_item(&path)->size < sizeof(struct mixfs_inode_item)) {
+        err = -EFSCORRUPTED;
+    }
+    if (err < 0) {
+        mixfs_path_release(&path);
+        return err;
+    }
+
+    struct mixfs_inode_item* item = mixfs_path_data(&path);
+    inode->mode = item->mode;
+    inode->uid = item->uid;
+    inode->gid = item->gid;
+    inode->nlink = item->nlink;
+    inode->size = item->size;
+    inode->atime = (uint32_t)item->atime;
+    inode->mtime = (uint32_t)item->mtime;
+    inode->ctime = (uint32_t)item->ctime;
+    ei->blocks = item->blocks;
+    ei->generation = item->generation;
+    ei->parent = item->parent;
+    ei->next_index = item->next_index;
+    ei->flags = item->flags;
+    mixfs_path_release(&path);
+
+    mixfs_set_inode_ops(inode);
+    return 0;
+}
+
+static void mixfs_fill_inode_item(struct inode* inode, struct mixfs_inode_item* item) {
+    struct mixfs_inode_info* ei = MIXFS_I(inode);
+
+    memset(item, 0, sizeof(*item));
+    item->mode = inode->mode;
+    item->uid = inode->uid;
+    item->gid = inode->gid;
+    item->nlink = inode->nlink;
+    item->size = inode->size;
+    item->blocks = ei->blocks;
+    item->atime = inode->atime;
+    item->mtime = inode->mtime;
+    item->ctime = inode->ctime;
+    item->generation = ei->generation;
+    item->parent = ei->parent;
+    item->next_index = ei->next_index;
+    item->flags = ei->flags;
+}
+
+int mixfs_write_inode(struct inode* inode) {
+    struct mixfs_path path;
+    struct mixfs_key key;
+
+    mixfs_set_key(&key, inode->ino, MIXFS_INODE_ITEM, 0);
+    mixfs_path_init(&path);
+    int err = mixfs_search(inode->sb, &key, &path, 0, true);
+    if (err == 1) {
+        err = -EFSCORRUPTED;
+    }
+    if (err == 0) {
+        mixfs_fill_inode_item(inode, mixfs_path_data(&path));
+        mixfs_mark_leaf_dirty(&path);
+    }
+    mixfs_path_release(&path);
+    return err;
+}
+
+int mixfs_new_inode(struct inode* dir, uint32_t mode, struct inode** out) {
+    struct super_block* sb = dir->sb;
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    struct inode* inode = new_inode(sb, sbi->next_ino);
+    if (!inode) {
+        return -ENOMEM;
+    }
+    struct mixfs_inode_info* ei = MIXFS_I(inode);
+    sbi->next_ino++;
+    sbi->trans_dirty = true;
+
+    inode->mode = mode;
+    inode->atime = inode->mtime = inode->ctime = (uint32_t)mixfs_current_time(sb);
+    ei->generation = sbi->transid;
+    ei->parent = dir->ino;
+    ei->next_index = MIXFS_FIRST_DIR_INDEX;
+    mixfs_set_inode_ops(inode);
+
+    struct mixfs_inode_item item;
+    struct mixfs_key key;
+    mixfs_fill_inode_item(inode, &item);
+    mixfs_set_key(&key, inode->ino, MIXFS_INODE_ITEM, 0);
+    int err = mixfs_insert(sb, &key, &item, sizeof(item));
+    if (err < 0) {
+        iput(inode);
+        return err;
+    }
+    *out = inode;
+    return 0;
+}
+
+/* ============================================================================
+ * Экстенты
+ * ============================================================================ */
+
+static void mixfs_invalidate_extent_cache(struct inode* inode) {
+    MIXFS_I(inode)->cache_len = 0;
+}
+
+/*
+ * Первый экстент файла, содержащий блок fblock или лежащий за ним.
+ * Возвращает 0 (экстент найден), 1 (таких нет) или ошибку.
+ */
+static int mixfs_find_extent(struct inode* inode, uint64_t fblock, uint64_t* start,
+                             struct mixfs_extent_item* extent) {
+    struct mixfs_path path;
+    struct mixfs_key key;
+
+    mixfs_set_key(&key, inode->ino, MIXFS_EXTENT_ITEM, fblock);
+    mixfs_path_init(&path);
+    int ret = mixfs_search(inode->sb, &key, &path, 0, false);
+    if (ret < 0) {
+        mixfs_path_release(&path);
+        return ret;
+    }
+
+    /* Предшественник позиции вставки всегда в том же листе */
+    if (ret == 1 && path.slots[0] > 0) {
+        path.slots[0]--;
+        struct mixfs_item* item = mixfs_path_item(&path);
+        struct mixfs_extent_item* prev = mixfs_path_data(&path);
+        if (item->key.objectid == inode->ino && item->key.type == MIXFS_EXTENT_ITEM &&
+            item->key.offset + prev->nr_blocks > fblock) {
+            ret = 0;
+        } else {
+            path.slots[0]++;
+        }
+    }
+    if (ret == 1) {
+        /* Следующий элемент может оказаться в соседнем листе */
+        if (path.slots[0] >= mixfs_path_node(&path, 0)->nritems) {
+            path.slots[0]--;
+            ret = mixfs_next_item(inode->sb, &path);
+        } else {
+            ret = 0;
+        }
+        if (ret == 0) {
+            struct mixfs_item* item = mixfs_path_item(&path);
+            if (item->key.objectid != inode->ino || item->key.type != MIXFS_EXTENT_ITEM) {
+                ret = 1;
+            }
+        }
+    }
+    if (ret == 0) {
+        struct mixfs_item* item = mixfs_path_item(&path);
+        if (item->size < sizeof(*extent)) {
+            ret = -EFSCORRUPTED;
+        } else {
+            *start = item->key.offset;
+            *extent = *(struct mixfs_extent_item*)mixfs_path_data(&path);
+        }
+    }
+    mixfs_path_release(&path);
+    return ret;
+}
+
+/* Блок диска для блока файла fblock; 0 - дыра */
+static int mixfs_get_block(struct inode* inode, uint64_t fblock, uint64_t* dblock) {
+    struct mixfs_inode_info* ei = MIXFS_I(inode);
+
+    if (ei->cache_len && fblock >= ei->cache_fblock && fblock < ei->cache_fblock + ei->cache_len) {
+        *dblock = ei->cache_dblock + (fblock - ei->cache_fblock);
+        return 0;
+    }
+
+    uint64_t start;
+    struct mixfs_extent_item extent;
+    int err = mixfs_find_extent(inode, fblock, &start, &extent);
+    if (err < 0) {
+        return err;
+    }
+    if (err == 1 || start > fblock) {
+        *dblock = 0;
+        return 0;
+    }
+    ei->cache_fblock = start;
+    ei->cache_dblock = extent.disk_block;
+    ei->cache_len = extent.nr_blocks;
+    *dblock = extent.disk_block + (fblock - start);
+    return 0;
+}
+
+/* Удаление блоков файла [start, end) из экстентов с освобождением места */
+static int mixfs_drop_extents(struct inode* inode, uint64_t start, uint64_t end) {
+    struct super_block* sb = inode->sb;
+    struct mixfs_inode_info* ei = MIXFS_I(inode);
+
+    mixfs_invalidate_extent_cache(inode);
+    for (;;) {
+        uint64_t e_start;
+        struct mixfs_extent_item extent;
+        int err = mixfs_find_extent(inode, start, &e_start, &extent);
+        if (err < 0) {
+            return err;
+        }
+        if (err == 1 || e_start >= end) {
+            return 0;
+        }
+        uint64_t e_end = e_start + extent.nr_blocks;
+
+        struct mixfs_path path;
+        struct mixfs_key key;
+        mixfs_set_key(&key, inode->ino, MIXFS_EXTENT_ITEM, e_start);
+        mixfs_path_init(&path);
+        err = mixfs_search(sb, &key, &path, 0, true);
+        if (err != 0) {
+            mixfs_path_release(&path);
+            return err < 0 ? err : -EFSCORRUPTED;
+        }
+
+        uint64_t cut_start = MAX(e_start, start);
+        uint64_t cut_end = MIN(e_end, end);
+        struct mixfs_extent_item* item = mixfs_path_data(&path);
+        if (e_start < start) {
+            /* Начало экстента остаётся на месте */
+            item->nr_blocks = start - e_start;
+            mixfs_mark_leaf_dirty(&path);
+            mixfs_path_release(&path);
+        } else {
+            err = mixfs_del_item(sb, &path);
+            mixfs_path_release(&path);
+            if (err < 0) {
+                return err;
+            }
+        }
+        if (e_end > end) {
+            /* Хвост экстента за концом диапазона становится отдельным экстентом */
+            struct mixfs_extent_item tail = {
+                .disk_block = extent.disk_block + (end - e_start),
+                .nr_blocks = e_end - end,
+            };
+            mixfs_set_key(&key, inode->ino, MIXFS_EXTENT_ITEM, end);
+            err = mixfs_insert(sb, &key, &tail, sizeof(tail));
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        mixfs_free_blocks(sb, extent.disk_block + (cut_start - e_start), cut_end - cut_start, false);
+        ei->blocks -= cut_end - cut_start;
+        start = cut_end;
+    }
+}
+
+/* Блоки файла [fblock, fblock + count) теперь лежат в dblock... */
+static int mixfs_set_extent(struct inode* inode, uint64_t fblock, uint64_t dblock, uint64_t count) {
+    struct super_block* sb = inode->sb;
+    struct mixfs_inode_info* ei = MIXFS_I(inode);
+
+    int err = mixfs_drop_extents(inode, fblock, fblock + count);
+    if (err < 0) {
+        return err;
+    }
+
+    struct mixfs_path path;
+    struct mixfs_key key;
+    mixfs_set_key(&key, inode->ino, MIXFS_EXTENT_ITEM, fblock);
+    mixfs_path_init(&path);
+    err = mixfs_search(sb, &key, &path, sizeof(struct mixfs_extent_item), true);
+    if (err == 0) {
+        err = -EFSCORRUPTED;
+    }
+    if (err < 0) {
+        mixfs_path_release(&path);
+        return err;
+    }
+    err = 0;
+
+    /* Продолжение предыдущего экстента на диске просто удлиняет его */
+    bool merged = false;
+    if (path.slots[0] > 0) {
+        path.slots[0]--;
+        struct mixfs_item* item = mixfs_path_item(&path);
+        struct mixfs_extent_item* prev = mixfs_path_data(&path);
+        if (item->key.objectid == inode->ino && item->key.type == MIXFS_EXTENT_ITEM &&
+            item->key.offset + prev->nr_blocks == fblock &&
+            prev->disk_block + prev->nr_blocks == dblock) {
+            prev->nr_blocks += count;
+            mixfs_mark_leaf_dirty(&path);
+            ei->cache_fblock = item->key.offset;
+            ei->cache_dblock = prev->disk_block;
+            ei->cache_len = prev->nr_blocks;
+            merged = true;
+        } else {
+            path.slots[0]++;
+        }
+    }
+    if (!merged) {
+        err = mixfs_insert_item(sb, &path, &key, sizeof(struct mixfs_extent_item));
+        if (err == 0) {
+            struct mixfs_extent_item* extent = mixfs_path_data(&path);
+            extent->disk_block = dblock;
+            extent->nr_blocks = count;
+            ei->cache_fblock = fblock;
+            ei->cache_dblock = dblock;
+            ei->cache_len = count;
+        }
+    }
+    mixfs_path_release(&path);
+    if (err == 0) {
+        ei->blocks += count;
+    }
+    return err;
+}
+
+/* ============================================================================
+ * Page cache
+ * ============================================================================ */
+
+static int mixfs_readpage(struct address_space* mapping, struct page* page) {
+    struct inode* inode = mapping->host;
+    uint64_t dblock = 0;
+
+    if (page->index < DIV_ROUND_UP(inode->size, PAGE_SIZE)) {
+        int err = mixfs_get_block(inode, page->index, &dblock);
+        if (err < 0) {
+            return err;
+        }
+    }
+    if (dblock == 0) {
+        memset(page_address(page), 0, PAGE_SIZE);
+        return 0;
+    }
+    return block_read(inode->sb->bdev, mixfs_block_sector(dblock), MIXFS_SECTORS_PER_BLOCK,
+                      page_address(page));
+}
+
+/* Резерв места под грязную страницу (один раз, пока она не записана) */
+static int mixfs_reserve_page(struct inode* inode, struct page* page) {
+    if (page->private & MIXFS_PAGE_RESERVED) {
+        return 0;
+    }
+    int err = mixfs_reserve_blocks(inode->sb, 1);
+    if (err < 0) {
+        return err;
+    }
+    page->private |= MIXFS_PAGE_RESERVED;
+    MIXFS_I(inode)->reserved++;
+    return 0;
+}
+
+static void mixfs_unreserve_page(struct inode* inode, struct page* page) {
+    if (page->private & MIXFS_PAGE_RESERVED) {
+        page->private &= ~(uint64_t)MIXFS_PAGE_RESERVED;
+        MIXFS_I(inode)->reserved--;
+        mixfs_release_blocks(inode->sb, 1);
+    }
+}
+
+/* Место выделяется при сбросе страниц, здесь - только резерв */
+static int mixfs_write_begin(struct address_space* mapping, struct page* page,
+                             uint32_t from, uint32_t to) {
+    (void)from;
+    (void)to;
+    return mixfs_reserve_page(mapping->host, page);
+}
+
+static void mixfs_sift_down(struct page** pages, size_t root, size_t count) {
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= count) {
+            return;
+        }
+        if (child + 1 < count && pages[child + 1]->index > pages[child]->index) {
+            child++;
+        }
+        if (pages[root]->index >= pages[child]->index) {
+            return;
+        }
+        struct page* tmp = pages[root];
+        pages[root] = pages[child];
+        pages[child] = tmp;
+        root = child;
+    }
+}
+
+/* Пирамидальная сортировка по индексу: без рекурсии и дополнительной памяти */
+static void mixfs_sort_pages(struct page** pages, size_t count) {
+    for (size_t i = count / 2; i-- > 0; ) {
+        mixfs_sift_down(pages, i, count);
+    }
+    for (size_t end = count; end > 1; end--) {
+        struct page* tmp = pages[0];
+        pages[0] = pages[end - 1];
+        pages[end - 1] = tmp;
+        mixfs_sift_down(pages, 0, end - 1);
+    }
+}
+
+/* Запись серии страниц с подряд идущими индексами */
+static int mixfs_write_run(struct inode* inode, struct page** pages, size_t count) {
+    struct super_block* sb = inode->sb;
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    struct mixfs_inode_info* ei = MIXFS_I(inode);
+
+    while (count) {
+        uint64_t goal = ei->alloc_hint ? ei->alloc_hint : sbi->data_hint;
+        uint64_t start, length;
+        int err = mixfs_alloc_blocks(sb, goal, count, &start, &length);
+        if (err < 0) {
+            return err;
+        }
+
+        /* Соседние в памяти страницы уходят на устройство одним запросом */
+        for (uint64_t i = 0; i < length; ) {
+            uint64_t n = 1;
+            while (i + n < length &&
+                   page_address(pages[i + n]) == (uint8_t*)page_address(pages[i]) + n * PAGE_SIZE) {
+                n++;
+            }
+            err = block_write(sb->bdev, mixfs_block_sector(start + i),
+                              (uint32_t)(n * MIXFS_SECTORS_PER_BLOCK), page_address(pages[i]));
+            if (err < 0) {
+                mixfs_free_blocks(sb, start, length, false);
+                return err;
+            }
+            i += n;
+        }
+
+        err = mixfs_set_extent(inode, pages[0]->index, start, length);
+        if (err < 0) {
+            mixfs_free_blocks(sb, start, length, false);
+            return err;
+        }
+        for (uint64_t i = 0; i < length; i++) {
+            clear_page_dirty(pages[i]);
+            mixfs_unreserve_page(inode, pages[i]);
+        }
+        ei->alloc_hint = start + length;
+        sbi->data_hint = start + length;
+        pages += length;
+        count -= length;
+    }
+    return 0;
+}
+
+static int mixfs_writepages(struct address_space* mapping) {
+    struct inode* inode = mapping->host;
+    struct page* pages[MIXFS_WRITEPAGES_BATCH];
+    uint64_t end_index = DIV_ROUND_UP(inode->size, PAGE_SIZE);
+
+    while (!list_empty(&mapping->dirty_pages)) {
+        size_t count = 0;
+        struct list_head* pos;
+        list_for_each(pos, &mapping->dirty_pages) {
+            if (count == MIXFS_WRITEPAGES_BATCH) {
+                break;
+            }
+            struct page* page = list_entry(pos, struct page, lru);
+            get_page(page);
+            pages[count++] = page;
+        }
+        mixfs_sort_pages(pages, count);
+
+        int err = 0;
+        for (size_t i = 0; i < count && err == 0; ) {
+            if (pages[i]->index >= end_index) {
+                /* Страница за концом файла (гонка с усечением) не пишется */
+                clear_page_dirty(pages[i]);
+                mixfs_unreserve_page(inode, pages[i]);
+                i++;
+                continue;
+            }
+            size_t n = 1;
+            while (i + n < count && pages[i + n]->index == pages[i]->index + n &&
+                   pages[i + n]->index < end_index) {
+                n++;
+            }
+            err = mixfs_write_run(inode, &pages[i], n);
+            i += n;
+        }
+        for (size_t i = 0; i < count; i++) {
+            page_cache_release(pages[i]);
+        }
+        if (err < 0) {
+            return err;
+        }
+    }
+    mark_inode_dirty(inode);
+    return 0;
+}
+
+static int mixfs_writepage(struct address_space* mapping, struct page* page) {
+    struct inode* inode = mapping->host;
+    if (page->index >= DIV_ROUND_UP(inode->size, PAGE_SIZE)) {
+        mixfs_unreserve_page(inode, page);
+        return 0;
+    }
+    int err = mixfs_write_run(inode, &page, 1);
+    if (err == 0) {
+        mark_inode_dirty(inode);
+    }
+    return err;
+}
+
+const struct address_space_ops mixfs_aops = {
+    .readpage = mixfs_readpage,
+    .writepage = mixfs_writepage,
+    .write_begin = mixfs_write_begin,
+    .writepages = mixfs_writepages,
+};
+
+/* ============================================================================
+ * Усечение и удаление
+ * ============================================================================ */
+
+/* Отказ от резерва грязных страниц с индексами >= start перед их удалением */
+static void mixfs_unreserve_from(struct inode* inode, uint64_t start) {
+    struct list_head* pos;
+    list_for_each(pos, &inode->mapping.dirty_pages) {
+        struct page* page = list_entry(pos, struct page, lru);
+        if (page->index >= start) {
+            mixfs_unreserve_page(inode, page);
+        }
+    }
+}
+
+int mixfs_truncate(struct inode* inode, uint64_t size) {
+    if (!S_ISREG(inode->mode)) {
+        return -EINVAL;
+    }
+    if (size >= inode->size) {
+        /* Расширение: новые блоки станут дырами */
+        inode->size = size;
+        mark_inode_dirty(inode);
+        return 0;
+    }
+
+    uint64_t first = DIV_ROUND_UP(size, PAGE_SIZE);
+    mixfs_unreserve_from(inode, first);
+    truncate_mapping(&inode->mapping, first);
+
+    /*
+     * Хвост последней страницы обнуляется и на диске: иначе при последующем
+     * расширении файла за старым концом оказались бы прежние данные.
+     */
+    if (size & (PAGE_SIZE - 1)) {
+        struct page* page;
+        int err = read_cache_page(&inode->mapping, size >> PAGE_SHIFT, &page);
+        if (err == 0) {
+            err = mixfs_reserve_page(inode, page);
+            if (err == 0) {
+                uint32_t offset = size & (PAGE_SIZE - 1);
+                memset((uint8_t*)page_address(page) + offset, 0, PAGE_SIZE - offset);
+                set_page_dirty(page);
+            }
+            page_cache_release(page);
+        }
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    int err = mixfs_drop_extents(inode, first, UINT64_MAX);
+    MIXFS_I(inode)->alloc_hint = 0;
+    inode->size = size;
+    inode->mtime = inode->ctime = (uint32_t)mixfs_current_time(inode->sb);
+    mark_inode_dirty(inode);
+    return err;
+}
+
+void mixfs_evict_inode(struct inode* inode) {
+    struct super_block* sb = inode->sb;
+    struct mixfs_inode_info* ei = MIXFS_I(inode);
+
+    /* Грязные страницы уже отброшены VFS вместе с их резервом */
+    mixfs_release_blocks(sb, ei->reserved);
+    ei->reserved = 0;
+    if (S_ISREG(inode->mode)) {
+        mixfs_drop_extents(inode, 0, UINT64_MAX);
+    }
+
+    struct mixfs_path path;
+    struct mixfs_key key;
+    mixfs_set_key(&key, inode->ino, MIXFS_INODE_ITEM, 0);
+    mixfs_path_init(&path);
+    if (mixfs_search(sb, &key, &path, 0, true) == 0) {
+        mixfs_del_item(sb, &path);
+    }
+    mixfs_path_release(&path);
+}
+
+/* ============================================================================
+ * Операции обычных файлов
+ * ============================================================================ */
+
+const struct inode_operations mixfs_file_inode_operations = {
+    .truncate = mixfs_truncate,
+};
+
+const struct file_operations mixfs_file_operations = {
+    .read = generic_file_read,
+    .write = generic_file_write,
+    .splice_read = generic_file_splice_read,
+    .fsync = generic_file_fsync,
+};
@@ -0,0 +1,156 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/mixfs/mixfs.h
+ * MixFS: структуры в памяти и внутренние интерфейсы драйвера
+ *
+ * Транзакция открыта всегда и фиксируется в sync_fs. Узлы дерева с
+ * поколением меньше текущей транзакции принадлежат зафиксированному
+ * состоянию и перед изменением копируются в новый блок. Освобождённые
+ * в транзакции блоки нельзя занимать до её фиксации: на них ещё может
+ * ссылаться суперблок на диске.
+ *
+ * Данные файлов пишутся с отложенным выделением: при записи в page cache
+ * лишь резервируется место, а блоки выделяются при сбросе страниц сразу
+ * на весь непрерывный участок. Данные тоже не перезаписываются на месте:
+ * каждый сброс получает новые блоки, старые освобождаются.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_MIXFS_H
+#define MIXOS_FS_MIXFS_H
+
+#include "kernel.h"
+#include "fs/vfs.h"
+#include "fs/mixfs/mixfs_fs.h"
+
+#define MIXFS_SECTORS_PER_BLOCK (MIXFS_BLOCK_SIZE / SECTOR_SIZE)
+
+/* Запас блоков для узлов дерева, недоступный отложенной записи данных */
+#define MIXFS_META_RESERVE      64
+
+struct mixfs_inode_info {
+    uint64_t blocks;
+    uint64_t generation;
+    uint64_t parent;
+    uint64_t next_index;
+    uint64_t flags;
+    uint64_t reserved;              /* Страниц с зарезервированным местом */
+    uint64_t alloc_hint;            /* Блок за последним записанным экстентом */
+
+    /* Последний найденный экстент (для чтения подряд без поиска в дереве) */
+    uint64_t cache_fblock;
+    uint64_t cache_dblock;
+    uint64_t cache_len;             /* 0 - кеш пуст */
+
+    struct inode vfs_inode;
+};
+
+struct mixfs_sb_info {
+    struct super_block* sb;
+    uint64_t total_blocks;
+    uint64_t map_blocks;
+    uint64_t first_data_block;
+    uint64_t mkfs_time;
+    uint64_t commit_time;
+
+    /* Дерево */
+    uint64_t root;
+    uint32_t root_level;
+    uint64_t transid;               /* Текущая (незафиксированная) транзакция */
+    bool trans_dirty;
+    uint64_t next_ino;
+
+    /* Карта места: текущее состояние и состояние последней фиксации */
+    uint64_t* map;
+    uint64_t* map_committed;
+    uint64_t* map_block_gen;        /* Транзакция последнего изменения блока карты */
+    uint64_t map_written[2];        /* Транзакция последней записи копии */
+    uint32_t active_map;
+    uint64_t free_blocks;           /* Свободно в текущей карте */
+    uint64_t pinned_blocks;         /* Освобождены в транзакции, заняты на диске */
+    uint64_t delalloc_blocks;       /* Зарезервированы отложенной записью */
+    uint64_t meta_hint;
+    uint64_t data_hint;
+
+    struct mixfs_super_block super; /* Копия последнего записанного суперблока */
+};
+
+static inline struct mixfs_inode_info* MIXFS_I(struct inode* inode) {
+    return container_of(inode, struct mixfs_inode_info, vfs_inode);
+}
+
+static inline struct mixfs_sb_info* MIXFS_SB(struct super_block* sb) {
+    return (struct mixfs_sb_info*)sb->fs_info;
+}
+
+static inline uint64_t mixfs_block_sector(uint64_t block) {
+    return block * MIXFS_SECTORS_PER_BLOCK;
+}
+
+/* Путь от корня до листа: буферы узлов и позиции в них по уровням */
+struct mixfs_path {
+    struct buffer nodes[MIXFS_MAX_LEVEL];
+    int slots[MIXFS_MAX_LEVEL];
+};
+
+static inline struct mixfs_node_header* mixfs_path_node(struct mixfs_path* path, int level) {
+    return path->nodes[level].data;
+}
+
+static inline struct mixfs_item* mixfs_path_item(struct mixfs_path* path) {
+    return &mixfs_leaf_items(path->nodes[0].data)[path->slots[0]];
+}
+
+static inline void* mixfs_path_data(struct mixfs_path* path) {
+    return (uint8_t*)path->nodes[0].data + mixfs_path_item(path)->offset;
+}
+
+/* super.c */
+uint64_t mixfs_current_time(struct super_block* sb);
+int mixfs_commit(struct super_block* sb);
+void mixfs_init(void);
+
+/* space.c: карта свободного места */
+int mixfs_space_load(struct super_block* sb);
+int mixfs_space_write(struct super_block* sb, uint32_t copy);
+void mixfs_space_commit(struct super_block* sb);
+void mixfs_space_release(struct mixfs_sb_info* sbi);
+int mixfs_alloc_blocks(struct super_block* sb, uint64_t goal, uint64_t want,
+                       uint64_t* start, uint64_t* count);
+void mixfs_free_blocks(struct super_block* sb, uint64_t start, uint64_t count, bool metadata);
+int mixfs_reserve_blocks(struct super_block* sb, uint64_t count);
+void mixfs_release_blocks(struct super_block* sb, uint64_t count);
+
+/* btree.c: B+дерево с копированием при записи */
+void mixfs_path_init(struct mixfs_path* path);
+void mixfs_path_release(struct mixfs_path* path);
+int mixfs_read_node(struct super_block* sb, uint64_t blocknr, uint64_t generation,
+                    struct buffer* buf);
+int mixfs_search(struct super_block* sb, const struct mixfs_key* key, struct mixfs_path* path,
+                 int ins_len, bool cow);
+int mixfs_insert_item(struct super_block* sb, struct mixfs_path* path,
+                      const struct mixfs_key* key, uint32_t size);
+int mixfs_insert(struct super_block* sb, const struct mixfs_key* key, const void* data,
+                 uint32_t size);
+int mixfs_del_item(struct super_block* sb, struct mixfs_path* path);
+void mixfs_extend_item(struct mixfs_path* path, uint32_t extra);
+void mixfs_shrink_item(struct mixfs_path* path, uint32_t new_size);
+void mixfs_mark_leaf_dirty(struct mixfs_path* path);
+int mixfs_next_item(struct super_block* sb, struct mixfs_path* path);
+void mixfs_tree_checksum(struct super_block* sb);
+
+/* inode.c */
+extern const struct address_space_ops mixfs_aops;
+extern const struct inode_operations mixfs_file_inode_operations;
+extern const struct file_operations mixfs_file_operations;
+int mixfs_read_inode(struct inode* inode);
+int mixfs_write_inode(struct inode* inode);
+void mixfs_evict_inode(struct inode* inode);
+int mixfs_new_inode(struct inode* dir, uint32_t mode, struct inode** out);
+int mixfs_truncate(struct inode* inode, uint64_t size);
+
+/* dir.c */
+extern const struct inode_operations mixfs_dir_inode_operations;
+extern const struct file_operations mixfs_dir_operations;
+
+#endif /* MIXOS_FS_MIXFS_H */
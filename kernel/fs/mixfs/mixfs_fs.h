@@ -0,0 +1,261 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/mixfs/mixfs_fs.h
+ * MixFS: формат на диске (общий для ядра и утилит tools/)
+ *
+ * Раскладка тома (блоки по 4 KiB):
+ *   0                    - не используется (загрузчик, таблица разделов)
+ *   1, 2                 - две копии суперблока
+ *   3 ...                - две копии карты свободного места (битовая карта)
+ *   далее                - узлы B+дерева и данные файлов
+ *
+ * Все метаданные, кроме карты, лежат в одном B+дереве с ключами
+ * (objectid, type, offset): inode, записи каталогов (по хешу имени и по
+ * порядковому номеру) и экстенты файлов. Дерево обновляется копированием
+ * при записи: изменённый узел пишется в новый блок, и фиксация транзакции
+ * сводится к записи суперблока с новым корнем. Суперблок пишется
+ * поочерёдно в две копии (по чётности поколения), при монтировании
+ * выбирается корректная копия с большим поколением.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_MIXFS_FS_H
+#define MIXOS_FS_MIXFS_FS_H
+
+#include "kernel.h"
+#include "lib/crc32c.h"
+
+#define MIXFS_MAGIC             0x5346584DU     /* "MXFS" */
+#define MIXFS_NODE_MAGIC        0x444E584DU     /* "MXND" */
+#define MIXFS_MAP_MAGIC         0x504D584DU     /* "MXMP" */
+#define MIXFS_VERSION           1
+
+#define MIXFS_BLOCK_SHIFT       12
+#define MIXFS_BLOCK_SIZE        (1U << MIXFS_BLOCK_SHIFT)
+
+#define MIXFS_SUPER_BLOCK       1               /* Копии в блоках 1 и 2 */
+#define MIXFS_MAP_START         3
+
+#define MIXFS_ROOT_INO          1
+#define MIXFS_FIRST_INO         2
+
+#define MIXFS_MAX_LEVEL         8
+#define MIXFS_NAME_MAX          255
+
+/* Типы элементов дерева (порядок важен: элементы inode идут подряд) */
+#define MIXFS_INODE_ITEM        1               /* offset = 0 */
+#define MIXFS_DIR_ITEM          2               /* offset = хеш имени */
+#define MIXFS_DIR_INDEX         3               /* offset = номер записи */
+#define MIXFS_EXTENT_ITEM       4               /* offset = блок файла */
+
+/* Типы файлов в записях каталога (значения совпадают с DT_*) */
+#define MIXFS_FT_UNKNOWN        0
+#define MIXFS_FT_DIR            4
+#define MIXFS_FT_REG            8
+#define MIXFS_FT_LNK            10
+
+/* ============================================================================
+ * Суперблок
+ * ============================================================================ */
+
+struct mixfs_super_block {
+    uint32_t csum;                  /* CRC32C остальной части структуры */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t generation;            /* Транзакция, записавшая эту копию */
+    uint64_t total_blocks;
+    uint64_t free_blocks;
+    uint64_t root;                  /* Блок корневого узла дерева */
+    uint64_t map_blocks;            /* Блоков в одной копии карты */
+    uint64_t next_ino;
+    uint32_t root_level;
+    uint32_t active_map;            /* Копия карты (0/1), актуальная для generation */
+    uint64_t mkfs_time;
+    uint64_t commit_time;
+    uint8_t  uuid[16];
+    char     label[32];
+    uint8_t  reserved[376];
+};
+
+_Static_assert(sizeof(struct mixfs_super_block) == 512, "MixFS superblock size");
+
+/* ============================================================================
+ * Карта свободного места: бит на блок, 1 - занят
+ * ============================================================================ */
+
+struct mixfs_map_header {
+    uint32_t csum;                  /* CRC32C блока без этого поля */
+    uint32_t magic;
+    uint32_t index;                 /* Номер блока внутри копии карты */
+    uint32_t copy;
+};
+
+#define MIXFS_MAP_BYTES         (MIXFS_BLOCK_SIZE - sizeof(struct mixfs_map_header))
+#define MIXFS_MAP_BITS          (MIXFS_MAP_BYTES * 8)
+#define MIXFS_MAP_WORDS         (MIXFS_MAP_BYTES / sizeof(uint64_t))
+
+_Static_assert(MIXFS_MAP_BYTES % sizeof(uint64_t) == 0, "MixFS map block alignment");
+
+/* ============================================================================
+ * Узлы B+дерева
+ * ============================================================================ */
+
+struct mixfs_key {
+    uint64_t objectid;              /* Номер inode */
+    uint8_t  type;
+    uint8_t  pad[7];
+    uint64_t offset;
+};
+
+struct mixfs_node_header {
+    uint32_t csum;                  /* CRC32C блока без этого поля */
+    uint32_t magic;
+    uint64_t blocknr;               /* Собственный номер блока */
+    uint64_t generation;            /* Транзакция, создавшая узел */
+    uint16_t nritems;
+    uint8_t  level;                 /* 0 - лист */
+    uint8_t  pad[5];
+};
+
+/*
+ * Лист: заголовки элементов растут от начала блока, данные элементов -
+ * от конца навстречу им. Данные элемента i лежат выше данных элемента i+1.
+ */
+struct mixfs_item {
+    struct mixfs_key key;
+    uint32_t offset;                /* Смещение данных от начала блока */
+    uint32_t size;
+};
+
+/* Внутренний узел: ключ - наименьший ключ поддерева */
+struct mixfs_ptr {
+    struct mixfs_key key;
+    uint64_t blocknr;
+    uint64_t generation;            /* Поколение дочернего узла */
+};
+
+_Static_assert(sizeof(struct mixfs_key) == 24, "MixFS key size");
+_Static_assert(sizeof(struct mixfs_node_header) == 32, "MixFS node header size");
+_Static_assert(sizeof(struct mixfs_item) == 32, "MixFS item size");
+_Static_assert(sizeof(struct mixfs_ptr) == 40, "MixFS pointer size");
+
+#define MIXFS_LEAF_SPACE        (MIXFS_BLOCK_SIZE - sizeof(struct mixfs_node_header))
+#define MIXFS_NODE_PTRS         (MIXFS_LEAF_SPACE / sizeof(struct mixfs_ptr))
+
+/*
+ * Предел размера данных элемента: после деления листа пополам в каждой
+ * половине остаётся место для ещё одного элемента такого размера.
+ */
+#define MIXFS_MAX_ITEM_SIZE     768
+
+/* ============================================================================
+ * Элементы
+ * ============================================================================ */
+
+struct mixfs_inode_item {
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t nlink;
+    uint64_t size;                  /* У каталога - число записей */
+    uint64_t blocks;                /* Блоков данных в экстентах */
+    uint64_t atime;
+    uint64_t mtime;
+    uint64_t ctime;
+    uint64_t generation;            /* Транзакция создания */
+    uint64_t parent;                /* Каталог: родительский каталог */
+    uint64_t next_index;            /* Каталог: следующий номер DIR_INDEX */
+    uint64_t flags;
+    uint8_t  reserved[32];
+};
+
+/*
+ * Запись каталога. Элемент DIR_ITEM содержит все имена с одинаковым хешем
+ * подряд (каждое выровнено на 8 байт), DIR_INDEX - одно имя.
+ */
+struct mixfs_dir_entry {
+    uint64_t ino;
+    uint64_t index;                 /* Ключ парного DIR_INDEX */
+    uint16_t name_len;
+    uint8_t  type;
+    uint8_t  pad[5];
+    char     name[];
+};
+
+#define MIXFS_DIR_ENTRY_LEN(len) \
+    ((uint32_t)ALIGN_UP(sizeof(struct mixfs_dir_entry) + (len), 8))
+
+/* Номера DIR_INDEX начинаются с 2: позиции 0 и 1 readdir - "." и ".." */
+#define MIXFS_FIRST_DIR_INDEX   2
+
+/* Экстент: блоки файла [key.offset, key.offset + nr_blocks) */
+struct mixfs_extent_item {
+    uint64_t disk_block;
+    uint64_t nr_blocks;
+};
+
+_Static_assert(sizeof(struct mixfs_inode_item) == 120, "MixFS inode item size");
+_Static_assert(sizeof(struct mixfs_dir_entry) == 24, "MixFS dir entry size");
+
+/* ============================================================================
+ * Общие функции
+ * ============================================================================ */
+
+static inline int mixfs_key_cmp(const struct mixfs_key* a, const struct mixfs_key* b) {
+    if (a->objectid != b->objectid) {
+        return a->objectid < b->objectid ? -1 : 1;
+    }
+    if (a->type != b->type) {
+        return a->type < b->type ? -1 : 1;
+    }
+    if (a->offset != b->offset) {
+        return a->offset < b->offset ? -1 : 1;
+    }
+    return 0;
+}
+
+static inline void mixfs_set_key(struct mixfs_key* key, uint64_t objectid, uint8_t type,
+                                 uint64_t offset) {
+    memset(key, 0, sizeof(*key));
+    key->objectid = objectid;
+    key->type = type;
+    key->offset = offset;
+}
+
+static inline uint32_t mixfs_name_hash(const char* name, size_t len) {
+    return crc32c(0, name, len);
+}
+
+/* Контрольная сумма блока (узла или карты): всё, кроме первых 4 байт */
+static inline uint32_t mixfs_block_csum(const void* block) {
+    return crc32c(0, (const uint8_t*)block + sizeof(uint32_t), MIXFS_BLOCK_SIZE - sizeof(uint32_t));
+}
+
+static inline uint32_t mixfs_super_csum(const struct mixfs_super_block* sb) {
+    return crc32c(0, (const uint8_t*)sb + sizeof(uint32_t), sizeof(*sb) - sizeof(uint32_t));
+}
+
+static inline uint64_t mixfs_map_blocks(uint64_t total_blocks) {
+    return DIV_ROUND_UP(total_blocks, (uint64_t)MIXFS_MAP_BITS);
+}
+
+/* Первый блок копии карты copy */
+static inline uint64_t mixfs_map_block(uint64_t map_blocks, uint32_t copy) {
+    return MIXFS_MAP_START + copy * map_blocks;
+}
+
+/* Первый блок, доступный для узлов и данных */
+static inline uint64_t mixfs_first_data_block(uint64_t map_blocks) {
+    return MIXFS_MAP_START + 2 * map_blocks;
+}
+
+static inline struct mixfs_item* mixfs_leaf_items(void* node) {
+    return (struct mixfs_item*)((uint8_t*)node + sizeof(struct mixfs_node_header));
+}
+
+static inline struct mixfs_ptr* mixfs_node_ptrs(void* node) {
+    return (struct mixfs_ptr*)((uint8_t*)node + sizeof(struct mixfs_node_header));
+}
+
+#endif /* MIXOS_FS_MIXFS_FS_H */
@@ -0,0 +1,253 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/mixfs/space.c
+ * MixFS: карта свободного места и выделение блоков
+ *
+ * Карта целиком хранится в памяти в двух экземплярах: текущем и на момент
+ * последней фиксации. Блок можно выделить, только если он свободен в обоих:
+ * так блоки, освобождённые в открытой транзакции, не перезаписываются, пока
+ * на них ссылается суперблок на диске. При фиксации текущая карта пишется
+ * в неактивную копию на диске, причём только блоки карты, изменённые после
+ * предыдущей записи этой копии.
+ * ============================================================================
+ */
+
+#include "fs/mixfs/mixfs.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+static inline bool map_test(const uint64_t* map, uint64_t block) {
+    return (map[block / 64] >> (block % 64)) & 1;
+}
+
+static inline void map_set(uint64_t* map, uint64_t block) {
+    map[block / 64] |= 1ULL << (block % 64);
+}
+
+static inline void map_clear(uint64_t* map, uint64_t block) {
+    map[block / 64] &= ~(1ULL << (block % 64));
+}
+
+static inline void map_touch(struct mixfs_sb_info* sbi, uint64_t block) {
+    sbi->map_block_gen[block / MIXFS_MAP_BITS] = sbi->transid;
+}
+
+static uint64_t map_words(struct mixfs_sb_info* sbi) {
+    return sbi->map_blocks * MIXFS_MAP_WORDS;
+}
+
+/* Без -mpopcnt __builtin_popcountll - вызов libgcc, а ядро собрано без неё */
+static inline uint64_t popcount64(uint64_t x) {
+    x -= (x >> 1) & 0x5555555555555555ULL;
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+void mixfs_space_release(struct mixfs_sb_info* sbi) {
+    kfree(sbi->map);
+    kfree(sbi->map_committed);
+    kfree(sbi->map_block_gen);
+    sbi->map = sbi->map_committed = sbi->map_block_gen = NULL;
+}
+
+int mixfs_space_load(struct super_block* sb) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    uint64_t bytes = map_words(sbi) * sizeof(uint64_t);
+
+    sbi->map = kmalloc(bytes);
+    sbi->map_committed = kmalloc(bytes);
+    sbi->map_block_gen = kzalloc(sbi->map_blocks * sizeof(uint64_t));
+    if (!sbi->map || !sbi->map_committed || !sbi->map_block_gen) {
+        mixfs_space_release(sbi);
+        return -ENOMEM;
+    }
+
+    uint64_t first = mixfs_map_block(sbi->map_blocks, sbi->active_map);
+    for (uint64_t i = 0; i < sbi->map_blocks; i++) {
+        struct buffer buf;
+        int err = bread(sb->bdev, first + i, MIXFS_BLOCK_SIZE, &buf);
+        if (err < 0) {
+            return err;
+        }
+        struct mixfs_map_header* header = buf.data;
+        if (header->magic != MIXFS_MAP_MAGIC || header->index != i ||
+            header->csum != mixfs_block_csum(buf.data)) {
+            brelse(&buf);
+            terminal_writestring("  mixfs: space map checksum mismatch\n");
+            return -EFSCORRUPTED;
+        }
+        memcpy(&sbi->map[i * MIXFS_MAP_WORDS], header + 1, MIXFS_MAP_BYTES);
+        brelse(&buf);
+    }
+
+    /* Хвост последнего блока карты за концом тома считается занятым */
+    for (uint64_t block = sbi->total_blocks; block < map_words(sbi) * 64; block++) {
+        map_set(sbi->map, block);
+    }
+    memcpy(sbi->map_committed, sbi->map, bytes);
+
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < map_words(sbi); i++) {
+        used += popcount64(sbi->map[i]);
+    }
+    sbi->free_blocks = map_words(sbi) * 64 - used;
+    sbi->pinned_blocks = 0;
+
+    /* Активная копия соответствует последней фиксации, другая - предыдущей */
+    sbi->map_written[sbi->active_map] = sbi->transid - 1;
+    sbi->map_written[sbi->active_map ^ 1] = 0;
+    return 0;
+}
+
+/* Запись текущей карты в копию copy (блоки, изменённые после её записи) */
+int mixfs_space_write(struct super_block* sb, uint32_t copy) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    uint64_t first = mixfs_map_block(sbi->map_blocks, copy);
+
+    for (uint64_t i = 0; i < sbi->map_blocks; i++) {
+        if (sbi->map_written[copy] && sbi->map_block_gen[i] <= sbi->map_written[copy]) {
+            continue;
+        }
+        struct buffer buf;
+        int err = bread(sb->bdev, first + i, MIXFS_BLOCK_SIZE, &buf);
+        if (err < 0) {
+            return err;
+        }
+        struct mixfs_map_header* header = buf.data;
+        header->magic = MIXFS_MAP_MAGIC;
+        header->index = (uint32_t)i;
+        header->copy = copy;
+        memcpy(header + 1, &sbi->map[i * MIXFS_MAP_WORDS], MIXFS_MAP_BYTES);
+        header->csum = mixfs_block_csum(buf.data);
+        mark_buffer_dirty(&buf);
+        brelse(&buf);
+    }
+    sbi->map_written[copy] = sbi->transid;
+    return 0;
+}
+
+/* Транзакция зафиксирована: освобождённые в ней блоки снова доступны */
+void mixfs_space_commit(struct super_block* sb) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    memcpy(sbi->map_committed, sbi->map, map_words(sbi) * sizeof(uint64_t));
+    sbi->pinned_blocks = 0;
+}
+
+/* Блок свободен и в текущей карте, и на диске */
+static inline uint64_t busy_word(struct mixfs_sb_info* sbi, uint64_t word) {
+    return sbi->map[word] | sbi->map_committed[word];
+}
+
+/* Первый доступный блок в [from, to) или to */
+static uint64_t find_free(struct mixfs_sb_info* sbi, uint64_t from, uint64_t to) {
+    uint64_t block = from;
+    while (block < to) {
+        uint64_t word = busy_word(sbi, block / 64) | ((1ULL << (block % 64)) - 1);
+        if (word != ~0ULL) {
+            block = ALIGN_DOWN(block, 64) + (uint64_t)__builtin_ctzll(~word);
+            return MIN(block, to);
+        }
+        block = ALIGN_DOWN(block, 64) + 64;
+    }
+    return to;
+}
+
+/*
+ * Выделение до want блоков подряд, начиная поиск с goal (с переходом
+ * через конец тома). Возвращается первый найденный свободный участок,
+ * обрезанный до want; count >= 1.
+ */
+int mixfs_alloc_blocks(struct super_block* sb, uint64_t goal, uint64_t want,
+                       uint64_t* start, uint64_t* count) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    if (sbi->free_blocks <= sbi->pinned_blocks) {
+        return -ENOSPC;
+    }
+    if (goal < sbi->first_data_block || goal >= sbi->total_blocks) {
+        goal = sbi->first_data_block;
+    }
+
+    uint64_t block = find_free(sbi, goal, sbi->total_blocks);
+    if (block == sbi->total_blocks) {
+        block = find_free(sbi, sbi->first_data_block, goal);
+        if (block == goal) {
+            return -ENOSPC;
+        }
+    }
+
+    uint64_t length = 0;
+    while (length < want && block + length < sbi->total_blocks) {
+        uint64_t b = block + length;
+        if (map_test(sbi->map, b) || map_test(sbi->map_committed, b)) {
+            break;
+        }
+        map_set(sbi->map, b);
+        map_touch(sbi, b);
+        length++;
+    }
+
+    sbi->free_blocks -= length;
+    sbi->trans_dirty = true;
+    *start = block;
+    *count = length;
+    return 0;
+}
+
+/*
+ * Освобождение блоков. У блоков узлов (metadata) отменяется отложенная
+ * запись из кеша устройства: блок может стать данными файла, которые
+ * пишутся в обход кеша.
+ */
+void mixfs_free_blocks(struct super_block* sb, uint64_t start, uint64_t count, bool metadata) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    for (uint64_t b = start; b < start + count; b++) {
+        if (b < sbi->first_data_block || b >= sbi->total_blocks || !map_test(sbi->map, b)) {
+            terminal_writestring("  mixfs: freeing free block ");
+            terminal_writedec(b);
+            terminal_writestring("\n");
+            continue;
+        }
+        map_clear(sbi->map, b);
+        map_touch(sbi, b);
+        sbi->free_blocks++;
+        if (map_test(sbi->map_committed, b)) {
+            sbi->pinned_blocks++;
+        }
+        if (metadata) {
+            bforget(sb->bdev, b, MIXFS_BLOCK_SIZE);
+        }
+    }
+    sbi->trans_dirty = true;
+}
+
+/*
+ * Резерв места под отложенную запись. Если места не хватает только из-за
+ * блоков, освобождённых в открытой транзакции, она фиксируется досрочно.
+ */
+int mixfs_reserve_blocks(struct super_block* sb, uint64_t count) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint64_t available = sbi->free_blocks - sbi->pinned_blocks;
+        if (available >= sbi->delalloc_blocks + count + MIXFS_META_RESERVE) {
+            sbi->delalloc_blocks += count;
+            return 0;
+        }
+        if (sbi->pinned_blocks == 0) {
+            break;
+        }
+        int err = mixfs_commit(sb);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return -ENOSPC;
+}
+
+void mixfs_release_blocks(struct super_block* sb, uint64_t count) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    sbi->delalloc_blocks -= MIN(count, sbi->delalloc_blocks);
+}
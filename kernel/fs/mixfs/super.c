@@ -0,0 +1,236 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/mixfs/super.c
+ * MixFS: монтирование и фиксация транзакций
+ *
+ * Фиксация: контрольные суммы новых узлов, запись карты в неактивную
+ * копию, сброс кеша устройства, затем суперблок. Пока суперблок не
+ * записан, на диске действует предыдущее состояние целиком: старые узлы
+ * и блоки данных не перезаписывались.
+ * ============================================================================
+ */
+
+#include "fs/mixfs/mixfs.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/*
+ * Часов реального времени в ядре пока нет: временем считается момент
+ * последней фиксации (не ноль, чтобы отличать от незаполненного поля).
+ */
+uint64_t mixfs_current_time(struct super_block* sb) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+    uint64_t now = MAX(sbi->commit_time, sbi->mkfs_time);
+    return now ? now : 1;
+}
+
+/* ============================================================================
+ * Фиксация
+ * ============================================================================ */
+
+int mixfs_commit(struct super_block* sb) {
+    struct mixfs_sb_info* sbi = MIXFS_SB(sb);
+
+    if (!sbi->trans_dirty) {
+        return 0;
+    }
+
+    mixfs_tree_checksum(sb);
+    uint32_t copy = sbi->active_map ^ 1;
+    int err = mixfs_space_write(sb, copy);
+    if (err < 0) {
+        return err;
+    }
+    /* Узлы и карта должны оказаться на носителе раньше суперблока */
+    err = bdev_sync(sb->bdev);
+    if (err < 0) {
+        return err;
+    }
+
+    struct mixfs_super_block super = sbi->super;
+    super.generation = sbi->transid;
+    super.root = sbi->root;
+    super.root_level = sbi->root_level;
+    super.free_blocks = sbi->free_blocks;
+    super.next_ino = sbi->next_ino;
+    super.active_map = copy;
+    super.commit_time = mixfs_current_time(sb);
+    super.csum = mixfs_super_csum(&super);
+
+    struct buffer buf;
+    err = bread(sb->bdev, MIXFS_SUPER_BLOCK + sbi->transid % 2, MIXFS_BLOCK_SIZE, &buf);
+    if (err < 0) {
+        return err;
+    }
+    memset(buf.data, 0, MIXFS_BLOCK_SIZE);
+    memcpy(buf.data, &super, sizeof(super));
+    mark_buffer_dirty(&buf);
+    brelse(&buf);
+    err = bdev_sync(sb->bdev);
+    if (err < 0) {
+        return err;
+    }
+
+    sbi->super = super;
+    sbi->active_map = copy;
+    sbi->commit_time = super.commit_time;
+    mixfs_space_commit(sb);
+    sbi->transid++;
+    sbi->trans_dirty = false;
+    return 0;
+}
+
+/* ============================================================================
+ * Операции суперблока
+ * ============================================================================ */
+
+static struct inode* mixfs_alloc_inode(struct super_block* sb) {
+    (void)sb;
+    struct mixfs_inode_info* ei = kzalloc(sizeof(*ei));
+    return ei ? &ei->vfs_inode : NULL;
+}
+
+static void mixfs_destroy_inode(struct inode* inode) {
+    kfree(MIXFS_I(inode));
+}
+
+static int mixfs_sync_fs(struct super_block* sb) {
+    return mixfs_commit(sb);
+}
+
+static const struct super_operations mixfs_super_operations = {
+    .alloc_inode = mixfs_alloc_inode,
+    .destroy_inode = mixfs_destroy_inode,
+    .read_inode = mixfs_read_inode,
+    .write_inode = mixfs_write_inode,
+    .evict_inode = mixfs_evict_inode,
+    .sync_fs = mixfs_sync_fs,
+};
+
+/* ============================================================================
+ * Монтирование
+ * ============================================================================ */
+
+static bool mixfs_valid_super(const struct mixfs_super_block* super, struct block_device* bdev) {
+    if (super->magic != MIXFS_MAGIC || super->csum != mixfs_super_csum(super)) {
+        return false;
+    }
+    if (super->version != MIXFS_VERSION || super->block_size != MIXFS_BLOCK_SIZE) {
+        return false;
+    }
+    uint64_t first_data = mixfs_first_data_block(super->map_blocks);
+    return super->total_blocks <= bdev->nr_sectors / MIXFS_SECTORS_PER_BLOCK &&
+           super->map_blocks == mixfs_map_blocks(super->total_blocks) &&
+           first_data < super->total_blocks &&
+           super->root >= first_data && super->root < super->total_blocks &&
+           super->root_level < MIXFS_MAX_LEVEL && super->active_map < 2 &&
+           super->next_ino >= MIXFS_FIRST_INO;
+}
+
+/* Корректная копия суперблока с наибольшим поколением */
+static int mixfs_read_super(struct block_device* bdev, struct mixfs_super_block* out) {
+    bool found = false;
+
+    for (uint32_t i = 0; i < 2; i++) {
+        struct buffer buf;
+        int err = bread(bdev, MIXFS_SUPER_BLOCK + i, MIXFS_BLOCK_SIZE, &buf);
+        if (err < 0) {
+            return err;
+        }
+        const struct mixfs_super_block* super = buf.data;
+        if (mixfs_valid_super(super, bdev) && (!found || super->generation > out->generation)) {
+            *out = *super;
+            found = true;
+        }
+        brelse(&buf);
+    }
+    return found ? 0 : -EINVAL;
+}
+
+static void mixfs_put_super(struct mixfs_sb_info* sbi) {
+    mixfs_space_release(sbi);
+    kfree(sbi);
+}
+
+static int mixfs_fill_super(struct mixfs_sb_info* sbi, struct super_block* sb) {
+    const struct mixfs_super_block* super = &sbi->super;
+
+    sbi->total_blocks = super->total_blocks;
+    sbi->map_blocks = super->map_blocks;
+    sbi->first_data_block = mixfs_first_data_block(super->map_blocks);
+    sbi->mkfs_time = super->mkfs_time;
+    sbi->commit_time = super->commit_time;
+    sbi->root = super->root;
+    sbi->root_level = super->root_level;
+    sbi->transid = super->generation + 1;
+    sbi->next_ino = super->next_ino;
+    sbi->active_map = super->active_map;
+    sbi->meta_hint = sbi->first_data_block;
+    sbi->data_hint = sbi->first_data_block;
+
+    sb->block_size = MIXFS_BLOCK_SIZE;
+    sb->s_op = &mixfs_super_operations;
+    sb->fs_info = sbi;
+
+    int err = mixfs_space_load(sb);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* root;
+    err = iget(sb, MIXFS_ROOT_INO, &root);
+    if (err < 0) {
+        return err;
+    }
+    if (!S_ISDIR(root->mode)) {
+        iput(root);
+        return -EFSCORRUPTED;
+    }
+    sb->root = root;
+    return 0;
+}
+
+static int mixfs_mount(struct block_device* bdev, struct super_block* sb) {
+    struct mixfs_sb_info* sbi = kzalloc(sizeof(*sbi));
+    if (!sbi) {
+        return -ENOMEM;
+    }
+    sbi->sb = sb;
+    sb->bdev = bdev;
+
+    int err = mixfs_read_super(bdev, &sbi->super);
+    if (err == 0) {
+        err = mixfs_fill_super(sbi, sb);
+    }
+    if (err < 0) {
+        sb->fs_info = NULL;
+        mixfs_put_super(sbi);
+        return err;
+    }
+
+    terminal_writestring("  mixfs: ");
+    terminal_writedec(sbi->total_blocks);
+    terminal_writestring(" blocks, ");
+    terminal_writedec(sbi->free_blocks);
+    terminal_writestring(" free, generation ");
+    terminal_writedec(sbi->super.generation);
+    terminal_writestring("\n");
+    return 0;
+}
+
+static void mixfs_unmount(struct super_block* sb) {
+    if (sb->root) {
+        iput(sb->root);
+    }
+    mixfs_put_super(MIXFS_SB(sb));
+}
+
+static struct filesystem_type mixfs_fs_type = {
+    .name = "mixfs",
+    .mount = mixfs_mount,
+    .unmount = mixfs_unmount,
+};
+
+void mixfs_init(void) {
+    register_filesystem(&mixfs_fs_type);
+}
@@ -0,0 +1,352 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/pipe.c
+ * Каналы (pipe): псевдо-ФС pipefs, чтение и запись
+ *
+ * Inode канала живёт в безымянном суперблоке pipefs и не имеет жёстких
+ * ссылок: он освобождается вместе с последним открытым концом. Пока нет
+ * планировщика, операции не блокируются: чтение из пустого канала с
+ * живыми писателями и запись в заполненный канал возвращают -EAGAIN.
+ *
+ * Пробуждения пакетные: писатель будит читателей в конце вызова и только
+ * если канал был пуст. Пока читатель не выбрал данные, следующие мелкие
+ * записи дописываются в ту же страницу и никого не будят.
+ * ============================================================================
+ */
+
+#include "fs/pipe.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+static struct super_block pipe_sb;
+static uint64_t pipe_last_ino;
+
+/* ============================================================================
+ * Буферы канала
+ * ============================================================================ */
+
+void pipe_push_page(struct pipe_inode_info* pipe, struct page* page,
+                    uint32_t offset, uint32_t len, uint32_t flags) {
+    struct pipe_buffer* buf = pipe_buf(pipe, pipe->head++);
+    buf->page = page;
+    buf->offset = offset;
+    buf->len = len;
+    buf->flags = flags;
+}
+
+void pipe_consume(struct pipe_inode_info* pipe, struct pipe_buffer* buf, uint32_t len) {
+    buf->offset += len;
+    buf->len -= len;
+    if (buf->len == 0) {
+        put_page(buf->page);
+        buf->page = NULL;
+        pipe->tail++;
+    }
+}
+
+static void pipe_release_buffers(struct pipe_inode_info* pipe) {
+    while (!pipe_empty(pipe)) {
+        struct pipe_buffer* buf = pipe_buf(pipe, pipe->tail);
+        pipe_consume(pipe, buf, buf->len);
+    }
+}
+
+static int pipe_alloc_ring(struct pipe_inode_info* pipe) {
+    pipe->bufs = kzalloc(PIPE_DEF_BUFFERS * sizeof(struct pipe_buffer));
+    if (!pipe->bufs) {
+        return -ENOMEM;
+    }
+    pipe->ring_size = PIPE_DEF_BUFFERS;
+    return 0;
+}
+
+static void pipe_free_ring(struct pipe_inode_info* pipe) {
+    pipe_release_buffers(pipe);
+    kfree(pipe->bufs);
+}
+
+struct pipe_inode_info* pipe_alloc_internal(void) {
+    struct pipe_inode_info* pipe = kzalloc(sizeof(*pipe));
+    if (!pipe) {
+        return NULL;
+    }
+    if (pipe_alloc_ring(pipe) < 0) {
+        kfree(pipe);
+        return NULL;
+    }
+    pipe->readers = 1;
+    pipe->writers = 1;
+    return pipe;
+}
+
+void pipe_free_internal(struct pipe_inode_info* pipe) {
+    pipe_free_ring(pipe);
+    kfree(pipe);
+}
+
+/* Кольцо переупорядочивается с tail = 0; занятых буферов должно хватать места */
+static int pipe_resize_ring(struct pipe_inode_info* pipe, uint32_t nr_bufs) {
+    uint32_t occupancy = pipe->head - pipe->tail;
+    if (nr_bufs < occupancy) {
+        return -EBUSY;
+    }
+    struct pipe_buffer* bufs = kzalloc(nr_bufs * sizeof(struct pipe_buffer));
+    if (!bufs) {
+        return -ENOMEM;
+    }
+    for (uint32_t i = 0; i < occupancy; i++) {
+        bufs[i] = *pipe_buf(pipe, pipe->tail + i);
+    }
+    bool was_full = pipe_full(pipe);
+    kfree(pipe->bufs);
+    pipe->bufs = bufs;
+    pipe->ring_size = nr_bufs;
+    pipe->tail = 0;
+    pipe->head = occupancy;
+    pipe_wake_writers(pipe, was_full);
+    return 0;
+}
+
+/* ============================================================================
+ * Пробуждения
+ * ============================================================================ */
+
+void pipe_wake_readers(struct pipe_inode_info* pipe, bool was_empty) {
+    if (was_empty && !pipe_empty(pipe) && pipe->wake_readers) {
+        pipe->wake_readers(pipe, pipe->wake_data);
+    }
+}
+
+void pipe_wake_writers(struct pipe_inode_info* pipe, bool was_full) {
+    if (was_full && !pipe_full(pipe) && pipe->wake_writers) {
+        pipe->wake_writers(pipe, pipe->wake_data);
+    }
+}
+
+/* ============================================================================
+ * Файловые операции
+ * ============================================================================ */
+
+static int64_t pipe_read(struct file* file, void* buffer, size_t count, uint64_t* pos) {
+    (void)pos;
+    struct pipe_inode_info* pipe = PIPE_I(file->inode);
+    uint8_t* out = buffer;
+    size_t done = 0;
+    bool was_full = pipe_full(pipe);
+
+    while (done < count && !pipe_empty(pipe)) {
+        struct pipe_buffer* buf = pipe_buf(pipe, pipe->tail);
+        uint32_t chunk = (uint32_t)MIN((size_t)buf->len, count - done);
+        memcpy(out + done, (uint8_t*)page_address(buf->page) + buf->offset, chunk);
+        pipe_consume(pipe, buf, chunk);
+        done += chunk;
+    }
+    pipe_wake_writers(pipe, was_full);
+    if (done || count == 0) {
+        return (int64_t)done;
+    }
+    return pipe->writers ? -EAGAIN : 0;
+}
+
+static int64_t pipe_write(struct file* file, const void* buffer, size_t count, uint64_t* pos) {
+    (void)pos;
+    struct pipe_inode_info* pipe = PIPE_I(file->inode);
+    const uint8_t* in = buffer;
+    size_t done = 0;
+    bool was_empty = pipe_empty(pipe);
+
+    if (pipe->readers == 0) {
+        return -EPIPE;
+    }
+
+    /* Мелкие записи дописываются в последнюю страницу канала */
+    if (!pipe_empty(pipe) && count) {
+        struct pipe_buffer* last = pipe_buf(pipe, pipe->head - 1);
+        uint32_t end = last->offset + last->len;
+        if ((last->flags & PIPE_BUF_FLAG_CAN_MERGE) && end < PAGE_SIZE) {
+            uint32_t chunk = (uint32_t)MIN((size_t)(PAGE_SIZE - end), count);
+            memcpy((uint8_t*)page_address(last->page) + end, in, chunk);
+            last->len += chunk;
+            done += chunk;
+        }
+    }
+
+    while (done < count && !pipe_full(pipe)) {
+        struct page* page = alloc_page();
+        if (!page) {
+            break;
+        }
+        uint32_t chunk = (uint32_t)MIN((size_t)PAGE_SIZE, count - done);
+        memcpy(page_address(page), in + done, chunk);
+        pipe_push_page(pipe, page, 0, chunk, PIPE_BUF_FLAG_CAN_MERGE);
+        done += chunk;
+    }
+    pipe_wake_readers(pipe, was_empty);
+    if (done || count == 0) {
+        return (int64_t)done;
+    }
+    return pipe_full(pipe) ? -EAGAIN : -ENOMEM;
+}
+
+/*
+ * Страница целиком уходит в канал вместо копирования: ссылка вызывающего
+ * переходит буферу. Страница, которой вызывающий владеет один, остаётся
+ * дописываемой; общую (например, из page cache) канал только читает.
+ * Короткий кусок, помещающийся в последнюю страницу канала, копируется,
+ * чтобы мелкие записи не занимали по буферу.
+ */
+static int64_t pipe_write_page(struct pipe_inode_info* pipe, struct page* page,
+                               uint32_t offset, uint32_t len) {
+    bool was_empty = pipe_empty(pipe);
+
+    if (!was_empty) {
+        struct pipe_buffer* last = pipe_buf(pipe, pipe->head - 1);
+        uint32_t end = last->offset + last->len;
+        if ((last->flags & PIPE_BUF_FLAG_CAN_MERGE) && len <= PAGE_SIZE - end) {
+            memcpy((uint8_t*)page_address(last->page) + end,
+                   (uint8_t*)page_address(page) + offset, len);
+            last->len += len;
+            put_page(page);
+            return len;
+        }
+    }
+    if (pipe_full(pipe)) {
+        return -EAGAIN;
+    }
+    bool exclusive = page->refcount == 1 && !page->mapping;
+    pipe_push_page(pipe, page, offset, len, exclusive ? PIPE_BUF_FLAG_CAN_MERGE : 0);
+    pipe_wake_readers(pipe, was_empty);
+    return len;
+}
+
+static void pipe_release(struct file* file) {
+    struct pipe_inode_info* pipe = PIPE_I(file->inode);
+    if ((file->flags & O_ACCMODE) == O_RDONLY) {
+        if (--pipe->readers == 0 && pipe->wake_writers) {
+            pipe->wake_writers(pipe, pipe->wake_data);
+        }
+    } else {
+        if (--pipe->writers == 0 && pipe->wake_readers) {
+            pipe->wake_readers(pipe, pipe->wake_data);
+        }
+    }
+}
+
+static const struct file_operations pipe_file_operations = {
+    .read = pipe_read,
+    .write = pipe_write,
+    .release = pipe_release,
+};
+
+struct pipe_inode_info* get_pipe_info(struct file* file) {
+    return file->f_op == &pipe_file_operations ? PIPE_I(file->inode) : NULL;
+}
+
+int64_t vfs_pipe_write_page(struct file* file, struct page* page, uint32_t offset, uint32_t len) {
+    struct pipe_inode_info* pipe = get_pipe_info(file);
+    if (!pipe || (file->flags & O_ACCMODE) == O_RDONLY) {
+        return -EBADF;
+    }
+    if (offset >= PAGE_SIZE || len == 0 || len > PAGE_SIZE - offset) {
+        return -EINVAL;
+    }
+    if (pipe->readers == 0) {
+        return -EPIPE;
+    }
+    return pipe_write_page(pipe, page, offset, len);
+}
+
+int64_t vfs_pipe_get_size(struct file* file) {
+    struct pipe_inode_info* pipe = get_pipe_info(file);
+    if (!pipe) {
+        return -EBADF;
+    }
+    return (int64_t)pipe->ring_size * PAGE_SIZE;
+}
+
+/* Размер округляется вверх до степени двойки страниц, как F_SETPIPE_SZ */
+int64_t vfs_pipe_set_size(struct file* file, size_t size) {
+    struct pipe_inode_info* pipe = get_pipe_info(file);
+    if (!pipe) {
+        return -EBADF;
+    }
+    if (size > (size_t)PIPE_MAX_BUFFERS * PAGE_SIZE) {
+        return -EPERM;
+    }
+    uint32_t nr_bufs = 1;
+    while ((size_t)nr_bufs * PAGE_SIZE < size) {
+        nr_bufs <<= 1;
+    }
+    if (nr_bufs != pipe->ring_size) {
+        int err = pipe_resize_ring(pipe, nr_bufs);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return (int64_t)nr_bufs * PAGE_SIZE;
+}
+
+/* ============================================================================
+ * pipefs
+ * ============================================================================ */
+
+static struct inode* pipe_alloc_inode(struct super_block* sb) {
+    (void)sb;
+    struct pipe_inode_info* pipe = kzalloc(sizeof(*pipe));
+    if (!pipe) {
+        return NULL;
+    }
+    if (pipe_alloc_ring(pipe) < 0) {
+        kfree(pipe);
+        return NULL;
+    }
+    return &pipe->vfs_inode;
+}
+
+static void pipe_destroy_inode(struct inode* inode) {
+    struct pipe_inode_info* pipe = PIPE_I(inode);
+    pipe_free_ring(pipe);
+    kfree(pipe);
+}
+
+static const struct super_operations pipe_super_operations = {
+    .alloc_inode = pipe_alloc_inode,
+    .destroy_inode = pipe_destroy_inode,
+};
+
+int vfs_pipe(struct file** read_end, struct file** write_end) {
+    struct inode* inode = new_inode(&pipe_sb, ++pipe_last_ino);
+    if (!inode) {
+        return -ENOMEM;
+    }
+    inode->mode = S_IFIFO | 0600;
+    inode->nlink = 0;
+    inode->f_op = &pipe_file_operations;
+
+    struct pipe_inode_info* pipe = PIPE_I(inode);
+    struct file* reader = file_alloc(inode, O_RDONLY);
+    if (!reader) {
+        iput(inode);
+        return -ENOMEM;
+    }
+    pipe->readers = 1;
+
+    ihold(inode);
+    struct file* writer = file_alloc(inode, O_WRONLY);
+    if (!writer) {
+        iput(inode);
+        fput(reader);
+        return -ENOMEM;
+    }
+    pipe->writers = 1;
+
+    *read_end = reader;
+    *write_end = writer;
+    return 0;
+}
+
+void pipe_init(void) {
+    pipe_sb.s_op = &pipe_super_operations;
+    pipe_sb.block_size = PAGE_SIZE;
+    list_init(&pipe_sb.dirty_inodes);
+}
@@ -0,0 +1,90 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/pipe.h
+ * Каналы (pipe): кольцо ссылок на страницы
+ *
+ * Канал хранит не копию данных, а ссылки на страницы с их смещением и
+ * длиной. write() копирует байты в собственные страницы канала, а
+ * splice() кладёт в канал ссылки на страницы page cache, так что данные
+ * файла проходят через канал без копирования.
+ *
+ * Ёмкость канала (число буферов в кольце) меняется на ходу степенью
+ * двойки. Ожидающая сторона будится не на каждый буфер, а один раз за
+ * вызов и только при переходе канала из пустого (полного) состояния.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_PIPE_H
+#define MIXOS_FS_PIPE_H
+
+#include "fs/vfs.h"
+
+/* Буферов (страниц) в кольце канала: по умолчанию и предел для vfs_pipe_set_size */
+#define PIPE_DEF_BUFFERS        16
+#define PIPE_MAX_BUFFERS        256
+
+/* Флаги буфера канала */
+#define PIPE_BUF_FLAG_CAN_MERGE (1U << 0)   /* Страница канала: можно дописывать */
+
+struct pipe_buffer {
+    struct page* page;              /* Со ссылкой, снимаемой при опустошении */
+    uint32_t offset;
+    uint32_t len;
+    uint32_t flags;
+};
+
+struct pipe_inode_info;
+
+/* Пробуждение ожидающей стороны канала (сюда подключается планировщик) */
+typedef void (*pipe_wake_t)(struct pipe_inode_info* pipe, void* data);
+
+struct pipe_inode_info {
+    struct pipe_buffer* bufs;
+    uint32_t ring_size;             /* Буферов в кольце, степень двойки */
+    uint32_t head;                  /* Следующий заполняемый буфер (счётчик) */
+    uint32_t tail;                  /* Самый старый непрочитанный буфер */
+    uint32_t readers;
+    uint32_t writers;
+    pipe_wake_t wake_readers;       /* Появились данные или ушёл последний писатель */
+    pipe_wake_t wake_writers;       /* Появилось место или ушёл последний читатель */
+    void* wake_data;
+    struct inode vfs_inode;
+};
+
+static inline struct pipe_inode_info* PIPE_I(struct inode* inode) {
+    return container_of(inode, struct pipe_inode_info, vfs_inode);
+}
+
+static inline bool pipe_empty(const struct pipe_inode_info* pipe) {
+    return pipe->head == pipe->tail;
+}
+
+static inline bool pipe_full(const struct pipe_inode_info* pipe) {
+    return pipe->head - pipe->tail >= pipe->ring_size;
+}
+
+static inline struct pipe_buffer* pipe_buf(struct pipe_inode_info* pipe, uint32_t slot) {
+    return &pipe->bufs[slot & (pipe->ring_size - 1)];
+}
+
+/* Канал, если файл - его конец, иначе NULL */
+struct pipe_inode_info* get_pipe_info(struct file* file);
+
+/* Ссылка на страницу в конец канала (канал не должен быть заполнен) */
+void pipe_push_page(struct pipe_inode_info* pipe, struct page* page,
+                    uint32_t offset, uint32_t len, uint32_t flags);
+
+/* Снять с головы канала len байт прочитанного буфера */
+void pipe_consume(struct pipe_inode_info* pipe, struct pipe_buffer* buf, uint32_t len);
+
+/* Разбудить ожидающих, если канал был пуст (полон) до изменения */
+void pipe_wake_readers(struct pipe_inode_info* pipe, bool was_empty);
+void pipe_wake_writers(struct pipe_inode_info* pipe, bool was_full);
+
+/* Канал без файлов для sendfile: только кольцо буферов */
+struct pipe_inode_info* pipe_alloc_internal(void);
+void pipe_free_internal(struct pipe_inode_info* pipe);
+
+void pipe_init(void);
+
+#endif /* MIXOS_FS_PIPE_H */
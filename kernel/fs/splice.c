@@ -0,0 +1,251 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/splice.c
+ * splice и sendfile: перемещение данных через канал без копирования
+ *
+ * splice из файла в канал кладёт в канал ссылки на страницы page cache;
+ * между каналами переходят сами буферы. Данные копируются один раз -
+ * в приёмник при splice из канала в файл, если у приёмника нет своего
+ * splice_write, принимающего страницы (как у будущих сокетов).
+ * sendfile - то же самое через внутренний канал, без пользовательского
+ * буфера. Страница в канале остаётся страницей файла: запись в файл
+ * до чтения из канала видна читателю канала.
+ * ============================================================================
+ */
+
+#include "fs/pipe.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Файл -> канал
+ * ============================================================================ */
+
+int64_t generic_file_splice_read(struct file* in, uint64_t* pos,
+                                 struct pipe_inode_info* pipe, size_t len) {
+    struct inode* inode = in->inode;
+    size_t done = 0;
+
+    if (*pos >= inode->size) {
+        return 0;
+    }
+    len = (size_t)MIN((uint64_t)len, inode->size - *pos);
+
+    while (done < len && !pipe_full(pipe)) {
+        uint64_t index = *pos >> PAGE_SHIFT;
+        uint32_t offset = *pos & (PAGE_SIZE - 1);
+        uint32_t chunk = (uint32_t)MIN((size_t)(PAGE_SIZE - offset), len - done);
+
+        struct page* page;
+        int err = read_cache_page(&inode->mapping, index, &page);
+        if (err < 0) {
+            return done ? (int64_t)done : err;
+        }
+        /* Ссылка из read_cache_page переходит к буферу канала */
+        pipe_push_page(pipe, page, offset, chunk, 0);
+        done += chunk;
+        *pos += chunk;
+    }
+    return (int64_t)done;
+}
+
+/* Файл без page cache: чтение в собственные страницы канала */
+static int64_t default_splice_read(struct file* in, uint64_t* pos,
+                                   struct pipe_inode_info* pipe, size_t len) {
+    size_t done = 0;
+
+    while (done < len && !pipe_full(pipe)) {
+        struct page* page = alloc_page();
+        if (!page) {
+            return done ? (int64_t)done : -ENOMEM;
+        }
+        size_t chunk = MIN((size_t)PAGE_SIZE, len - done);
+        int64_t n = in->f_op->read(in, page_address(page), chunk, pos);
+        if (n <= 0) {
+            put_page(page);
+            return done ? (int64_t)done : n;
+        }
+        pipe_push_page(pipe, page, 0, (uint32_t)n, PIPE_BUF_FLAG_CAN_MERGE);
+        done += (size_t)n;
+        if ((size_t)n < chunk) {
+            break;
+        }
+    }
+    return (int64_t)done;
+}
+
+static int64_t do_splice_to(struct file* in, uint64_t* pos,
+                            struct pipe_inode_info* pipe, size_t len) {
+    if (in->f_op && in->f_op->splice_read) {
+        return in->f_op->splice_read(in, pos, pipe, len);
+    }
+    if (in->f_op && in->f_op->read) {
+        return default_splice_read(in, pos, pipe, len);
+    }
+    return -EINVAL;
+}
+
+/* ============================================================================
+ * Канал -> файл
+ * ============================================================================ */
+
+/* Приёмник без splice_write получает содержимое буферов через write() */
+int64_t generic_file_splice_write(struct pipe_inode_info* pipe, struct file* out,
+                                  uint64_t* pos, size_t len) {
+    size_t done = 0;
+
+    while (done < len && !pipe_empty(pipe)) {
+        struct pipe_buffer* buf = pipe_buf(pipe, pipe->tail);
+        uint32_t chunk = (uint32_t)MIN((size_t)buf->len, len - done);
+        int64_t n = out->f_op->write(out, (uint8_t*)page_address(buf->page) + buf->offset,
+                                     chunk, pos);
+        if (n <= 0) {
+            return done ? (int64_t)done : n;
+        }
+        pipe_consume(pipe, buf, (uint32_t)n);
+        done += (size_t)n;
+        if ((uint32_t)n < chunk) {
+            break;
+        }
+    }
+    return (int64_t)done;
+}
+
+static int64_t do_splice_from(struct pipe_inode_info* pipe, struct file* out,
+                              uint64_t* pos, size_t len) {
+    if (out->f_op && out->f_op->splice_write) {
+        return out->f_op->splice_write(pipe, out, pos, len);
+    }
+    if (out->f_op && out->f_op->write) {
+        return generic_file_splice_write(pipe, out, pos, len);
+    }
+    return -EINVAL;
+}
+
+/* ============================================================================
+ * Канал -> канал
+ * ============================================================================ */
+
+/* Буферы переходят целиком; от разделённого буфера берётся ещё одна ссылка */
+static int64_t splice_pipe_to_pipe(struct pipe_inode_info* in, struct pipe_inode_info* out,
+                                   size_t len) {
+    size_t done = 0;
+
+    while (done < len && !pipe_empty(in) && !pipe_full(out)) {
+        struct pipe_buffer* buf = pipe_buf(in, in->tail);
+        if (buf->len <= len - done) {
+            done += buf->len;
+            pipe_push_page(out, buf->page, buf->offset, buf->len, buf->flags);
+            buf->page = NULL;
+            buf->len = 0;
+            in->tail++;
+        } else {
+            uint32_t chunk = (uint32_t)(len - done);
+            get_page(buf->page);
+            /* Страница теперь общая: дописывать в неё нельзя ни одному каналу */
+            buf->flags &= ~PIPE_BUF_FLAG_CAN_MERGE;
+            pipe_push_page(out, buf->page, buf->offset, chunk, 0);
+            pipe_consume(in, buf, chunk);
+            done += chunk;
+        }
+    }
+    return (int64_t)done;
+}
+
+/* ============================================================================
+ * Системные вызовы
+ * ============================================================================ */
+
+int64_t vfs_splice(struct file* in, uint64_t* in_pos, struct file* out, uint64_t* out_pos,
+                   size_t len) {
+    if ((in->flags & O_ACCMODE) == O_WRONLY || (out->flags & O_ACCMODE) == O_RDONLY) {
+        return -EBADF;
+    }
+    struct pipe_inode_info* ipipe = get_pipe_info(in);
+    struct pipe_inode_info* opipe = get_pipe_info(out);
+    if (len == 0) {
+        return 0;
+    }
+
+    if (ipipe) {
+        if (in_pos) {
+            return -ESPIPE;
+        }
+        if (pipe_empty(ipipe)) {
+            return ipipe->writers ? -EAGAIN : 0;
+        }
+    }
+    if (opipe) {
+        if (out_pos) {
+            return -ESPIPE;
+        }
+        if (opipe->readers == 0) {
+            return -EPIPE;
+        }
+        if (pipe_full(opipe)) {
+            return -EAGAIN;
+        }
+    }
+
+    if (ipipe == opipe || (!ipipe && !opipe)) {
+        return -EINVAL;
+    }
+
+    /* Пробуждения - один раз за вызов, а не на каждый перенесённый буфер */
+    bool was_full = ipipe && pipe_full(ipipe);
+    bool was_empty = opipe && pipe_empty(opipe);
+    int64_t ret;
+    if (ipipe && opipe) {
+        ret = splice_pipe_to_pipe(ipipe, opipe, len);
+    } else if (ipipe) {
+        ret = do_splice_from(ipipe, out, out_pos ? out_pos : &out->pos, len);
+    } else {
+        ret = do_splice_to(in, in_pos ? in_pos : &in->pos, opipe, len);
+    }
+    if (ipipe) {
+        pipe_wake_writers(ipipe, was_full);
+    }
+    if (opipe) {
+        pipe_wake_readers(opipe, was_empty);
+    }
+    return ret;
+}
+
+int64_t vfs_sendfile(struct file* out, struct file* in, uint64_t* pos, size_t count) {
+    if ((in->flags & O_ACCMODE) == O_WRONLY || (out->flags & O_ACCMODE) == O_RDONLY) {
+        return -EBADF;
+    }
+    if (get_pipe_info(in)) {
+        return -EINVAL;
+    }
+    if (get_pipe_info(out)) {
+        return vfs_splice(in, pos, out, NULL, count);
+    }
+
+    struct pipe_inode_info* pipe = pipe_alloc_internal();
+    if (!pipe) {
+        return -ENOMEM;
+    }
+    uint64_t* in_pos = pos ? pos : &in->pos;
+    size_t done = 0;
+    int64_t err = 0;
+
+    while (done < count) {
+        int64_t n = do_splice_to(in, in_pos, pipe, count - done);
+        if (n <= 0) {
+            err = n;
+            break;
+        }
+        int64_t written = do_splice_from(pipe, out, &out->pos, (size_t)n);
+        if (written > 0) {
+            done += (size_t)written;
+        }
+        if (written < n) {
+            /* Непереданный остаток снова достанется следующему чтению */
+            *in_pos -= (uint64_t)(n - MAX(written, 0));
+            err = written;
+            break;
+        }
+    }
+    pipe_free_internal(pipe);
+    return done ? (int64_t)done : err;
+}
@@ -0,0 +1,767 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/vfs.c
+ * Виртуальная файловая система: кеш inode, разбор путей, файловые операции
+ * ============================================================================
+ */
+
+#include "fs/vfs.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+#define INODE_HASH_SIZE     1024
+#define INODE_UNUSED_LIMIT  4096
+#define VFS_MAX_MOUNTS      16
+
+struct vfs_mount {
+    struct inode* mountpoint;       /* Каталог, поверх которого смонтирована ФС */
+    struct super_block* sb;
+};
+
+static struct list_head filesystems = LIST_HEAD_INIT(filesystems);
+static struct super_block* root_sb;
+static struct vfs_mount mounts[VFS_MAX_MOUNTS];
+static size_t mount_count;
+
+static struct inode* inode_hash[INODE_HASH_SIZE];
+static struct list_head inode_unused = LIST_HEAD_INIT(inode_unused);
+static size_t inode_unused_count;
+
+/* ============================================================================
+ * Инициализация и регистрация файловых систем
+ * ============================================================================ */
+
+void vfs_init(void) {
+    root_sb = NULL;
+    mount_count = 0;
+    memset(inode_hash, 0, sizeof(inode_hash));
+}
+
+void register_filesystem(struct filesystem_type* type) {
+    list_add_tail(&type->list, &filesystems);
+}
+
+static struct filesystem_type* find_filesystem(const char* name) {
+    struct list_head* pos;
+    list_for_each(pos, &filesystems) {
+        struct filesystem_type* type = list_entry(pos, struct filesystem_type, list);
+        if (strcmp(type->name, name) == 0) {
+            return type;
+        }
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * Кеш inode
+ * ============================================================================ */
+
+static inline size_t inode_hashfn(const struct super_block* sb, uint64_t ino) {
+    uint64_t key = (uint64_t)(uintptr_t)sb ^ (ino * 0x9E3779B97F4A7C15ULL);
+    return (size_t)((key ^ (key >> 32)) & (INODE_HASH_SIZE - 1));
+}
+
+static struct inode* inode_alloc(struct super_block* sb, uint64_t ino) {
+    struct inode* inode = sb->s_op->alloc_inode
+                        ? sb->s_op->alloc_inode(sb)
+                        : kzalloc(sizeof(struct inode));
+    if (!inode) {
+        return NULL;
+    }
+    inode->ino = ino;
+    inode->sb = sb;
+    inode->refcount = 1;
+    inode->state = 0;
+    list_init(&inode->lru);
+    list_init(&inode->dirty);
+    address_space_init(&inode->mapping, NULL, inode);
+    return inode;
+}
+
+static void inode_destroy(struct inode* inode) {
+    if (inode->sb->s_op->destroy_inode) {
+        inode->sb->s_op->destroy_inode(inode);
+    } else {
+        kfree(inode);
+    }
+}
+
+static void inode_hash_insert(struct inode* inode) {
+    size_t bucket = inode_hashfn(inode->sb, inode->ino);
+    inode->hash_next = inode_hash[bucket];
+    inode_hash[bucket] = inode;
+}
+
+static void inode_hash_remove(struct inode* inode) {
+    struct inode** link = &inode_hash[inode_hashfn(inode->sb, inode->ino)];
+    while (*link && *link != inode) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = inode->hash_next;
+    }
+    inode->hash_next = NULL;
+}
+
+int iget(struct super_block* sb, uint64_t ino, struct inode** out) {
+    for (struct inode* inode = inode_hash[inode_hashfn(sb, ino)]; inode; inode = inode->hash_next) {
+        if (inode->sb == sb && inode->ino == ino) {
+            if (inode->refcount++ == 0) {
+                list_del(&inode->lru);
+                inode_unused_count--;
+            }
+            *out = inode;
+            return 0;
+        }
+    }
+
+    struct inode* inode = inode_alloc(sb, ino);
+    if (!inode) {
+        return -ENOMEM;
+    }
+    int err = sb->s_op->read_inode(inode);
+    if (err < 0) {
+        inode_destroy(inode);
+        return err;
+    }
+    inode_hash_insert(inode);
+    *out = inode;
+    return 0;
+}
+
+struct inode* new_inode(struct super_block* sb, uint64_t ino) {
+    struct inode* inode = inode_alloc(sb, ino);
+    if (inode) {
+        inode_hash_insert(inode);
+    }
+    return inode;
+}
+
+void ihold(struct inode* inode) {
+    inode->refcount++;
+}
+
+void mark_inode_dirty(struct inode* inode) {
+    if (!(inode->state & I_DIRTY)) {
+        inode->state |= I_DIRTY;
+        list_add_tail(&inode->dirty, &inode->sb->dirty_inodes);
+    }
+}
+
+int write_inode_now(struct inode* inode) {
+    if (!(inode->state & I_DIRTY)) {
+        return 0;
+    }
+    inode->state &= ~I_DIRTY;
+    list_del(&inode->dirty);
+    return inode->sb->s_op->write_inode(inode);
+}
+
+/* Запись данных и метаданных inode */
+static int sync_inode(struct inode* inode) {
+    int err = 0;
+    if (inode->mapping.a_ops) {
+        err = sync_mapping(&inode->mapping);
+    }
+    int werr = write_inode_now(inode);
+    return err < 0 ? err : werr;
+}
+
+/* Окончательное удаление inode из памяти */
+static void inode_evict(struct inode* inode) {
+    if (inode->nlink == 0) {
+        inode->state |= I_FREEING;
+        truncate_mapping(&inode->mapping, 0);
+        if (inode->state & I_DIRTY) {
+            inode->state &= ~I_DIRTY;
+            list_del(&inode->dirty);
+        }
+        if (inode->sb->s_op->evict_inode) {
+            inode->sb->s_op->evict_inode(inode);
+        }
+        /* Освобождение блоков снова помечает inode грязным */
+        if (inode->state & I_DIRTY) {
+            inode->state &= ~I_DIRTY;
+            list_del(&inode->dirty);
+        }
+    } else {
+        sync_inode(inode);
+        truncate_mapping(&inode->mapping, 0);
+    }
+    inode_hash_remove(inode);
+    inode_destroy(inode);
+}
+
+void iput(struct inode* inode) {
+    if (!inode || --inode->refcount > 0) {
+        return;
+    }
+
+    if (inode->nlink == 0) {
+        inode_evict(inode);
+        return;
+    }
+
+    /* Неиспользуемые inode остаются в кеше до превышения лимита */
+    list_add(&inode->lru, &inode_unused);
+    inode_unused_count++;
+    while (inode_unused_count > INODE_UNUSED_LIMIT) {
+        struct inode* victim = list_entry(inode_unused.prev, struct inode, lru);
+        list_del(&victim->lru);
+        inode_unused_count--;
+        inode_evict(victim);
+    }
+}
+
+/* ============================================================================
+ * Монтирование
+ * ============================================================================ */
+
+static int do_mount(const char* path, struct filesystem_type* type,
+                    struct block_device* bdev, const char* options) {
+    if (root_sb && mount_count == VFS_MAX_MOUNTS) {
+        return -EBUSY;
+    }
+
+    struct super_block* sb = kzalloc(sizeof(*sb));
+    if (!sb) {
+        return -ENOMEM;
+    }
+    sb->bdev = bdev;
+    sb->type = type;
+    sb->options = options;
+    list_init(&sb->dirty_inodes);
+
+    int err = type->mount(bdev, sb);
+    sb->options = NULL;
+    if (err < 0) {
+        kfree(sb);
+        return err;
+    }
+
+    if (!root_sb) {
+        root_sb = sb;
+        return 0;
+    }
+
+    struct inode* mountpoint;
+    err = vfs_lookup(path, &mountpoint);
+    if (err == 0 && !S_ISDIR(mountpoint->mode)) {
+        iput(mountpoint);
+        err = -ENOTDIR;
+    }
+    if (err < 0) {
+        if (type->unmount) {
+            type->unmount(sb);
+        }
+        kfree(sb);
+        return err;
+    }
+
+    mounts[mount_count].mountpoint = mountpoint;
+    mounts[mount_count].sb = sb;
+    mount_count++;
+    return 0;
+}
+
+int vfs_mount(const char* path, const char* fstype, struct block_device* bdev,
+              const char* options) {
+    struct filesystem_type* type = find_filesystem(fstype);
+    if (!type) {
+        return -ENODEV;
+    }
+    return do_mount(path, type, bdev, options);
+}
+
+int vfs_mount_any(const char* path, struct block_device* bdev, const char* options,
+                  const char** fstype) {
+    struct list_head* pos;
+    list_for_each(pos, &filesystems) {
+        struct filesystem_type* type = list_entry(pos, struct filesystem_type, list);
+        if (do_mount(path, type, bdev, options) == 0) {
+            if (fstype) {
+                *fstype = type->name;
+            }
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+/* Переход через точку монтирования к корню смонтированной ФС */
+static struct inode* follow_mount(struct inode* inode) {
+    for (size_t i = 0; i < mount_count; i++) {
+        if (mounts[i].mountpoint == inode) {
+            struct inode* root = mounts[i].sb->root;
+            ihold(root);
+            iput(inode);
+            return root;
+        }
+    }
+    return inode;
+}
+
+/* ============================================================================
+ * Разбор путей
+ * ============================================================================ */
+
+/*
+ * Проход по абсолютному пути. Если last != NULL, останавливается на
+ * родительском каталоге последнего компонента и возвращает его имя.
+ */
+static int path_walk(const char* path, struct inode** out,
+                     const char** last, size_t* last_len) {
+    if (!root_sb) {
+        return -ENOENT;
+    }
+    if (path[0] != '/') {
+        return -EINVAL;
+    }
+
+    struct inode* inode = root_sb->root;
+    ihold(inode);
+
+    const char* p = path;
+    while (1) {
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        const char* name = p;
+        while (*p && *p != '/') {
+            p++;
+        }
+        size_t len = (size_t)(p - name);
+
+        /* Последний компонент при поиске родителя */
+        const char* rest = p;
+        while (*rest == '/') {
+            rest++;
+        }
+        if (last && *rest == '\0') {
+            *last = name;
+            *last_len = len;
+            *out = inode;
+            return 0;
+        }
+
+        if (!S_ISDIR(inode->mode)) {
+            iput(inode);
+            return -ENOTDIR;
+        }
+        if (len > VFS_NAME_MAX) {
+            iput(inode);
+            return -ENAMETOOLONG;
+        }
+        if (len == 1 && name[0] == '.') {
+            continue;
+        }
+
+        struct inode* next;
+        int err = inode->i_op->lookup(inode, name, len, &next);
+        iput(inode);
+        if (err < 0) {
+            return err;
+        }
+        inode = follow_mount(next);
+    }
+
+    if (last) {
+        /* Путь "/" не имеет последнего компонента */
+        iput(inode);
+        return -EINVAL;
+    }
+    *out = inode;
+    return 0;
+}
+
+int vfs_lookup(const char* path, struct inode** out) {
+    return path_walk(path, out, NULL, NULL);
+}
+
+/* ============================================================================
+ * Файлы
+ * ============================================================================ */
+
+struct file* file_alloc(struct inode* inode, uint32_t flags) {
+    struct file* file = kzalloc(sizeof(*file));
+    if (!file) {
+        return NULL;
+    }
+    file->inode = inode;
+    file->flags = flags;
+    file->refcount = 1;
+    file->f_op = inode ? inode->f_op : NULL;
+    return file;
+}
+
+void fput(struct file* file) {
+    if (--file->refcount > 0) {
+        return;
+    }
+    if (file->f_op && file->f_op->release) {
+        file->f_op->release(file);
+    }
+    iput(file->inode);
+    kfree(file);
+}
+
+int vfs_open(const char* path, uint32_t flags, uint32_t mode, struct file** out) {
+    struct inode* inode;
+    int err;
+
+    if (flags & O_CREAT) {
+        struct inode* dir;
+        const char* name;
+        size_t len;
+
+        err = path_walk(path, &dir, &name, &len);
+        if (err < 0) {
+            return err;
+        }
+        if (!S_ISDIR(dir->mode)) {
+            iput(dir);
+            return -ENOTDIR;
+        }
+        if (len > VFS_NAME_MAX) {
+            iput(dir);
+            return -ENAMETOOLONG;
+        }
+
+        err = dir->i_op->lookup(dir, name, len, &inode);
+        if (err == -ENOENT) {
+            if (dir->sb->flags & SB_RDONLY) {
+                err = -EROFS;
+            } else if (!dir->i_op->create) {
+                err = -EPERM;
+            } else {
+                err = dir->i_op->create(dir, name, len, S_IFREG | (mode & 07777), &inode);
+            }
+        } else if (err == 0) {
+            inode = follow_mount(inode);
+            if (flags & O_EXCL) {
+                iput(inode);
+                err = -EEXIST;
+            }
+        }
+        iput(dir);
+        if (err < 0) {
+            return err;
+        }
+    } else {
+        err = vfs_lookup(path, &inode);
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    bool writable = (flags & O_ACCMODE) != O_RDONLY;
+    if ((flags & O_DIRECTORY) && !S_ISDIR(inode->mode)) {
+        err = -ENOTDIR;
+    } else if (S_ISDIR(inode->mode) && writable) {
+        err = -EISDIR;
+    } else if (writable && (inode->sb->flags & SB_RDONLY)) {
+        err = -EROFS;
+    } else if ((flags & O_TRUNC) && writable && S_ISREG(inode->mode) && inode->size) {
+        err = inode->i_op->truncate ? inode->i_op->truncate(inode, 0) : -EPERM;
+    }
+    if (err < 0) {
+        iput(inode);
+        return err;
+    }
+
+    struct file* file = file_alloc(inode, flags);
+    if (!file) {
+        iput(inode);
+        return -ENOMEM;
+    }
+    *out = file;
+    return 0;
+}
+
+int64_t vfs_read(struct file* file, void* buffer, size_t count) {
+    if ((file->flags & O_ACCMODE) == O_WRONLY) {
+        return -EBADF;
+    }
+    if (!file->f_op || !file->f_op->read) {
+        return S_ISDIR(file->inode->mode) ? -EISDIR : -EINVAL;
+    }
+    return file->f_op->read(file, buffer, count, &file->pos);
+}
+
+int64_t vfs_write(struct file* file, const void* buffer, size_t count) {
+    if ((file->flags & O_ACCMODE) == O_RDONLY) {
+        return -EBADF;
+    }
+    if (!file->f_op || !file->f_op->write) {
+        return -EINVAL;
+    }
+    return file->f_op->write(file, buffer, count, &file->pos);
+}
+
+int vfs_readdir(struct file* file, filldir_t filldir, void* ctx) {
+    if (!S_ISDIR(file->inode->mode)) {
+        return -ENOTDIR;
+    }
+    if (!file->f_op || !file->f_op->readdir) {
+        return -EINVAL;
+    }
+    return file->f_op->readdir(file, filldir, ctx);
+}
+
+int vfs_fsync(struct file* file) {
+    if (file->f_op && file->f_op->fsync) {
+        return file->f_op->fsync(file);
+    }
+    return 0;
+}
+
+void vfs_close(struct file* file) {
+    fput(file);
+}
+
+/* Общая часть mkdir/unlink/rmdir: поиск родительского каталога */
+static int lookup_parent(const char* path, struct inode** dir,
+                         const char** name, size_t* len) {
+    int err = path_walk(path, dir, name, len);
+    if (err < 0) {
+        return err;
+    }
+    if (!S_ISDIR((*dir)->mode)) {
+        iput(*dir);
+        return -ENOTDIR;
+    }
+    if (*len > VFS_NAME_MAX) {
+        iput(*dir);
+        return -ENAMETOOLONG;
+    }
+    if ((*dir)->sb->flags & SB_RDONLY) {
+        iput(*dir);
+        return -EROFS;
+    }
+    return 0;
+}
+
+int vfs_mkdir(const char* path, uint32_t mode) {
+    struct inode* dir;
+    const char* name;
+    size_t len;
+
+    int err = lookup_parent(path, &dir, &name, &len);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode;
+    err = dir->i_op->lookup(dir, name, len, &inode);
+    if (err == 0) {
+        iput(inode);
+        err = -EEXIST;
+    } else if (err == -ENOENT) {
+        err = dir->i_op->mkdir
+            ? dir->i_op->mkdir(dir, name, len, S_IFDIR | (mode & 07777), &inode)
+            : -EPERM;
+        if (err == 0) {
+            iput(inode);
+        }
+    }
+    iput(dir);
+    return err;
+}
+
+/* Удаление записи каталога с проверкой типа цели */
+static int vfs_remove(const char* path, bool directory) {
+    struct inode* dir;
+    const char* name;
+    size_t len;
+
+    int err = lookup_parent(path, &dir, &name, &len);
+    if (err < 0) {
+        return err;
+    }
+
+    struct inode* inode;
+    err = dir->i_op->lookup(dir, name, len, &inode);
+    if (err == 0) {
+        bool is_dir = S_ISDIR(inode->mode);
+        iput(inode);
+        if (directory && !is_dir) {
+            err = -ENOTDIR;
+        } else if (!directory && is_dir) {
+            err = -EISDIR;
+        } else if (directory) {
+            err = dir->i_op->rmdir ? dir->i_op->rmdir(dir, name, len) : -EPERM;
+        } else {
+            err = dir->i_op->unlink ? dir->i_op->unlink(dir, name, len) : -EPERM;
+        }
+    }
+    iput(dir);
+    return err;
+}
+
+int vfs_unlink(const char* path) {
+    return vfs_remove(path, false);
+}
+
+int vfs_rmdir(const char* path) {
+    return vfs_remove(path, true);
+}
+
+/* Запись всех грязных данных и метаданных одной ФС */
+static int sync_super(struct super_block* sb) {
+    int result = 0;
+
+    for (size_t i = 0; i < INODE_HASH_SIZE; i++) {
+        for (struct inode* inode = inode_hash[i]; inode; inode = inode->hash_next) {
+            if (inode->sb != sb) {
+                continue;
+            }
+            int err = sync_inode(inode);
+            if (err < 0 && result == 0) {
+                result = err;
+            }
+        }
+    }
+    if (sb->s_op->sync_fs) {
+        int err = sb->s_op->sync_fs(sb);
+        if (err < 0 && result == 0) {
+            result = err;
+        }
+    }
+    int err = bdev_sync(sb->bdev);
+    return result < 0 ? result : err;
+}
+
+int vfs_sync(void) {
+    if (!root_sb) {
+        return 0;
+    }
+    int result = sync_super(root_sb);
+    for (size_t i = 0; i < mount_count; i++) {
+        int err = sync_super(mounts[i].sb);
+        if (err < 0 && result == 0) {
+            result = err;
+        }
+    }
+    return result;
+}
+
+/* ============================================================================
+ * Общие файловые операции поверх page cache
+ * ============================================================================ */
+
+int64_t generic_file_read(struct file* file, void* buffer, size_t count, uint64_t* pos) {
+    struct inode* inode = file->inode;
+    uint8_t* out = buffer;
+    size_t done = 0;
+
+    if (*pos >= inode->size) {
+        return 0;
+    }
+    count = (size_t)MIN((uint64_t)count, inode->size - *pos);
+
+    while (done < count) {
+        uint64_t index = *pos >> PAGE_SHIFT;
+        size_t offset = *pos & (PAGE_SIZE - 1);
+        size_t chunk = MIN(PAGE_SIZE - offset, count - done);
+
+        struct page* page;
+        int err = read_cache_page(&inode->mapping, index, &page);
+        if (err < 0) {
+            return done ? (int64_t)done : err;
+        }
+        memcpy(out + done, (uint8_t*)page_address(page) + offset, chunk);
+        page_cache_release(page);
+
+        done += chunk;
+        *pos += chunk;
+    }
+    return (int64_t)done;
+}
+
+/* Страница для записи chunk байт: читать с диска нужно только
+ * при частичной перезаписи уже существующих данных */
+static int prepare_write_page(struct inode* inode, uint64_t index,
+                              size_t chunk, struct page** out) {
+    uint64_t page_start = index << PAGE_SHIFT;
+
+    if (chunk < PAGE_SIZE && page_start < inode->size) {
+        return read_cache_page(&inode->mapping, index, out);
+    }
+
+    struct page* page = grab_cache_page(&inode->mapping, index);
+    if (!page) {
+        return -ENOMEM;
+    }
+    if (!(page->flags & PG_UPTODATE)) {
+        memset(page_address(page), 0, PAGE_SIZE);
+        page->flags |= PG_UPTODATE;
+    }
+    *out = page;
+    return 0;
+}
+
+int64_t generic_file_write(struct file* file, const void* buffer, size_t count, uint64_t* pos) {
+    struct inode* inode = file->inode;
+    struct address_space* mapping = &inode->mapping;
+    const uint8_t* in = buffer;
+    size_t done = 0;
+    int err = 0;
+
+    if (file->flags & O_APPEND) {
+        *pos = inode->size;
+    }
+
+    while (done < count) {
+        uint64_t index = *pos >> PAGE_SHIFT;
+        size_t offset = *pos & (PAGE_SIZE - 1);
+        size_t chunk = MIN(PAGE_SIZE - offset, count - done);
+
+        struct page* page;
+        err = prepare_write_page(inode, index, chunk, &page);
+        if (err < 0) {
+            break;
+        }
+        if (mapping->a_ops->write_begin) {
+            err = mapping->a_ops->write_begin(mapping, page, (uint32_t)offset,
+                                              (uint32_t)(offset + chunk));
+            if (err < 0) {
+                page_cache_release(page);
+                break;
+            }
+        }
+
+        memcpy((uint8_t*)page_address(page) + offset, in + done, chunk);
+        set_page_dirty(page);
+        page_cache_release(page);
+
+        done += chunk;
+        *pos += chunk;
+        if (*pos > inode->size) {
+            inode->size = *pos;
+        }
+    }
+
+    if (done) {
+        mark_inode_dirty(inode);
+        return (int64_t)done;
+    }
+    return err;
+}
+
+int generic_file_fsync(struct file* file) {
+    struct inode* inode = file->inode;
+    struct super_block* sb = inode->sb;
+
+    int err = sync_inode(inode);
+    if (err == 0 && sb->s_op->sync_fs) {
+        err = sb->s_op->sync_fs(sb);
+    }
+    if (err == 0) {
+        err = bdev_sync(sb->bdev);
+    }
+    return err;
+}
@@ -0,0 +1,237 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/fs/vfs.h
+ * Виртуальная файловая система: inode, суперблоки, файлы, монтирование
+ * ============================================================================
+ */
+
+#ifndef MIXOS_FS_VFS_H
+#define MIXOS_FS_VFS_H
+
+#include "kernel.h"
+#include "lib/list.h"
+#include "mm/page_cache.h"
+#include "block/block.h"
+
+/* Типы файлов и права (совместимы с POSIX) */
+#define S_IFMT      0170000
+#define S_IFSOCK    0140000
+#define S_IFLNK     0120000
+#define S_IFREG     0100000
+#define S_IFBLK     0060000
+#define S_IFDIR     0040000
+#define S_IFCHR     0020000
+#define S_IFIFO     0010000
+
+#define S_ISREG(m)  (((m) & S_IFMT) == S_IFREG)
+#define S_ISDIR(m)  (((m) & S_IFMT) == S_IFDIR)
+#define S_ISLNK(m)  (((m) & S_IFMT) == S_IFLNK)
+#define S_ISFIFO(m) (((m) & S_IFMT) == S_IFIFO)
+
+/* Флаги открытия файла */
+#define O_RDONLY    0x0000
+#define O_WRONLY    0x0001
+#define O_RDWR      0x0002
+#define O_ACCMODE   0x0003
+#define O_CREAT     0x0040
+#define O_EXCL      0x0080
+#define O_TRUNC     0x0200
+#define O_APPEND    0x0400
+#define O_DIRECTORY 0x10000
+
+/* Типы записей каталога для readdir */
+#define DT_UNKNOWN  0
+#define DT_FIFO     1
+#define DT_CHR      2
+#define DT_DIR      4
+#define DT_BLK      6
+#define DT_REG      8
+#define DT_LNK      10
+#define DT_SOCK     12
+
+#define VFS_NAME_MAX 255
+
+struct inode;
+struct file;
+struct super_block;
+struct pipe_inode_info;
+
+/* Флаги состояния inode */
+#define I_DIRTY     (1U << 0)   /* Метаданные inode изменены */
+#define I_FREEING   (1U << 1)   /* Inode удаляется */
+
+struct inode {
+    uint64_t ino;
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t nlink;
+    uint64_t size;
+    uint32_t atime;
+    uint32_t mtime;
+    uint32_t ctime;
+    uint32_t state;
+    int32_t refcount;
+    struct super_block* sb;
+    const struct inode_operations* i_op;
+    const struct file_operations* f_op;
+    struct address_space mapping;
+    struct inode* hash_next;
+    struct list_head lru;           /* Список неиспользуемых inode */
+    struct list_head dirty;         /* Список грязных inode суперблока */
+};
+
+/* Обратный вызов readdir: ненулевой результат останавливает обход */
+typedef int (*filldir_t)(void* ctx, const char* name, size_t len,
+                         uint64_t ino, uint8_t type);
+
+struct inode_operations {
+    int (*lookup)(struct inode* dir, const char* name, size_t len, struct inode** out);
+    int (*create)(struct inode* dir, const char* name, size_t len,
+                  uint32_t mode, struct inode** out);
+    int (*mkdir)(struct inode* dir, const char* name, size_t len,
+                 uint32_t mode, struct inode** out);
+    int (*unlink)(struct inode* dir, const char* name, size_t len);
+    int (*rmdir)(struct inode* dir, const char* name, size_t len);
+    int (*truncate)(struct inode* inode, uint64_t size);
+};
+
+struct file_operations {
+    int64_t (*read)(struct file* file, void* buffer, size_t count, uint64_t* pos);
+    int64_t (*write)(struct file* file, const void* buffer, size_t count, uint64_t* pos);
+    int (*readdir)(struct file* file, filldir_t filldir, void* ctx);
+    int (*fsync)(struct file* file);
+    void (*release)(struct file* file);
+    /* Необязательно: передача данных в канал и из канала ссылками на
+     * страницы (без них splice читает и пишет через read/write) */
+    int64_t (*splice_read)(struct file* in, uint64_t* pos, struct pipe_inode_info* pipe,
+                           size_t len);
+    int64_t (*splice_write)(struct pipe_inode_info* pipe, struct file* out, uint64_t* pos,
+                            size_t len);
+};
+
+struct super_operations {
+    struct inode* (*alloc_inode)(struct super_block* sb);
+    void (*destroy_inode)(struct inode* inode);
+    int (*read_inode)(struct inode* inode);
+    int (*write_inode)(struct inode* inode);
+    /* Последняя ссылка на inode без жёстких ссылок: освободить на диске */
+    void (*evict_inode)(struct inode* inode);
+    int (*sync_fs)(struct super_block* sb);
+};
+
+struct super_block {
+    struct block_device* bdev;
+    uint32_t block_size;
+    uint32_t flags;
+    const struct super_operations* s_op;
+    const struct filesystem_type* type;
+    struct inode* root;
+    void* fs_info;
+    struct list_head dirty_inodes;
+    const char* options;            /* Параметры монтирования "a=1,b" (NULL - нет), только в mount */
+};
+
+#define SB_RDONLY   (1U << 0)
+
+struct filesystem_type {
+    const char* name;
+    int (*mount)(struct block_device* bdev, struct super_block* sb);
+    void (*unmount)(struct super_block* sb);
+    struct list_head list;
+};
+
+struct file {
+    struct inode* inode;
+    uint64_t pos;
+    uint32_t flags;
+    int32_t refcount;
+    const struct file_operations* f_op;
+    void* private;
+};
+
+/* ============================================================================
+ * Инициализация и регистрация
+ * ============================================================================ */
+
+void vfs_init(void);
+void register_filesystem(struct filesystem_type* type);
+
+/*
+ * Монтирование: первая смонтированная ФС становится корнем "/".
+ * options - параметры через запятую, ФС разбирает их в mount.
+ */
+int vfs_mount(const char* path, const char* fstype, struct block_device* bdev,
+              const char* options);
+
+/* Перебор зарегистрированных ФС, пока одна не примет устройство */
+int vfs_mount_any(const char* path, struct block_device* bdev, const char* options,
+                  const char** fstype);
+
+/* ============================================================================
+ * Кеш inode
+ * ============================================================================ */
+
+int iget(struct super_block* sb, uint64_t ino, struct inode** out);
+struct inode* new_inode(struct super_block* sb, uint64_t ino);
+void ihold(struct inode* inode);
+void iput(struct inode* inode);
+void mark_inode_dirty(struct inode* inode);
+int write_inode_now(struct inode* inode);
+
+/* ============================================================================
+ * Операции над путями и файлами
+ * ============================================================================ */
+
+int vfs_lookup(const char* path, struct inode** out);
+int vfs_open(const char* path, uint32_t flags, uint32_t mode, struct file** out);
+int64_t vfs_read(struct file* file, void* buffer, size_t count);
+int64_t vfs_write(struct file* file, const void* buffer, size_t count);
+int vfs_readdir(struct file* file, filldir_t filldir, void* ctx);
+int vfs_fsync(struct file* file);
+void vfs_close(struct file* file);
+int vfs_mkdir(const char* path, uint32_t mode);
+int vfs_unlink(const char* path);
+int vfs_rmdir(const char* path);
+int vfs_sync(void);
+
+/* Канал: чтение с read_end, запись в write_end */
+int vfs_pipe(struct file** read_end, struct file** write_end);
+
+/* Ёмкость канала в байтах; установка возвращает округлённую ёмкость */
+int64_t vfs_pipe_get_size(struct file* file);
+int64_t vfs_pipe_set_size(struct file* file, size_t size);
+
+/*
+ * Запись страницы в канал без копирования: при успехе ссылка на page
+ * переходит каналу, при ошибке остаётся у вызывающего.
+ */
+int64_t vfs_pipe_write_page(struct file* file, struct page* page, uint32_t offset, uint32_t len);
+
+/*
+ * Перемещение до len байт между каналом и файлом (или двумя каналами)
+ * без пользовательского буфера. Позиция NULL - позиция файла; для
+ * канала позиция не допускается (-ESPIPE).
+ */
+int64_t vfs_splice(struct file* in, uint64_t* in_pos, struct file* out, uint64_t* out_pos,
+                   size_t len);
+
+/* Копирование из файла в файл или канал через page cache (pos NULL - позиция in) */
+int64_t vfs_sendfile(struct file* out, struct file* in, uint64_t* pos, size_t count);
+
+struct file* file_alloc(struct inode* inode, uint32_t flags);
+void fput(struct file* file);
+
+/* ============================================================================
+ * Общие реализации для файловых систем на page cache
+ * ============================================================================ */
+
+int64_t generic_file_read(struct file* file, void* buffer, size_t count, uint64_t* pos);
+int64_t generic_file_write(struct file* file, const void* buffer, size_t count, uint64_t* pos);
+int generic_file_fsync(struct file* file);
+int64_t generic_file_splice_read(struct file* in, uint64_t* pos,
+                                 struct pipe_inode_info* pipe, size_t len);
+int64_t generic_file_splice_write(struct pipe_inode_info* pipe, struct file* out,
+                                  uint64_t* pos, size_t len);
+
+#endif /* MIXOS_FS_VFS_H */
@@ -5,8 +5,30 @@
  * ============================================================================
  */
 
-#include <stdint.h>
-#include <stddef.h>
+#include "kernel.h"
+#include "cpu/cpu.h"
+#include "cpu/fpu.h"
+#include "cpu/tsc.h"
+#include "lib/crc_accel.h"
+#include "acpi/acpi.h"
+#include "mm/pmm.h"
+#include "mm/page_cache.h"
+#include "mm/mm.h"
+#include "mm/huge_mm.h"
+#include "block/block.h"
+#include "block/zram.h"
+#include "mm/swap.h"
+#include "mm/ksm.h"
+#include "mm/compaction.h"
+#include "mm/page_reporting.h"
+#include "virtio/virtio_balloon.h"
+#include "fs/vfs.h"
+#include "proc/task.h"
+#include "fs/pipe.h"
+#include "fs/ext2/ext2.h"
+#include "fs/fat/fat.h"
+#include "fs/mixfs/mixfs.h"
+#include "bench.h"
 
 /* ============================================================================
  * VGA текстовый режим (для отладочного вывода)
@@ -149,6 +171,41 @@ void terminal_writestring(const char* data) {
     terminal_write(data, len);
 }
 
+/* Вывод беззнакового числа в десятичном виде */
+void terminal_writedec(uint64_t value) {
+    char buffer[20];
+    size_t i = sizeof(buffer);
+    do {
+        buffer[--i] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    terminal_write(buffer + i, sizeof(buffer) - i);
+}
+
+/* Вывод числа в шестнадцатеричном виде (без префикса 0x) */
+void terminal_writehex(uint64_t value) {
+    static const char digits[] = "0123456789ABCDEF";
+    char buffer[16];
+    size_t i = sizeof(buffer);
+    do {
+        buffer[--i] = digits[value & 0xF];
+        value >>= 4;
+    } while (value);
+    terminal_write(buffer + i, sizeof(buffer) - i);
+}
+
+/* Остановка системы при неисправимой ошибке */
+void panic(const char* message) {
+    terminal_setcolor(vga_entry_color(VGA_LIGHT_RED, VGA_BLACK));
+    terminal_writestring("\n[PANIC] ");
+    terminal_writestring(message);
+    terminal_writestring("\nSystem halted.\n");
+    __asm__ volatile ("cli");
+    while (1) {
+        __asm__ volatile ("hlt");
+    }
+}
+
 /* ============================================================================
  * Базовые библиотечные функции (kernel/lib/)
  * ============================================================================ */
@@ -171,6 +228,16 @@ int strcmp(const char* s1, const char* s2) {
     return *(unsigned char*)s1 - *(unsigned char*)s2;
 }
 
+/* Сравнение не более n символов */
+int strncmp(const char* s1, const char* s2, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (s1[i] != s2[i] || !s1[i]) {
+            return (unsigned char)s1[i] - (unsigned char)s2[i];
+        }
+    }
+    return 0;
+}
+
 /* Копирование памяти */
 void* memcpy(void* dest, const void* src, size_t n) {
     uint8_t* d = (uint8_t*)dest;
@@ -181,6 +248,22 @@ void* memcpy(void* dest, const void* src, size_t n) {
     return dest;
 }
 
+/* Копирование памяти с перекрытием областей */
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    if (d < s) {
+        for (size_t i = 0; i < n; i++) {
+            d[i] = s[i];
+        }
+    } else {
+        for (size_t i = n; i > 0; i--) {
+            d[i - 1] = s[i - 1];
+        }
+    }
+    return dest;
+}
+
 /* Заполнение памяти */
 void* memset(void* s, int c, size_t n) {
     uint8_t* p = (uint8_t*)s;
@@ -190,6 +273,18 @@ void* memset(void* s, int c, size_t n) {
     return s;
 }
 
+/* Сравнение областей памяти */
+int memcmp(const void* s1, const void* s2, size_t n) {
+    const uint8_t* a = (const uint8_t*)s1;
+    const uint8_t* b = (const uint8_t*)s2;
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return a[i] - b[i];
+        }
+    }
+    return 0;
+}
+
 /* ============================================================================
  * Multiboot2 структуры
  * ============================================================================ */
@@ -220,6 +315,97 @@ struct multiboot_tag_basic_meminfo {
     uint32_t mem_upper;
 };
 
+struct multiboot_mmap_entry {
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+    uint32_t zero;
+};
+
+struct multiboot_tag_mmap {
+    uint32_t type;
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+    struct multiboot_mmap_entry entries[0];
+};
+
+/* Копия RSDP: тег 14 - ACPI 1.0, тег 15 - ACPI 2.0+ */
+struct multiboot_tag_acpi {
+    uint32_t type;
+    uint32_t size;
+    uint8_t rsdp[0];
+};
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+#define MULTIBOOT2_BOOTLOADER_MAGIC 0x36d76289
+
+/* ============================================================================
+ * PVH структуры (вход по ELF-заметке, qemu -kernel)
+ * ============================================================================ */
+
+#define PVH_START_MAGIC 0x336ec578
+
+struct hvm_start_info {
+    uint32_t magic;
+    uint32_t version;               /* С версии 1 есть карта памяти */
+    uint32_t flags;
+    uint32_t nr_modules;
+    uint64_t modlist_paddr;
+    uint64_t cmdline_paddr;
+    uint64_t rsdp_paddr;
+    uint64_t memmap_paddr;
+    uint32_t memmap_entries;
+    uint32_t reserved;
+};
+
+struct hvm_modlist_entry {
+    uint64_t paddr;
+    uint64_t size;
+    uint64_t cmdline_paddr;
+    uint64_t reserved;
+};
+
+/* Типы областей - как в E820 и Multiboot2 */
+struct hvm_memmap_table_entry {
+    uint64_t addr;
+    uint64_t size;
+    uint32_t type;
+    uint32_t reserved;
+};
+
+/* ============================================================================
+ * Карта памяти, собранная из Multiboot информации
+ * ============================================================================ */
+
+#define BOOT_MAX_REGIONS 64
+
+extern uint8_t __kernel_start[];
+extern uint8_t __kernel_end[];
+
+static struct pmm_region boot_avail[BOOT_MAX_REGIONS];
+static size_t boot_avail_count;
+static struct pmm_region boot_reserved[BOOT_MAX_REGIONS];
+static size_t boot_reserved_count;
+
+/* Первый модуль загрузчика используется как образ корневой ФС */
+static uint64_t boot_module_start;
+static uint64_t boot_module_end;
+
+static const struct acpi_rsdp* boot_rsdp;
+
+/* Командная строка ядра от загрузчика (NULL - нет) */
+static const char* boot_cmdline;
+
+static void boot_add_region(struct pmm_region* regions, size_t* count,
+                            uint64_t base, uint64_t length) {
+    if (*count < BOOT_MAX_REGIONS && length) {
+        regions[*count].base = base;
+        regions[*count].length = length;
+        (*count)++;
+    }
+}
+
 /* ============================================================================
  * Парсинг Multiboot информации
  * ============================================================================ */
@@ -228,8 +414,12 @@ void parse_multiboot_info(uint64_t multiboot_addr) {
     struct multiboot_tag* tag;
     
     terminal_writestring("Multiboot information at: 0x");
-    // TODO: добавить функцию для вывода hex чисел
+    terminal_writehex(multiboot_addr);
     terminal_writestring("\n");
+
+    /* Сама структура информации не должна попасть в аллокатор */
+    boot_add_region(boot_reserved, &boot_reserved_count,
+                    multiboot_addr, *(uint32_t*)multiboot_addr);
     
     /* Пропускаем первые 8 байт (total_size и reserved) */
     for (tag = (struct multiboot_tag*)(multiboot_addr + 8);
@@ -239,6 +429,7 @@ void parse_multiboot_info(uint64_t multiboot_addr) {
         switch (tag->type) {
             case 1: { /* Boot command line */
                 struct multiboot_tag_string* cmd = (struct multiboot_tag_string*)tag;
+                boot_cmdline = cmd->string;
                 terminal_writestring("  Command line: ");
                 terminal_writestring(cmd->string);
                 terminal_writestring("\n");
@@ -253,13 +444,298 @@ void parse_multiboot_info(uint64_t multiboot_addr) {
             }
             case 4: { /* Basic memory info */
                 struct multiboot_tag_basic_meminfo* mem = (struct multiboot_tag_basic_meminfo*)tag;
-                terminal_writestring("  Memory detected\n");
-                // TODO: вывести количество памяти
-                (void)mem; // Убираем warning
+                terminal_writestring("  Memory detected: ");
+                terminal_writedec(((uint64_t)mem->mem_lower + mem->mem_upper) / 1024);
+                terminal_writestring(" MiB\n");
+                break;
+            }
+            case 3: { /* Boot module */
+                struct multiboot_tag_module* module = (struct multiboot_tag_module*)tag;
+                terminal_writestring("  Module: ");
+                terminal_writestring(module->cmdline);
+                terminal_writestring(" (");
+                terminal_writedec((module->mod_end - module->mod_start) / 1024);
+                terminal_writestring(" KiB)\n");
+                boot_add_region(boot_reserved, &boot_reserved_count, module->mod_start,
+                                module->mod_end - module->mod_start);
+                if (!boot_module_end) {
+                    boot_module_start = module->mod_start;
+                    boot_module_end = module->mod_end;
+                }
                 break;
             }
+            case 6: { /* Memory map */
+                struct multiboot_tag_mmap* mmap = (struct multiboot_tag_mmap*)tag;
+                for (uint8_t* entry = (uint8_t*)mmap->entries;
+                     entry < (uint8_t*)tag + tag->size;
+                     entry += mmap->entry_size) {
+                    struct multiboot_mmap_entry* e = (struct multiboot_mmap_entry*)entry;
+                    if (e->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                        boot_add_region(boot_avail, &boot_avail_count, e->addr, e->len);
+                    }
+                }
+                break;
+            }
+            case 14:   /* ACPI old RSDP */
+            case 15: { /* ACPI new RSDP */
+                struct multiboot_tag_acpi* acpi = (struct multiboot_tag_acpi*)tag;
+                if (!boot_rsdp || tag->type == 15) {
+                    boot_rsdp = (const struct acpi_rsdp*)acpi->rsdp;
+                }
+                break;
+            }
+        }
+    }
+}
+
+/* ============================================================================
+ * Парсинг PVH start info
+ * ============================================================================ */
+
+static void parse_pvh_info(uint64_t start_info_addr) {
+    struct hvm_start_info* info = (struct hvm_start_info*)start_info_addr;
+
+    terminal_writestring("PVH start info at: 0x");
+    terminal_writehex(start_info_addr);
+    terminal_writestring("\n");
+
+    boot_add_region(boot_reserved, &boot_reserved_count, start_info_addr, sizeof(*info));
+
+    if (info->cmdline_paddr) {
+        boot_cmdline = (const char*)info->cmdline_paddr;
+        terminal_writestring("  Command line: ");
+        terminal_writestring((const char*)info->cmdline_paddr);
+        terminal_writestring("\n");
+    }
+
+    struct hvm_modlist_entry* modules = (struct hvm_modlist_entry*)info->modlist_paddr;
+    boot_add_region(boot_reserved, &boot_reserved_count, info->modlist_paddr,
+                    info->nr_modules * sizeof(*modules));
+    for (uint32_t i = 0; i < info->nr_modules; i++) {
+        terminal_writestring("  Module: ");
+        terminal_writedec(modules[i].size / 1024);
+        terminal_writestring(" KiB\n");
+        boot_add_region(boot_reserved, &boot_reserved_count, modules[i].paddr, modules[i].size);
+        if (!boot_module_end) {
+            boot_module_start = modules[i].paddr;
+            boot_module_end = modules[i].paddr + modules[i].size;
+        }
+    }
+
+    if (info->version >= 1 && info->memmap_paddr) {
+        struct hvm_memmap_table_entry* map = (struct hvm_memmap_table_entry*)info->memmap_paddr;
+        boot_add_region(boot_reserved, &boot_reserved_count, info->memmap_paddr,
+                        info->memmap_entries * sizeof(*map));
+        for (uint32_t i = 0; i < info->memmap_entries; i++) {
+            if (map[i].type == MULTIBOOT_MEMORY_AVAILABLE) {
+                boot_add_region(boot_avail, &boot_avail_count, map[i].addr, map[i].size);
+            }
+        }
+    } else {
+        terminal_writestring("  No memory map (PVH start info version 0)\n");
+    }
+
+    if (info->rsdp_paddr) {
+        boot_rsdp = (const struct acpi_rsdp*)info->rsdp_paddr;
+    }
+}
+
+/* ============================================================================
+ * Инициализация подсистем
+ * ============================================================================ */
+
+/*
+ * Значение параметра командной строки "name=value" (до пробела) в buf;
+ * false - параметра нет или он не поместился.
+ */
+static bool boot_param(const char* name, char* buf, size_t size) {
+    size_t name_len = strlen(name);
+    for (const char* p = boot_cmdline; p && *p; ) {
+        while (*p == ' ') {
+            p++;
+        }
+        const char* end = p;
+        while (*end && *end != ' ') {
+            end++;
+        }
+        if ((size_t)(end - p) > name_len && strncmp(p, name, name_len) == 0 &&
+            p[name_len] == '=') {
+            size_t len = (size_t)(end - p) - name_len - 1;
+            if (len >= size) {
+                return false;
+            }
+            memcpy(buf, p + name_len + 1, len);
+            buf[len] = '\0';
+            return true;
         }
+        p = end;
+    }
+    return false;
+}
+
+/* Числовой параметр "name=N"; false - параметра нет или он не число */
+static bool boot_param_u32(const char* name, uint32_t* value) {
+    char buf[16];
+    if (!boot_param(name, buf, sizeof(buf)) || !buf[0]) {
+        return false;
+    }
+    uint64_t result = 0;
+    for (const char* c = buf; *c; c++) {
+        if (*c < '0' || *c > '9' || result > UINT32_MAX / 10) {
+            return false;
+        }
+        result = result * 10 + (uint64_t)(*c - '0');
+    }
+    if (result > UINT32_MAX) {
+        return false;
+    }
+    *value = (uint32_t)result;
+    return true;
+}
+
+static void mm_init(void) {
+    /* Первый мегабайт (BIOS, VGA) и образ ядра не отдаются аллокатору */
+    boot_add_region(boot_reserved, &boot_reserved_count, 0, 0x100000);
+    boot_add_region(boot_reserved, &boot_reserved_count, (uint64_t)__kernel_start,
+                    (uint64_t)(__kernel_end - __kernel_start));
+
+    /* Узлы NUMA нужны аллокатору до раздачи кадров */
+    if (acpi_init(boot_rsdp) == 0 && acpi_numa_init() == 0) {
+        terminal_writestring("  ACPI SRAT found\n");
+    }
+    numa_init();
+
+    pmm_init(boot_avail, boot_avail_count, boot_reserved, boot_reserved_count);
+    terminal_writestring("  Physical memory: ");
+    terminal_writedec(pmm_free_pages() * PAGE_SIZE / 1024);
+    terminal_writestring(" KiB free\n");
+    for (uint32_t nid = 0; nid < nr_node_ids && nr_node_ids > 1; nid++) {
+        struct zone* zone = &NODE_DATA(nid)->zone;
+        terminal_writestring("  Node ");
+        terminal_writedec(nid);
+        terminal_writestring(": ");
+        terminal_writedec(zone->free_pages * PAGE_SIZE / 1024);
+        terminal_writestring(" KiB free, ");
+        terminal_writedec((zone->managed_pages - zone->free_pages) * PAGE_SIZE / 1024);
+        terminal_writestring(" KiB used\n");
+    }
+
+    page_cache_init();
+    vmm_init();
+
+    /* Сжатый swap в памяти: половина RAM под вытесненные анонимные страницы */
+    struct block_device* zram = zram_create("zram0", pmm_total_pages() * PAGE_SIZE / 2);
+    if (!zram || swapon(zram) < 0) {
+        terminal_writestring("  Cannot set up zram swap\n");
+    }
+
+    /* Слияние страниц только по запросу: ksm=1, скорость - ksm_pages=N */
+    uint32_t value;
+    if (boot_param_u32("ksm", &value)) {
+        ksm_run = value != 0;
+    }
+    if (boot_param_u32("ksm_pages", &value) && value) {
+        ksm_pages_to_scan = value;
+    }
+    if (ksm_run) {
+        terminal_writestring("  KSM: ");
+        terminal_writedec(ksm_pages_to_scan);
+        terminal_writestring(" pages per idle step\n");
+    }
+}
+
+static void fs_init(void) {
+    vfs_init();
+    pipe_init();
+    ext2_init();
+    fat_init();
+    mixfs_init();
+
+    if (!boot_module_end) {
+        terminal_writestring("  No root filesystem module\n");
+        return;
+    }
+
+    struct block_device* rd = ramdisk_create("rd0", phys_to_virt(boot_module_start),
+                                             boot_module_end - boot_module_start);
+    /* rootflags=commit_ops=512 - параметры монтирования корня */
+    static char rootflags[128];
+    const char* options = boot_param("rootflags", rootflags, sizeof(rootflags)) ? rootflags : NULL;
+
+    const char* fstype;
+    if (!rd || vfs_mount_any("/", rd, options, &fstype) < 0) {
+        terminal_writestring("  Cannot mount root filesystem\n");
+        return;
+    }
+    terminal_writestring("  Root filesystem: ");
+    terminal_writestring(fstype);
+    terminal_writestring(" on rd0\n");
+}
+
+/* ============================================================================
+ * Фоновая работа в простое
+ * ============================================================================ */
+
+/*
+ * Сканер (khugepaged, ksm) считается занятым, пока не сделает подряд
+ * IDLE_QUIET_PASSES полных проходов без результата: ksm сливает страницу
+ * не раньше второго прохода, когда её контрольная сумма устоялась.
+ */
+#define IDLE_QUIET_PASSES   2
+
+struct idle_scanner {
+    uint64_t full_scans;            /* Счётчик полных проходов при прошлом шаге */
+    bool progress;                  /* В текущем проходе был результат */
+    uint32_t quiet;                 /* Полных проходов подряд без результата */
+};
+
+static bool idle_scanner_busy(struct idle_scanner* scanner, bool has_work,
+                              uint32_t done, uint64_t full_scans) {
+    if (!has_work) {
+        return false;
+    }
+    scanner->progress |= done != 0;
+    if (full_scans != scanner->full_scans) {
+        scanner->full_scans = full_scans;
+        scanner->quiet = scanner->progress ? 0 : scanner->quiet + 1;
+        scanner->progress = false;
     }
+    return scanner->quiet < IDLE_QUIET_PASSES;
+}
+
+/*
+ * Один шаг фоновой работы; false - делать больше нечего. Подкачка,
+ * уплотнение и сообщение о свободных страницах доделывают свою работу
+ * за вызов и лишь подхватывают то, что оставили остальные шаги; шар
+ * занят, пока меняет размер.
+ */
+static bool idle_work(void) {
+    static struct idle_scanner khugepaged, ksm;
+    struct ksm_stats ksm_stats;
+    bool busy = false;
+
+    kswapd_balance();
+    busy |= prezero_pages(PREZERO_BATCH_PAGES) != 0;
+    kcompactd_run();
+
+    uint32_t collapsed = khugepaged_scan(KHUGEPAGED_PAGES_TO_SCAN);
+    busy |= idle_scanner_busy(&khugepaged, khugepaged_has_work(), collapsed,
+                              thp_stats.full_scans);
+    uint32_t merged = ksm_scan(ksm_pages_to_scan);
+    ksm_get_stats(&ksm_stats);
+    busy |= idle_scanner_busy(&ksm, ksm_has_work(), merged, ksm_stats.full_scans);
+
+    busy |= virtio_balloon_poll() != 0;
+    page_reporting_process();
+    return busy;
+}
+
+/*
+ * Устройства, о событиях которых ядро узнаёт только опросом: пока они
+ * есть, останавливать процессор навсегда нельзя.
+ */
+static bool idle_has_polled_devices(void) {
+    return virtio_balloon_ready() || page_reporting_dev;
 }
 
 /* ============================================================================
@@ -278,8 +754,8 @@ void kernel_main(uint64_t magic, uint64_t multiboot_addr) {
     
     terminal_setcolor(vga_entry_color(VGA_LIGHT_GREY, VGA_BLACK));
     
-    /* Проверка Multiboot magic number */
-    if (magic != 0x36d76289) {
+    /* Проверка magic number: Multiboot2 (GRUB) или PVH (qemu -kernel) */
+    if (magic != MULTIBOOT2_BOOTLOADER_MAGIC && magic != PVH_START_MAGIC) {
         terminal_setcolor(vga_entry_color(VGA_LIGHT_RED, VGA_BLACK));
         terminal_writestring("[ERROR] Invalid Multiboot magic number!\n");
         terminal_writestring("System halted.\n");
@@ -287,32 +763,55 @@ void kernel_main(uint64_t magic, uint64_t multiboot_addr) {
     }
     
     terminal_setcolor(vga_entry_color(VGA_LIGHT_GREEN, VGA_BLACK));
-    terminal_writestring("[OK] Multiboot2 boot detected\n");
+    terminal_writestring(magic == PVH_START_MAGIC ? "[OK] PVH boot detected\n" :
+                                                    "[OK] Multiboot2 boot detected\n");
     terminal_setcolor(vga_entry_color(VGA_LIGHT_GREY, VGA_BLACK));
     
-    /* Парсинг Multiboot информации */
-    terminal_writestring("\n[INFO] Parsing multiboot information...\n");
-    parse_multiboot_info(multiboot_addr);
+    /* Парсинг информации загрузчика */
+    if (magic == PVH_START_MAGIC) {
+        terminal_writestring("\n[INFO] Parsing PVH start info...\n");
+        parse_pvh_info(multiboot_addr);
+    } else {
+        terminal_writestring("\n[INFO] Parsing multiboot information...\n");
+        parse_multiboot_info(multiboot_addr);
+    }
     
     /* Инициализация архитектурно-зависимых модулей */
     terminal_writestring("\n[INFO] Initializing architecture (x86_64)...\n");
+    cpu_init();
+    tsc_init();
+    fpu_init();
+    crc_accel_init();
     // TODO: arch_init() - GDT, IDT, interrupts
     
     /* Инициализация управления памятью */
     terminal_writestring("[INFO] Initializing memory management...\n");
-    // TODO: mm_init() - PMM, VMM, heap
+    mm_init();
     
     /* Инициализация планировщика */
     terminal_writestring("[INFO] Initializing scheduler...\n");
+    task_init();
     // TODO: sched_init()
     
     /* Инициализация драйверов */
     terminal_writestring("[INFO] Initializing drivers...\n");
     // TODO: drivers_init() - timer, keyboard, disk
+    if (virtio_balloon_init() == 0) {
+        terminal_writestring("  virtio-balloon ready\n");
+    }
     
     /* Инициализация файловой системы */
     terminal_writestring("[INFO] Initializing filesystem...\n");
-    // TODO: vfs_init(), ramfs_init()
+    fs_init();
+
+    /* Замеры при загрузке: bench=fork (см. make bench) */
+    static char bench_list[64];
+    static char bench_prog[128];
+    if (boot_param("bench", bench_list, sizeof(bench_list))) {
+        terminal_writestring("[INFO] Running benchmarks...\n");
+        bench_run(bench_list, boot_param("benchprog", bench_prog, sizeof(bench_prog)) ?
+                              bench_prog : BENCH_DEFAULT_PROG);
+    }
     
     terminal_writestring("\n");
     terminal_setcolor(vga_entry_color(VGA_YELLOW, VGA_BLACK));
@@ -322,7 +821,25 @@ void kernel_main(uint64_t magic, uint64_t multiboot_addr) {
     terminal_writestring("Next step: implement userspace and system calls.\n");
     
 halt:
-    /* Бесконечный цикл (пока нет планировщика) */
+    /*
+     * Простой (пока нет планировщика): фоновая работа, пока она есть.
+     * Прерывания запрещены и IDT нет, поэтому дальше устройства с
+     * опросом (virtio-balloon, сообщение о свободных страницах)
+     * опрашиваются в цикле с pause: новая цель хоста снова запускает
+     * фоновую работу. Без таких устройств новой работе взяться неоткуда,
+     * и hlt - окончательная остановка.
+     */
+    while (1) {
+        while (idle_work()) {
+        }
+        if (!idle_has_polled_devices()) {
+            break;
+        }
+        while (!virtio_balloon_poll()) {
+            page_reporting_process();
+            __asm__ volatile ("pause");
+        }
+    }
     while (1) {
         __asm__ volatile ("hlt");
     }
@@ -0,0 +1,58 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/kernel.h
+ * Общие объявления ядра: терминал, базовые библиотечные функции
+ * ============================================================================
+ */
+
+#ifndef MIXOS_KERNEL_H
+#define MIXOS_KERNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ * Вспомогательные макросы
+ * ============================================================================ */
+
+#define ARRAY_SIZE(a)       (sizeof(a) / sizeof((a)[0]))
+#define ALIGN_UP(x, a)      (((x) + ((a) - 1)) & ~((uint64_t)(a) - 1))
+#define ALIGN_DOWN(x, a)    ((x) & ~((uint64_t)(a) - 1))
+#define DIV_ROUND_UP(x, d)  (((x) + (d) - 1) / (d))
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+#define likely(x)           __builtin_expect(!!(x), 1)
+#define unlikely(x)         __builtin_expect(!!(x), 0)
+
+/* Получение указателя на структуру по указателю на её поле */
+#define container_of(ptr, type, member) \
+    ((type*)((uint8_t*)(ptr) - offsetof(type, member)))
+
+/* ============================================================================
+ * Терминал (kernel/kernel.c)
+ * ============================================================================ */
+
+void terminal_putchar(char c);
+void terminal_write(const char* data, size_t size);
+void terminal_writestring(const char* data);
+void terminal_writedec(uint64_t value);
+void terminal_writehex(uint64_t value);
+
+/* Остановка системы с сообщением об ошибке */
+void panic(const char* message) __attribute__((noreturn));
+
+/* ============================================================================
+ * Базовые библиотечные функции (kernel/kernel.c)
+ * ============================================================================ */
+
+size_t strlen(const char* str);
+int strcmp(const char* s1, const char* s2);
+int strncmp(const char* s1, const char* s2, size_t n);
+void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
+void* memset(void* s, int c, size_t n);
+int memcmp(const void* s1, const void* s2, size_t n);
+
+#endif /* MIXOS_KERNEL_H */
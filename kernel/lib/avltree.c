@@ -0,0 +1,185 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/avltree.c
+ * Интрузивное AVL-дерево с пользовательскими данными поддеревьев
+ *
+ * После любого изменения путь от затронутого узла до корня проходится
+ * целиком: на нём восстанавливаются высоты и баланс и пересчитываются
+ * данные поддеревьев. Высота AVL-дерева не больше 1.44 log2(n), так что
+ * проход стоит O(log n).
+ * ============================================================================
+ */
+
+#include "lib/avltree.h"
+
+static inline int32_t height(const struct avl_node* node) {
+    return node ? node->height : 0;
+}
+
+static void fix_node(struct avl_node* node, avl_update_t update) {
+    node->height = 1 + MAX(height(node->left), height(node->right));
+    if (update) {
+        update(node);
+    }
+}
+
+static void replace_child(struct avl_root* root, struct avl_node* parent,
+                          struct avl_node* old, struct avl_node* new) {
+    if (!parent) {
+        root->node = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+}
+
+static struct avl_node* rotate_left(struct avl_root* root, struct avl_node* x,
+                                    avl_update_t update) {
+    struct avl_node* y = x->right;
+    x->right = y->left;
+    if (y->left) {
+        y->left->parent = x;
+    }
+    y->parent = x->parent;
+    replace_child(root, x->parent, x, y);
+    y->left = x;
+    x->parent = y;
+    fix_node(x, update);
+    fix_node(y, update);
+    return y;
+}
+
+static struct avl_node* rotate_right(struct avl_root* root, struct avl_node* x,
+                                     avl_update_t update) {
+    struct avl_node* y = x->left;
+    x->left = y->right;
+    if (y->right) {
+        y->right->parent = x;
+    }
+    y->parent = x->parent;
+    replace_child(root, x->parent, x, y);
+    y->right = x;
+    x->parent = y;
+    fix_node(x, update);
+    fix_node(y, update);
+    return y;
+}
+
+static void rebalance(struct avl_root* root, struct avl_node* node, avl_update_t update) {
+    while (node) {
+        fix_node(node, update);
+        int32_t balance = height(node->left) - height(node->right);
+        if (balance > 1) {
+            if (height(node->left->left) < height(node->left->right)) {
+                rotate_left(root, node->left, update);
+            }
+            node = rotate_right(root, node, update);
+        } else if (balance < -1) {
+            if (height(node->right->right) < height(node->right->left)) {
+                rotate_right(root, node->right, update);
+            }
+            node = rotate_left(root, node, update);
+        }
+        node = node->parent;
+    }
+}
+
+void avl_insert(struct avl_root* root, struct avl_node* node, struct avl_node* parent,
+                struct avl_node** link, avl_update_t update) {
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->height = 1;
+    *link = node;
+    if (update) {
+        update(node);
+    }
+    rebalance(root, parent, update);
+}
+
+void avl_erase(struct avl_root* root, struct avl_node* node, avl_update_t update) {
+    struct avl_node* start;
+
+    if (node->left && node->right) {
+        /* Место node занимает следующий по порядку узел (у него нет левого) */
+        struct avl_node* succ = node->right;
+        while (succ->left) {
+            succ = succ->left;
+        }
+        if (succ->parent != node) {
+            start = succ->parent;
+            start->left = succ->right;
+            if (succ->right) {
+                succ->right->parent = start;
+            }
+            succ->right = node->right;
+            node->right->parent = succ;
+        } else {
+            start = succ;
+        }
+        succ->left = node->left;
+        node->left->parent = succ;
+        succ->parent = node->parent;
+        replace_child(root, node->parent, node, succ);
+        succ->height = node->height;
+    } else {
+        struct avl_node* child = node->left ? node->left : node->right;
+        if (child) {
+            child->parent = node->parent;
+        }
+        replace_child(root, node->parent, node, child);
+        start = node->parent;
+    }
+    rebalance(root, start, update);
+}
+
+void avl_propagate(struct avl_node* node, avl_update_t update) {
+    for (; node; node = node->parent) {
+        update(node);
+    }
+}
+
+struct avl_node* avl_first(const struct avl_root* root) {
+    struct avl_node* node = root->node;
+    while (node && node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+struct avl_node* avl_last(const struct avl_root* root) {
+    struct avl_node* node = root->node;
+    while (node && node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+struct avl_node* avl_next(const struct avl_node* node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return (struct avl_node*)node;
+    }
+    while (node->parent && node->parent->right == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+struct avl_node* avl_prev(const struct avl_node* node) {
+    if (node->left) {
+        node = node->left;
+        while (node->right) {
+            node = node->right;
+        }
+        return (struct avl_node*)node;
+    }
+    while (node->parent && node->parent->left == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
@@ -0,0 +1,50 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/avltree.h
+ * Интрузивное AVL-дерево с пользовательскими данными поддеревьев
+ *
+ * Узел встраивается в структуру владельца. Поиск места вставки ведёт
+ * владелец (как для rbtree в Linux): он спускается по дереву и передаёт
+ * родителя и ссылку, куда подвесить узел. Обратный вызов update
+ * пересчитывает данные узла, зависящие от детей (например, максимум по
+ * поддереву); дерево вызывает его для каждого узла, поддерево которого
+ * изменилось при вставке, удалении или повороте.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_LIB_AVLTREE_H
+#define MIXOS_LIB_AVLTREE_H
+
+#include "kernel.h"
+
+struct avl_node {
+    struct avl_node* parent;
+    struct avl_node* left;
+    struct avl_node* right;
+    int32_t height;                 /* Высота поддерева (лист - 1) */
+};
+
+struct avl_root {
+    struct avl_node* node;
+};
+
+/* Пересчёт данных узла по его детям; NULL - дерево без дополнительных данных */
+typedef void (*avl_update_t)(struct avl_node* node);
+
+#define avl_entry(ptr, type, member) container_of(ptr, type, member)
+
+/* Подвесить node в *link под parent (найденные спуском) и сбалансировать */
+void avl_insert(struct avl_root* root, struct avl_node* node, struct avl_node* parent,
+                struct avl_node** link, avl_update_t update);
+
+void avl_erase(struct avl_root* root, struct avl_node* node, avl_update_t update);
+
+/* Данные node изменились не из-за дерева: пересчёт от node до корня */
+void avl_propagate(struct avl_node* node, avl_update_t update);
+
+struct avl_node* avl_first(const struct avl_root* root);
+struct avl_node* avl_last(const struct avl_root* root);
+struct avl_node* avl_next(const struct avl_node* node);
+struct avl_node* avl_prev(const struct avl_node* node);
+
+#endif /* MIXOS_LIB_AVLTREE_H */
@@ -0,0 +1,50 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc32.c
+ * CRC32 (старший бит первым): табличный побайтовый алгоритм, длинные
+ * буферы сворачиваются PCLMULQDQ (lib/crc_accel.h)
+ * ============================================================================
+ */
+
+#include "lib/crc32.h"
+#include "lib/crc_accel.h"
+
+#define CRC32_POLY_BE   0x04C11DB7U
+
+static uint32_t crc32_be_table[256];
+static bool crc32_be_table_ready;
+
+static void crc32_be_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc << 1) ^ ((crc & 0x80000000U) ? CRC32_POLY_BE : 0);
+        }
+        crc32_be_table[i] = crc;
+    }
+    crc32_be_table_ready = true;
+}
+
+static uint32_t crc32_be_bytes(uint32_t crc, const uint8_t* p, size_t length) {
+    while (length--) {
+        crc = (crc << 8) ^ crc32_be_table[(crc >> 24) ^ *p++];
+    }
+    return crc;
+}
+
+uint32_t crc32_be(uint32_t crc, const void* data, size_t length) {
+    const uint8_t* p = data;
+
+    if (unlikely(!crc32_be_table_ready)) {
+        crc32_be_init_table();
+    }
+    if (crc_pclmul_enabled && length >= CRC_PCLMUL_MIN_LEN) {
+        uint8_t folded[16];
+        size_t bulk = ALIGN_DOWN(length, 16);
+        crc_pclmul_fold_be(crc, 32, p, bulk, &crc32_be_fold, folded);
+        crc = crc32_be_bytes(0, folded, sizeof(folded));
+        p += bulk;
+        length -= bulk;
+    }
+    return crc32_be_bytes(crc, p, length);
+}
@@ -0,0 +1,20 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc32.h
+ * CRC32 (полином IEEE 802.3) в порядке бит от старшего, как crc32_be в Linux
+ * ============================================================================
+ */
+
+#ifndef MIXOS_LIB_CRC32_H
+#define MIXOS_LIB_CRC32_H
+
+#include "kernel.h"
+
+/*
+ * Продолжение CRC32 без инверсий: начальное значение и окончательная
+ * обработка остаются вызывающему (журнал ext3/ext4 начинает с ~0 и
+ * хранит результат как есть).
+ */
+uint32_t crc32_be(uint32_t crc, const void* data, size_t length);
+
+#endif /* MIXOS_LIB_CRC32_H */
@@ -0,0 +1,68 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc32c.c
+ * CRC32C: slicing-by-8 (восемь таблиц, 8 байт за шаг)
+ * ============================================================================
+ */
+
+#include "lib/crc32c.h"
+
+#define CRC32C_POLY_REFLECTED   0x82F63B78U
+
+/* crc32c_table[k][i] - CRC байта i, за которым следуют k нулевых байт */
+static uint32_t crc32c_table[8][256];
+static bool crc32c_table_ready;
+
+static crc32c_fn crc32c_impl = crc32c_sb8;
+
+static void crc32c_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY_REFLECTED : 0);
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xFF];
+        }
+    }
+    crc32c_table_ready = true;
+}
+
+/* Слово little-endian независимо от порядка байт хоста */
+static inline uint32_t load_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+uint32_t crc32c_sb8(uint32_t crc, const void* data, size_t length) {
+    const uint8_t* p = data;
+
+    if (unlikely(!crc32c_table_ready)) {
+        crc32c_init_table();
+    }
+    while (length >= 8) {
+        uint32_t lo = crc ^ load_le32(p);
+        uint32_t hi = load_le32(p + 4);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+void crc32c_set_impl(crc32c_fn fn) {
+    crc32c_impl = fn;
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length) {
+    return ~crc32c_impl(~crc, data, length);
+}
@@ -0,0 +1,32 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc32c.h
+ * CRC32C (полином Кастаньоли) для контрольных сумм метаданных
+ *
+ * Файл не зависит от остального ядра и собирается также в утилитах
+ * хоста (tools/). Переносимая реализация - slicing-by-8; ядро при
+ * загрузке подставляет инструкцию crc32 из SSE4.2 (lib/crc_accel.h).
+ * ============================================================================
+ */
+
+#ifndef MIXOS_LIB_CRC32C_H
+#define MIXOS_LIB_CRC32C_H
+
+#include "kernel.h"
+
+/*
+ * Продолжение CRC32C: crc - результат предыдущего вызова (0 для начала).
+ * Инверсия на входе и выходе выполняется внутри, поэтому
+ * crc32c(crc32c(0, a, n), b, m) == crc32c(0, ab, n + m).
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+
+/* Реализация без инверсий: состояние регистра CRC до и после data */
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const void* data, size_t length);
+
+uint32_t crc32c_sb8(uint32_t crc, const void* data, size_t length);
+
+/* Замена реализации, которой пользуется crc32c (по умолчанию crc32c_sb8) */
+void crc32c_set_impl(crc32c_fn fn);
+
+#endif /* MIXOS_LIB_CRC32C_H */
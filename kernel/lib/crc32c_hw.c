@@ -0,0 +1,155 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc32c_hw.c
+ * CRC32C инструкцией crc32 (SSE4.2) в три потока
+ * ============================================================================
+ */
+
+#include "lib/crc_accel.h"
+
+#define CRC32C_POLY_REFLECTED   0x82F63B78U
+
+/* Длины потоков: длинные для больших буферов, короткие для остатка */
+#define CRC32C_LONG             8192
+#define CRC32C_SHORT            256
+
+/* Сдвиг CRC на CRC32C_LONG/SHORT нулевых байт: по таблице на байт CRC */
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+
+/* ============================================================================
+ * Операторы сдвига: матрицы 32x32 над GF(2)
+ * ============================================================================ */
+
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+/* Оператор дописывания len (степень двойки) нулевых байт */
+static void crc32c_zeros_op(uint32_t* even, size_t len) {
+    uint32_t odd[32];
+
+    /* Один нулевой бит */
+    odd[0] = CRC32C_POLY_REFLECTED;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; n++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2_matrix_square(even, odd);   /* Два бита */
+    gf2_matrix_square(odd, even);   /* Четыре */
+
+    /* Каждое возведение в квадрат удваивает длину, начиная с байта */
+    while (true) {
+        gf2_matrix_square(even, odd);
+        len >>= 1;
+        if (len == 0) {
+            return;
+        }
+        gf2_matrix_square(odd, even);
+        len >>= 1;
+        if (len == 0) {
+            break;
+        }
+    }
+    memcpy(even, odd, sizeof(odd));
+}
+
+static void crc32c_zeros(uint32_t zeros[4][256], size_t len) {
+    uint32_t op[32];
+    crc32c_zeros_op(op, len);
+    for (uint32_t n = 0; n < 256; n++) {
+        zeros[0][n] = gf2_matrix_times(op, n);
+        zeros[1][n] = gf2_matrix_times(op, n << 8);
+        zeros[2][n] = gf2_matrix_times(op, n << 16);
+        zeros[3][n] = gf2_matrix_times(op, n << 24);
+    }
+}
+
+static inline uint32_t crc32c_shift(uint32_t zeros[4][256], uint32_t crc) {
+    return zeros[0][crc & 0xFF] ^ zeros[1][(crc >> 8) & 0xFF] ^
+           zeros[2][(crc >> 16) & 0xFF] ^ zeros[3][crc >> 24];
+}
+
+void crc32c_hw_init(void) {
+    crc32c_zeros(crc32c_long, CRC32C_LONG);
+    crc32c_zeros(crc32c_short, CRC32C_SHORT);
+}
+
+/* ============================================================================
+ * Подсчёт
+ * ============================================================================ */
+
+static inline uint64_t crc32q(uint64_t crc, const uint8_t* p) {
+    uint64_t word;
+    __builtin_memcpy(&word, p, sizeof(word));
+    __asm__ ("crc32q %1, %0" : "+r"(crc) : "rm"(word));
+    return crc;
+}
+
+static inline uint32_t crc32b(uint32_t crc, uint8_t byte) {
+    __asm__ ("crc32b %1, %0" : "+r"(crc) : "rm"(byte));
+    return crc;
+}
+
+/* Три потока по stream байт, пока хватает данных */
+static const uint8_t* crc32c_3way(uint64_t* crc, const uint8_t* p, size_t* length,
+                                  size_t stream, uint32_t zeros[4][256]) {
+    uint64_t crc0 = *crc;
+    while (*length >= 3 * stream) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const uint8_t* end = p + stream;
+        do {
+            crc0 = crc32q(crc0, p);
+            crc1 = crc32q(crc1, p + stream);
+            crc2 = crc32q(crc2, p + 2 * stream);
+            p += 8;
+        } while (p < end);
+        crc0 = crc32c_shift(zeros, (uint32_t)crc0) ^ crc1;
+        crc0 = crc32c_shift(zeros, (uint32_t)crc0) ^ crc2;
+        p += 2 * stream;
+        *length -= 3 * stream;
+    }
+    *crc = crc0;
+    return p;
+}
+
+uint32_t crc32c_hw(uint32_t crc, const void* data, size_t length) {
+    const uint8_t* p = data;
+
+    /* До границы 8 байт - побайтово */
+    while (length && ((uintptr_t)p & 7)) {
+        crc = crc32b(crc, *p++);
+        length--;
+    }
+
+    uint64_t crc64 = crc;
+    p = crc32c_3way(&crc64, p, &length, CRC32C_LONG, crc32c_long);
+    p = crc32c_3way(&crc64, p, &length, CRC32C_SHORT, crc32c_short);
+    while (length >= 8) {
+        crc64 = crc32q(crc64, p);
+        p += 8;
+        length -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+    while (length--) {
+        crc = crc32b(crc, *p++);
+    }
+    return crc;
+}
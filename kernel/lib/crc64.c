@@ -0,0 +1,50 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc64.c
+ * CRC64 (старший бит первым): табличный побайтовый алгоритм, длинные
+ * буферы сворачиваются PCLMULQDQ (lib/crc_accel.h)
+ * ============================================================================
+ */
+
+#include "lib/crc64.h"
+#include "lib/crc_accel.h"
+
+#define CRC64_POLY_BE   0x42F0E1EBA9EA3693ULL
+
+static uint64_t crc64_be_table[256];
+static bool crc64_be_table_ready;
+
+static void crc64_be_init_table(void) {
+    for (uint64_t i = 0; i < 256; i++) {
+        uint64_t crc = i << 56;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc << 1) ^ ((crc & (1ULL << 63)) ? CRC64_POLY_BE : 0);
+        }
+        crc64_be_table[i] = crc;
+    }
+    crc64_be_table_ready = true;
+}
+
+static uint64_t crc64_be_bytes(uint64_t crc, const uint8_t* p, size_t length) {
+    while (length--) {
+        crc = (crc << 8) ^ crc64_be_table[(crc >> 56) ^ *p++];
+    }
+    return crc;
+}
+
+uint64_t crc64_be(uint64_t crc, const void* data, size_t length) {
+    const uint8_t* p = data;
+
+    if (unlikely(!crc64_be_table_ready)) {
+        crc64_be_init_table();
+    }
+    if (crc_pclmul_enabled && length >= CRC_PCLMUL_MIN_LEN) {
+        uint8_t folded[16];
+        size_t bulk = ALIGN_DOWN(length, 16);
+        crc_pclmul_fold_be(crc, 64, p, bulk, &crc64_be_fold, folded);
+        crc = crc64_be_bytes(0, folded, sizeof(folded));
+        p += bulk;
+        length -= bulk;
+    }
+    return crc64_be_bytes(crc, p, length);
+}
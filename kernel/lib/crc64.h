@@ -0,0 +1,16 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc64.h
+ * CRC64 (полином ECMA-182) в порядке бит от старшего, как crc64_be в Linux
+ * ============================================================================
+ */
+
+#ifndef MIXOS_LIB_CRC64_H
+#define MIXOS_LIB_CRC64_H
+
+#include "kernel.h"
+
+/* Продолжение CRC64 без инверсий, как crc32_be */
+uint64_t crc64_be(uint64_t crc, const void* data, size_t length);
+
+#endif /* MIXOS_LIB_CRC64_H */
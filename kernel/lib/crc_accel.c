@@ -0,0 +1,65 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc_accel.c
+ * Выбор аппаратных реализаций CRC
+ * ============================================================================
+ */
+
+#include "lib/crc_accel.h"
+#include "lib/crc32c.h"
+#include "cpu/cpu.h"
+#include "cpu/fpu.h"
+
+#define CRC32_POLY_BE   0x04C11DB7ULL
+#define CRC64_POLY_BE   0x42F0E1EBA9EA3693ULL
+
+bool crc_pclmul_enabled;
+struct crc_fold_consts crc32_be_fold;
+struct crc_fold_consts crc64_be_fold;
+
+/* x^n mod P для P = x^width + poly */
+static uint64_t xn_mod(unsigned int n, uint64_t poly, unsigned int width) {
+    uint64_t mask = width == 64 ? UINT64_MAX : (1ULL << width) - 1;
+    uint64_t r = 1;
+    while (n--) {
+        uint64_t top = (r >> (width - 1)) & 1;
+        r = (r << 1) & mask;
+        if (top) {
+            r ^= poly;
+        }
+    }
+    return r;
+}
+
+static void crc_fold_consts_init(struct crc_fold_consts* consts, uint64_t poly,
+                                 unsigned int width) {
+    consts->fold128[0] = xn_mod(128, poly, width);
+    consts->fold128[1] = xn_mod(192, poly, width);
+    consts->fold512[0] = xn_mod(512, poly, width);
+    consts->fold512[1] = xn_mod(576, poly, width);
+}
+
+void crc_accel_init(void) {
+    if (cpu_has(X86_FEATURE_XMM4_2)) {
+        crc32c_hw_init();
+        crc32c_set_impl(crc32c_hw);
+    }
+    if (cpu_has(X86_FEATURE_PCLMULQDQ) && cpu_has(X86_FEATURE_SSSE3)) {
+        crc_fold_consts_init(&crc32_be_fold, CRC32_POLY_BE, 32);
+        crc_fold_consts_init(&crc64_be_fold, CRC64_POLY_BE, 64);
+        crc_pclmul_enabled = true;
+    }
+}
+
+void crc_pclmul_fold_be(uint64_t crc, unsigned int width, const void* data, size_t length,
+                        const struct crc_fold_consts* consts, uint8_t out[16]) {
+    /* Вызов из другой векторной секции: регистры уже свободны */
+    bool nested = kernel_fpu_in_section();
+    if (!nested) {
+        kernel_fpu_begin();
+    }
+    crc_fold_be_sse(crc, width, data, length, consts, out);
+    if (!nested) {
+        kernel_fpu_end();
+    }
+}
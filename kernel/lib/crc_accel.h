@@ -0,0 +1,57 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc_accel.h
+ * Аппаратное ускорение CRC: выбор реализаций при загрузке
+ *
+ * CRC32C считает инструкция crc32 (SSE4.2) в трёх независимых потоках:
+ * у неё задержка 3 такта при пропускной способности 1, и три цепочки
+ * загружают конвейер целиком. Частичные CRC соединяются сдвигом на
+ * длину потока (умножение на x^(8n) по модулю полинома, по таблицам).
+ * Инструкция работает с регистрами общего назначения, секция
+ * kernel_fpu_begin/end ей не нужна.
+ *
+ * CRC32 и CRC64 со старшим битом первым (crc32_be, crc64_be) на длинных
+ * буферах сворачиваются PCLMULQDQ по 128 бит (в четыре потока): остаток
+ * от деления не меняется при замене старшей части на её произведение с
+ * x^k mod P. Свёрнутые 16 байт и хвост досчитываются таблицей.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_LIB_CRC_ACCEL_H
+#define MIXOS_LIB_CRC_ACCEL_H
+
+#include "kernel.h"
+
+/* Короче этого свёртка не окупает сохранение векторных регистров */
+#define CRC_PCLMUL_MIN_LEN      256
+
+/* Константы свёртки: [0] - для младшей половины, [1] - для старшей */
+struct crc_fold_consts {
+    uint64_t fold128[2];            /* x^128, x^192 mod P */
+    uint64_t fold512[2];            /* x^512, x^576 mod P */
+};
+
+extern bool crc_pclmul_enabled;
+extern struct crc_fold_consts crc32_be_fold;
+extern struct crc_fold_consts crc64_be_fold;
+
+/* Выбор реализаций по возможностям процессора; после fpu_init */
+void crc_accel_init(void);
+
+/* CRC32C инструкцией crc32, без инверсий (см. crc32c_fn) */
+uint32_t crc32c_hw(uint32_t crc, const void* data, size_t length);
+void crc32c_hw_init(void);
+
+/*
+ * Свёртка length байт (кратно 16, не меньше 64) CRC ширины width с
+ * начальным значением crc до 16 байт out: CRC от out с нулевого
+ * начального значения равен CRC от data с начальным crc.
+ */
+void crc_pclmul_fold_be(uint64_t crc, unsigned int width, const void* data, size_t length,
+                        const struct crc_fold_consts* consts, uint8_t out[16]);
+
+/* Векторная часть (lib/crc_pclmul_sse.c): только внутри kernel_fpu_begin/end */
+void crc_fold_be_sse(uint64_t crc, unsigned int width, const uint8_t* data, size_t length,
+                     const struct crc_fold_consts* consts, uint8_t out[16]);
+
+#endif /* MIXOS_LIB_CRC_ACCEL_H */
@@ -0,0 +1,65 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/crc_pclmul_sse.c
+ * Свёртка CRC (старший бит первым) инструкцией PCLMULQDQ
+ * ============================================================================
+ */
+
+#include "lib/crc_accel.h"
+#include "cpu/fpu.h"
+
+typedef long long v2di __attribute__((vector_size(16)));
+typedef char v16qi __attribute__((vector_size(16)));
+
+/* Первый байт блока - старшие коэффициенты многочлена */
+static const v16qi bswap_mask = { 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+
+/* -ffreestanding не встраивает memcpy сам */
+static inline v2di load_be128(const uint8_t* p) {
+    v2di v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return (v2di)__builtin_ia32_pshufb128((v16qi)v, bswap_mask);
+}
+
+/* a * x^n по модулю P, где k = { x^n mod P, x^(n+64) mod P } */
+static inline v2di fold(v2di a, v2di k) {
+    return __builtin_ia32_pclmulqdq128(a, k, 0x00) ^ __builtin_ia32_pclmulqdq128(a, k, 0x11);
+}
+
+void crc_fold_be_sse(uint64_t crc, unsigned int width, const uint8_t* data, size_t length,
+                     const struct crc_fold_consts* consts, uint8_t out[16]) {
+    kernel_fpu_assert("crc_fold_be_sse: outside kernel_fpu_begin/end");
+
+    v2di k128 = { (long long)consts->fold128[0], (long long)consts->fold128[1] };
+    v2di k512 = { (long long)consts->fold512[0], (long long)consts->fold512[1] };
+
+    /* Начальное значение складывается со старшими битами сообщения */
+    v2di a0 = load_be128(data);
+    v2di a1 = load_be128(data + 16);
+    v2di a2 = load_be128(data + 32);
+    v2di a3 = load_be128(data + 48);
+    a0 ^= (v2di){ 0, (long long)(crc << (64 - width)) };
+    data += 64;
+    length -= 64;
+
+    while (length >= 64) {
+        a0 = fold(a0, k512) ^ load_be128(data);
+        a1 = fold(a1, k512) ^ load_be128(data + 16);
+        a2 = fold(a2, k512) ^ load_be128(data + 32);
+        a3 = fold(a3, k512) ^ load_be128(data + 48);
+        data += 64;
+        length -= 64;
+    }
+
+    v2di a = fold(a0, k128) ^ a1;
+    a = fold(a, k128) ^ a2;
+    a = fold(a, k128) ^ a3;
+    while (length >= 16) {
+        a = fold(a, k128) ^ load_be128(data);
+        data += 16;
+        length -= 16;
+    }
+
+    a = (v2di)__builtin_ia32_pshufb128((v16qi)a, bswap_mask);
+    __builtin_memcpy(out, &a, sizeof(a));
+}
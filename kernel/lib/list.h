@@ -0,0 +1,77 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/list.h
+ * Интрузивный двусвязный список
+ * ============================================================================
+ */
+
+#ifndef MIXOS_LIB_LIST_H
+#define MIXOS_LIB_LIST_H
+
+#include "kernel.h"
+
+struct list_head {
+    struct list_head* next;
+    struct list_head* prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+
+static inline void list_init(struct list_head* head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static inline bool list_empty(const struct list_head* head) {
+    return head->next == head;
+}
+
+static inline void __list_insert(struct list_head* entry,
+                                 struct list_head* prev,
+                                 struct list_head* next) {
+    next->prev = entry;
+    entry->next = next;
+    entry->prev = prev;
+    prev->next = entry;
+}
+
+/* Вставка в начало списка */
+static inline void list_add(struct list_head* entry, struct list_head* head) {
+    __list_insert(entry, head, head->next);
+}
+
+/* Вставка в конец списка */
+static inline void list_add_tail(struct list_head* entry, struct list_head* head) {
+    __list_insert(entry, head->prev, head);
+}
+
+static inline void list_del(struct list_head* entry) {
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+    entry->next = entry;
+    entry->prev = entry;
+}
+
+static inline void list_move(struct list_head* entry, struct list_head* head) {
+    list_del(entry);
+    list_add(entry, head);
+}
+
+static inline void list_move_tail(struct list_head* entry, struct list_head* head) {
+    list_del(entry);
+    list_add_tail(entry, head);
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_first_entry(head, type, member) \
+    list_entry((head)->next, type, member)
+
+#define list_for_each(pos, head) \
+    for (pos = (head)->next; pos != (head); pos = pos->next)
+
+#define list_for_each_safe(pos, tmp, head) \
+    for (pos = (head)->next, tmp = pos->next; pos != (head); \
+         pos = tmp, tmp = pos->next)
+
+#endif /* MIXOS_LIB_LIST_H */
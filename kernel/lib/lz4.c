@@ -0,0 +1,466 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/lz4.c
+ * Сжатие LZ4: жадный поиск совпадений по хешу 4 байт
+ * ============================================================================
+ */
+
+#include "lib/lz4.h"
+#include "errno.h"
+
+#define LZ4_MIN_MATCH       4
+#define LZ4_MAX_OFFSET      65535
+#define LZ4_LAST_LITERALS   5       /* Блок всегда кончается литералами */
+#define LZ4_MFLIMIT         12      /* Последнее совпадение начинается не ближе к концу */
+#define LZ4_ML_BITS         4
+#define LZ4_ML_MASK         ((1U << LZ4_ML_BITS) - 1)
+#define LZ4_RUN_MASK        LZ4_ML_MASK
+
+/* Чем дольше нет совпадений, тем больше шаг поиска (несжимаемые данные) */
+#define LZ4_SKIP_TRIGGER    6
+
+static inline uint32_t lz4_read32(const uint8_t* p) {
+    uint32_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t lz4_read64(const uint8_t* p) {
+    uint64_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz4_hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Копирование по 8 байт; может записать до 7 байт за dst + len */
+static inline void lz4_wild_copy(uint8_t* dst, const uint8_t* src, size_t len) {
+    uint8_t* end = dst + len;
+    do {
+        uint64_t v = lz4_read64(src);
+        __builtin_memcpy(dst, &v, sizeof(v));
+        dst += sizeof(uint64_t);
+        src += sizeof(uint64_t);
+    } while (dst < end);
+}
+
+/* Длина 15 и больше продолжается байтами по 255 */
+static inline uint8_t* lz4_write_length(uint8_t* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+/* Место под последовательность из lit литералов и совпадения длины match */
+static inline size_t lz4_sequence_size(size_t lit, size_t match) {
+    return 1 + lit + lit / 255 + 1 + 2 + match / 255 + 1;
+}
+
+/* Длина совпадения ip и ref не дальше limit: по 8 байт, первый отличный - по ctz */
+static inline size_t lz4_count(const uint8_t* ip, const uint8_t* ref, const uint8_t* limit) {
+    const uint8_t* start = ip;
+    while (ip + sizeof(uint64_t) <= limit) {
+        uint64_t diff = lz4_read64(ip) ^ lz4_read64(ref);
+        if (diff) {
+            return (size_t)(ip - start) + ((size_t)__builtin_ctzll(diff) >> 3);
+        }
+        ip += sizeof(uint64_t);
+        ref += sizeof(uint64_t);
+    }
+    while (ip < limit && *ip == *ref) {
+        ip++;
+        ref++;
+    }
+    return (size_t)(ip - start);
+}
+
+/* Где лежит история, на которую могут ссылаться совпадения */
+enum lz4_dict_mode {
+    LZ4_NO_DICT,
+    LZ4_PREFIX_DICT,                /* Непосредственно перед src */
+    LZ4_EXT_DICT,                   /* Отдельно: после её конца идёт src */
+};
+
+/*
+ * Позиции в хеш-таблице - сквозные индексы потока: src[0] имеет индекс
+ * start, словарь - [start - dict_size, start). Режим - константа в
+ * каждом вызове, и компилятор собирает три отдельных цикла.
+ */
+static inline __attribute__((always_inline))
+size_t lz4_compress_generic(uint32_t* table, const uint8_t* src, size_t src_len,
+                            uint8_t* dst, size_t dst_cap, uint32_t start,
+                            const uint8_t* dict, uint32_t dict_size,
+                            enum lz4_dict_mode mode) {
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* iend = src + src_len;
+    const uint8_t* dict_end = dict + dict_size;
+    uint8_t* op = dst;
+    uint8_t* oend = op + dst_cap;
+    uint32_t low = start - (mode == LZ4_NO_DICT ? 0 : dict_size);
+
+    if (src_len >= LZ4_MFLIMIT + 1) {
+        const uint8_t* mflimit = iend - LZ4_MFLIMIT;
+        const uint8_t* matchlimit = iend - LZ4_LAST_LITERALS;
+
+        table[lz4_hash(lz4_read32(ip))] = start;
+        ip++;
+
+        uint32_t misses = 1U << LZ4_SKIP_TRIGGER;
+        while (ip < mflimit) {
+            uint32_t sequence = lz4_read32(ip);
+            uint32_t h = lz4_hash(sequence);
+            uint32_t index = start + (uint32_t)(ip - src);
+            uint32_t ref_index = table[h];
+            table[h] = index;
+
+            if (ref_index < low || ref_index >= index || index - ref_index > LZ4_MAX_OFFSET) {
+                ip += misses++ >> LZ4_SKIP_TRIGGER;
+                continue;
+            }
+            /* Начало сегмента истории, в котором лежит ref */
+            const uint8_t* ref;
+            const uint8_t* ref_low;
+            if (ref_index >= start) {
+                ref = src + (ref_index - start);
+                ref_low = src;
+            } else if (mode == LZ4_EXT_DICT) {
+                ref = dict_end - (start - ref_index);
+                ref_low = dict;
+            } else {
+                ref = src - (start - ref_index);
+                ref_low = src - dict_size;
+            }
+            if (lz4_read32(ref) != sequence) {
+                ip += misses++ >> LZ4_SKIP_TRIGGER;
+                continue;
+            }
+            misses = 1U << LZ4_SKIP_TRIGGER;
+
+            /* Совпадение может начинаться раньше найденной позиции */
+            while (ip > anchor && ref > ref_low && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            size_t match;
+            if (mode == LZ4_EXT_DICT && ref_low == dict) {
+                /* Дойдя до конца словаря, совпадение продолжается с начала src */
+                const uint8_t* limit = MIN(matchlimit, ip + (dict_end - ref));
+                match = LZ4_MIN_MATCH + lz4_count(ip + LZ4_MIN_MATCH, ref + LZ4_MIN_MATCH, limit);
+                if (ip + match == limit && limit < matchlimit) {
+                    match += lz4_count(ip + match, src, matchlimit);
+                }
+            } else {
+                match = LZ4_MIN_MATCH +
+                        lz4_count(ip + LZ4_MIN_MATCH, ref + LZ4_MIN_MATCH, matchlimit);
+            }
+            /* Возврат назад сдвинул ip и ref одинаково */
+            uint16_t offset = (uint16_t)(index - ref_index);
+
+            size_t lit = (size_t)(ip - anchor);
+            if (lz4_sequence_size(lit, match) > (size_t)(oend - op)) {
+                return 0;
+            }
+            uint8_t* token = op++;
+            if (lit >= LZ4_RUN_MASK) {
+                *token = LZ4_RUN_MASK << LZ4_ML_BITS;
+                op = lz4_write_length(op, lit - LZ4_RUN_MASK);
+            } else {
+                *token = (uint8_t)(lit << LZ4_ML_BITS);
+            }
+            /* За литералами в src ещё не меньше LZ4_MFLIMIT байт */
+            if ((size_t)(oend - op) >= lit + sizeof(uint64_t)) {
+                lz4_wild_copy(op, anchor, lit);
+            } else {
+                memcpy(op, anchor, lit);
+            }
+            op += lit;
+
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+
+            size_t ml = match - LZ4_MIN_MATCH;
+            if (ml >= LZ4_ML_MASK) {
+                *token |= LZ4_ML_MASK;
+                op = lz4_write_length(op, ml - LZ4_ML_MASK);
+            } else {
+                *token |= (uint8_t)ml;
+            }
+
+            ip += match;
+            anchor = ip;
+            /* Позиция внутри совпадения улучшает поиск следующего */
+            if (ip < mflimit) {
+                table[lz4_hash(lz4_read32(ip - 2))] = start + (uint32_t)(ip - 2 - src);
+            }
+        }
+    }
+
+    /* Хвост - только литералы */
+    size_t lit = (size_t)(iend - anchor);
+    if (1 + lit + lit / 255 + 1 > (size_t)(oend - op)) {
+        return 0;
+    }
+    if (lit >= LZ4_RUN_MASK) {
+        *op++ = LZ4_RUN_MASK << LZ4_ML_BITS;
+        op = lz4_write_length(op, lit - LZ4_RUN_MASK);
+    } else {
+        *op++ = (uint8_t)(lit << LZ4_ML_BITS);
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+    return (size_t)(op - dst);
+}
+
+size_t lz4_compress(const void* src, size_t src_len, void* dst, size_t dst_cap,
+                    void* wrkmem) {
+    memset(wrkmem, 0, LZ4_MEM_COMPRESS);
+    return lz4_compress_generic(wrkmem, src, src_len, dst, dst_cap, 0, NULL, 0, LZ4_NO_DICT);
+}
+
+/* Продолжение длины; false - блок кончился раньше */
+static inline bool lz4_read_length(const uint8_t** ip, const uint8_t* iend, size_t* length) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return false;
+        }
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return true;
+}
+
+/*
+ * Короткие литералы и совпадения копируются по 8 байт с заходом за
+ * конец, пока до конца буферов есть запас; у границ - точно.
+ */
+#define LZ4_WILDCOPY_MARGIN 16
+
+/*
+ * Распаковка с историей: prefix_size байт непосредственно перед dst и,
+ * раньше них, внешний словарь ext_dict.
+ */
+static inline __attribute__((always_inline))
+int64_t lz4_decompress_generic(const uint8_t* src, size_t src_len, uint8_t* dst,
+                               size_t dst_cap, size_t prefix_size,
+                               const uint8_t* ext_dict, size_t ext_size) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = ip + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = op + dst_cap;
+    uint8_t* low_prefix = dst - prefix_size;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t lit = token >> LZ4_ML_BITS;
+        if (lit == LZ4_RUN_MASK && !lz4_read_length(&ip, iend, &lit)) {
+            return -EINVAL;
+        }
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) {
+            return -EINVAL;
+        }
+        if ((size_t)(iend - ip) >= lit + LZ4_WILDCOPY_MARGIN &&
+            (size_t)(oend - op) >= lit + LZ4_WILDCOPY_MARGIN) {
+            lz4_wild_copy(op, ip, lit);
+        } else {
+            memcpy(op, ip, lit);
+        }
+        ip += lit;
+        op += lit;
+
+        /* Последняя последовательность без совпадения */
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -EINVAL;
+        }
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - low_prefix) + ext_size) {
+            return -EINVAL;
+        }
+
+        size_t match = token & LZ4_ML_MASK;
+        if (match == LZ4_ML_MASK && !lz4_read_length(&ip, iend, &match)) {
+            return -EINVAL;
+        }
+        match += LZ4_MIN_MATCH;
+        if (match > (size_t)(oend - op)) {
+            return -EINVAL;
+        }
+
+        if (offset > (size_t)(op - low_prefix)) {
+            /* Начало совпадения во внешнем словаре, продолжение - с low_prefix */
+            const uint8_t* ref = ext_dict + ext_size - (offset - (size_t)(op - low_prefix));
+            size_t from_ext = MIN(match, (size_t)(ext_dict + ext_size - ref));
+            memcpy(op, ref, from_ext);
+            op += from_ext;
+            ref = low_prefix;
+            for (size_t i = from_ext; i < match; i++) {
+                *op++ = *ref++;
+            }
+            continue;
+        }
+
+        const uint8_t* ref = op - offset;
+        if (offset >= sizeof(uint64_t) && (size_t)(oend - op) >= match + LZ4_WILDCOPY_MARGIN) {
+            /* Восьмёрка источника целиком позади восьмёрки назначения */
+            lz4_wild_copy(op, ref, match);
+            op += match;
+        } else {
+            /* Короткое смещение (повтор шаблона) или конец буфера: побайтно */
+            for (size_t i = 0; i < match; i++) {
+                *op++ = *ref++;
+            }
+        }
+    }
+    return (int64_t)(op - dst);
+}
+
+int64_t lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_cap) {
+    return lz4_decompress_generic(src, src_len, dst, dst_cap, 0, NULL, 0);
+}
+
+/* ============================================================================
+ * Потоковое сжатие
+ * ============================================================================ */
+
+/*
+ * Первый индекс потока: нули ещё не заполненной таблицы смотрят за
+ * 64 KiB назад и отбрасываются без чтения памяти.
+ */
+#define LZ4_STREAM_START        (LZ4_DICT_SIZE + 1)
+
+/* Перед переполнением индексы сдвигаются вниз */
+#define LZ4_STREAM_RENORM       0x80000000U
+
+void lz4_stream_init(struct lz4_stream* stream) {
+    memset(stream->table, 0, sizeof(stream->table));
+    stream->dict = NULL;
+    stream->dict_size = 0;
+    stream->start = LZ4_STREAM_START;
+}
+
+/* Сдвиг сквозных индексов: история не дальше 64 KiB, старые позиции - в 0 */
+static void lz4_stream_renorm(struct lz4_stream* stream) {
+    uint32_t delta = stream->start - LZ4_STREAM_START;
+    for (uint32_t i = 0; i < ARRAY_SIZE(stream->table); i++) {
+        stream->table[i] = stream->table[i] > delta ? stream->table[i] - delta : 0;
+    }
+    stream->start = LZ4_STREAM_START;
+}
+
+void lz4_load_dict(struct lz4_stream* stream, const void* dict, size_t size) {
+    const uint8_t* p = dict;
+
+    lz4_stream_init(stream);
+    if (size > LZ4_DICT_SIZE) {
+        p += size - LZ4_DICT_SIZE;
+        size = LZ4_DICT_SIZE;
+    }
+    uint32_t first = stream->start - (uint32_t)size;
+    for (size_t i = 0; i + sizeof(uint32_t) <= size; i++) {
+        stream->table[lz4_hash(lz4_read32(p + i))] = first + (uint32_t)i;
+    }
+    stream->dict = p;
+    stream->dict_size = (uint32_t)size;
+}
+
+size_t lz4_compress_continue(struct lz4_stream* stream, const void* src, size_t src_len,
+                             void* dst, size_t dst_cap) {
+    const uint8_t* in = src;
+    size_t len;
+
+    if (stream->start > LZ4_STREAM_RENORM) {
+        lz4_stream_renorm(stream);
+    }
+    /* Вход затирает начало истории (кольцевой буфер): остаётся только хвост */
+    const uint8_t* dict_end = stream->dict + stream->dict_size;
+    if (in + src_len > stream->dict && in + src_len < dict_end) {
+        stream->dict_size = (uint32_t)(dict_end - (in + src_len));
+        if (stream->dict_size < LZ4_MIN_MATCH) {
+            stream->dict_size = 0;
+        }
+        stream->dict = dict_end - stream->dict_size;
+    }
+    if (stream->dict_size == 0) {
+        len = lz4_compress_generic(stream->table, in, src_len, dst, dst_cap, stream->start,
+                                   NULL, 0, LZ4_NO_DICT);
+    } else if (stream->dict + stream->dict_size == in) {
+        len = lz4_compress_generic(stream->table, in, src_len, dst, dst_cap, stream->start,
+                                   stream->dict, stream->dict_size, LZ4_PREFIX_DICT);
+    } else {
+        len = lz4_compress_generic(stream->table, in, src_len, dst, dst_cap, stream->start,
+                                   stream->dict, stream->dict_size, LZ4_EXT_DICT);
+    }
+
+    /* Историей следующего блока становится этот (с примыкающей к нему) */
+    if (stream->dict_size && stream->dict + stream->dict_size == in) {
+        size_t total = MIN(stream->dict_size + src_len, (size_t)LZ4_DICT_SIZE);
+        stream->dict = in + src_len - total;
+        stream->dict_size = (uint32_t)total;
+    } else {
+        size_t total = MIN(src_len, (size_t)LZ4_DICT_SIZE);
+        stream->dict = in + src_len - total;
+        stream->dict_size = (uint32_t)total;
+    }
+    stream->start += (uint32_t)src_len;
+    return len;
+}
+
+size_t lz4_save_dict(struct lz4_stream* stream, void* buf, size_t size) {
+    size = MIN(size, (size_t)stream->dict_size);
+    memmove(buf, stream->dict + stream->dict_size - size, size);
+    stream->dict = buf;
+    stream->dict_size = (uint32_t)size;
+    return size;
+}
+
+/* ============================================================================
+ * Потоковая распаковка
+ * ============================================================================ */
+
+void lz4_stream_decode_init(struct lz4_stream_decode* stream, const void* dict, size_t size) {
+    stream->prefix_end = (const uint8_t*)dict + size;
+    stream->prefix_size = size;
+    stream->ext_dict = NULL;
+    stream->ext_size = 0;
+}
+
+int64_t lz4_decompress_continue(struct lz4_stream_decode* stream, const void* src,
+                                size_t src_len, void* dst, size_t dst_cap) {
+    uint8_t* out = dst;
+    int64_t len;
+
+    if (stream->prefix_end == out) {
+        /* Продолжение предыдущего вывода (общий буфер) */
+        len = lz4_decompress_generic(src, src_len, out, dst_cap, stream->prefix_size,
+                                     stream->ext_dict, stream->ext_size);
+        if (len < 0) {
+            return len;
+        }
+        stream->prefix_size += (size_t)len;
+    } else {
+        /* Предыдущий вывод остаётся в памяти как внешний словарь */
+        stream->ext_dict = stream->prefix_end - stream->prefix_size;
+        stream->ext_size = stream->prefix_size;
+        len = lz4_decompress_generic(src, src_len, out, dst_cap, 0,
+                                     stream->ext_dict, stream->ext_size);
+        if (len < 0) {
+            return len;
+        }
+        stream->prefix_size = (size_t)len;
+    }
+    stream->prefix_end = out + len;
+    return len;
+}
@@ -0,0 +1,93 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/lib/lz4.h
+ * Сжатие LZ4 (блочный формат)
+ *
+ * Блок - последовательность пар "литералы + совпадение": байт-токен с
+ * длинами, литералы, 16-битное смещение назад и продолжение длины
+ * совпадения. Формат совместим с эталонной реализацией LZ4; кадры
+ * (заголовки, контрольные суммы) здесь не поддерживаются.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_LIB_LZ4_H
+#define MIXOS_LIB_LZ4_H
+
+#include "kernel.h"
+
+/* Рабочая память сжатия: хеш-таблица позиций */
+#define LZ4_HASH_LOG        12
+#define LZ4_MEM_COMPRESS    ((1U << LZ4_HASH_LOG) * sizeof(uint32_t))
+
+/* Сколько истории видят совпадения (наибольшее смещение + 1) */
+#define LZ4_DICT_SIZE       (64 * 1024)
+
+/* Наибольший размер сжатого блока для src_len байт (несжимаемые данные) */
+#define LZ4_COMPRESS_BOUND(src_len)     ((src_len) + (src_len) / 255 + 16)
+
+/*
+ * Сжатие src_len байт в dst (не больше dst_cap). Возвращает размер
+ * сжатых данных или 0, если они не поместились. wrkmem -
+ * LZ4_MEM_COMPRESS байт, содержимое не важно.
+ */
+size_t lz4_compress(const void* src, size_t src_len, void* dst, size_t dst_cap,
+                    void* wrkmem);
+
+/*
+ * Распаковка блока src_len байт в dst (не больше dst_cap). Возвращает
+ * размер распакованных данных или -EINVAL для повреждённого блока;
+ * за границы src и dst распаковка не выходит.
+ */
+int64_t lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_cap);
+
+/* ============================================================================
+ * Потоковый режим
+ * ============================================================================ */
+
+/*
+ * Контекст сжатия. Предыдущий блок (последние 64 KiB потока) должен
+ * оставаться в памяти неизменным до сжатия следующего; иначе его нужно
+ * перенести в свой буфер через lz4_save_dict. Блоки в одном кольцевом
+ * буфере подряд считаются единой историей.
+ */
+struct lz4_stream {
+    uint32_t table[1U << LZ4_HASH_LOG];     /* Сквозные индексы позиций */
+    const uint8_t* dict;                    /* История: последние байты потока */
+    uint32_t dict_size;
+    uint32_t start;                         /* Сквозной индекс следующего блока */
+};
+
+void lz4_stream_init(struct lz4_stream* stream);
+
+/* Начало потока с заранее известного словаря (последние 64 KiB) */
+void lz4_load_dict(struct lz4_stream* stream, const void* dict, size_t size);
+
+/*
+ * Сжатие очередного блока потока; результат как у lz4_compress.
+ * После неудачи (0) поток начинается заново с lz4_stream_init.
+ */
+size_t lz4_compress_continue(struct lz4_stream* stream, const void* src, size_t src_len,
+                             void* dst, size_t dst_cap);
+
+/* Копия истории в buf (не больше size байт); возвращает её размер */
+size_t lz4_save_dict(struct lz4_stream* stream, void* buf, size_t size);
+
+/*
+ * Контекст распаковки. Ранее распакованные блоки должны оставаться на
+ * месте: последний целиком, вместе с примыкающими к нему, и ещё один
+ * перед ними, если вывод перешёл в другой буфер.
+ */
+struct lz4_stream_decode {
+    const uint8_t* prefix_end;      /* Конец последнего вывода */
+    size_t prefix_size;             /* Непрерывная история, кончающаяся там */
+    const uint8_t* ext_dict;        /* История до неё (другой буфер) */
+    size_t ext_size;
+};
+
+/* dict - тот же словарь, что у lz4_load_dict (или NULL, 0) */
+void lz4_stream_decode_init(struct lz4_stream_decode* stream, const void* dict, size_t size);
+
+int64_t lz4_decompress_continue(struct lz4_stream_decode* stream, const void* src,
+                                size_t src_len, void* dst, size_t dst_cap);
+
+#endif /* MIXOS_LIB_LZ4_H */
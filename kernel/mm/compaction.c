@@ -0,0 +1,350 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/compaction.c
+ * Уплотнение памяти
+ * ============================================================================
+ */
+
+#include "mm/compaction.h"
+#include "mm/mm.h"
+#include "mm/page_cache.h"
+#include "mm/swap.h"
+#include "errno.h"
+
+struct compact_stats compact_stats;
+
+/* Заказанный kcompactd порядок по узлам (0 - заказа нет) */
+static uint8_t kcompactd_order[MAX_NUMNODES];
+
+#define COMPACT_BLOCK_PAGES     (1U << (PMM_MAX_ORDER - 1))
+
+/* Рабочие массивы уплотняемого блока */
+static uint32_t block_refs[COMPACT_BLOCK_PAGES];    /* Записей PTE на страницу */
+static struct page* block_new[COMPACT_BLOCK_PAGES]; /* Новое место страницы */
+
+enum compact_result {
+    COMPACT_SKIPPED,                /* Уплотнение не поможет */
+    COMPACT_CONTINUE,               /* Стоит уплотнять */
+    COMPACT_SUCCESS,                /* Блок уже есть */
+};
+
+int fragmentation_index(const struct zone* zone, unsigned int order) {
+    uint64_t requested = 1UL << order;
+    uint64_t blocks_total = 0;
+    uint64_t blocks_suitable = 0;
+
+    for (unsigned int o = 0; o < PMM_MAX_ORDER; o++) {
+        blocks_total += zone->free_area[o].nr_free;
+        if (o >= order) {
+            blocks_suitable += zone->free_area[o].nr_free << (o - order);
+        }
+    }
+    if (blocks_total == 0) {
+        return 0;
+    }
+    if (blocks_suitable) {
+        return -1000;
+    }
+    return (int)(1000 - (1000 + zone->free_pages * 1000 / requested) / blocks_total);
+}
+
+static enum compact_result compaction_suitable(const struct zone* zone, unsigned int order) {
+    int index = fragmentation_index(zone, order);
+    if (index == -1000) {
+        return COMPACT_SUCCESS;
+    }
+    /* Копиям страниц блока нужно место вне его */
+    if (zone->free_pages < 2 * (1UL << order)) {
+        return COMPACT_SKIPPED;
+    }
+    if (index <= COMPACT_EXTFRAG_THRESHOLD) {
+        return COMPACT_SKIPPED;
+    }
+    return COMPACT_CONTINUE;
+}
+
+/* Недавно не удалось: эта попытка пропускается */
+static bool compaction_deferred(struct zone* zone) {
+    if (++zone->compact_considered >= (1U << zone->compact_defer_shift)) {
+        zone->compact_considered = 1U << zone->compact_defer_shift;
+        return false;
+    }
+    compact_stats.deferred++;
+    return true;
+}
+
+static void defer_compaction(struct zone* zone) {
+    zone->compact_considered = 0;
+    if (zone->compact_defer_shift < COMPACT_MAX_DEFER_SHIFT) {
+        zone->compact_defer_shift++;
+    }
+}
+
+static void compaction_defer_reset(struct zone* zone) {
+    zone->compact_considered = 0;
+    zone->compact_defer_shift = 0;
+}
+
+/* ============================================================================
+ * Выбор блока
+ * ============================================================================ */
+
+/* Занятых страниц в блоке или -1, если среди них есть заведомо неперемещаемые */
+static int64_t block_used_pages(const struct zone* zone, uint64_t start, uint64_t nr) {
+    int64_t used = 0;
+    for (uint64_t pfn = start; pfn < start + nr;) {
+        struct page* page = pfn_to_page(pfn);
+        if (page->node != zone->node) {
+            return -1;
+        }
+        if (page->flags & PG_BUDDY) {
+            pfn += 1UL << page->order;
+            continue;
+        }
+        /* Ссылок нет, но не в buddy: пул обнулённых или изъятый блок */
+        if (page->refcount <= 0 || page->order != 0 || page == zero_page ||
+            (page->flags & (PG_RESERVED | PG_SLAB | PG_KSM))) {
+            return -1;
+        }
+        used++;
+        pfn++;
+    }
+    return used;
+}
+
+/* Блок с наименьшим числом занятых страниц, кроме уже опробованных */
+static bool find_block(const struct zone* zone, uint64_t nr, const uint64_t* tried,
+                       uint32_t nr_tried, uint64_t* out) {
+    int64_t best = -1;
+    for (uint64_t start = ALIGN_UP(zone->start_pfn, nr); start + nr <= zone->end_pfn;
+         start += nr) {
+        bool skip = false;
+        for (uint32_t i = 0; i < nr_tried; i++) {
+            skip |= tried[i] == start;
+        }
+        int64_t used = skip ? -1 : block_used_pages(zone, start, nr);
+        if (used > 0 && (best < 0 || used < best)) {
+            best = used;
+            *out = start;
+        }
+    }
+    return best > 0;
+}
+
+/* ============================================================================
+ * Перенос страниц блока
+ * ============================================================================ */
+
+/*
+ * Обход записей PTE всех адресных пространств, указывающих в блок:
+ * подсчёт (remap false) или перенаправление на новые страницы.
+ */
+static void walk_block_ptes(uint64_t start, uint64_t nr, bool remap) {
+    for (struct mm_struct* mm = mmlist_next(NULL); mm; mm = mmlist_next(mm)) {
+        bool changed = false;
+        for (uint32_t i = USER_PGD_FIRST; i <= USER_PGD_LAST; i++) {
+            if (!pte_present(mm->pgd[i])) {
+                continue;
+            }
+            pte_t* pud = pte_table(mm->pgd[i]);
+            for (uint32_t j = 0; j < PTRS_PER_TABLE; j++) {
+                if (!pte_present(pud[j]) || (pud[j] & _PAGE_PSE)) {
+                    continue;
+                }
+                pte_t* pmd = pte_table(pud[j]);
+                for (uint32_t k = 0; k < PTRS_PER_TABLE; k++) {
+                    /* Большая страница - составной блок, такие блоки не выбираются */
+                    if (!pte_present(pmd[k]) || (pmd[k] & _PAGE_PSE)) {
+                        continue;
+                    }
+                    pte_t* table = pte_table(pmd[k]);
+                    for (uint32_t l = 0; l < PTRS_PER_TABLE; l++) {
+                        pte_t pte = table[l];
+                        uint64_t idx = ((pte & PTE_ADDR_MASK) >> PAGE_SHIFT) - start;
+                        if (!pte_present(pte) || idx >= nr) {
+                            continue;
+                        }
+                        if (remap) {
+                            table[l] = mk_pte(block_new[idx], pte & ~PTE_ADDR_MASK);
+                            changed = true;
+                        } else {
+                            block_refs[idx]++;
+                        }
+                    }
+                }
+            }
+        }
+        if (changed) {
+            flush_tlb_mm(mm);
+        }
+    }
+}
+
+static void migrate_page_copy(struct page* new, struct page* old) {
+    memcpy(page_address(new), page_address(old), PAGE_SIZE);
+    new->flags = old->flags;
+    new->refcount = old->refcount;
+    new->private = old->private;
+    if (old->mapping) {
+        replace_page_cache_page(old, new);
+    }
+}
+
+/*
+ * Перенос всех занятых страниц блока [start, start + nr). 0 - блок
+ * свободен целиком, -EBUSY - в нём есть неперемещаемая страница,
+ * -ENOMEM - копиям не хватило места.
+ */
+static int compact_block(struct zone* zone, uint64_t start, uint64_t nr) {
+    memset(block_refs, 0, nr * sizeof(block_refs[0]));
+    walk_block_ptes(start, nr, false);
+
+    for (uint64_t pfn = start; pfn < start + nr;) {
+        struct page* page = pfn_to_page(pfn);
+        if (page->flags & PG_BUDDY) {
+            pfn += 1UL << page->order;
+            continue;
+        }
+        int32_t expected = (int32_t)block_refs[pfn - start] + (page->mapping ? 1 : 0);
+        if (expected == 0 || page->refcount != expected) {
+            return -EBUSY;
+        }
+        pfn++;
+    }
+
+    /* Свободные части блока изымаются: копии не должны попасть в него же */
+    struct list_head isolated = LIST_HEAD_INIT(isolated);
+    for (uint64_t pfn = start; pfn < start + nr;) {
+        struct page* page = pfn_to_page(pfn);
+        if (!(page->flags & PG_BUDDY)) {
+            block_new[pfn - start] = NULL;
+            pfn++;
+            continue;
+        }
+        pfn += 1UL << page->order;
+        isolate_free_block(page);
+        list_add(&page->lru, &isolated);
+    }
+
+    int err = 0;
+    for (uint64_t pfn = start; pfn < start + nr;) {
+        struct page* page = pfn_to_page(pfn);
+        if (page->refcount == 0) {
+            pfn += 1UL << page->order;
+            continue;
+        }
+        block_new[pfn - start] = alloc_pages_node((int)zone->node, 0);
+        if (!block_new[pfn - start]) {
+            err = -ENOMEM;
+            break;
+        }
+        pfn++;
+    }
+
+    if (err == 0) {
+        uint64_t migrated = 0;
+        for (uint64_t i = 0; i < nr; i++) {
+            if (block_new[i]) {
+                migrate_page_copy(block_new[i], pfn_to_page(start + i));
+                migrated++;
+            }
+        }
+        walk_block_ptes(start, nr, true);
+        compact_stats.pages_migrated += migrated;
+    }
+
+    /* Старые страницы (или новые, если перенос не удался) - в buddy */
+    for (uint64_t i = 0; i < nr; i++) {
+        if (!block_new[i]) {
+            continue;
+        }
+        struct page* page = err == 0 ? pfn_to_page(start + i) : block_new[i];
+        block_new[i] = NULL;
+        page->refcount = 1;
+        page->private = 0;
+        put_page(page);
+    }
+    struct list_head* pos;
+    struct list_head* tmp;
+    list_for_each_safe(pos, tmp, &isolated) {
+        struct page* page = list_entry(pos, struct page, lru);
+        list_del(&page->lru);
+        putback_isolated_block(page, false);
+    }
+    return err;
+}
+
+/* Уплотнение зоны до появления блока порядка order */
+static bool compact_zone(struct zone* zone, unsigned int order) {
+    uint64_t nr = 1UL << order;
+    uint64_t tried[COMPACT_MAX_BLOCKS];
+    uint32_t nr_tried = 0;
+
+    while (nr_tried < COMPACT_MAX_BLOCKS) {
+        uint64_t start;
+        if (!find_block(zone, nr, tried, nr_tried, &start)) {
+            break;
+        }
+        tried[nr_tried++] = start;
+
+        int err = compact_block(zone, start, nr);
+        if (err == 0) {
+            compaction_defer_reset(zone);
+            compact_stats.success++;
+            return true;
+        }
+        if (err != -EBUSY) {
+            break;
+        }
+        compact_stats.blocks_busy++;
+    }
+    defer_compaction(zone);
+    compact_stats.fail++;
+    return false;
+}
+
+bool try_to_compact_pages(int nid, unsigned int order) {
+    if (nid == NUMA_NO_NODE || (uint32_t)nid >= nr_node_ids) {
+        nid = (int)numa_node_id();
+    }
+    compact_stats.stall++;
+
+    struct pglist_data* pgdat = NODE_DATA((uint32_t)nid);
+    for (uint32_t i = 0; i < pgdat->nr_zonelist; i++) {
+        struct zone* zone = &pgdat->zonelist[i]->zone;
+        enum compact_result result = compaction_suitable(zone, order);
+        if (result == COMPACT_SUCCESS) {
+            return true;
+        }
+        if (result == COMPACT_SKIPPED || compaction_deferred(zone)) {
+            continue;
+        }
+        if (compact_zone(zone, order)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void wakeup_kcompactd(int nid, unsigned int order) {
+    if (nid == NUMA_NO_NODE || (uint32_t)nid >= nr_node_ids) {
+        nid = (int)numa_node_id();
+    }
+    kcompactd_order[nid] = (uint8_t)MAX(kcompactd_order[nid], order);
+}
+
+void kcompactd_run(void) {
+    for (uint32_t nid = 0; nid < nr_node_ids; nid++) {
+        struct zone* zone = &NODE_DATA(nid)->zone;
+        unsigned int order = kcompactd_order[nid] ? kcompactd_order[nid]
+                                                  : COMPACT_PROACTIVE_ORDER;
+        kcompactd_order[nid] = 0;
+
+        if (compaction_suitable(zone, order) != COMPACT_CONTINUE ||
+            compaction_deferred(zone)) {
+            continue;
+        }
+        compact_stats.kcompactd_runs++;
+        compact_zone(zone, order);
+    }
+}
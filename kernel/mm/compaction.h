@@ -0,0 +1,77 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/compaction.h
+ * Уплотнение памяти: сборка непрерывных свободных блоков
+ *
+ * Со временем свободная память дробится, и выделения порядка > 0 (большие
+ * страницы, буферы DMA) перестают находить блок. Уплотнение переносит
+ * перемещаемые страницы (анонимные и page cache) из выбранного блока в
+ * свободные страницы вне его, и блок освобождается целиком.
+ *
+ * Обратных отображений нет, поэтому блок выбирается заранее: выровненный
+ * диапазон 2^order страниц с наименьшим числом занятых, среди которых нет
+ * заведомо неперемещаемых (kmalloc, зарезервированные, составные блоки,
+ * страницы KSM). Затем обход таблиц страниц всех адресных пространств
+ * считает записи PTE, указывающие в блок. Страница перемещаема, если эти
+ * записи и ссылка page cache объясняют все её ссылки; иначе её держит
+ * кто-то ещё (таблицы страниц, буфер ФС, драйвер). После копирования
+ * второй обход переписывает записи на новые страницы.
+ *
+ * Уплотнение запускает неудачное выделение (прямое - для вызывающих без
+ * запасного пути) и фоновый kcompactd в простое, который к тому же
+ * держит наготове блок под большую страницу, если таких блоков нет
+ * из-за фрагментации. После неудачи попытки на зоне откладываются.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_COMPACTION_H
+#define MIXOS_MM_COMPACTION_H
+
+#include "mm/pmm.h"
+
+/*
+ * Индекс фрагментации выше порога - выделение не удаётся из-за
+ * раздробленности, ниже - из-за нехватки памяти, и уплотнять бесполезно
+ * (аналог /proc/sys/vm/extfrag_threshold).
+ */
+#define COMPACT_EXTFRAG_THRESHOLD   500
+
+/* Порядок, блок которого kcompactd держит наготове: 2 MiB */
+#define COMPACT_PROACTIVE_ORDER     9
+
+/* После неудач уплотняется не чаще каждой 2^6-й попытки */
+#define COMPACT_MAX_DEFER_SHIFT     6
+
+/* Блоков, которые пробует одно уплотнение зоны */
+#define COMPACT_MAX_BLOCKS          4
+
+struct compact_stats {
+    uint64_t stall;                 /* Прямых уплотнений при выделении */
+    uint64_t kcompactd_runs;        /* Фоновых уплотнений */
+    uint64_t success;               /* Уплотнений, собравших блок */
+    uint64_t fail;
+    uint64_t deferred;              /* Попыток пропущено после неудач */
+    uint64_t blocks_busy;           /* Блоков с неперемещаемыми страницами */
+    uint64_t pages_migrated;
+};
+
+extern struct compact_stats compact_stats;
+
+/*
+ * Индекс фрагментации зоны для порядка order (аналог
+ * /sys/kernel/debug/extfrag/extfrag_index) в тысячных: -1000 - блок
+ * нужного порядка есть, около 0 - не хватает памяти, около 1000 -
+ * свободной памяти достаточно, но она раздроблена.
+ */
+int fragmentation_index(const struct zone* zone, unsigned int order);
+
+/* Прямое уплотнение зон узла nid; true - блок порядка order появился */
+bool try_to_compact_pages(int nid, unsigned int order);
+
+/* Заказ фонового уплотнения после неудачного выделения */
+void wakeup_kcompactd(int nid, unsigned int order);
+
+/* Шаг фонового уплотнения (из цикла простоя) */
+void kcompactd_run(void);
+
+#endif /* MIXOS_MM_COMPACTION_H */
@@ -0,0 +1,300 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/huge_memory.c
+ * Прозрачные большие страницы: отказы, расщепление и khugepaged
+ * ============================================================================
+ */
+
+#include "mm/huge_mm.h"
+#include "mm/tlb.h"
+#include "errno.h"
+
+struct thp_stats thp_stats;
+bool thp_enabled = true;
+
+static uint64_t vma_pmd_flags(struct vm_area_struct* vma, bool writable) {
+    uint64_t flags = _PAGE_PRESENT | _PAGE_USER | _PAGE_ACCESSED | _PAGE_PSE;
+    if (writable && (vma->flags & VM_WRITE)) {
+        flags |= _PAGE_RW | _PAGE_DIRTY;
+    }
+    return flags;
+}
+
+/* Отказ и khugepaged обходятся страницами по 4 KiB: уплотнение - в фоне */
+static struct page* alloc_huge_page(void) {
+    return try_alloc_pages(HPAGE_PMD_ORDER);
+}
+
+uint64_t thp_get_unmapped_area(struct mm_struct* mm, uint64_t len) {
+    /* С запасом на выравнивание: внутри любого такого промежутка найдётся
+     * выровненный адрес, после которого остаётся len */
+    uint64_t addr = get_unmapped_area(mm, len + HPAGE_SIZE - PAGE_SIZE);
+    if (addr) {
+        return ALIGN_UP(addr, HPAGE_SIZE);
+    }
+    return get_unmapped_area(mm, len);
+}
+
+/* ============================================================================
+ * Отказы
+ * ============================================================================ */
+
+int do_huge_pmd_anonymous_page(struct mm_struct* mm, struct vm_area_struct* vma,
+                               uint64_t haddr, pte_t* pmd) {
+    struct page* page = alloc_huge_page();
+    if (!page) {
+        thp_stats.fault_fallback++;
+        return -ENOMEM;
+    }
+    memset(page_address(page), 0, HPAGE_SIZE);
+    *pmd = mk_pte(page, vma_pmd_flags(vma, true));
+    mm->anon_huge_pages++;
+    thp_stats.fault_alloc++;
+    flush_tlb_page(mm, haddr);
+    return 0;
+}
+
+/*
+ * Копия большой страницы, общей после fork. Если блока на 2 MiB нет,
+ * PMD расщепляется, и do_wp_page копирует только страницу отказа.
+ */
+int do_huge_pmd_wp_page(struct mm_struct* mm, struct vm_area_struct* vma,
+                        uint64_t haddr, pte_t* pmd) {
+    struct page* old = pte_page(*pmd);
+
+    if (old->refcount == 1) {
+        /* Единственный владелец: копия не нужна */
+        *pmd |= vma_pmd_flags(vma, true);
+        flush_tlb_page(mm, haddr);
+        return 0;
+    }
+
+    struct page* copy = alloc_huge_page();
+    if (!copy) {
+        thp_stats.fault_fallback++;
+        int err = split_huge_pmd(mm, pmd, haddr);
+        return err < 0 ? err : -ENOMEM;
+    }
+    memcpy(page_address(copy), page_address(old), HPAGE_SIZE);
+    *pmd = mk_pte(copy, vma_pmd_flags(vma, true));
+    put_page(old);
+    thp_stats.fault_alloc++;
+    flush_tlb_page(mm, haddr);
+    return 0;
+}
+
+/* ============================================================================
+ * Расщепление
+ * ============================================================================ */
+
+/*
+ * Блок единственного владельца распадается на 512 независимых страниц
+ * порядка 0 (buddy сольёт их обратно при освобождении). Блок, который
+ * видят другие адресные пространства, так разделить нельзя: их записи
+ * PMD держат ссылку на голову блока. Тогда этот процесс получает копии
+ * страниц, а его ссылка на блок снимается.
+ */
+int split_huge_pmd(struct mm_struct* mm, pte_t* pmd, uint64_t addr) {
+    struct page* head = pte_page(*pmd);
+    uint64_t flags = *pmd & (_PAGE_PRESENT | _PAGE_RW | _PAGE_USER |
+                             _PAGE_ACCESSED | _PAGE_DIRTY);
+    uint64_t haddr = addr & HPAGE_MASK;
+
+    struct page* table_page = alloc_zeroed_page();
+    if (!table_page) {
+        return -ENOMEM;
+    }
+    pte_t* table = page_address(table_page);
+
+    if (head->refcount == 1) {
+        for (uint32_t i = 0; i < HPAGE_PMD_NR; i++) {
+            struct page* page = head + i;
+            if (i > 0) {
+                page->flags = 0;
+                page->refcount = 1;
+                page->mapping = NULL;
+                page->index = 0;
+                page->hash_next = NULL;
+                page->private = 0;
+                list_init(&page->lru);
+            }
+            page->order = 0;
+            table[i] = mk_pte(page, flags);
+        }
+    } else {
+        for (uint32_t i = 0; i < HPAGE_PMD_NR; i++) {
+            struct page* copy = alloc_page();
+            if (!copy) {
+                while (i-- > 0) {
+                    put_page(pte_page(table[i]));
+                }
+                free_page(table_page);
+                return -ENOMEM;
+            }
+            memcpy(page_address(copy), (uint8_t*)page_address(head) + i * PAGE_SIZE,
+                   PAGE_SIZE);
+            table[i] = mk_pte(copy, flags);
+        }
+        put_page(head);
+    }
+
+    *pmd = mk_pte(table_page, _PAGE_TABLE);
+    mm->anon_huge_pages--;
+    mm->anon_pages += HPAGE_PMD_NR;
+    thp_stats.split++;
+    flush_tlb_page(mm, haddr);
+    return 0;
+}
+
+int split_huge_pmd_address(struct mm_struct* mm, uint64_t addr) {
+    if ((addr & ~HPAGE_MASK) == 0) {
+        return 0;
+    }
+    pte_t* pmd = pmd_offset(mm, addr, false);
+    if (!pmd || !pmd_huge(*pmd)) {
+        return 0;
+    }
+    return split_huge_pmd(mm, pmd, addr);
+}
+
+/* ============================================================================
+ * khugepaged
+ *
+ * Диапазоны, отказы в которых не нашли свободного блока, остаются из
+ * страниц по 4 KiB. khugepaged обходит анонимные области зарегистрированных
+ * mm и собирает выровненные диапазоны, где все 512 страниц присутствуют и
+ * принадлежат только этому процессу, в одну большую страницу. Сканирование
+ * идёт порциями с запоминанием позиции, так что один вызов стоит не
+ * больше заданного числа страниц.
+ * ============================================================================ */
+
+static struct list_head khugepaged_mms = LIST_HEAD_INIT(khugepaged_mms);
+
+/* Позиция сканирования: mm и адрес внутри него */
+static struct {
+    struct mm_struct* mm;
+    uint64_t address;
+} khugepaged_cursor;
+
+void khugepaged_enter(struct mm_struct* mm) {
+    if (list_empty(&mm->khugepaged_link)) {
+        list_add_tail(&mm->khugepaged_link, &khugepaged_mms);
+    }
+}
+
+/* Следующий mm списка или NULL в конце прохода */
+static struct mm_struct* khugepaged_next_mm(struct mm_struct* mm) {
+    struct list_head* next = mm->khugepaged_link.next;
+    if (next == &khugepaged_mms) {
+        return NULL;
+    }
+    return list_entry(next, struct mm_struct, khugepaged_link);
+}
+
+void khugepaged_exit(struct mm_struct* mm) {
+    if (list_empty(&mm->khugepaged_link)) {
+        return;
+    }
+    if (khugepaged_cursor.mm == mm) {
+        khugepaged_cursor.mm = khugepaged_next_mm(mm);
+        khugepaged_cursor.address = 0;
+    }
+    list_del(&mm->khugepaged_link);
+}
+
+/* 1 - диапазон собран, 0 - не подходит, -ENOMEM - нет свободного блока */
+static int collapse_huge_page(struct mm_struct* mm, struct vm_area_struct* vma,
+                              uint64_t haddr) {
+    pte_t* pmd = pmd_offset(mm, haddr, false);
+    if (!pmd || !pte_present(*pmd) || pmd_huge(*pmd)) {
+        return 0;
+    }
+
+    pte_t* table = pte_table(*pmd);
+    bool writable = true;
+    for (uint32_t i = 0; i < HPAGE_PMD_NR; i++) {
+        if (!pte_present(table[i])) {
+            return 0;
+        }
+        struct page* page = pte_page(table[i]);
+        if (!page_anon(page) || page->refcount != 1) {
+            return 0;
+        }
+        writable &= pte_write(table[i]);
+    }
+
+    struct page* huge = alloc_huge_page();
+    if (!huge) {
+        thp_stats.collapse_fail++;
+        return -ENOMEM;
+    }
+    for (uint32_t i = 0; i < HPAGE_PMD_NR; i++) {
+        memcpy((uint8_t*)page_address(huge) + i * PAGE_SIZE,
+               page_address(pte_page(table[i])), PAGE_SIZE);
+    }
+
+    *pmd = mk_pte(huge, vma_pmd_flags(vma, writable));
+    flush_tlb_range(mm, haddr, haddr + HPAGE_SIZE);
+    for (uint32_t i = 0; i < HPAGE_PMD_NR; i++) {
+        put_page(pte_page(table[i]));
+    }
+    free_page(virt_to_page(table));
+    mm->anon_pages -= HPAGE_PMD_NR;
+    mm->anon_huge_pages++;
+    thp_stats.collapse_alloc++;
+    return 1;
+}
+
+bool khugepaged_has_work(void) {
+    return thp_enabled && !list_empty(&khugepaged_mms);
+}
+
+uint32_t khugepaged_scan(uint32_t pages) {
+    uint32_t collapsed = 0;
+
+    if (!thp_enabled || list_empty(&khugepaged_mms)) {
+        return 0;
+    }
+    if (!khugepaged_cursor.mm) {
+        khugepaged_cursor.mm = list_first_entry(&khugepaged_mms, struct mm_struct,
+                                                khugepaged_link);
+        khugepaged_cursor.address = 0;
+    }
+
+    while (pages > 0) {
+        struct mm_struct* mm = khugepaged_cursor.mm;
+        struct vm_area_struct* vma = find_vma(mm, khugepaged_cursor.address);
+
+        for (; vma; vma = vma->list.next == &mm->vmas ? NULL
+                        : list_entry(vma->list.next, struct vm_area_struct, list)) {
+            if (vma->file || (vma->flags & VM_SHARED)) {
+                continue;
+            }
+            uint64_t addr = ALIGN_UP(MAX(vma->start, khugepaged_cursor.address), HPAGE_SIZE);
+            for (; addr + HPAGE_SIZE <= vma->end; addr += HPAGE_SIZE) {
+                if (pages == 0) {
+                    return collapsed;
+                }
+                pages -= MIN(pages, HPAGE_PMD_NR);
+                thp_stats.pages_scanned += HPAGE_PMD_NR;
+                khugepaged_cursor.address = addr + HPAGE_SIZE;
+
+                int ret = collapse_huge_page(mm, vma, addr);
+                if (ret < 0) {
+                    /* Непрерывной памяти нет: следующая попытка в другой раз */
+                    return collapsed;
+                }
+                collapsed += ret;
+            }
+        }
+
+        /* mm просмотрен целиком */
+        khugepaged_cursor.mm = khugepaged_next_mm(mm);
+        khugepaged_cursor.address = 0;
+        if (!khugepaged_cursor.mm) {
+            thp_stats.full_scans++;
+            break;
+        }
+    }
+    return collapsed;
+}
@@ -0,0 +1,102 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/huge_mm.h
+ * Прозрачные большие страницы (THP) для анонимной памяти
+ *
+ * Выровненный на 2 MiB диапазон анонимной области, целиком лежащий в ней,
+ * при первом отказе отображается одной записью PMD с битом PS на блок
+ * порядка 9 из buddy-аллокатора. Если непрерывного блока нет, отказ
+ * обслуживается обычными страницами по 4 KiB; позже khugepaged собирает
+ * полностью заполненные диапазоны таких страниц в большие.
+ *
+ * Большая страница держит одну ссылку на голову блока и никогда не
+ * пересекает границу области: частичное снятие отображения сначала
+ * расщепляет её на таблицу PTE.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_HUGE_MM_H
+#define MIXOS_MM_HUGE_MM_H
+
+#include "mm/mm.h"
+
+#define HPAGE_SHIFT         PMD_SHIFT
+#define HPAGE_SIZE          (1ULL << HPAGE_SHIFT)
+#define HPAGE_MASK          (~(HPAGE_SIZE - 1))
+#define HPAGE_PMD_ORDER     (HPAGE_SHIFT - PAGE_SHIFT)
+#define HPAGE_PMD_NR        (1U << HPAGE_PMD_ORDER)
+
+/* Сколько страниц просматривает khugepaged за один вызов */
+#define KHUGEPAGED_PAGES_TO_SCAN    (8 * HPAGE_PMD_NR)
+
+/* Счётчики событий THP (аналог /proc/vmstat) */
+struct thp_stats {
+    uint64_t fault_alloc;           /* Большая страница выделена при отказе */
+    uint64_t fault_fallback;        /* Не нашлось блока: отказ по 4 KiB */
+    uint64_t collapse_alloc;        /* khugepaged собрал большую страницу */
+    uint64_t collapse_fail;         /* Диапазон подходил, но блока не нашлось */
+    uint64_t split;                 /* Большая страница расщеплена на PTE */
+    uint64_t pages_scanned;         /* Страниц просмотрено khugepaged */
+    uint64_t full_scans;            /* Полных проходов по всем mm */
+};
+
+extern struct thp_stats thp_stats;
+
+/* Выключатель THP (аналог /sys/kernel/mm/transparent_hugepage/enabled) */
+extern bool thp_enabled;
+
+/* Запись PMD, отображающая большую страницу */
+static inline bool pmd_huge(pte_t pmd) {
+    return (pmd & (_PAGE_PRESENT | _PAGE_PSE)) == (_PAGE_PRESENT | _PAGE_PSE);
+}
+
+/* Доля анонимной памяти mm в больших страницах, в процентах */
+static inline uint32_t mm_thp_coverage(const struct mm_struct* mm) {
+    uint64_t huge = mm->anon_huge_pages * HPAGE_PMD_NR;
+    uint64_t total = huge + mm->anon_pages;
+    return total ? (uint32_t)(huge * 100 / total) : 0;
+}
+
+/* Адрес под анонимное отображение длины len, выровненный на 2 MiB */
+uint64_t thp_get_unmapped_area(struct mm_struct* mm, uint64_t len);
+
+/*
+ * Отказ в пустой записи PMD выровненного диапазона haddr анонимной
+ * области. 0 - отображена большая страница; иначе отказ нужно
+ * обслужить страницами по 4 KiB.
+ */
+int do_huge_pmd_anonymous_page(struct mm_struct* mm, struct vm_area_struct* vma,
+                               uint64_t haddr, pte_t* pmd);
+
+/*
+ * Запись в большую страницу, отображённую только для чтения. 0 - запись
+ * разрешена; иначе PMD уже расщеплён и отказ продолжается на уровне PTE.
+ */
+int do_huge_pmd_wp_page(struct mm_struct* mm, struct vm_area_struct* vma,
+                        uint64_t haddr, pte_t* pmd);
+
+/* Замена большой страницы таблицей из 512 PTE с теми же правами */
+int split_huge_pmd(struct mm_struct* mm, pte_t* pmd, uint64_t addr);
+
+/* Расщепление большой страницы, внутри которой (не на границе) лежит addr */
+int split_huge_pmd_address(struct mm_struct* mm, uint64_t addr);
+
+/* ============================================================================
+ * khugepaged
+ * ============================================================================ */
+
+/* mm с анонимными областями от 2 MiB попадает в список сканирования */
+void khugepaged_enter(struct mm_struct* mm);
+void khugepaged_exit(struct mm_struct* mm);
+
+/*
+ * Один шаг фонового сканирования: не больше pages страниц, начиная с
+ * места, где остановился предыдущий вызов. Возвращает число собранных
+ * больших страниц.
+ */
+uint32_t khugepaged_scan(uint32_t pages);
+
+/* Есть что сканировать: THP включены и список mm не пуст */
+bool khugepaged_has_work(void);
+
+#endif /* MIXOS_MM_HUGE_MM_H */
@@ -0,0 +1,95 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/kmalloc.c
+ * Куча ядра: объекты до 2 KiB нарезаются из страниц по классам размеров,
+ * более крупные запросы обслуживаются напрямую buddy-аллокатором.
+ * ============================================================================
+ */
+
+#include "mm/kmalloc.h"
+#include "mm/pmm.h"
+
+/* Свободный объект хранит указатель на следующий свободный объект */
+struct kmalloc_free_object {
+    struct kmalloc_free_object* next;
+};
+
+struct kmalloc_class {
+    size_t size;
+    struct kmalloc_free_object* free_list;
+};
+
+static struct kmalloc_class kmalloc_classes[] = {
+    { 16, NULL }, { 32, NULL }, { 64, NULL }, { 128, NULL },
+    { 256, NULL }, { 512, NULL }, { 1024, NULL }, { 2048, NULL },
+};
+
+/* Нарезка новой страницы на объекты класса */
+static bool kmalloc_refill(size_t class_index) {
+    struct kmalloc_class* cls = &kmalloc_classes[class_index];
+    struct page* page = alloc_page();
+    if (!page) {
+        return false;
+    }
+    page->flags |= PG_SLAB;
+    page->private = class_index;
+
+    uint8_t* base = page_address(page);
+    for (size_t offset = 0; offset + cls->size <= PAGE_SIZE; offset += cls->size) {
+        struct kmalloc_free_object* object = (struct kmalloc_free_object*)(base + offset);
+        object->next = cls->free_list;
+        cls->free_list = object;
+    }
+    return true;
+}
+
+void* kmalloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(kmalloc_classes); i++) {
+        struct kmalloc_class* cls = &kmalloc_classes[i];
+        if (size > cls->size) {
+            continue;
+        }
+        if (!cls->free_list && !kmalloc_refill(i)) {
+            return NULL;
+        }
+        struct kmalloc_free_object* object = cls->free_list;
+        cls->free_list = object->next;
+        return object;
+    }
+
+    /* Крупный объект: целый блок страниц */
+    unsigned int order = 0;
+    while ((PAGE_SIZE << order) < size) {
+        order++;
+    }
+    struct page* page = alloc_pages(order);
+    return page ? page_address(page) : NULL;
+}
+
+void* kzalloc(size_t size) {
+    void* ptr = kmalloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void kfree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    struct page* page = virt_to_page(ptr);
+    if (page->flags & PG_SLAB) {
+        struct kmalloc_class* cls = &kmalloc_classes[page->private];
+        struct kmalloc_free_object* object = ptr;
+        object->next = cls->free_list;
+        cls->free_list = object;
+        return;
+    }
+    put_page(page);
+}
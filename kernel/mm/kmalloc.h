@@ -0,0 +1,17 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/kmalloc.h
+ * Куча ядра: аллокатор объектов по классам размеров
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_KMALLOC_H
+#define MIXOS_MM_KMALLOC_H
+
+#include "kernel.h"
+
+void* kmalloc(size_t size);
+void* kzalloc(size_t size);
+void kfree(void* ptr);
+
+#endif /* MIXOS_MM_KMALLOC_H */
@@ -0,0 +1,436 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/ksm.c
+ * Слияние одинаковых анонимных страниц (KSM)
+ * ============================================================================
+ */
+
+#include "mm/ksm.h"
+#include "mm/huge_mm.h"
+#include "mm/kmalloc.h"
+
+bool ksm_run;
+uint32_t ksm_pages_to_scan = KSM_PAGES_TO_SCAN;
+bool ksm_use_zero_pages = true;
+
+static struct ksm_stats ksm_stats;
+
+/*
+ * page->private анонимной страницы вне деревьев: контрольная сумма,
+ * посчитанная на прошлом проходе. У страницы KSM там её узел
+ * стабильного дерева.
+ */
+#define KSM_CHECKSUM_VALID  (1ULL << 32)
+
+/* Контрольная сумма страницы из одних нулей (см. calc_checksum) */
+#define ZERO_PAGE_CHECKSUM  0
+
+/* Общая страница в стабильном дереве; дерево держит на неё ссылку */
+struct stable_node {
+    struct avl_node node;
+    struct page* kpage;
+};
+
+/*
+ * Кандидат в нестабильном дереве. Ссылки на страницу он не держит:
+ * иначе запись в неё копировала бы страницу в do_wp_page, а подкачка
+ * пропускала бы её до конца прохода. Страница действительна, пока её
+ * отображает PTE кандидата (rmap_item_pte).
+ */
+struct rmap_item {
+    struct avl_node node;
+    struct list_head list;          /* Все кандидаты текущего прохода */
+    struct mm_struct* mm;
+    uint64_t address;
+    struct page* page;
+};
+
+static struct avl_root stable_tree;
+static uint64_t nr_stable_nodes;
+
+static struct avl_root unstable_tree;
+static struct list_head unstable_items = LIST_HEAD_INIT(unstable_items);
+
+static struct list_head ksm_mms = LIST_HEAD_INIT(ksm_mms);
+
+/* Позиция сканирования: mm и адрес внутри него */
+static struct {
+    struct mm_struct* mm;
+    uint64_t address;
+} ksm_cursor;
+
+/*
+ * Быстрая 32-битная сумма содержимого: четыре независимые цепочки
+ * умножений, чтобы не ждать каждое умножение. Сумма нулей - ноль.
+ */
+static uint32_t calc_checksum(const void* data) {
+    const uint64_t* words = data;
+    uint64_t h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i += 4) {
+        h0 = (h0 + words[i]) * 0x9E3779B97F4A7C15ULL;
+        h1 = (h1 + words[i + 1]) * 0xC2B2AE3D27D4EB4FULL;
+        h2 = (h2 + words[i + 2]) * 0x165667B19E3779F9ULL;
+        h3 = (h3 + words[i + 3]) * 0xD6E8FEB86659FD93ULL;
+    }
+    uint64_t h = h0 ^ (h1 >> 7) ^ (h2 >> 13) ^ (h3 >> 19);
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static inline int memcmp_pages(struct page* a, struct page* b) {
+    return memcmp(page_address(a), page_address(b), PAGE_SIZE);
+}
+
+/* ============================================================================
+ * Деревья
+ * ============================================================================ */
+
+/* PTE кандидата, если он всё ещё отображает свою страницу и только он */
+static pte_t* rmap_item_pte(struct rmap_item* item) {
+    pte_t* pte = pte_offset(item->mm, item->address, false);
+    if (!pte || !pte_present(*pte) || pte_page(*pte) != item->page) {
+        return NULL;
+    }
+    if (item->page->refcount != 1) {
+        return NULL;
+    }
+    return pte;
+}
+
+static struct page* stable_tree_search(struct page* page) {
+    struct avl_node* node = stable_tree.node;
+    while (node) {
+        struct stable_node* sn = avl_entry(node, struct stable_node, node);
+        int ret = memcmp_pages(page, sn->kpage);
+        if (ret == 0) {
+            return sn->kpage;
+        }
+        node = ret < 0 ? node->left : node->right;
+    }
+    return NULL;
+}
+
+static void stable_tree_insert(struct stable_node* sn) {
+    struct avl_node** link = &stable_tree.node;
+    struct avl_node* parent = NULL;
+    while (*link) {
+        parent = *link;
+        struct stable_node* other = avl_entry(parent, struct stable_node, node);
+        link = memcmp_pages(sn->kpage, other->kpage) < 0 ? &parent->left : &parent->right;
+    }
+    avl_insert(&stable_tree, &sn->node, parent, link, NULL);
+    nr_stable_nodes++;
+}
+
+static void stable_node_free(struct stable_node* sn) {
+    struct page* kpage = sn->kpage;
+    avl_erase(&stable_tree, &sn->node, NULL);
+    nr_stable_nodes--;
+    kpage->flags &= ~PG_KSM;
+    kpage->private = 0;
+    put_page(kpage);
+    kfree(sn);
+}
+
+static void unstable_item_remove(struct rmap_item* item) {
+    avl_erase(&unstable_tree, &item->node, NULL);
+    list_del(&item->list);
+    kfree(item);
+}
+
+/*
+ * Кандидат с тем же содержимым, что у page, или NULL - тогда page
+ * добавляется в дерево сама. Содержимое страниц дерева могло измениться
+ * после вставки, поэтому найденного кандидата ещё нужно проверить. Узел,
+ * чья страница больше не отображена, удаляется, и спуск начинается
+ * заново: страница могла освободиться, и сравнивать с ней нельзя.
+ */
+static struct rmap_item* unstable_tree_search_insert(struct mm_struct* mm, uint64_t addr,
+                                                     struct page* page) {
+    struct avl_node** link = &unstable_tree.node;
+    struct avl_node* parent = NULL;
+    while (*link) {
+        parent = *link;
+        struct rmap_item* item = avl_entry(parent, struct rmap_item, node);
+        if (item->page == page) {
+            return NULL;
+        }
+        if (!rmap_item_pte(item)) {
+            unstable_item_remove(item);
+            link = &unstable_tree.node;
+            parent = NULL;
+            continue;
+        }
+        int ret = memcmp_pages(page, item->page);
+        if (ret == 0) {
+            return item;
+        }
+        link = ret < 0 ? &parent->left : &parent->right;
+    }
+
+    struct rmap_item* item = kmalloc(sizeof(*item));
+    if (!item) {
+        return NULL;
+    }
+    item->mm = mm;
+    item->address = addr;
+    item->page = page;
+    avl_insert(&unstable_tree, &item->node, parent, link, NULL);
+    list_add_tail(&item->list, &unstable_items);
+    return NULL;
+}
+
+/* ============================================================================
+ * Слияние
+ * ============================================================================ */
+
+/*
+ * Запрет записи перед сравнением: после сброса TLB содержимое страницы
+ * не изменится до слияния. Лишняя защита после неудачного сравнения
+ * безвредна: у частной страницы (и у кандидата нестабильного дерева,
+ * который ссылок не держит) одна ссылка, и do_wp_page снимет защиту
+ * без копирования.
+ */
+static void write_protect_page(struct mm_struct* mm, uint64_t addr, pte_t* pte) {
+    if (pte_write(*pte)) {
+        *pte &= ~(_PAGE_RW | _PAGE_DIRTY);
+        flush_tlb_page(mm, addr);
+    }
+}
+
+/* Запись PTE начинает указывать на kpage; page теряет ссылку */
+static void replace_page(struct mm_struct* mm, uint64_t addr, pte_t* pte, struct page* page,
+                         struct page* kpage) {
+    get_page(kpage);
+    *pte = mk_pte(kpage, *pte & ~(PTE_ADDR_MASK | _PAGE_RW | _PAGE_DIRTY));
+    flush_tlb_page(mm, addr);
+    put_page(page);
+    if (!page_anon(kpage)) {
+        mm->anon_pages--;
+    }
+    ksm_stats.merges++;
+}
+
+/* Слияние page с уже общей или нулевой kpage; 1 - слито */
+static uint32_t try_to_merge_with_ksm_page(struct mm_struct* mm, uint64_t addr, pte_t* pte,
+                                           struct page* page, struct page* kpage) {
+    write_protect_page(mm, addr, pte);
+    if (memcmp_pages(page, kpage) != 0) {
+        return 0;
+    }
+    replace_page(mm, addr, pte, page, kpage);
+    return 1;
+}
+
+/*
+ * Две частные страницы с одинаковым содержимым: страница кандидата
+ * становится общей и переходит в стабильное дерево, page заменяется ею.
+ */
+static uint32_t try_to_merge_two_pages(struct mm_struct* mm, uint64_t addr, pte_t* pte,
+                                       struct page* page, struct rmap_item* item) {
+    pte_t* tree_pte = rmap_item_pte(item);
+    if (!tree_pte) {
+        unstable_item_remove(item);
+        return 0;
+    }
+
+    write_protect_page(item->mm, item->address, tree_pte);
+    write_protect_page(mm, addr, pte);
+    if (memcmp_pages(page, item->page) != 0) {
+        return 0;
+    }
+    struct stable_node* sn = kmalloc(sizeof(*sn));
+    if (!sn) {
+        return 0;
+    }
+
+    /* Стабильное дерево, в отличие от нестабильного, держит ссылку */
+    struct page* kpage = item->page;
+    unstable_item_remove(item);
+    get_page(kpage);
+    sn->kpage = kpage;
+    kpage->flags |= PG_KSM;
+    kpage->private = (uint64_t)sn;
+    stable_tree_insert(sn);
+
+    replace_page(mm, addr, pte, page, kpage);
+    return 1;
+}
+
+static uint32_t cmp_and_merge_page(struct mm_struct* mm, uint64_t addr, pte_t* pte) {
+    struct page* page = pte_page(*pte);
+
+    /* Общие страницы (в том числе после fork) уже не стоят отдельной памяти */
+    if (!page_anon(page) || (page->flags & PG_KSM) || page->refcount != 1) {
+        return 0;
+    }
+
+    struct page* kpage = stable_tree_search(page);
+    if (kpage) {
+        return try_to_merge_with_ksm_page(mm, addr, pte, page, kpage);
+    }
+
+    /* Изменилась с прошлого прохода: сливать пока рано */
+    uint32_t checksum = calc_checksum(page_address(page));
+    if (page->private != (KSM_CHECKSUM_VALID | checksum)) {
+        page->private = KSM_CHECKSUM_VALID | checksum;
+        return 0;
+    }
+
+    if (ksm_use_zero_pages && checksum == ZERO_PAGE_CHECKSUM) {
+        if (try_to_merge_with_ksm_page(mm, addr, pte, page, zero_page)) {
+            ksm_stats.zero_merges++;
+            return 1;
+        }
+        return 0;
+    }
+
+    struct rmap_item* item = unstable_tree_search_insert(mm, addr, page);
+    if (item) {
+        return try_to_merge_two_pages(mm, addr, pte, page, item);
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Сканирование
+ * ============================================================================ */
+
+void ksm_enter(struct mm_struct* mm) {
+    if (list_empty(&mm->ksm_link)) {
+        list_add_tail(&mm->ksm_link, &ksm_mms);
+    }
+}
+
+/* Следующий mm списка или NULL в конце прохода */
+static struct mm_struct* ksm_next_mm(struct mm_struct* mm) {
+    struct list_head* next = mm->ksm_link.next;
+    if (next == &ksm_mms) {
+        return NULL;
+    }
+    return list_entry(next, struct mm_struct, ksm_link);
+}
+
+void ksm_exit(struct mm_struct* mm) {
+    if (list_empty(&mm->ksm_link)) {
+        return;
+    }
+    if (ksm_cursor.mm == mm) {
+        ksm_cursor.mm = ksm_next_mm(mm);
+        ksm_cursor.address = 0;
+    }
+    list_del(&mm->ksm_link);
+
+    struct list_head* pos;
+    struct list_head* tmp;
+    list_for_each_safe(pos, tmp, &unstable_items) {
+        struct rmap_item* item = list_entry(pos, struct rmap_item, list);
+        if (item->mm == mm) {
+            unstable_item_remove(item);
+        }
+    }
+}
+
+/* Общие страницы, которые больше никто не отображает, возвращаются аллокатору */
+static void prune_stable_tree(void) {
+    struct avl_node* node = avl_first(&stable_tree);
+    while (node) {
+        struct avl_node* next = avl_next(node);
+        struct stable_node* sn = avl_entry(node, struct stable_node, node);
+        if (sn->kpage->refcount == 1) {
+            stable_node_free(sn);
+        }
+        node = next;
+    }
+}
+
+/* Конец прохода: нестабильное дерево строится заново */
+static void ksm_end_pass(void) {
+    struct list_head* pos;
+    struct list_head* tmp;
+    list_for_each_safe(pos, tmp, &unstable_items) {
+        struct rmap_item* item = list_entry(pos, struct rmap_item, list);
+        kfree(item);
+    }
+    list_init(&unstable_items);
+    unstable_tree.node = NULL;
+
+    prune_stable_tree();
+    ksm_stats.full_scans++;
+}
+
+bool ksm_has_work(void) {
+    return ksm_run && !list_empty(&ksm_mms);
+}
+
+uint32_t ksm_scan(uint32_t pages) {
+    uint32_t merged = 0;
+
+    if (!ksm_run) {
+        return 0;
+    }
+    /* Все участники вышли: общие страницы держит только дерево */
+    if (list_empty(&ksm_mms)) {
+        prune_stable_tree();
+        return 0;
+    }
+    if (!ksm_cursor.mm) {
+        ksm_cursor.mm = list_first_entry(&ksm_mms, struct mm_struct, ksm_link);
+        ksm_cursor.address = 0;
+    }
+
+    while (pages > 0) {
+        struct mm_struct* mm = ksm_cursor.mm;
+        struct vm_area_struct* vma = find_vma(mm, ksm_cursor.address);
+
+        for (; vma; vma = vma->list.next == &mm->vmas ? NULL
+                        : list_entry(vma->list.next, struct vm_area_struct, list)) {
+            if (vma->flags & VM_SHARED) {
+                continue;
+            }
+            uint64_t addr = MAX(vma->start, ksm_cursor.address);
+            while (addr < vma->end) {
+                if (pages == 0) {
+                    return merged;
+                }
+                /* Большие страницы не сливаются: пропускаем PMD целиком */
+                pte_t* pmd = pmd_offset(mm, addr, false);
+                if (!pmd || !pte_present(*pmd) || pmd_huge(*pmd)) {
+                    addr = ALIGN_DOWN(addr, HPAGE_SIZE) + HPAGE_SIZE;
+                    ksm_cursor.address = addr;
+                    continue;
+                }
+                pte_t* pte = pte_table(*pmd) + pte_index(addr);
+                ksm_cursor.address = addr + PAGE_SIZE;
+                if (pte_present(*pte)) {
+                    pages--;
+                    ksm_stats.pages_scanned++;
+                    merged += cmp_and_merge_page(mm, addr, pte);
+                }
+                addr += PAGE_SIZE;
+            }
+        }
+
+        /* mm просмотрен целиком */
+        ksm_cursor.mm = ksm_next_mm(mm);
+        ksm_cursor.address = 0;
+        if (!ksm_cursor.mm) {
+            ksm_end_pass();
+            break;
+        }
+    }
+    return merged;
+}
+
+void ksm_get_stats(struct ksm_stats* stats) {
+    *stats = ksm_stats;
+    stats->pages_shared = nr_stable_nodes;
+    stats->pages_sharing = 0;
+    for (struct avl_node* node = avl_first(&stable_tree); node; node = avl_next(node)) {
+        struct stable_node* sn = avl_entry(node, struct stable_node, node);
+        /* Кроме ссылки дерева и первого отображения */
+        if (sn->kpage->refcount > 2) {
+            stats->pages_sharing += (uint64_t)sn->kpage->refcount - 2;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/ksm.h
+ * Слияние одинаковых анонимных страниц (KSM)
+ *
+ * Фоновый сканер обходит частные области зарегистрированных mm и ищет
+ * страницы с одинаковым содержимым. Найденные копии заменяются одной
+ * общей страницей, отображённой только для чтения; запись в неё идёт
+ * обычным путём copy-on-write и получает собственную копию.
+ *
+ * Общие (KSM) страницы лежат в стабильном дереве, упорядоченном по
+ * содержимому. Кандидаты на слияние, ещё ни с чем не совпавшие, - в
+ * нестабильном дереве, которое строится заново на каждом проходе:
+ * содержимое этих страниц может меняться, и дерево годно лишь как
+ * подсказка. В него попадают только страницы, контрольная сумма которых
+ * не изменилась с прошлого прохода, - часто записываемые страницы
+ * сливать бесполезно.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_KSM_H
+#define MIXOS_MM_KSM_H
+
+#include "mm/mm.h"
+
+/* Сколько страниц просматривает ksm_scan за один вызов по умолчанию */
+#define KSM_PAGES_TO_SCAN   100
+
+/* Счётчики KSM (аналог /sys/kernel/mm/ksm) */
+struct ksm_stats {
+    uint64_t pages_shared;          /* Общих страниц в стабильном дереве */
+    uint64_t pages_sharing;         /* Отображений, сэкономивших страницу */
+    uint64_t merges;                /* Страниц заменено общими */
+    uint64_t zero_merges;           /* Из них - страницей нулей */
+    uint64_t pages_scanned;         /* Страниц просмотрено */
+    uint64_t full_scans;            /* Полных проходов по всем mm */
+};
+
+/*
+ * Выключатель и скорость сканирования (аналог run и pages_to_scan).
+ * По умолчанию KSM выключен; при загрузке задаются параметрами ksm=1
+ * и ksm_pages=N.
+ */
+extern bool ksm_run;
+extern uint32_t ksm_pages_to_scan;
+
+/* Сливать нулевые страницы со страницей нулей, а не между собой */
+extern bool ksm_use_zero_pages;
+
+/* mm с частными записываемыми областями попадает в список сканирования */
+void ksm_enter(struct mm_struct* mm);
+void ksm_exit(struct mm_struct* mm);
+
+/*
+ * Один шаг сканирования: не больше pages страниц, начиная с места, где
+ * остановился предыдущий вызов. Возвращает число слитых страниц.
+ */
+uint32_t ksm_scan(uint32_t pages);
+
+/* Есть что сканировать: KSM включён и список mm не пуст */
+bool ksm_has_work(void);
+
+void ksm_get_stats(struct ksm_stats* stats);
+
+#endif /* MIXOS_MM_KSM_H */
@@ -0,0 +1,584 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/memory.c
+ * Таблицы страниц процессов и обработка отказов страниц
+ *
+ * Каждая присутствующая пользовательская запись PTE держит одну ссылку
+ * на свою страницу. Страница, которую нельзя менять на месте (страница
+ * page cache в частном отображении, общая нулевая страница, страница с
+ * несколькими владельцами), отображается только для чтения; запись в неё
+ * получает копию (copy-on-write). Анонимная память по возможности
+ * отображается большими страницами (mm/huge_memory.c). Неприсутствующая
+ * запись может хранить слот swap вытесненной страницы (mm/swap.h).
+ * ============================================================================
+ */
+
+#include "mm/mm.h"
+#include "mm/huge_mm.h"
+#include "mm/tlb.h"
+#include "mm/page_cache.h"
+#include "mm/swap.h"
+#include "fs/vfs.h"
+#include "errno.h"
+
+pte_t* kernel_pgd;
+
+struct page* zero_page;
+
+void vmm_init(void) {
+    kernel_pgd = phys_to_virt(read_cr3() & PTE_ADDR_MASK);
+    tlb_init();
+    zero_page = alloc_zeroed_page();
+    if (!zero_page) {
+        panic("vmm_init: cannot allocate zero page");
+    }
+}
+
+/* ============================================================================
+ * Таблицы страниц
+ * ============================================================================ */
+
+pte_t* pgd_alloc(void) {
+    struct page* page = alloc_zeroed_page();
+    if (!page) {
+        return NULL;
+    }
+    pte_t* pgd = page_address(page);
+    for (uint32_t i = 0; i < PTRS_PER_TABLE; i++) {
+        if (i < USER_PGD_FIRST || i > USER_PGD_LAST) {
+            pgd[i] = kernel_pgd[i];
+        }
+    }
+    return pgd;
+}
+
+static void free_table(pte_t* table, int level) {
+    if (level > 1) {
+        for (uint32_t i = 0; i < PTRS_PER_TABLE; i++) {
+            if (pte_present(table[i]) && !(table[i] & _PAGE_PSE)) {
+                free_table(pte_table(table[i]), level - 1);
+            }
+        }
+    }
+    free_page(virt_to_page(table));
+}
+
+/* Страницы к этому моменту сняты zap_page_range: освобождаются только таблицы */
+void pgd_free(pte_t* pgd) {
+    for (uint32_t i = USER_PGD_FIRST; i <= USER_PGD_LAST; i++) {
+        if (pte_present(pgd[i])) {
+            free_table(pte_table(pgd[i]), 3);
+        }
+    }
+    free_page(virt_to_page(pgd));
+}
+
+/*
+ * Спуск до записи таблицы уровня levels (2 - PMD, 3 - PTE). Если таблицы
+ * уровня нет (и alloc не задан), в *next возвращается начало следующего
+ * диапазона, который она покрывала бы. Большая страница в PMD не таблица:
+ * с alloc она расщепляется, без него спуск к PTE завершается NULL.
+ */
+static pte_t* walk_page_table(struct mm_struct* mm, uint64_t addr, int levels, bool alloc,
+                              uint64_t* next) {
+    static const uint32_t shifts[3] = { PGDIR_SHIFT, PUD_SHIFT, PMD_SHIFT };
+    pte_t* table = mm->pgd;
+
+    for (int level = 0; level < levels; level++) {
+        pte_t* entry = &table[(addr >> shifts[level]) & (PTRS_PER_TABLE - 1)];
+        if (!pte_present(*entry)) {
+            if (!alloc) {
+                if (next) {
+                    *next = ALIGN_DOWN(addr, 1ULL << shifts[level]) + (1ULL << shifts[level]);
+                }
+                return NULL;
+            }
+            struct page* page = alloc_zeroed_page();
+            if (!page) {
+                return NULL;
+            }
+            *entry = mk_pte(page, _PAGE_TABLE);
+        } else if (level == 2 && pmd_huge(*entry)) {
+            if (!alloc) {
+                if (next) {
+                    *next = ALIGN_DOWN(addr, HPAGE_SIZE) + HPAGE_SIZE;
+                }
+                return NULL;
+            }
+            if (split_huge_pmd(mm, entry, addr) < 0) {
+                return NULL;
+            }
+        }
+        table = pte_table(*entry);
+    }
+    return &table[levels == 2 ? pmd_index(addr) : pte_index(addr)];
+}
+
+pte_t* pmd_offset(struct mm_struct* mm, uint64_t addr, bool alloc) {
+    return walk_page_table(mm, addr, 2, alloc, NULL);
+}
+
+pte_t* pte_offset(struct mm_struct* mm, uint64_t addr, bool alloc) {
+    return walk_page_table(mm, addr, 3, alloc, NULL);
+}
+
+/*
+ * Большие страницы не пересекают границ областей, а do_munmap расщепляет
+ * их на границах диапазона заранее, так что здесь они снимаются целиком.
+ */
+void unmap_page_range(struct mmu_gather* tlb, uint64_t start, uint64_t end) {
+    struct mm_struct* mm = tlb->mm;
+    uint64_t addr = start;
+    while (addr < end) {
+        uint64_t next;
+        pte_t* pmd = walk_page_table(mm, addr, 2, false, &next);
+        if (!pmd) {
+            addr = next;
+            continue;
+        }
+        if (!pte_present(*pmd)) {
+            addr = ALIGN_DOWN(addr, HPAGE_SIZE) + HPAGE_SIZE;
+            continue;
+        }
+        if (pmd_huge(*pmd)) {
+            if ((addr & ~HPAGE_MASK) == 0 && end - addr >= HPAGE_SIZE) {
+                struct page* head = pte_page(*pmd);
+                *pmd = 0;
+                mm->anon_huge_pages--;
+                tlb_remove_page(tlb, head, addr, HPAGE_SIZE);
+                addr += HPAGE_SIZE;
+                continue;
+            }
+            if (split_huge_pmd(mm, pmd, addr) < 0) {
+                panic("zap_page_range: cannot split huge page");
+            }
+        }
+
+        pte_t* pte = pte_table(*pmd) + pte_index(addr);
+        uint64_t table_end = MIN(ALIGN_DOWN(addr, HPAGE_SIZE) + HPAGE_SIZE, end);
+        for (; addr < table_end; addr += PAGE_SIZE, pte++) {
+            if (is_swap_pte(*pte)) {
+                swap_free(pte_to_swp_slot(*pte));
+                *pte = 0;
+                mm->swap_pages--;
+                continue;
+            }
+            if (!pte_present(*pte)) {
+                continue;
+            }
+            struct page* page = pte_page(*pte);
+            *pte = 0;
+            if (page_anon(page)) {
+                mm->anon_pages--;
+            }
+            tlb_remove_page(tlb, page, addr, PAGE_SIZE);
+        }
+    }
+}
+
+void zap_page_range(struct mm_struct* mm, uint64_t start, uint64_t end) {
+    struct mmu_gather tlb;
+    tlb_gather_mmu(&tlb, mm, false);
+    unmap_page_range(&tlb, start, end);
+    tlb_finish_mmu(&tlb);
+}
+
+/*
+ * Копирование отображений области при fork. Страницы не копируются:
+ * дочерний процесс получает те же PTE и по ссылке на каждую страницу, а
+ * частные записываемые страницы защищаются от записи в обоих процессах.
+ * Первая запись любой из сторон скопирует страницу (do_wp_page), пока
+ * у неё больше одной ссылки; последний владелец пишет в неё на месте.
+ * Большие страницы так же делятся целиком одной записью PMD, а слоты
+ * swap - записью со слотом и ссылкой на него.
+ */
+int copy_page_range(struct mm_struct* dst, struct mm_struct* src, struct vm_area_struct* vma) {
+    bool cow = !(vma->flags & VM_SHARED);
+    uint64_t addr = vma->start;
+
+    while (addr < vma->end) {
+        uint64_t next;
+        pte_t* src_pmd = walk_page_table(src, addr, 2, false, &next);
+        if (!src_pmd) {
+            addr = next;
+            continue;
+        }
+        if (!pte_present(*src_pmd)) {
+            addr = ALIGN_DOWN(addr, HPAGE_SIZE) + HPAGE_SIZE;
+            continue;
+        }
+        pte_t* dst_pmd = walk_page_table(dst, addr, 2, true, NULL);
+        if (!dst_pmd) {
+            return -ENOMEM;
+        }
+
+        if (pmd_huge(*src_pmd)) {
+            pte_t pmd = *src_pmd;
+            if (cow && pte_write(pmd)) {
+                pmd &= ~_PAGE_RW;
+                *src_pmd = pmd;
+            }
+            get_page(pte_page(pmd));
+            *dst_pmd = pmd;
+            dst->anon_huge_pages++;
+            addr += HPAGE_SIZE;
+            continue;
+        }
+
+        pte_t* src_pte = pte_table(*src_pmd) + pte_index(addr);
+        pte_t* dst_pte = walk_page_table(dst, addr, 3, true, NULL);
+        if (!dst_pte) {
+            return -ENOMEM;
+        }
+
+        /* До конца таблицы PTE: следующая потребует нового спуска */
+        uint64_t table_end = MIN(ALIGN_DOWN(addr, HPAGE_SIZE) + HPAGE_SIZE, vma->end);
+        for (; addr < table_end; addr += PAGE_SIZE, src_pte++, dst_pte++) {
+            pte_t pte = *src_pte;
+            if (is_swap_pte(pte)) {
+                if (swap_duplicate(pte_to_swp_slot(pte)) < 0) {
+                    return -ENOMEM;
+                }
+                *dst_pte = pte;
+                dst->swap_pages++;
+                continue;
+            }
+            if (!pte_present(pte)) {
+                continue;
+            }
+            if (cow && pte_write(pte)) {
+                pte &= ~_PAGE_RW;
+                *src_pte = pte;
+            }
+            get_page(pte_page(pte));
+            if (page_anon(pte_page(pte))) {
+                dst->anon_pages++;
+            }
+            *dst_pte = pte;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Отказы страниц
+ * ============================================================================ */
+
+static uint64_t vma_pte_flags(struct vm_area_struct* vma, bool writable) {
+    uint64_t flags = _PAGE_PRESENT | _PAGE_USER | _PAGE_ACCESSED;
+    if (writable && (vma->flags & VM_WRITE)) {
+        flags |= _PAGE_RW | _PAGE_DIRTY;
+    }
+    return flags;
+}
+
+/* Страница page cache, которую отображает адрес файловой области */
+static int vma_file_page(struct vm_area_struct* vma, uint64_t addr, struct page** out) {
+    struct inode* inode = vma->file->inode;
+    uint64_t index = vma->pgoff + ((addr - vma->start) >> PAGE_SHIFT);
+
+    /* За концом файла данных нет: SIGBUS, как в POSIX */
+    if (index >= DIV_ROUND_UP(inode->size, PAGE_SIZE)) {
+        return -EFAULT;
+    }
+    return read_cache_page(&inode->mapping, index, out);
+}
+
+/*
+ * Fault-around: при чтении из файловой области вместе со страницей отказа
+ * отображаются соседние страницы окна, уже лежащие в page cache. При
+ * последовательном чтении отказ случается раз на окно, а не на страницу.
+ * Окно выровнено и не выходит за таблицу PTE, в которой лежит pte.
+ */
+#define FAULT_AROUND_PAGES  16
+
+static void do_fault_around(struct vm_area_struct* vma, uint64_t addr, pte_t* pte) {
+    struct address_space* mapping = &vma->file->inode->mapping;
+    uint64_t nr_pages = DIV_ROUND_UP(vma->file->inode->size, PAGE_SIZE);
+    uint64_t window = FAULT_AROUND_PAGES * PAGE_SIZE;
+    uint64_t start = MAX(vma->start, ALIGN_DOWN(addr, window));
+    uint64_t end = MIN(vma->end, ALIGN_DOWN(addr, window) + window);
+    pte_t* table = pte - pte_index(addr);
+
+    for (uint64_t a = start; a < end; a += PAGE_SIZE) {
+        pte_t* entry = &table[pte_index(a)];
+        if (a == addr || *entry) {
+            continue;
+        }
+        uint64_t index = vma->pgoff + ((a - vma->start) >> PAGE_SHIFT);
+        if (index >= nr_pages) {
+            break;
+        }
+        struct page* page = find_get_page(mapping, index);
+        if (!page) {
+            continue;
+        }
+        if (!(page->flags & PG_UPTODATE)) {
+            put_page(page);
+            continue;
+        }
+        *entry = mk_pte(page, vma_pte_flags(vma, false));
+    }
+}
+
+static int do_no_page(struct mm_struct* mm, struct vm_area_struct* vma, uint64_t addr,
+                      pte_t* pte, bool write) {
+    struct page* page;
+
+    if (!vma->file) {
+        if (!write) {
+            get_page(zero_page);
+            *pte = mk_pte(zero_page, vma_pte_flags(vma, false));
+            return 0;
+        }
+        page = alloc_zeroed_page();
+        if (!page) {
+            return -ENOMEM;
+        }
+        *pte = mk_pte(page, vma_pte_flags(vma, true));
+        mm->anon_pages++;
+        return 0;
+    }
+
+    int err = vma_file_page(vma, addr, &page);
+    if (err < 0) {
+        return err;
+    }
+    if (write && !(vma->flags & VM_SHARED)) {
+        /* Частная запись: своя копия, страница кеша остаётся нетронутой */
+        struct page* copy = alloc_page();
+        if (!copy) {
+            put_page(page);
+            return -ENOMEM;
+        }
+        memcpy(page_address(copy), page_address(page), PAGE_SIZE);
+        put_page(page);
+        *pte = mk_pte(copy, vma_pte_flags(vma, true));
+        mm->anon_pages++;
+        return 0;
+    }
+    /* Общее отображение файла только для чтения (VM_SHARED | VM_WRITE запрещено) */
+    *pte = mk_pte(page, vma_pte_flags(vma, false));
+    if (!write) {
+        do_fault_around(vma, addr, pte);
+    }
+    return 0;
+}
+
+/*
+ * Отказ по вытесненной странице. Копия читается заново в каждом процессе,
+ * который на неё ссылается (кеша swap нет), поэтому страница своя и
+ * отображается с правом записи.
+ */
+static int do_swap_page(struct mm_struct* mm, struct vm_area_struct* vma, uint64_t addr,
+                        pte_t* pte) {
+    uint64_t slot = pte_to_swp_slot(*pte);
+    struct page* page = alloc_page();
+    if (!page) {
+        return -ENOMEM;
+    }
+    int err = swap_readpage(slot, page);
+    if (err < 0) {
+        put_page(page);
+        return err;
+    }
+    *pte = mk_pte(page, vma_pte_flags(vma, true));
+    mm->anon_pages++;
+    mm->swap_pages--;
+    swap_free(slot);
+    flush_tlb_page(mm, addr);
+    return 0;
+}
+
+/*
+ * Запись в страницу, отображённую только для чтения. Счётчик ссылок
+ * страницы - число её отображений (плюс ссылка page cache): копия нужна,
+ * пока страницу видит кто-то ещё.
+ */
+static int do_wp_page(struct mm_struct* mm, struct vm_area_struct* vma, uint64_t addr,
+                      pte_t* pte) {
+    struct page* old = pte_page(*pte);
+
+    if (old->mapping || old->refcount > 1) {
+        struct page* copy;
+        if (old == zero_page) {
+            copy = alloc_zeroed_page();
+        } else {
+            copy = alloc_page();
+            if (copy) {
+                memcpy(page_address(copy), page_address(old), PAGE_SIZE);
+            }
+        }
+        if (!copy) {
+            return -ENOMEM;
+        }
+        *pte = mk_pte(copy, vma_pte_flags(vma, true));
+        if (!page_anon(old)) {
+            mm->anon_pages++;
+        }
+        put_page(old);
+    } else {
+        /* Единственный владелец: копия не нужна */
+        *pte |= vma_pte_flags(vma, true);
+    }
+    flush_tlb_page(mm, addr);
+    return 0;
+}
+
+static int __handle_mm_fault(struct mm_struct* mm, uint64_t addr, uint32_t flags) {
+    struct vm_area_struct* vma = find_vma(mm, addr);
+    if (!vma || addr < vma->start) {
+        return -EFAULT;
+    }
+
+    bool write = flags & FAULT_FLAG_WRITE;
+    /* Общее отображение нельзя подменить частной копией даже принудительно */
+    if (write && (vma->flags & VM_SHARED) && !(vma->flags & VM_WRITE)) {
+        return -EFAULT;
+    }
+    if (!(flags & FAULT_FLAG_FORCE)) {
+        if ((write && !(vma->flags & VM_WRITE)) ||
+            ((flags & FAULT_FLAG_INSTRUCTION) && !(vma->flags & VM_EXEC)) ||
+            !(vma->flags & (VM_READ | VM_WRITE | VM_EXEC))) {
+            return -EFAULT;
+        }
+    }
+
+    addr = ALIGN_DOWN(addr, PAGE_SIZE);
+    pte_t* pmd = pmd_offset(mm, addr, true);
+    if (!pmd) {
+        return -ENOMEM;
+    }
+    uint64_t haddr = addr & HPAGE_MASK;
+    if (!pte_present(*pmd) && thp_enabled && !vma->file &&
+        haddr >= vma->start && haddr + HPAGE_SIZE <= vma->end) {
+        if (do_huge_pmd_anonymous_page(mm, vma, haddr, pmd) == 0) {
+            return 0;
+        }
+    } else if (pmd_huge(*pmd)) {
+        if (!write || pte_write(*pmd)) {
+            flush_tlb_page(mm, addr);
+            return 0;
+        }
+        if (do_huge_pmd_wp_page(mm, vma, haddr, pmd) == 0) {
+            return 0;
+        }
+    }
+
+    pte_t* pte = pte_offset(mm, addr, true);
+    if (!pte) {
+        return -ENOMEM;
+    }
+    if (is_swap_pte(*pte)) {
+        return do_swap_page(mm, vma, addr, pte);
+    }
+    if (!pte_present(*pte)) {
+        return do_no_page(mm, vma, addr, pte, write);
+    }
+    if (write && !pte_write(*pte)) {
+        return do_wp_page(mm, vma, addr, pte);
+    }
+    /* Отображение уже есть: в TLB осталась устаревшая запись */
+    flush_tlb_page(mm, addr);
+    return 0;
+}
+
+int handle_mm_fault(struct mm_struct* mm, uint64_t addr, uint32_t flags) {
+    reclaim_direct();
+    int err = __handle_mm_fault(mm, addr, flags);
+    /* Памяти нет: вытесняем анонимные страницы в swap и пробуем ещё раз */
+    if (err == -ENOMEM && try_to_free_pages(SWAP_CLUSTER_MAX) > 0) {
+        err = __handle_mm_fault(mm, addr, flags);
+    }
+    return err;
+}
+
+/* Биты кода ошибки #PF */
+#define PF_PROT     (1U << 0)
+#define PF_WRITE    (1U << 1)
+#define PF_USER     (1U << 2)
+#define PF_INSTR    (1U << 4)
+
+int do_page_fault(uint64_t error_code, uint64_t addr) {
+    if (!current_mm || addr < USER_SPACE_START || addr >= USER_SPACE_END) {
+        return -EFAULT;
+    }
+    uint32_t flags = 0;
+    if (error_code & PF_WRITE) {
+        flags |= FAULT_FLAG_WRITE;
+    }
+    if (error_code & PF_USER) {
+        flags |= FAULT_FLAG_USER;
+    }
+    if (error_code & PF_INSTR) {
+        flags |= FAULT_FLAG_INSTRUCTION;
+    }
+    return handle_mm_fault(current_mm, addr, flags);
+}
+
+/* ============================================================================
+ * Доступ к памяти другого адресного пространства
+ * ============================================================================ */
+
+/* Страница, отображённая по addr (доступная для записи, если write), или NULL */
+static struct page* follow_page(struct mm_struct* mm, uint64_t addr, bool write) {
+    pte_t* pmd = pmd_offset(mm, addr, false);
+    if (!pmd || !pte_present(*pmd)) {
+        return NULL;
+    }
+    bool huge = pmd_huge(*pmd);
+    pte_t entry = huge ? *pmd : pte_table(*pmd)[pte_index(addr)];
+    if (!pte_present(entry) || (write && !pte_write(entry))) {
+        return NULL;
+    }
+    if (huge) {
+        return pte_page(entry) + ((addr & ~HPAGE_MASK) >> PAGE_SHIFT);
+    }
+    return pte_page(entry);
+}
+
+/* buf NULL при записи - обнуление */
+static int64_t access_vm(struct mm_struct* mm, uint64_t addr, void* buf, size_t len,
+                         bool write) {
+    size_t done = 0;
+
+    while (done < len) {
+        uint64_t page_addr = ALIGN_DOWN(addr + done, PAGE_SIZE);
+        struct page* page = follow_page(mm, page_addr, write);
+        if (!page) {
+            uint32_t flags = FAULT_FLAG_FORCE | (write ? FAULT_FLAG_WRITE : 0);
+            int err = handle_mm_fault(mm, page_addr, flags);
+            if (err < 0) {
+                return done ? (int64_t)done : err;
+            }
+            /* Права области могли не дать записи: копия всё равно частная */
+            page = follow_page(mm, page_addr, false);
+        }
+
+        uint32_t offset = (addr + done) & (PAGE_SIZE - 1);
+        size_t chunk = MIN((size_t)(PAGE_SIZE - offset), len - done);
+        uint8_t* data = (uint8_t*)page_address(page) + offset;
+        if (!write) {
+            memcpy((uint8_t*)buf + done, data, chunk);
+        } else if (buf) {
+            memcpy(data, (const uint8_t*)buf + done, chunk);
+        } else {
+            memset(data, 0, chunk);
+        }
+        done += chunk;
+    }
+    return (int64_t)done;
+}
+
+int64_t access_process_vm(struct mm_struct* mm, uint64_t addr, void* buf, size_t len,
+                          bool write) {
+    return access_vm(mm, addr, buf, len, write);
+}
+
+int clear_process_vm(struct mm_struct* mm, uint64_t addr, size_t len) {
+    int64_t n = access_vm(mm, addr, NULL, len, true);
+    if (n < 0) {
+        return (int)n;
+    }
+    return (size_t)n == len ? 0 : -EFAULT;
+}
@@ -0,0 +1,165 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/mm.h
+ * Виртуальная память процессов: адресные пространства и области (VMA)
+ *
+ * Адресное пространство - таблицы страниц и области, упорядоченные по
+ * адресам в списке и в AVL-дереве. Узел дерева хранит наибольший
+ * свободный промежуток перед областями своего поддерева, так что поиск
+ * области и свободного места стоят O(log n). Страницы не выделяются при отображении: их подставляет
+ * обработчик отказа страницы при первом обращении (для анонимной памяти -
+ * по возможности большими страницами, см. mm/huge_mm.h). Файловая область
+ * отображает страницы page cache, поэтому неизменённые страницы одного
+ * файла общие для всех процессов; запись в частное отображение получает
+ * собственную копию страницы.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_MM_H
+#define MIXOS_MM_MM_H
+
+#include "mm/pgtable.h"
+#include "mm/tlb.h"
+#include "lib/list.h"
+#include "lib/avltree.h"
+
+struct file;
+
+/* Права и свойства области */
+#define VM_READ         (1U << 0)
+#define VM_WRITE        (1U << 1)
+#define VM_EXEC         (1U << 2)
+#define VM_SHARED       (1U << 3)   /* Запись видна в файле и другим процессам */
+#define VM_STACK        (1U << 4)   /* Стек процесса */
+
+/* Раскладка пользовательского адресного пространства */
+#define STACK_TOP       0x00007FFFFFFFF000ULL
+#define STACK_SIZE      (8ULL << 20)
+#define MMAP_BASE       0x00007F0000000000ULL  /* mmap растёт вниз отсюда */
+
+struct vm_area_struct {
+    struct mm_struct* mm;
+    uint64_t start;                 /* Первый адрес (выровнен на страницу) */
+    uint64_t end;                   /* Адрес за последним байтом */
+    uint32_t flags;
+    struct file* file;              /* NULL - анонимная память (нули) */
+    uint64_t pgoff;                 /* Страница файла, отображённая в start */
+    struct list_head list;          /* Список областей mm по адресам */
+    struct avl_node node;           /* Узел дерева областей mm */
+    uint64_t subtree_gap;           /* Наибольший промежуток перед областями поддерева */
+};
+
+struct mm_struct {
+    pte_t* pgd;                     /* Таблица PML4 */
+    struct list_head vmas;
+    struct avl_root vma_tree;
+    struct vm_area_struct* vmacache; /* Область последнего find_vma */
+    uint32_t map_count;
+    int32_t users;
+    uint64_t mmap_base;             /* Отсюда вниз ищется место под mmap */
+    struct mm_context context;      /* PCID и поколение TLB */
+    uint64_t start_code, end_code;
+    uint64_t start_data, end_data;
+    uint64_t start_brk, brk;
+    uint64_t start_stack;
+    uint64_t anon_pages;            /* Анонимные страницы по 4 KiB в таблицах */
+    uint64_t anon_huge_pages;       /* Анонимные большие страницы (2 MiB) */
+    uint64_t swap_pages;            /* Записи PTE, указывающие в swap */
+    struct list_head khugepaged_link; /* Список сканирования khugepaged */
+    struct list_head ksm_link;      /* Список сканирования KSM */
+    struct list_head mmlist;        /* Все адресные пространства (вытеснение в swap) */
+};
+
+/* Таблица PML4 ядра: источник общих записей для новых адресных пространств */
+extern pte_t* kernel_pgd;
+
+/* Общая страница нулей: чтение анонимной памяти не выделяет страниц */
+extern struct page* zero_page;
+
+/* Страница принадлежит анонимной памяти (не page cache и не страница нулей) */
+static inline bool page_anon(const struct page* page) {
+    return !page->mapping && page != zero_page;
+}
+
+/* Флаги отказа страницы */
+#define FAULT_FLAG_WRITE        (1U << 0)
+#define FAULT_FLAG_INSTRUCTION  (1U << 1)
+#define FAULT_FLAG_USER         (1U << 2)
+#define FAULT_FLAG_FORCE        (1U << 3)   /* Доступ ядра в обход прав области */
+
+void vmm_init(void);
+
+/* ============================================================================
+ * Адресные пространства и области (mm/mmap.c)
+ * ============================================================================ */
+
+struct mm_struct* mm_alloc(void);
+void mmget(struct mm_struct* mm);
+void mmput(struct mm_struct* mm);
+
+/* Первая область, заканчивающаяся выше addr (addr может быть ниже её начала) */
+struct vm_area_struct* find_vma(struct mm_struct* mm, uint64_t addr);
+
+/*
+ * Отображение [addr, addr + len) файла с позиции pgoff (страниц) или
+ * анонимной памяти (file NULL). addr 0 - адрес выбирает ядро; иначе он
+ * обязателен и не должен пересекаться с существующими областями.
+ * Возвращает адрес области или отрицательный код ошибки.
+ */
+int64_t mmap_region(struct mm_struct* mm, uint64_t addr, uint64_t len, uint32_t flags,
+                    struct file* file, uint64_t pgoff);
+
+/* Свободный диапазон длины len под самым верхним отображением */
+uint64_t get_unmapped_area(struct mm_struct* mm, uint64_t len);
+
+int do_munmap(struct mm_struct* mm, uint64_t addr, uint64_t len);
+
+/* Копия адресного пространства для fork: области общие, страницы copy-on-write */
+struct mm_struct* dup_mm(struct mm_struct* oldmm);
+
+/* ============================================================================
+ * Таблицы страниц и отказы страниц (mm/memory.c)
+ * ============================================================================ */
+
+pte_t* pgd_alloc(void);
+void pgd_free(pte_t* pgd);
+
+/*
+ * Запись PMD для addr; alloc - создать недостающие таблицы верхних
+ * уровней. Запись может быть пустой или отображать большую страницу.
+ */
+pte_t* pmd_offset(struct mm_struct* mm, uint64_t addr, bool alloc);
+
+/*
+ * Запись PTE для addr; alloc - создать недостающие таблицы (большая
+ * страница при этом расщепляется). Без alloc для большой страницы NULL.
+ */
+pte_t* pte_offset(struct mm_struct* mm, uint64_t addr, bool alloc);
+
+/* Перенос PTE области vma из src в dst с защитой частных страниц от записи */
+int copy_page_range(struct mm_struct* dst, struct mm_struct* src, struct vm_area_struct* vma);
+
+/*
+ * Снятие отображений [start, end) с освобождением ссылок на страницы.
+ * unmap_page_range копит сброс TLB в tlb, zap_page_range сбрасывает сразу.
+ */
+void unmap_page_range(struct mmu_gather* tlb, uint64_t start, uint64_t end);
+void zap_page_range(struct mm_struct* mm, uint64_t start, uint64_t end);
+
+/* Отказ страницы: 0 - отображение установлено, -EFAULT - нарушение доступа */
+int handle_mm_fault(struct mm_struct* mm, uint64_t addr, uint32_t flags);
+
+/* Точка входа из обработчика #PF: код ошибки процессора и CR2 */
+int do_page_fault(uint64_t error_code, uint64_t addr);
+
+/*
+ * Чтение или запись памяти чужого адресного пространства (загрузчик,
+ * отладчик): недостающие страницы подгружаются как при отказе.
+ */
+int64_t access_process_vm(struct mm_struct* mm, uint64_t addr, void* buf, size_t len,
+                          bool write);
+
+/* Обнуление [addr, addr + len) памяти mm */
+int clear_process_vm(struct mm_struct* mm, uint64_t addr, size_t len);
+
+#endif /* MIXOS_MM_MM_H */
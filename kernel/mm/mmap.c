@@ -0,0 +1,386 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/mmap.c
+ * Адресные пространства процессов и их области (VMA)
+ * ============================================================================
+ */
+
+#include "mm/mm.h"
+#include "mm/huge_mm.h"
+#include "mm/tlb.h"
+#include "mm/kmalloc.h"
+#include "mm/page_cache.h"
+#include "mm/swap.h"
+#include "mm/ksm.h"
+#include "fs/vfs.h"
+#include "errno.h"
+
+/* ============================================================================
+ * Адресное пространство
+ * ============================================================================ */
+
+struct mm_struct* mm_alloc(void) {
+    struct mm_struct* mm = kzalloc(sizeof(*mm));
+    if (!mm) {
+        return NULL;
+    }
+    mm->pgd = pgd_alloc();
+    if (!mm->pgd) {
+        kfree(mm);
+        return NULL;
+    }
+    list_init(&mm->vmas);
+    list_init(&mm->khugepaged_link);
+    list_init(&mm->ksm_link);
+    init_new_context(mm);
+    mm->users = 1;
+    mm->mmap_base = MMAP_BASE;
+    mmlist_add(mm);
+    return mm;
+}
+
+void mmget(struct mm_struct* mm) {
+    mm->users++;
+}
+
+static void vma_free(struct vm_area_struct* vma) {
+    if (vma->file) {
+        fput(vma->file);
+    }
+    kfree(vma);
+}
+
+void mmput(struct mm_struct* mm) {
+    if (--mm->users > 0) {
+        return;
+    }
+    khugepaged_exit(mm);
+    ksm_exit(mm);
+    mmlist_del(mm);
+
+    struct mmu_gather tlb;
+    tlb_gather_mmu(&tlb, mm, true);
+    struct list_head* pos;
+    struct list_head* tmp;
+    list_for_each_safe(pos, tmp, &mm->vmas) {
+        struct vm_area_struct* vma = list_entry(pos, struct vm_area_struct, list);
+        unmap_page_range(&tlb, vma->start, vma->end);
+        list_del(&vma->list);
+        vma_free(vma);
+    }
+    tlb_finish_mmu(&tlb);
+    destroy_context(mm);
+    pgd_free(mm->pgd);
+    kfree(mm);
+}
+
+static void insert_vma(struct mm_struct* mm, struct vm_area_struct* vma);
+
+struct mm_struct* dup_mm(struct mm_struct* oldmm) {
+    struct mm_struct* mm = mm_alloc();
+    if (!mm) {
+        return NULL;
+    }
+    mm->mmap_base = oldmm->mmap_base;
+    mm->start_code = oldmm->start_code;
+    mm->end_code = oldmm->end_code;
+    mm->start_data = oldmm->start_data;
+    mm->end_data = oldmm->end_data;
+    mm->start_brk = oldmm->start_brk;
+    mm->brk = oldmm->brk;
+    mm->start_stack = oldmm->start_stack;
+    if (!list_empty(&oldmm->khugepaged_link)) {
+        khugepaged_enter(mm);
+    }
+    if (!list_empty(&oldmm->ksm_link)) {
+        ksm_enter(mm);
+    }
+
+    int err = 0;
+    struct list_head* pos;
+    list_for_each(pos, &oldmm->vmas) {
+        struct vm_area_struct* vma = list_entry(pos, struct vm_area_struct, list);
+        struct vm_area_struct* copy = kmalloc(sizeof(*copy));
+        if (!copy) {
+            err = -ENOMEM;
+            break;
+        }
+        *copy = *vma;
+        copy->mm = mm;
+        if (copy->file) {
+            copy->file->refcount++;
+        }
+        insert_vma(mm, copy);
+        err = copy_page_range(mm, oldmm, vma);
+        if (err < 0) {
+            break;
+        }
+    }
+
+    /* Записываемые страницы родителя стали только для чтения */
+    flush_tlb_mm(oldmm);
+    if (err < 0) {
+        mmput(mm);
+        return NULL;
+    }
+    return mm;
+}
+
+/* ============================================================================
+ * Дерево областей
+ * ============================================================================ */
+
+static inline struct vm_area_struct* node_vma(struct avl_node* node) {
+    return node ? avl_entry(node, struct vm_area_struct, node) : NULL;
+}
+
+/* Свободный промежуток между предыдущей областью (или началом) и vma */
+static uint64_t vma_gap(struct vm_area_struct* vma) {
+    struct list_head* prev = vma->list.prev;
+    uint64_t prev_end = prev == &vma->mm->vmas
+                        ? USER_SPACE_START
+                        : list_entry(prev, struct vm_area_struct, list)->end;
+    return vma->start - prev_end;
+}
+
+static void vma_update_gap(struct avl_node* node) {
+    struct vm_area_struct* vma = node_vma(node);
+    uint64_t gap = vma_gap(vma);
+    if (node->left) {
+        gap = MAX(gap, node_vma(node->left)->subtree_gap);
+    }
+    if (node->right) {
+        gap = MAX(gap, node_vma(node->right)->subtree_gap);
+    }
+    vma->subtree_gap = gap;
+}
+
+/* Следующая за vma область: её промежуток зависит от конца vma */
+static void vma_next_gap_changed(struct mm_struct* mm, struct list_head* next) {
+    if (next != &mm->vmas) {
+        avl_propagate(&list_entry(next, struct vm_area_struct, list)->node, vma_update_gap);
+    }
+}
+
+struct vm_area_struct* find_vma(struct mm_struct* mm, uint64_t addr) {
+    struct vm_area_struct* vma = mm->vmacache;
+    if (vma && vma->start <= addr && addr < vma->end) {
+        return vma;
+    }
+
+    struct avl_node* node = mm->vma_tree.node;
+    vma = NULL;
+    while (node) {
+        struct vm_area_struct* cur = node_vma(node);
+        if (addr < cur->end) {
+            vma = cur;
+            if (addr >= cur->start) {
+                break;
+            }
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    if (vma) {
+        mm->vmacache = vma;
+    }
+    return vma;
+}
+
+/* Области не пересекаются: место в дереве и списке определяет start */
+static void insert_vma(struct mm_struct* mm, struct vm_area_struct* vma) {
+    struct avl_node** link = &mm->vma_tree.node;
+    struct avl_node* parent = NULL;
+    struct vm_area_struct* next = NULL;
+
+    while (*link) {
+        parent = *link;
+        if (vma->start < node_vma(parent)->start) {
+            next = node_vma(parent);
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+        }
+    }
+    list_add_tail(&vma->list, next ? &next->list : &mm->vmas);
+    avl_insert(&mm->vma_tree, &vma->node, parent, link, vma_update_gap);
+    vma_next_gap_changed(mm, vma->list.next);
+    mm->map_count++;
+}
+
+static void remove_vma(struct mm_struct* mm, struct vm_area_struct* vma) {
+    struct list_head* next = vma->list.next;
+    list_del(&vma->list);
+    avl_erase(&mm->vma_tree, &vma->node, vma_update_gap);
+    vma_next_gap_changed(mm, next);
+    if (mm->vmacache == vma) {
+        mm->vmacache = NULL;
+    }
+    mm->map_count--;
+}
+
+/* Самый верхний промежуток поддерева длины не меньше len, заканчивающийся до limit */
+static uint64_t find_gap_topdown(struct avl_node* node, uint64_t len, uint64_t limit) {
+    if (!node || node_vma(node)->subtree_gap < len) {
+        return 0;
+    }
+    struct vm_area_struct* vma = node_vma(node);
+
+    /* Промежутки правого поддерева начинаются не ниже vma->end */
+    if (vma->end < limit) {
+        uint64_t addr = find_gap_topdown(node->right, len, limit);
+        if (addr) {
+            return addr;
+        }
+    }
+    uint64_t gap_start = vma->start - vma_gap(vma);
+    uint64_t gap_end = MIN(vma->start, limit);
+    if (gap_end > gap_start && gap_end - gap_start >= len) {
+        return gap_end - len;
+    }
+    return find_gap_topdown(node->left, len, limit);
+}
+
+uint64_t get_unmapped_area(struct mm_struct* mm, uint64_t len) {
+    uint64_t base = mm->mmap_base;
+
+    /* Промежуток над последней областью не принадлежит ни одному узлу */
+    struct vm_area_struct* last = node_vma(avl_last(&mm->vma_tree));
+    uint64_t top_start = last ? last->end : USER_SPACE_START;
+    if (top_start < base && base - top_start >= len) {
+        return base - len;
+    }
+    return find_gap_topdown(mm->vma_tree.node, len, base);
+}
+
+/* ============================================================================
+ * Отображение и снятие отображения
+ * ============================================================================ */
+
+int64_t mmap_region(struct mm_struct* mm, uint64_t addr, uint64_t len, uint32_t flags,
+                    struct file* file, uint64_t pgoff) {
+    if (len == 0 || (addr & (PAGE_SIZE - 1))) {
+        return -EINVAL;
+    }
+    len = ALIGN_UP(len, PAGE_SIZE);
+
+    if (file) {
+        struct inode* inode = file->inode;
+        if (!S_ISREG(inode->mode) || !inode->mapping.a_ops) {
+            return -ENODEV;
+        }
+        if ((file->flags & O_ACCMODE) == O_WRONLY) {
+            return -EACCES;
+        }
+        /* Запись через общее отображение требует учёта грязных страниц */
+        if ((flags & (VM_SHARED | VM_WRITE)) == (VM_SHARED | VM_WRITE)) {
+            return -EINVAL;
+        }
+    } else if (flags & VM_SHARED) {
+        /* Общей анонимной памяти нужен объект-владелец страниц (shmem) */
+        return -EINVAL;
+    }
+
+    if (addr) {
+        if (addr < USER_SPACE_START || addr > USER_SPACE_END - len) {
+            return -EINVAL;
+        }
+        struct vm_area_struct* next = find_vma(mm, addr);
+        if (next && next->start < addr + len) {
+            return -EEXIST;
+        }
+    } else {
+        /* Анонимную память выравниваем так, чтобы в ней были большие страницы */
+        addr = !file && len >= HPAGE_SIZE ? thp_get_unmapped_area(mm, len)
+                                          : get_unmapped_area(mm, len);
+        if (!addr) {
+            return -ENOMEM;
+        }
+    }
+
+    struct vm_area_struct* vma = kzalloc(sizeof(*vma));
+    if (!vma) {
+        return -ENOMEM;
+    }
+    vma->mm = mm;
+    vma->start = addr;
+    vma->end = addr + len;
+    vma->flags = flags;
+    vma->pgoff = pgoff;
+    if (file) {
+        file->refcount++;
+        vma->file = file;
+    } else if (len >= HPAGE_SIZE) {
+        khugepaged_enter(mm);
+    }
+    if (!(flags & VM_SHARED)) {
+        ksm_enter(mm);
+    }
+    insert_vma(mm, vma);
+    return (int64_t)addr;
+}
+
+/* Хвост области начиная с addr становится отдельной областью */
+static int split_vma(struct mm_struct* mm, struct vm_area_struct* vma, uint64_t addr) {
+    struct vm_area_struct* tail = kmalloc(sizeof(*tail));
+    if (!tail) {
+        return -ENOMEM;
+    }
+    *tail = *vma;
+    tail->start = addr;
+    if (tail->file) {
+        tail->pgoff += (addr - vma->start) >> PAGE_SHIFT;
+        tail->file->refcount++;
+    }
+    vma->end = addr;
+    insert_vma(mm, tail);
+    return 0;
+}
+
+int do_munmap(struct mm_struct* mm, uint64_t addr, uint64_t len) {
+    if ((addr & (PAGE_SIZE - 1)) || len == 0) {
+        return -EINVAL;
+    }
+    uint64_t end = addr + ALIGN_UP(len, PAGE_SIZE);
+    if (addr < USER_SPACE_START || end > USER_SPACE_END || end < addr) {
+        return -EINVAL;
+    }
+
+    /* Большие страницы на краях диапазона снимаются лишь частично */
+    int err = split_huge_pmd_address(mm, addr);
+    if (err == 0) {
+        err = split_huge_pmd_address(mm, end);
+    }
+    if (err < 0) {
+        return err;
+    }
+
+    /* Один сброс TLB на всю операцию, сколько бы областей она ни задела */
+    struct mmu_gather tlb;
+    tlb_gather_mmu(&tlb, mm, false);
+    struct vm_area_struct* vma = find_vma(mm, addr);
+    while (vma && vma->start < end) {
+        if (vma->start < addr) {
+            err = split_vma(mm, vma, addr);
+            if (err < 0) {
+                break;
+            }
+            vma = list_entry(vma->list.next, struct vm_area_struct, list);
+        }
+        if (vma->end > end) {
+            err = split_vma(mm, vma, end);
+            if (err < 0) {
+                break;
+            }
+        }
+
+        struct list_head* next = vma->list.next;
+        unmap_page_range(&tlb, vma->start, vma->end);
+        remove_vma(mm, vma);
+        vma_free(vma);
+        vma = next == &mm->vmas ? NULL : list_entry(next, struct vm_area_struct, list);
+    }
+    tlb_finish_mmu(&tlb);
+    return err;
+}
@@ -0,0 +1,55 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/mmu_gather.c
+ * Накопление сбросов TLB и освобождений страниц при снятии отображений
+ * ============================================================================
+ */
+
+#include "mm/mm.h"
+#include "mm/tlb.h"
+
+void tlb_gather_mmu(struct mmu_gather* tlb, struct mm_struct* mm, bool fullmm) {
+    tlb->mm = mm;
+    tlb->start = UINT64_MAX;
+    tlb->end = 0;
+    tlb->fullmm = fullmm;
+    list_init(&tlb->pages);
+}
+
+void tlb_finish_mmu(struct mmu_gather* tlb) {
+    if (tlb->end > tlb->start) {
+        /* Адресное пространство разбирается целиком: дешевле сбросить весь PCID */
+        if (tlb->fullmm) {
+            flush_tlb_mm(tlb->mm);
+        } else {
+            flush_tlb_range(tlb->mm, tlb->start, tlb->end);
+        }
+        tlb_stats.gather_flushes++;
+    }
+
+    struct list_head* pos;
+    struct list_head* tmp;
+    list_for_each_safe(pos, tmp, &tlb->pages) {
+        struct page* page = list_entry(pos, struct page, lru);
+        list_del(&page->lru);
+        put_page(page);
+        tlb_stats.gather_pages++;
+    }
+}
+
+void tlb_remove_page(struct mmu_gather* tlb, struct page* page, uint64_t addr, uint64_t size) {
+    tlb->start = MIN(tlb->start, addr);
+    tlb->end = MAX(tlb->end, addr + size);
+
+    /*
+     * Освобождение откладывается только для последней ссылки: у страницы,
+     * которую держит кто-то ещё (page cache, другой процесс), её списки
+     * заняты, а сама она после put_page не освободится. Отображённая
+     * страница без других ссылок - анонимная, её lru свободен.
+     */
+    if (page->refcount > 1) {
+        put_page(page);
+        return;
+    }
+    list_add_tail(&page->lru, &tlb->pages);
+}
@@ -0,0 +1,142 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/numa.c
+ * Топология NUMA: диапазоны памяти узлов, процессоры и расстояния
+ * ============================================================================
+ */
+
+#include "mm/numa.h"
+#include "cpu/cpu.h"
+#include "errno.h"
+
+#define NR_NODE_MEMBLKS     (MAX_NUMNODES * 4)
+#define NR_NUMA_CPUS        64
+
+/* Диапазон физической памяти узла */
+struct numa_memblk {
+    uint64_t start;
+    uint64_t end;
+    uint32_t nid;
+};
+
+static struct numa_memblk numa_memblks[NR_NODE_MEMBLKS];
+static uint32_t nr_numa_memblks;
+
+static struct {
+    uint32_t apic_id;
+    uint32_t nid;
+} numa_cpus[NR_NUMA_CPUS];
+static uint32_t nr_numa_cpus;
+
+/* 0 - расстояние не задано (до своего узла LOCAL, до чужого REMOTE) */
+static uint8_t numa_distance[MAX_NUMNODES][MAX_NUMNODES];
+
+uint32_t nr_node_ids = 1;
+static uint32_t boot_cpu_node;
+
+int numa_add_memblk(uint32_t nid, uint64_t start, uint64_t end) {
+    if (nid >= MAX_NUMNODES || start >= end) {
+        return -EINVAL;
+    }
+    for (uint32_t i = 0; i < nr_numa_memblks; i++) {
+        struct numa_memblk* mb = &numa_memblks[i];
+        if (start < mb->end && mb->start < end && mb->nid != nid) {
+            return -EINVAL;
+        }
+    }
+    if (nr_numa_memblks == NR_NODE_MEMBLKS) {
+        return -ENOSPC;
+    }
+    numa_memblks[nr_numa_memblks].start = start;
+    numa_memblks[nr_numa_memblks].end = end;
+    numa_memblks[nr_numa_memblks].nid = nid;
+    nr_numa_memblks++;
+    return 0;
+}
+
+int numa_add_cpu(uint32_t apic_id, uint32_t nid) {
+    if (nid >= MAX_NUMNODES) {
+        return -EINVAL;
+    }
+    if (nr_numa_cpus == NR_NUMA_CPUS) {
+        return -ENOSPC;
+    }
+    numa_cpus[nr_numa_cpus].apic_id = apic_id;
+    numa_cpus[nr_numa_cpus].nid = nid;
+    nr_numa_cpus++;
+    return 0;
+}
+
+void numa_set_distance(uint32_t from, uint32_t to, uint8_t distance) {
+    if (from < MAX_NUMNODES && to < MAX_NUMNODES) {
+        numa_distance[from][to] = distance;
+    }
+}
+
+void numa_reset(void) {
+    nr_numa_memblks = 0;
+    nr_numa_cpus = 0;
+    memset(numa_distance, 0, sizeof(numa_distance));
+}
+
+uint8_t node_distance(uint32_t from, uint32_t to) {
+    if (numa_distance[from][to]) {
+        return numa_distance[from][to];
+    }
+    return from == to ? LOCAL_DISTANCE : REMOTE_DISTANCE;
+}
+
+/* Расстояние до своего узла минимально, до чужих - больше */
+static bool numa_distances_valid(void) {
+    for (uint32_t a = 0; a < nr_node_ids; a++) {
+        for (uint32_t b = 0; b < nr_node_ids; b++) {
+            uint8_t d = node_distance(a, b);
+            if (a == b ? d != LOCAL_DISTANCE : d <= LOCAL_DISTANCE) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void numa_init(void) {
+    uint32_t max_nid = 0;
+
+    if (nr_numa_memblks == 0) {
+        /* Прошивка не описала память узлов: вся память - узел 0 */
+        numa_reset();
+    }
+    for (uint32_t i = 0; i < nr_numa_memblks; i++) {
+        max_nid = MAX(max_nid, numa_memblks[i].nid);
+    }
+    for (uint32_t i = 0; i < nr_numa_cpus; i++) {
+        max_nid = MAX(max_nid, numa_cpus[i].nid);
+    }
+    nr_node_ids = max_nid + 1;
+
+    if (!numa_distances_valid()) {
+        memset(numa_distance, 0, sizeof(numa_distance));
+    }
+
+    boot_cpu_node = 0;
+    for (uint32_t i = 0; i < nr_numa_cpus; i++) {
+        if (numa_cpus[i].apic_id == boot_cpu.apic_id) {
+            boot_cpu_node = numa_cpus[i].nid;
+            break;
+        }
+    }
+}
+
+uint32_t numa_node_of_phys(uint64_t phys) {
+    for (uint32_t i = 0; i < nr_numa_memblks; i++) {
+        if (phys >= numa_memblks[i].start && phys < numa_memblks[i].end) {
+            return numa_memblks[i].nid;
+        }
+    }
+    return 0;
+}
+
+uint32_t numa_node_id(void) {
+    /* Процессор пока один - загрузочный */
+    return boot_cpu_node;
+}
@@ -0,0 +1,44 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/numa.h
+ * Узлы NUMA: какой памяти и каким процессорам какой узел, расстояния
+ *
+ * Топологию описывает прошивка (ACPI SRAT и SLIT, см. acpi/numa.c). Без
+ * неё вся память - один узел 0. Номера узлов плотные: 0..nr_node_ids-1.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_NUMA_H
+#define MIXOS_MM_NUMA_H
+
+#include "kernel.h"
+
+#define MAX_NUMNODES        8
+#define NUMA_NO_NODE        (-1)
+
+/* Расстояния SLIT: до своего узла и по умолчанию до чужого */
+#define LOCAL_DISTANCE      10
+#define REMOTE_DISTANCE     20
+
+extern uint32_t nr_node_ids;
+
+/* Описание топологии (вызывается разбором таблиц до numa_init) */
+int numa_add_memblk(uint32_t nid, uint64_t start, uint64_t end);
+int numa_add_cpu(uint32_t apic_id, uint32_t nid);
+void numa_set_distance(uint32_t from, uint32_t to, uint8_t distance);
+
+/* Отказ от описанной топологии (таблицы противоречивы): один узел */
+void numa_reset(void);
+
+/* Проверка топологии; неверные расстояния заменяются умолчаниями */
+void numa_init(void);
+
+uint8_t node_distance(uint32_t from, uint32_t to);
+
+/* Узел физического адреса (0 - адрес вне описанной памяти) */
+uint32_t numa_node_of_phys(uint64_t phys);
+
+/* Узел процессора, на котором выполняется код */
+uint32_t numa_node_id(void);
+
+#endif /* MIXOS_MM_NUMA_H */
@@ -0,0 +1,190 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/page_cache.c
+ * Страничный кеш: глобальная хеш-таблица (mapping, index) -> struct page
+ * ============================================================================
+ */
+
+#include "mm/page_cache.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+static struct page** page_hash_table;
+static uint64_t page_hash_mask;
+
+static inline uint64_t page_hash(const struct address_space* mapping, uint64_t index) {
+    uint64_t key = (uint64_t)(uintptr_t)mapping ^ (index * 0x9E3779B97F4A7C15ULL);
+    key ^= key >> 29;
+    return key & page_hash_mask;
+}
+
+void page_cache_init(void) {
+    /* Одна корзина на 8 страниц памяти, не менее 512 и не более 64K */
+    uint64_t buckets = 512;
+    while (buckets < 65536 && buckets * 8 < pmm_total_pages()) {
+        buckets <<= 1;
+    }
+
+    page_hash_table = kzalloc(buckets * sizeof(struct page*));
+    if (!page_hash_table) {
+        panic("page_cache_init: cannot allocate hash table");
+    }
+    page_hash_mask = buckets - 1;
+}
+
+void address_space_init(struct address_space* mapping,
+                        const struct address_space_ops* a_ops, void* host) {
+    mapping->a_ops = a_ops;
+    mapping->host = host;
+    mapping->nrpages = 0;
+    list_init(&mapping->clean_pages);
+    list_init(&mapping->dirty_pages);
+}
+
+static struct page* __find_page(struct address_space* mapping, uint64_t index) {
+    struct page* page = page_hash_table[page_hash(mapping, index)];
+    while (page) {
+        if (page->mapping == mapping && page->index == index) {
+            return page;
+        }
+        page = page->hash_next;
+    }
+    return NULL;
+}
+
+static void __insert_page(struct address_space* mapping, struct page* page, uint64_t index) {
+    uint64_t bucket = page_hash(mapping, index);
+    page->mapping = mapping;
+    page->index = index;
+    page->hash_next = page_hash_table[bucket];
+    page_hash_table[bucket] = page;
+    list_add_tail(&page->lru, &mapping->clean_pages);
+    mapping->nrpages++;
+}
+
+static void __remove_page(struct page* page) {
+    struct address_space* mapping = page->mapping;
+    struct page** link = &page_hash_table[page_hash(mapping, page->index)];
+    while (*link != page) {
+        link = &(*link)->hash_next;
+    }
+    *link = page->hash_next;
+    page->hash_next = NULL;
+    list_del(&page->lru);
+    page->mapping = NULL;
+    mapping->nrpages--;
+}
+
+void replace_page_cache_page(struct page* old, struct page* new) {
+    struct page** link = &page_hash_table[page_hash(old->mapping, old->index)];
+    while (*link != old) {
+        link = &(*link)->hash_next;
+    }
+    new->mapping = old->mapping;
+    new->index = old->index;
+    new->hash_next = old->hash_next;
+    *link = new;
+    /* На место old в списке чистых или грязных страниц */
+    list_add(&new->lru, &old->lru);
+    list_del(&old->lru);
+    old->hash_next = NULL;
+    old->mapping = NULL;
+}
+
+struct page* find_get_page(struct address_space* mapping, uint64_t index) {
+    struct page* page = __find_page(mapping, index);
+    if (page) {
+        get_page(page);
+    }
+    return page;
+}
+
+struct page* grab_cache_page(struct address_space* mapping, uint64_t index) {
+    struct page* page = find_get_page(mapping, index);
+    if (page) {
+        return page;
+    }
+
+    page = alloc_page();
+    if (!page) {
+        return NULL;
+    }
+    /* Одна ссылка принадлежит кешу, вторая - вызывающему */
+    __insert_page(mapping, page, index);
+    get_page(page);
+    return page;
+}
+
+int read_cache_page(struct address_space* mapping, uint64_t index, struct page** out) {
+    struct page* page = grab_cache_page(mapping, index);
+    if (!page) {
+        return -ENOMEM;
+    }
+
+    if (!(page->flags & PG_UPTODATE)) {
+        int err = mapping->a_ops->readpage(mapping, page);
+        if (err < 0) {
+            put_page(page);
+            return err;
+        }
+        page->flags |= PG_UPTODATE;
+    }
+
+    *out = page;
+    return 0;
+}
+
+void set_page_dirty(struct page* page) {
+    if (!(page->flags & PG_DIRTY)) {
+        page->flags |= PG_DIRTY;
+        list_move_tail(&page->lru, &page->mapping->dirty_pages);
+    }
+}
+
+void clear_page_dirty(struct page* page) {
+    if (page->flags & PG_DIRTY) {
+        page->flags &= ~PG_DIRTY;
+        list_move_tail(&page->lru, &page->mapping->clean_pages);
+    }
+}
+
+int sync_mapping(struct address_space* mapping) {
+    int result = 0;
+
+    if (mapping->a_ops->writepages && !list_empty(&mapping->dirty_pages)) {
+        return mapping->a_ops->writepages(mapping);
+    }
+
+    while (!list_empty(&mapping->dirty_pages)) {
+        struct page* page = list_first_entry(&mapping->dirty_pages, struct page, lru);
+        page->flags &= ~PG_DIRTY;
+        list_move_tail(&page->lru, &mapping->clean_pages);
+
+        get_page(page);
+        int err = mapping->a_ops->writepage(mapping, page);
+        put_page(page);
+        if (err < 0 && result == 0) {
+            result = err;
+        }
+    }
+    return result;
+}
+
+static void truncate_list(struct list_head* list, uint64_t start) {
+    struct list_head* pos;
+    struct list_head* tmp;
+
+    list_for_each_safe(pos, tmp, list) {
+        struct page* page = list_entry(pos, struct page, lru);
+        if (page->index >= start) {
+            page->flags &= ~PG_DIRTY;
+            __remove_page(page);
+            put_page(page);
+        }
+    }
+}
+
+void truncate_mapping(struct address_space* mapping, uint64_t start) {
+    truncate_list(&mapping->dirty_pages, start);
+    truncate_list(&mapping->clean_pages, start);
+}
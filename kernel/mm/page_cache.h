@@ -0,0 +1,74 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/page_cache.h
+ * Страничный кеш: страницы файлов и блочных устройств в памяти
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_PAGE_CACHE_H
+#define MIXOS_MM_PAGE_CACHE_H
+
+#include "kernel.h"
+#include "lib/list.h"
+#include "mm/pmm.h"
+
+struct address_space;
+
+/* Операции владельца кеша (файловой системы или блочного устройства) */
+struct address_space_ops {
+    /* Заполнить страницу данными с носителя (дыры заполняются нулями) */
+    int (*readpage)(struct address_space* mapping, struct page* page);
+    /* Записать грязную страницу на носитель */
+    int (*writepage)(struct address_space* mapping, struct page* page);
+    /* Подготовить байты [from, to) страницы к записи (выделить блоки) */
+    int (*write_begin)(struct address_space* mapping, struct page* page,
+                       uint32_t from, uint32_t to);
+    /* Необязательно: записать все грязные страницы объекта за один проход
+     * (снимая с них clear_page_dirty), чтобы разместить их на носителе
+     * вместе. Без неё sync_mapping вызывает writepage для каждой страницы */
+    int (*writepages)(struct address_space* mapping);
+};
+
+/* Набор закешированных страниц одного объекта */
+struct address_space {
+    const struct address_space_ops* a_ops;
+    void* host;                     /* struct inode или struct block_device */
+    uint64_t nrpages;
+    struct list_head clean_pages;
+    struct list_head dirty_pages;
+};
+
+void page_cache_init(void);
+
+void address_space_init(struct address_space* mapping,
+                        const struct address_space_ops* a_ops, void* host);
+
+/* Поиск страницы в кеше; возвращает страницу с лишней ссылкой или NULL */
+struct page* find_get_page(struct address_space* mapping, uint64_t index);
+
+/* Поиск или создание страницы (без чтения с носителя) */
+struct page* grab_cache_page(struct address_space* mapping, uint64_t index);
+
+/* Страница с актуальными данными; при необходимости читается с носителя */
+int read_cache_page(struct address_space* mapping, uint64_t index, struct page** out);
+
+/*
+ * new занимает место old в кеше (перенос страницы при уплотнении).
+ * Содержимое, флаги и ссылки переносит вызывающий.
+ */
+void replace_page_cache_page(struct page* old, struct page* new);
+
+void set_page_dirty(struct page* page);
+void clear_page_dirty(struct page* page);
+
+/* Запись всех грязных страниц объекта */
+int sync_mapping(struct address_space* mapping);
+
+/* Удаление из кеша страниц с индексами >= start (грязные отбрасываются) */
+void truncate_mapping(struct address_space* mapping, uint64_t start);
+
+static inline void page_cache_release(struct page* page) {
+    put_page(page);
+}
+
+#endif /* MIXOS_MM_PAGE_CACHE_H */
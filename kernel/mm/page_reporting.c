@@ -0,0 +1,87 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/page_reporting.c
+ * Сообщение гипервизору о свободной памяти
+ * ============================================================================
+ */
+
+#include "mm/page_reporting.h"
+#include "errno.h"
+
+struct page_reporting_stats page_reporting_stats;
+bool page_reporting_requested;
+struct page_reporting_dev_info* page_reporting_dev;
+
+int page_reporting_register(struct page_reporting_dev_info* prdev) {
+    if (page_reporting_dev) {
+        return -EBUSY;
+    }
+    page_reporting_dev = prdev;
+    page_reporting_requested = true;
+    return 0;
+}
+
+void page_reporting_unregister(struct page_reporting_dev_info* prdev) {
+    if (page_reporting_dev == prdev) {
+        page_reporting_dev = NULL;
+        page_reporting_requested = false;
+    }
+}
+
+/* Сообщение пачки и возврат её блоков в buddy */
+static int report_batch(struct page** pages, uint32_t nents) {
+    int err = page_reporting_dev->report(page_reporting_dev, pages, nents);
+
+    page_reporting_stats.reports++;
+    if (err < 0) {
+        page_reporting_stats.failed++;
+    }
+    for (uint32_t i = 0; i < nents; i++) {
+        if (err == 0) {
+            page_reporting_stats.pages_reported += 1UL << pages[i]->order;
+        }
+        putback_isolated_block(pages[i], err == 0);
+    }
+    return err;
+}
+
+void page_reporting_process(void) {
+    if (!page_reporting_dev || !page_reporting_requested) {
+        return;
+    }
+    page_reporting_requested = false;
+
+    /*
+     * Несообщённые блоки стоят в голове списков, сообщённые - в хвосте,
+     * так что каждый список просматривается до первого сообщённого.
+     * Возвращённый блок не сливается с соседом: свободный сосед того же
+     * порядка слился бы с ним ещё до изъятия.
+     */
+    struct page* batch[PAGE_REPORTING_CAPACITY];
+    uint32_t nents = 0;
+    for (uint32_t nid = 0; nid < nr_node_ids; nid++) {
+        struct zone* zone = &NODE_DATA(nid)->zone;
+        for (int order = PMM_MAX_ORDER - 1; order >= PAGE_REPORTING_MIN_ORDER; order--) {
+            struct list_head* list = &zone->free_area[order].free_list;
+            while (!list_empty(list)) {
+                struct page* page = list_first_entry(list, struct page, lru);
+                if (page->flags & PG_REPORTED) {
+                    break;
+                }
+                isolate_free_block(page);
+                batch[nents++] = page;
+                if (nents < PAGE_REPORTING_CAPACITY) {
+                    continue;
+                }
+                /* Устройство не принимает сообщения: до следующего освобождения */
+                if (report_batch(batch, nents) < 0) {
+                    return;
+                }
+                nents = 0;
+            }
+        }
+    }
+    if (nents) {
+        report_batch(batch, nents);
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/page_reporting.h
+ * Сообщение гипервизору о свободной памяти (free page reporting)
+ *
+ * Свободные блоки buddy от 2 MiB и крупнее пачками передаются драйверу
+ * устройства (virtio-balloon), а тот сообщает их хосту, и хост забирает
+ * их память. На время сообщения блок изымается из buddy, после -
+ * возвращается с отметкой PG_REPORTED и повторно не сообщается, пока не
+ * будет выделен или слит с соседом. Новые сообщения запускает
+ * освобождение достаточно крупного блока; обработка идёт в простое.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_PAGE_REPORTING_H
+#define MIXOS_MM_PAGE_REPORTING_H
+
+#include "mm/pmm.h"
+
+/* Наименьший сообщаемый блок: 2 MiB, как большая страница */
+#define PAGE_REPORTING_MIN_ORDER    9
+
+/* Блоков в одном сообщении */
+#define PAGE_REPORTING_CAPACITY     32
+
+struct page_reporting_dev_info {
+    /*
+     * Сообщение хосту о nents свободных блоках (порядок - page->order).
+     * 0 - хост принял их; иначе блоки вернутся в buddy несообщёнными.
+     */
+    int (*report)(struct page_reporting_dev_info* prdev, struct page** pages, uint32_t nents);
+};
+
+struct page_reporting_stats {
+    uint64_t reports;               /* Сообщений отправлено */
+    uint64_t pages_reported;        /* Страниц в них */
+    uint64_t failed;                /* Сообщений, не принятых устройством */
+};
+
+extern struct page_reporting_stats page_reporting_stats;
+
+/* Есть несообщённые крупные свободные блоки */
+extern bool page_reporting_requested;
+extern struct page_reporting_dev_info* page_reporting_dev;
+
+/* Освобождение блока порядка order (после слияния) из buddy */
+static inline void page_reporting_notify_free(unsigned int order) {
+    if (page_reporting_dev && order >= PAGE_REPORTING_MIN_ORDER) {
+        page_reporting_requested = true;
+    }
+}
+
+/* Одно устройство; регистрация запускает сообщение всей свободной памяти */
+int page_reporting_register(struct page_reporting_dev_info* prdev);
+void page_reporting_unregister(struct page_reporting_dev_info* prdev);
+
+/* Сообщение накопившихся блоков (из цикла простоя) */
+void page_reporting_process(void);
+
+#endif /* MIXOS_MM_PAGE_REPORTING_H */
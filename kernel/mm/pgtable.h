@@ -0,0 +1,104 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/pgtable.h
+ * Таблицы страниц x86_64: формат записей и индексы уровней
+ *
+ * Четыре уровня (PML4 -> PDPT -> PD -> PT) по 512 записей. Таблицы
+ * процессов - страницы из pmm, доступные через прямое отображение.
+ * Запись PML4 0 (первые 4 GiB один-в-один из boot.asm) и верхняя
+ * половина адресного пространства принадлежат ядру и общие для всех
+ * процессов; пользовательская память - записи PML4 с 1 по 255.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_PGTABLE_H
+#define MIXOS_MM_PGTABLE_H
+
+#include "mm/pmm.h"
+
+typedef uint64_t pte_t;
+
+/* Биты записи таблицы страниц */
+#define _PAGE_PRESENT       (1ULL << 0)
+#define _PAGE_RW            (1ULL << 1)
+#define _PAGE_USER          (1ULL << 2)
+#define _PAGE_PWT           (1ULL << 3)
+#define _PAGE_PCD           (1ULL << 4)
+#define _PAGE_ACCESSED      (1ULL << 5)
+#define _PAGE_DIRTY         (1ULL << 6)
+#define _PAGE_PSE           (1ULL << 7)     /* Большая страница (в PD/PDPT) */
+#define _PAGE_GLOBAL        (1ULL << 8)     /* Не сбрасывается при смене CR3 */
+
+#define PTE_ADDR_MASK       0x000FFFFFFFFFF000ULL
+
+/*
+ * Неприсутствующая запись PTE с этим битом - страница вытеснена в swap,
+ * номер слота - на месте номера кадра. Процессор биты неприсутствующей
+ * записи не читает.
+ */
+#define _PAGE_SWP_ENTRY     (1ULL << 9)
+
+/* Запись таблицы верхнего уровня, указывающая на таблицу ниже */
+#define _PAGE_TABLE         (_PAGE_PRESENT | _PAGE_RW | _PAGE_USER)
+
+#define PTRS_PER_TABLE      512
+#define PGDIR_SHIFT         39
+#define PUD_SHIFT           30
+#define PMD_SHIFT           21
+
+/* Пользовательская часть адресного пространства: записи PML4 1..255 */
+#define USER_SPACE_START    0x0000008000000000ULL
+#define USER_SPACE_END      0x0000800000000000ULL
+#define USER_PGD_FIRST      (USER_SPACE_START >> PGDIR_SHIFT)
+#define USER_PGD_LAST       ((USER_SPACE_END >> PGDIR_SHIFT) - 1)
+
+static inline uint32_t pgd_index(uint64_t addr) {
+    return (addr >> PGDIR_SHIFT) & (PTRS_PER_TABLE - 1);
+}
+
+static inline uint32_t pud_index(uint64_t addr) {
+    return (addr >> PUD_SHIFT) & (PTRS_PER_TABLE - 1);
+}
+
+static inline uint32_t pmd_index(uint64_t addr) {
+    return (addr >> PMD_SHIFT) & (PTRS_PER_TABLE - 1);
+}
+
+static inline uint32_t pte_index(uint64_t addr) {
+    return (addr >> PAGE_SHIFT) & (PTRS_PER_TABLE - 1);
+}
+
+static inline bool pte_present(pte_t pte) {
+    return pte & _PAGE_PRESENT;
+}
+
+static inline bool pte_write(pte_t pte) {
+    return pte & _PAGE_RW;
+}
+
+static inline struct page* pte_page(pte_t pte) {
+    return pfn_to_page((pte & PTE_ADDR_MASK) >> PAGE_SHIFT);
+}
+
+static inline pte_t mk_pte(struct page* page, uint64_t flags) {
+    return page_to_phys(page) | flags;
+}
+
+static inline bool is_swap_pte(pte_t pte) {
+    return !pte_present(pte) && (pte & _PAGE_SWP_ENTRY);
+}
+
+static inline pte_t swp_entry_to_pte(uint64_t slot) {
+    return (slot << PAGE_SHIFT) | _PAGE_SWP_ENTRY;
+}
+
+static inline uint64_t pte_to_swp_slot(pte_t pte) {
+    return (pte & PTE_ADDR_MASK) >> PAGE_SHIFT;
+}
+
+/* Таблица, на которую указывает запись верхнего уровня */
+static inline pte_t* pte_table(pte_t entry) {
+    return phys_to_virt(entry & PTE_ADDR_MASK);
+}
+
+#endif /* MIXOS_MM_PGTABLE_H */
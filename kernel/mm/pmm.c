@@ -0,0 +1,455 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/pmm.c
+ * Менеджер физической памяти: buddy-аллокатор страниц
+ * ============================================================================
+ */
+
+#include "mm/pmm.h"
+#include "mm/page_reporting.h"
+#include "mm/compaction.h"
+
+struct page* mem_map;
+uint64_t max_pfn;
+
+struct pglist_data node_data[MAX_NUMNODES];
+struct prezero_stats prezero_stats;
+
+/* Нижний 1 MiB (BIOS, VGA, таблицы загрузчика) никогда не выделяется */
+#define PMM_LOW_MEMORY_LIMIT 0x100000ULL
+
+/* ============================================================================
+ * Вспомогательные функции инициализации
+ * ============================================================================ */
+
+static bool ranges_overlap(uint64_t a_start, uint64_t a_end,
+                           uint64_t b_start, uint64_t b_end) {
+    return a_start < b_end && b_start < a_end;
+}
+
+/* Проверка, пересекается ли [start, end) с каким-либо занятым диапазоном */
+static const struct pmm_region* find_conflict(uint64_t start, uint64_t end,
+                                              const struct pmm_region* reserved,
+                                              size_t reserved_count) {
+    for (size_t i = 0; i < reserved_count; i++) {
+        if (ranges_overlap(start, end, reserved[i].base,
+                           reserved[i].base + reserved[i].length)) {
+            return &reserved[i];
+        }
+    }
+    return NULL;
+}
+
+/* Поиск места под массив mem_map в доступной памяти */
+static uint64_t place_mem_map(uint64_t size,
+                              const struct pmm_region* avail, size_t avail_count,
+                              const struct pmm_region* reserved, size_t reserved_count) {
+    for (size_t i = 0; i < avail_count; i++) {
+        uint64_t start = ALIGN_UP(MAX(avail[i].base, PMM_LOW_MEMORY_LIMIT), PAGE_SIZE);
+        uint64_t end = MIN(avail[i].base + avail[i].length, PMM_DIRECT_MAP_LIMIT);
+
+        while (start + size <= end) {
+            const struct pmm_region* conflict =
+                find_conflict(start, start + size, reserved, reserved_count);
+            if (!conflict) {
+                return start;
+            }
+            start = ALIGN_UP(conflict->base + conflict->length, PAGE_SIZE);
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Buddy-аллокатор
+ * ============================================================================ */
+
+static inline bool page_is_buddy(struct zone* zone, uint64_t pfn, unsigned int order) {
+    if (pfn < zone->start_pfn || pfn >= zone->end_pfn) {
+        return false;
+    }
+    /* Соседний кадр может принадлежать другому узлу: блоки узлов не сливаются */
+    struct page* page = pfn_to_page(pfn);
+    return (page->flags & PG_BUDDY) && page->order == order && page->node == zone->node;
+}
+
+/*
+ * Возврат блока в свободные списки со слиянием соседей-близнецов;
+ * возвращает порядок получившегося блока. reported - хост уже знает, что
+ * память блока свободна (page_reporting). Такие блоки стоят в хвосте
+ * списка, и выделение сначала берёт память, которую хост не забирал.
+ * Слияние сбрасывает отметку: о соседе хосту не сообщалось.
+ */
+static unsigned int __free_block(struct zone* zone, uint64_t pfn, unsigned int order,
+                                 bool reported) {
+    zone->free_pages += 1UL << order;
+
+    while (order < PMM_MAX_ORDER - 1) {
+        uint64_t buddy_pfn = pfn ^ (1UL << order);
+        if (!page_is_buddy(zone, buddy_pfn, order)) {
+            break;
+        }
+        struct page* buddy = pfn_to_page(buddy_pfn);
+        list_del(&buddy->lru);
+        buddy->flags &= ~(PG_BUDDY | PG_REPORTED);
+        zone->free_area[order].nr_free--;
+
+        pfn &= ~(1UL << order);
+        order++;
+        reported = false;
+    }
+
+    struct page* page = pfn_to_page(pfn);
+    page->flags |= PG_BUDDY;
+    page->order = (uint8_t)order;
+    if (reported) {
+        page->flags |= PG_REPORTED;
+        list_add_tail(&page->lru, &zone->free_area[order].free_list);
+    } else {
+        list_add(&page->lru, &zone->free_area[order].free_list);
+    }
+    zone->free_area[order].nr_free++;
+    return order;
+}
+
+/* Изъятие блока нужного порядка с расщеплением более крупного */
+static struct page* __alloc_block(struct zone* zone, unsigned int order) {
+    for (unsigned int current = order; current < PMM_MAX_ORDER; current++) {
+        struct free_area* area = &zone->free_area[current];
+        if (list_empty(&area->free_list)) {
+            continue;
+        }
+
+        struct page* page = list_first_entry(&area->free_list, struct page, lru);
+        uint32_t reported = page->flags & PG_REPORTED;
+        list_del(&page->lru);
+        page->flags &= ~(PG_BUDDY | PG_REPORTED);
+        area->nr_free--;
+
+        /*
+         * Вторые половины расщеплённого блока возвращаем в младшие списки;
+         * половины сообщённого блока остаются сообщёнными.
+         */
+        uint64_t pfn = page_to_pfn(page);
+        while (current > order) {
+            current--;
+            struct page* half = pfn_to_page(pfn + (1UL << current));
+            half->flags |= PG_BUDDY | reported;
+            half->order = (uint8_t)current;
+            if (reported) {
+                list_add_tail(&half->lru, &zone->free_area[current].free_list);
+            } else {
+                list_add(&half->lru, &zone->free_area[current].free_list);
+            }
+            zone->free_area[current].nr_free++;
+        }
+
+        zone->free_pages -= 1UL << order;
+        return page;
+    }
+    return NULL;
+}
+
+static void prep_new_page(struct page* page, unsigned int order) {
+    page->flags = 0;
+    page->refcount = 1;
+    page->order = (uint8_t)order;
+    page->mapping = NULL;
+    page->index = 0;
+    page->hash_next = NULL;
+    page->private = 0;
+    list_init(&page->lru);
+}
+
+/* Возврат всех пулов обнулённых страниц в buddy; число страниц */
+static uint64_t drain_zeroed_pages(void) {
+    uint64_t drained = 0;
+    for (uint32_t nid = 0; nid < nr_node_ids; nid++) {
+        struct pglist_data* pgdat = NODE_DATA(nid);
+        while (!list_empty(&pgdat->zeroed_list)) {
+            struct page* page = list_first_entry(&pgdat->zeroed_list, struct page, lru);
+            list_del(&page->lru);
+            pgdat->nr_zeroed--;
+            page_reporting_notify_free(__free_block(&pgdat->zone, page_to_pfn(page), 0, false));
+            drained++;
+        }
+    }
+    prezero_stats.drained += drained;
+    return drained;
+}
+
+static struct page* __alloc_pages(int nid, unsigned int order, bool compact) {
+    if (order >= PMM_MAX_ORDER) {
+        return NULL;
+    }
+    if (nid == NUMA_NO_NODE || (uint32_t)nid >= nr_node_ids) {
+        nid = (int)numa_node_id();
+    }
+
+    struct pglist_data* pgdat = NODE_DATA((uint32_t)nid);
+    struct page* page = NULL;
+    for (uint32_t i = 0; i < pgdat->nr_zonelist && !page; i++) {
+        struct pglist_data* target = pgdat->zonelist[i];
+        page = __alloc_block(&target->zone, order);
+        if (!page) {
+            continue;
+        }
+        if (target == pgdat) {
+            pgdat->numa_hit++;
+        } else {
+            target->numa_miss++;
+            pgdat->numa_foreign++;
+        }
+    }
+    if (!page) {
+        /* Последний запас - страницы пулов обнулённых */
+        if (drain_zeroed_pages() > 0) {
+            return __alloc_pages(nid, order, compact);
+        }
+        /* Свободная память есть, но раздроблена */
+        if (order > 0) {
+            if (compact && try_to_compact_pages(nid, order)) {
+                return __alloc_pages(nid, order, false);
+            }
+            if (!compact) {
+                wakeup_kcompactd(nid, order);
+            }
+        }
+        return NULL;
+    }
+
+    prep_new_page(page, order);
+    return page;
+}
+
+struct page* alloc_pages_node(int nid, unsigned int order) {
+    return __alloc_pages(nid, order, true);
+}
+
+struct page* alloc_pages(unsigned int order) {
+    return __alloc_pages((int)numa_node_id(), order, true);
+}
+
+struct page* try_alloc_pages(unsigned int order) {
+    return __alloc_pages((int)numa_node_id(), order, false);
+}
+
+void free_pages(struct page* page, unsigned int order) {
+    if (page->flags & (PG_RESERVED | PG_BUDDY)) {
+        panic("free_pages: freeing reserved or already free page");
+    }
+    page->flags = 0;
+    page->refcount = 0;
+    page->mapping = NULL;
+    order = __free_block(&NODE_DATA(page->node)->zone, page_to_pfn(page), order, false);
+    page_reporting_notify_free(order);
+}
+
+void isolate_free_block(struct page* page) {
+    struct zone* zone = &NODE_DATA(page->node)->zone;
+    list_del(&page->lru);
+    page->flags &= ~(PG_BUDDY | PG_REPORTED);
+    zone->free_area[page->order].nr_free--;
+    zone->free_pages -= 1UL << page->order;
+}
+
+void putback_isolated_block(struct page* page, bool reported) {
+    __free_block(&NODE_DATA(page->node)->zone, page_to_pfn(page), page->order, reported);
+}
+
+/* ============================================================================
+ * Пул обнулённых страниц
+ * ============================================================================ */
+
+/*
+ * Очистка невременными записями (movnti): строки идут в память мимо
+ * кеша и не вытесняют рабочий набор. Это целочисленная инструкция,
+ * регистры SSE ядру не нужны. Порядок относительно обычных записей
+ * восстанавливает sfence после пачки.
+ */
+static void clear_page_nt(void* addr) {
+    uint64_t* p = addr;
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i += 8) {
+        __asm__ volatile ("movnti %1, 0(%0)\n\t"
+                          "movnti %1, 8(%0)\n\t"
+                          "movnti %1, 16(%0)\n\t"
+                          "movnti %1, 24(%0)\n\t"
+                          "movnti %1, 32(%0)\n\t"
+                          "movnti %1, 40(%0)\n\t"
+                          "movnti %1, 48(%0)\n\t"
+                          "movnti %1, 56(%0)"
+                          : : "r"(p + i), "r"(0UL) : "memory");
+    }
+}
+
+unsigned int prezero_pages(unsigned int nr) {
+    unsigned int done = 0;
+
+    for (uint32_t nid = 0; nid < nr_node_ids && done < nr; nid++) {
+        struct pglist_data* pgdat = NODE_DATA(nid);
+        /* Пул не должен отнимать последние свободные страницы узла */
+        while (done < nr && pgdat->nr_zeroed < PREZERO_POOL_PAGES &&
+               pgdat->zone.free_pages > PREZERO_POOL_PAGES) {
+            struct page* page = __alloc_block(&pgdat->zone, 0);
+            if (!page) {
+                break;
+            }
+            clear_page_nt(page_address(page));
+            list_add_tail(&page->lru, &pgdat->zeroed_list);
+            pgdat->nr_zeroed++;
+            done++;
+        }
+    }
+    if (done) {
+        __asm__ volatile ("sfence" : : : "memory");
+        prezero_stats.zeroed += done;
+    }
+    return done;
+}
+
+struct page* alloc_zeroed_page(void) {
+    struct pglist_data* pgdat = NODE_DATA(numa_node_id());
+    if (!list_empty(&pgdat->zeroed_list)) {
+        struct page* page = list_first_entry(&pgdat->zeroed_list, struct page, lru);
+        list_del(&page->lru);
+        pgdat->nr_zeroed--;
+        pgdat->numa_hit++;
+        prezero_stats.hits++;
+        prep_new_page(page, 0);
+        return page;
+    }
+
+    prezero_stats.misses++;
+    struct page* page = alloc_page();
+    if (page) {
+        memset(page_address(page), 0, PAGE_SIZE);
+    }
+    return page;
+}
+
+void put_page(struct page* page) {
+    if (--page->refcount == 0) {
+        free_pages(page, page->order);
+    }
+}
+
+uint64_t pmm_free_pages(void) {
+    uint64_t total = 0;
+    for (uint32_t nid = 0; nid < nr_node_ids; nid++) {
+        total += NODE_DATA(nid)->zone.free_pages + NODE_DATA(nid)->nr_zeroed;
+    }
+    return total;
+}
+
+uint64_t pmm_total_pages(void) {
+    uint64_t total = 0;
+    for (uint32_t nid = 0; nid < nr_node_ids; nid++) {
+        total += NODE_DATA(nid)->zone.managed_pages;
+    }
+    return total;
+}
+
+/* ============================================================================
+ * Инициализация
+ * ============================================================================ */
+
+/* Запасные узлы каждого узла: по возрастанию расстояния, только с памятью */
+static void build_zonelists(void) {
+    for (uint32_t nid = 0; nid < nr_node_ids; nid++) {
+        struct pglist_data* pgdat = NODE_DATA(nid);
+        pgdat->nr_zonelist = 0;
+        for (uint32_t other = 0; other < nr_node_ids; other++) {
+            if (NODE_DATA(other)->zone.managed_pages == 0) {
+                continue;
+            }
+            /* Вставка с сохранением порядка: при равных расстояниях - по номеру */
+            uint32_t pos = pgdat->nr_zonelist;
+            while (pos > 0 && node_distance(nid, pgdat->zonelist[pos - 1]->node_id) >
+                              node_distance(nid, other)) {
+                pgdat->zonelist[pos] = pgdat->zonelist[pos - 1];
+                pos--;
+            }
+            pgdat->zonelist[pos] = NODE_DATA(other);
+            pgdat->nr_zonelist++;
+        }
+    }
+}
+
+void pmm_init(const struct pmm_region* avail, size_t avail_count,
+              const struct pmm_region* reserved, size_t reserved_count) {
+    max_pfn = 0;
+    for (size_t i = 0; i < avail_count; i++) {
+        uint64_t start = avail[i].base >> PAGE_SHIFT;
+        uint64_t end = MIN(avail[i].base + avail[i].length, PMM_DIRECT_MAP_LIMIT) >> PAGE_SHIFT;
+        if (end > start) {
+            max_pfn = MAX(max_pfn, end);
+        }
+    }
+    if (max_pfn == 0) {
+        panic("pmm_init: no usable memory");
+    }
+
+    uint64_t map_size = ALIGN_UP(max_pfn * sizeof(struct page), PAGE_SIZE);
+    uint64_t map_base = place_mem_map(map_size, avail, avail_count,
+                                      reserved, reserved_count);
+    if (map_base == 0) {
+        panic("pmm_init: no room for mem_map");
+    }
+    mem_map = phys_to_virt(map_base);
+
+    for (uint32_t nid = 0; nid < MAX_NUMNODES; nid++) {
+        struct pglist_data* pgdat = NODE_DATA(nid);
+        memset(pgdat, 0, sizeof(*pgdat));
+        pgdat->node_id = nid;
+        pgdat->zone.name = "Normal";
+        pgdat->zone.node = nid;
+        pgdat->zone.start_pfn = UINT64_MAX;
+        for (unsigned int order = 0; order < PMM_MAX_ORDER; order++) {
+            list_init(&pgdat->zone.free_area[order].free_list);
+        }
+        list_init(&pgdat->zeroed_list);
+    }
+
+    /* Все кадры изначально зарезервированы */
+    for (uint64_t pfn = 0; pfn < max_pfn; pfn++) {
+        struct page* page = &mem_map[pfn];
+        memset(page, 0, sizeof(*page));
+        page->flags = PG_RESERVED;
+        page->refcount = 1;
+        page->node = (uint8_t)numa_node_of_phys(pfn << PAGE_SHIFT);
+        list_init(&page->lru);
+    }
+
+    /* Охват зон: кадры из доступных диапазонов */
+    for (size_t i = 0; i < avail_count; i++) {
+        uint64_t start = avail[i].base >> PAGE_SHIFT;
+        uint64_t end = MIN(avail[i].base + avail[i].length, PMM_DIRECT_MAP_LIMIT) >> PAGE_SHIFT;
+        for (uint64_t pfn = start; pfn < end; pfn++) {
+            struct zone* zone = &NODE_DATA(mem_map[pfn].node)->zone;
+            zone->start_pfn = MIN(zone->start_pfn, pfn);
+            zone->end_pfn = MAX(zone->end_pfn, pfn + 1);
+        }
+    }
+
+    /* Освобождаем доступные кадры, не попадающие в занятые диапазоны */
+    for (size_t i = 0; i < avail_count; i++) {
+        uint64_t start = ALIGN_UP(MAX(avail[i].base, PMM_LOW_MEMORY_LIMIT), PAGE_SIZE);
+        uint64_t end = ALIGN_DOWN(MIN(avail[i].base + avail[i].length,
+                                      PMM_DIRECT_MAP_LIMIT), PAGE_SIZE);
+
+        for (uint64_t addr = start; addr < end; addr += PAGE_SIZE) {
+            if (ranges_overlap(addr, addr + PAGE_SIZE, map_base, map_base + map_size) ||
+                find_conflict(addr, addr + PAGE_SIZE, reserved, reserved_count)) {
+                continue;
+            }
+            struct page* page = &mem_map[addr >> PAGE_SHIFT];
+            struct zone* zone = &NODE_DATA(page->node)->zone;
+            page->flags = 0;
+            page->refcount = 0;
+            zone->managed_pages++;
+            __free_block(zone, addr >> PAGE_SHIFT, 0, false);
+        }
+    }
+
+    build_zonelists();
+}
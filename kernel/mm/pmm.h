@@ -0,0 +1,210 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/pmm.h
+ * Менеджер физической памяти (buddy-аллокатор страниц)
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_PMM_H
+#define MIXOS_MM_PMM_H
+
+#include "kernel.h"
+#include "lib/list.h"
+#include "mm/numa.h"
+
+#define PAGE_SHIFT          12
+#define PAGE_SIZE           (1UL << PAGE_SHIFT)
+#define PAGE_MASK           (~(PAGE_SIZE - 1))
+
+/* Максимальный порядок блока: 2^(PMM_MAX_ORDER-1) страниц = 4 MiB */
+#define PMM_MAX_ORDER       11
+
+/*
+ * boot.asm отображает первые 4 GiB физической памяти один-в-один,
+ * поэтому аллокатор управляет только памятью ниже этой границы.
+ */
+#define PMM_DIRECT_MAP_LIMIT 0x100000000ULL
+
+/* Флаги struct page */
+#define PG_RESERVED     (1U << 0)   /* Страница не управляется аллокатором */
+#define PG_BUDDY        (1U << 1)   /* Голова свободного блока в buddy */
+#define PG_SLAB         (1U << 2)   /* Страница принадлежит kmalloc */
+#define PG_UPTODATE     (1U << 3)   /* Данные страницы актуальны */
+#define PG_DIRTY        (1U << 4)   /* Страница изменена и требует записи */
+#define PG_CHECKED      (1U << 5)   /* Владелец проверил содержимое (контрольную сумму) */
+#define PG_KSM          (1U << 6)   /* Общая страница KSM (mm/ksm.h) */
+#define PG_REPORTED     (1U << 7)   /* Свободный блок сообщён хосту (mm/page_reporting.h) */
+
+/*
+ * Описатель физической страницы. Массив mem_map содержит по одному
+ * описателю на каждый кадр от 0 до max_pfn.
+ */
+struct page {
+    uint32_t flags;
+    int32_t refcount;
+    uint8_t order;                  /* Порядок блока (для головы блока) */
+    uint8_t node;                   /* Узел NUMA кадра */
+    struct list_head lru;           /* Списки buddy / kmalloc / LRU */
+    struct address_space* mapping;  /* Владелец в page cache */
+    uint64_t index;                 /* Смещение в страницах внутри mapping */
+    struct page* hash_next;         /* Цепочка хеш-таблицы page cache */
+    uint64_t private;               /* Данные владельца страницы */
+};
+
+/* Область свободных блоков одного порядка */
+struct free_area {
+    struct list_head free_list;
+    uint64_t nr_free;
+};
+
+/* Зона физической памяти */
+struct zone {
+    const char* name;
+    uint32_t node;
+    uint64_t start_pfn;             /* Охват кадров узла; узлы могут чередоваться */
+    uint64_t end_pfn;
+    uint64_t managed_pages;
+    uint64_t free_pages;
+    struct free_area free_area[PMM_MAX_ORDER];
+    uint32_t compact_considered;    /* Попыток уплотнения после неудачи */
+    uint32_t compact_defer_shift;   /* Уплотняется каждая 2^shift-я попытка */
+};
+
+/*
+ * Узел NUMA: своя зона со своим buddy-аллокатором и порядок запасных
+ * узлов по возрастанию расстояния (сначала сам узел).
+ */
+struct pglist_data {
+    uint32_t node_id;
+    struct zone zone;
+    struct pglist_data* zonelist[MAX_NUMNODES];
+    uint32_t nr_zonelist;
+    uint64_t numa_hit;              /* Выделено здесь по запросу к этому узлу */
+    uint64_t numa_miss;             /* Выделено здесь, хотя просили другой узел */
+    uint64_t numa_foreign;          /* Просили этот узел, выделено на другом */
+    struct list_head zeroed_list;   /* Пул заранее обнулённых страниц (через lru) */
+    uint64_t nr_zeroed;
+};
+
+extern struct pglist_data node_data[MAX_NUMNODES];
+
+static inline struct pglist_data* NODE_DATA(uint32_t nid) {
+    return &node_data[nid];
+}
+
+/* Непрерывный диапазон физических адресов */
+struct pmm_region {
+    uint64_t base;
+    uint64_t length;
+};
+
+extern struct page* mem_map;
+extern uint64_t max_pfn;
+
+static inline void* phys_to_virt(uint64_t phys) {
+    return (void*)(uintptr_t)phys;
+}
+
+static inline uint64_t virt_to_phys(const void* virt) {
+    return (uint64_t)(uintptr_t)virt;
+}
+
+static inline uint64_t page_to_pfn(const struct page* page) {
+    return (uint64_t)(page - mem_map);
+}
+
+static inline struct page* pfn_to_page(uint64_t pfn) {
+    return &mem_map[pfn];
+}
+
+static inline uint32_t page_to_nid(const struct page* page) {
+    return page->node;
+}
+
+static inline uint64_t page_to_phys(const struct page* page) {
+    return page_to_pfn(page) << PAGE_SHIFT;
+}
+
+static inline void* page_address(const struct page* page) {
+    return phys_to_virt(page_to_phys(page));
+}
+
+static inline struct page* virt_to_page(const void* virt) {
+    return pfn_to_page(virt_to_phys(virt) >> PAGE_SHIFT);
+}
+
+/*
+ * Инициализация аллокатора: avail - доступная RAM из карты памяти
+ * загрузчика, reserved - занятые диапазоны (ядро, модули, Multiboot info).
+ */
+void pmm_init(const struct pmm_region* avail, size_t avail_count,
+              const struct pmm_region* reserved, size_t reserved_count);
+
+/* Блок 2^order страниц с узла nid, при нехватке - с ближайших (NUMA_NO_NODE - свой узел) */
+struct page* alloc_pages_node(int nid, unsigned int order);
+
+/* Блок с узла процессора, на котором выполняется код */
+struct page* alloc_pages(unsigned int order);
+
+/*
+ * Блок без прямого уплотнения (у вызывающего есть запасной путь, как у
+ * больших страниц): при неудаче уплотнение запускается в фоне.
+ */
+struct page* try_alloc_pages(unsigned int order);
+void free_pages(struct page* page, unsigned int order);
+
+static inline struct page* alloc_page(void) {
+    return alloc_pages(0);
+}
+
+static inline void free_page(struct page* page) {
+    free_pages(page, 0);
+}
+
+/*
+ * Изъятие свободного блока (голова с PG_BUDDY, порядок в page->order)
+ * из buddy и возврат обратно; reported - хост знает, что блок свободен.
+ */
+void isolate_free_block(struct page* page);
+void putback_isolated_block(struct page* page, bool reported);
+
+/* Обнулённая страница: из пула узла, если он не пуст */
+struct page* alloc_zeroed_page(void);
+
+/*
+ * Пул обнулённых страниц. В простое ядро заранее обнуляет свободные
+ * страницы (невременными записями, не вытесняя кеш), и ошибка страницы
+ * получает готовую нулевую страницу без очистки 4 KiB на своём пути.
+ * Страницы пула считаются свободными и при нехватке памяти
+ * возвращаются в buddy.
+ */
+#define PREZERO_POOL_PAGES      256     /* Цель на узел: 1 MiB */
+#define PREZERO_BATCH_PAGES     16      /* Страниц за один проход простоя */
+
+struct prezero_stats {
+    uint64_t hits;                  /* alloc_zeroed_page взял страницу из пула */
+    uint64_t misses;                /* Пул пуст: очистка на пути выделения */
+    uint64_t zeroed;                /* Страниц обнулено в простое */
+    uint64_t drained;               /* Возвращено в buddy при нехватке памяти */
+};
+
+extern struct prezero_stats prezero_stats;
+
+/*
+ * Обнуление до nr свободных страниц в пулы узлов (из цикла простоя).
+ * Возвращает число обнулённых страниц: 0 - пулы полны.
+ */
+unsigned int prezero_pages(unsigned int nr);
+
+/* Счётчик ссылок: страница освобождается при достижении нуля */
+static inline void get_page(struct page* page) {
+    page->refcount++;
+}
+
+void put_page(struct page* page);
+
+/* Суммы по всем узлам */
+uint64_t pmm_free_pages(void);
+uint64_t pmm_total_pages(void);
+
+#endif /* MIXOS_MM_PMM_H */
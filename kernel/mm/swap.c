@@ -0,0 +1,328 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/swap.c
+ * Слоты swap и вытеснение анонимных страниц
+ * ============================================================================
+ */
+
+#include "mm/swap.h"
+#include "mm/huge_mm.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/* Предел счётчика ссылок слота (uint16_t) */
+#define SWAP_MAP_MAX        0xFFFF
+
+/*
+ * Пороги вытеснения в долях всей памяти. Ниже low фоновое вытеснение
+ * начинается и идёт до high. Ниже min вытесняет сам отказ страницы:
+ * сжатию в zram тоже нужна память, и ждать её полного исчерпания нельзя.
+ */
+#define SWAP_WMARK_MIN_SHIFT    7   /* 1/128 */
+#define SWAP_WMARK_LOW_SHIFT    5   /* 1/32 */
+#define SWAP_WMARK_HIGH_SHIFT   4   /* 1/16 */
+
+struct swap_stats swap_stats;
+
+static struct {
+    struct block_device* bdev;
+    uint64_t nr_slots;
+    uint64_t inuse;
+    uint64_t next;                  /* Отсюда ищется свободный слот */
+    uint16_t* map;                  /* Число записей PTE на слот (0 - свободен) */
+} swap_info;
+
+static struct list_head mm_list = LIST_HEAD_INIT(mm_list);
+
+/* Позиция обхода: mm и адрес внутри него */
+static struct {
+    struct mm_struct* mm;
+    uint64_t address;
+} swap_cursor;
+
+int swapon(struct block_device* bdev) {
+    uint64_t nr_slots = bdev->nr_sectors / SECTORS_PER_PAGE;
+    if (swap_info.bdev) {
+        return -EBUSY;
+    }
+    if (nr_slots == 0) {
+        return -EINVAL;
+    }
+    swap_info.map = kzalloc(nr_slots * sizeof(uint16_t));
+    if (!swap_info.map) {
+        return -ENOMEM;
+    }
+    swap_info.bdev = bdev;
+    swap_info.nr_slots = nr_slots;
+    swap_info.inuse = 0;
+    swap_info.next = 0;
+    return 0;
+}
+
+uint64_t total_swap_pages(void) {
+    return swap_info.nr_slots;
+}
+
+uint64_t nr_free_swap_pages(void) {
+    return swap_info.nr_slots - swap_info.inuse;
+}
+
+/* ============================================================================
+ * Слоты
+ * ============================================================================ */
+
+static bool get_swap_slot(uint64_t* slot) {
+    if (swap_info.inuse == swap_info.nr_slots) {
+        return false;
+    }
+    /* Подряд идущие вытеснения получают подряд идущие слоты */
+    for (uint64_t i = 0; i < swap_info.nr_slots; i++) {
+        uint64_t s = (swap_info.next + i) % swap_info.nr_slots;
+        if (swap_info.map[s] == 0) {
+            swap_info.map[s] = 1;
+            swap_info.inuse++;
+            swap_info.next = s + 1;
+            *slot = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+int swap_duplicate(uint64_t slot) {
+    if (swap_info.map[slot] == SWAP_MAP_MAX) {
+        return -ENOMEM;
+    }
+    swap_info.map[slot]++;
+    return 0;
+}
+
+void swap_free(uint64_t slot) {
+    if (swap_info.map[slot] == 0) {
+        panic("swap_free: slot is not in use");
+    }
+    if (--swap_info.map[slot] == 0) {
+        swap_info.inuse--;
+        /* zram сразу отдаёт память сжатой копии */
+        block_discard(swap_info.bdev, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE);
+    }
+}
+
+int swap_readpage(uint64_t slot, struct page* page) {
+    int err = block_read(swap_info.bdev, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE,
+                         page_address(page));
+    if (err == 0) {
+        swap_stats.swapin++;
+    }
+    return err;
+}
+
+/* ============================================================================
+ * Список адресных пространств
+ * ============================================================================ */
+
+void mmlist_add(struct mm_struct* mm) {
+    list_add_tail(&mm->mmlist, &mm_list);
+}
+
+struct mm_struct* mmlist_next(struct mm_struct* mm) {
+    struct list_head* next = mm ? mm->mmlist.next : mm_list.next;
+    if (next == &mm_list) {
+        return NULL;
+    }
+    return list_entry(next, struct mm_struct, mmlist);
+}
+
+void mmlist_del(struct mm_struct* mm) {
+    if (swap_cursor.mm == mm) {
+        swap_cursor.mm = mmlist_next(mm);
+        swap_cursor.address = 0;
+    }
+    list_del(&mm->mmlist);
+}
+
+/* ============================================================================
+ * Вытеснение
+ * ============================================================================ */
+
+/* Страница, снятая с отображения и ждущая записи в swap */
+struct swap_candidate {
+    pte_t* pte;
+    pte_t orig;
+    struct page* page;
+    uint64_t slot;
+};
+
+struct swap_batch {
+    struct mm_struct* mm;
+    uint64_t start;
+    uint64_t end;
+    uint32_t nr;
+    struct swap_candidate pages[SWAP_CLUSTER_MAX];
+};
+
+/*
+ * Запись накопленных страниц. Записи PTE уже указывают на слоты, и после
+ * сброса TLB страницу никто не изменит; при ошибке записи отображение
+ * возвращается.
+ */
+static uint64_t swap_batch_flush(struct swap_batch* batch) {
+    uint64_t freed = 0;
+
+    if (batch->nr == 0) {
+        return 0;
+    }
+    flush_tlb_range(batch->mm, batch->start, batch->end);
+    for (uint32_t i = 0; i < batch->nr; i++) {
+        struct swap_candidate* c = &batch->pages[i];
+        int err = block_write(swap_info.bdev, c->slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE,
+                              page_address(c->page));
+        if (err < 0) {
+            *c->pte = c->orig;
+            swap_free(c->slot);
+            swap_stats.swapout_fail++;
+            continue;
+        }
+        batch->mm->anon_pages--;
+        batch->mm->swap_pages++;
+        put_page(c->page);
+        swap_stats.swapout++;
+        freed++;
+    }
+    batch->nr = 0;
+    batch->start = UINT64_MAX;
+    batch->end = 0;
+    return freed;
+}
+
+/*
+ * Обход записей PTE [addr, end) одной таблицы. false - слоты кончились
+ * или набрано nr страниц (тогда *addr - где продолжить).
+ */
+static bool swap_scan_ptes(struct swap_batch* batch, pte_t* pmd, uint64_t* addr, uint64_t end,
+                           uint64_t nr, uint64_t* freed) {
+    pte_t* pte = pte_table(*pmd) + pte_index(*addr);
+
+    for (; *addr < end; *addr += PAGE_SIZE, pte++) {
+        if (*freed + batch->nr >= nr) {
+            return false;
+        }
+        if (!pte_present(*pte)) {
+            continue;
+        }
+        swap_stats.pages_scanned++;
+        struct page* page = pte_page(*pte);
+        if (!page_anon(page) || page->refcount != 1) {
+            continue;
+        }
+        if (*pte & _PAGE_ACCESSED) {
+            /* Второй шанс: обращение с прошлого прохода */
+            *pte &= ~_PAGE_ACCESSED;
+            continue;
+        }
+
+        uint64_t slot;
+        if (!get_swap_slot(&slot)) {
+            return false;
+        }
+        struct swap_candidate* c = &batch->pages[batch->nr++];
+        c->pte = pte;
+        c->orig = *pte;
+        c->page = page;
+        c->slot = slot;
+        *pte = swp_entry_to_pte(slot);
+        batch->start = MIN(batch->start, *addr);
+        batch->end = MAX(batch->end, *addr + PAGE_SIZE);
+        if (batch->nr == SWAP_CLUSTER_MAX) {
+            *freed += swap_batch_flush(batch);
+        }
+    }
+    return true;
+}
+
+/* Обход mm с позиции курсора; true - mm просмотрен до конца */
+static bool swap_scan_mm(struct mm_struct* mm, uint64_t nr, uint64_t* freed) {
+    struct swap_batch batch = { .mm = mm, .start = UINT64_MAX };
+    struct vm_area_struct* vma = find_vma(mm, swap_cursor.address);
+    bool done = true;
+
+    for (; vma && done; vma = vma->list.next == &mm->vmas ? NULL
+                    : list_entry(vma->list.next, struct vm_area_struct, list)) {
+        if (vma->flags & VM_SHARED) {
+            continue;
+        }
+        uint64_t addr = MAX(vma->start, swap_cursor.address);
+        while (addr < vma->end) {
+            uint64_t pmd_end = MIN(ALIGN_DOWN(addr, HPAGE_SIZE) + HPAGE_SIZE, vma->end);
+            pte_t* pmd = pmd_offset(mm, addr, false);
+            if (!pmd || !pte_present(*pmd)) {
+                addr = pmd_end;
+                continue;
+            }
+            if (pmd_huge(*pmd)) {
+                struct page* head = pte_page(*pmd);
+                if (*pmd & _PAGE_ACCESSED) {
+                    *pmd &= ~_PAGE_ACCESSED;
+                    addr = pmd_end;
+                    continue;
+                }
+                if (head->refcount != 1 || split_huge_pmd(mm, pmd, addr) < 0) {
+                    addr = pmd_end;
+                    continue;
+                }
+                swap_stats.huge_split++;
+            }
+            if (!swap_scan_ptes(&batch, pmd, &addr, pmd_end, nr, freed)) {
+                done = false;
+                break;
+            }
+        }
+        swap_cursor.address = addr;
+    }
+    *freed += swap_batch_flush(&batch);
+    return done;
+}
+
+uint64_t try_to_free_pages(uint64_t nr) {
+    uint64_t freed = 0;
+    uint32_t passes = 0;
+
+    if (!swap_info.bdev || list_empty(&mm_list)) {
+        return 0;
+    }
+    /* Два полных прохода: первый мог только снять биты Accessed */
+    while (freed < nr && passes < 2 && nr_free_swap_pages() > 0) {
+        if (!swap_cursor.mm) {
+            swap_cursor.mm = list_first_entry(&mm_list, struct mm_struct, mmlist);
+            swap_cursor.address = 0;
+        }
+        struct mm_struct* mm = swap_cursor.mm;
+        if (swap_scan_mm(mm, nr, &freed)) {
+            swap_cursor.mm = mmlist_next(mm);
+            swap_cursor.address = 0;
+            if (!swap_cursor.mm) {
+                passes++;
+            }
+        }
+    }
+    return freed;
+}
+
+void reclaim_direct(void) {
+    if (swap_info.bdev && pmm_free_pages() < pmm_total_pages() >> SWAP_WMARK_MIN_SHIFT) {
+        try_to_free_pages(SWAP_CLUSTER_MAX);
+    }
+}
+
+void kswapd_balance(void) {
+    uint64_t total = pmm_total_pages();
+
+    if (!swap_info.bdev || pmm_free_pages() >= total >> SWAP_WMARK_LOW_SHIFT) {
+        return;
+    }
+    while (pmm_free_pages() < total >> SWAP_WMARK_HIGH_SHIFT) {
+        if (try_to_free_pages(SWAP_CLUSTER_MAX) == 0) {
+            break;
+        }
+    }
+}
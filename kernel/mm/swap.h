@@ -0,0 +1,68 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/swap.h
+ * Вытеснение анонимной памяти в swap
+ *
+ * Устройство swap (обычно zram) делится на слоты по странице. Вытесненная
+ * страница оставляет в PTE номер слота (is_swap_pte), отказ по такой
+ * записи читает страницу обратно. fork копирует запись и увеличивает
+ * счётчик ссылок слота; слот освобождается вместе с последней записью.
+ *
+ * Кандидатов ищет обход всех адресных пространств по часовой стрелке:
+ * страница, к которой обращались с прошлого прохода (бит Accessed),
+ * получает второй шанс. Обратных отображений нет, поэтому вытесняются
+ * только анонимные страницы с единственным владельцем; большие страницы
+ * сначала расщепляются.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_SWAP_H
+#define MIXOS_MM_SWAP_H
+
+#include "mm/mm.h"
+#include "block/block.h"
+
+/* Сколько страниц вытесняется за одну порцию (один сброс TLB) */
+#define SWAP_CLUSTER_MAX    32
+
+struct swap_stats {
+    uint64_t swapout;               /* Страниц записано в swap */
+    uint64_t swapin;                /* Страниц прочитано при отказах */
+    uint64_t swapout_fail;          /* Запись не удалась (нет памяти под сжатие) */
+    uint64_t pages_scanned;         /* Записей PTE просмотрено обходом */
+    uint64_t huge_split;            /* Больших страниц расщеплено ради вытеснения */
+};
+
+extern struct swap_stats swap_stats;
+
+/* Устройство swap (одно); 0 или отрицательный код ошибки */
+int swapon(struct block_device* bdev);
+
+uint64_t total_swap_pages(void);
+uint64_t nr_free_swap_pages(void);
+
+/* Адресное пространство участвует (не участвует) в обходе вытеснения */
+void mmlist_add(struct mm_struct* mm);
+void mmlist_del(struct mm_struct* mm);
+
+/* Первое адресное пространство (mm NULL) или следующее за mm; NULL в конце */
+struct mm_struct* mmlist_next(struct mm_struct* mm);
+
+/* Ещё одна запись PTE ссылается на слот */
+int swap_duplicate(uint64_t slot);
+
+/* Запись PTE, ссылавшаяся на слот, снята */
+void swap_free(uint64_t slot);
+
+int swap_readpage(uint64_t slot, struct page* page);
+
+/* Вытеснение до nr страниц; возвращает число освобождённых */
+uint64_t try_to_free_pages(uint64_t nr);
+
+/* Вытеснение на пути отказа страницы, если свободной памяти почти нет */
+void reclaim_direct(void);
+
+/* Фоновое вытеснение из цикла простоя при нехватке свободной памяти */
+void kswapd_balance(void);
+
+#endif /* MIXOS_MM_SWAP_H */
@@ -0,0 +1,271 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/tlb.c
+ * Переключение адресных пространств и сброс TLB
+ * ============================================================================
+ */
+
+#include "mm/tlb.h"
+#include "mm/mm.h"
+#include "cpu/cpu.h"
+
+struct mm_struct* current_mm;
+struct tlb_stats tlb_stats;
+
+/* Дальше этого числа страниц invlpg по одной дороже перезагрузки CR3 */
+#define FLUSH_TLB_SINGLE_LIMIT  32
+
+/* Бит 63 CR3 при включённом PCID: не сбрасывать записи загружаемого PCID */
+#define X86_CR3_PCID_NOFLUSH    (1ULL << 63)
+
+/* Типы INVPCID */
+#define INVPCID_TYPE_INDIV_ADDR     0
+#define INVPCID_TYPE_SINGLE_CTXT    1
+
+/*
+ * Сколько адресных пространств одновременно держат свои записи в TLB.
+ * PCID 0 - таблицы ядра без процесса, процессам достаются 1..N.
+ */
+#define TLB_NR_DYN_ASIDS        6
+
+/* Состояние TLB процессора */
+struct tlb_state {
+    struct mm_struct* loaded_mm;    /* Чьи таблицы в CR3 (NULL - kernel_pgd) */
+    uint16_t loaded_asid;
+    bool is_lazy;                   /* Выполняется поток ядра, loaded_mm не нужен */
+    uint16_t next_asid;             /* Следующий вытесняемый слот */
+    struct {
+        uint64_t ctx_id;            /* Чей PCID (0 - слот пуст) */
+        uint64_t tlb_gen;           /* Поколение, до которого записи актуальны */
+    } ctxs[TLB_NR_DYN_ASIDS];
+};
+
+static struct tlb_state cpu_tlbstate[NR_CPUS];
+
+static bool pcid_enabled;
+static bool invpcid_enabled;
+static uint64_t last_ctx_id;
+
+static inline struct tlb_state* this_tlbstate(void) {
+    return &cpu_tlbstate[smp_processor_id()];
+}
+
+uint64_t read_cr3(void) {
+    uint64_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    return cr3;
+}
+
+static inline void write_cr3(uint64_t cr3) {
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(cr3) : "memory");
+}
+
+static inline void invlpg(uint64_t addr) {
+    __asm__ volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+static inline void invpcid(uint64_t type, uint16_t pcid, uint64_t addr) {
+    struct { uint64_t pcid; uint64_t addr; } desc = { pcid, addr };
+    __asm__ volatile ("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
+static inline uint16_t asid_to_pcid(uint16_t asid) {
+    return asid + 1;
+}
+
+void tlb_init(void) {
+    /* Отображение ядра из boot.asm помечено глобальным */
+    if (cpu_has(X86_FEATURE_PGE)) {
+        write_cr4(read_cr4() | X86_CR4_PGE);
+    }
+    /* CR4.PCIDE включается только при нулевом PCID в CR3 (так после загрузки) */
+    if (cpu_has(X86_FEATURE_PCID)) {
+        write_cr4(read_cr4() | X86_CR4_PCIDE);
+        pcid_enabled = true;
+        invpcid_enabled = cpu_has(X86_FEATURE_INVPCID);
+    }
+}
+
+void init_new_context(struct mm_struct* mm) {
+    mm->context.ctx_id = ++last_ctx_id;
+    mm->context.tlb_gen = 0;
+    mm->context.cpu_mask = 0;
+}
+
+/*
+ * Прерывание сброса TLB процессору cpu; его обработчик - flush_tlb_func.
+ * Вторичные процессоры пока не запускаются (NR_CPUS 1), и других
+ * процессоров в cpu_mask не бывает.
+ */
+static void send_tlb_ipi(uint32_t cpu) {
+    (void)cpu;
+    panic("send_tlb_ipi: no secondary CPUs");
+}
+
+/* Слот кеша, в котором записи mm ещё могут лежать в TLB, или -1 */
+static int find_asid(struct tlb_state* st, struct mm_struct* mm) {
+    for (int asid = 0; asid < TLB_NR_DYN_ASIDS; asid++) {
+        if (st->ctxs[asid].ctx_id == mm->context.ctx_id) {
+            return asid;
+        }
+    }
+    return -1;
+}
+
+/* Загрузка таблиц mm в CR3 со сбросом, только если записи его PCID устарели */
+static void load_new_mm_cr3(struct tlb_state* st, struct mm_struct* next) {
+    if (!pcid_enabled) {
+        st->loaded_asid = 0;
+        st->ctxs[0].ctx_id = next->context.ctx_id;
+        st->ctxs[0].tlb_gen = next->context.tlb_gen;
+        write_cr3(virt_to_phys(next->pgd));
+        return;
+    }
+
+    bool need_flush;
+    int asid = find_asid(st, next);
+    if (asid >= 0) {
+        need_flush = st->ctxs[asid].tlb_gen != next->context.tlb_gen;
+    } else {
+        /* Вытесняем самый давний слот: его записи чужие и сбрасываются */
+        asid = st->next_asid;
+        st->next_asid = (st->next_asid + 1) % TLB_NR_DYN_ASIDS;
+        st->ctxs[asid].ctx_id = next->context.ctx_id;
+        need_flush = true;
+    }
+    st->loaded_asid = (uint16_t)asid;
+    st->ctxs[asid].tlb_gen = next->context.tlb_gen;
+
+    uint64_t cr3 = virt_to_phys(next->pgd) | asid_to_pcid((uint16_t)asid);
+    write_cr3(need_flush ? cr3 : cr3 | X86_CR3_PCID_NOFLUSH);
+}
+
+/* Сброс всех записей загруженного mm, пропущенных с прошлого сброса */
+static void flush_tlb_func(struct tlb_state* st) {
+    struct mm_struct* mm = st->loaded_mm;
+    if (!mm || st->is_lazy || st->ctxs[st->loaded_asid].tlb_gen == mm->context.tlb_gen) {
+        return;
+    }
+    /* CR3 без бита NOFLUSH сбрасывает только записи текущего PCID */
+    write_cr3(read_cr3());
+    st->ctxs[st->loaded_asid].tlb_gen = mm->context.tlb_gen;
+    tlb_stats.flush_local++;
+    tlb_stats.flush_local_full++;
+}
+
+void switch_mm(struct mm_struct* next) {
+    struct tlb_state* st = this_tlbstate();
+    struct mm_struct* prev = st->loaded_mm;
+    uint64_t cpu_bit = 1ULL << smp_processor_id();
+
+    current_mm = next;
+    if (!next) {
+        /* Поток ядра: таблицы prev остаются в CR3, сбросы для них откладываются */
+        st->is_lazy = prev != NULL;
+        return;
+    }
+    st->is_lazy = false;
+    if (next == prev) {
+        /* Возврат из ленивого режима: догоняем сбросы, пропущенные за это время */
+        flush_tlb_func(st);
+        return;
+    }
+
+    if (prev) {
+        prev->context.cpu_mask &= ~cpu_bit;
+    }
+    next->context.cpu_mask |= cpu_bit;
+    st->loaded_mm = next;
+    load_new_mm_cr3(st, next);
+}
+
+void destroy_context(struct mm_struct* mm) {
+    uint32_t cpu = smp_processor_id();
+    struct tlb_state* st = this_tlbstate();
+
+    if (st->loaded_mm == mm) {
+        /* mm держался только лениво: переходим на таблицы ядра */
+        uint64_t cr3 = virt_to_phys(kernel_pgd);
+        write_cr3(pcid_enabled ? cr3 | X86_CR3_PCID_NOFLUSH : cr3);
+        st->loaded_mm = NULL;
+        st->is_lazy = false;
+        mm->context.cpu_mask &= ~(1ULL << cpu);
+    }
+    for (uint32_t other = 0; other < NR_CPUS; other++) {
+        if (other != cpu && (mm->context.cpu_mask & (1ULL << other))) {
+            send_tlb_ipi(other);
+        }
+    }
+}
+
+/* Сброс на своём процессоре для загруженного mm */
+static void flush_tlb_local(struct tlb_state* st, uint64_t start, uint64_t end,
+                            uint64_t new_gen) {
+    uint64_t* gen = &st->ctxs[st->loaded_asid].tlb_gen;
+    tlb_stats.flush_local++;
+
+    /* Пропущены и другие сбросы: точечного invlpg мало */
+    if (*gen + 1 != new_gen || (end - start) >> PAGE_SHIFT > FLUSH_TLB_SINGLE_LIMIT) {
+        write_cr3(read_cr3());
+        tlb_stats.flush_local_full++;
+    } else {
+        for (uint64_t addr = start; addr < end; addr += PAGE_SIZE) {
+            invlpg(addr);
+        }
+    }
+    *gen = new_gen;
+}
+
+/*
+ * Сброс записей mm, не загруженного в CR3 этого процессора, но ещё
+ * держащего PCID в кеше. Без INVPCID они сбросятся при загрузке mm.
+ */
+static void flush_tlb_cached(struct tlb_state* st, struct mm_struct* mm, uint64_t start,
+                             uint64_t end, uint64_t new_gen) {
+    if (!pcid_enabled || !invpcid_enabled) {
+        return;
+    }
+    int asid = find_asid(st, mm);
+    if (asid < 0) {
+        return;
+    }
+    uint16_t pcid = asid_to_pcid((uint16_t)asid);
+    tlb_stats.flush_local++;
+    if (st->ctxs[asid].tlb_gen + 1 != new_gen ||
+        (end - start) >> PAGE_SHIFT > FLUSH_TLB_SINGLE_LIMIT) {
+        invpcid(INVPCID_TYPE_SINGLE_CTXT, pcid, 0);
+        tlb_stats.flush_local_full++;
+    } else {
+        for (uint64_t addr = start; addr < end; addr += PAGE_SIZE) {
+            invpcid(INVPCID_TYPE_INDIV_ADDR, pcid, addr);
+        }
+    }
+    st->ctxs[asid].tlb_gen = new_gen;
+}
+
+void flush_tlb_mm_range(struct mm_struct* mm, uint64_t start, uint64_t end) {
+    uint32_t cpu = smp_processor_id();
+    struct tlb_state* st = this_tlbstate();
+    uint64_t new_gen = ++mm->context.tlb_gen;
+
+    if (st->loaded_mm != mm) {
+        flush_tlb_cached(st, mm, start, end, new_gen);
+    } else if (st->is_lazy) {
+        tlb_stats.shootdown_lazy_skipped++;
+    } else {
+        flush_tlb_local(st, start, end, new_gen);
+    }
+
+    /* Другим процессорам - по одному прерыванию на операцию */
+    for (uint32_t other = 0; other < NR_CPUS; other++) {
+        if (other == cpu || !(mm->context.cpu_mask & (1ULL << other))) {
+            continue;
+        }
+        if (cpu_tlbstate[other].is_lazy) {
+            tlb_stats.shootdown_lazy_skipped++;
+            continue;
+        }
+        tlb_stats.shootdown++;
+        send_tlb_ipi(other);
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/tlb.h
+ * Переключение адресных пространств и сброс TLB
+ *
+ * Если процессор поддерживает PCID, записи TLB помечены номером
+ * адресного пространства, и переключение CR3 их не сбрасывает. Номера
+ * раздаются недавно работавшим mm из небольшого кеша процессора.
+ *
+ * Каждый сброс увеличивает поколение TLB адресного пространства, а
+ * процессор помнит, до какого поколения его записи актуальны. Процессор,
+ * на котором mm не выполняется (или выполняется поток ядра - ленивый
+ * режим TLB), сбрасывается не сразу, а при следующей загрузке mm, если
+ * поколение успело смениться. Сразу сбрасываются только процессоры,
+ * активно выполняющие mm (межпроцессорное прерывание - shootdown).
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_TLB_H
+#define MIXOS_MM_TLB_H
+
+#include "mm/pmm.h"
+
+struct mm_struct;
+
+/* Контекст TLB адресного пространства */
+struct mm_context {
+    uint64_t ctx_id;                /* Уникален за всё время работы, не переиспользуется */
+    uint64_t tlb_gen;               /* Растёт при каждом сбросе */
+    uint64_t cpu_mask;              /* Процессоры, в CR3 которых загружены таблицы mm */
+};
+
+/* Счётчики сбросов TLB */
+struct tlb_stats {
+    uint64_t flush_local;           /* Сбросы на своём процессоре */
+    uint64_t flush_local_full;      /* Из них перезагрузкой всего PCID */
+    uint64_t shootdown;             /* Прерывания другим процессорам */
+    uint64_t shootdown_lazy_skipped; /* Процессоров пропущено: ленивый режим */
+    uint64_t gather_flushes;        /* Сбросов по накопленным mmu_gather */
+    uint64_t gather_pages;          /* Страниц освобождено через mmu_gather */
+};
+
+extern struct tlb_stats tlb_stats;
+
+/* Адресное пространство выполняемой задачи (NULL - поток ядра) */
+extern struct mm_struct* current_mm;
+
+/* Физический адрес таблицы PML4, с которой загрузилось ядро */
+uint64_t read_cr3(void);
+
+/* Включение глобальных страниц и PCID, если процессор их поддерживает */
+void tlb_init(void);
+
+void init_new_context(struct mm_struct* mm);
+
+/* Перед освобождением таблиц: ни один процессор не должен держать их в CR3 */
+void destroy_context(struct mm_struct* mm);
+
+/*
+ * Переход к задаче с адресным пространством next. NULL (поток ядра,
+ * простой) оставляет в CR3 таблицы прежнего mm в ленивом режиме: их
+ * половина ядра та же, а возврат к тому же mm не перезагружает CR3.
+ */
+void switch_mm(struct mm_struct* next);
+
+/* Сброс записей TLB для страниц [start, end) mm на всех процессорах */
+void flush_tlb_mm_range(struct mm_struct* mm, uint64_t start, uint64_t end);
+
+static inline void flush_tlb_page(struct mm_struct* mm, uint64_t addr) {
+    flush_tlb_mm_range(mm, addr, addr + PAGE_SIZE);
+}
+
+static inline void flush_tlb_range(struct mm_struct* mm, uint64_t start, uint64_t end) {
+    flush_tlb_mm_range(mm, start, end);
+}
+
+static inline void flush_tlb_mm(struct mm_struct* mm) {
+    flush_tlb_mm_range(mm, 0, UINT64_MAX);
+}
+
+/* ============================================================================
+ * Накопление сбросов (mm/mmu_gather.c)
+ *
+ * Снятие отображений копит диапазон адресов и страницы, теряющие
+ * последнюю ссылку, а TLB сбрасывается один раз на операцию. Страницы
+ * освобождаются только после сброса: до него другой процессор ещё может
+ * обратиться к ним через устаревшую запись TLB.
+ * ============================================================================ */
+
+struct mmu_gather {
+    struct mm_struct* mm;
+    uint64_t start;                 /* Накопленный диапазон сброса */
+    uint64_t end;
+    bool fullmm;                    /* Разбирается всё адресное пространство */
+    struct list_head pages;         /* Страницы к освобождению (через page->lru) */
+};
+
+void tlb_gather_mmu(struct mmu_gather* tlb, struct mm_struct* mm, bool fullmm);
+
+/* Сброс накопленного диапазона и освобождение накопленных страниц */
+void tlb_finish_mmu(struct mmu_gather* tlb);
+
+/* Отображение [addr, addr + size) снято; ссылка на page снимается после сброса */
+void tlb_remove_page(struct mmu_gather* tlb, struct page* page, uint64_t addr, uint64_t size);
+
+#endif /* MIXOS_MM_TLB_H */
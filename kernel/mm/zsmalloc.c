@@ -0,0 +1,157 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/zsmalloc.c
+ * Аллокатор сжатых объектов: классы размеров и блоки zspage
+ * ============================================================================
+ */
+
+#include "mm/zsmalloc.h"
+#include "mm/kmalloc.h"
+
+/* Блок страниц, нарезанный на объекты одного класса */
+struct zspage {
+    struct list_head list;          /* В списке partial класса, пока не заполнен */
+    struct size_class* class;
+    struct page* first_page;
+    uint8_t order;
+    uint32_t nr_objs;
+    uint32_t inuse;
+    void* freelist;                 /* Свободный объект хранит указатель на следующий */
+};
+
+/* Порядок блока с наименьшей долей остатка для объектов size байт */
+static uint8_t zs_best_order(uint32_t size) {
+    uint8_t best = 0;
+    uint64_t best_used = 0;
+    uint64_t best_total = 1;
+
+    for (uint8_t order = 0; order <= ZS_MAX_ZSPAGE_ORDER; order++) {
+        uint64_t total = PAGE_SIZE << order;
+        uint64_t used = total / size * size;
+        /* used / total > best_used / best_total */
+        if (used * best_total > best_used * total) {
+            best = order;
+            best_used = used;
+            best_total = total;
+        }
+    }
+    return best;
+}
+
+struct zs_pool* zs_create_pool(void) {
+    struct zs_pool* pool = kzalloc(sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < ZS_NR_CLASSES; i++) {
+        struct size_class* class = &pool->classes[i];
+        class->size = (i + 1) * ZS_SIZE_CLASS_DELTA;
+        class->order = zs_best_order(class->size);
+        list_init(&class->partial);
+    }
+    return pool;
+}
+
+static void free_zspage(struct zs_pool* pool, struct zspage* zspage) {
+    list_del(&zspage->list);
+    pool->pages_allocated -= 1UL << zspage->order;
+    free_pages(zspage->first_page, zspage->order);
+    kfree(zspage);
+}
+
+/* Освобождаются только пустые блоки: объекты к этому моменту сняты */
+void zs_destroy_pool(struct zs_pool* pool) {
+    for (uint32_t i = 0; i < ZS_NR_CLASSES; i++) {
+        struct list_head* pos;
+        struct list_head* tmp;
+        list_for_each_safe(pos, tmp, &pool->classes[i].partial) {
+            free_zspage(pool, list_entry(pos, struct zspage, list));
+        }
+    }
+    kfree(pool);
+}
+
+static struct zspage* alloc_zspage(struct zs_pool* pool, struct size_class* class) {
+    struct zspage* zspage = kmalloc(sizeof(*zspage));
+    if (!zspage) {
+        return NULL;
+    }
+
+    /* Без непрерывного блока класс довольствуется одной страницей */
+    uint8_t order = class->order;
+    struct page* page = alloc_pages(order);
+    if (!page && order > 0) {
+        order = 0;
+        page = alloc_pages(0);
+    }
+    if (!page) {
+        kfree(zspage);
+        return NULL;
+    }
+
+    zspage->class = class;
+    zspage->first_page = page;
+    zspage->order = order;
+    zspage->nr_objs = (uint32_t)((PAGE_SIZE << order) / class->size);
+    zspage->inuse = 0;
+    zspage->freelist = NULL;
+
+    /* По страницам блока находится его zspage при освобождении объекта */
+    for (uint32_t i = 0; i < (1U << order); i++) {
+        page[i].private = (uint64_t)(uintptr_t)zspage;
+    }
+    uint8_t* base = page_address(page);
+    for (uint32_t i = zspage->nr_objs; i-- > 0;) {
+        void** object = (void**)(base + (size_t)i * class->size);
+        *object = zspage->freelist;
+        zspage->freelist = object;
+    }
+
+    list_add(&zspage->list, &class->partial);
+    pool->pages_allocated += 1UL << order;
+    return zspage;
+}
+
+uint64_t zs_malloc(struct zs_pool* pool, size_t size) {
+    if (size == 0 || size > ZS_MAX_ALLOC_SIZE) {
+        return 0;
+    }
+    size_t index = DIV_ROUND_UP(MAX(size, (size_t)ZS_MIN_ALLOC_SIZE), ZS_SIZE_CLASS_DELTA) - 1;
+    struct size_class* class = &pool->classes[index];
+
+    struct zspage* zspage;
+    if (list_empty(&class->partial)) {
+        zspage = alloc_zspage(pool, class);
+        if (!zspage) {
+            return 0;
+        }
+    } else {
+        zspage = list_first_entry(&class->partial, struct zspage, list);
+    }
+
+    void** object = zspage->freelist;
+    zspage->freelist = *object;
+    if (++zspage->inuse == zspage->nr_objs) {
+        list_del(&zspage->list);
+        list_init(&zspage->list);
+    }
+    class->objs_allocated++;
+    return (uint64_t)(uintptr_t)object;
+}
+
+void zs_free(struct zs_pool* pool, uint64_t handle) {
+    void** object = zs_map_object(handle);
+    struct zspage* zspage = (struct zspage*)(uintptr_t)virt_to_page(object)->private;
+    struct size_class* class = zspage->class;
+
+    if (zspage->inuse == zspage->nr_objs) {
+        list_add(&zspage->list, &class->partial);
+    }
+    *object = zspage->freelist;
+    zspage->freelist = object;
+    class->objs_allocated--;
+
+    if (--zspage->inuse == 0) {
+        free_zspage(pool, zspage);
+    }
+}
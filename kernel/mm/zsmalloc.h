@@ -0,0 +1,52 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/mm/zsmalloc.h
+ * Аллокатор сжатых объектов по классам размеров
+ *
+ * Сжатые страницы имеют произвольный размер до PAGE_SIZE, и kmalloc с
+ * классами-степенями двойки терял бы на них до половины памяти. Здесь
+ * классы идут с шагом ZS_SIZE_CLASS_DELTA, а объекты класса плотно
+ * нарезаются из блока в 1-4 страницы (zspage), подобранного так, чтобы
+ * остаток был наименьшим. Объект может пересекать границу страниц
+ * блока: блок непрерывен в прямом отображении.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_MM_ZSMALLOC_H
+#define MIXOS_MM_ZSMALLOC_H
+
+#include "kernel.h"
+#include "lib/list.h"
+#include "mm/pmm.h"
+
+#define ZS_MIN_ALLOC_SIZE       32
+#define ZS_SIZE_CLASS_DELTA     32
+#define ZS_MAX_ALLOC_SIZE       PAGE_SIZE
+#define ZS_NR_CLASSES           (ZS_MAX_ALLOC_SIZE / ZS_SIZE_CLASS_DELTA)
+#define ZS_MAX_ZSPAGE_ORDER     2
+
+struct size_class {
+    uint32_t size;                  /* Размер объекта класса */
+    uint8_t order;                  /* Порядок блока zspage */
+    struct list_head partial;       /* zspage со свободными объектами */
+    uint64_t objs_allocated;
+};
+
+struct zs_pool {
+    struct size_class classes[ZS_NR_CLASSES];
+    uint64_t pages_allocated;       /* Страниц под zspage */
+};
+
+struct zs_pool* zs_create_pool(void);
+void zs_destroy_pool(struct zs_pool* pool);
+
+/* Объект size байт (1..ZS_MAX_ALLOC_SIZE); 0 - нет памяти */
+uint64_t zs_malloc(struct zs_pool* pool, size_t size);
+void zs_free(struct zs_pool* pool, uint64_t handle);
+
+/* Данные объекта (блоки лежат в прямом отображении) */
+static inline void* zs_map_object(uint64_t handle) {
+    return (void*)(uintptr_t)handle;
+}
+
+#endif /* MIXOS_MM_ZSMALLOC_H */
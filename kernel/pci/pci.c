@@ -0,0 +1,81 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/pci/pci.c
+ * Шина PCI: конфигурационное пространство и поиск устройств
+ * ============================================================================
+ */
+
+#include "pci/pci.h"
+#include "cpu/io.h"
+#include "errno.h"
+
+#define PCI_CONFIG_ADDRESS      0xCF8
+#define PCI_CONFIG_DATA         0xCFC
+
+#define PCI_MAX_BUS             256
+#define PCI_MAX_SLOT            32
+#define PCI_MAX_FUNC            8
+
+static void pci_select(const struct pci_dev* dev, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000U | ((uint32_t)dev->bus << 16) |
+                             ((uint32_t)dev->slot << 11) | ((uint32_t)dev->func << 8) |
+                             (offset & 0xFC));
+}
+
+uint32_t pci_read_config32(const struct pci_dev* dev, uint8_t offset) {
+    pci_select(dev, offset);
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_read_config16(const struct pci_dev* dev, uint8_t offset) {
+    pci_select(dev, offset);
+    return inw(PCI_CONFIG_DATA + (offset & 2));
+}
+
+uint8_t pci_read_config8(const struct pci_dev* dev, uint8_t offset) {
+    pci_select(dev, offset);
+    return inb(PCI_CONFIG_DATA + (offset & 3));
+}
+
+void pci_write_config16(const struct pci_dev* dev, uint8_t offset, uint16_t value) {
+    pci_select(dev, offset);
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+int pci_find_device(uint16_t vendor, uint16_t device, struct pci_dev* dev) {
+    for (uint32_t bus = 0; bus < PCI_MAX_BUS; bus++) {
+        for (uint32_t slot = 0; slot < PCI_MAX_SLOT; slot++) {
+            struct pci_dev probe = { (uint8_t)bus, (uint8_t)slot, 0, 0, 0 };
+            if (pci_read_config16(&probe, PCI_VENDOR_ID) == 0xFFFF) {
+                continue;
+            }
+            /* Функции 1-7 есть только у многофункциональных устройств */
+            uint32_t nr_func = (pci_read_config8(&probe, PCI_HEADER_TYPE) & PCI_HEADER_MULTIFUNC)
+                               ? PCI_MAX_FUNC : 1;
+            for (uint32_t func = 0; func < nr_func; func++) {
+                probe.func = (uint8_t)func;
+                probe.vendor = pci_read_config16(&probe, PCI_VENDOR_ID);
+                probe.device = pci_read_config16(&probe, PCI_DEVICE_ID);
+                if (probe.vendor == vendor && probe.device == device) {
+                    *dev = probe;
+                    return 0;
+                }
+            }
+        }
+    }
+    return -ENODEV;
+}
+
+void pci_enable_device(const struct pci_dev* dev) {
+    uint16_t cmd = pci_read_config16(dev, PCI_COMMAND);
+    pci_write_config16(dev, PCI_COMMAND,
+                       cmd | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+}
+
+uint16_t pci_resource_io(const struct pci_dev* dev, uint32_t bar) {
+    uint32_t value = pci_read_config32(dev, (uint8_t)(PCI_BASE_ADDRESS_0 + bar * 4));
+    if (!(value & PCI_BASE_ADDRESS_SPACE_IO)) {
+        return 0;
+    }
+    return (uint16_t)(value & PCI_BASE_ADDRESS_IO_MASK);
+}
@@ -0,0 +1,55 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/pci/pci.h
+ * Шина PCI: конфигурационное пространство и поиск устройств
+ *
+ * Доступ к конфигурационному пространству - механизмом №1 через порты
+ * 0xCF8/0xCFC (есть на всех PC и во всех гипервизорах). Шины
+ * перебираются целиком, без разбора мостов.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_PCI_PCI_H
+#define MIXOS_PCI_PCI_H
+
+#include "kernel.h"
+
+/* Смещения заголовка конфигурационного пространства */
+#define PCI_VENDOR_ID           0x00
+#define PCI_DEVICE_ID           0x02
+#define PCI_COMMAND             0x04
+#define PCI_HEADER_TYPE         0x0E
+#define PCI_BASE_ADDRESS_0      0x10
+
+/* Биты PCI_COMMAND */
+#define PCI_COMMAND_IO          (1U << 0)
+#define PCI_COMMAND_MEMORY      (1U << 1)
+#define PCI_COMMAND_MASTER      (1U << 2)
+
+#define PCI_HEADER_MULTIFUNC    0x80
+#define PCI_BASE_ADDRESS_SPACE_IO   0x01
+#define PCI_BASE_ADDRESS_IO_MASK    (~0x03U)
+
+struct pci_dev {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint16_t vendor;
+    uint16_t device;
+};
+
+uint8_t pci_read_config8(const struct pci_dev* dev, uint8_t offset);
+uint16_t pci_read_config16(const struct pci_dev* dev, uint8_t offset);
+uint32_t pci_read_config32(const struct pci_dev* dev, uint8_t offset);
+void pci_write_config16(const struct pci_dev* dev, uint8_t offset, uint16_t value);
+
+/* Первое устройство с данными производителем и номером; 0 или -ENODEV */
+int pci_find_device(uint16_t vendor, uint16_t device, struct pci_dev* dev);
+
+/* Включение декодирования адресов BAR и захвата шины (DMA) */
+void pci_enable_device(const struct pci_dev* dev);
+
+/* Базовый порт BAR ввода-вывода или 0, если BAR описывает память */
+uint16_t pci_resource_io(const struct pci_dev* dev, uint32_t bar);
+
+#endif /* MIXOS_PCI_PCI_H */
@@ -0,0 +1,166 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/proc/task.c
+ * Процессы: создание (fork, vfork, spawn), запуск программы и завершение
+ *
+ * fork копирует только описание адресного пространства и таблицы
+ * страниц; сами страницы становятся общими до первой записи. vfork и
+ * spawn не копируют и этого: потомок vfork живёт в памяти родителя до
+ * exec, а spawn строит новое адресное пространство сразу из программы.
+ * ============================================================================
+ */
+
+#include "proc/task.h"
+#include "mm/tlb.h"
+#include "mm/kmalloc.h"
+#include "fs/exec.h"
+#include "errno.h"
+
+static struct task init_task;
+static int32_t last_pid;
+
+struct task* current = &init_task;
+
+void task_init(void) {
+    init_task.pid = 0;
+    init_task.state = TASK_RUNNING;
+    list_init(&init_task.children);
+    list_init(&init_task.sibling);
+    current = &init_task;
+}
+
+static struct task* task_alloc(struct task* parent) {
+    struct task* task = kzalloc(sizeof(*task));
+    if (!task) {
+        return NULL;
+    }
+    if (fpu_alloc(&task->fpu) < 0) {
+        kfree(task);
+        return NULL;
+    }
+    task->pid = ++last_pid;
+    task->state = TASK_RUNNING;
+    task->parent = parent;
+    list_init(&task->children);
+    list_add_tail(&task->sibling, &parent->children);
+    return task;
+}
+
+static void task_free(struct task* task) {
+    list_del(&task->sibling);
+    fpu_free(&task->fpu);
+    kfree(task);
+}
+
+/* Потомок vfork отпускает адресное пространство родителя */
+static void vfork_done(struct task* task) {
+    if (!task->in_vfork) {
+        return;
+    }
+    task->in_vfork = false;
+    if (task->parent->vfork_child == task) {
+        task->parent->vfork_child = NULL;
+    }
+}
+
+/* Новое адресное пространство задачи; старое отпускается */
+static void task_set_mm(struct task* task, struct mm_struct* mm) {
+    struct mm_struct* old = task->mm;
+    task->mm = mm;
+    if (task == current) {
+        switch_mm(mm);
+    }
+    vfork_done(task);
+    if (old) {
+        mmput(old);
+    }
+}
+
+int task_fork(struct task* parent, uint32_t clone_flags, struct task** out) {
+    struct task* child = task_alloc(parent);
+    if (!child) {
+        return -ENOMEM;
+    }
+
+    if (parent->mm) {
+        if (clone_flags & CLONE_VM) {
+            mmget(parent->mm);
+            child->mm = parent->mm;
+        } else {
+            child->mm = dup_mm(parent->mm);
+            if (!child->mm) {
+                task_free(child);
+                return -ENOMEM;
+            }
+        }
+    }
+    child->user_rip = parent->user_rip;
+    child->user_rsp = parent->user_rsp;
+    if (parent->fpu.state) {
+        fpu_copy(&child->fpu, &parent->fpu);
+    }
+
+    if (clone_flags & CLONE_VFORK) {
+        child->in_vfork = true;
+        parent->vfork_child = child;
+    }
+    *out = child;
+    return 0;
+}
+
+int task_exec(struct task* task, const char* path, const char* const* argv,
+              const char* const* envp) {
+    /* Поток ядра становится пользовательской задачей */
+    if (!task->fpu.state && fpu_alloc(&task->fpu) < 0) {
+        return -ENOMEM;
+    }
+
+    struct exec_image image;
+    int err = exec_load(path, argv, envp, &image);
+    if (err < 0) {
+        return err;
+    }
+    task->user_rip = image.entry;
+    task->user_rsp = image.stack;
+    fpu_reset(&task->fpu);
+    task_set_mm(task, image.mm);
+    return 0;
+}
+
+int task_spawn(struct task* parent, const char* path, const char* const* argv,
+               const char* const* envp, struct task** out) {
+    struct task* child = task_alloc(parent);
+    if (!child) {
+        return -ENOMEM;
+    }
+    int err = task_exec(child, path, argv, envp);
+    if (err < 0) {
+        task_free(child);
+        return err;
+    }
+    *out = child;
+    return 0;
+}
+
+void task_exit(struct task* task, int32_t code) {
+    task_set_mm(task, NULL);
+    fpu_free(&task->fpu);
+    task->exit_code = code;
+    task->state = TASK_ZOMBIE;
+
+    /* Потомки переходят к init_task */
+    while (!list_empty(&task->children)) {
+        struct task* child = list_first_entry(&task->children, struct task, sibling);
+        list_move_tail(&child->sibling, &init_task.children);
+        child->parent = &init_task;
+    }
+}
+
+int32_t task_reap(struct task* task) {
+    if (task->state != TASK_ZOMBIE) {
+        return -EBUSY;
+    }
+    int32_t code = task->exit_code;
+    task_free(task);
+    return code;
+}
@@ -0,0 +1,74 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/proc/task.h
+ * Процессы: создание (fork, vfork, spawn), запуск программы и завершение
+ *
+ * Планировщика пока нет: задача - владелец адресного пространства и
+ * точки входа в пользовательский режим, переключение на неё выполнит
+ * будущий планировщик (switch_mm + возврат в ring 3).
+ * ============================================================================
+ */
+
+#ifndef MIXOS_PROC_TASK_H
+#define MIXOS_PROC_TASK_H
+
+#include "mm/mm.h"
+#include "cpu/fpu.h"
+
+/* Состояние задачи */
+#define TASK_RUNNING    0
+#define TASK_ZOMBIE     1
+
+/* Флаги создания задачи (как у clone) */
+#define CLONE_VM        (1U << 0)   /* Общее адресное пространство с родителем */
+#define CLONE_VFORK     (1U << 1)   /* Родитель ждёт exec или exit потомка */
+
+struct task {
+    int32_t pid;
+    uint32_t state;
+    int32_t exit_code;
+    struct mm_struct* mm;           /* NULL - поток ядра */
+    struct task* parent;
+    struct list_head children;
+    struct list_head sibling;
+    struct task* vfork_child;       /* Потомок, занявший адресное пространство */
+    bool in_vfork;                  /* mm заимствован у родителя до exec/exit */
+    uint64_t user_rip;              /* Точка входа и стек после exec */
+    uint64_t user_rsp;
+    struct fpu fpu;                 /* У потока ядра state == NULL */
+};
+
+/* Выполняющаяся задача (init_task до запуска первого процесса) */
+extern struct task* current;
+
+void task_init(void);
+
+/*
+ * Новая задача - копия parent. Без CLONE_VM адресное пространство
+ * копируется (copy-on-write); с CLONE_VM оно общее, и с CLONE_VFORK
+ * родитель не может выполняться, пока потомок не вызовет exec или exit.
+ */
+int task_fork(struct task* parent, uint32_t clone_flags, struct task** out);
+
+/* Замена адресного пространства задачи программой path */
+int task_exec(struct task* task, const char* path, const char* const* argv,
+              const char* const* envp);
+
+/*
+ * posix_spawn: новая задача сразу с программой path. Адресное
+ * пространство родителя не копируется и не заимствуется.
+ */
+int task_spawn(struct task* parent, const char* path, const char* const* argv,
+               const char* const* envp, struct task** out);
+
+void task_exit(struct task* task, int32_t code);
+
+/* Освобождение завершённого потомка; возвращает его код выхода */
+int32_t task_reap(struct task* task);
+
+/* Родитель ждёт потомка после vfork и ещё не может выполняться */
+static inline bool task_vfork_blocked(const struct task* task) {
+    return task->vfork_child != NULL;
+}
+
+#endif /* MIXOS_PROC_TASK_H */
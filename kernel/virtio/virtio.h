@@ -0,0 +1,130 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/virtio/virtio.h
+ * Устройства virtio: транспорт PCI и очереди (virtqueue)
+ *
+ * Поддержан унаследованный (legacy) интерфейс virtio-pci: регистры в
+ * BAR0 ввода-вывода, разделённые очереди (split virtqueue) с раскладкой
+ * колец, выровненной на страницу. Такой интерфейс есть у переходных
+ * (transitional) устройств QEMU по умолчанию.
+ *
+ * Прерываний ядро пока не обрабатывает, поэтому драйверы опрашивают
+ * кольцо использованных буферов. QEMU обрабатывает запрос прямо в
+ * обработчике записи в порт уведомления, так что к возврату из kick
+ * ответ обычно уже готов.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_VIRTIO_VIRTIO_H
+#define MIXOS_VIRTIO_VIRTIO_H
+
+#include "pci/pci.h"
+
+#define VIRTIO_PCI_VENDOR_ID        0x1AF4
+
+/* Биты состояния устройства */
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE 1
+#define VIRTIO_CONFIG_S_DRIVER      2
+#define VIRTIO_CONFIG_S_DRIVER_OK   4
+#define VIRTIO_CONFIG_S_FAILED      0x80
+
+/* Дескриптор кольца */
+#define VRING_DESC_F_NEXT           1
+#define VRING_DESC_F_WRITE          2   /* Буфер пишет устройство */
+
+#define VRING_AVAIL_F_NO_INTERRUPT  1
+
+struct vring_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct vring_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed));
+
+struct vring_used_elem {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed));
+
+struct vring_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct vring_used_elem ring[];
+} __attribute__((packed));
+
+/* Фрагмент буфера запроса */
+struct virtio_sg {
+    uint64_t addr;                  /* Физический адрес */
+    uint32_t len;
+};
+
+struct virtio_device;
+
+struct virtqueue {
+    struct virtio_device* vdev;
+    uint16_t index;
+    uint16_t num;                   /* Размер кольца (задаёт устройство) */
+    struct page* pages;             /* Память колец, порядок в pages->order */
+    struct vring_desc* desc;
+    struct vring_avail* avail;
+    struct vring_used* used;
+    uint16_t free_head;             /* Цепочка свободных дескрипторов */
+    uint16_t num_free;
+    uint16_t last_used_idx;
+    void** tokens;                  /* Токен запроса по голове цепочки */
+};
+
+struct virtio_device {
+    struct pci_dev pci;
+    uint16_t io;                    /* Базовый порт регистров */
+    uint32_t features;              /* Согласованные возможности */
+};
+
+/*
+ * Поиск и сброс устройства; 0 или -ENODEV. Возможности, предлагаемые
+ * устройством, сохраняются в vdev->features до virtio_finalize_features.
+ */
+int virtio_pci_probe(uint16_t device_id, struct virtio_device* vdev);
+
+/* Согласование: остаются возможности устройства, которые знает драйвер */
+void virtio_finalize_features(struct virtio_device* vdev, uint32_t driver_features);
+
+static inline bool virtio_has_feature(const struct virtio_device* vdev, uint32_t bit) {
+    return vdev->features & (1U << bit);
+}
+
+/* Устройство готово к работе; при ошибке настройки - virtio_fail */
+void virtio_device_ready(struct virtio_device* vdev);
+void virtio_fail(struct virtio_device* vdev);
+
+/* Пространство конфигурации устройства */
+uint32_t virtio_cread32(struct virtio_device* vdev, uint32_t offset);
+void virtio_cwrite32(struct virtio_device* vdev, uint32_t offset, uint32_t value);
+
+/* Очередь index; 0 или отрицательный код ошибки */
+int virtio_setup_vq(struct virtio_device* vdev, uint16_t index, struct virtqueue* vq);
+void virtio_del_vq(struct virtqueue* vq);
+
+/*
+ * Запрос из out фрагментов, читаемых устройством, и in фрагментов, в
+ * которые оно пишет. token вернёт virtqueue_get_buf. 0 или -ENOSPC.
+ */
+int virtqueue_add(struct virtqueue* vq, const struct virtio_sg* sg, uint32_t out, uint32_t in,
+                  void* token);
+
+/* Уведомление устройства о новых запросах */
+void virtqueue_kick(struct virtqueue* vq);
+
+/* Токен выполненного запроса или NULL; len - сколько записало устройство */
+void* virtqueue_get_buf(struct virtqueue* vq, uint32_t* len);
+
+/* Ожидание выполненного запроса опросом кольца */
+void* virtqueue_wait_buf(struct virtqueue* vq, uint32_t* len);
+
+#endif /* MIXOS_VIRTIO_VIRTIO_H */
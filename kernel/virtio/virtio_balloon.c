@@ -0,0 +1,215 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/virtio/virtio_balloon.c
+ * Драйвер virtio-balloon
+ * ============================================================================
+ */
+
+#include "virtio/virtio_balloon.h"
+#include "virtio/virtio.h"
+#include "mm/page_reporting.h"
+#include "mm/swap.h"
+#include "errno.h"
+
+/* Пространство конфигурации */
+#define VIRTIO_BALLOON_CONFIG_NUM_PAGES 0   /* Желаемый размер (пишет хост) */
+#define VIRTIO_BALLOON_CONFIG_ACTUAL    4   /* Текущий размер (пишет драйвер) */
+
+/* Теги статистики */
+#define VIRTIO_BALLOON_S_SWAP_IN    0
+#define VIRTIO_BALLOON_S_SWAP_OUT   1
+#define VIRTIO_BALLOON_S_MEMFREE    4
+#define VIRTIO_BALLOON_S_MEMTOT     5
+#define VIRTIO_BALLOON_S_NR         4
+
+struct virtio_balloon_stat {
+    uint16_t tag;
+    uint64_t val;
+} __attribute__((packed));
+
+static struct {
+    struct virtio_device vdev;
+    struct virtqueue inflate_vq;
+    struct virtqueue deflate_vq;
+    struct virtqueue stats_vq;
+    struct virtqueue reporting_vq;
+    bool ready;
+
+    struct list_head pages;         /* Страницы шара (через page->lru) */
+    uint32_t num_pages;
+
+    /* Номера кадров запроса надувания или сдувания (4 KiB, как у хоста) */
+    uint32_t pfns[VIRTIO_BALLOON_ARRAY_PFNS_MAX];
+    struct virtio_balloon_stat stats[VIRTIO_BALLOON_S_NR];
+    struct virtio_sg report_sg[PAGE_REPORTING_CAPACITY];
+    struct page_reporting_dev_info pr_dev;
+} vb = {
+    .pages = LIST_HEAD_INIT(vb.pages),
+};
+
+/* Номера кадров запроса сообщаются хосту одним буфером */
+static void tell_host(struct virtqueue* vq, uint32_t num) {
+    struct virtio_sg sg = { virt_to_phys(vb.pfns), num * sizeof(uint32_t) };
+    if (virtqueue_add(vq, &sg, 1, 0, vb.pfns) < 0) {
+        return;
+    }
+    virtqueue_kick(vq);
+    virtqueue_wait_buf(vq, NULL);
+}
+
+static void update_balloon_size(void) {
+    virtio_cwrite32(&vb.vdev, VIRTIO_BALLOON_CONFIG_ACTUAL, vb.num_pages);
+}
+
+/* Надувание до num страниц: не больше, чем есть свободной памяти */
+static uint32_t fill_balloon(uint32_t num) {
+    uint32_t n = 0;
+    num = MIN(num, VIRTIO_BALLOON_ARRAY_PFNS_MAX);
+    while (n < num) {
+        struct page* page = alloc_page();
+        if (!page) {
+            break;
+        }
+        vb.pfns[n++] = (uint32_t)page_to_pfn(page);
+        list_add(&page->lru, &vb.pages);
+    }
+    if (n == 0) {
+        return 0;
+    }
+    tell_host(&vb.inflate_vq, n);
+    vb.num_pages += n;
+    update_balloon_size();
+    return n;
+}
+
+/*
+ * Сдувание на num страниц. Хост узнаёт о них раньше, чем ядро их
+ * тронет, - этого требует MUST_TELL_HOST, а без неё это просто безопасно.
+ */
+static uint32_t leak_balloon(uint32_t num) {
+    struct list_head freed = LIST_HEAD_INIT(freed);
+    uint32_t n = 0;
+    num = MIN(num, VIRTIO_BALLOON_ARRAY_PFNS_MAX);
+    while (n < num && !list_empty(&vb.pages)) {
+        struct page* page = list_first_entry(&vb.pages, struct page, lru);
+        list_del(&page->lru);
+        list_add(&page->lru, &freed);
+        vb.pfns[n++] = (uint32_t)page_to_pfn(page);
+    }
+    if (n == 0) {
+        return 0;
+    }
+    tell_host(&vb.deflate_vq, n);
+
+    struct list_head* pos;
+    struct list_head* tmp;
+    list_for_each_safe(pos, tmp, &freed) {
+        struct page* page = list_entry(pos, struct page, lru);
+        list_del(&page->lru);
+        put_page(page);
+    }
+    vb.num_pages -= n;
+    update_balloon_size();
+    return n;
+}
+
+static void update_stat(uint32_t idx, uint16_t tag, uint64_t val) {
+    vb.stats[idx].tag = tag;
+    vb.stats[idx].val = val;
+}
+
+/* Буфер статистики у устройства: хост вернёт его, когда захочет свежие данные */
+static void stats_queue(void) {
+    update_stat(0, VIRTIO_BALLOON_S_SWAP_IN, swap_stats.swapin << PAGE_SHIFT);
+    update_stat(1, VIRTIO_BALLOON_S_SWAP_OUT, swap_stats.swapout << PAGE_SHIFT);
+    update_stat(2, VIRTIO_BALLOON_S_MEMFREE, pmm_free_pages() << PAGE_SHIFT);
+    update_stat(3, VIRTIO_BALLOON_S_MEMTOT, pmm_total_pages() << PAGE_SHIFT);
+
+    struct virtio_sg sg = { virt_to_phys(vb.stats), sizeof(vb.stats) };
+    if (virtqueue_add(&vb.stats_vq, &sg, 1, 0, vb.stats) == 0) {
+        virtqueue_kick(&vb.stats_vq);
+    }
+}
+
+static int virtballoon_free_page_report(struct page_reporting_dev_info* prdev,
+                                        struct page** pages, uint32_t nents) {
+    (void)prdev;
+    for (uint32_t i = 0; i < nents; i++) {
+        vb.report_sg[i].addr = page_to_phys(pages[i]);
+        vb.report_sg[i].len = (uint32_t)(PAGE_SIZE << pages[i]->order);
+    }
+    /* Хост пишет в эти страницы (освобождает их): буферы «для устройства» */
+    int err = virtqueue_add(&vb.reporting_vq, vb.report_sg, 0, nents, vb.report_sg);
+    if (err < 0) {
+        return err;
+    }
+    virtqueue_kick(&vb.reporting_vq);
+    virtqueue_wait_buf(&vb.reporting_vq, NULL);
+    return 0;
+}
+
+int virtio_balloon_init(void) {
+    struct virtio_device* vdev = &vb.vdev;
+    int err = virtio_pci_probe(VIRTIO_PCI_DEVICE_BALLOON, vdev);
+    if (err < 0) {
+        return err;
+    }
+    virtio_finalize_features(vdev, (1U << VIRTIO_BALLOON_F_MUST_TELL_HOST) |
+                                   (1U << VIRTIO_BALLOON_F_STATS_VQ) |
+                                   (1U << VIRTIO_BALLOON_F_REPORTING));
+
+    /* Номера очередей плотные: отсутствующие очереди не занимают номер */
+    uint16_t index = 0;
+    err = virtio_setup_vq(vdev, index++, &vb.inflate_vq);
+    if (err == 0) {
+        err = virtio_setup_vq(vdev, index++, &vb.deflate_vq);
+    }
+    if (err == 0 && virtio_has_feature(vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+        err = virtio_setup_vq(vdev, index++, &vb.stats_vq);
+    }
+    if (err == 0 && virtio_has_feature(vdev, VIRTIO_BALLOON_F_REPORTING)) {
+        err = virtio_setup_vq(vdev, index++, &vb.reporting_vq);
+    }
+    if (err < 0) {
+        virtio_fail(vdev);
+        return err;
+    }
+
+    virtio_device_ready(vdev);
+    vb.ready = true;
+    if (virtio_has_feature(vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+        stats_queue();
+    }
+    if (virtio_has_feature(vdev, VIRTIO_BALLOON_F_REPORTING)) {
+        vb.pr_dev.report = virtballoon_free_page_report;
+        page_reporting_register(&vb.pr_dev);
+    }
+    return 0;
+}
+
+bool virtio_balloon_ready(void) {
+    return vb.ready;
+}
+
+uint32_t virtio_balloon_poll(void) {
+    if (!vb.ready) {
+        return 0;
+    }
+    if (virtio_has_feature(&vb.vdev, VIRTIO_BALLOON_F_STATS_VQ) &&
+        virtqueue_get_buf(&vb.stats_vq, NULL)) {
+        stats_queue();
+    }
+
+    uint32_t target = virtio_cread32(&vb.vdev, VIRTIO_BALLOON_CONFIG_NUM_PAGES);
+    if (target > vb.num_pages) {
+        return fill_balloon(target - vb.num_pages);
+    }
+    if (target < vb.num_pages) {
+        return leak_balloon(vb.num_pages - target);
+    }
+    return 0;
+}
+
+uint32_t virtio_balloon_pages(void) {
+    return vb.num_pages;
+}
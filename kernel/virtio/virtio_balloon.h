@@ -0,0 +1,48 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/virtio/virtio_balloon.h
+ * Драйвер virtio-balloon
+ *
+ * Хост задаёт в конфигурации устройства желаемый размер «шара» в
+ * страницах. Драйвер надувает шар, забирая страницы у аллокатора и
+ * сообщая хосту их номера (хост освобождает их память), и сдувает,
+ * возвращая страницы аллокатору после уведомления хоста. Кроме того,
+ * крупные свободные блоки buddy сообщаются хосту без изъятия у ядра
+ * (VIRTIO_BALLOON_F_REPORTING, см. mm/page_reporting.h), а хост может
+ * запрашивать статистику памяти гостя.
+ * ============================================================================
+ */
+
+#ifndef MIXOS_VIRTIO_VIRTIO_BALLOON_H
+#define MIXOS_VIRTIO_VIRTIO_BALLOON_H
+
+#include "kernel.h"
+
+/* Номер переходного устройства virtio-balloon на PCI */
+#define VIRTIO_PCI_DEVICE_BALLOON       0x1002
+
+/* Возможности */
+#define VIRTIO_BALLOON_F_MUST_TELL_HOST 0   /* Сообщать хосту до использования страниц */
+#define VIRTIO_BALLOON_F_STATS_VQ       1   /* Очередь статистики памяти */
+#define VIRTIO_BALLOON_F_REPORTING      5   /* Очередь сообщений о свободных страницах */
+
+/* Страниц за одно надувание или сдувание */
+#define VIRTIO_BALLOON_ARRAY_PFNS_MAX   256
+
+/* Поиск устройства и запуск; 0 или -ENODEV, если устройства нет */
+int virtio_balloon_init(void);
+
+/* Устройство найдено и запущено */
+bool virtio_balloon_ready(void);
+
+/*
+ * Опрос устройства из цикла простоя: размер шара и запросы статистики.
+ * Прерываний нет, так что опрос - единственный способ узнать новую цель
+ * хоста. Возвращает число страниц, на которое изменился шар.
+ */
+uint32_t virtio_balloon_poll(void);
+
+/* Страниц в шаре */
+uint32_t virtio_balloon_pages(void);
+
+#endif /* MIXOS_VIRTIO_VIRTIO_BALLOON_H */
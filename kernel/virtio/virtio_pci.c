@@ -0,0 +1,139 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/virtio/virtio_pci.c
+ * Унаследованный (legacy) транспорт virtio-pci
+ * ============================================================================
+ */
+
+#include "virtio/virtio.h"
+#include "cpu/io.h"
+#include "mm/pmm.h"
+#include "mm/kmalloc.h"
+#include "errno.h"
+
+/* Регистры в BAR0 */
+#define VIRTIO_PCI_HOST_FEATURES    0
+#define VIRTIO_PCI_GUEST_FEATURES   4
+#define VIRTIO_PCI_QUEUE_PFN        8
+#define VIRTIO_PCI_QUEUE_NUM        12
+#define VIRTIO_PCI_QUEUE_SEL        14
+#define VIRTIO_PCI_QUEUE_NOTIFY     16
+#define VIRTIO_PCI_STATUS           18
+#define VIRTIO_PCI_CONFIG           20  /* Конфигурация устройства (без MSI-X) */
+
+/* Кольцо использованных буферов начинается с границы страницы */
+#define VIRTIO_PCI_VRING_ALIGN      4096
+#define VIRTIO_PCI_QUEUE_ADDR_SHIFT 12
+
+static void virtio_add_status(struct virtio_device* vdev, uint8_t status) {
+    outb(vdev->io + VIRTIO_PCI_STATUS, inb(vdev->io + VIRTIO_PCI_STATUS) | status);
+}
+
+int virtio_pci_probe(uint16_t device_id, struct virtio_device* vdev) {
+    if (pci_find_device(VIRTIO_PCI_VENDOR_ID, device_id, &vdev->pci) < 0) {
+        return -ENODEV;
+    }
+    vdev->io = pci_resource_io(&vdev->pci, 0);
+    if (!vdev->io) {
+        /* Только современный интерфейс (disable-legacy=on) */
+        return -ENODEV;
+    }
+    pci_enable_device(&vdev->pci);
+
+    outb(vdev->io + VIRTIO_PCI_STATUS, 0);
+    virtio_add_status(vdev, VIRTIO_CONFIG_S_ACKNOWLEDGE);
+    virtio_add_status(vdev, VIRTIO_CONFIG_S_DRIVER);
+    vdev->features = inl(vdev->io + VIRTIO_PCI_HOST_FEATURES);
+    return 0;
+}
+
+void virtio_finalize_features(struct virtio_device* vdev, uint32_t driver_features) {
+    vdev->features &= driver_features;
+    outl(vdev->io + VIRTIO_PCI_GUEST_FEATURES, vdev->features);
+}
+
+void virtio_device_ready(struct virtio_device* vdev) {
+    virtio_add_status(vdev, VIRTIO_CONFIG_S_DRIVER_OK);
+}
+
+void virtio_fail(struct virtio_device* vdev) {
+    virtio_add_status(vdev, VIRTIO_CONFIG_S_FAILED);
+}
+
+uint32_t virtio_cread32(struct virtio_device* vdev, uint32_t offset) {
+    return inl((uint16_t)(vdev->io + VIRTIO_PCI_CONFIG + offset));
+}
+
+void virtio_cwrite32(struct virtio_device* vdev, uint32_t offset, uint32_t value) {
+    outl((uint16_t)(vdev->io + VIRTIO_PCI_CONFIG + offset), value);
+}
+
+/* Байт под кольца очереди из num дескрипторов */
+static uint64_t vring_size(uint16_t num) {
+    uint64_t avail_end = sizeof(struct vring_desc) * num + sizeof(uint16_t) * (3 + num);
+    return ALIGN_UP(avail_end, VIRTIO_PCI_VRING_ALIGN) +
+           sizeof(uint16_t) * 3 + sizeof(struct vring_used_elem) * num;
+}
+
+int virtio_setup_vq(struct virtio_device* vdev, uint16_t index, struct virtqueue* vq) {
+    outw(vdev->io + VIRTIO_PCI_QUEUE_SEL, index);
+    uint16_t num = inw(vdev->io + VIRTIO_PCI_QUEUE_NUM);
+    if (num == 0) {
+        return -ENOENT;
+    }
+    if (inl(vdev->io + VIRTIO_PCI_QUEUE_PFN) != 0) {
+        return -EBUSY;
+    }
+
+    uint64_t size = vring_size(num);
+    unsigned int order = 0;
+    while ((PAGE_SIZE << order) < size) {
+        order++;
+    }
+    vq->pages = alloc_pages(order);
+    vq->tokens = kzalloc(sizeof(void*) * num);
+    if (!vq->pages || !vq->tokens) {
+        if (vq->pages) {
+            free_pages(vq->pages, order);
+        }
+        kfree(vq->tokens);
+        return -ENOMEM;
+    }
+
+    uint8_t* ring = page_address(vq->pages);
+    memset(ring, 0, PAGE_SIZE << order);
+    vq->vdev = vdev;
+    vq->index = index;
+    vq->num = num;
+    vq->desc = (struct vring_desc*)ring;
+    vq->avail = (struct vring_avail*)(ring + sizeof(struct vring_desc) * num);
+    vq->used = (struct vring_used*)(ring + ALIGN_UP(sizeof(struct vring_desc) * num +
+                                                    sizeof(uint16_t) * (3 + num),
+                                                    VIRTIO_PCI_VRING_ALIGN));
+    for (uint16_t i = 0; i + 1 < num; i++) {
+        vq->desc[i].next = i + 1;
+    }
+    vq->free_head = 0;
+    vq->num_free = num;
+    vq->last_used_idx = 0;
+    /* Ответы забираются опросом */
+    vq->avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+
+    outl(vdev->io + VIRTIO_PCI_QUEUE_PFN,
+         (uint32_t)(page_to_phys(vq->pages) >> VIRTIO_PCI_QUEUE_ADDR_SHIFT));
+    return 0;
+}
+
+void virtio_del_vq(struct virtqueue* vq) {
+    struct virtio_device* vdev = vq->vdev;
+    outw(vdev->io + VIRTIO_PCI_QUEUE_SEL, vq->index);
+    outl(vdev->io + VIRTIO_PCI_QUEUE_PFN, 0);
+    free_pages(vq->pages, vq->pages->order);
+    kfree(vq->tokens);
+}
+
+void virtqueue_kick(struct virtqueue* vq) {
+    /* Индекс доступных запросов должен быть виден устройству до уведомления */
+    __sync_synchronize();
+    outw(vq->vdev->io + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+}
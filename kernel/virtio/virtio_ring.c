@@ -0,0 +1,81 @@
+/*
+ * ============================================================================
+ * MixOS Kernel - kernel/virtio/virtio_ring.c
+ * Разделённые очереди virtio (split virtqueue)
+ * ============================================================================
+ */
+
+#include "virtio/virtio.h"
+#include "errno.h"
+
+/* На x86 записи не переупорядочиваются с записями: хватает барьера компилятора */
+#define virtio_wmb()    __asm__ volatile ("" : : : "memory")
+#define virtio_rmb()    __asm__ volatile ("" : : : "memory")
+
+int virtqueue_add(struct virtqueue* vq, const struct virtio_sg* sg, uint32_t out, uint32_t in,
+                  void* token) {
+    uint32_t total = out + in;
+    if (total == 0 || total > vq->num_free) {
+        return -ENOSPC;
+    }
+
+    uint16_t head = vq->free_head;
+    uint16_t idx = head;
+    uint16_t last = head;
+    for (uint32_t i = 0; i < total; i++) {
+        struct vring_desc* desc = &vq->desc[idx];
+        desc->addr = sg[i].addr;
+        desc->len = sg[i].len;
+        desc->flags = VRING_DESC_F_NEXT | (i >= out ? VRING_DESC_F_WRITE : 0);
+        last = idx;
+        idx = desc->next;
+    }
+    vq->desc[last].flags &= ~VRING_DESC_F_NEXT;
+    vq->free_head = idx;
+    vq->num_free -= (uint16_t)total;
+    vq->tokens[head] = token;
+
+    /* Дескрипторы должны быть записаны раньше, чем устройство увидит голову */
+    uint16_t avail_idx = vq->avail->idx;
+    vq->avail->ring[avail_idx % vq->num] = head;
+    virtio_wmb();
+    vq->avail->idx = avail_idx + 1;
+    return 0;
+}
+
+void* virtqueue_get_buf(struct virtqueue* vq, uint32_t* len) {
+    if (vq->last_used_idx == *(volatile uint16_t*)&vq->used->idx) {
+        return NULL;
+    }
+    /* Элемент читается только после индекса, который его опубликовал */
+    virtio_rmb();
+
+    struct vring_used_elem* elem = &vq->used->ring[vq->last_used_idx % vq->num];
+    uint16_t head = (uint16_t)elem->id;
+    if (len) {
+        *len = elem->len;
+    }
+    vq->last_used_idx++;
+
+    void* token = vq->tokens[head];
+    vq->tokens[head] = NULL;
+
+    /* Цепочка дескрипторов возвращается в свободный список */
+    uint16_t idx = head;
+    vq->num_free++;
+    while (vq->desc[idx].flags & VRING_DESC_F_NEXT) {
+        idx = vq->desc[idx].next;
+        vq->num_free++;
+    }
+    vq->desc[idx].next = vq->free_head;
+    vq->free_head = head;
+    return token;
+}
+
+void* virtqueue_wait_buf(struct virtqueue* vq, uint32_t* len) {
+    void* token;
+    while (!(token = virtqueue_get_buf(vq, len))) {
+        __asm__ volatile ("pause" : : : "memory");
+    }
+    return token;
+}
@@ -0,0 +1,494 @@
+/*
+ * ============================================================================
+ * MixOS - tools/fsck.mixfs.c
+ * Проверка образа MixFS на хосте (только чтение)
+ *
+ *   fsck.mixfs [-v] образ
+ *
+ * Проверяются суперблоки, контрольные суммы и структура всех узлов дерева
+ * (порядок ключей, ключи указателей, поколения), согласованность inode,
+ * записей каталогов и экстентов, а также совпадение карты свободного
+ * места с фактически занятыми блоками. Код возврата 0 - ошибок нет,
+ * 1 - найдены ошибки, 2 - образ не удалось прочитать.
+ * ============================================================================
+ */
+
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fs/mixfs/mixfs_fs.h"
+
+struct inode_state {
+    bool present;
+    struct mixfs_inode_item item;
+    uint64_t links;                 /* Записей каталогов, ссылающихся на inode */
+    uint64_t subdirs;
+    uint64_t entries;               /* Каталог: элементов DIR_INDEX */
+    uint64_t dir_items;             /* Каталог: имён в DIR_ITEM */
+    uint64_t max_index;
+    uint64_t extent_blocks;
+    uint64_t extent_end;            /* Конец последнего экстента (блок файла) */
+    uint64_t parent_seen;           /* Каталог, в котором найдено имя */
+};
+
+static struct {
+    int fd;
+    bool verbose;
+    uint64_t errors;
+    struct mixfs_super_block super;
+    uint64_t first_data;
+    uint8_t* used;                  /* Бит на блок: занят узлом или данными */
+    struct inode_state* inodes;
+    uint64_t nr_inodes;
+    uint64_t nodes;
+    uint64_t items;
+} fsck;
+
+static void error(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "fsck.mixfs: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    fsck.errors++;
+}
+
+static bool read_block(uint64_t block, void* buf) {
+    return pread(fsck.fd, buf, MIXFS_BLOCK_SIZE, (off_t)(block * MIXFS_BLOCK_SIZE)) ==
+           MIXFS_BLOCK_SIZE;
+}
+
+static void mark_used(uint64_t start, uint64_t count, const char* what) {
+    for (uint64_t b = start; b < start + count; b++) {
+        if (b < fsck.first_data || b >= fsck.super.total_blocks) {
+            error("%s: block %llu outside the data area", what, (unsigned long long)b);
+            continue;
+        }
+        if (fsck.used[b / 8] & (1 << (b % 8))) {
+            error("%s: block %llu is used twice", what, (unsigned long long)b);
+        }
+        fsck.used[b / 8] |= (uint8_t)(1 << (b % 8));
+    }
+}
+
+static struct inode_state* inode_state(uint64_t ino) {
+    if (ino >= fsck.nr_inodes) {
+        uint64_t count = MAX(ino + 1, fsck.nr_inodes * 2);
+        fsck.inodes = realloc(fsck.inodes, count * sizeof(struct inode_state));
+        if (!fsck.inodes) {
+            fprintf(stderr, "fsck.mixfs: out of memory\n");
+            exit(2);
+        }
+        memset(&fsck.inodes[fsck.nr_inodes], 0,
+               (count - fsck.nr_inodes) * sizeof(struct inode_state));
+        fsck.nr_inodes = count;
+    }
+    return &fsck.inodes[ino];
+}
+
+/* ============================================================================
+ * Суперблок
+ * ============================================================================ */
+
+static bool load_super(uint64_t image_blocks) {
+    uint8_t buf[MIXFS_BLOCK_SIZE];
+    bool found = false;
+
+    for (uint32_t i = 0; i < 2; i++) {
+        if (!read_block(MIXFS_SUPER_BLOCK + i, buf)) {
+            continue;
+        }
+        struct mixfs_super_block* super = (struct mixfs_super_block*)buf;
+        if (super->magic != MIXFS_MAGIC) {
+            continue;
+        }
+        if (super->csum != mixfs_super_csum(super)) {
+            printf("superblock copy %u: checksum mismatch (ignored)\n", i);
+            continue;
+        }
+        if (super->generation % 2 != i) {
+            error("superblock copy %u has generation %llu", i,
+                  (unsigned long long)super->generation);
+        }
+        if (!found || super->generation > fsck.super.generation) {
+            fsck.super = *super;
+            found = true;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    struct mixfs_super_block* super = &fsck.super;
+    if (super->version != MIXFS_VERSION || super->block_size != MIXFS_BLOCK_SIZE) {
+        error("unsupported version %u or block size %u", super->version, super->block_size);
+        return false;
+    }
+    if (super->total_blocks > image_blocks) {
+        error("volume has %llu blocks, image only %llu",
+              (unsigned long long)super->total_blocks, (unsigned long long)image_blocks);
+        return false;
+    }
+    if (super->map_blocks != mixfs_map_blocks(super->total_blocks) || super->active_map > 1) {
+        error("%s", "invalid space map geometry");
+        return false;
+    }
+    fsck.first_data = mixfs_first_data_block(super->map_blocks);
+    return true;
+}
+
+/* ============================================================================
+ * Дерево
+ * ============================================================================ */
+
+static void check_item(const struct mixfs_key* key, const uint8_t* data, uint32_t size,
+                       const struct mixfs_key* prev) {
+    struct inode_state* st = inode_state(key->objectid);
+    fsck.items++;
+
+    switch (key->type) {
+    case MIXFS_INODE_ITEM:
+        if (key->offset != 0 || size < sizeof(struct mixfs_inode_item)) {
+            error("inode %llu: bad inode item", (unsigned long long)key->objectid);
+            return;
+        }
+        st->present = true;
+        memcpy(&st->item, data, sizeof(st->item));
+        if (st->item.generation > fsck.super.generation) {
+            error("inode %llu: generation from the future", (unsigned long long)key->objectid);
+        }
+        break;
+
+    case MIXFS_DIR_ITEM:
+    case MIXFS_DIR_INDEX: {
+        uint32_t offset = 0;
+        uint32_t names = 0;
+        while (offset < size) {
+            const struct mixfs_dir_entry* de = (const struct mixfs_dir_entry*)(data + offset);
+            if (offset + sizeof(*de) > size || offset + MIXFS_DIR_ENTRY_LEN(de->name_len) > size ||
+                de->name_len == 0 || de->name_len > MIXFS_NAME_MAX) {
+                error("dir %llu: malformed entry", (unsigned long long)key->objectid);
+                return;
+            }
+            names++;
+            if (key->type == MIXFS_DIR_ITEM) {
+                if (mixfs_name_hash(de->name, de->name_len) != key->offset) {
+                    error("dir %llu: name %.*s stored under a wrong hash",
+                          (unsigned long long)key->objectid, de->name_len, de->name);
+                }
+                st->dir_items++;
+            } else {
+                if (de->index != key->offset) {
+                    error("dir %llu: index entry %llu mismatch", (unsigned long long)key->objectid,
+                          (unsigned long long)key->offset);
+                }
+                struct inode_state* child = inode_state(de->ino);
+                child->links++;
+                child->parent_seen = key->objectid;
+                st = inode_state(key->objectid);
+                if (de->type == MIXFS_FT_DIR) {
+                    st->subdirs++;
+                }
+                st->entries++;
+                st->max_index = MAX(st->max_index, key->offset);
+            }
+            offset += MIXFS_DIR_ENTRY_LEN(de->name_len);
+        }
+        if (key->type == MIXFS_DIR_INDEX && names != 1) {
+            error("dir %llu: index item with %u names", (unsigned long long)key->objectid, names);
+        }
+        break;
+    }
+
+    case MIXFS_EXTENT_ITEM: {
+        if (size < sizeof(struct mixfs_extent_item)) {
+            error("inode %llu: short extent item", (unsigned long long)key->objectid);
+            return;
+        }
+        struct mixfs_extent_item extent;
+        memcpy(&extent, data, sizeof(extent));
+        if (extent.nr_blocks == 0) {
+            error("inode %llu: empty extent", (unsigned long long)key->objectid);
+            return;
+        }
+        if (prev && prev->objectid == key->objectid && prev->type == MIXFS_EXTENT_ITEM &&
+            st->extent_end > key->offset) {
+            error("inode %llu: overlapping extents at %llu", (unsigned long long)key->objectid,
+                  (unsigned long long)key->offset);
+        }
+        st->extent_end = key->offset + extent.nr_blocks;
+        st->extent_blocks += extent.nr_blocks;
+        mark_used(extent.disk_block, extent.nr_blocks, "extent");
+        break;
+    }
+
+    default:
+        error("unknown item type %u", key->type);
+    }
+}
+
+/*
+ * Обход поддерева. low - ключ указателя на узел (наименьший ключ
+ * поддерева), high - ключ следующего указателя (NULL - без ограничения).
+ */
+static void check_node(uint64_t blocknr, uint64_t generation, int level,
+                       const struct mixfs_key* low, const struct mixfs_key* high,
+                       struct mixfs_key* last) {
+    uint8_t node[MIXFS_BLOCK_SIZE];
+    struct mixfs_node_header* header = (struct mixfs_node_header*)node;
+
+    if (blocknr < fsck.first_data || blocknr >= fsck.super.total_blocks || !read_block(blocknr, node)) {
+        error("node %llu: invalid block number", (unsigned long long)blocknr);
+        return;
+    }
+    mark_used(blocknr, 1, "node");
+    fsck.nodes++;
+
+    if (header->magic != MIXFS_NODE_MAGIC || header->csum != mixfs_block_csum(node)) {
+        error("node %llu: bad magic or checksum", (unsigned long long)blocknr);
+        return;
+    }
+    if (header->blocknr != blocknr || header->level != level) {
+        error("node %llu: header says block %llu level %u, expected level %d",
+              (unsigned long long)blocknr, (unsigned long long)header->blocknr,
+              header->level, level);
+        return;
+    }
+    if ((generation && header->generation != generation) ||
+        header->generation > fsck.super.generation) {
+        error("node %llu: generation %llu, pointer expects %llu", (unsigned long long)blocknr,
+              (unsigned long long)header->generation, (unsigned long long)generation);
+    }
+    if (header->nritems == 0 && (level > 0 || low)) {
+        error("node %llu: empty non-root node", (unsigned long long)blocknr);
+        return;
+    }
+
+    if (level > 0) {
+        struct mixfs_ptr* ptrs = mixfs_node_ptrs(node);
+        if (header->nritems > MIXFS_NODE_PTRS) {
+            error("node %llu: too many pointers", (unsigned long long)blocknr);
+            return;
+        }
+        if (low && mixfs_key_cmp(&ptrs[0].key, low) != 0) {
+            error("node %llu: first key does not match the parent", (unsigned long long)blocknr);
+        }
+        for (uint32_t i = 0; i < header->nritems; i++) {
+            if (i && mixfs_key_cmp(&ptrs[i - 1].key, &ptrs[i].key) >= 0) {
+                error("node %llu: keys out of order", (unsigned long long)blocknr);
+            }
+            const struct mixfs_key* next = i + 1 < header->nritems ? &ptrs[i + 1].key : high;
+            check_node(ptrs[i].blocknr, ptrs[i].generation, level - 1, &ptrs[i].key, next, last);
+        }
+        return;
+    }
+
+    struct mixfs_item* items = mixfs_leaf_items(node);
+    uint32_t header_end = (uint32_t)(sizeof(*header) + header->nritems * sizeof(struct mixfs_item));
+    uint32_t data_top = MIXFS_BLOCK_SIZE;
+    if (header_end > MIXFS_BLOCK_SIZE) {
+        error("leaf %llu: too many items", (unsigned long long)blocknr);
+        return;
+    }
+    if (low && header->nritems && mixfs_key_cmp(&items[0].key, low) != 0) {
+        error("leaf %llu: first key does not match the parent", (unsigned long long)blocknr);
+    }
+    for (uint32_t i = 0; i < header->nritems; i++) {
+        struct mixfs_item* item = &items[i];
+        if (item->offset + item->size != data_top || item->offset < header_end) {
+            error("leaf %llu: item %u data out of place", (unsigned long long)blocknr, i);
+            return;
+        }
+        data_top = item->offset;
+        if (last->type && mixfs_key_cmp(last, &item->key) >= 0) {
+            error("leaf %llu: keys out of order", (unsigned long long)blocknr);
+        }
+        if (high && mixfs_key_cmp(&item->key, high) >= 0) {
+            error("leaf %llu: key beyond the parent range", (unsigned long long)blocknr);
+        }
+        check_item(&item->key, node + item->offset, item->size, last->type ? last : NULL);
+        *last = item->key;
+    }
+}
+
+/* ============================================================================
+ * Согласованность inode
+ * ============================================================================ */
+
+static void check_inodes(void) {
+    struct inode_state* root = inode_state(MIXFS_ROOT_INO);
+    if (!root->present || !S_ISDIR(root->item.mode)) {
+        error("%s", "root directory is missing");
+    }
+    root->links++;                  /* Ссылка из суперблока */
+    root->parent_seen = MIXFS_ROOT_INO;
+
+    for (uint64_t ino = 1; ino < fsck.nr_inodes; ino++) {
+        struct inode_state* st = &fsck.inodes[ino];
+        unsigned long long n = (unsigned long long)ino;
+
+        if (!st->present) {
+            if (st->links || st->extent_blocks || st->entries || st->dir_items) {
+                error("inode %llu: referenced but has no inode item", n);
+            }
+            continue;
+        }
+        if (ino >= fsck.super.next_ino) {
+            error("inode %llu: number is not below next_ino", n);
+        }
+        if (st->links == 0) {
+            error("inode %llu: not linked from any directory", n);
+        }
+        if (S_ISDIR(st->item.mode)) {
+            if (st->links > 1) {
+                error("inode %llu: directory linked %llu times", n, (unsigned long long)st->links);
+            }
+            if (st->item.size != st->entries || st->dir_items != st->entries) {
+                error("dir %llu: size %llu, %llu index entries, %llu names", n,
+                      (unsigned long long)st->item.size, (unsigned long long)st->entries,
+                      (unsigned long long)st->dir_items);
+            }
+            if (st->item.nlink != 2 + st->subdirs) {
+                error("dir %llu: nlink %u, expected %llu", n, st->item.nlink,
+                      (unsigned long long)(2 + st->subdirs));
+            }
+            if (st->entries && st->item.next_index <= st->max_index) {
+                error("dir %llu: next_index below existing entries", n);
+            }
+            if (st->links && st->item.parent != st->parent_seen) {
+                error("dir %llu: parent %llu, found in %llu", n,
+                      (unsigned long long)st->item.parent, (unsigned long long)st->parent_seen);
+            }
+            if (st->extent_blocks) {
+                error("dir %llu: has data extents", n);
+            }
+        } else {
+            if (st->entries || st->dir_items) {
+                error("inode %llu: directory entries on a non-directory", n);
+            }
+            if (st->item.nlink != st->links) {
+                error("inode %llu: nlink %u, %llu links found", n, st->item.nlink,
+                      (unsigned long long)st->links);
+            }
+            if (st->extent_end > DIV_ROUND_UP(st->item.size, MIXFS_BLOCK_SIZE)) {
+                error("inode %llu: extents beyond end of file", n);
+            }
+        }
+        if (st->item.blocks != st->extent_blocks) {
+            error("inode %llu: blocks %llu, extents hold %llu", n,
+                  (unsigned long long)st->item.blocks, (unsigned long long)st->extent_blocks);
+        }
+    }
+}
+
+/* ============================================================================
+ * Карта свободного места
+ * ============================================================================ */
+
+static void check_space_map(void) {
+    const struct mixfs_super_block* super = &fsck.super;
+    uint64_t first = mixfs_map_block(super->map_blocks, super->active_map);
+    uint8_t buf[MIXFS_BLOCK_SIZE];
+    uint64_t free_blocks = 0, mismatches = 0;
+
+    for (uint64_t i = 0; i < super->map_blocks; i++) {
+        struct mixfs_map_header* header = (struct mixfs_map_header*)buf;
+        if (!read_block(first + i, buf) || header->magic != MIXFS_MAP_MAGIC ||
+            header->index != i || header->csum != mixfs_block_csum(buf)) {
+            error("space map block %llu is damaged", (unsigned long long)i);
+            return;
+        }
+        const uint8_t* bits = (const uint8_t*)(header + 1);
+        for (uint64_t j = 0; j < MIXFS_MAP_BITS; j++) {
+            uint64_t block = i * MIXFS_MAP_BITS + j;
+            if (block >= super->total_blocks) {
+                break;
+            }
+            bool map_used = bits[j / 8] & (1 << (j % 8));
+            bool real_used = block < fsck.first_data || (fsck.used[block / 8] & (1 << (block % 8)));
+            if (!map_used) {
+                free_blocks++;
+            }
+            if (map_used != real_used) {
+                if (mismatches++ < 16) {
+                    error("block %llu: space map says %s, actually %s", (unsigned long long)block,
+                          map_used ? "used" : "free", real_used ? "used" : "free");
+                }
+            }
+        }
+    }
+    if (mismatches > 16) {
+        error("... %llu space map mismatches in total", (unsigned long long)mismatches);
+    }
+    if (free_blocks != super->free_blocks) {
+        error("superblock free count %llu, space map has %llu",
+              (unsigned long long)super->free_blocks, (unsigned long long)free_blocks);
+    }
+}
+
+/* ============================================================================
+ * main
+ * ============================================================================ */
+
+int main(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        if (opt == 'v') {
+            fsck.verbose = true;
+        } else {
+            fprintf(stderr, "usage: fsck.mixfs [-v] image\n");
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: fsck.mixfs [-v] image\n");
+        return 2;
+    }
+
+    const char* image = argv[optind];
+    fsck.fd = open(image, O_RDONLY);
+    struct stat st;
+    if (fsck.fd < 0 || fstat(fsck.fd, &st) < 0) {
+        fprintf(stderr, "fsck.mixfs: cannot open %s\n", image);
+        return 2;
+    }
+    if (!load_super((uint64_t)st.st_size / MIXFS_BLOCK_SIZE)) {
+        fprintf(stderr, "fsck.mixfs: %s: no valid MixFS superblock\n", image);
+        return 2;
+    }
+    if (fsck.verbose) {
+        printf("generation %llu, root %llu (level %u), %llu blocks, %llu free\n",
+               (unsigned long long)fsck.super.generation, (unsigned long long)fsck.super.root,
+               fsck.super.root_level, (unsigned long long)fsck.super.total_blocks,
+               (unsigned long long)fsck.super.free_blocks);
+    }
+
+    fsck.used = calloc(DIV_ROUND_UP(fsck.super.total_blocks, 8), 1);
+    if (!fsck.used) {
+        fprintf(stderr, "fsck.mixfs: out of memory\n");
+        return 2;
+    }
+
+    struct mixfs_key last;
+    memset(&last, 0, sizeof(last));
+    check_node(fsck.super.root, 0, (int)fsck.super.root_level, NULL, NULL, &last);
+    check_inodes();
+    check_space_map();
+
+    uint64_t files = 0;
+    for (uint64_t ino = 1; ino < fsck.nr_inodes; ino++) {
+        files += fsck.inodes[ino].present;
+    }
+    printf("%s: %llu inodes, %llu items in %llu nodes, %llu errors\n", image,
+           (unsigned long long)files, (unsigned long long)fsck.items,
+           (unsigned long long)fsck.nodes, (unsigned long long)fsck.errors);
+    close(fsck.fd);
+    return fsck.errors ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+/*
+ * ============================================================================
+ * MixOS - tools/lz4pack.c
+ * Сжатие образа ядра для заглушки boot.asm (make COMPRESS=1)
+ *
+ *   lz4pack образ выход     упаковать плоский образ ядра
+ *   lz4pack -s образ        размеры и оценка времени загрузки
+ *   lz4pack -b файл         скорость сжатия блоками по 4 KiB и потоком
+ *
+ * Выход - заголовок из трёх слов (магия "MXLZ", размер образа, размер
+ * блока) и один LZ4-блок. Заглушка распаковывает его по адресу
+ * компоновки ядра и сверяет размер. Для оценки блок распаковывается на
+ * хосте, а время чтения считается для нескольких типичных носителей:
+ * сжатие выгодно, пока сэкономленное чтение дольше распаковки.
+ *
+ * Замер -b повторяет замер lz4 из kernel/bench.c (make bench BENCH=lz4),
+ * чтобы цифры хоста и гостя в QEMU были сравнимы.
+ * ============================================================================
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lib/lz4.h"
+
+#define LZ4PACK_MAGIC       0x5A4C584D      /* "MXLZ", см. boot/boot.asm */
+
+struct lz4pack_header {
+    uint32_t magic;
+    uint32_t raw_size;
+    uint32_t packed_size;
+};
+
+/* Скорость чтения носителей, байт/с */
+static const struct {
+    const char* name;
+    double rate;
+} media[] = {
+    { "CD-ROM 24x",     3.6e6 },
+    { "USB 2.0 flash",  30e6 },
+    { "SATA HDD",       150e6 },
+    { "SATA SSD",       500e6 },
+};
+
+static void die(const char* fmt, const char* arg) {
+    fprintf(stderr, "lz4pack: ");
+    fprintf(stderr, fmt, arg);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void* xmalloc(size_t size) {
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        die("%s", "out of memory");
+    }
+    return ptr;
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        die("cannot open %s", path);
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (len < 0 || (unsigned long)len > UINT32_MAX) {
+        die("%s: bad size", path);
+    }
+    uint8_t* buf = xmalloc((size_t)len);
+    if (fread(buf, 1, (size_t)len, f) != (size_t)len) {
+        die("cannot read %s", path);
+    }
+    fclose(f);
+    *size = (size_t)len;
+    return buf;
+}
+
+static size_t pack(const uint8_t* raw, size_t raw_size, uint8_t** packed) {
+    static uint8_t wrkmem[LZ4_MEM_COMPRESS];
+    size_t cap = LZ4_COMPRESS_BOUND(raw_size);
+    *packed = xmalloc(cap);
+    size_t len = lz4_compress(raw, raw_size, *packed, cap, wrkmem);
+    if (!len) {
+        die("%s", "compression failed");
+    }
+    return len;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Время распаковки блока на хосте, секунды (лучшее из повторов) */
+static double decompress_time(const uint8_t* packed, size_t packed_size,
+                              const uint8_t* raw, size_t raw_size) {
+    uint8_t* out = xmalloc(raw_size);
+    double best = 0;
+    double deadline = now() + 0.2;
+    do {
+        double start = now();
+        int64_t len = lz4_decompress(packed, packed_size, out, raw_size);
+        double elapsed = now() - start;
+        if (len != (int64_t)raw_size || memcmp(out, raw, raw_size) != 0) {
+            die("%s", "round trip mismatch");
+        }
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    } while (now() < deadline);
+    free(out);
+    return best;
+}
+
+static void report(const char* path) {
+    size_t raw_size;
+    uint8_t* raw = read_file(path, &raw_size);
+    uint8_t* packed;
+    size_t packed_size = pack(raw, raw_size, &packed);
+    size_t image_size = packed_size + sizeof(struct lz4pack_header);
+    double unpack = decompress_time(packed, packed_size, raw, raw_size);
+
+    printf("Kernel image: %zu bytes, LZ4 %zu bytes (%.1f%%)\n", raw_size, image_size,
+           100.0 * (double)image_size / (double)raw_size);
+    printf("Decompression: %.2f ms on this host (%.0f MB/s)\n", unpack * 1e3,
+           (double)raw_size / unpack / 1e6);
+    printf("%-16s %12s %12s\n", "Boot read", "raw, ms", "LZ4, ms");
+    for (size_t i = 0; i < sizeof(media) / sizeof(media[0]); i++) {
+        double plain = (double)raw_size / media[i].rate;
+        double compressed = (double)image_size / media[i].rate + unpack;
+        printf("%-16s %12.2f %12.2f%s\n", media[i].name, plain * 1e3, compressed * 1e3,
+               compressed < plain ? "" : "  (raw is faster)");
+    }
+    free(packed);
+    free(raw);
+}
+
+/* ============================================================================
+ * Замер скорости (как bench_lz4 в ядре)
+ * ============================================================================ */
+
+#define BENCH_BLOCK         4096
+#define BENCH_RING          (LZ4_DICT_SIZE + BENCH_BLOCK)
+#define BENCH_SECONDS       0.5
+
+struct bench {
+    const uint8_t* src;
+    size_t size;
+    size_t nr_blocks;
+    uint8_t* packed;
+    uint32_t* packed_size;
+    uint8_t ring[BENCH_RING];
+    uint8_t out[BENCH_RING];
+    uint8_t wrkmem[LZ4_MEM_COMPRESS];
+    struct lz4_stream stream;
+    struct lz4_stream_decode decode;
+};
+
+static size_t ring_pos(size_t pos, size_t len) {
+    return pos + len > BENCH_RING ? 0 : pos;
+}
+
+static size_t bench_compress(struct bench* b, bool stream) {
+    size_t total = 0;
+    size_t pos = 0;
+
+    lz4_stream_init(&b->stream);
+    for (size_t i = 0; i < b->nr_blocks; i++) {
+        size_t offset = i * BENCH_BLOCK;
+        size_t len = MIN(BENCH_BLOCK, b->size - offset);
+        size_t packed;
+        if (stream) {
+            pos = ring_pos(pos, len);
+            memcpy(b->ring + pos, b->src + offset, len);
+            packed = lz4_compress_continue(&b->stream, b->ring + pos, len, b->packed + total,
+                                           LZ4_COMPRESS_BOUND(len));
+            pos += len;
+        } else {
+            packed = lz4_compress(b->src + offset, len, b->packed + total,
+                                  LZ4_COMPRESS_BOUND(len), b->wrkmem);
+        }
+        if (!packed) {
+            die("%s", "compression failed");
+        }
+        b->packed_size[i] = (uint32_t)packed;
+        total += packed;
+    }
+    return total;
+}
+
+static void bench_decompress(struct bench* b, bool stream, bool verify) {
+    const uint8_t* packed = b->packed;
+    size_t pos = 0;
+
+    lz4_stream_decode_init(&b->decode, NULL, 0);
+    for (size_t i = 0; i < b->nr_blocks; i++) {
+        size_t offset = i * BENCH_BLOCK;
+        size_t len = MIN(BENCH_BLOCK, b->size - offset);
+        int64_t ret;
+        pos = ring_pos(pos, len);
+        if (stream) {
+            ret = lz4_decompress_continue(&b->decode, packed, b->packed_size[i],
+                                          b->out + pos, len);
+        } else {
+            ret = lz4_decompress(packed, b->packed_size[i], b->out + pos, len);
+        }
+        if (ret != (int64_t)len || (verify && memcmp(b->out + pos, b->src + offset, len))) {
+            die("%s", "round trip mismatch");
+        }
+        packed += b->packed_size[i];
+        pos += len;
+    }
+}
+
+/* Скорость прохода, MB/s: проходы повторяются BENCH_SECONDS */
+static double bench_rate(struct bench* b, bool stream, bool compress) {
+    uint64_t passes = 0;
+    double start = now();
+    double elapsed;
+    do {
+        if (compress) {
+            bench_compress(b, stream);
+        } else {
+            bench_decompress(b, stream, false);
+        }
+        passes++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+    return (double)passes * (double)b->size / elapsed / 1e6;
+}
+
+static void bench(const char* path) {
+    static struct bench b;
+    uint8_t* raw = read_file(path, &b.size);
+    if (!b.size) {
+        die("%s: empty file", path);
+    }
+    b.src = raw;
+    b.nr_blocks = (b.size + BENCH_BLOCK - 1) / BENCH_BLOCK;
+    b.packed = xmalloc(LZ4_COMPRESS_BOUND(BENCH_BLOCK) * b.nr_blocks);
+    b.packed_size = xmalloc(b.nr_blocks * sizeof(uint32_t));
+
+    printf("%s: %zu KiB in 4 KiB blocks\n", path, b.size / 1024);
+    for (int stream = 0; stream <= 1; stream++) {
+        size_t packed = bench_compress(&b, stream);
+        bench_decompress(&b, stream, true);
+        double compress = bench_rate(&b, stream, true);
+        double decompress = bench_rate(&b, stream, false);
+        printf("  %-7s ratio %.3f, compress %.0f MB/s, decompress %.0f MB/s\n",
+               stream ? "stream:" : "block:", (double)packed / (double)b.size, compress,
+               decompress);
+    }
+    free(b.packed_size);
+    free(b.packed);
+    free(raw);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: lz4pack image output\n       lz4pack -s image\n"
+                    "       lz4pack -b file\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+        report(argv[2]);
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[1], "-b") == 0) {
+        bench(argv[2]);
+        return 0;
+    }
+    if (argc != 3) {
+        usage();
+    }
+
+    size_t raw_size;
+    uint8_t* raw = read_file(argv[1], &raw_size);
+    uint8_t* packed;
+    size_t packed_size = pack(raw, raw_size, &packed);
+
+    struct lz4pack_header header = {
+        .magic = LZ4PACK_MAGIC,
+        .raw_size = (uint32_t)raw_size,
+        .packed_size = (uint32_t)packed_size,
+    };
+    FILE* f = fopen(argv[2], "wb");
+    if (!f) {
+        die("cannot create %s", argv[2]);
+    }
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+        fwrite(packed, 1, packed_size, f) != packed_size || fclose(f) != 0) {
+        die("cannot write %s", argv[2]);
+    }
+    free(packed);
+    free(raw);
+    return 0;
+}
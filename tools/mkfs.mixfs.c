@@ -0,0 +1,483 @@
+/*
+ * ============================================================================
+ * MixOS - tools/mkfs.mixfs.c
+ * Создание образа MixFS на хосте
+ *
+ *   mkfs.mixfs [-s размер] [-L метка] [-d каталог] образ
+ *
+ * Размер задаётся в байтах с суффиксом K/M/G; без -s используется размер
+ * существующего файла. С -d в образ копируется дерево каталога хоста
+ * (обычные файлы и каталоги). Данные файлов размещаются подряд от начала
+ * области данных, затем дерево строится снизу вверх из отсортированных
+ * элементов с плотно заполненными листьями.
+ * ============================================================================
+ */
+
+#define _DEFAULT_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fs/mixfs/mixfs_fs.h"
+
+/* Генерация образа: все узлы создаются в транзакции 1 */
+#define MKFS_GENERATION 1
+
+struct item {
+    struct mixfs_key key;
+    uint8_t* data;
+    uint32_t size;
+};
+
+static struct {
+    int fd;
+    uint64_t total_blocks;
+    uint64_t map_blocks;
+    uint64_t next_block;            /* Следующий свободный блок (выделение подряд) */
+    uint64_t next_ino;
+    uint64_t now;
+
+    struct item* items;
+    size_t nr_items;
+    size_t cap_items;
+} mkfs;
+
+static void die(const char* fmt, const char* arg) {
+    fprintf(stderr, "mkfs.mixfs: ");
+    fprintf(stderr, fmt, arg);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void* xmalloc(size_t size) {
+    void* ptr = calloc(1, size ? size : 1);
+    if (!ptr) {
+        die("%s", "out of memory");
+    }
+    return ptr;
+}
+
+static void write_block(uint64_t block, const void* data) {
+    if (pwrite(mkfs.fd, data, MIXFS_BLOCK_SIZE, (off_t)(block * MIXFS_BLOCK_SIZE)) !=
+        MIXFS_BLOCK_SIZE) {
+        die("write failed: %s", strerror(errno));
+    }
+}
+
+static uint64_t alloc_blocks(uint64_t count) {
+    if (mkfs.next_block + count > mkfs.total_blocks) {
+        die("%s", "image is too small for the source tree");
+    }
+    uint64_t block = mkfs.next_block;
+    mkfs.next_block += count;
+    return block;
+}
+
+/* ============================================================================
+ * Элементы дерева
+ * ============================================================================ */
+
+static void add_item(uint64_t objectid, uint8_t type, uint64_t offset,
+                     const void* data, uint32_t size) {
+    if (mkfs.nr_items == mkfs.cap_items) {
+        mkfs.cap_items = mkfs.cap_items ? mkfs.cap_items * 2 : 256;
+        mkfs.items = realloc(mkfs.items, mkfs.cap_items * sizeof(struct item));
+        if (!mkfs.items) {
+            die("%s", "out of memory");
+        }
+    }
+    struct item* item = &mkfs.items[mkfs.nr_items++];
+    mixfs_set_key(&item->key, objectid, type, offset);
+    item->data = xmalloc(size);
+    memcpy(item->data, data, size);
+    item->size = size;
+}
+
+static int item_cmp(const void* a, const void* b) {
+    return mixfs_key_cmp(&((const struct item*)a)->key, &((const struct item*)b)->key);
+}
+
+/* DIR_ITEM с одинаковым хешем объединяются в один элемент */
+static void merge_items(void) {
+    size_t out = 0;
+    for (size_t i = 0; i < mkfs.nr_items; i++) {
+        struct item* item = &mkfs.items[i];
+        if (out && mixfs_key_cmp(&mkfs.items[out - 1].key, &item->key) == 0) {
+            struct item* prev = &mkfs.items[out - 1];
+            if (item->key.type != MIXFS_DIR_ITEM || prev->size + item->size > MIXFS_MAX_ITEM_SIZE) {
+                die("%s", "too many names with the same hash");
+            }
+            prev->data = realloc(prev->data, prev->size + item->size);
+            memcpy(prev->data + prev->size, item->data, item->size);
+            prev->size += item->size;
+            free(item->data);
+            continue;
+        }
+        mkfs.items[out++] = *item;
+    }
+    mkfs.nr_items = out;
+}
+
+static void add_inode(uint64_t ino, uint32_t mode, uint32_t nlink, uint64_t size,
+                      uint64_t blocks, uint64_t parent, uint64_t next_index, uint64_t mtime) {
+    struct mixfs_inode_item inode;
+    memset(&inode, 0, sizeof(inode));
+    inode.mode = mode;
+    inode.nlink = nlink;
+    inode.size = size;
+    inode.blocks = blocks;
+    inode.atime = inode.mtime = inode.ctime = mtime;
+    inode.generation = MKFS_GENERATION;
+    inode.parent = parent;
+    inode.next_index = next_index;
+    add_item(ino, MIXFS_INODE_ITEM, 0, &inode, sizeof(inode));
+}
+
+static void add_dir_entry(uint64_t dir, uint64_t index, const char* name, uint64_t ino,
+                          uint8_t type) {
+    size_t len = strlen(name);
+    uint32_t rec_len = MIXFS_DIR_ENTRY_LEN(len);
+    struct mixfs_dir_entry* de = xmalloc(rec_len);
+    de->ino = ino;
+    de->index = index;
+    de->name_len = (uint16_t)len;
+    de->type = type;
+    memcpy(de->name, name, len);
+    add_item(dir, MIXFS_DIR_ITEM, mixfs_name_hash(name, len), de, rec_len);
+    add_item(dir, MIXFS_DIR_INDEX, index, de, rec_len);
+    free(de);
+}
+
+/* ============================================================================
+ * Копирование каталога хоста
+ * ============================================================================ */
+
+static uint64_t copy_file(const char* path, uint64_t ino, uint64_t size) {
+    uint64_t nr_blocks = DIV_ROUND_UP(size, MIXFS_BLOCK_SIZE);
+    if (nr_blocks == 0) {
+        return 0;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        die("cannot open %s", path);
+    }
+    uint64_t start = alloc_blocks(nr_blocks);
+    uint8_t block[MIXFS_BLOCK_SIZE];
+    for (uint64_t i = 0; i < nr_blocks; i++) {
+        memset(block, 0, sizeof(block));
+        if (read(fd, block, sizeof(block)) < 0) {
+            die("cannot read %s", path);
+        }
+        write_block(start + i, block);
+    }
+    close(fd);
+
+    struct mixfs_extent_item extent = { .disk_block = start, .nr_blocks = nr_blocks };
+    add_item(ino, MIXFS_EXTENT_ITEM, 0, &extent, sizeof(extent));
+    return nr_blocks;
+}
+
+/* Рекурсивное копирование каталога; nlink каталога = 2 + число подкаталогов */
+static void copy_dir(const char* path, uint64_t ino, uint64_t parent, uint64_t mtime) {
+    DIR* dir = opendir(path);
+    if (!dir) {
+        die("cannot open directory %s", path);
+    }
+
+    uint64_t index = MIXFS_FIRST_DIR_INDEX;
+    uint32_t subdirs = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        if (strlen(ent->d_name) > MIXFS_NAME_MAX) {
+            die("name too long: %s", ent->d_name);
+        }
+        char child[4096];
+        snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+        struct stat st;
+        if (lstat(child, &st) < 0) {
+            die("cannot stat %s", child);
+        }
+
+        uint64_t child_ino = mkfs.next_ino;
+        if (S_ISDIR(st.st_mode)) {
+            mkfs.next_ino++;
+            add_dir_entry(ino, index++, ent->d_name, child_ino, MIXFS_FT_DIR);
+            copy_dir(child, child_ino, ino, (uint64_t)st.st_mtime);
+            subdirs++;
+        } else if (S_ISREG(st.st_mode)) {
+            mkfs.next_ino++;
+            add_dir_entry(ino, index++, ent->d_name, child_ino, MIXFS_FT_REG);
+            uint64_t blocks = copy_file(child, child_ino, (uint64_t)st.st_size);
+            add_inode(child_ino, S_IFREG | (st.st_mode & 07777), 1, (uint64_t)st.st_size,
+                      blocks, 0, 0, (uint64_t)st.st_mtime);
+        } else {
+            fprintf(stderr, "mkfs.mixfs: skipping %s (unsupported file type)\n", child);
+        }
+    }
+    closedir(dir);
+
+    add_inode(ino, S_IFDIR | 0755, 2 + subdirs, index - MIXFS_FIRST_DIR_INDEX, 0, parent, index,
+              mtime);
+}
+
+/* ============================================================================
+ * Построение дерева
+ * ============================================================================ */
+
+struct node_ref {
+    struct mixfs_key key;           /* Наименьший ключ узла */
+    uint64_t blocknr;
+};
+
+static void finish_node(uint8_t* node, uint64_t blocknr, uint8_t level, uint16_t nritems) {
+    struct mixfs_node_header* header = (struct mixfs_node_header*)node;
+    header->magic = MIXFS_NODE_MAGIC;
+    header->blocknr = blocknr;
+    header->generation = MKFS_GENERATION;
+    header->nritems = nritems;
+    header->level = level;
+    header->csum = mixfs_block_csum(node);
+    write_block(blocknr, node);
+}
+
+/* Листья из отсортированных элементов; возвращает число листьев */
+static size_t build_leaves(struct node_ref** refs) {
+    size_t cap = 16, count = 0;
+    *refs = xmalloc(cap * sizeof(struct node_ref));
+
+    uint8_t node[MIXFS_BLOCK_SIZE];
+    size_t i = 0;
+    do {
+        memset(node, 0, sizeof(node));
+        struct mixfs_item* items = mixfs_leaf_items(node);
+        uint32_t data_end = MIXFS_BLOCK_SIZE;
+        uint16_t n = 0;
+        while (i < mkfs.nr_items) {
+            struct item* item = &mkfs.items[i];
+            uint32_t header_end = (uint32_t)(sizeof(struct mixfs_node_header) +
+                                             (n + 1) * sizeof(struct mixfs_item));
+            if (header_end + item->size > data_end) {
+                break;
+            }
+            data_end -= item->size;
+            items[n].key = item->key;
+            items[n].offset = data_end;
+            items[n].size = item->size;
+            memcpy(node + data_end, item->data, item->size);
+            n++;
+            i++;
+        }
+
+        uint64_t blocknr = alloc_blocks(1);
+        if (count == cap) {
+            cap *= 2;
+            *refs = realloc(*refs, cap * sizeof(struct node_ref));
+        }
+        (*refs)[count].key = n ? items[0].key : (struct mixfs_key){ 0 };
+        (*refs)[count].blocknr = blocknr;
+        count++;
+        finish_node(node, blocknr, 0, n);
+    } while (i < mkfs.nr_items);
+    return count;
+}
+
+/* Уровень внутренних узлов над refs; refs заменяется ссылками нового уровня */
+static size_t build_level(struct node_ref* refs, size_t count, uint8_t level) {
+    /* Узлы заполняются на 3/4, чтобы первые вставки не делили их сразу */
+    size_t per_node = MIXFS_NODE_PTRS * 3 / 4;
+    size_t out = 0;
+    uint8_t node[MIXFS_BLOCK_SIZE];
+
+    for (size_t i = 0; i < count; ) {
+        size_t n = MIN(per_node, count - i);
+        /* Последний узел не оставляем слишком маленьким */
+        if (count - i - n > 0 && count - i - n < per_node / 2) {
+            n = (count - i) / 2;
+        }
+        memset(node, 0, sizeof(node));
+        struct mixfs_ptr* ptrs = mixfs_node_ptrs(node);
+        for (size_t j = 0; j < n; j++) {
+            ptrs[j].key = refs[i + j].key;
+            ptrs[j].blocknr = refs[i + j].blocknr;
+            ptrs[j].generation = MKFS_GENERATION;
+        }
+        uint64_t blocknr = alloc_blocks(1);
+        struct mixfs_key first = refs[i].key;
+        finish_node(node, blocknr, level, (uint16_t)n);
+        refs[out].key = first;
+        refs[out].blocknr = blocknr;
+        out++;
+        i += n;
+    }
+    return out;
+}
+
+/* ============================================================================
+ * Карта места и суперблок
+ * ============================================================================ */
+
+static void write_space_map(void) {
+    uint64_t words = mkfs.map_blocks * MIXFS_MAP_WORDS;
+    uint64_t* map = xmalloc(words * sizeof(uint64_t));
+    for (uint64_t block = 0; block < words * 64; block++) {
+        if (block < mkfs.next_block || block >= mkfs.total_blocks) {
+            map[block / 64] |= 1ULL << (block % 64);
+        }
+    }
+
+    uint8_t buf[MIXFS_BLOCK_SIZE];
+    for (uint32_t copy = 0; copy < 2; copy++) {
+        for (uint64_t i = 0; i < mkfs.map_blocks; i++) {
+            memset(buf, 0, sizeof(buf));
+            struct mixfs_map_header* header = (struct mixfs_map_header*)buf;
+            header->magic = MIXFS_MAP_MAGIC;
+            header->index = (uint32_t)i;
+            header->copy = copy;
+            memcpy(header + 1, &map[i * MIXFS_MAP_WORDS], MIXFS_MAP_BYTES);
+            header->csum = mixfs_block_csum(buf);
+            write_block(mixfs_map_block(mkfs.map_blocks, copy) + i, buf);
+        }
+    }
+    free(map);
+}
+
+static void write_super(uint64_t root, uint32_t root_level, const char* label) {
+    uint8_t buf[MIXFS_BLOCK_SIZE];
+    memset(buf, 0, sizeof(buf));
+    /* Копия для чётного поколения стирается: в ней мог остаться старый том */
+    write_block(MIXFS_SUPER_BLOCK, buf);
+
+    struct mixfs_super_block* super = (struct mixfs_super_block*)buf;
+    super->magic = MIXFS_MAGIC;
+    super->version = MIXFS_VERSION;
+    super->block_size = MIXFS_BLOCK_SIZE;
+    super->generation = MKFS_GENERATION;
+    super->total_blocks = mkfs.total_blocks;
+    super->free_blocks = mkfs.total_blocks - mkfs.next_block;
+    super->root = root;
+    super->map_blocks = mkfs.map_blocks;
+    super->next_ino = mkfs.next_ino;
+    super->root_level = root_level;
+    super->active_map = 0;
+    super->mkfs_time = mkfs.now;
+    super->commit_time = mkfs.now;
+    for (size_t i = 0; i < sizeof(super->uuid); i++) {
+        super->uuid[i] = (uint8_t)rand();
+    }
+    strncpy(super->label, label, sizeof(super->label) - 1);
+    super->csum = mixfs_super_csum(super);
+    write_block(MIXFS_SUPER_BLOCK + MKFS_GENERATION % 2, buf);
+}
+
+/* ============================================================================
+ * main
+ * ============================================================================ */
+
+static uint64_t parse_size(const char* arg) {
+    char* end;
+    uint64_t size = strtoull(arg, &end, 0);
+    switch (*end) {
+    case 'G': case 'g': size <<= 10; /* fallthrough */
+    case 'M': case 'm': size <<= 10; /* fallthrough */
+    case 'K': case 'k': size <<= 10; end++; break;
+    default: break;
+    }
+    if (*end != '\0' || size == 0) {
+        die("invalid size: %s", arg);
+    }
+    return size;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: mkfs.mixfs [-s size[K|M|G]] [-L label] [-d srcdir] image\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = 0;
+    const char* label = "";
+    const char* source = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:L:d:")) != -1) {
+        switch (opt) {
+        case 's': size = parse_size(optarg); break;
+        case 'L': label = optarg; break;
+        case 'd': source = optarg; break;
+        default: usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+    const char* image = argv[optind];
+
+    mkfs.fd = open(image, O_RDWR | O_CREAT, 0644);
+    if (mkfs.fd < 0) {
+        die("cannot open %s", image);
+    }
+    if (size) {
+        if (ftruncate(mkfs.fd, (off_t)size) < 0) {
+            die("cannot resize %s", image);
+        }
+    } else {
+        struct stat st;
+        fstat(mkfs.fd, &st);
+        size = (uint64_t)st.st_size;
+    }
+
+    mkfs.total_blocks = size / MIXFS_BLOCK_SIZE;
+    mkfs.map_blocks = mixfs_map_blocks(mkfs.total_blocks);
+    mkfs.next_block = mixfs_first_data_block(mkfs.map_blocks);
+    if (mkfs.next_block + 16 > mkfs.total_blocks) {
+        die("%s", "image is too small");
+    }
+    mkfs.next_ino = MIXFS_FIRST_INO;
+    mkfs.now = (uint64_t)time(NULL);
+    srand((unsigned)mkfs.now ^ (unsigned)getpid());
+
+    if (source) {
+        struct stat st;
+        if (stat(source, &st) < 0 || !S_ISDIR(st.st_mode)) {
+            die("not a directory: %s", source);
+        }
+        copy_dir(source, MIXFS_ROOT_INO, MIXFS_ROOT_INO, mkfs.now);
+    } else {
+        add_inode(MIXFS_ROOT_INO, S_IFDIR | 0755, 2, 0, 0, MIXFS_ROOT_INO,
+                  MIXFS_FIRST_DIR_INDEX, mkfs.now);
+    }
+
+    qsort(mkfs.items, mkfs.nr_items, sizeof(struct item), item_cmp);
+    merge_items();
+
+    struct node_ref* refs;
+    size_t count = build_leaves(&refs);
+    uint8_t level = 0;
+    while (count > 1) {
+        if (++level >= MIXFS_MAX_LEVEL) {
+            die("%s", "tree is too deep");
+        }
+        count = build_level(refs, count, level);
+    }
+
+    write_space_map();
+    write_super(refs[0].blocknr, level, label);
+    free(refs);
+
+    if (fsync(mkfs.fd) < 0 || close(mkfs.fd) < 0) {
+        die("cannot write %s", image);
+    }
+    printf("mkfs.mixfs: %s: %llu blocks, %llu used, %llu inodes\n", image,
+           (unsigned long long)mkfs.total_blocks, (unsigned long long)mkfs.next_block,
+           (unsigned long long)(mkfs.next_ino - 1));
+    return 0;
+}
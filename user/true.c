@@ -0,0 +1,17 @@
+/*
+ * ============================================================================
+ * MixOS - user/true.c
+ * Программа для замеров fork+exec (make bench)
+ *
+ * Системных вызовов пока нет, и ядро пользовательские задачи не
+ * запускает: замер включает создание задачи и загрузку ELF, но не
+ * выполнение. Собирается как static-pie (ET_DYN), такие программы
+ * загрузчик размещает с ELF_ET_DYN_BASE.
+ * ============================================================================
+ */
+
+void _start(void) {
+    for (;;) {
+        __asm__ volatile ("pause");
+    }
+}